@@ -1,153 +1,451 @@
 #include "KDTree.h"
 #include <algorithm>
-#include <cassert>
+#include <cstring>
+#include <exception>
 #include <fstream>
-#include <iostream>
-#include <list>
+#include <limits>
+#include <utility>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include "Controller/Controller.h"
+#include "EndianConvert.h"
 
 using namespace tuvok;
 
-class splitElem {
-public:
-  splitElem(double p=0) : pos(p), n1count(0), n2count(0) {}
-  double pos;
-  size_t n1count;
-  size_t n2count;
+namespace {
+  static_assert(sizeof(KDTreeNode) == 8, "nodes are saved as two words");
+
+  // bounding box of a triangle, computed once for the whole build
+  struct TriBounds {
+    FLOATVECTOR3 min;
+    FLOATVECTOR3 max;
+  };
+
+  // split planes are placed between BIN_COUNT equally wide bins per axis
+  enum { BIN_COUNT = 32 };
+  struct Bins {
+    uint32_t minCount[3][BIN_COUNT];  // triangles starting in each bin
+    uint32_t maxCount[3][BIN_COUNT];  // triangles ending in each bin
+  };
+
+  // nodes with this few triangles are not split any further
+  const size_t LEAF_SIZE = 2;
+  // nodes with more triangles are binned and partitioned on all threads
+  const size_t PARALLEL_SIZE = 1 << 16;
+  // cost of a traversal step relative to one triangle test
+  const double TRAVERSAL_COST = 0.3;
+
+  // "KDT" followed by a format version
+  const uint32_t KDTREE_MAGIC = 0x0054444B;
+  const uint32_t KDTREE_VERSION = 1;
+
+  int ChunkCount(bool bParallel) {
+#ifdef _OPENMP
+    return bParallel ? omp_get_max_threads() : 1;
+#else
+    (void)bParallel;
+    return 1;
+#endif
+  }
+
+  double HalfArea(const FLOATVECTOR3& size) {
+    return double(size.x)*size.y + double(size.y)*size.z +
+           double(size.x)*size.z;
+  }
+
+  // Finds the cheapest plane between the bins of any axis and splits the
+  // triangle list there, a triangle goes left if it reaches down to the
+  // plane and right if it reaches beyond.  Returns false if the node is
+  // cheaper to keep as a leaf.
+  bool SplitNode(const std::vector<TriBounds>& bounds, const triVec& tris,
+                 const FLOATVECTOR3& min, const FLOATVECTOR3& max,
+                 unsigned int depth, bool bParallel,
+                 unsigned char& axis, float& pos,
+                 triVec& left, triVec& right) {
+    const size_t n = tris.size();
+    if (depth == 0 || n <= LEAF_SIZE) return false;
+
+    const FLOATVECTOR3 size = max - min;
+    const double fHalfArea = HalfArea(size);
+    if (!(fHalfArea > 0)) return false;
+
+    FLOATVECTOR3 binScale;
+    for (size_t a = 0;a<3;a++)
+      binScale[a] = size[a] > 0 ? float(BIN_COUNT) / size[a] : 0.0f;
+
+    // bin the triangle bounds, every chunk into its own bins
+    const int iChunks = ChunkCount(bParallel && n > PARALLEL_SIZE);
+    Bins localBins;
+    std::vector<Bins> chunkBins(iChunks > 1 ? iChunks : 0);
+#pragma omp parallel for if(iChunks > 1)
+    for (int c = 0;c<iChunks;c++) {
+      Bins& bins = iChunks > 1 ? chunkBins[c] : localBins;
+      memset(&bins, 0, sizeof(Bins));
+      const size_t iEnd = n*(c+1)/iChunks;
+      for (size_t i = n*c/iChunks;i<iEnd;i++) {
+        const TriBounds& b = bounds[tris[i]];
+        for (size_t a = 0;a<3;a++) {
+          const int iMin = int((b.min[a] - min[a]) * binScale[a]);
+          const int iMax = int((b.max[a] - min[a]) * binScale[a]);
+          bins.minCount[a][std::min(std::max(iMin, 0), BIN_COUNT-1)]++;
+          bins.maxCount[a][std::min(std::max(iMax, 0), BIN_COUNT-1)]++;
+        }
+      }
+    }
+    for (int c = 1;c<iChunks;c++) {
+      for (size_t a = 0;a<3;a++) {
+        for (size_t k = 0;k<BIN_COUNT;k++) {
+          chunkBins[0].minCount[a][k] += chunkBins[c].minCount[a][k];
+          chunkBins[0].maxCount[a][k] += chunkBins[c].maxCount[a][k];
+        }
+      }
+    }
+    const Bins& bins = iChunks > 1 ? chunkBins[0] : localBins;
+
+    // sweep the planes between the bins
+    double minCost = std::numeric_limits<double>::max();
+    size_t nBestLeft = 0, nBestRight = 0;
+    for (unsigned char a = 0;a<3;a++) {
+      if (size[a] <= 0) continue;
+      size_t nLeft = 0;
+      size_t nRight = n;
+      for (size_t k = 1;k<BIN_COUNT;k++) {
+        nLeft  += bins.minCount[a][k-1];
+        nRight -= bins.maxCount[a][k-1];
+        const float p = min[a] + size[a] * float(k) / float(BIN_COUNT);
+        FLOATVECTOR3 b1 = size;  b1[a] = p - min[a];
+        FLOATVECTOR3 b2 = size;  b2[a] = max[a] - p;
+        const double cost = TRAVERSAL_COST +
+          (HalfArea(b1) * double(nLeft) + HalfArea(b2) * double(nRight)) /
+          fHalfArea;
+        if (cost < minCost) {
+          minCost = cost;
+          axis = a;
+          pos = p;
+          nBestLeft = nLeft;
+          nBestRight = nRight;
+        }
+      }
+    }
+    // if splitting makes things worse -> stop
+    if (minCost >= double(n)) return false;
+
+    if (iChunks == 1) {
+      left.reserve(nBestLeft);
+      right.reserve(nBestRight);
+      for (size_t i = 0;i<n;i++) {
+        const TriBounds& b = bounds[tris[i]];
+        if (b.min[axis] <= pos) left.push_back(tris[i]);
+        if (b.max[axis] > pos) right.push_back(tris[i]);
+      }
+    } else {
+      // count per chunk first so that every chunk knows where to write its
+      // part of the two lists
+      std::vector<size_t> leftStart(iChunks+1, 0), rightStart(iChunks+1, 0);
+#pragma omp parallel for
+      for (int c = 0;c<iChunks;c++) {
+        size_t nLeft = 0, nRight = 0;
+        const size_t iEnd = n*(c+1)/iChunks;
+        for (size_t i = n*c/iChunks;i<iEnd;i++) {
+          const TriBounds& b = bounds[tris[i]];
+          if (b.min[axis] <= pos) nLeft++;
+          if (b.max[axis] > pos) nRight++;
+        }
+        leftStart[c+1] = nLeft;
+        rightStart[c+1] = nRight;
+      }
+      for (int c = 0;c<iChunks;c++) {
+        leftStart[c+1] += leftStart[c];
+        rightStart[c+1] += rightStart[c];
+      }
+      left.resize(leftStart[iChunks]);
+      right.resize(rightStart[iChunks]);
+#pragma omp parallel for
+      for (int c = 0;c<iChunks;c++) {
+        size_t iLeft = leftStart[c], iRight = rightStart[c];
+        const size_t iEnd = n*(c+1)/iChunks;
+        for (size_t i = n*c/iChunks;i<iEnd;i++) {
+          const TriBounds& b = bounds[tris[i]];
+          if (b.min[axis] <= pos) left[iLeft++] = tris[i];
+          if (b.max[axis] > pos) right[iRight++] = tris[i];
+        }
+      }
+    }
+    // binning is approximate, make sure the split gets somewhere
+    if (left.size() == n && right.size() == n) return false;
+    return true;
+  }
 
-  bool operator<(const splitElem& other) const {
-    return pos < other.pos;
+  // builds a subtree on one thread, with its root at nodes[iNode]
+  void BuildSubtree(const std::vector<TriBounds>& bounds, triVec& tris,
+                    const FLOATVECTOR3& min, const FLOATVECTOR3& max,
+                    unsigned int depth, uint32_t iNode,
+                    std::vector<KDTreeNode>& nodes, triVec& leafTris) {
+    unsigned char axis = 0;
+    float pos = 0;
+    triVec left, right;
+    if (!SplitNode(bounds, tris, min, max, depth, false,
+                   axis, pos, left, right)) {
+      nodes[iNode] = KDTreeNode::Leaf(uint32_t(leafTris.size()),
+                                      uint32_t(tris.size()));
+      leafTris.insert(leafTris.end(), tris.begin(), tris.end());
+      return;
+    }
+    triVec().swap(tris);
+
+    const uint32_t iChildren = uint32_t(nodes.size());
+    nodes[iNode] = KDTreeNode::Inner(axis, pos, iChildren);
+    nodes.resize(nodes.size()+2);
+
+    FLOATVECTOR3 max1 = max; max1[axis] = pos;
+    FLOATVECTOR3 min2 = min; min2[axis] = pos;
+    BuildSubtree(bounds, left, min, max1, depth-1, iChildren,
+                 nodes, leafTris);
+    BuildSubtree(bounds, right, min2, max, depth-1, iChildren+1,
+                 nodes, leafTris);
+  }
+
+  // a node of the upper levels that is still to be split
+  struct BuildJob {
+    uint32_t     iNode;
+    triVec       tris;
+    FLOATVECTOR3 min;
+    FLOATVECTOR3 max;
+    unsigned int depth;
+  };
+
+  bool LargerJob(const BuildJob& a, const BuildJob& b) {
+    return a.tris.size() > b.tris.size();
   }
-};
 
-typedef std::vector<splitElem> slist;
-typedef std::pair<double, double> dPair;
+  template<typename T>
+  void WriteLE(std::ostream& s, const T* data, size_t count) {
+    if (EndianConvert::IsLittleEndian()) {
+      s.write(reinterpret_cast<const char*>(data), sizeof(T)*count);
+    } else {
+      for (size_t i = 0;i<count;i++) {
+        const T v = EndianConvert::Swap(data[i]);
+        s.write(reinterpret_cast<const char*>(&v), sizeof(T));
+      }
+    }
+  }
 
-typedef std::vector< dPair > eventVec;
-bool compMin(const dPair& a, const dPair& b) {return a.first < b.first;}
-bool compMax(const dPair& a, const dPair& b) {return a.second < b.second;}
-bool compFirst(const dPair& a, const double b) {return a.second < b;}
+  template<typename T>
+  bool ReadLE(std::istream& s, T* data, size_t count) {
+    s.read(reinterpret_cast<char*>(data), sizeof(T)*count);
+    if (EndianConvert::IsBigEndian())
+      for (size_t i = 0;i<count;i++) EndianConvert::SwapSitu(&data[i]);
+    return !s.fail();
+  }
 
+  uint64_t TriangleCount(const Mesh* mesh) {
+    if (mesh->GetMeshType() != Mesh::MT_TRIANGLES) return 0;
+    return mesh->GetVertexIndices().size() / 3;
+  }
+}
 
 KDTree::KDTree(Mesh* mesh, const std::string& filename, unsigned int maxDepth) :
   m_mesh(mesh),
-  m_maxDepth(maxDepth),
-  m_Root(0)
+  m_maxDepth(maxDepth)
 {
   if (filename != "") {
     // try to load kd from disk if filename is given
-    std::ifstream kdfile;
-	  kdfile.open(filename.c_str());
+    std::ifstream kdfile(filename.c_str(), std::ios::binary);
     if (kdfile.is_open()) {
-      std::cout << "Loading KD-Tree " << filename << std::endl;
-      kdfile >> m_maxDepth;
-      m_Root = new KDTreeNode(kdfile);
-      kdfile.close();
-      std::cout << "Done" << std::endl;
-      return;
+      if (Load(kdfile)) {
+        MESSAGE("Loaded KD-Tree %s", filename.c_str());
+        return;
+      }
+      WARNING("%s does not hold a KD-Tree of this mesh, rebuilding it",
+              filename.c_str());
     }
   }
-  assert(m_maxDepth>0);
 
-  std::cout << "Generating KD-Tree" << std::endl;
-  m_Root = new KDTreeNode();
-	for ( size_t e = 0; e < m_mesh->m_Data.m_VertIndices.size(); e++ ) m_Root->Add( e );
-  Subdivide( m_Root, DOUBLEVECTOR3(m_mesh->m_Bounds[0]),
-                     DOUBLEVECTOR3(m_mesh->m_Bounds[1]), m_maxDepth );
-  std::cout << "Done" << std::endl;
+  m_maxDepth = std::min<unsigned int>(m_maxDepth, MAX_DEPTH);
+
+  Build();
+  MESSAGE("Built a KD-Tree of %u nodes with %u triangle references",
+          unsigned(m_Nodes.size()), unsigned(m_Triangles.size()));
 
   if (filename != "") {
-    std::cout << "Saving KD-Tree " << filename << std::endl;
-    std::ofstream kdfile;
-	  kdfile.open(filename.c_str());
-    if (kdfile.is_open()) {
-      kdfile << m_maxDepth << std::endl;
-      m_Root->Save(kdfile);
-      kdfile.close();
-    }
-    std::cout << "Done" << std::endl;
+    std::ofstream kdfile(filename.c_str(), std::ios::binary);
+    if (!kdfile.is_open() || !Save(kdfile))
+      WARNING("Could not save the KD-Tree to %s", filename.c_str());
   }
 }
 
 KDTree::~KDTree(void)
 {
-  delete m_Root;  
 }
 
-#include <iostream>
+void KDTree::Build() {
+  m_Bounds[0] = m_mesh->m_Bounds[0];
+  m_Bounds[1] = m_mesh->m_Bounds[1];
+  m_Nodes.clear();
+  m_Triangles.clear();
 
-struct StackElem {
-  KDTreeNode* node;  // pointer to far child 
-  double t;          // the entry/exit signed distance 
-  DOUBLEVECTOR3 pb;          // the coordinates of entry/exit point 
-  int prev;          // the pointer to the previous stack item 
-};
+  const int iTriCount = int(TriangleCount(m_mesh));
+  if (iTriCount == 0) {
+    m_Nodes.push_back(KDTreeNode::Leaf(0, 0));
+    return;
+  }
+
+  const VertVec& vertices = m_mesh->m_Data.m_vertices;
+  const IndexVec& indices = m_mesh->m_Data.m_VertIndices;
+  std::vector<TriBounds> bounds(iTriCount);
+  BuildJob root;
+  root.iNode = 0;
+  root.tris.resize(iTriCount);
+  root.min = m_Bounds[0];
+  root.max = m_Bounds[1];
+  root.depth = m_maxDepth;
+#pragma omp parallel for
+  for (int t = 0;t<iTriCount;t++) {
+    const FLOATVECTOR3& v0 = vertices[indices[size_t(t)*3+0]];
+    const FLOATVECTOR3& v1 = vertices[indices[size_t(t)*3+1]];
+    const FLOATVECTOR3& v2 = vertices[indices[size_t(t)*3+2]];
+    for (size_t a = 0;a<3;a++) {
+      bounds[t].min[a] = std::min(v0[a], std::min(v1[a], v2[a]));
+      bounds[t].max[a] = std::max(v0[a], std::max(v1[a], v2[a]));
+    }
+    root.tris[t] = uint32_t(t);
+  }
+
+  // split the upper levels one node at a time with all threads working on
+  // each node, until the nodes are small enough to hand one to each thread
+  const size_t iSubtreeSize = std::max<size_t>(PARALLEL_SIZE / 16,
+                                    size_t(iTriCount) / (8*ChunkCount(true)));
+  std::vector<BuildJob> pending, subtrees;
+  m_Nodes.resize(1);
+  pending.push_back(std::move(root));
+  while (!pending.empty()) {
+    BuildJob job = std::move(pending.back());
+    pending.pop_back();
+    if (job.tris.size() <= iSubtreeSize) {
+      subtrees.push_back(std::move(job));
+      continue;
+    }
+
+    unsigned char axis = 0;
+    float pos = 0;
+    BuildJob left, right;
+    if (!SplitNode(bounds, job.tris, job.min, job.max, job.depth, true,
+                   axis, pos, left.tris, right.tris)) {
+      m_Nodes[job.iNode] = KDTreeNode::Leaf(uint32_t(m_Triangles.size()),
+                                            uint32_t(job.tris.size()));
+      m_Triangles.insert(m_Triangles.end(), job.tris.begin(), job.tris.end());
+      continue;
+    }
+
+    const uint32_t iChildren = uint32_t(m_Nodes.size());
+    m_Nodes[job.iNode] = KDTreeNode::Inner(axis, pos, iChildren);
+    m_Nodes.resize(m_Nodes.size()+2);
+
+    left.iNode  = iChildren;
+    left.min    = job.min;
+    left.max    = job.max;  left.max[axis] = pos;
+    left.depth  = job.depth-1;
+    right.iNode = iChildren+1;
+    right.min   = job.min;  right.min[axis] = pos;
+    right.max   = job.max;
+    right.depth = job.depth-1;
+    pending.push_back(std::move(left));
+    pending.push_back(std::move(right));
+  }
+
+  // build the subtrees in parallel, largest first
+  std::sort(subtrees.begin(), subtrees.end(), LargerJob);
+  std::vector< std::vector<KDTreeNode> > subNodes(subtrees.size());
+  std::vector<triVec> subTris(subtrees.size());
+  std::exception_ptr pError;
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0;i<int(subtrees.size());i++) {
+    try {
+      subNodes[i].resize(1);
+      BuildSubtree(bounds, subtrees[i].tris, subtrees[i].min,
+                   subtrees[i].max, subtrees[i].depth, 0,
+                   subNodes[i], subTris[i]);
+    } catch (...) {
+#pragma omp critical (KDTreeBuildError)
+      { if (!pError) pError = std::current_exception(); }
+    }
+  }
+  if (pError) std::rethrow_exception(pError);
+
+  // and append them, every subtree in one block of nodes
+  for (size_t i = 0;i<subtrees.size();i++) {
+    // local node 1 goes to the current end of the array
+    const uint32_t iNodeOffset = uint32_t(m_Nodes.size()) - 1;
+    const uint32_t iTriOffset = uint32_t(m_Triangles.size());
+    for (size_t j = 0;j<subNodes[i].size();j++)
+      subNodes[i][j].Relocate(iNodeOffset, iTriOffset);
+    m_Nodes[subtrees[i].iNode] = subNodes[i][0];
+    m_Nodes.insert(m_Nodes.end(), subNodes[i].begin()+1, subNodes[i].end());
+    m_Triangles.insert(m_Triangles.end(), subTris[i].begin(),
+                       subTris[i].end());
+    std::vector<KDTreeNode>().swap(subNodes[i]);
+    triVec().swap(subTris[i]);
+  }
+}
 
 double KDTree::Intersect(const Ray& ray, FLOATVECTOR3& normal,
                          FLOATVECTOR2& tc, FLOATVECTOR4& color,
                          double tmin, double tmax) const {
+  // far children still to visit and the part of the ray inside them
+  struct StackElem {
+    uint32_t node;
+    double   tmin;
+    double   tmax;
+  };
+  StackElem stack[MAX_DEPTH];
+  int iStack = 0;
+
+  double t = std::numeric_limits<double>::max();
+  FLOATVECTOR3 _normal;   FLOATVECTOR2 _tc; FLOATVECTOR4 _color;
+
+  uint32_t iNode = 0;
+  for (;;) {
+    // a hit in front of this cell cannot be beaten by anything behind it
+    if (t < tmin) break;
+
+    const KDTreeNode& node = m_Nodes[iNode];
+    if (!node.IsLeaf()) {
+      const unsigned char axis = node.GetAxis();
+      const double splitpos = node.GetSplitPos();
+      const double start = ray.start[axis];
+      const double dir = ray.direction[axis];
+
+      const bool bLeftFirst = start < splitpos ||
+                              (start == splitpos && dir <= 0);
+      const uint32_t nearchild = node.GetChildren() + (bLeftFirst ? 0 : 1);
+      const uint32_t farchild  = node.GetChildren() + (bLeftFirst ? 1 : 0);
+      if (dir == 0) {
+        iNode = nearchild;
+        continue;
+      }
 
-  StackElem* stack = new StackElem[m_maxDepth+3];
-
-	// init stack
-	int enPt = 0, exPt = 1;
-
-  // init traversal
-	KDTreeNode* farchild = 0, *currnode = m_Root;
-
-	stack[enPt].t    = tmin;
-  stack[enPt].pb   = (tmin > 0) ? (ray.start + ray.direction * tmin) :ray.start;
-  stack[enPt].node = 0;
-  stack[enPt].prev = 0;
-
-	stack[exPt].t    = tmax;
-	stack[exPt].pb   = ray.start + ray.direction * tmax;
-	stack[exPt].node = 0;
-  stack[enPt].prev = 0;
-	
-  // traverse kd-tree
-	while (currnode)
-	{
-		while (!currnode->IsLeaf())
-		{
-			double splitpos = currnode->GetSplitPos();
-			int axis = currnode->GetAxis();
-			if (stack[enPt].pb[axis] <= splitpos)
-			{
-				if (stack[exPt].pb[axis] <= splitpos)
-				{
-					currnode = currnode->GetLeft();
-					continue;
-				}
-				farchild = currnode->GetRight();
-				currnode = currnode->GetLeft();
-			}
-			else
-			{
-				if (stack[exPt].pb[axis] > splitpos)
-				{
-					currnode = currnode->GetRight();
-					continue;
-				}
-				farchild = currnode->GetLeft();
-				currnode = currnode->GetRight();
-			}
-
-			double t = (splitpos - ray.start[axis]) / ray.direction[axis];
-			int tmp = exPt++;
-			if (exPt == enPt) exPt++;
-
-			stack[exPt].prev = tmp;
-			stack[exPt].t = t;
-			stack[exPt].node = farchild;
-      stack[exPt].pb = ray.start + ray.direction * t;
+      const double tSplit = (splitpos - start) / dir;
+      if (tSplit > tmax || tSplit <= 0) {
+        iNode = nearchild;
+      } else if (tSplit < tmin) {
+        iNode = farchild;
+      } else {
+        stack[iStack].node = farchild;
+        stack[iStack].tmin = tSplit;
+        stack[iStack].tmax = tmax;
+        iStack++;
+        iNode = nearchild;
+        tmax = tSplit;
+      }
+      continue;
     }
 
-    // check leaf cell
-    double t = std::numeric_limits<double>::max();
-    FLOATVECTOR3 _normal;   FLOATVECTOR2 _tc; FLOATVECTOR4 _color;
-
-    for (size_t i = 0;i<currnode->GetList().size();i++) {
-      double currentT = m_mesh->IntersectTriangle(currnode->GetList()[i],
+    // check leaf cell, triangles may reach out of it so keep the closest
+    // hit and go on until no cell in front of it is left
+    const uint32_t* tris = m_Triangles.data() + node.GetFirst();
+    for (uint32_t i = 0;i<node.GetCount();i++) {
+      double currentT = m_mesh->IntersectTriangle(size_t(tris[i])*3,
                                                   ray, _normal, _tc, _color);
       if (currentT < t) {
         normal = _normal;
@@ -156,151 +454,71 @@ double KDTree::Intersect(const Ray& ray, FLOATVECTOR3& normal,
         color = _color;
       }
     }
-    if (t != std::numeric_limits<double>::max()) {
-      delete [] stack;
-      return t;
-    }
 
-		enPt = exPt;
-		currnode = stack[exPt].node;
-		exPt = stack[enPt].prev;
-	}
-
-  delete [] stack;
-	return std::numeric_limits<double>::max();
+    if (iStack == 0) break;
+    iStack--;
+    iNode = stack[iStack].node;
+    tmin  = stack[iStack].tmin;
+    tmax  = stack[iStack].tmax;
+  }
+  return t;
 }
 
-void KDTree::Subdivide(KDTreeNode* node, const DOUBLEVECTOR3& min,
-                       const DOUBLEVECTOR3& max, int recDepth) {
-	// determine split axis (always split along the longest axis)
-	DOUBLEVECTOR3 bboxSize = max-min;
-
-  unsigned char axis = 2;
-	if ((bboxSize.x >= bboxSize.y) && (bboxSize.x >= bboxSize.z))
-    axis = 0;
-	else 
-    if ((bboxSize.y >= bboxSize.x) && (bboxSize.y >= bboxSize.z))
-      axis = 1;
-
-  node->SetAxis(axis);
-
-	// make a list of the split position candidates
-	double pos1 = min[axis];
-	double pos2 = max[axis];
-  slist splitCandidates;
-  splitCandidates.reserve(node->GetList().size());
-  eventVec events;
-  for (size_t i = 0;i<node->GetList().size();i++) {
-    size_t triIndex = node->GetList()[i];
-    double vertices[3] = {
-      m_mesh->m_Data.m_vertices[m_mesh->m_Data.m_VertIndices[triIndex*3+0]][axis],
-      m_mesh->m_Data.m_vertices[m_mesh->m_Data.m_VertIndices[triIndex*3+1]][axis],
-      m_mesh->m_Data.m_vertices[m_mesh->m_Data.m_VertIndices[triIndex*3+2]][axis]
-    };
-
-    
-    double pMin = vertices[0];
-    double pMax = vertices[0];
-    for (size_t j = 1;j<3;j++) {
-      if (vertices[j] < pMin) pMin = vertices[j];
-      if (vertices[j] > pMax) pMax = vertices[j];
-    }
-    
-    if ( pMin >= pos1 ) splitCandidates.push_back( pMin );
-    if ( pMax <= pos2 ) splitCandidates.push_back( pMax );
-
-    events.push_back(std::make_pair(pMin,pMax));
+void KDTree::GetGeometry(uint32_t iNode, VertVec& vertices, NormVec& normals,
+                         IndexVec& vIndices, IndexVec& nIndices,
+                         const FLOATVECTOR3& min, const FLOATVECTOR3& max,
+                         unsigned int iDepth) const {
+  const KDTreeNode& node = m_Nodes[iNode];
+  if (node.IsLeaf()) return;
+  const unsigned char axis = node.GetAxis();
+  const float splitpos = node.GetSplitPos();
+
+  uint32_t sNormals = uint32_t(normals.size());
+  // indices for two triangles
+  for (int i = 0;i<6;i++)
+    nIndices.push_back(sNormals);
+  FLOATVECTOR3 normal(0,0,0);
+  normal[axis] = 1.0;
+  normals.push_back(normal);
+
+  uint32_t sVertices = uint32_t(vertices.size());
+  vIndices.push_back(sVertices);
+  vIndices.push_back(sVertices+1);
+  vIndices.push_back(sVertices+3);
+
+  vIndices.push_back(sVertices+2);
+  vIndices.push_back(sVertices+3);
+  vIndices.push_back(sVertices);
+
+  FLOATVECTOR3 vertex1 = min;
+  FLOATVECTOR3 vertex2 = min;
+  FLOATVECTOR3 vertex3 = min;
+  FLOATVECTOR3 vertex4 = max;
+  vertex1[axis] = splitpos;
+  vertex2[axis] = splitpos;
+  vertex3[axis] = splitpos;
+  vertex4[axis] = splitpos;
+
+  switch (axis) {
+    case 0  : vertex2.y = max.y; vertex3.z = max.z; break;
+    case 1  : vertex2.x = max.x; vertex3.z = max.z; break;
+    default : vertex2.x = max.x; vertex3.y = max.y; break;
   }
 
-  // calculate the inverse half surface area for
-  // current node, used for normalization
-  double halfInverseArea = 1.0/(bboxSize[0]*bboxSize[1] + 
-                                bboxSize[0]*bboxSize[2] + 
-                                bboxSize[1]*bboxSize[2]);
-  
-  double minCost = std::numeric_limits<double>::max();
-  double bestpos = 0;
-
-  // sort the triangles (events) bythe max and min index and then figure out
-  // the number of triangles on the right and on the left by using binary search
-  eventVec eventsMax = events;
-  sort(events.begin(), events.end(), compMin);
-  sort(eventsMax.begin(), eventsMax.end(), compMax);
-  for (size_t i = 0;i<splitCandidates.size();i++) {
-    splitCandidates[i].n1count = upper_bound(events.begin(), 
-                                             events.end(),
-                                             dPair(splitCandidates[i].pos, 0),
-                                             compMin)-events.begin();
-    splitCandidates[i].n2count = eventsMax.size()-
-                                   (upper_bound(eventsMax.begin(),
-                                                eventsMax.end(),
-                                                dPair(0,splitCandidates[i].pos),
-                                                compMax)-eventsMax.begin());
-  }
+  vertices.push_back(vertex1);
+  vertices.push_back(vertex2);
+  vertices.push_back(vertex3);
+  vertices.push_back(vertex4);
 
-  // compute costs for splits
-  for (slist::iterator candidate = splitCandidates.begin();
-       candidate!=splitCandidates.end(); ++candidate) {
-    DOUBLEVECTOR3 b1 = bboxSize;  b1[axis] = candidate->pos - min[axis];
-    DOUBLEVECTOR3 b2 = bboxSize;  b2[axis] -= b1[axis];
-
-    // compute the cost for this split
-		double halfArea1 = b1.x * b1.y + b1.y * b1.z + b1.x * b1.z;
-		double halfArea2 = b2.x * b2.y + b2.y * b2.z + b2.x * b2.z;
-
-    // the 0.3 is some wild guess for the tree 
-    // (travesal/triangle intersect)-cost
-		double splitcost = 0.3 + halfInverseArea * 
-      (halfArea1 * candidate->n1count + halfArea2 * candidate->n2count);
-
-		// update best cost tracking variables
-		if (minCost > splitcost) {
-      minCost = splitcost;
-      bestpos = candidate->pos;
-    }
-  }
-	// calculate cost for not splitting
-	double noSplitCost = double(node->GetList().size());
-  // if splitting makes things worse -> stop
-  if (minCost > noSplitCost) return;
-
-  // split
-  node->SetLeaf(false);
-  KDTreeNode* left  = new KDTreeNode;
-  KDTreeNode* right = new KDTreeNode;
-
-  // push objects into children
-  for (size_t i = 0;i<node->GetList().size();i++) {
-    size_t triIndex = node->GetList()[i];
-    double vertices[3] = {
-      m_mesh->m_Data.m_vertices[m_mesh->m_Data.m_VertIndices[triIndex*3+0]][axis],
-      m_mesh->m_Data.m_vertices[m_mesh->m_Data.m_VertIndices[triIndex*3+1]][axis],
-      m_mesh->m_Data.m_vertices[m_mesh->m_Data.m_VertIndices[triIndex*3+2]][axis]
-    };
-
-    if ( vertices[0] <= bestpos ||
-         vertices[1] <= bestpos || 
-         vertices[2] <= bestpos) 
-      left->Add(triIndex);
-    if ( vertices[0] > bestpos || 
-         vertices[1] > bestpos || 
-         vertices[2] > bestpos) 
-      right->Add(triIndex);
+  if (iDepth > 0) {
+    FLOATVECTOR3 max1 = max; max1[axis] = splitpos;
+    FLOATVECTOR3 min2 = min; min2[axis] = splitpos;
+
+    GetGeometry(node.GetChildren(), vertices, normals, vIndices, nIndices,
+                min, max1, iDepth-1);
+    GetGeometry(node.GetChildren()+1, vertices, normals, vIndices, nIndices,
+                min2, max, iDepth-1);
   }
-  
-  node->SetLeft(left);
-  node->SetRight(right);
-  node->SetAxis(axis);
-  node->SetSplitPos(bestpos);
-
-
-	if (recDepth > 1)
-	{
-    DOUBLEVECTOR3 max1 = max; max1[axis] = bestpos;
-		if (left->GetList().size() > 2) Subdivide( left,  min,  max1, recDepth-1);
-    DOUBLEVECTOR3 min2 = min; min2[axis] = bestpos;
-		if (right->GetList().size() > 2) Subdivide( right, min2, max,  recDepth-1);
-	}
 }
 
 Mesh* KDTree::GetGeometry(unsigned int iDepth, bool buildKDTree) const {
@@ -317,26 +535,92 @@ Mesh* KDTree::GetGeometry(unsigned int iDepth, bool buildKDTree) const {
     // as the GetGeometry call does not create colors or texture coords
     // we do not pass these two to this call but since the constructor
     // requires them to be given we pass the empty vectors to it
-    m_Root->GetGeometry(vertices, normals,  
-                        vIndices, nIndices,
-                        m_mesh->m_Bounds[0], m_mesh->m_Bounds[1], iDepth);
+    GetGeometry(0, vertices, normals, vIndices, nIndices,
+                m_Bounds[0], m_Bounds[1], iDepth);
 
-    return new Mesh(vertices, normals, texcoords, colors, 
+    return new Mesh(vertices, normals, texcoords, colors,
                     vIndices, nIndices, tIndices, cIndices,
                     buildKDTree,false,"KD-Tree Mesh", Mesh::MT_TRIANGLES);
 }
 
-void KDTree::RescaleAndShift(KDTreeNode* node, 
-                             const FLOATVECTOR3& translation,
+void KDTree::RescaleAndShift(const FLOATVECTOR3& translation,
                              const FLOATVECTOR3& scale) {
+  for (size_t i = 0;i<m_Nodes.size();i++) {
+    KDTreeNode& node = m_Nodes[i];
+    if (node.IsLeaf()) continue;
+    const unsigned char axis = node.GetAxis();
+    node.SetSplitPos(node.GetSplitPos() * scale[axis] + translation[axis]);
+    // a mirrored axis swaps what is left and right of the plane
+    if (scale[axis] < 0)
+      std::swap(m_Nodes[node.GetChildren()], m_Nodes[node.GetChildren()+1]);
+  }
+  for (size_t a = 0;a<3;a++) {
+    const float b0 = m_Bounds[0][a] * scale[a] + translation[a];
+    const float b1 = m_Bounds[1][a] * scale[a] + translation[a];
+    m_Bounds[0][a] = std::min(b0, b1);
+    m_Bounds[1][a] = std::max(b0, b1);
+  }
+}
 
-  unsigned char axis = node->GetAxis();
-	double pos = node->GetSplitPos();
-  pos = pos * scale[axis] + translation[axis];
-  node->SetSplitPos(pos);
+bool KDTree::Save(std::ostream& kdfile) const {
+  const uint32_t header[3] = { KDTREE_MAGIC, KDTREE_VERSION, m_maxDepth };
+  const uint64_t counts[3] = { TriangleCount(m_mesh),
+                               uint64_t(m_Nodes.size()),
+                               uint64_t(m_Triangles.size()) };
+  WriteLE(kdfile, header, 3);
+  WriteLE(kdfile, counts, 3);
+  WriteLE(kdfile, &m_Bounds[0].x, 3);
+  WriteLE(kdfile, &m_Bounds[1].x, 3);
+  WriteLE(kdfile, reinterpret_cast<const uint32_t*>(&m_Nodes[0]),
+          2*m_Nodes.size());
+  if (!m_Triangles.empty())
+    WriteLE(kdfile, &m_Triangles[0], m_Triangles.size());
+  return !kdfile.fail();
+}
 
-  if (!node->IsLeaf()) {
-    RescaleAndShift(node->GetLeft(), translation, scale);
-    RescaleAndShift(node->GetRight(), translation, scale);
+bool KDTree::Load(std::istream& kdfile) {
+  uint32_t header[3];
+  uint64_t counts[3];
+  if (!ReadLE(kdfile, header, 3) ||
+      header[0] != KDTREE_MAGIC || header[1] != KDTREE_VERSION ||
+      header[2] > MAX_DEPTH) return false;
+  if (!ReadLE(kdfile, counts, 3) ||
+      counts[0] != TriangleCount(m_mesh) ||
+      counts[1] == 0 || counts[1] > (1u << 30) ||
+      counts[2] > std::numeric_limits<uint32_t>::max()) return false;
+
+  FLOATVECTOR3 bounds[2];
+  std::vector<KDTreeNode> nodes(static_cast<size_t>(counts[1]));
+  triVec triangles(static_cast<size_t>(counts[2]));
+  if (!ReadLE(kdfile, &bounds[0].x, 3) || !ReadLE(kdfile, &bounds[1].x, 3) ||
+      !ReadLE(kdfile, reinterpret_cast<uint32_t*>(&nodes[0]),
+              2*nodes.size()) ||
+      (!triangles.empty() &&
+       !ReadLE(kdfile, &triangles[0], triangles.size()))) return false;
+
+  // children always follow their parents, so one pass finds every depth
+  // and rules out cycles
+  std::vector<unsigned char> depth(nodes.size(), 0);
+  for (size_t i = 0;i<nodes.size();i++) {
+    const KDTreeNode& node = nodes[i];
+    if (node.IsLeaf()) {
+      if (uint64_t(node.GetFirst()) + node.GetCount() > triangles.size())
+        return false;
+      continue;
+    }
+    const size_t c = node.GetChildren();
+    if (c <= i || c+1 >= nodes.size() || depth[i] >= header[2])
+      return false;
+    depth[c]   = std::max<unsigned char>(depth[c], depth[i]+1);
+    depth[c+1] = std::max<unsigned char>(depth[c+1], depth[i]+1);
   }
+  for (size_t i = 0;i<triangles.size();i++)
+    if (triangles[i] >= counts[0]) return false;
+
+  m_maxDepth = header[2];
+  m_Bounds[0] = bounds[0];
+  m_Bounds[1] = bounds[1];
+  m_Nodes.swap(nodes);
+  m_Triangles.swap(triangles);
+  return true;
 }
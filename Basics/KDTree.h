@@ -7,140 +7,65 @@
 
 namespace tuvok {
 
-typedef std::vector<size_t> triVec;
-
+typedef std::vector<uint32_t> triVec;
 
+/// One node of the flattened tree, eight bytes so that a cache line holds
+/// eight of them.  Children are always allocated as a pair, the left one
+/// at GetChildren() and the right one right after it.
 class KDTreeNode
 {
 public:
-  KDTreeNode(std::istream& kdfile) :
-    m_Axis(0),
-    m_SplitPos(0),
-    m_leftChild(0), 
-    m_rightChild(0),
-    m_bIsLeaf(true) 
-  {
-    unsigned int itemCount;
-    int iAxis;
-    kdfile >> iAxis>> m_SplitPos>> m_bIsLeaf >> itemCount;
-    m_Axis = (unsigned char)(iAxis);
-    m_items.resize(itemCount);
-    for (unsigned int i=0;i<itemCount;i++) kdfile >> m_items[i];
-    if (!m_bIsLeaf) { 
-      m_leftChild  = new KDTreeNode(kdfile);
-      m_rightChild = new KDTreeNode(kdfile);      
-    }
-  }
+  enum { LEAF = 3 };
 
-  KDTreeNode() : 
-    m_Axis(0),
-    m_SplitPos(0),
-    m_leftChild(0), 
-    m_rightChild(0),
-    m_bIsLeaf(true)
-  {}
-
-  ~KDTreeNode() {
-    delete m_leftChild;
-    delete m_rightChild;
+  static KDTreeNode Leaf(uint32_t iFirst, uint32_t iCount) {
+    KDTreeNode n;
+    n.m_iFirst = iFirst;
+    n.m_iFlags = (iCount << 2) | LEAF;
+    return n;
   }
-
-  void Save(std::ostream& kdfile) const {
-    int iAxis = m_Axis;
-    kdfile << iAxis << " " << m_SplitPos << " " << m_bIsLeaf 
-           << " " << (unsigned int)(m_items.size()) << std::endl;
-    for (unsigned int i=0;i<(unsigned int)m_items.size();i++) 
-      kdfile << m_items[i] << " ";
-    kdfile << std::endl;
-    if (!m_bIsLeaf) { 
-      m_leftChild->Save(kdfile);
-      m_rightChild->Save(kdfile);   
-    }
+  static KDTreeNode Inner(unsigned char axis, float fSplitPos,
+                          uint32_t iChildren) {
+    KDTreeNode n;
+    n.m_fSplitPos = fSplitPos;
+    n.m_iFlags = (iChildren << 2) | axis;
+    return n;
   }
 
-  void GetGeometry(VertVec& vertices, NormVec& normals,
-                   IndexVec& vIndices, IndexVec& nIndices,
-                   const FLOATVECTOR3& min, const FLOATVECTOR3& max,
-                   unsigned int iDepth) {
-    uint32_t sNormals = uint32_t(normals.size());
-    // indices for two triangles
-    for (int i = 0;i<6;i++)
-      nIndices.push_back(sNormals);
-    FLOATVECTOR3 normal(0,0,0);
-    normal[m_Axis] = 1.0;
-    normals.push_back(normal);
-
-    uint32_t sVertices = uint32_t(vertices.size());
-    UINTVECTOR3 iVertices1(sVertices,sVertices+1,sVertices+3);
-    UINTVECTOR3 iVertices2(sVertices+2,sVertices+3,sVertices+0);
-    vIndices.push_back(sVertices);
-    vIndices.push_back(sVertices+1);
-    vIndices.push_back(sVertices+3);
-
-    vIndices.push_back(sVertices+2);
-    vIndices.push_back(sVertices+3);
-    vIndices.push_back(sVertices);
-
-    FLOATVECTOR3 vertex1 = min;
-    FLOATVECTOR3 vertex2 = min;
-    FLOATVECTOR3 vertex3 = min;
-    FLOATVECTOR3 vertex4 = max;
-    vertex1[m_Axis] = float(m_SplitPos);
-    vertex2[m_Axis] = float(m_SplitPos);
-    vertex3[m_Axis] = float(m_SplitPos);
-    vertex4[m_Axis] = float(m_SplitPos);
-
-    switch (m_Axis) {
-      case 0  : vertex2.y = max.y; vertex3.z = max.z; break;
-      case 1  : vertex2.x = max.x; vertex3.z = max.z; break;
-      default : vertex2.x = max.x; vertex3.y = max.y; break;
-    }
-
-    vertices.push_back(vertex1);
-    vertices.push_back(vertex2);
-    vertices.push_back(vertex3);
-    vertices.push_back(vertex4);
-
-    if (!m_bIsLeaf && iDepth > 0) {
-      FLOATVECTOR3 max1 = max; max1[m_Axis] = float(m_SplitPos);
-      FLOATVECTOR3 min2 = min; min2[m_Axis] = float(m_SplitPos);
-
-      m_leftChild->GetGeometry(vertices, normals,
-                               vIndices, nIndices,
-                               min, max1, iDepth-1);
-      m_rightChild->GetGeometry(vertices, normals,
-                                vIndices, nIndices,
-                                min2, max, iDepth-1);
-    }
-
+  bool IsLeaf() const { return (m_iFlags & 3) == LEAF; }
+  unsigned char GetAxis() const { return (unsigned char)(m_iFlags & 3); }
+  float GetSplitPos() const { return m_fSplitPos; }
+  void SetSplitPos(float pos) { m_fSplitPos = pos; }
+  /// index of the left child, inner nodes only
+  uint32_t GetChildren() const { return m_iFlags >> 2; }
+  /// range of the leaf in the tree's triangle list, leaves only
+  uint32_t GetFirst() const { return m_iFirst; }
+  uint32_t GetCount() const { return m_iFlags >> 2; }
+
+  /// moves the references of a subtree that was built on its own
+  void Relocate(uint32_t iNodeOffset, uint32_t iTriOffset) {
+    if (IsLeaf()) m_iFirst += iTriOffset;
+    else m_iFlags += iNodeOffset << 2;
   }
 
-
-  void SetAxis( unsigned char axis ) { m_Axis = axis; }
-  unsigned char GetAxis() const { return m_Axis; }
-  void SetSplitPos( double pos ) { m_SplitPos = pos; }
-  double GetSplitPos() const  { return m_SplitPos; }
-  void SetLeft( KDTreeNode* leftChild ) { m_leftChild = leftChild; }
-  void SetRight( KDTreeNode* rightChild ) { m_rightChild = rightChild; }
-  KDTreeNode* GetLeft() const { return m_leftChild; }
-  KDTreeNode* GetRight() const  { return m_rightChild; }
-  void Add( size_t triIndex ) {m_items.push_back(triIndex);}
-  bool IsLeaf() const { return m_bIsLeaf; }
-  void SetLeaf( bool bIsLeaf ) { m_bIsLeaf = bIsLeaf; }	  
-  triVec& GetList() { return m_items; }
-
 private:
-  unsigned char m_Axis;
-  double        m_SplitPos;
-  KDTreeNode*   m_leftChild;
-  KDTreeNode*   m_rightChild;
-  triVec        m_items;     
-  bool          m_bIsLeaf;
+  union {
+    float    m_fSplitPos;
+    uint32_t m_iFirst;
+  };
+  // two low bits: split axis or LEAF; the rest: children or triangle count
+  uint32_t   m_iFlags;
 };
 
+/// A kd-tree over the triangles of a mesh for picking.  The tree is stored
+/// as one array of nodes plus one array of triangle numbers, built with a
+/// binned surface area heuristic, where the upper levels bin on all threads
+/// and the subtrees below are built in parallel.
 class KDTree
 {
 public:
+  /// Builds the tree, at most maxDepth (and MAX_DEPTH) levels deep.  If a
+  /// filename is given the tree is loaded from there if the file holds a
+  /// tree for this mesh, otherwise it is built and saved there.
   KDTree(Mesh* mesh, const std::string& filename = "",
          unsigned int maxDepth = 20);
   ~KDTree(void);
@@ -151,22 +76,34 @@ public:
   Mesh* GetGeometry(unsigned int iDepth, bool buildKDTree) const;
 
   void RescaleAndShift(const FLOATVECTOR3& translation,
-                       const FLOATVECTOR3& scale) {
-   RescaleAndShift(m_Root, translation, scale);
-  }
+                       const FLOATVECTOR3& scale);
 
-private:
-  Mesh*        m_mesh;
-  unsigned int m_maxDepth;
-  KDTreeNode*  m_Root;
+  /// Writes the tree in a versioned, little endian binary format.
+  bool Save(std::ostream& kdfile) const;
+  /// Reads a tree written by Save; fails (and leaves this tree as it was)
+  /// if the stream is damaged, has an unknown version or was written for a
+  /// mesh with a different triangle count.
+  bool Load(std::istream& kdfile);
 
-  void Subdivide(KDTreeNode* node, const DOUBLEVECTOR3& min,
-                 const DOUBLEVECTOR3& max, int recDepth);
+  /// Deepest tree Intersect can traverse without allocating.
+  enum { MAX_DEPTH = 64 };
 
-  void RescaleAndShift(KDTreeNode* node,
-                       const FLOATVECTOR3& translation,
-                       const FLOATVECTOR3& scale);
+  size_t GetNodeCount() const { return m_Nodes.size(); }
+  size_t GetTriangleReferenceCount() const { return m_Triangles.size(); }
+  unsigned int GetMaxDepth() const { return m_maxDepth; }
 
+private:
+  Mesh*                   m_mesh;
+  unsigned int            m_maxDepth;
+  FLOATVECTOR3            m_Bounds[2];
+  std::vector<KDTreeNode> m_Nodes;
+  triVec                  m_Triangles;
+
+  void Build();
+  void GetGeometry(uint32_t iNode, VertVec& vertices, NormVec& normals,
+                   IndexVec& vIndices, IndexVec& nIndices,
+                   const FLOATVECTOR3& min, const FLOATVECTOR3& max,
+                   unsigned int iDepth) const;
 };
 
 }
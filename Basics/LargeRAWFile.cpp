@@ -165,6 +165,13 @@ void LargeRAWFile::SeekPos(uint64_t iPos) {
   #endif
 }
 
+size_t LargeRAWFile::ReadRAWAt(uint64_t iPos, unsigned char* pData,
+                               uint64_t iCount) {
+  SCOPEDLOCK(m_PositionGuard);
+  SeekPos(iPos);
+  return ReadRAW(pData, iCount);
+}
+
 size_t LargeRAWFile::ReadRAW(unsigned char* pData, uint64_t iCount) {
   #ifdef _WIN32
   uint64_t iTotalRead = 0;
@@ -35,6 +35,8 @@
   typedef FILE* FILETYPE;
 #endif
 
+#include "Threads.h"
+
 class LargeRAWFile {
 public:
   LargeRAWFile(const std::string& strFilename, uint64_t iHeaderSize=0);
@@ -59,6 +61,10 @@ public:
   virtual uint64_t GetPos();
   virtual void SeekPos(uint64_t iPos);
   virtual size_t ReadRAW(unsigned char* pData, uint64_t iCount);
+  /// SeekPos and ReadRAW as one step.  The file position is shared, so
+  /// threads reading the same file (all blocks of a UVF, the brick
+  /// prefetcher) must use this instead of their own seek and read.
+  size_t ReadRAWAt(uint64_t iPos, unsigned char* pData, uint64_t iCount);
   virtual size_t WriteRAW(const unsigned char* pData, uint64_t iCount);
   virtual bool CopyRAW(uint64_t iCount, uint64_t iSourcePos, uint64_t iTargetPos,
                        unsigned char* pBuffer, uint64_t iBufferSize);
@@ -157,6 +163,7 @@ protected:
   bool          m_bIsOpen;
   bool          m_bWritable;
   uint64_t      m_iHeaderSize;
+  tuvok::CriticalSection m_PositionGuard;
 };
 
 #include <memory>
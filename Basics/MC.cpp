@@ -129,3 +129,43 @@ void Isosurface::Transform(const FLOATMATRIX4& matrix) {
     vfNormals[i].normalize();
   }
 }
+
+void IsoBlock::Clear() {
+  // swap, to actually free the memory
+  std::vector<FLOATVECTOR3>().swap(vfVertices);
+  std::vector<FLOATVECTOR3>().swap(vfNormals);
+  std::vector<uint64_t>().swap(viEdges);
+  std::vector<uint32_t>().swap(viSeams);
+  std::vector<uint32_t>().swap(viIndices);
+}
+
+void IsoWelder::Add(const IsoBlock& block) {
+  const uint32_t iNone = uint32_t(-1);
+  m_viRemap.assign(block.vfVertices.size(), iNone);
+
+  // seam vertices: reuse the vertex if another block already made it
+  for (size_t i = 0; i < block.viSeams.size(); i++) {
+    const uint32_t v = block.viSeams[i];
+    const uint32_t iNew = uint32_t(vfVertices.size());
+    std::pair<std::unordered_map<uint64_t, uint32_t>::iterator, bool> res =
+      m_mSeams.insert(std::make_pair(block.viEdges[v], iNew));
+    m_viRemap[v] = res.first->second;
+    if (res.second) {
+      vfVertices.push_back(block.vfVertices[v]);
+      vfNormals.push_back(block.vfNormals[v]);
+    }
+  }
+  // everything else is the block's alone
+  for (size_t v = 0; v < block.vfVertices.size(); v++) {
+    if (m_viRemap[v] != iNone) continue;
+    m_viRemap[v] = uint32_t(vfVertices.size());
+    vfVertices.push_back(block.vfVertices[v]);
+    vfNormals.push_back(block.vfNormals[v]);
+  }
+
+  const size_t iFirst = viIndices.size();
+  viIndices.resize(iFirst + block.viIndices.size());
+  for (size_t i = 0; i < block.viIndices.size(); i++) {
+    viIndices[iFirst + i] = m_viRemap[block.viIndices[i]];
+  }
+}
@@ -38,6 +38,9 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+#include "StdDefines.h"
 #include "Vectors.h"
 
 #define EPSILON 0.000001f
@@ -103,4 +106,56 @@ protected:
 
 };
 
+// The part of an isosurface which lies in one block (a brick, or a slab of
+// one) of a larger volume.  Every vertex is tagged with the id of the grid
+// edge it lies on; ids are unique in the whole volume, so the blocks can be
+// welded into a single mesh, see IsoWelder.
+class IsoBlock {
+public:
+    std::vector<FLOATVECTOR3> vfVertices; // in voxel coordinates of the volume
+    std::vector<FLOATVECTOR3> vfNormals;
+    std::vector<uint64_t>     viEdges;    // grid edge of each vertex
+    std::vector<uint32_t>     viSeams;    // vertices on the block's faces
+    std::vector<uint32_t>     viIndices;  // three per triangle
+
+    void Clear();
+};
+
+// Marching Cubes on a sub range of a block's cells.  Each grid edge gets one
+// vertex, i.e. the result is an indexed mesh without duplicates.
+template <class T=float> class BlockMarchingCubes : public MarchingCubes<T> {
+public:
+    // Marches all cells whose first voxel lies in [vFirst, vLast) of the
+    // iSize voxels at pTData; cells read one voxel past vLast, which thus
+    // must be < iSize.  vGlobal is the position of vFirst in a volume of
+    // vDomain voxels.  Edge ids are offset by iEdgeBase, e.g. to keep time
+    // steps apart.
+    static void March(const T* pTData, const UINT64VECTOR3& vSize,
+                      const UINT64VECTOR3& vFirst, const UINT64VECTOR3& vLast,
+                      const UINT64VECTOR3& vGlobal,
+                      const UINT64VECTOR3& vDomain, uint64_t iEdgeBase,
+                      T TIsoValue, IsoBlock& block);
+
+protected:
+    static FLOATVECTOR3 Gradient(const T* pTData, const UINT64VECTOR3& vSize,
+                                 const UINT64VECTOR3& vPos);
+};
+
+// Merges IsoBlocks into one indexed mesh.  Vertices which several blocks
+// found on the same grid edge become one.  The result depends on the order
+// the blocks are added in, but not on how they were computed.
+class IsoWelder {
+public:
+    std::vector<FLOATVECTOR3> vfVertices;
+    std::vector<FLOATVECTOR3> vfNormals;
+    std::vector<uint32_t>     viIndices;
+
+    void Add(const IsoBlock& block);
+
+private:
+    // only vertices on block faces can be shared, so only those are kept
+    std::unordered_map<uint64_t, uint32_t> m_mSeams;
+    std::vector<uint32_t> m_viRemap;
+};
+
 #include "MC.inl"
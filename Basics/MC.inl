@@ -37,6 +37,9 @@
 //!    Copyright (C) 2008 SCI Institute
 
 
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
 #include <sstream>
 #include <iomanip>
 
@@ -717,3 +720,144 @@ template <class T> void LayerTempData<T>::NextIteration() {
     }
   }
 }
+
+// first voxel (relative to the cell) and axis of each of the 12 cell edges,
+// in the corner numbering of the tables above.
+static const int s_iBlockEdges[12][4] = {
+  {0,1,0,0}, {1,0,0,1}, {0,0,0,0}, {0,0,0,1},
+  {0,1,1,0}, {1,0,1,1}, {0,0,1,0}, {0,0,1,1},
+  {0,1,0,2}, {1,1,0,2}, {1,0,0,2}, {0,0,0,2}
+};
+
+template <class T> void BlockMarchingCubes<T>::March(const T* pTData,
+                                                     const UINT64VECTOR3& vSize,
+                                                     const UINT64VECTOR3& vFirst,
+                                                     const UINT64VECTOR3& vLast,
+                                                     const UINT64VECTOR3& vGlobal,
+                                                     const UINT64VECTOR3& vDomain,
+                                                     uint64_t iEdgeBase,
+                                                     T TIsoValue,
+                                                     IsoBlock& block) {
+  if (vLast.x <= vFirst.x || vLast.y <= vFirst.y || vLast.z <= vFirst.z) return;
+  assert(vLast.x < vSize.x && vLast.y < vSize.y && vLast.z < vSize.z);
+
+  const size_t iCellsX = size_t(vLast.x - vFirst.x);
+  const size_t iCellsY = size_t(vLast.y - vFirst.y);
+  const size_t iCellsZ = size_t(vLast.z - vFirst.z);
+  const size_t iSliceX = size_t(vSize.x);
+  const size_t iSlice  = size_t(vSize.x * vSize.y);
+  const double fIso    = double(TIsoValue);
+
+  // vertex indices of the edges starting at the bottom and the top voxels
+  // of the current layer of cells, three axes per voxel
+  const uint32_t iNone = uint32_t(-1);
+  const size_t iCacheX = iCellsX+1;
+  std::vector<uint32_t> viBottom(iCacheX * (iCellsY+1) * 3, iNone);
+  std::vector<uint32_t> viTop(viBottom.size(), iNone);
+
+  for (size_t k = 0; k < iCellsZ; k++) {
+    for (size_t j = 0; j < iCellsY; j++) {
+      const T* pRow = pTData + size_t(vFirst.z+k) * iSlice +
+                               size_t(vFirst.y+j) * iSliceX + size_t(vFirst.x);
+      for (size_t i = 0; i < iCellsX; i++) {
+        const T* pCell = pRow + i;
+        const T fValues[8] = {
+          pCell[iSliceX],        pCell[iSliceX+1],
+          pCell[1],              pCell[0],
+          pCell[iSlice+iSliceX], pCell[iSlice+iSliceX+1],
+          pCell[iSlice+1],       pCell[iSlice]
+        };
+        int cellIndex = 0;
+        for (int c = 0; c < 8; c++) {
+          cellIndex |= int(fValues[c] < TIsoValue) << c;
+        }
+        const int iEdgeMask = MarchingCubes<T>::ms_edgeTable[cellIndex];
+        if (iEdgeMask == 0) continue;
+
+        uint32_t cellVerts[12];
+        for (int e = 0; e < 12; e++) {
+          if (!(iEdgeMask & (1 << e))) continue;
+          const int* edge = s_iBlockEdges[e];
+          std::vector<uint32_t>& cache = edge[2] ? viTop : viBottom;
+          uint32_t& iVertex = cache[((j+edge[1]) * iCacheX + (i+edge[0])) * 3 +
+                                    edge[3]];
+          if (iVertex == iNone) {
+            // the edge runs from voxel 'a' one step along 'axis'
+            const int axis = edge[3];
+            const UINT64VECTOR3 a(vFirst.x+i+edge[0], vFirst.y+j+edge[1],
+                                  vFirst.z+k+edge[2]);
+            UINT64VECTOR3 b(a);
+            b[axis]++;
+            const double fA = double(pTData[size_t(a.z)*iSlice +
+                                            size_t(a.y)*iSliceX + size_t(a.x)]);
+            const double fB = double(pTData[size_t(b.z)*iSlice +
+                                            size_t(b.y)*iSliceX + size_t(b.x)]);
+
+            float d = float((fA - fIso) / (fA - fB));
+            if (d < EPSILON) d = 0.0f; else if (d > (1.0f-EPSILON)) d = 1.0f;
+
+            const UINT64VECTOR3 vPos = vGlobal + a - vFirst;
+            FLOATVECTOR3 vVertex(vPos);
+            vVertex[axis] += d;
+
+            const FLOATVECTOR3 vNormA = Gradient(pTData, vSize, a);
+            const FLOATVECTOR3 vNormB = Gradient(pTData, vSize, b);
+            FLOATVECTOR3 vNormal = vNormA + d * (vNormB - vNormA);
+            vNormal.normalize(EPSILON);
+
+            iVertex = uint32_t(block.vfVertices.size());
+            block.vfVertices.push_back(vVertex);
+            block.vfNormals.push_back(vNormal);
+            block.viEdges.push_back(iEdgeBase + 3 * (vPos.x + vDomain.x *
+                                    (vPos.y + vDomain.y * vPos.z)) + axis);
+            // edges in a face of the block are also seen by the neighbor
+            for (int o = 0; o < 3; o++) {
+              if (o != axis && (a[o] == vFirst[o] || a[o] == vLast[o])) {
+                block.viSeams.push_back(iVertex);
+                break;
+              }
+            }
+          }
+          cellVerts[e] = iVertex;
+        }
+
+        const int* tri = MarchingCubes<T>::ms_triTable[cellIndex];
+        for (int t = 0; tri[t] != NO_EDGE; t++) {
+          block.viIndices.push_back(cellVerts[tri[t]]);
+        }
+      }
+    }
+    // the top of this layer is the bottom of the next one
+    std::swap(viBottom, viTop);
+    std::fill(viTop.begin(), viTop.end(), iNone);
+  }
+}
+
+// central differences, or three point forward/backward differences on the
+// faces of the block; see MarchingCubes::InterpolateNormal.
+template <class T> FLOATVECTOR3 BlockMarchingCubes<T>::Gradient(const T* pTData,
+                                                                const UINT64VECTOR3& vSize,
+                                                                const UINT64VECTOR3& vPos) {
+  const size_t iStride[3] = { 1, size_t(vSize.x), size_t(vSize.x*vSize.y) };
+  const T* p = pTData + size_t(vPos.z)*iStride[2] + size_t(vPos.y)*iStride[1] +
+               size_t(vPos.x);
+  FLOATVECTOR3 result;
+  for (int axis = 0; axis < 3; axis++) {
+    const size_t s = iStride[axis];
+    double g;
+    if (vSize[axis] < 3) {
+      g = vSize[axis] < 2 ? 0.0
+                          : vPos[axis] == 0 ? double(p[s]) - double(p[0])
+                                            : double(p[0]) - double(p[-ptrdiff_t(s)]);
+    } else if (vPos[axis] == 0) {
+      g = 0.5 * (-3.0 * double(p[0]) + 4.0 * double(p[s]) - double(p[2*s]));
+    } else if (vPos[axis] == vSize[axis]-1) {
+      g = 0.5 * (3.0 * double(p[0]) - 4.0 * double(p[-ptrdiff_t(s)]) +
+                 double(p[-ptrdiff_t(2*s)]));
+    } else {
+      g = 0.5 * (double(p[s]) - double(p[-ptrdiff_t(s)]));
+    }
+    result[axis] = float(g);
+  }
+  return result;
+}
@@ -35,6 +35,7 @@
 #include <algorithm>
 #include "Mesh.h"
 #include "KDTree.h"
+#include "MeshTools.h"
 
 using namespace tuvok;
 
@@ -220,172 +221,23 @@ bool Mesh::UnifyIndices() {
   if (!Validate()) return false;
   if (HasUniformIndices()) return true;
 
-  VertVec     vertices(m_Data.m_vertices);
-  NormVec     normals(m_Data.m_normals);
-  TexCoordVec texcoords(m_Data.m_texcoords);
-  ColorVec    colors(m_Data.m_colors);
-
-  // compute an inverse lookup index, i.e. for each
-  // vertex, store what indices point to it
-  std::vector<std::vector<size_t>> inverseIndex(m_Data.m_vertices.size());
-  for (size_t i = 0;i<m_Data.m_VertIndices.size();++i) {
-    inverseIndex[m_Data.m_VertIndices[i]].push_back(i);
-  }
-
-  for (size_t i = 0;i<m_Data.m_VertIndices.size();++i) {
-    uint32_t index = m_Data.m_VertIndices[i];
-
-    // simple resort
-    if (inverseIndex[index].size() == 1 || (inverseIndex[index].size() > 1 && inverseIndex[index][0] == i)) {      
-      if (!m_Data.m_NormalIndices.empty()) normals[index] = m_Data.m_normals[m_Data.m_NormalIndices[i]];
-      if (!m_Data.m_TCIndices.empty()) texcoords[index] = m_Data.m_texcoords[m_Data.m_TCIndices[i]];
-      if (!m_Data.m_COLIndices.empty()) colors[index] = m_Data.m_colors[m_Data.m_COLIndices[i]];
-      continue;
-    }
-
-    // more complicated case of a multiply used point
-    if (inverseIndex[index].size() > 1) {
-
-      if ((!m_Data.m_NormalIndices.empty() && m_Data.m_normals[m_Data.m_NormalIndices[i]] != m_Data.m_normals[m_Data.m_NormalIndices[inverseIndex[index][0]]]) ||
-          (!m_Data.m_TCIndices.empty() && m_Data.m_texcoords[m_Data.m_TCIndices[i]] != m_Data.m_texcoords[m_Data.m_TCIndices[inverseIndex[index][0]]]) ||
-          (!m_Data.m_COLIndices.empty() && m_Data.m_colors[m_Data.m_COLIndices[i]] != m_Data.m_colors[m_Data.m_COLIndices[inverseIndex[index][0]]])) {
-
-        m_Data.m_VertIndices[i] = uint32_t(vertices.size());
-        vertices.push_back(m_Data.m_vertices[index]);
-
-        if (!m_Data.m_NormalIndices.empty()) normals.push_back( m_Data.m_normals[m_Data.m_NormalIndices[i]]);
-        if (!m_Data.m_TCIndices.empty()) texcoords.push_back(m_Data.m_texcoords[m_Data.m_TCIndices[i]]);
-        if (!m_Data.m_COLIndices.empty()) colors.push_back(m_Data.m_colors[m_Data.m_COLIndices[i]]);
-      } else {
-        if (!m_Data.m_NormalIndices.empty()) normals[index] = m_Data.m_normals[m_Data.m_NormalIndices[inverseIndex[index][0]]];
-        if (!m_Data.m_TCIndices.empty()) texcoords[index] = m_Data.m_texcoords[m_Data.m_TCIndices[inverseIndex[index][0]]];
-        if (!m_Data.m_COLIndices.empty()) colors[index] = m_Data.m_colors[m_Data.m_COLIndices[inverseIndex[index][0]]];
-      }
-    }
-  }
-
-  m_Data.m_vertices = vertices;
-  m_Data.m_normals = normals;
-  m_Data.m_texcoords = texcoords;
-  m_Data.m_colors =colors;
-
-  m_Data.m_NormalIndices = m_Data.m_TCIndices = m_Data.m_COLIndices = m_Data.m_VertIndices;
-
-  return true;
+  return MeshTools::UnifyIndices(m_Data);
 }
 
 std::vector<Mesh*> Mesh::PartitionMesh(size_t iMaxIndexCount, bool bOptimize) const {
-  const Mesh* source;
-  if (HasUniformIndices()) {
-    source = this;
-  } else {
-    Mesh* unifiedIndexMesh = new Mesh();
-    unifiedIndexMesh->Clone(this);
-    unifiedIndexMesh->UnifyIndices();
-    source = unifiedIndexMesh;
-  }
-
-  // march over all vertices and hash them into the sub-meshes
-  // based on their index modulo iMaxIndex, those primitives that
-  // have indices that spawn over multiple of those sub-meshes
-  // are stored in an boundary list
-  std::vector<size_t> boundaryList;
-  std::vector<BasicMeshData> basicMeshVec( size_t( ceil(source->m_Data.m_vertices.size() / double(iMaxIndexCount)) ) );
-
-  size_t iLastBinsize = source->m_Data.m_vertices.size()%iMaxIndexCount;
-
-  for (size_t i = 0;i<basicMeshVec.size();++i) {
-    size_t iBinsize = (i == basicMeshVec.size()-1 ) ? iLastBinsize : iMaxIndexCount;
-
-    basicMeshVec[i].m_vertices.resize(iBinsize);
-    if (!source->m_Data.m_NormalIndices.empty()) basicMeshVec[i].m_normals.resize(iBinsize);
-    if (!source->m_Data.m_TCIndices.empty())     basicMeshVec[i].m_texcoords.resize(iBinsize);
-    if (!source->m_Data.m_COLIndices.empty())    basicMeshVec[i].m_colors.resize(iBinsize);
-  }
-
-
-  for (size_t i = 0;i<source->m_Data.m_VertIndices.size();i+=m_VerticesPerPoly) {
-    bool bConsistentBin = true;
-    size_t iTargetBin = source->m_Data.m_VertIndices[i] / iMaxIndexCount;
-    for (size_t j = 1;j<m_VerticesPerPoly;++j) {
-      if (source->m_Data.m_VertIndices[i+j] / iMaxIndexCount != iTargetBin) {
-        bConsistentBin = false;
-        break;
-      }
-    }
-
-    if (!bConsistentBin) {
-      boundaryList.push_back(i);
-      continue;
-    }
-
-    size_t iIndexTransform = iMaxIndexCount*iTargetBin;    
-
-    for (size_t j = 0;j<m_VerticesPerPoly;++j) {
-      uint32_t iNewIndex = uint32_t(source->m_Data.m_VertIndices[i+j] - iIndexTransform);
-     
-      basicMeshVec[iTargetBin].m_VertIndices.push_back( iNewIndex );
-      basicMeshVec[iTargetBin].m_vertices[iNewIndex] = source->m_Data.m_vertices[source->m_Data.m_VertIndices[i+j]];
-
-      if (!source->m_Data.m_NormalIndices.empty()) {
-        basicMeshVec[iTargetBin].m_NormalIndices.push_back( iNewIndex );
-        basicMeshVec[iTargetBin].m_normals[iNewIndex] = source->m_Data.m_normals[source->m_Data.m_VertIndices[i+j]];
-      }
-      if (!source->m_Data.m_TCIndices.empty()) {
-        basicMeshVec[iTargetBin].m_TCIndices.push_back( iNewIndex );
-        basicMeshVec[iTargetBin].m_texcoords[iNewIndex] = source->m_Data.m_texcoords[source->m_Data.m_VertIndices[i+j]];
-      }
-      if (!source->m_Data.m_COLIndices.empty())  {
-        basicMeshVec[iTargetBin].m_COLIndices.push_back( iNewIndex );
-        basicMeshVec[iTargetBin].m_colors[iNewIndex] = source->m_Data.m_colors[source->m_Data.m_VertIndices[i+j]];
-      }
-    }
-  }
-
+  BasicMeshData data(m_Data);
   if (bOptimize) {
-    // remove unused items
-    for (size_t i = 0;i<basicMeshVec.size();++i) basicMeshVec[i].RemoveUnusedVertices();
+    // merge identical positions and normals, unifying the indices
+    // afterwards turns them into shared vertices
+    MeshTools::WeldVertices(data);
+    MeshTools::WeldNormals(data);
   }
+  if (!MeshTools::UnifyIndices(data)) return std::vector<Mesh*>();
 
-  // insert boundary items into meshes
-  size_t iTargetBin = 0;
-  for (size_t i = 0;i<boundaryList.size();++i) {
-    while (basicMeshVec[iTargetBin].m_VertIndices.size()+m_VerticesPerPoly > iMaxIndexCount) {
-      ++iTargetBin;
-      if (iTargetBin >= basicMeshVec.size()) {
-        basicMeshVec.push_back(BasicMeshData());
-        break;
-      }
-    }
-
-    for (size_t j = 0;j<m_VerticesPerPoly;++j) {
-      size_t sourceIndex = boundaryList[i]+j;
-      uint32_t iNewIndex = uint32_t(basicMeshVec[iTargetBin].m_vertices.size());
-
-      basicMeshVec[iTargetBin].m_VertIndices.push_back( iNewIndex );
-      basicMeshVec[iTargetBin].m_vertices.push_back(source->m_Data.m_vertices[source->m_Data.m_VertIndices[sourceIndex]]);
-
-      if (!source->m_Data.m_NormalIndices.empty()) {
-        basicMeshVec[iTargetBin].m_NormalIndices.push_back( iNewIndex );
-        basicMeshVec[iTargetBin].m_normals.push_back(source->m_Data.m_normals[source->m_Data.m_VertIndices[sourceIndex]]);
-      }
-      if (!source->m_Data.m_TCIndices.empty()) {
-        basicMeshVec[iTargetBin].m_TCIndices.push_back( iNewIndex );
-        basicMeshVec[iTargetBin].m_texcoords.push_back(source->m_Data.m_texcoords[source->m_Data.m_VertIndices[sourceIndex]]);
-      }
-      if (!source->m_Data.m_COLIndices.empty())  {
-        basicMeshVec[iTargetBin].m_COLIndices.push_back( iNewIndex );
-        basicMeshVec[iTargetBin].m_colors.push_back(source->m_Data.m_colors[source->m_Data.m_VertIndices[sourceIndex]]);
-      }
-    }
-  }
-
-  if (bOptimize) {
-    // TODO: remove duplicate vertices
-  }
+  std::vector<BasicMeshData> basicMeshVec =
+    MeshTools::Partition(data, m_VerticesPerPoly, iMaxIndexCount);
 
-  // cleanup and convert BasicMeshData back to "full featured" mesh
-  if (source != this) delete source;
+  // convert BasicMeshData back to "full featured" mesh
   std::vector<Mesh*> meshVec(basicMeshVec.size());
   for (size_t i = 0;i<meshVec.size();++i) {
     meshVec[i] = new Mesh(basicMeshVec[i], m_KDTree != NULL, false, m_MeshDesc, m_meshType);
@@ -612,9 +464,6 @@ bool Mesh::AABBIntersect(const Ray& r, double& tmin, double& tmax) const {
 
 
 void BasicMeshData::RemoveUnusedVertices() {
-  RemoveUnusedEntries(m_VertIndices, m_vertices);
-  if (!m_NormalIndices.empty()) RemoveUnusedEntries(m_NormalIndices, m_normals);
-  if (!m_TCIndices.empty()) RemoveUnusedEntries(m_TCIndices, m_texcoords);
-  if (!m_COLIndices.empty()) RemoveUnusedEntries(m_COLIndices, m_colors);
+  MeshTools::RemoveUnused(*this);
 }
 
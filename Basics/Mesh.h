@@ -81,31 +81,8 @@ public:
   IndexVec      m_TCIndices;
   IndexVec      m_COLIndices;
 
+  // removes the entries no index refers to
   void RemoveUnusedVertices();
-
-protected:
-  template <typename T>
-  void RemoveUnusedEntries(IndexVec& indices, std::vector<T>& entries) const {
-    // compute an inverse lookup index, i.e. for each
-    // vertex, store what indices point to it
-    std::vector<size_t> inverseIndex(entries.size(),0);
-    for (size_t i = 0;i<indices.size();++i) {
-      inverseIndex[indices[i]]++;
-    }
-
-    for (int64_t i = int64_t(inverseIndex.size()-1);i>=0;--i) {
-      // unused vertex found, i.e. vertex that has no indices pointing to it
-      if (inverseIndex[size_t(i)] == 0) {
-        // shift all indices
-        for (size_t j = 0;j<indices.size();++j) {
-          if (indices[j] > size_t(i) ) indices[j]--; 
-        }
-        // delete vertex
-        entries.erase(entries.begin()+size_t(i));
-      }
-    } 
-  }
-
 };
 
 class Mesh 
@@ -158,7 +135,9 @@ public:
   bool UnifyIndices();
 
   // computes a vector of meshes whereas all of those meshes
-  // have index vectors smaller then iMaxIndexCount
+  // have less than iMaxIndexCount vertices, i.e. all indices are
+  // smaller than iMaxIndexCount, if bOptimize is set identical
+  // vertices are merged first
   std::vector<Mesh*> PartitionMesh(size_t iMaxIndexCount, bool bOptimize) const;
 
   bool HasUniformIndices() const;
@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include "MeshTools.h"
+
+using namespace tuvok;
+
+namespace {
+  const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  void RemapIndices(IndexVec& indices, const std::vector<uint32_t>& newIndex) {
+#pragma omp parallel for
+    for (int i = 0;i<int(indices.size());i++)
+      indices[i] = newIndex[indices[i]];
+  }
+
+  template<typename T>
+  size_t RemoveUnusedTemplate(IndexVec& indices, std::vector<T>& entries) {
+    std::vector<uint32_t> newIndex(entries.size(), NONE);
+    for (size_t i = 0;i<indices.size();++i) newIndex[indices[i]] = 0;
+
+    // compact in place, entries only ever move towards the front
+    uint32_t count = 0;
+    for (size_t i = 0;i<entries.size();++i) {
+      if (newIndex[i] == NONE) continue;
+      newIndex[i] = count;
+      entries[count++] = entries[i];
+    }
+    const size_t removed = entries.size() - count;
+    if (removed == 0) return 0;
+    entries.resize(count);
+    RemapIndices(indices, newIndex);
+    return removed;
+  }
+
+  template<typename T>
+  bool InRange(const IndexVec& indices, const std::vector<T>& entries) {
+    const uint32_t count = uint32_t(entries.size());
+    int bInRange = 1;
+#pragma omp parallel for reduction(&:bInRange)
+    for (int i = 0;i<int(indices.size());i++)
+      bInRange &= int(indices[i] < count);
+    return bInRange != 0;
+  }
+
+  uint64_t Mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // a cell of the welding grid, or the bits of an entry when welding
+  // bit identical entries only
+  struct Cell {
+    int64_t c[3];
+    bool operator==(const Cell& other) const {
+      return c[0] == other.c[0] && c[1] == other.c[1] && c[2] == other.c[2];
+    }
+    uint64_t Hash() const {
+      return Mix(uint64_t(c[0]) ^ Mix(uint64_t(c[1]) ^ Mix(uint64_t(c[2]))));
+    }
+  };
+
+  int64_t Bits(float f) {
+    if (f == 0.0f) f = 0.0f;  // -0 welds with 0
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return int64_t(bits);
+  }
+
+  // true if corners a and b have the same attributes, by index or by value
+  bool SameAttributes(const BasicMeshData& d, size_t a, size_t b) {
+    if (!d.m_NormalIndices.empty() &&
+        d.m_NormalIndices[a] != d.m_NormalIndices[b] &&
+        d.m_normals[d.m_NormalIndices[a]] != d.m_normals[d.m_NormalIndices[b]])
+      return false;
+    if (!d.m_TCIndices.empty() &&
+        d.m_TCIndices[a] != d.m_TCIndices[b] &&
+        d.m_texcoords[d.m_TCIndices[a]] != d.m_texcoords[d.m_TCIndices[b]])
+      return false;
+    if (!d.m_COLIndices.empty() &&
+        d.m_COLIndices[a] != d.m_COLIndices[b] &&
+        d.m_colors[d.m_COLIndices[a]] != d.m_colors[d.m_COLIndices[b]])
+      return false;
+    return true;
+  }
+}
+
+size_t MeshTools::RemoveUnusedEntries(IndexVec& indices, VertVec& entries) {
+  return RemoveUnusedTemplate(indices, entries);
+}
+
+size_t MeshTools::RemoveUnusedEntries(IndexVec& indices,
+                                      TexCoordVec& entries) {
+  return RemoveUnusedTemplate(indices, entries);
+}
+
+size_t MeshTools::RemoveUnusedEntries(IndexVec& indices, ColorVec& entries) {
+  return RemoveUnusedTemplate(indices, entries);
+}
+
+void MeshTools::RemoveUnused(BasicMeshData& data) {
+  RemoveUnusedEntries(data.m_VertIndices, data.m_vertices);
+  if (!data.m_NormalIndices.empty())
+    RemoveUnusedEntries(data.m_NormalIndices, data.m_normals);
+  if (!data.m_TCIndices.empty())
+    RemoveUnusedEntries(data.m_TCIndices, data.m_texcoords);
+  if (!data.m_COLIndices.empty())
+    RemoveUnusedEntries(data.m_COLIndices, data.m_colors);
+}
+
+size_t MeshTools::Weld(IndexVec& indices, VertVec& entries, float fEpsilon) {
+  const int n = int(entries.size());
+  if (n == 0) return 0;
+  const bool bExact = !(fEpsilon > 0);
+  const double fCellScale = bExact ? 0.0 : 0.5 / fEpsilon;
+  const float fEpsilonSq = fEpsilon*fEpsilon;
+
+  // With cells twice as wide as epsilon, whatever is close enough to an
+  // entry lies in its cell or, per axis, in the neighbor on the side of
+  // the cell's center the entry is on: eight cells to look at.
+  std::vector<Cell> cells(n);
+  std::vector<uint64_t> hashes(n);
+  std::vector<unsigned char> sides(n, 0);
+#pragma omp parallel for
+  for (int i = 0;i<n;i++) {
+    const FLOATVECTOR3& v = entries[i];
+    for (size_t a = 0;a<3;a++) {
+      if (bExact) {
+        cells[i].c[a] = Bits(v[a]);
+      } else {
+        const double s = double(v[a]) * fCellScale;
+        const double f = std::floor(s);
+        cells[i].c[a] = int64_t(f);
+        if (s - f >= 0.5) sides[i] |= (unsigned char)(1 << a);
+      }
+    }
+    hashes[i] = cells[i].Hash();
+  }
+
+  size_t iSlots = 1;
+  while (iSlots < 2*size_t(n)) iSlots <<= 1;
+  const size_t iMask = iSlots-1;
+  std::vector<uint32_t> table(iSlots, NONE);
+
+  std::vector<uint32_t> remap(n);
+  std::vector<uint32_t> kept;
+  kept.reserve(n);
+  const int iNeighbors = bExact ? 1 : 8;
+  for (int i = 0;i<n;i++) {
+    uint32_t found = NONE;
+    for (int k = 0;k<iNeighbors && found == NONE;k++) {
+      Cell cell = cells[i];
+      uint64_t h = hashes[i];
+      if (k) {
+        for (size_t a = 0;a<3;a++)
+          if (k & (1 << a)) cell.c[a] += (sides[i] & (1 << a)) ? 1 : -1;
+        h = cell.Hash();
+      }
+      for (size_t s = size_t(h) & iMask;table[s] != NONE;s = (s+1) & iMask) {
+        const uint32_t r = table[s];
+        if (!(cells[r] == cell)) continue;
+        const FLOATVECTOR3 d = entries[r] - entries[i];
+        if (bExact || (d ^ d) <= fEpsilonSq) {
+          found = r;
+          break;
+        }
+      }
+    }
+    if (found != NONE) {
+      remap[i] = remap[found];
+      continue;
+    }
+
+    size_t s = size_t(hashes[i]) & iMask;
+    while (table[s] != NONE) s = (s+1) & iMask;
+    table[s] = uint32_t(i);
+    remap[i] = uint32_t(kept.size());
+    kept.push_back(uint32_t(i));
+  }
+
+  const size_t merged = size_t(n) - kept.size();
+  if (merged == 0) return 0;
+
+  VertVec welded(kept.size());
+#pragma omp parallel for
+  for (int k = 0;k<int(kept.size());k++) welded[k] = entries[kept[k]];
+  entries.swap(welded);
+  RemapIndices(indices, remap);
+  return merged;
+}
+
+size_t MeshTools::WeldVertices(BasicMeshData& data, float fEpsilon) {
+  return Weld(data.m_VertIndices, data.m_vertices, fEpsilon);
+}
+
+size_t MeshTools::WeldNormals(BasicMeshData& data, float fEpsilon) {
+  if (data.m_NormalIndices.empty()) return 0;
+  return Weld(data.m_NormalIndices, data.m_normals, fEpsilon);
+}
+
+bool MeshTools::UnifyIndices(BasicMeshData& d) {
+  const bool bNormals = !d.m_NormalIndices.empty();
+  const bool bTexCoords = !d.m_TCIndices.empty();
+  const bool bColors = !d.m_COLIndices.empty();
+  if (!bNormals && !bTexCoords && !bColors) return true;
+
+  const size_t nCorners = d.m_VertIndices.size();
+  if ((bNormals && d.m_NormalIndices.size() != nCorners) ||
+      (bTexCoords && d.m_TCIndices.size() != nCorners) ||
+      (bColors && d.m_COLIndices.size() != nCorners)) return false;
+  if (!InRange(d.m_VertIndices, d.m_vertices) ||
+      !InRange(d.m_NormalIndices, d.m_normals) ||
+      !InRange(d.m_TCIndices, d.m_texcoords) ||
+      !InRange(d.m_COLIndices, d.m_colors)) return false;
+
+  // every vertex remembers the first corner that uses it and keeps a list
+  // of copies for corners with other attributes
+  const size_t nVerts = d.m_vertices.size();
+  std::vector<uint32_t> primary(nVerts, NONE), firstCopy(nVerts, NONE);
+  std::vector<uint32_t> copyCorner, copyNext;
+  IndexVec unified(nCorners);
+  for (size_t i = 0;i<nCorners;i++) {
+    const uint32_t v = d.m_VertIndices[i];
+    if (primary[v] == NONE) {
+      primary[v] = uint32_t(i);
+      unified[i] = v;
+      continue;
+    }
+    if (SameAttributes(d, primary[v], i)) {
+      unified[i] = v;
+      continue;
+    }
+    uint32_t c = firstCopy[v];
+    while (c != NONE && !SameAttributes(d, copyCorner[c], i)) c = copyNext[c];
+    if (c == NONE) {
+      c = uint32_t(copyCorner.size());
+      copyCorner.push_back(uint32_t(i));
+      copyNext.push_back(firstCopy[v]);
+      firstCopy[v] = c;
+    }
+    unified[i] = uint32_t(nVerts + c);
+  }
+
+  const int nNew = int(nVerts + copyCorner.size());
+  VertVec     vertices(nNew);
+  NormVec     normals(bNormals ? nNew : 0);
+  TexCoordVec texcoords(bTexCoords ? nNew : 0);
+  ColorVec    colors(bColors ? nNew : 0);
+#pragma omp parallel for
+  for (int v = 0;v<nNew;v++) {
+    const bool bCopy = size_t(v) >= nVerts;
+    const uint32_t corner = bCopy ? copyCorner[v-nVerts] : primary[v];
+    vertices[v] = d.m_vertices[bCopy ? d.m_VertIndices[corner] : v];
+    // unused vertices keep zero attributes
+    if (corner == NONE) continue;
+    if (bNormals) normals[v] = d.m_normals[d.m_NormalIndices[corner]];
+    if (bTexCoords) texcoords[v] = d.m_texcoords[d.m_TCIndices[corner]];
+    if (bColors) colors[v] = d.m_colors[d.m_COLIndices[corner]];
+  }
+
+  d.m_vertices.swap(vertices);
+  d.m_normals.swap(normals);
+  d.m_texcoords.swap(texcoords);
+  d.m_colors.swap(colors);
+  d.m_VertIndices.swap(unified);
+  if (bNormals) d.m_NormalIndices = d.m_VertIndices;
+  if (bTexCoords) d.m_TCIndices = d.m_VertIndices;
+  if (bColors) d.m_COLIndices = d.m_VertIndices;
+  return true;
+}
+
+std::vector<BasicMeshData>
+MeshTools::Partition(const BasicMeshData& d, size_t iVerticesPerPoly,
+                     size_t iMaxVertexCount) {
+  std::vector<BasicMeshData> parts;
+  const bool bNormals = !d.m_NormalIndices.empty();
+  const bool bTexCoords = !d.m_TCIndices.empty();
+  const bool bColors = !d.m_COLIndices.empty();
+  if ((bNormals && d.m_NormalIndices != d.m_VertIndices) ||
+      (bTexCoords && d.m_TCIndices != d.m_VertIndices) ||
+      (bColors && d.m_COLIndices != d.m_VertIndices)) return parts;
+  if (iVerticesPerPoly == 0) return parts;
+  iMaxVertexCount = std::max(iMaxVertexCount, iVerticesPerPoly);
+
+  // decide where each part starts and number the vertices in each part
+  const size_t nPolys = d.m_VertIndices.size() / iVerticesPerPoly;
+  if (nPolys == 0) return parts;
+  std::vector<uint32_t> stamp(d.m_vertices.size(), NONE);
+  std::vector<uint32_t> local(d.m_vertices.size());
+  IndexVec localIndices(nPolys*iVerticesPerPoly);
+  std::vector<uint32_t> partVertices;  // the source of each part's vertices
+  std::vector<size_t> firstPoly(1, 0), firstVertex(1, 0);
+  uint32_t part = 0;
+  size_t partSize = 0;
+  for (size_t p = 0;p<nPolys;p++) {
+    const uint32_t* poly = &d.m_VertIndices[p*iVerticesPerPoly];
+    size_t iNew = 0;
+    for (size_t j = 0;j<iVerticesPerPoly;j++) {
+      if (stamp[poly[j]] == part) continue;
+      if (std::find(poly, poly+j, poly[j]) == poly+j) iNew++;
+    }
+    if (partSize + iNew > iMaxVertexCount) {
+      part++;
+      partSize = 0;
+      firstPoly.push_back(p);
+      firstVertex.push_back(partVertices.size());
+    }
+    for (size_t j = 0;j<iVerticesPerPoly;j++) {
+      const uint32_t v = poly[j];
+      if (stamp[v] != part) {
+        stamp[v] = part;
+        local[v] = uint32_t(partSize++);
+        partVertices.push_back(v);
+      }
+      localIndices[p*iVerticesPerPoly+j] = local[v];
+    }
+  }
+  firstPoly.push_back(nPolys);
+  firstVertex.push_back(partVertices.size());
+
+  // and copy the parts out
+  parts.resize(firstPoly.size()-1);
+  std::exception_ptr pError;
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0;i<int(parts.size());i++) {
+    try {
+      BasicMeshData& out = parts[i];
+      const size_t v0 = firstVertex[i];
+      const size_t n = firstVertex[i+1] - v0;
+      out.m_vertices.resize(n);
+      if (bNormals) out.m_normals.resize(n);
+      if (bTexCoords) out.m_texcoords.resize(n);
+      if (bColors) out.m_colors.resize(n);
+      for (size_t k = 0;k<n;k++) {
+        const uint32_t v = partVertices[v0+k];
+        out.m_vertices[k] = d.m_vertices[v];
+        if (bNormals) out.m_normals[k] = d.m_normals[v];
+        if (bTexCoords) out.m_texcoords[k] = d.m_texcoords[v];
+        if (bColors) out.m_colors[k] = d.m_colors[v];
+      }
+      out.m_VertIndices.assign(
+        localIndices.begin() + firstPoly[i]*iVerticesPerPoly,
+        localIndices.begin() + firstPoly[i+1]*iVerticesPerPoly);
+      if (bNormals) out.m_NormalIndices = out.m_VertIndices;
+      if (bTexCoords) out.m_TCIndices = out.m_VertIndices;
+      if (bColors) out.m_COLIndices = out.m_VertIndices;
+    } catch (...) {
+#pragma omp critical (MeshPartitionError)
+      { if (!pError) pError = std::current_exception(); }
+    }
+  }
+  if (pError) std::rethrow_exception(pError);
+  return parts;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef BASICS_MESHTOOLS_H
+#define BASICS_MESHTOOLS_H
+
+#include <vector>
+#include "Mesh.h"
+
+/// Mesh post processing in linear (expected) time, for isosurfaces and
+/// imported meshes with millions of vertices.  The lookups run through
+/// hash tables or per vertex lists on one thread, everything that can be
+/// done per entry (keys, renumbering indices, copying attributes) is done
+/// on all threads.
+namespace MeshTools {
+  /// Drops the entries no index refers to and renumbers the indices; the
+  /// remaining entries keep their order.  @returns the number dropped.
+  size_t RemoveUnusedEntries(tuvok::IndexVec& indices,
+                             tuvok::VertVec& entries);
+  size_t RemoveUnusedEntries(tuvok::IndexVec& indices,
+                             tuvok::TexCoordVec& entries);
+  size_t RemoveUnusedEntries(tuvok::IndexVec& indices,
+                             tuvok::ColorVec& entries);
+
+  /// RemoveUnusedEntries for every attribute that has indices.
+  void RemoveUnused(tuvok::BasicMeshData& data);
+
+  /// Merges every entry into an earlier one at most fEpsilon away, if
+  /// there is one, found through a hash grid of 2*fEpsilon cells; with
+  /// fEpsilon 0 only bit identical entries (and 0 and -0) are merged.  The
+  /// entries that are kept keep their order, unused ones are kept, too.
+  /// @returns the number of entries merged away.
+  size_t Weld(tuvok::IndexVec& indices, tuvok::VertVec& entries,
+              float fEpsilon);
+  /// Weld for positions.  Only the vertex indices change, so a mesh with
+  /// uniform indices afterwards needs UnifyIndices before partitioning.
+  size_t WeldVertices(tuvok::BasicMeshData& data, float fEpsilon = 0.0f);
+  /// Weld for normals, if the mesh has normal indices.
+  size_t WeldNormals(tuvok::BasicMeshData& data, float fEpsilon = 0.0f);
+
+  /// Reduces the mesh to the vertex index list: every vertex keeps its
+  /// number for the first attributes it is used with and is copied for
+  /// other attributes, identical copies are shared.  Attributes without
+  /// indices stay without.  @returns false if the index lists do not match
+  /// or point out of their arrays.
+  bool UnifyIndices(tuvok::BasicMeshData& data);
+
+  /// Cuts a mesh with uniform indices into meshes of at most
+  /// iMaxVertexCount vertices each, so that every index is smaller than
+  /// iMaxVertexCount.  Primitives are taken in order and a new mesh is
+  /// started whenever the next one does not fit, which keeps neighbors
+  /// together for meshes that come out of a marching cubes run.
+  /// @returns nothing if the indices are not uniform.
+  std::vector<tuvok::BasicMeshData>
+  Partition(const tuvok::BasicMeshData& data, size_t iVerticesPerPoly,
+            size_t iMaxVertexCount);
+}
+
+#endif // BASICS_MESHTOOLS_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
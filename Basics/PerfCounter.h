@@ -37,6 +37,11 @@ enum PerfCounter {
   PERF_EO_DISK_READ,     // reading bricks from disk (milliseconds)
   PERF_EO_DECOMPRESSION, // decompressing brick data (milliseconds)
 
+  // GPU memory manager brick textures
+  PERF_GPU_BRICK_HITS,      // requested bricks already resident (counter)
+  PERF_GPU_BRICK_MISSES,    // requested bricks that must be uploaded (counter)
+  PERF_GPU_BRICK_EVICTIONS, // resident bricks deleted or replaced (counter)
+
   PERF_MM_PRECOMPUTE,    // computing min/max for new bricks (milliseconds)
   PERF_SOMETHING,        // ad hoc, always changing (milliseconds)
 
@@ -1184,8 +1184,7 @@ public:
     operator D3DXMATRIX(void) const {return toD3DXMAT();}
   #endif
 
-  // OpenGL
-  #ifdef USEGL
+  // camera matrices as OpenGL builds them, these need no GL
     static void BuildStereoLookAtAndProjection(const VECTOR3<T>& vEye,
                                                const VECTOR3<T>& vAt,
                                                const VECTOR3<T>& vUp,
@@ -1290,6 +1289,8 @@ public:
       array[ 3]= T(0);                  array[ 7]=T(0);                   array[11]=T(-1);                      array[15]=T(0);
     }
 
+  // OpenGL
+  #ifdef USEGL
     void getProjection() {
       float P[16];
       glGetFloatv(GL_PROJECTION_MATRIX,P);
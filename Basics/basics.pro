@@ -29,11 +29,13 @@ SOURCES += \
   ./MC.cpp \
   ./MemMappedFile.cpp \
   ./Mesh.cpp \
+  ./MeshTools.cpp \
   ./Plane.cpp \
   ./SystemInfo.cpp \
   ./Systeminfo/VidMemViaDDraw.cpp \
   ./Systeminfo/VidMemViaDXGI.cpp \
   ./SysTools.cpp \
+  ./Threads.cpp \
   ./Timer.cpp \
   ./ProgressTimer.cpp \
   ./Clipper.cpp
@@ -54,11 +56,13 @@ HEADERS += \
   ./MC.h \
   ./MemMappedFile.h \
   ./Mesh.h \
+  ./MeshTools.h \
   ./Plane.h \
   ./Ray.h \
   ./StdDefines.h \
   ./SystemInfo.h \
   ./SysTools.h \
+  ./Threads.h \
   ./Timer.h \
   ./ProgressTimer.h \
   ./Clipper.h \
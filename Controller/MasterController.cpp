@@ -45,6 +45,7 @@
 #include "../IO/Dataset.h"
 #include "../IO/AbstrConverter.h"
 #include "../Renderer/GPUMemMan/GPUMemMan.h"
+#include "../Renderer/CPU/CPURaycaster.h"
 #include "../Renderer/GL/GLRaycaster.h"
 #include "../Renderer/GL/GLRaycasterLava.h"
 #include "../Renderer/GL/GLGridLeaper.h"
@@ -197,6 +198,15 @@ MasterController::RequestNewVolumeRenderer(EVolumeRendererType eRendererType,
                              bDisableBorder);
     break;
 
+  case CPU_RAYCASTER :
+    api = "CPU";
+    method = "Raycaster";
+    retval = new CPURaycaster(this,
+                              bUseOnlyPowerOfTwo,
+                              bDownSampleTo8Bits,
+                              bDisableBorder);
+    break;
+
   case DIRECTX_RAYCASTER :
   case DIRECTX_2DSBVR :
   case DIRECTX_SBVR :
@@ -313,6 +323,7 @@ unsigned MasterController::GetHTSize() const {
 
 double MasterController::PerfQuery(enum PerfCounter pc) {
   assert(pc < PERF_END);
+  SCOPEDLOCK(m_PerfGuard);
   double tmp = m_Perf[pc];
   m_Perf[pc] = 0.0;
   return tmp;
@@ -320,6 +331,7 @@ double MasterController::PerfQuery(enum PerfCounter pc) {
 void MasterController::IncrementPerfCounter(enum PerfCounter pc,
                                             double amount) {
   assert(pc < PERF_END);
+  SCOPEDLOCK(m_PerfGuard);
   m_Perf[pc] += amount;
 }
 
@@ -378,6 +390,10 @@ void register_perf_enum(std::shared_ptr<LuaScripting>& ss) {
   register_unsigned(lua, "PERF_EO_DISK_READ", PERF_EO_DISK_READ);
   register_unsigned(lua, "PERF_EO_DECOMPRESSION", PERF_EO_DECOMPRESSION);
 
+  register_unsigned(lua, "PERF_GPU_BRICK_HITS", PERF_GPU_BRICK_HITS);
+  register_unsigned(lua, "PERF_GPU_BRICK_MISSES", PERF_GPU_BRICK_MISSES);
+  register_unsigned(lua, "PERF_GPU_BRICK_EVICTIONS", PERF_GPU_BRICK_EVICTIONS);
+
   register_unsigned(lua, "PERF_MM_PRECOMPUTE", PERF_MM_PRECOMPUTE);
   register_unsigned(lua, "PERF_SOMETHING", PERF_SOMETHING);
 }
@@ -405,6 +421,7 @@ void MasterController::RegisterLuaCommands() {
   AddLuaRendererType(renderer, "OpenGL_2DSBVR", OPENGL_2DSBVR);
   AddLuaRendererType(renderer, "OpenGL_Raycaster", OPENGL_RAYCASTER);
   AddLuaRendererType(renderer, "OpenGL_GridLeaper", OPENGL_GRIDLEAPER);
+  AddLuaRendererType(renderer, "CPU_Raycaster", CPU_RAYCASTER);
 
   AddLuaRendererType(renderer, "DirectX_SBVR", DIRECTX_SBVR);
   AddLuaRendererType(renderer, "DirectX_2DSBVR", DIRECTX_2DSBVR);
@@ -38,6 +38,7 @@
 #include <vector>
 
 #include "Basics/PerfCounter.h"
+#include "Basics/Threads.h"
 #include "Basics/Vectors.h"
 #include "../DebugOut/MultiplexOut.h"
 #include "../DebugOut/ConsoleOut.h"
@@ -94,6 +95,7 @@ public:
     OPENGL_GRIDLEAPER,
     DIRECTX_GRIDLEAPER,
     OPENGL_CHOOSE, ///< let the system choose for the user
+    CPU_RAYCASTER, ///< software renderer, needs no GPU
     RENDERER_LAST,
   };
 
@@ -232,6 +234,8 @@ private:
 
   /// for PerfCounter tracking.
   double m_Perf[PERF_END];
+  /// counters are bumped from brick loading threads, too.
+  CriticalSection m_PerfGuard;
 };
 
 }
@@ -1,16 +1,26 @@
-#include <algorithm>
 #include "BMinMax.h"
 #include "Basics/MinMaxBlock.h"
 #include "BrickedDataset.h"
 #include "Controller/Controller.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
 
 namespace {
+  // value and gradient magnitude range in one pass, see
+  // VolumeTools::ComputeBrickStats.
   template<typename T> tuvok::MinMaxBlock mm(const tuvok::BrickKey& bk,
                                              const tuvok::BrickedDataset& ds) {
     std::vector<T> data(ds.GetMaxBrickSize().volume());
-    ds.GetBrick(bk, data);
-    auto mmax = std::minmax_element(data.begin(), data.end());
-    return tuvok::MinMaxBlock(*mmax.first, *mmax.second, DBL_MAX, -FLT_MAX);
+    if(!ds.GetBrick(bk, data) || data.empty()) { return tuvok::MinMaxBlock(); }
+
+    // without the brick's shape there are no gradients
+    const UINTVECTOR3 n = ds.GetBrickVoxelCounts(bk);
+    const bool shaped = data.size() >= n.volume();
+    tuvok::MinMaxBlock rv;
+    VolumeTools::ComputeBrickStats(
+      &data[0], shaped ? UINT64VECTOR3(n) : UINT64VECTOR3(data.size(), 1, 1),
+      1, shaped, &rv
+    );
+    return rv;
   }
 }
 
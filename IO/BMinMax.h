@@ -7,6 +7,8 @@
 namespace tuvok {
 class BrickedDataset;
 
+/// Computes the range of the brick's values and of their gradient magnitude
+/// (central differences, in data units per voxel).
 MinMaxBlock minmax_brick(const BrickKey& bk, const BrickedDataset& ds);
 
 }
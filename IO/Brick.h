@@ -72,6 +72,11 @@ struct BKeyHash : std::unary_function<BrickKey, std::size_t> {
   }
 };
 typedef std::unordered_map<BrickKey, BrickMD, BKeyHash> BrickTable;
+/// Decides whether a box, given by its center and extents in the same space
+/// as BrickMD, can be skipped.  A box which is skipped must not contain any
+/// box which is not.
+typedef std::function<bool (const FLOATVECTOR3&, const FLOATVECTOR3&)>
+  BrickCuller;
 
 } // namespace tuvok
 
@@ -0,0 +1,107 @@
+#ifndef TUVOK_BRICK_BUFFER_H
+#define TUVOK_BRICK_BUFFER_H
+
+#include "StdTuvokDefines.h"
+#include <cassert>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace tuvok {
+
+/// A read-only view of the voxels of one brick, as given out by
+/// Dataset::GetBrickBuffer.  The buffer keeps whatever owns the memory
+/// alive: a pinned brick cache entry, a mapped region of a file, or simply a
+/// vector it adopted.  As long as you hold on to the shared_ptr, the data
+/// stay valid and are not evicted from any cache.
+class BrickBuffer {
+public:
+  /// adopts the given data; no copy is made.
+  template<typename T>
+  static std::shared_ptr<const BrickBuffer> adopt(std::vector<T>& data);
+  /// views 'elems' elements at 'data', which are kept alive by 'owner'.
+  template<typename T>
+  static std::shared_ptr<const BrickBuffer> view(
+    std::shared_ptr<const void> owner, const T* data, size_t elems
+  );
+
+  const void* data() const { return this->ptr; }
+  /// @returns the number of elements (not voxels: components count, too)
+  size_t size() const { return this->elems; }
+  size_t bytes() const { return this->elems * this->width; }
+  /// @returns the size of one element, in bytes.
+  unsigned elemWidth() const { return this->width; }
+  bool isSigned() const { return this->sign; }
+  bool isFloat() const { return this->fp; }
+
+  /// @returns true if the buffer holds elements of type T.
+  template<typename T> bool holds() const {
+    return sizeof(T) == this->width &&
+           std::is_floating_point<T>::value == this->fp &&
+           (std::is_signed<T>::value || std::is_floating_point<T>::value) ==
+             this->sign;
+  }
+  template<typename T> const T* as() const {
+    assert(this->holds<T>());
+    return static_cast<const T*>(this->ptr);
+  }
+
+private:
+  BrickBuffer(std::shared_ptr<const void> o, const void* p, size_t n,
+              unsigned w, bool s, bool f) :
+    owner(o), ptr(p), elems(n), width(w), sign(s), fp(f) {}
+
+  std::shared_ptr<const void> owner;
+  const void* ptr;
+  size_t elems;
+  unsigned width;
+  bool sign;
+  bool fp;
+};
+
+template<typename T>
+std::shared_ptr<const BrickBuffer> BrickBuffer::view(
+  std::shared_ptr<const void> owner, const T* data, size_t elems
+) {
+  return std::shared_ptr<const BrickBuffer>(new BrickBuffer(
+    owner, data, elems, sizeof(T),
+    std::is_signed<T>::value || std::is_floating_point<T>::value,
+    std::is_floating_point<T>::value
+  ));
+}
+
+template<typename T>
+std::shared_ptr<const BrickBuffer> BrickBuffer::adopt(std::vector<T>& data) {
+  std::shared_ptr<std::vector<T>> store = std::make_shared<std::vector<T>>();
+  store->swap(data);
+  return view<T>(store, store->data(), store->size());
+}
+
+}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
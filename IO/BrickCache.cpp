@@ -1,10 +1,11 @@
-#include <algorithm>
-#include <ctime>
-#include <functional>
-#include <map>
+#include <atomic>
+#include <cassert>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <unordered_map>
 #include "BrickCache.h"
-#include "Controller/StackTimer.h"
+#include "Basics/Threads.h"
 
 namespace tuvok {
 
@@ -76,237 +77,251 @@ struct TypeErase {
   {}
 };
 
-struct BrickInfo {
+// One cache entry.  Entries live in a recency list (most recently used at
+// the front); the hash table maps keys to their position in that list, so
+// finding, touching and evicting an entry are all constant time.
+// An entry is pinned while anyone outside the cache holds a reference to
+// its data: the shared_ptr inside 'data' is then not unique.  Pins are only
+// ever created with the shard lock held, so a unique pointer seen under the
+// lock really means nobody can be using the data.
+struct CacheEntry {
   BrickKey key;
-  uint64_t access_time;
-  BrickInfo(const BrickKey& k, time_t t) : key(k),
-                                           access_time(uint64_t(t)) {}
+  TypeErase data;
+  size_t bytes;
+  CacheEntry(const BrickKey& k, TypeErase&& d, size_t b) :
+    key(k), data(std::move(d)), bytes(b) {}
+  bool pinned() const { return this->data.gt.use_count() > 1; }
 };
 
-struct CacheLRU {
-  typedef std::pair<BrickInfo, TypeErase> CacheElem;
-  bool operator()(const CacheElem& a, const CacheElem& b) const {
-    return a.first.access_time > b.first.access_time;
+// the raw pointer to the data held in a type-erased vector of T.
+template<typename T>
+static const void* raw(const TypeErase& te) {
+  TypeErase::GenericType& gt = *te.gt;
+  return dynamic_cast<TypeErase::TypeEraser<std::vector<T>>&>(gt).get().data();
+}
+
+// a pin shares ownership with the entry, but points at the brick data.
+template<typename T>
+static std::shared_ptr<const void> pin(const TypeErase& te) {
+  return std::shared_ptr<const void>(te.gt, raw<T>(te));
+}
+
+// One independently locked part of the cache.  Every key lives in exactly
+// one shard, chosen by its hash.
+struct Shard {
+  typedef std::list<CacheEntry> RecencyList;
+
+  CriticalSection guard;
+  RecencyList recency; ///< front is most recently used.
+  std::unordered_map<BrickKey, RecencyList::iterator, BKeyHash> index;
+
+  // all of these must be called with 'guard' held.
+  ///@{
+  RecencyList::iterator find(const BrickKey& k) {
+    auto i = this->index.find(k);
+    if(i == this->index.end()) { return this->recency.end(); }
+    // move it to the front: it is now the most recently used entry.
+    this->recency.splice(this->recency.begin(), this->recency, i->second);
+    return i->second;
+  }
+  /// @returns the number of bytes released.
+  size_t erase(RecencyList::iterator entry) {
+    const size_t bytes = entry->bytes;
+    this->index.erase(entry->key);
+    this->recency.erase(entry);
+    return bytes;
+  }
+  /// evicts the least recently used entry which is neither pinned nor
+  /// 'keep'.  @returns the number of bytes released; 0 if nothing could go.
+  size_t evict(RecencyList::const_iterator keep) {
+    for(auto e = this->recency.rbegin(); e != this->recency.rend(); ++e) {
+      if(e->pinned() ||
+         RecencyList::const_iterator(std::prev(e.base())) == keep) {
+        continue;
+      }
+      return this->erase(std::prev(e.base()));
+    }
+    return 0;
   }
+  ///@}
 };
 
 struct BrickCache::bcinfo {
-    bcinfo(): bytes(0) {}
-    // this is wordy but they all just forward to a real implementation below.
-    const void* lookup(const BrickKey& k, uint8_t) {
-      return this->typed_lookup<uint8_t>(k);
+    explicit bcinfo(unsigned n): shards(n > 0 ? n : 1), bytes(0),
+                                 capacity(0) {}
+
+    template<typename T> const void* lookup(const BrickKey& k) {
+      Shard& s = this->shard(k);
+      SCOPEDLOCK(s.guard);
+      auto e = s.find(k);
+      return e == s.recency.end() ? NULL : raw<T>(e->data);
     }
-    const void* lookup(const BrickKey& k, uint16_t) {
-      return this->typed_lookup<uint16_t>(k);
+    template<typename T>
+    std::shared_ptr<const void> acquire(const BrickKey& k) {
+      Shard& s = this->shard(k);
+      SCOPEDLOCK(s.guard);
+      auto e = s.find(k);
+      return e == s.recency.end() ? std::shared_ptr<const void>()
+                                  : pin<T>(e->data);
     }
-    const void* lookup(const BrickKey& k, uint32_t) {
-      return this->typed_lookup<uint32_t>(k);
+
+    template<typename T>
+    const void* add(const BrickKey& k, std::vector<T>& data) {
+      return this->insert<T>(k, data, false).get();
     }
-    const void* lookup(const BrickKey& k, uint64_t) {
-      return this->typed_lookup<uint64_t>(k);
+    template<typename T>
+    std::shared_ptr<const void> store(const BrickKey& k,
+                                      std::vector<T>& data) {
+      return this->insert<T>(k, data, true);
     }
 
-    const void* lookup(const BrickKey& k, int8_t) {
-      return this->typed_lookup<int8_t>(k);
+    void remove() {
+      // the least recently used element of the fullest shard: we have no
+      // global recency order anymore, but this is the best approximation.
+      Shard* fullest = NULL;
+      size_t most = 0;
+      for(auto s = this->shards.begin(); s != this->shards.end(); ++s) {
+        SCOPEDLOCK(s->guard);
+        if(s->recency.size() > most) {
+          most = s->recency.size();
+          fullest = &*s;
+        }
+      }
+      if(fullest == NULL) { return; }
+      SCOPEDLOCK(fullest->guard);
+      this->bytes -= fullest->evict(fullest->recency.end());
     }
-    const void* lookup(const BrickKey& k, int16_t) {
-      return this->typed_lookup<int16_t>(k);
+    void clear() {
+      // pinned data stays alive through its pins; it just isn't cached.
+      for(auto s = this->shards.begin(); s != this->shards.end(); ++s) {
+        SCOPEDLOCK(s->guard);
+        while(!s->recency.empty()) {
+          this->bytes -= s->erase(s->recency.begin());
+        }
+      }
     }
-    const void* lookup(const BrickKey& k, int32_t) {
-      return this->typed_lookup<int32_t>(k);
+    size_t size() const { return this->bytes; }
+    size_t count() {
+      size_t n = 0;
+      for(auto s = this->shards.begin(); s != this->shards.end(); ++s) {
+        SCOPEDLOCK(s->guard);
+        n += s->recency.size();
+      }
+      return n;
     }
-    const void* lookup(const BrickKey& k, int64_t) {
-      return this->typed_lookup<int64_t>(k);
+    bool contains(const BrickKey& k) {
+      Shard& s = this->shard(k);
+      SCOPEDLOCK(s.guard);
+      return s.index.find(k) != s.index.end();
     }
 
-    const void* lookup(const BrickKey& k, float) {
-      return this->typed_lookup<float>(k);
+    void setCapacity(size_t cap) {
+      this->capacity = cap;
+      for(auto s = this->shards.begin(); s != this->shards.end(); ++s) {
+        this->shrink(*s, s->recency.end(), true);
+      }
     }
+    size_t getCapacity() const { return this->capacity; }
 
-    // the erasure means we can just do the insert with the thing we already
-    // have: it'll make a shared_ptr out of it and insert it into the
-    // container.
-    ///@{
-    const void* add(const BrickKey& k, std::vector<uint8_t>& data) {
-      return this->typed_add<uint8_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<uint16_t>& data) {
-      return this->typed_add<uint16_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<uint32_t>& data) {
-      return this->typed_add<uint32_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<uint64_t>& data) {
-      return this->typed_add<uint64_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<int8_t>& data) {
-      return this->typed_add<int8_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<int16_t>& data) {
-      return this->typed_add<int16_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<int32_t>& data) {
-      return this->typed_add<int32_t>(k, data);
-    }
-    const void* add(const BrickKey& k, std::vector<int64_t>& data) {
-      return this->typed_add<int64_t>(k, data);
+  private:
+    Shard& shard(const BrickKey& k) {
+      size_t h = BKeyHash()(k);
+      h ^= h >> 16;
+      return this->shards[h % this->shards.size()];
     }
-    const void* add(const BrickKey& k, std::vector<float>& data) {
-      return this->typed_add<float>(k, data);
+    bool over() const {
+      return this->capacity != 0 && this->bytes > this->capacity;
     }
-    ///@}
-    void remove() {
-      if(!cache.empty()) {
-        // libstdc++ complains it's not a heap otherwise.. somehow.  bug?
-        std::make_heap(this->cache.begin(), this->cache.end(), CacheLRU());
-        const CacheElem& entry = this->cache.front();
-        TypeErase::GenericType& gt = *(entry.second.gt);
-        assert((entry.second.width * gt.elems()) <= this->bytes);
-        this->bytes -= entry.second.width * gt.elems();
-
-        std::pop_heap(this->cache.begin(), this->cache.end(), CacheLRU());
-        this->cache.pop_back();
+    // evicts from 's' until we are within budget or nothing more can go.
+    void shrink(Shard& s, Shard::RecencyList::const_iterator keep,
+                bool lock) {
+      if(lock) { s.guard.Lock(); }
+      while(this->over()) {
+        const size_t freed = s.evict(keep);
+        if(freed == 0) { break; }
+        this->bytes -= freed;
       }
-      assert(this->size() == this->bytes);
-    }
-    void clear() {
-      this->cache.clear();
-      this->bytes = 0;
+      if(lock) { s.guard.Unlock(); }
     }
-    size_t size() const { return this->bytes; }
 
-  private:
-    template<typename T> const void* typed_lookup(const BrickKey& k);
-    template<typename T> const void* typed_add(const BrickKey&,
-                                               std::vector<T>&);
+    template<typename T>
+    std::shared_ptr<const void> insert(const BrickKey& k,
+                                       std::vector<T>& data, bool pinned) {
+      Shard& s = this->shard(k);
+      std::shared_ptr<const void> rv;
+      {
+        SCOPEDLOCK(s.guard);
+        // Two threads can miss on the same brick and both load it; the first
+        // one to get here wins and the second gets the cached copy.
+        auto dup = s.find(k);
+        if(dup != s.recency.end()) { return pin<T>(dup->data); }
+
+        const size_t nbytes = sizeof(T) * data.size();
+        s.recency.emplace_front(k, TypeErase(std::move(data)), nbytes);
+        s.index.insert(std::make_pair(k, s.recency.begin()));
+        this->bytes += nbytes;
+        // An empty cache always accepts an entry, even one larger than the
+        // whole budget; otherwise large bricks could never be cached at all.
+        // So the new entry itself is never a candidate for eviction.
+        this->shrink(s, s.recency.begin(), false);
+        const TypeErase& te = s.recency.front().data;
+        rv = pinned ? pin<T>(te)
+                    : std::shared_ptr<const void>(std::shared_ptr<void>(),
+                                                  raw<T>(te));
+      }
+      // still too big?  Our own shard has nothing left to give, so steal
+      // from the others.  We never hold two shard locks at once.
+      for(auto o = this->shards.begin(); o != this->shards.end() &&
+                                         this->over(); ++o) {
+        if(&*o != &s) { this->shrink(*o, o->recency.end(), true); }
+      }
+      return rv;
+    }
 
   private:
-    typedef std::pair<BrickInfo, TypeErase> CacheElem;
-    std::vector<CacheElem> cache;
-    size_t bytes; ///< how much memory we're currently using for data.
+    std::vector<Shard> shards;
+    std::atomic<size_t> bytes; ///< how much memory we're currently using.
+    std::atomic<size_t> capacity; ///< max bytes we may hold; 0: no limit.
 };
 
-struct KeyMatches {
-  bool operator()(const BrickKey& key,
-                  const std::pair<BrickInfo,TypeErase>& a) const {
-    return key == a.first.key;
-  }
-};
-
-// if the key doesn't exist, you get an empty vector.
-template<typename T>
-const void* BrickCache::bcinfo::typed_lookup(const BrickKey& k) {
-  using namespace std::placeholders;
-  KeyMatches km;
-  auto func = std::bind(&KeyMatches::operator(), km, k, _1);
-
-  // gcc can't seem to deduce this with 'auto'.
-  typedef std::vector<CacheElem> maptype;
-  maptype::iterator i = std::find_if(this->cache.begin(), this->cache.end(),
-                                     func);
-  if(i == this->cache.end()) { return NULL; }
-
-  i->first.access_time = time(NULL);
-  TypeErase::GenericType& gt = *(i->second.gt);
-  assert(this->size() == this->bytes);
-  return dynamic_cast<TypeErase::TypeEraser<std::vector<T>>&>(gt).get().data();
-}
-
-template<typename T>
-const void* BrickCache::bcinfo::typed_add(const BrickKey& k,
-                                          std::vector<T>& data) {
-  // maybe the case of a general cache allows duplicate insert, but for our uses
-  // there should never be a duplicate entry.
-#ifndef NDEBUG
-  KeyMatches km;
-  using namespace std::placeholders;
-  auto func = std::bind(&KeyMatches::operator(), km, k, _1);
-  assert(std::find_if(this->cache.begin(), this->cache.end(), func) ==
-         this->cache.end());
-#endif
-  this->bytes += sizeof(T) * data.size();
-  this->cache.push_back(std::make_pair(BrickInfo(k, time(NULL)),
-                        std::move(data)));
-
-  assert(this->size() == this->bytes);
-  TypeErase::GenericType& gt = *this->cache.back().second.gt;
-  return dynamic_cast<TypeErase::TypeEraser<std::vector<T>>&>(gt).get().data();
-}
-
-BrickCache::BrickCache() : ci(new BrickCache::bcinfo) {}
+BrickCache::BrickCache(unsigned shards) : ci(new BrickCache::bcinfo(shards)) {}
 BrickCache::~BrickCache() {}
 
-const void* BrickCache::lookup(const BrickKey& k, uint8_t value) {
-  return this->ci->lookup(k, value);
-}
-const void* BrickCache::lookup(const BrickKey& k, uint16_t value) {
-  return this->ci->lookup(k, value);
-}
-const void* BrickCache::lookup(const BrickKey& k, uint32_t value) {
-  return this->ci->lookup(k, value);
-}
-const void* BrickCache::lookup(const BrickKey& k, uint64_t value) {
-  return this->ci->lookup(k, value);
-}
-
-const void* BrickCache::lookup(const BrickKey& k, int8_t value) {
-  return this->ci->lookup(k, value);
-}
-const void* BrickCache::lookup(const BrickKey& k, int16_t value) {
-  return this->ci->lookup(k, value);
-}
-const void* BrickCache::lookup(const BrickKey& k, int32_t value) {
-  return this->ci->lookup(k, value);
-}
-const void* BrickCache::lookup(const BrickKey& k, int64_t value) {
-  return this->ci->lookup(k, value);
-}
-
-const void* BrickCache::lookup(const BrickKey& k, float value) {
-  return this->ci->lookup(k, value);
-}
-
-
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<uint8_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<uint16_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<uint32_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<uint64_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                           std::vector<int8_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<int16_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<int32_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                            std::vector<int64_t>& data) {
-  return this->ci->add(k, data);
-}
-const void* BrickCache::add(const BrickKey& k,
-                          std::vector<float>& data) {
-  return this->ci->add(k, data);
-}
+// this is wordy but they all just forward to the typed implementations.
+#define BCACHE_TYPED(T) \
+  const void* BrickCache::lookup(const BrickKey& k, T) { \
+    return this->ci->lookup<T>(k); \
+  } \
+  std::shared_ptr<const void> BrickCache::acquire(const BrickKey& k, T) { \
+    return this->ci->acquire<T>(k); \
+  } \
+  const void* BrickCache::add(const BrickKey& k, std::vector<T>& data) { \
+    return this->ci->add<T>(k, data); \
+  } \
+  std::shared_ptr<const void> \
+  BrickCache::store(const BrickKey& k, std::vector<T>& data) { \
+    return this->ci->store<T>(k, data); \
+  }
+BCACHE_TYPED(uint8_t)
+BCACHE_TYPED(uint16_t)
+BCACHE_TYPED(uint32_t)
+BCACHE_TYPED(uint64_t)
+BCACHE_TYPED(int8_t)
+BCACHE_TYPED(int16_t)
+BCACHE_TYPED(int32_t)
+BCACHE_TYPED(int64_t)
+BCACHE_TYPED(float)
+#undef BCACHE_TYPED
 
 void BrickCache::remove() { this->ci->remove(); }
 void BrickCache::clear() { return this->ci->clear(); }
 size_t BrickCache::size() const { return this->ci->size(); }
+size_t BrickCache::count() const { return this->ci->count(); }
+bool BrickCache::contains(const BrickKey& k) const {
+  return this->ci->contains(k);
+}
+void BrickCache::setCapacity(size_t bytes) { this->ci->setCapacity(bytes); }
+size_t BrickCache::getCapacity() const { return this->ci->getCapacity(); }
 
 }
 /*
@@ -9,16 +9,26 @@ namespace tuvok {
 
 // Implements a simple brick cache: associates a chunk of data with the given
 // brick key.
-// Lookup of a nonexistent key results in an empty vector: there is no way to
-// tell whether a key doesn't exist, or whether the data it stores is actually
+// Entries are hashed by their key and kept in least-recently-used order, so
+// lookups, inserts and evictions are all constant time.
+// The cache is safe to use from multiple threads.  It is split into shards,
+// each with its own lock, so threads working on different bricks rarely
+// contend.  Recency is exact within a shard; eviction prefers the shard
+// that is being added to.
+// Lookup of a nonexistent key results in NULL: there is no way to tell
+// whether a key doesn't exist, or whether the data it stores is actually
 // empty.
 class BrickCache {
   public:
-    BrickCache();
+    /// @param shards number of independently locked parts.  Use 1 for
+    ///        single threaded use; recency is then exact cache-wide.
+    explicit BrickCache(unsigned shards=1);
     ~BrickCache();
 
     /// looks up a value in the cache, and fills the second argument if it
     /// exists.
+    /// @warning the pointer is not pinned: a concurrent add() may evict the
+    ///          brick while you use it.  Prefer acquire() with threads.
     ///@{
     const void* lookup(const BrickKey&, uint8_t);
     const void* lookup(const BrickKey&, uint16_t);
@@ -31,7 +41,27 @@ class BrickCache {
     const void* lookup(const BrickKey&, float);
     ///@}
 
+    /// looks up a value in the cache and pins it: the brick will not be
+    /// evicted while the returned pointer (or a copy of it) is alive.
+    /// Empty if the key is not cached.
+    ///@{
+    std::shared_ptr<const void> acquire(const BrickKey&, uint8_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, uint16_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, uint32_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, uint64_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, int8_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, int16_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, int32_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, int64_t);
+    std::shared_ptr<const void> acquire(const BrickKey&, float);
+    ///@}
+
     /// These return their argument for ease of use.
+    /// If a capacity is set, least recently used entries are evicted until
+    /// the new data fits.  An empty cache always accepts the data, even if
+    /// it is larger than the capacity.
+    /// If the key is already cached (another thread was faster), the
+    /// argument is left alone and the cached data is returned instead.
     ///@{
     const void* add(const BrickKey&, std::vector<uint8_t>&);
     const void* add(const BrickKey&, std::vector<uint16_t>&);
@@ -44,13 +74,37 @@ class BrickCache {
     const void* add(const BrickKey&, std::vector<float>&);
     ///@}
 
-    /// removes the most appropriate element.
+    /// like add(), but the returned data is pinned as with acquire().
+    ///@{
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<uint8_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<uint16_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<uint32_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<uint64_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<int8_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<int16_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<int32_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<int64_t>&);
+    std::shared_ptr<const void> store(const BrickKey&, std::vector<float>&);
+    ///@}
+
+    /// removes the least recently used, unpinned element.
     void remove();
 
     /// @returns cache size currently in use (in bytes)
     size_t size() const;
-
-    /// empties the cache.
+    /// @returns the number of bricks currently cached
+    size_t count() const;
+    /// @returns true if the key is cached.  Unlike lookup() this does not
+    /// count as a use: the brick keeps its place in the eviction order.
+    bool contains(const BrickKey&) const;
+
+    /// sets the maximum number of bytes the cache may hold, evicting as
+    /// needed.  0 (the default) means the cache is unbounded.  Pinned bricks
+    /// are never evicted, so the cache can temporarily exceed this.
+    void setCapacity(size_t bytes);
+    size_t getCapacity() const;
+
+    /// empties the cache.  Pinned data stays valid until it is released.
     void clear();
 
   private:
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include "BrickPrefetcher.h"
+#include "Controller/Controller.h"
+
+namespace tuvok {
+
+BrickPrefetcher::BrickPrefetcher(LoadFunction load, unsigned threads) :
+  m_Load(load),
+  m_bStop(false)
+{
+  if(threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  for(unsigned i=0; i < threads; ++i) {
+    m_Workers.push_back(std::unique_ptr<LambdaThread>(new LambdaThread(
+      [this](bool const&, LambdaThread::Interface&) { this->Run(); }
+    )));
+    m_Workers.back()->StartThread();
+  }
+}
+
+BrickPrefetcher::~BrickPrefetcher() {
+  {
+    SCOPEDLOCK(m_Guard);
+    m_Queue.clear();
+    m_bStop = true;
+    m_WorkAvailable.WakeAll();
+  }
+  for(auto w = m_Workers.begin(); w != m_Workers.end(); ++w) {
+    (*w)->JoinThread();
+  }
+}
+
+void BrickPrefetcher::Request(const std::vector<BrickKey>& keys) {
+  SCOPEDLOCK(m_Guard);
+  m_Queue.assign(keys.begin(), keys.end());
+  m_WorkAvailable.WakeAll();
+}
+
+void BrickPrefetcher::Cancel() {
+  SCOPEDLOCK(m_Guard);
+  m_Queue.clear();
+  // nothing pending anymore; wake up anyone in Wait() if we're idle.
+  m_BrickDone.WakeAll();
+}
+
+void BrickPrefetcher::Wait() {
+  SCOPEDLOCK(m_Guard);
+  while(!m_Queue.empty() || !m_InFlight.empty()) {
+    m_BrickDone.Wait(m_Guard);
+  }
+}
+
+void BrickPrefetcher::WaitFor(const BrickKey& key) {
+  SCOPEDLOCK(m_Guard);
+  while(IsInFlight(key)) {
+    m_BrickDone.Wait(m_Guard);
+  }
+}
+
+size_t BrickPrefetcher::Pending() const {
+  SCOPEDLOCK(m_Guard);
+  return m_Queue.size();
+}
+
+// must hold m_Guard.
+bool BrickPrefetcher::IsInFlight(const BrickKey& key) const {
+  return std::find(m_InFlight.begin(), m_InFlight.end(), key) !=
+         m_InFlight.end();
+}
+
+void BrickPrefetcher::Run() {
+  for(;;) {
+    BrickKey key;
+    {
+      SCOPEDLOCK(m_Guard);
+      while(m_Queue.empty() && !m_bStop) {
+        m_WorkAvailable.Wait(m_Guard);
+      }
+      if(m_bStop) { return; }
+      key = m_Queue.front();
+      m_Queue.pop_front();
+      // two requests in a row could name the same brick; don't load it twice.
+      if(IsInFlight(key)) { continue; }
+      m_InFlight.push_back(key);
+    }
+
+    // a failed prefetch is not fatal: the consumer reads the brick itself
+    // when it actually needs it, and reports the error then.
+    try {
+      m_Load(key);
+    } catch(const std::exception& e) {
+      WARNING("prefetching brick <%u,%u,%u> failed: %s",
+              unsigned(std::get<0>(key)), unsigned(std::get<1>(key)),
+              unsigned(std::get<2>(key)), e.what());
+    }
+
+    SCOPEDLOCK(m_Guard);
+    m_InFlight.erase(std::find(m_InFlight.begin(), m_InFlight.end(), key));
+    m_BrickDone.WakeAll();
+  }
+}
+
+}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,88 @@
+#ifndef TUVOK_BRICK_PREFETCHER_H
+#define TUVOK_BRICK_PREFETCHER_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Basics/Threads.h"
+#include "Brick.h"
+
+namespace tuvok {
+
+/// Loads bricks ahead of demand on a pool of worker threads.
+/// The prefetcher does not know what "loading" means: it calls the given
+/// function for every requested key, in request order, and that function
+/// is expected to put the brick wherever the consumer will look for it
+/// (typically a BrickCache).  The load function must be thread safe.
+/// Requests replace each other: when the view changes, bricks which were
+/// requested for the old view but not started yet are simply dropped.
+class BrickPrefetcher {
+  public:
+    typedef std::function<void (const BrickKey&)> LoadFunction;
+
+    /// @param threads number of workers; 0 picks one per hardware thread.
+    explicit BrickPrefetcher(LoadFunction load, unsigned threads=0);
+    /// stops all workers.  Loads in flight are finished first.
+    ~BrickPrefetcher();
+
+    /// replaces the list of pending bricks.  Keys should be sorted by
+    /// priority, most important first.
+    void Request(const std::vector<BrickKey>& keys);
+    /// drops all pending requests.  Loads already in flight still finish.
+    void Cancel();
+    /// blocks until nothing is pending or in flight anymore.
+    void Wait();
+    /// blocks while the given brick is being loaded by a worker, so the
+    /// caller does not read the same brick a second time.
+    void WaitFor(const BrickKey&);
+
+    /// @returns the number of bricks which are requested but not started.
+    size_t Pending() const;
+    size_t Threads() const { return m_Workers.size(); }
+
+  private:
+    void Run();
+    bool IsInFlight(const BrickKey&) const;
+
+    LoadFunction                              m_Load;
+    mutable CriticalSection                   m_Guard;
+    WaitCondition                             m_WorkAvailable;
+    WaitCondition                             m_BrickDone;
+    std::deque<BrickKey>                      m_Queue;
+    std::vector<BrickKey>                     m_InFlight;
+    bool                                      m_bStop;
+    std::vector<std::unique_ptr<LambdaThread>> m_Workers;
+
+    BrickPrefetcher(const BrickPrefetcher&);
+    BrickPrefetcher& operator=(const BrickPrefetcher&);
+};
+
+}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <limits>
+#include "BrickTree.h"
+
+namespace tuvok {
+
+namespace {
+  struct Task {
+    uint32_t iFirst;
+    uint32_t iCount;
+    uint32_t iParent; ///< whose second child this is, or 'none'
+  };
+  const uint32_t none = std::numeric_limits<uint32_t>::max();
+}
+
+BrickTree::BrickTree(const std::vector<BrickTable::const_iterator>& vBricks)
+  : m_vBricks(vBricks)
+{
+  if(m_vBricks.empty()) { return; }
+  m_vNodes.reserve(2*m_vBricks.size());
+
+  std::vector<uint32_t> vOrder(m_vBricks.size());
+  std::vector<FLOATVECTOR3> vCenters(m_vBricks.size());
+  for(size_t i=0; i < m_vBricks.size(); ++i) {
+    vOrder[i] = uint32_t(i);
+    vCenters[i] = m_vBricks[i]->second.center;
+  }
+
+  // the tree is built depth first, so the first child of a node is always
+  // the next one; the index of the second is filled in once we get there.
+  std::vector<Task> vStack;
+  Task root = { 0, uint32_t(m_vBricks.size()), none };
+  vStack.push_back(root);
+  while(!vStack.empty()) {
+    const Task t = vStack.back();
+    vStack.pop_back();
+
+    const uint32_t iNode = uint32_t(m_vNodes.size());
+    if(t.iParent != none) { m_vNodes[t.iParent].iIndex = iNode; }
+
+    const BrickMD& front = m_vBricks[vOrder[t.iFirst]]->second;
+    FLOATVECTOR3 vMin(front.center - front.extents*0.5f);
+    FLOATVECTOR3 vMax(front.center + front.extents*0.5f);
+    FLOATVECTOR3 vCenterMin(front.center), vCenterMax(front.center);
+    for(uint32_t i=t.iFirst+1; i < t.iFirst+t.iCount; ++i) {
+      const BrickMD& md = m_vBricks[vOrder[i]]->second;
+      vMin.StoreMin(md.center - md.extents*0.5f);
+      vMax.StoreMax(md.center + md.extents*0.5f);
+      vCenterMin.StoreMin(md.center);
+      vCenterMax.StoreMax(md.center);
+    }
+    Node n;
+    n.vCenter = (vMin + vMax) * 0.5f;
+    n.vExtents = vMax - vMin;
+    n.fSplit = 0.0f;
+    n.iAxis = 3;
+    n.iIndex = t.iFirst;
+    n.iCount = t.iCount;
+
+    // split along the axis along which the centers spread the most.  If
+    // they do not spread at all, all bricks share their center; such a
+    // (degenerate) set stays in one leaf.
+    const FLOATVECTOR3 vSpread = vCenterMax - vCenterMin;
+    const uint32_t iAxis = vSpread.x >= vSpread.y ?
+                             (vSpread.x >= vSpread.z ? 0 : 2) :
+                             (vSpread.y >= vSpread.z ? 1 : 2);
+    if(t.iCount > 1 && vSpread[iAxis] > 0.0f) {
+      std::vector<uint32_t>::iterator first = vOrder.begin() + t.iFirst;
+      std::vector<uint32_t>::iterator last = first + t.iCount;
+      std::vector<uint32_t>::iterator mid = first + t.iCount/2;
+      std::nth_element(first, mid, last, [&](uint32_t a, uint32_t b) {
+        return vCenters[a][iAxis] < vCenters[b][iAxis];
+      });
+      const float fMedian = vCenters[*mid][iAxis];
+      mid = std::partition(first, last, [&](uint32_t a) {
+        return vCenters[a][iAxis] < fMedian;
+      });
+      // the median may also be the minimum; since the centers spread, it
+      // cannot be the maximum as well.
+      if(mid == first) {
+        mid = std::partition(first, last, [&](uint32_t a) {
+          return vCenters[a][iAxis] <= fMedian;
+        });
+      }
+      // the plane lies between the faces of the two halves; for a grid
+      // of bricks that is the face they share.
+      float fLeft = -std::numeric_limits<float>::max();
+      float fRight = std::numeric_limits<float>::max();
+      for(std::vector<uint32_t>::iterator i=first; i != mid; ++i) {
+        const BrickMD& md = m_vBricks[*i]->second;
+        fLeft = std::max(fLeft, md.center[iAxis] + md.extents[iAxis]*0.5f);
+      }
+      for(std::vector<uint32_t>::iterator i=mid; i != last; ++i) {
+        const BrickMD& md = m_vBricks[*i]->second;
+        fRight = std::min(fRight, md.center[iAxis] - md.extents[iAxis]*0.5f);
+      }
+      n.fSplit = (fLeft + fRight) * 0.5f;
+      n.iAxis = iAxis;
+      n.iIndex = 0;
+      n.iCount = 0;
+
+      const uint32_t iLeft = uint32_t(mid - first);
+      Task right = { t.iFirst+iLeft, t.iCount-iLeft, iNode };
+      Task left = { t.iFirst, iLeft, none };
+      vStack.push_back(right);
+      vStack.push_back(left);
+    }
+    m_vNodes.push_back(n);
+  }
+
+  std::vector<BrickTable::const_iterator> vSorted(m_vBricks.size());
+  for(size_t i=0; i < vOrder.size(); ++i) {
+    vSorted[i] = m_vBricks[vOrder[i]];
+  }
+  m_vBricks.swap(vSorted);
+}
+
+void BrickTree::Query(const FLOATVECTOR3& vEye, const BrickCuller& cull,
+                       std::vector<BrickTable::const_iterator>& vBricks) const
+{
+  if(m_vNodes.empty()) { return; }
+
+  std::vector<uint32_t> vStack(1, 0);
+  while(!vStack.empty()) {
+    const uint32_t iNode = vStack.back();
+    vStack.pop_back();
+    const Node& n = m_vNodes[iNode];
+    if(cull && cull(n.vCenter, n.vExtents)) { continue; }
+
+    if(n.iAxis == 3) {
+      for(uint32_t i=n.iIndex; i < n.iIndex+n.iCount; ++i) {
+        const BrickMD& md = m_vBricks[i]->second;
+        if(n.iCount == 1 || !cull || !cull(md.center, md.extents)) {
+          vBricks.push_back(m_vBricks[i]);
+        }
+      }
+      continue;
+    }
+    // the near child goes on top of the stack
+    if(vEye[n.iAxis] < n.fSplit) {
+      vStack.push_back(n.iIndex);
+      vStack.push_back(iNode+1);
+    } else {
+      vStack.push_back(iNode+1);
+      vStack.push_back(n.iIndex);
+    }
+  }
+}
+
+}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,74 @@
+#ifndef TUVOK_BRICK_TREE_H
+#define TUVOK_BRICK_TREE_H
+
+#include <vector>
+#include "Brick.h"
+
+namespace tuvok {
+
+/// Spatial index over the bricks of one LoD and timestep.
+/// A k-d tree with one brick per leaf (or several sharing one center):
+/// every inner node splits its bricks at the median of their centers,
+/// along the axis in which the centers spread the most, so the children
+/// are separated by a plane.  Visiting the child on the eye's side of that
+/// plane first therefore yields the bricks front to back, without sorting
+/// them, and a culled node takes all of its bricks with it.
+/// The index refers to the bricks by iterator; it must be rebuilt whenever
+/// bricks are added to the table.
+class BrickTree {
+public:
+  explicit BrickTree(const std::vector<BrickTable::const_iterator>& vBricks);
+
+  size_t GetBrickCount() const { return m_vBricks.size(); }
+
+  /// Appends the bricks whose boxes pass 'cull' to vBricks, ordered front
+  /// to back as seen from vEye.  Both the eye and the boxes handed to the
+  /// culler are in the space of the bricks' metadata.  An empty culler
+  /// passes every brick.
+  void Query(const FLOATVECTOR3& vEye, const BrickCuller& cull,
+             std::vector<BrickTable::const_iterator>& vBricks) const;
+
+private:
+  struct Node {
+    FLOATVECTOR3 vCenter;  ///< bounding box of all bricks below
+    FLOATVECTOR3 vExtents;
+    float fSplit;          ///< position of the splitting plane
+    uint32_t iAxis;        ///< of the splitting plane; 3 for leaves
+    uint32_t iIndex;       ///< leaves: first brick, else: second child
+    uint32_t iCount;       ///< leaves: number of bricks
+  };
+
+  /// bricks in tree order; every leaf covers a contiguous range
+  std::vector<BrickTable::const_iterator> m_vBricks;
+  /// in depth first order, so the first child follows its parent
+  std::vector<Node> m_vNodes;
+};
+
+}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
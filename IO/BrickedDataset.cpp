@@ -34,11 +34,12 @@
 #include <cassert>
 #include <stdexcept>
 #include "BrickedDataset.h"
+#include "BrickTree.h"
 #include "Controller/Controller.h"
 
 namespace tuvok {
 
-BrickedDataset::BrickedDataset() { }
+BrickedDataset::BrickedDataset() : m_bIndicesValid(false) { }
 BrickedDataset::~BrickedDataset() { }
 
 void BrickedDataset::NBricksHint(size_t n) {
@@ -63,7 +64,9 @@ void BrickedDataset::AddBrick(const BrickKey& bk,
           static_cast<unsigned>(brick.n_voxels[1]),
           static_cast<unsigned>(brick.n_voxels[2]));
 #endif
+  SCOPEDLOCK(m_IndexGuard);
   this->bricks.insert(std::make_pair(bk, brick));
+  m_bIndicesValid = false;
 }
 
 /// Looks up the spatial range of a brick.
@@ -101,15 +104,56 @@ BrickTable::const_iterator BrickedDataset::BricksEnd() const
 /// @return the number of bricks at the given LOD.
 BrickTable::size_type BrickedDataset::GetBrickCount(size_t lod, size_t ts) const
 {
-  BrickTable::size_type count = 0;
-  BrickTable::const_iterator iter = this->bricks.begin();
-  for(; iter != this->bricks.end(); ++iter) {
-    if(std::get<0>(iter->first) == ts &&
-       std::get<1>(iter->first) == lod) {
-      ++count;
-    }
+  SCOPEDLOCK(m_IndexGuard);
+  SortBricks();
+  const LoDTimestep key(lod, ts);
+  auto index = m_Indices.find(key);
+  if(index != m_Indices.end()) { return index->second->GetBrickCount(); }
+  auto unindexed = m_UnindexedBricks.find(key);
+  return unindexed == m_UnindexedBricks.end() ? 0 : unindexed->second.size();
+}
+
+void BrickedDataset::GetBricksFrontToBack(
+  size_t lod, size_t ts, const FLOATVECTOR3& vEye, const BrickCuller& cull,
+  std::vector<BrickTable::const_iterator>& vBricks) const
+{
+  GetIndex(lod, ts)->Query(vEye, cull, vBricks);
+}
+
+std::shared_ptr<const BrickTree>
+BrickedDataset::GetIndex(size_t lod, size_t ts) const
+{
+  SCOPEDLOCK(m_IndexGuard);
+  SortBricks();
+  const LoDTimestep key(lod, ts);
+  auto index = m_Indices.find(key);
+  if(index != m_Indices.end()) { return index->second; }
+
+  std::shared_ptr<const BrickTree> result;
+  auto unindexed = m_UnindexedBricks.find(key);
+  if(unindexed == m_UnindexedBricks.end()) {
+    result.reset(new BrickTree(std::vector<BrickTable::const_iterator>()));
+  } else {
+    result.reset(new BrickTree(unindexed->second));
+    m_UnindexedBricks.erase(unindexed);
+  }
+  m_Indices[key] = result;
+  return result;
+}
+
+// sorts all bricks by LoD + timestep in one go; the indices are only built
+// for the ones which are asked for.
+void BrickedDataset::SortBricks() const
+{
+  if(m_bIndicesValid) { return; }
+  m_UnindexedBricks.clear();
+  m_Indices.clear();
+  for(BrickTable::const_iterator b = this->bricks.begin();
+      b != this->bricks.end(); ++b) {
+    m_UnindexedBricks[LoDTimestep(std::get<1>(b->first),
+                                  std::get<0>(b->first))].push_back(b);
   }
-  return count;
+  m_bIndicesValid = true;
 }
 
 size_t BrickedDataset::GetLargestSingleBrickLOD(size_t ts) const {
@@ -174,7 +218,9 @@ BrickedDataset::BrickIsLastInDimension(size_t dim, const BrickKey& k) const
 
 void BrickedDataset::Clear() {
   MESSAGE("Clearing brick metadata.");
+  SCOPEDLOCK(m_IndexGuard);
   bricks.clear();
+  m_bIndicesValid = false;
 }
 
 } // namespace tuvok
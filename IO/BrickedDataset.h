@@ -35,11 +35,16 @@
 #ifndef TUVOK_BRICKED_DATASET_H
 #define TUVOK_BRICKED_DATASET_H
 
+#include <map>
+#include <memory>
 #include "Basics/MinMaxBlock.h"
+#include "Basics/Threads.h"
 #include "Dataset.h"
 
 namespace tuvok {
 
+class BrickTree;
+
 /// Base for data sets which split their data into blocks.  All bricks are kept
 /// into an internal table; derived classes should add to it via AddBrick.
 /// This class then handles the query of much meta data.
@@ -59,6 +64,9 @@ public:
   /// @return the number of bricks at the given LOD + timestep
   virtual BrickTable::size_type GetBrickCount(size_t lod, size_t ts) const;
   virtual size_t GetLargestSingleBrickLOD(size_t ts) const;
+  virtual void GetBricksFrontToBack(
+    size_t lod, size_t ts, const FLOATVECTOR3& vEye, const BrickCuller& cull,
+    std::vector<BrickTable::const_iterator>& vBricks) const;
   virtual uint64_t GetTotalBrickCount() const;
 
   virtual const BrickMD& GetBrickMetadata(const BrickKey&) const;
@@ -93,6 +101,22 @@ protected:
 
 protected:
   BrickTable bricks;
+
+private:
+  typedef std::pair<size_t, size_t> LoDTimestep;
+  /// @returns the spatial index of the given LoD + timestep, built on first
+  /// use.
+  std::shared_ptr<const BrickTree> GetIndex(size_t lod, size_t ts) const;
+  /// fills m_UnindexedBricks if the bricks changed; needs m_IndexGuard
+  void SortBricks() const;
+
+  mutable CriticalSection m_IndexGuard;
+  /// bricks of each LoD + timestep which have no index yet
+  mutable std::map<LoDTimestep, std::vector<BrickTable::const_iterator>>
+    m_UnindexedBricks;
+  mutable std::map<LoDTimestep, std::shared_ptr<const BrickTree>> m_Indices;
+  /// false if the two maps above are out of date
+  mutable bool m_bIndicesValid;
 };
 
 } // namespace tuvok
@@ -36,13 +36,18 @@
 */
 
 #include <algorithm>
+#include <exception>
+#include <fstream>
 #include <functional>
+#include <streambuf>
 #include <sys/stat.h>
 #include <vector>
 #include "DICOMParser.h"
 
 #include <Controller/Controller.h>
 #include <Basics/SysTools.h>
+#include <Basics/Threads.h>
+#include <IO/DirectoryScanCache.h>
 
 #ifdef DEBUG_DICOM
   #define DICOM_DBG(...) Console::printf(__VA_ARGS__)
@@ -90,6 +95,49 @@ std::string DICOM_TypeStrings[28] = {
 
 using namespace std;
 
+// Headers are parsed on several threads, but the debug output is not
+// thread safe.
+static tuvok::CriticalSection logGuard;
+#define DICOM_MESSAGE(...) \
+  do { SCOPEDLOCK(logGuard); MESSAGE(__VA_ARGS__); } while(0)
+#define DICOM_WARNING(...) \
+  do { SCOPEDLOCK(logGuard); WARNING(__VA_ARGS__); } while(0)
+#define DICOM_ERROR(...) \
+  do { SCOPEDLOCK(logGuard); T_ERROR(__VA_ARGS__); } while(0)
+
+namespace {
+  // Most headers fit into this much of the file; reading it in one go is
+  // a lot cheaper than the many small reads the parser does.
+  const uint64_t iHeaderPrefix = 64*1024;
+
+  // Read-only, seekable stream buffer over a block of memory.
+  class MemoryBuffer : public std::streambuf {
+  public:
+    MemoryBuffer(char* data, size_t length) {
+      setg(data, data, data+length);
+    }
+
+  protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode) {
+      off_type base = 0;
+      if(dir == std::ios_base::cur) { base = gptr() - eback(); }
+      else if(dir == std::ios_base::end) { base = egptr() - eback(); }
+      return seek(base + off);
+    }
+    pos_type seekpos(pos_type pos, std::ios_base::openmode) {
+      return seek(off_type(pos));
+    }
+
+  private:
+    pos_type seek(off_type pos) {
+      if(pos < 0 || pos > egptr() - eback()) { return pos_type(off_type(-1)); }
+      setg(eback(), eback() + pos, egptr());
+      return pos_type(pos);
+    }
+  };
+}
+
 DICOMParser::DICOMParser(void)
 {
 }
@@ -111,13 +159,57 @@ void DICOMParser::GetDirInfo(string  strDirectory) {
   vector<string> files = SysTools::GetDirContents(strDirectory);
   vector<DICOMFileInfo> fileInfos;
 
-  // query directory for DICOM files
-  for (size_t i = 0;i<files.size();i++) {
-    MESSAGE("Looking for DICOM data in file %s", files[i].c_str());
-    DICOMFileInfo info;
-    if (GetDICOMFileInfo(files[i], info)) {
-      fileInfos.push_back(info);
+  // query directory for DICOM files.  Parsing the headers is dominated by
+  // file system latency, so it pays to have many files in flight; files
+  // which did not change since the last scan are not parsed at all.
+  if (!files.empty()) {
+    tuvok::DirectoryScanCache cache(strDirectory, "dicom");
+    vector<DICOMFileInfo> infos(files.size());
+    vector<LARGE_STAT_BUFFER> stats(files.size());
+    vector<char> hasStat(files.size(), 0);
+    vector<char> valid(files.size(), 0);
+    size_t iCached = 0;
+    std::exception_ptr error;
+
+#pragma omp parallel for schedule(dynamic) num_threads(ScanThreads(files.size()))
+    for (int i = 0; i < int(files.size()); ++i) {
+      try {
+        if (!SysTools::GetFileStats(files[i], stats[i])) continue;
+        hasStat[i] = 1;
+
+        string record;
+        if (cache.Lookup(files[i], stats[i], record)) {
+          if (record.empty()) continue; // known not to be a DICOM
+          if (infos[i].FromCacheRecord(files[i], record)) {
+            valid[i] = 1;
+#pragma omp atomic
+            ++iCached;
+            continue;
+          }
+          infos[i] = DICOMFileInfo();
+        }
+        valid[i] = GetDICOMFileInfo(files[i], infos[i]) ? 1 : 0;
+      } catch (...) {
+#pragma omp critical (DICOMScanError)
+        {
+          if (!error) { error = std::current_exception(); }
+        }
+      }
+    }
+    if (error) { std::rethrow_exception(error); }
+
+    for (size_t i = 0; i<files.size(); i++) {
+      if (hasStat[i]) {
+        cache.Store(files[i], stats[i],
+                    valid[i] ? infos[i].ToCacheRecord() : string());
+      }
+      if (valid[i]) fileInfos.push_back(infos[i]);
     }
+    cache.Save();
+    MESSAGE("Scanned %u files: %u DICOMs, %u of them from the cache.",
+            static_cast<unsigned>(files.size()),
+            static_cast<unsigned>(fileInfos.size()),
+            static_cast<unsigned>(iCached));
   }
 
   // sort results into stacks
@@ -160,7 +252,7 @@ void DICOMParser::GetDirInfo(wstring wstrDirectory) {
   GetDirInfo(strDirectory);
 }
 
-void DICOMParser::ReadHeaderElemStart(ifstream& fileDICOM, short& iGroupID, short& iElementID, DICOM_eType& eElementType, uint32_t& iElemLength, bool bImplicit, bool bNeedsEndianConversion) {
+void DICOMParser::ReadHeaderElemStart(istream& fileDICOM, short& iGroupID, short& iElementID, DICOM_eType& eElementType, uint32_t& iElemLength, bool bImplicit, bool bNeedsEndianConversion) {
   string typeString = "  ";
 
   fileDICOM.read((char*)&iGroupID,2);
@@ -210,7 +302,7 @@ void DICOMParser::ReadHeaderElemStart(ifstream& fileDICOM, short& iGroupID, shor
 }
 
 
-uint32_t DICOMParser::GetUInt(ifstream& fileDICOM, const DICOM_eType eElementType, const uint32_t iElemLength, const bool bNeedsEndianConversion) {
+uint32_t DICOMParser::GetUInt(istream& fileDICOM, const DICOM_eType eElementType, const uint32_t iElemLength, const bool bNeedsEndianConversion) {
   string value;
   uint32_t result;
   switch (eElementType) {
@@ -239,11 +331,11 @@ uint32_t DICOMParser::GetUInt(ifstream& fileDICOM, const DICOM_eType eElementTyp
 
 
 #ifdef DEBUG_DICOM
-void DICOMParser::ParseUndefLengthSequence(ifstream& fileDICOM, short& iSeqGroupID, short& iSeqElementID, DICOMFileInfo& info, const bool bImplicit, const bool bNeedsEndianConversion, uint32_t iDepth) {
+void DICOMParser::ParseUndefLengthSequence(istream& fileDICOM, short& iSeqGroupID, short& iSeqElementID, DICOMFileInfo& info, const bool bImplicit, const bool bNeedsEndianConversion, uint32_t iDepth) {
   for (int i = 0;i<int(iDepth)-1;i++) Console::printf("  ");
   Console::printf("iGroupID=%x iElementID=%x elementType=SEQUENCE (undef length)\n", iSeqGroupID, iSeqElementID);
 #else
-void DICOMParser::ParseUndefLengthSequence(ifstream& fileDICOM, short& , short& , DICOMFileInfo& info, const bool bImplicit, const bool bNeedsEndianConversion) {
+void DICOMParser::ParseUndefLengthSequence(istream& fileDICOM, short& , short& , DICOMFileInfo& info, const bool bImplicit, const bool bNeedsEndianConversion) {
 #endif
   int iItemCount = 0;
   uint32_t iData;
@@ -313,7 +405,7 @@ void DICOMParser::ParseUndefLengthSequence(ifstream& fileDICOM, short& , short&
         }
       }
     }
-  } while (iData != 0xE0DDFFFE && !fileDICOM.eof());
+  } while (iData != 0xE0DDFFFE && fileDICOM.good());
   fileDICOM.read((char*)&iData,4);
 
 #ifdef DEBUG_DICOM
@@ -323,14 +415,14 @@ void DICOMParser::ParseUndefLengthSequence(ifstream& fileDICOM, short& , short&
 
 }
 
-void DICOMParser::ReadSizedElement(ifstream& fileDICOM, string& value, const uint32_t iElemLength) {
+void DICOMParser::ReadSizedElement(istream& fileDICOM, string& value, const uint32_t iElemLength) {
   value.resize(iElemLength);
   if (iElemLength) {
     fileDICOM.read(&value[0],iElemLength);
   }
 }
 
-void DICOMParser::SkipUnusedElement(ifstream& fileDICOM, string& value, const uint32_t iElemLength) {
+void DICOMParser::SkipUnusedElement(istream& fileDICOM, string& value, const uint32_t iElemLength) {
   ReadSizedElement(fileDICOM, value, iElemLength);
 }
 
@@ -340,27 +432,58 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
 
   LARGE_STAT_BUFFER stat_buf;
 
-  bool bImplicit    = false;
   info.m_bIsJPEGEncoded = false;
-  bool bNeedsEndianConversion = EndianConvert::IsBigEndian();
-
   info.m_strFileName = strFilename;
   info.m_wstrFileName = wstring(strFilename.begin(), strFilename.end());
   info.m_ivSize.z = 1; // default if slices does not appear in the dicom
 
   // check for basic properties
   if (!SysTools::GetFileStats(strFilename, stat_buf)) {// file must exist
-    MESSAGE("File '%s' can't be a DICOM -- doesn't exist.",
-            strFilename.c_str());
+    DICOM_MESSAGE("File '%s' can't be a DICOM -- doesn't exist.",
+                  strFilename.c_str());
     return false;
   }
   if (stat_buf.st_size < 128+4) { // file has minimum length ?
-    MESSAGE("File '%s' can't be a DICOM -- too short.", strFilename.c_str());
+    DICOM_MESSAGE("File '%s' can't be a DICOM -- too short.",
+                  strFilename.c_str());
     return false;
   }
+  const uint64_t iFileLength = uint64_t(stat_buf.st_size);
 
-  // open file
+  // Parse from a prefix of the file first; only if the header turns out to
+  // extend beyond it we need to go through the whole file.
+  const DICOMFileInfo initial(info);
   ifstream fileDICOM(strFilename.c_str(), ios::in | ios::binary);
+  vector<char> vHeader(size_t(min(iFileLength, iHeaderPrefix)));
+  fileDICOM.read(&vHeader[0], vHeader.size());
+  vHeader.resize(size_t(fileDICOM.gcount()));
+  if (vHeader.size() < 128+4) return false;
+
+  bool bTruncated = false;
+  {
+    MemoryBuffer buffer(&vHeader[0], vHeader.size());
+    istream header(&buffer);
+    const bool bOK = ParseHeader(header, iFileLength,
+                                 vHeader.size() == iFileLength, info,
+                                 bTruncated);
+    if (!bTruncated) return bOK;
+  }
+
+  DICOM_DBG("Header exceeds %u bytes, parsing the whole file\n",
+            static_cast<unsigned>(vHeader.size()));
+  info = initial;
+  fileDICOM.clear();
+  return ParseHeader(fileDICOM, iFileLength, true, info, bTruncated);
+}
+
+bool DICOMParser::ParseHeader(istream& fileDICOM, uint64_t iFileLength,
+                              bool bComplete, DICOMFileInfo& info,
+                              bool& bTruncated) {
+  const string& strFilename = info.m_strFileName;
+  bool bImplicit    = false;
+  bool bNeedsEndianConversion = EndianConvert::IsBigEndian();
+  bTruncated = false;
+
   fileDICOM.seekg(128);  // skip first 128 bytes
 
   string value;
@@ -375,7 +498,8 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
   char DICM[4];
   fileDICOM.read(DICM,4);
   if (DICM[0] != 'D' || DICM[1] != 'I' || DICM[2] != 'C' || DICM[3] != 'M') {
-    MESSAGE("File '%s' does not contain DICM meta header.", strFilename.c_str());
+    DICOM_MESSAGE("File '%s' does not contain DICM meta header.",
+                  strFilename.c_str());
 
     // DICOM supports files without the meta header, 
     // in that case you have to guess the parameters
@@ -389,7 +513,7 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
                         iElemLength, bImplicit, bNeedsEndianConversion);
 
     if (iGroupID != 0x08) {
-      MESSAGE("File '%s' is not a DICM file.", strFilename.c_str());
+      DICOM_MESSAGE("File '%s' is not a DICM file.", strFilename.c_str());
       return false;
     }
 
@@ -407,11 +531,11 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
     ReadHeaderElemStart(fileDICOM, iGroupID, iElementID, elementType,
                         iElemLength, bImplicit, info.m_bIsBigEndian);
 
-    while (bParsingMetaHeader && iGroupID == 0x2 && !fileDICOM.eof()) {
+    while (bParsingMetaHeader && iGroupID == 0x2 && fileDICOM.good()) {
       switch (iElementID) {
         case 0x0 : {  // File Meta Elements Group Len
               if (iElemLength != 4) {
-                MESSAGE("Metaheader length field is invalid.");
+                DICOM_MESSAGE("Metaheader length field is invalid.");
                 return false;
               }
               int iMetaHeaderLength;
@@ -458,9 +582,9 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
                 info.m_bIsBigEndian = false;
                 DICOM_DBG("DICOM file is JPEG Explicit VR Big Endian\n");
               } else {
-                WARNING("Unknown DICOM type '%s' -- not a DICOM? "
-                        "Might just be something we haven't seen: please "
-                        "send a debug log.", value.c_str());
+                DICOM_WARNING("Unknown DICOM type '%s' -- not a DICOM? "
+                              "Might just be something we haven't seen: "
+                              "please send a debug log.", value.c_str());
                 return false; // unsupported file format
               }
               fileDICOM.seekg(iMetaHeaderEnd, std::ios_base::beg);
@@ -778,7 +902,18 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
     #endif
 
     ReadHeaderElemStart(fileDICOM, iGroupID, iElementID, elementType, iElemLength, bImplicit, info.m_bIsBigEndian);
-  } while (iGroupID != 0x7fe0 && elementType != TYPE_UN);
+  } while (iGroupID != 0x7fe0 && elementType != TYPE_UN &&
+           !fileDICOM.fail());
+
+  if (fileDICOM.fail()) {
+    // ran out of data before the pixel data showed up
+    if (!bComplete) {
+      bTruncated = true;
+      return false;
+    }
+    fileDICOM.clear();
+    elementType = TYPE_UN;
+  }
 
   if (elementType != TYPE_UN) {
     if (!bImplicit) {
@@ -794,16 +929,20 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
           fileDICOM.read((char*)iJPEGID,2);
           if (iJPEGID[0] == 0xFF && iJPEGID[1] == 0xE0 ) break;
         }
+        if (fileDICOM.eof() && !bComplete) {
+          bTruncated = true;
+          return false;
+        }
         // Try to get the offset, which can fail.  If it does, report an error
         // and fake an offset -- we're screwed at that point anyway.
         size_t offset = static_cast<size_t>(fileDICOM.tellg());
         if(static_cast<int>(fileDICOM.tellg()) == -1) {
-          T_ERROR("JPEG offset unknown; DICOM parsing failed.  "
-                  "Assuming offset 0.  Please send a debug log.");
+          DICOM_ERROR("JPEG offset unknown; DICOM parsing failed.  "
+                      "Assuming offset 0.  Please send a debug log.");
           offset = 4;  // make sure it won't underflow in the next line.
         }
         offset -= 4;
-        MESSAGE("JPEG is at offset: %u", static_cast<uint32_t>(offset));
+        DICOM_MESSAGE("JPEG is at offset: %u", static_cast<uint32_t>(offset));
         info.SetOffsetToData(static_cast<uint32_t>(offset));
       } else {
         if (iPixelDataSize != iDataSizeInFile) {
@@ -817,15 +956,17 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
   }
 
   if (elementType == TYPE_UN) {
+    // the search below needs all of the file
+    if (!bComplete) {
+      bTruncated = true;
+      return false;
+    }
     // ok we encoutered some strange DICOM file (most likely that additional
     // SIEMENS header) and found an unknown tag,
     // so lets just march througth the rest of the file and search the magic
     // 0x7fe0, then use the last one found
     DICOM_DBG("Manual search for GroupId 0x7fe0\n");
     size_t iPosition   = size_t(fileDICOM.tellg());
-    fileDICOM.seekg(0,ios::end);
-    size_t iFileLength = size_t(fileDICOM.tellg());
-    fileDICOM.seekg(iPosition,ios::beg);
 
     DICOM_DBG("volume size: %u\n", info.m_ivSize.volume());
     DICOM_DBG("n components: %u\n", info.m_iComponentCount);
@@ -875,15 +1016,13 @@ bool DICOMParser::GetDICOMFileInfo(const string& strFilename,
     if (!bOK) {
       // ok everthing failed than let's just use the data we have so far,
       // and let's hope that the file ends with the data
-      WARNING("Trouble parsing DICOM file; assuming data starts at %u",
-              static_cast<unsigned int>(iFileLength - size_t(iPixelDataSize)));
+      DICOM_WARNING("Trouble parsing DICOM file; assuming data starts at %u",
+                    static_cast<unsigned int>(iFileLength -
+                                              size_t(iPixelDataSize)));
       info.SetOffsetToData(uint32_t(iFileLength - size_t(iPixelDataSize)));
     }
   }
 
-
-  fileDICOM.close();
-
   return info.m_ivSize.volume() != 0;
 }
 
@@ -1012,6 +1151,75 @@ void DICOMFileInfo::SetOffsetToData(const uint32_t iOffset) {
   m_iDataSize = m_iComponentCount*m_ivSize.volume()*m_iAllocated/8;
 }
 
+std::string DICOMFileInfo::ToCacheRecord() const {
+  using tuvok::DirectoryScanCache;
+  std::string r;
+  DirectoryScanCache::Put(r, m_iImageIndex);
+  DirectoryScanCache::Put(r, m_iDataSize);
+  DirectoryScanCache::Put(r, m_fvPatientPosition.x);
+  DirectoryScanCache::Put(r, m_fvPatientPosition.y);
+  DirectoryScanCache::Put(r, m_fvPatientPosition.z);
+  DirectoryScanCache::Put(r, m_iComponentCount);
+  DirectoryScanCache::Put(r, m_fScale);
+  DirectoryScanCache::Put(r, m_fBias);
+  DirectoryScanCache::Put(r, m_fWindowWidth);
+  DirectoryScanCache::Put(r, m_fWindowCenter);
+  DirectoryScanCache::Put(r, m_bSigned);
+  DirectoryScanCache::Put(r, m_iOffsetToData);
+  DirectoryScanCache::Put(r, m_iSeries);
+  DirectoryScanCache::Put(r, m_ivSize.x);
+  DirectoryScanCache::Put(r, m_ivSize.y);
+  DirectoryScanCache::Put(r, m_ivSize.z);
+  DirectoryScanCache::Put(r, m_fvfAspect.x);
+  DirectoryScanCache::Put(r, m_fvfAspect.y);
+  DirectoryScanCache::Put(r, m_fvfAspect.z);
+  DirectoryScanCache::Put(r, m_iAllocated);
+  DirectoryScanCache::Put(r, m_iStored);
+  DirectoryScanCache::Put(r, m_bIsBigEndian);
+  DirectoryScanCache::Put(r, m_bIsJPEGEncoded);
+  DirectoryScanCache::Put(r, m_strAcquDate);
+  DirectoryScanCache::Put(r, m_strAcquTime);
+  DirectoryScanCache::Put(r, m_strModality);
+  DirectoryScanCache::Put(r, m_strDesc);
+  return r;
+}
+
+bool DICOMFileInfo::FromCacheRecord(const std::string& strFileName,
+                                    const std::string& r) {
+  using tuvok::DirectoryScanCache;
+  m_strFileName = strFileName;
+  m_wstrFileName = std::wstring(strFileName.begin(), strFileName.end());
+  size_t pos = 0;
+  return DirectoryScanCache::Get(r, pos, m_iImageIndex) &&
+         DirectoryScanCache::Get(r, pos, m_iDataSize) &&
+         DirectoryScanCache::Get(r, pos, m_fvPatientPosition.x) &&
+         DirectoryScanCache::Get(r, pos, m_fvPatientPosition.y) &&
+         DirectoryScanCache::Get(r, pos, m_fvPatientPosition.z) &&
+         DirectoryScanCache::Get(r, pos, m_iComponentCount) &&
+         DirectoryScanCache::Get(r, pos, m_fScale) &&
+         DirectoryScanCache::Get(r, pos, m_fBias) &&
+         DirectoryScanCache::Get(r, pos, m_fWindowWidth) &&
+         DirectoryScanCache::Get(r, pos, m_fWindowCenter) &&
+         DirectoryScanCache::Get(r, pos, m_bSigned) &&
+         DirectoryScanCache::Get(r, pos, m_iOffsetToData) &&
+         DirectoryScanCache::Get(r, pos, m_iSeries) &&
+         DirectoryScanCache::Get(r, pos, m_ivSize.x) &&
+         DirectoryScanCache::Get(r, pos, m_ivSize.y) &&
+         DirectoryScanCache::Get(r, pos, m_ivSize.z) &&
+         DirectoryScanCache::Get(r, pos, m_fvfAspect.x) &&
+         DirectoryScanCache::Get(r, pos, m_fvfAspect.y) &&
+         DirectoryScanCache::Get(r, pos, m_fvfAspect.z) &&
+         DirectoryScanCache::Get(r, pos, m_iAllocated) &&
+         DirectoryScanCache::Get(r, pos, m_iStored) &&
+         DirectoryScanCache::Get(r, pos, m_bIsBigEndian) &&
+         DirectoryScanCache::Get(r, pos, m_bIsJPEGEncoded) &&
+         DirectoryScanCache::Get(r, pos, m_strAcquDate) &&
+         DirectoryScanCache::Get(r, pos, m_strAcquTime) &&
+         DirectoryScanCache::Get(r, pos, m_strModality) &&
+         DirectoryScanCache::Get(r, pos, m_strDesc) &&
+         pos == r.size();
+}
+
 /*************************************************************************************/
 
 DICOMStackInfo::DICOMStackInfo() :
@@ -39,7 +39,7 @@
 #ifndef DICOMPARSER_H
 #define DICOMPARSER_H
 
-#include <fstream>
+#include <istream>
 #include <string>
 
 // if the following define is set, the DICOM parser outputs detailed parsing
@@ -104,6 +104,13 @@ public:
   std::string  m_strDesc;
 
   void SetOffsetToData(const uint32_t iOffset);
+
+  /// @return everything parsed from the header, for the directory scan cache
+  std::string ToCacheRecord() const;
+  /// Restores the header of strFileName from a cache record.
+  /// @return false if the record is damaged
+  bool FromCacheRecord(const std::string& strFileName,
+                       const std::string& record);
 };
 
 
@@ -164,21 +171,24 @@ public:
 
   static bool GetDICOMFileInfo(const std::string& fileName, DICOMFileInfo& info);
 protected:
-  static void ReadSizedElement(std::ifstream& fileDICOM, std::string& value, 
+  static bool ParseHeader(std::istream& fileDICOM, uint64_t iFileLength,
+                          bool bComplete, DICOMFileInfo& info,
+                          bool& bTruncated);
+  static void ReadSizedElement(std::istream& fileDICOM, std::string& value, 
                                 const uint32_t iElemLength);
-  static void SkipUnusedElement(std::ifstream& fileDICOM, std::string& value,
+  static void SkipUnusedElement(std::istream& fileDICOM, std::string& value,
                                 const uint32_t iElemLength);
-  static void ReadHeaderElemStart(std::ifstream& fileDICOM, short& iGroupID,
+  static void ReadHeaderElemStart(std::istream& fileDICOM, short& iGroupID,
                                   short& iElementID, DICOM_eType& eElementType,
                                   uint32_t& iElemLength, bool bImplicit,
                                   bool bNeedsEndianConversion);
-  static uint32_t GetUInt(std::ifstream& fileDICOM,
+  static uint32_t GetUInt(std::istream& fileDICOM,
                         const DICOM_eType eElementType,
                         const uint32_t iElemLength,
                         const bool bNeedsEndianConversion);
 
   #ifdef DEBUG_DICOM
-  static void ParseUndefLengthSequence(std::ifstream& fileDICOM,
+  static void ParseUndefLengthSequence(std::istream& fileDICOM,
                                        short& iSeqGroupID,
                                        short& iSeqElementID,
                                        DICOMFileInfo& info,
@@ -186,7 +196,7 @@ protected:
                                        const bool bNeedsEndianConversion,
                                        uint32_t iDepth);
   #else
-  static void ParseUndefLengthSequence(std::ifstream& fileDICOM,
+  static void ParseUndefLengthSequence(std::istream& fileDICOM,
                                        short& iSeqGroupID,
                                        short& iSeqElementID,
                                        DICOMFileInfo& info,
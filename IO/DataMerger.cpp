@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include "DataMerger.h"
+#include "Basics/LargeRAWFile.h"
+#include "Basics/SysTools.h"
+#include "Controller/Controller.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+
+namespace tuvok {
+
+namespace {
+  // values merged by one work item
+  const size_t iBlockElems = size_t(1) << 16;
+
+  int Threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+  int ThreadID() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
+
+  // fScale*(x+fBias) of one input, in the type of the data.  Results are
+  // clamped to the range of T (NaNs become 0 for integers); the identity is
+  // passed through as is and types up to 16 bits use a lookup table.
+  template<typename T> class Mapping {
+  public:
+    explicit Mapping(const MergeDataset& ds) :
+      m_fScale(ds.fScale), m_fBias(ds.fBias),
+      m_bIdentity(ds.fScale == 1.0 && ds.fBias == 0.0)
+    {
+      if(!m_bIdentity && sizeof(T) <= 2) {
+        m_vTable.resize(sizeof(T) == 1 ? 256 : 65536);
+        for(size_t i=0; i < m_vTable.size(); ++i) {
+          m_vTable[i] = Convert(T(i));
+        }
+      }
+    }
+
+    /// @returns the mapped values, which are either in 'in' or 'tmp'
+    const T* Apply(const T* in, T* tmp, size_t n) const {
+      if(m_bIdentity) { return in; }
+      if(!m_vTable.empty()) {
+        for(size_t i=0; i < n; ++i) { tmp[i] = m_vTable[Index(in[i])]; }
+      } else {
+        for(size_t i=0; i < n; ++i) { tmp[i] = Convert(in[i]); }
+      }
+      return tmp;
+    }
+
+  private:
+    static size_t Index(T x) {
+      return sizeof(T) == 1 ? size_t(uint8_t(x)) : size_t(uint16_t(x));
+    }
+
+    T Convert(T x) const {
+      const double v = m_fScale * (x + m_fBias);
+      const double lowest = double(std::numeric_limits<T>::lowest());
+      const double highest = double(std::numeric_limits<T>::max());
+      if(std::numeric_limits<T>::is_integer) {
+        if(!(v == v)) { return T(0); }
+        if(v <= lowest) { return std::numeric_limits<T>::lowest(); }
+        if(v >= highest) { return std::numeric_limits<T>::max(); }
+        return T(v);
+      }
+      // saturate at both ends like integers do; NaNs stay NaNs
+      if(v < lowest) { return std::numeric_limits<T>::lowest(); }
+      return T(std::min(v, highest));
+    }
+
+    double m_fScale;
+    double m_fBias;
+    bool m_bIdentity;
+    std::vector<T> m_vTable;
+  };
+}
+
+template <class T>
+DataMerger<T>::DataMerger(const std::vector<MergeDataset>& vFiles,
+                          const std::string& strTarget, uint64_t iElemCount,
+                          bool bUseMaxMode, uint64_t iMemory) :
+  bIsOK(false)
+{
+  if(vFiles.empty()) {
+    T_ERROR("Nothing to merge into '%s'.", strTarget.c_str());
+    return;
+  }
+  if(vFiles.size() == 1) {
+    MESSAGE("Copying %s ...",
+            SysTools::GetFilename(vFiles[0].strFilename).c_str());
+    bIsOK = LargeRAWFile::Copy(vFiles[0].strFilename, strTarget,
+                               vFiles[0].iHeaderSkip);
+    if(!bIsOK) {
+      T_ERROR("Could not copy '%s' to '%s'", vFiles[0].strFilename.c_str(),
+              strTarget.c_str());
+    }
+    return;
+  }
+
+  try {
+    bIsOK = Merge(vFiles, strTarget, iElemCount, bUseMaxMode, iMemory);
+  } catch(...) {
+    remove(strTarget.c_str());
+    throw;
+  }
+  if(!bIsOK) { remove(strTarget.c_str()); }
+}
+
+template <class T>
+bool DataMerger<T>::Merge(const std::vector<MergeDataset>& vFiles,
+                          const std::string& strTarget, uint64_t iElemCount,
+                          bool bUseMaxMode, uint64_t iMemory) {
+  const size_t iFiles = vFiles.size();
+  std::vector<std::unique_ptr<LargeRAWFile>> vSources;
+  std::vector<Mapping<T>> vMappings;
+  for(size_t i=0; i < iFiles; ++i) {
+    vSources.push_back(std::unique_ptr<LargeRAWFile>(
+      new LargeRAWFile(vFiles[i].strFilename, vFiles[i].iHeaderSkip)
+    ));
+    if(!vSources.back()->Open(false)) {
+      T_ERROR("Could not open '%s'!", vFiles[i].strFilename.c_str());
+      return false;
+    }
+    vMappings.push_back(Mapping<T>(vFiles[i]));
+  }
+  LargeRAWFile target(strTarget);
+  if(!target.Create(iElemCount*sizeof(T))) {
+    T_ERROR("Could not create '%s'", strTarget.c_str());
+    return false;
+  }
+
+  // two chunks of every input and of the output are in flight at once
+  uint64_t iChunk = std::max<uint64_t>(1024,
+                                       iMemory / (2*(iFiles+1)*sizeof(T)));
+  if(iChunk > iBlockElems) { iChunk -= iChunk % iBlockElems; }
+  iChunk = std::max<uint64_t>(1, std::min(iChunk, iElemCount));
+  const size_t iChunkElems = size_t(iChunk);
+  const size_t iBlock = std::min(iBlockElems, iChunkElems);
+  const uint64_t iChunks = (iElemCount + iChunk - 1) / iChunk;
+
+  std::vector<T> vIn[2], vOut[2];
+  for(size_t i=0; i < 2; ++i) {
+    vIn[i].resize(iFiles * iChunkElems);
+    vOut[i].resize(iChunkElems);
+  }
+  std::vector<std::vector<T>> vTmp(static_cast<size_t>(Threads()));
+  for(size_t i=0; i < vTmp.size(); ++i) { vTmp[i].resize(iBlock); }
+
+  MESSAGE("Merging %u files into %s ...", unsigned(iFiles),
+          SysTools::GetFilename(strTarget).c_str());
+
+  // in step s, chunk s is read, chunk s-1 merged and chunk s-2 written
+  bool bFailed = false;
+  std::exception_ptr error;
+  for(uint64_t s=0; s < iChunks+2 && !bFailed; ++s) {
+    const bool bRead = s < iChunks;
+    const bool bMerge = s >= 1 && s-1 < iChunks;
+    const bool bWrite = s >= 2;
+    const size_t iReadLen = bRead ?
+      size_t(std::min(iChunk, iElemCount - s*iChunk)) : 0;
+    const size_t iMergeLen = bMerge ?
+      size_t(std::min(iChunk, iElemCount - (s-1)*iChunk)) : 0;
+    const size_t iWriteLen = bWrite ?
+      size_t(std::min(iChunk, iElemCount - (s-2)*iChunk)) : 0;
+    const int iWrites = bWrite ? 1 : 0;
+    const int iReads = bRead ? int(iFiles) : 0;
+    const int iBlocks = int((iMergeLen + iBlock - 1) / iBlock);
+    T* pRead = vIn[s%2].data();
+    const T* pMergeIn = vIn[(s+1)%2].data();
+    T* pMergeOut = vOut[(s+1)%2].data();
+    const T* pWrite = vOut[s%2].data();
+
+    // the I/O comes first in the list, so that it starts right away and the
+    // merge work fills the remaining threads
+#pragma omp parallel for schedule(dynamic)
+    for(int item=0; item < iWrites + iReads + iBlocks; ++item) {
+      try {
+        if(item < iWrites) {
+          const uint64_t iBytes = uint64_t(iWriteLen) * sizeof(T);
+          if(target.WriteRAW(reinterpret_cast<const unsigned char*>(pWrite),
+                             iBytes) != iBytes) {
+#pragma omp critical (DataMergerError)
+            {
+              T_ERROR("Writing to '%s' failed.", strTarget.c_str());
+              bFailed = true;
+            }
+          }
+        } else if(item < iWrites + iReads) {
+          const size_t f = size_t(item - iWrites);
+          const uint64_t iBytes = uint64_t(iReadLen) * sizeof(T);
+          unsigned char* pData =
+            reinterpret_cast<unsigned char*>(pRead + f*iChunkElems);
+          if(vSources[f]->ReadRAW(pData, iBytes) != iBytes) {
+#pragma omp critical (DataMergerError)
+            {
+              T_ERROR("'%s' is too short.", vFiles[f].strFilename.c_str());
+              bFailed = true;
+            }
+          }
+        } else {
+          const size_t iStart = size_t(item - iWrites - iReads) * iBlock;
+          const size_t n = std::min(iBlock, iMergeLen - iStart);
+          T* tmp = vTmp[size_t(ThreadID())].data();
+          T* out = pMergeOut + iStart;
+          const T* first = vMappings[0].Apply(pMergeIn + iStart, out, n);
+          if(first != out) { std::memcpy(out, first, n * sizeof(T)); }
+          for(size_t f=1; f < iFiles; ++f) {
+            const T* in = vMappings[f].Apply(pMergeIn + f*iChunkElems + iStart,
+                                             tmp, n);
+            if(bUseMaxMode) {
+              VolumeTools::MaxRow(out, in, n);
+            } else {
+              VolumeTools::SaturatingAddRow(out, in, n);
+            }
+          }
+        }
+      } catch(...) {
+#pragma omp critical (DataMergerError)
+        {
+          if(!error) { error = std::current_exception(); }
+          bFailed = true;
+        }
+      }
+    }
+    if(error) { std::rethrow_exception(error); }
+  }
+  return !bFailed;
+}
+
+template class DataMerger<float>;
+template class DataMerger<double>;
+template class DataMerger<int8_t>;
+template class DataMerger<int16_t>;
+template class DataMerger<int32_t>;
+template class DataMerger<int64_t>;
+template class DataMerger<uint8_t>;
+template class DataMerger<uint16_t>;
+template class DataMerger<uint32_t>;
+template class DataMerger<uint64_t>;
+
+}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,81 @@
+#ifndef TUVOK_DATAMERGER_H
+#define TUVOK_DATAMERGER_H
+
+#include <string>
+#include <vector>
+#include "Basics/StdDefines.h"
+
+namespace tuvok {
+
+/// One input of a DataMerger: a raw file (after iHeaderSkip bytes) whose
+/// values x enter the merge as fScale*(x+fBias), clamped to the type.
+class MergeDataset {
+public:
+  MergeDataset(std::string _strFilename="", uint64_t _iHeaderSkip=0,
+               bool _bDelete=false, double _fScale=1.0, double _fBias=0.0) :
+    strFilename(_strFilename),
+    iHeaderSkip(_iHeaderSkip),
+    bDelete(_bDelete),
+    fScale(_fScale),
+    fBias(_fBias)
+  {}
+
+  std::string strFilename;
+  uint64_t iHeaderSkip;
+  bool bDelete;
+  double fScale;
+  double fBias;
+};
+
+/// Merges raw files of iElemCount values of type T into one, taking either
+/// the maximum or the sum, which saturates at the limits of T, of all
+/// inputs.  A single input is copied as it is.
+///
+/// The merge is a single pass: the inputs are streamed in chunks which are
+/// read in parallel, one thread per file, while the previous chunk is merged
+/// and the one before that is written.  All buffers together take at most
+/// iMemory bytes (plus one block per thread).
+template <class T> class DataMerger {
+public:
+  DataMerger(const std::vector<MergeDataset>& vFiles,
+             const std::string& strTarget, uint64_t iElemCount,
+             bool bUseMaxMode, uint64_t iMemory=BLOCK_COPY_SIZE);
+
+  bool IsOK() const {return bIsOK;}
+
+private:
+  bool Merge(const std::vector<MergeDataset>& vFiles,
+             const std::string& strTarget, uint64_t iElemCount,
+             bool bUseMaxMode, uint64_t iMemory);
+
+  bool bIsOK;
+};
+
+}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -31,9 +31,12 @@
            SCI Institute
            University of Utah
 */
+#include <algorithm>
 #include "Dataset.h"
 #include "Basics/MathTools.h"
 #include "Basics/Mesh.h"
+#include "BrickBuffer.h"
+#include "Controller/Controller.h"
 
 namespace tuvok {
 
@@ -61,6 +64,69 @@ DOUBLEVECTOR3 Dataset::GetRescaleFactors() const {
   return m_UserScale;
 }
 
+uint64_t Dataset::GetBrickStoredBytes(const BrickKey& k) const {
+  return uint64_t(this->GetBrickVoxelCounts(k).volume()) *
+         this->GetComponentCount() * (this->GetBitWidth()/8);
+}
+
+namespace {
+  template<typename T> std::shared_ptr<const BrickBuffer>
+  read_brick(const Dataset& ds, const BrickKey& k) {
+    std::vector<T> data;
+    if(!ds.GetBrick(k, data)) { return std::shared_ptr<const BrickBuffer>(); }
+    return BrickBuffer::adopt(data);
+  }
+}
+
+std::shared_ptr<const BrickBuffer>
+Dataset::GetBrickBuffer(const BrickKey& k) const {
+  const unsigned size = this->GetBitWidth() / 8;
+  const bool sign = this->GetIsSigned();
+  const bool fp = this->GetIsFloat();
+  if(!sign && !fp && size == 1) {
+    return read_brick<uint8_t>(*this, k);
+  } else if(!sign && !fp && size == 2) {
+    return read_brick<uint16_t>(*this, k);
+  } else if(!sign && !fp && size == 4) {
+    return read_brick<uint32_t>(*this, k);
+  } else if(sign && !fp && size == 1) {
+    return read_brick<int8_t>(*this, k);
+  } else if(sign && !fp && size == 2) {
+    return read_brick<int16_t>(*this, k);
+  } else if(sign && !fp && size == 4) {
+    return read_brick<int32_t>(*this, k);
+  } else if(sign && fp && size == 4) {
+    return read_brick<float>(*this, k);
+  } else if(sign && fp && size == 8) {
+    return read_brick<double>(*this, k);
+  }
+  T_ERROR("unsupported data type: %u bytes, %s%s", size,
+          sign ? "signed" : "unsigned", fp ? ", FP" : "");
+  return std::shared_ptr<const BrickBuffer>();
+}
+
+void Dataset::GetBricksFrontToBack(
+  size_t lod, size_t ts, const FLOATVECTOR3& vEye, const BrickCuller& cull,
+  std::vector<BrickTable::const_iterator>& vBricks) const
+{
+  std::vector<std::pair<float, BrickTable::const_iterator>> vSorted;
+  for(BrickTable::const_iterator b = BricksBegin(); b != BricksEnd(); ++b) {
+    if(std::get<0>(b->first) != ts || std::get<1>(b->first) != lod) {
+      continue;
+    }
+    if(cull && cull(b->second.center, b->second.extents)) { continue; }
+    vSorted.push_back(std::make_pair((b->second.center - vEye).length(), b));
+  }
+  std::sort(vSorted.begin(), vSorted.end(),
+            [](const std::pair<float, BrickTable::const_iterator>& a,
+               const std::pair<float, BrickTable::const_iterator>& b) {
+              return a.first < b.first;
+            });
+  for(size_t i=0; i < vSorted.size(); ++i) {
+    vBricks.push_back(vSorted[i].second);
+  }
+}
+
 std::pair<FLOATVECTOR3, FLOATVECTOR3>
 Dataset::GetTextCoords(BrickTable::const_iterator brick,
                        bool bUseOnlyPowerOfTwo) const {
@@ -55,6 +55,7 @@ class LargeRAWFile;
 
 namespace tuvok {
 
+class BrickBuffer;
 class Metadata;
 class Mesh;
 
@@ -98,13 +99,40 @@ public:
   virtual bool GetBrick(const BrickKey&, std::vector<int32_t>&) const=0;
   virtual bool GetBrick(const BrickKey&, std::vector<float>&) const=0;
   virtual bool GetBrick(const BrickKey&, std::vector<double>&) const=0;
+  /// Read-only, reference counted access to a brick's data, in the data
+  /// set's native type.  Implementations which have the data in memory
+  /// anyway (caches, mapped files) hand out views on it without copying.
+  /// The default simply reads the brick via GetBrick.
+  /// @returns an empty pointer on error.
+  virtual std::shared_ptr<const BrickBuffer>
+  GetBrickBuffer(const BrickKey&) const;
   ///@}
+  /// What loading a brick costs, for caches which decide what to keep.
+  ///@{
+  /// @returns the number of bytes read to load the brick, e.g. its
+  /// compressed size in the file.  The default is its size in memory.
+  virtual uint64_t GetBrickStoredBytes(const BrickKey&) const;
+  /// @returns true if the brick's data are in memory already (a cache, a
+  /// mapped file), so that loading it does not touch the disk.
+  virtual bool IsBrickInMemory(const BrickKey&) const { return false; }
+  ///@}
+  /// Hints that the given bricks will be needed soon, most important first.
+  /// Replaces any previous hint.  Data sets which can read ahead do so in
+  /// the background; the default ignores the hint.
+  virtual void Prefetch(const std::vector<BrickKey>&) const {}
   virtual BrickTable::const_iterator BricksBegin() const = 0;
   virtual BrickTable::const_iterator BricksEnd() const = 0;
   /// @return the number of bricks in a given LoD + timestep.
   virtual BrickTable::size_type GetBrickCount(size_t lod, size_t ts) const = 0;
   /// @return the LOD idx for a large 1-brick LOD.
   virtual size_t GetLargestSingleBrickLOD(size_t ts) const=0;
+  /// Appends the bricks of the given LoD + timestep which pass 'cull' to
+  /// vBricks, front to back as seen from vEye (in the space of the bricks'
+  /// metadata).  The default scans and sorts all bricks; bricked data sets
+  /// answer from a spatial index instead.
+  virtual void GetBricksFrontToBack(
+    size_t lod, size_t ts, const FLOATVECTOR3& vEye, const BrickCuller& cull,
+    std::vector<BrickTable::const_iterator>& vBricks) const;
 
   virtual bool BrickIsFirstInDimension(size_t, const BrickKey&) const = 0;
   virtual bool BrickIsLastInDimension(size_t, const BrickKey&) const = 0;
@@ -53,6 +53,11 @@ DirectoryParser::~DirectoryParser(void)
   m_FileStacks.clear();
 }
 
+int DirectoryParser::ScanThreads(size_t iFiles)
+{
+  return int(std::max<size_t>(1, std::min<size_t>(iFiles, 16)));
+}
+
 /*************************************************************************************/
 
 SimpleFileInfo::SimpleFileInfo(const std::string& strFileName) :
@@ -108,6 +108,12 @@ public:
   virtual void GetDirInfo(std::wstring wstrDirectory) = 0;
 
   std::vector<FileStackInfo*> m_FileStacks;
+
+protected:
+  /// @return the number of threads to parse the headers of iFiles files
+  ///         with; this is bound by file system latency rather than by the
+  ///         number of cores, but there is no point in swamping the server
+  static int ScanThreads(size_t iFiles);
 };
 
 #endif // DIRECTORYPARSER_H
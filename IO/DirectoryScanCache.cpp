@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include "DirectoryScanCache.h"
+
+namespace tuvok {
+
+// the cache file is a header followed by the entries, each string is stored
+// as its length followed by its characters.  Everything is in native byte
+// order; the cache never leaves the machine it was written on.
+static const char magic[8] = { 'T','U','V','O','K','D','I','R' };
+static const uint32_t version = 1;
+
+// FNV-1a
+static uint64_t hash(const std::string& s) {
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i=0; i < s.size(); ++i) {
+    h ^= uint8_t(s[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+DirectoryScanCache::DirectoryScanCache(const std::string& directory,
+                                       const std::string& kind) :
+  m_strDirectory(SysTools::CanonicalizePath(directory))
+{
+  std::string temp;
+  if(!SysTools::GetTempDirectory(temp)) { return; }
+  std::ostringstream fn;
+  fn << temp << "tuvok-" << kind << "-" << std::hex << hash(m_strDirectory)
+     << ".scan";
+  m_strFilename = fn.str();
+  this->Load();
+}
+
+void DirectoryScanCache::Put(std::string& record, const std::string& value) {
+  Put(record, uint64_t(value.size()));
+  record.append(value);
+}
+
+bool DirectoryScanCache::Get(const std::string& record, size_t& pos,
+                             std::string& value) {
+  uint64_t len;
+  if(!Get(record, pos, len) || len > record.size() - pos) { return false; }
+  value.assign(record, pos, size_t(len));
+  pos += size_t(len);
+  return true;
+}
+
+bool DirectoryScanCache::Lookup(const std::string& file,
+                                const LARGE_STAT_BUFFER& st,
+                                std::string& record) const {
+  const Entries::const_iterator e = m_Loaded.find(file);
+  if(e == m_Loaded.end() || e->second.time != int64_t(st.st_mtime) ||
+     e->second.size != uint64_t(st.st_size)) {
+    return false;
+  }
+  record = e->second.record;
+  return true;
+}
+
+void DirectoryScanCache::Store(const std::string& file,
+                               const LARGE_STAT_BUFFER& st,
+                               const std::string& record) {
+  Entry& e = m_Stored[file];
+  e.time = int64_t(st.st_mtime);
+  e.size = uint64_t(st.st_size);
+  e.record = record;
+}
+
+// the whole file is read at once and parsed from memory; anything that does
+// not look right means there is no cache.
+void DirectoryScanCache::Load() {
+  std::ifstream ifs(m_strFilename.c_str(), std::ios::in | std::ios::binary);
+  if(!ifs) { return; }
+  const std::string data((std::istreambuf_iterator<char>(ifs)),
+                         std::istreambuf_iterator<char>());
+
+  size_t pos = 0;
+  char m[sizeof(magic)];
+  uint32_t v;
+  std::string dir;
+  uint64_t count;
+  if(!Get(data, pos, m) || std::memcmp(m, magic, sizeof(magic)) != 0 ||
+     !Get(data, pos, v) || v != version ||
+     !Get(data, pos, dir) || dir != m_strDirectory ||
+     !Get(data, pos, count)) {
+    return;
+  }
+  Entries entries;
+  for(uint64_t i=0; i < count; ++i) {
+    std::string file;
+    Entry e;
+    if(!Get(data, pos, file) || !Get(data, pos, e.time) ||
+       !Get(data, pos, e.size) || !Get(data, pos, e.record)) {
+      return;
+    }
+    entries[file] = e;
+  }
+  m_Loaded.swap(entries);
+}
+
+// written to a temporary file first, so that a scan running concurrently
+// never sees half a cache.
+void DirectoryScanCache::Save() const {
+  if(m_strFilename.empty() || m_Stored == m_Loaded) { return; }
+
+  std::string data;
+  Put(data, magic);
+  Put(data, version);
+  Put(data, m_strDirectory);
+  Put(data, uint64_t(m_Stored.size()));
+  for(Entries::const_iterator e = m_Stored.begin(); e != m_Stored.end(); ++e) {
+    Put(data, e->first);
+    Put(data, e->second.time);
+    Put(data, e->second.size);
+    Put(data, e->second.record);
+  }
+
+  std::ostringstream tmp;
+  tmp << m_strFilename << "." << std::hex << hash(data);
+  {
+    std::ofstream ofs(tmp.str().c_str(), std::ios::out | std::ios::binary);
+    if(!ofs.write(data.data(), data.size())) {
+      ofs.close();
+      std::remove(tmp.str().c_str());
+      return;
+    }
+  }
+  std::remove(m_strFilename.c_str());
+  if(std::rename(tmp.str().c_str(), m_strFilename.c_str()) != 0) {
+    std::remove(tmp.str().c_str());
+  }
+}
+
+}
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,101 @@
+#ifndef TUVOK_DIRECTORY_SCAN_CACHE_H
+#define TUVOK_DIRECTORY_SCAN_CACHE_H
+
+#include <cstring>
+#include <map>
+#include <string>
+#include "Basics/SysTools.h"
+
+namespace tuvok {
+
+/// Remembers what a directory parser found in each file of a directory, so
+/// that scanning the directory again only has to parse new or modified
+/// files.  A file is identified by its path, modification time and size;
+/// what is stored per file is an opaque record that the parser encodes
+/// itself (see Put and Get).  The cache of a directory lives in a file in
+/// the temp directory; if that cannot be read or written the cache is
+/// simply empty.
+class DirectoryScanCache {
+public:
+  /// Loads the cache of the given directory.
+  /// @param kind distinguishes the caches of different parsers
+  DirectoryScanCache(const std::string& directory, const std::string& kind);
+
+  /// Finds the record of a file.  Safe to call from several threads at once.
+  /// @returns false if the file is unknown or changed since it was stored
+  bool Lookup(const std::string& file, const LARGE_STAT_BUFFER& st,
+              std::string& record) const;
+  /// Records what was found in a file.  Only the files stored since the
+  /// cache was loaded are saved, files which disappeared are dropped.
+  void Store(const std::string& file, const LARGE_STAT_BUFFER& st,
+             const std::string& record);
+  /// Writes the stored records back if they differ from the loaded ones.
+  void Save() const;
+
+  /// @returns the file the cache is kept in, empty if there is none
+  const std::string& Filename() const { return m_strFilename; }
+
+  /// Appends a value to a record, in native byte order.
+  template<typename T> static void Put(std::string& record, const T& value) {
+    record.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+  static void Put(std::string& record, const std::string& value);
+  /// Reads the next value of a record.
+  /// @returns false if the record is too short
+  template<typename T> static bool Get(const std::string& record, size_t& pos,
+                                       T& value) {
+    if(pos + sizeof(T) > record.size()) { return false; }
+    std::memcpy(&value, record.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+  static bool Get(const std::string& record, size_t& pos, std::string& value);
+
+private:
+  struct Entry {
+    int64_t time;
+    uint64_t size;
+    std::string record;
+    bool operator==(const Entry& e) const {
+      return time == e.time && size == e.size && record == e.record;
+    }
+  };
+  typedef std::map<std::string, Entry> Entries;
+
+  void Load();
+
+  std::string m_strDirectory;
+  std::string m_strFilename;
+  Entries m_Loaded;
+  Entries m_Stored;
+};
+
+}
+#endif /* TUVOK_DIRECTORY_SCAN_CACHE_H */
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
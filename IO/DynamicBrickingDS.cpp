@@ -4,20 +4,23 @@
 // * ContainsData: deal with new metadata appropriately
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
-#include <fstream>
+#include <exception>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
 #include "Basics/SysTools.h"
+#include "Basics/Threads.h"
 #include "BMinMax.h"
 #include "Controller/Controller.h"
 #include "Controller/StackTimer.h"
+#include "BrickBuffer.h"
 #include "BrickCache.h"
 #include "DynamicBrickingDS.h"
 #include "FileBackedDataset.h"
 #include "IOManager.h"
+#include "MinMaxIndex.h"
 #include "uvfDataset.h"
 
 // This file deals with some tricky indexing.  The convention here is that a
@@ -40,25 +43,42 @@ struct GBPrelim {
   VoxelIndex src_offset;
 };
 
+// number of independently locked parts of our brick cache.  More shards means
+// less contention between threads requesting bricks at the same time.
+static const unsigned CACHE_SHARDS = 16;
+
 struct DynamicBrickingDS::dbinfo {
   std::shared_ptr<LinearIndexDataset> ds;
+  /// the source data set is not thread safe; we serialize reads from it.
+  CriticalSection dsGuard;
   const BrickSize brickSize;
   BrickCache cache;
   size_t cacheBytes;
-  std::unordered_map<BrickKey, MinMaxBlock, BKeyHash> minmax;
+  /// brick min/maxes, kept on disk.  Entries are the bricks of all LODs,
+  /// LOD by LOD; see MinMaxEntry.
+  std::unique_ptr<MinMaxIndex> minmax;
+  std::vector<uint64_t> lodOffsets;
   enum MinMaxMode mmMode;
 
   dbinfo(std::shared_ptr<LinearIndexDataset> d,
          BrickSize bs, size_t bytes, enum MinMaxMode mm) :
-    ds(d), brickSize(bs), cacheBytes(bytes), mmMode(mm) {}
+    ds(d), brickSize(bs), cache(CACHE_SHARDS), cacheBytes(bytes), mmMode(mm) {
+    this->cache.setCapacity(bytes);
+  }
 
   // early, non-type-specific parts of GetBrick.
   GBPrelim BrickSetup(const BrickKey&, const DynamicBrickingDS& tgt) const;
 
-  // reads the brick + handles caching
+  // reads the source brick + handles caching
+  template<typename T> std::shared_ptr<const void>
+  SourceBrick(const BrickKey& skey, std::vector<T>& scratch);
+  // copies the target brick out of the source brick
   template<typename T> bool Brick(const DynamicBrickingDS& ds,
                                   const BrickKey& key,
                                   std::vector<T>& data);
+  // ditto, but avoids the copy where possible
+  template<typename T> std::shared_ptr<const BrickBuffer>
+  Buffer(const DynamicBrickingDS& ds, const BrickKey& key);
 
   // given the brick key in the dynamic DS, return the corresponding BrickKey
   // in the source data.
@@ -66,14 +86,15 @@ struct DynamicBrickingDS::dbinfo {
 
   BrickLayout TargetBrickLayout(size_t lod, size_t ts) const;
 
-  /// since ComputeMinMaxes is soooo absurdly slow, we try to cache the
-  /// results.  These load/save all our min/maxes to a stream.
-  ///@{
-  void LoadMinMax(std::istream&);
-  void SaveMinMax(std::ostream&) const;
-  ///@}
+  /// since computing min/maxes is soooo absurdly slow, we keep the results
+  /// in an index file which is reused the next time the data are opened.
+  void OpenMinMaxIndex(const BrickedDataset&);
+  /// position of the brick in the min/max index.
+  uint64_t MinMaxEntry(const BrickKey&) const;
+  /// the brick's min/max; computed (and stored) if it is not known yet.
+  MinMaxBlock MinMax(const BrickKey&, const BrickedDataset&);
 
-  /// run through all of the bricks and compute min/max info.
+  /// compute min/max info for all of the bricks which don't have it yet.
   void ComputeMinMaxes(BrickedDataset&);
 
   // sets the cache size (bytes)
@@ -81,9 +102,6 @@ struct DynamicBrickingDS::dbinfo {
   // get the cache size (bytes)
   size_t GetCacheSize() const;
 
-  /// @returns true if 'bytes' bytes will fit into the current cache
-  bool FitsInCache(size_t bytes) const;
-
   void VerifyBrick(const std::pair<BrickKey, BrickMD>& brk) const;
 
   /// @returns the size of the brick, minus any ghost voxels.
@@ -169,7 +187,7 @@ size_t DynamicBrickingDS::GetCacheSize() const {
 // Removes all the cache information we've made so far.
 void DynamicBrickingDS::Clear() {
   di->ds->Clear();
-  while(this->di->cache.size() > 0) { this->di->cache.remove(); }
+  this->di->cache.clear();
   BrickedDataset::Clear();
   this->Rebrick();
 }
@@ -563,60 +581,97 @@ DynamicBrickingDS::dbinfo::BrickSetup(const BrickKey& k,
   return rv;
 }
 
-// Looks for the brick in the cache; if so, uses it.  Otherwise, grab the brick
-template<typename T>
-bool DynamicBrickingDS::dbinfo::Brick(const DynamicBrickingDS& ds,
-                                      const BrickKey& key,
-                                      std::vector<T>& data) {
-  StackTimer gbrick(PERF_DY_GET_BRICK);
-  GBPrelim pre = this->BrickSetup(key, ds);
-
-  const void* lookup;
+// Looks for the source brick in the cache; if it is not there, reads it and
+// adds it.  This may be called from several threads at once.  The returned
+// pointer is pinned in the cache, so another thread cannot evict the brick
+// while we use it.  With caching disabled the data are read into 'scratch'
+// instead, which must then outlive the returned pointer.
+// @returns an empty pointer if the brick could not be read.
+template<typename T> std::shared_ptr<const void>
+DynamicBrickingDS::dbinfo::SourceBrick(const BrickKey& skey,
+                                       std::vector<T>& scratch) {
+  std::shared_ptr<const void> lookup;
   {
     tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_CACHE_LOOKUPS, 1.0);
     StackTimer cc(PERF_DY_CACHE_LOOKUP);
-    lookup = this->cache.lookup(pre.skey, T(42));
+    lookup = this->cache.acquire(skey, T(42));
   }
   // first: check the cache and see if we can get the data easy.
-  if(NULL != lookup) {
+  if(lookup) {
     MESSAGE("found <%u,%u,%u> in the cache!",
-            static_cast<unsigned>(std::get<0>(pre.skey)),
-            static_cast<unsigned>(std::get<1>(pre.skey)),
-            static_cast<unsigned>(std::get<2>(pre.skey)));
-    tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_BRICK_COPIED, 1.0);
-    StackTimer copies(PERF_DY_BRICK_COPY);
-    const T* srcdata = static_cast<const T*>(lookup);
-    const size_t components = this->ds->GetComponentCount();
-    return this->CopyBrick<T>(data, srcdata, components, pre.tgt_bs, pre.src_bs,
-                              pre.src_offset);
+            static_cast<unsigned>(std::get<0>(skey)),
+            static_cast<unsigned>(std::get<1>(skey)),
+            static_cast<unsigned>(std::get<2>(skey)));
+    return lookup;
   }
   // nope?  oh well.  read it.
-  std::vector<T> srcdata;
   {
     StackTimer loadBrick(PERF_DY_RESERVE_BRICK);
-    srcdata.resize(this->ds->GetBrickVoxelCounts(pre.skey).volume());
+    scratch.resize(this->ds->GetBrickVoxelCounts(skey).volume());
   }
   {
     StackTimer loadBrick(PERF_DY_LOAD_BRICK);
-    if(!this->ds->GetBrick(pre.skey, srcdata)) { return false; }
+    SCOPEDLOCK(this->dsGuard);
+    if(!this->ds->GetBrick(skey, scratch)) {
+      return std::shared_ptr<const void>();
+    }
   }
 
   // add it to the cache.
-  const T* sdata = static_cast<const T*>(srcdata.data());
   if(this->cacheBytes > 0) {
     tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_CACHE_ADDS, 1.0);
     StackTimer cc(PERF_DY_CACHE_ADD);
-    // is the cache full?  find room.
-    while(!this->FitsInCache(srcdata.size() * sizeof(T))) {
-      this->cache.remove();
-    }
-    sdata = static_cast<const T*>(this->cache.add(pre.skey, srcdata));
+    // the cache evicts old bricks itself if it needs to make room.
+    return this->cache.store(skey, scratch);
   }
+  return std::shared_ptr<const void>(std::shared_ptr<void>(), scratch.data());
+}
+
+// Copies the target brick out of its source brick.
+template<typename T>
+bool DynamicBrickingDS::dbinfo::Brick(const DynamicBrickingDS& ds,
+                                      const BrickKey& key,
+                                      std::vector<T>& data) {
+  StackTimer gbrick(PERF_DY_GET_BRICK);
+  GBPrelim pre = this->BrickSetup(key, ds);
+
+  std::vector<T> scratch;
+  const std::shared_ptr<const void> src = this->SourceBrick(pre.skey, scratch);
+  if(!src) { return false; }
+
   const size_t components = this->ds->GetComponentCount();
   tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_BRICK_COPIED, 1.0);
   StackTimer copies(PERF_DY_BRICK_COPY);
-  return this->CopyBrick<T>(data, sdata, components, pre.tgt_bs, pre.src_bs,
-                            pre.src_offset);
+  return this->CopyBrick<T>(data, static_cast<const T*>(src.get()), components,
+                            pre.tgt_bs, pre.src_bs, pre.src_offset);
+}
+
+// Like Brick, but if the target brick covers its whole source brick we hand
+// out the cached source brick itself instead of copying it.
+template<typename T> std::shared_ptr<const BrickBuffer>
+DynamicBrickingDS::dbinfo::Buffer(const DynamicBrickingDS& ds,
+                                  const BrickKey& key) {
+  StackTimer gbrick(PERF_DY_GET_BRICK);
+  GBPrelim pre = this->BrickSetup(key, ds);
+
+  std::vector<T> scratch;
+  const std::shared_ptr<const void> src = this->SourceBrick(pre.skey, scratch);
+  if(!src) { return std::shared_ptr<const BrickBuffer>(); }
+
+  const size_t components = this->ds->GetComponentCount();
+  if(pre.tgt_bs == pre.src_bs) {
+    if(src.get() == scratch.data()) { return BrickBuffer::adopt(scratch); }
+    const size_t elems = pre.tgt_bs[0] * pre.tgt_bs[1] * pre.tgt_bs[2] *
+                         components;
+    return BrickBuffer::view(src, static_cast<const T*>(src.get()), elems);
+  }
+
+  std::vector<T> data;
+  tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_BRICK_COPIED, 1.0);
+  StackTimer copies(PERF_DY_BRICK_COPY);
+  this->CopyBrick<T>(data, static_cast<const T*>(src.get()), components,
+                     pre.tgt_bs, pre.src_bs, pre.src_offset);
+  return BrickBuffer::adopt(data);
 }
 
 /// we can cache the precomputed brick min/maxes in a file, and then
@@ -624,13 +679,15 @@ bool DynamicBrickingDS::dbinfo::Brick(const DynamicBrickingDS& ds,
 /// veeeery slow.
 /// @return the file we would save for this case.
 static std::string precomputed_filename(const BrickedDataset& ds,
-                                        const BrickSize bsize)
+                                        const BrickSize bsize,
+                                        enum DynamicBrickingDS::MinMaxMode mm)
 {
   try {
     std::ostringstream fname;
     const FileBackedDataset& fbds = dynamic_cast<const FileBackedDataset&>(ds);
     fname << "." << bsize[0] << "x" << bsize[1] << "x" << bsize[2] << "-"
-          << SysTools::GetFilename(fbds.Filename()) << ".cached";
+          << SysTools::GetFilename(fbds.Filename()) << "." << int(mm)
+          << ".minmax";
     return fname.str();
   } catch(const std::bad_cast&) {
     WARNING("Data doesn't come from a file.  We can't save minmaxes.");
@@ -638,116 +695,89 @@ static std::string precomputed_filename(const BrickedDataset& ds,
   return "";
 }
 
-void DynamicBrickingDS::dbinfo::LoadMinMax(std::istream& is) {
-  if(!is) { T_ERROR("could not open min/max cache!"); return; }
-
-  uint64_t n_elems;
-  is.read(reinterpret_cast<char*>(&n_elems), sizeof(uint64_t));
-
-  for(uint64_t i=0; i < n_elems; ++i) {
-    uint64_t timestep, lod, brick;
-    is.read(reinterpret_cast<char*>(&timestep), sizeof(uint64_t));
-    is.read(reinterpret_cast<char*>(&lod), sizeof(uint64_t));
-    is.read(reinterpret_cast<char*>(&brick), sizeof(uint64_t));
-    const BrickKey key(timestep, lod, brick);
-    MinMaxBlock mm;
-    is.read(reinterpret_cast<char*>(&mm.minScalar), sizeof(double));
-    is.read(reinterpret_cast<char*>(&mm.maxScalar), sizeof(double));
-    if(!is) {
-      T_ERROR("read failed?  cache is broken.  ignoring it.");
-      this->minmax.clear();
-      return;
-    }
-    this->minmax.insert(std::make_pair(key, mm));
+void DynamicBrickingDS::dbinfo::OpenMinMaxIndex(const BrickedDataset& ds) {
+  this->minmax.reset();
+  const uint64_t entries = this->lodOffsets.empty() ? 0 :
+                           this->lodOffsets.back();
+  const std::string fname = precomputed_filename(ds, this->brickSize,
+                                                 this->mmMode);
+  if(fname.empty()) {
+    this->minmax.reset(new MinMaxIndex(entries));
+    return;
   }
+  const FileBackedDataset& fbds = dynamic_cast<const FileBackedDataset&>(ds);
+  const std::array<uint64_t,3> bsize = {{
+    this->brickSize[0], this->brickSize[1], this->brickSize[2]
+  }};
+  const MinMaxIndex::Identity id = MinMaxIndex::Identify(
+    fbds.Filename(), bsize, static_cast<uint32_t>(this->mmMode)
+  );
+  this->minmax.reset(new MinMaxIndex(fname, id, entries));
 }
 
-void DynamicBrickingDS::dbinfo::SaveMinMax(std::ostream& os) const {
-  if(!os) { T_ERROR("could not create min/max cache."); return; }
-
-  const uint64_t n_elems = this->minmax.size();
-  MESSAGE("Saving %llu brick min/maxes", n_elems);
-  os.write(reinterpret_cast<const char*>(&n_elems), sizeof(uint64_t));
-
-  for(auto b=this->minmax.cbegin(); b != this->minmax.cend(); ++b) {
-    uint64_t timestep, lod, brick;
-    timestep = std::get<0>(b->first);
-    lod = std::get<1>(b->first);
-    brick = std::get<2>(b->first);
-    os.write(reinterpret_cast<const char*>(&timestep), sizeof(uint64_t));
-    os.write(reinterpret_cast<const char*>(&lod), sizeof(uint64_t));
-    os.write(reinterpret_cast<const char*>(&brick), sizeof(uint64_t));
-    MinMaxBlock mm = b->second;
-    os.write(reinterpret_cast<const char*>(&mm.minScalar), sizeof(double));
-    os.write(reinterpret_cast<const char*>(&mm.maxScalar), sizeof(double));
-  }
+uint64_t DynamicBrickingDS::dbinfo::MinMaxEntry(const BrickKey& k) const {
+  assert(std::get<1>(k) + 1 < this->lodOffsets.size());
+  return this->lodOffsets[std::get<1>(k)] + std::get<2>(k);
 }
 
-/// run through all of the bricks and compute min/max info.
+MinMaxBlock DynamicBrickingDS::dbinfo::MinMax(const BrickKey& k,
+                                              const BrickedDataset& ds) {
+  MinMaxBlock mm;
+  const uint64_t entry = this->MinMaxEntry(k);
+  if(this->minmax->get(entry, mm)) { return mm; }
+  mm = minmax_brick(k, ds);
+  this->minmax->set(entry, mm);
+  return mm;
+}
+
+/// run through all of the bricks and compute min/max info.  Bricks are
+/// independent, so we do them in parallel; reads from the source are
+/// serialized anyway, but the copies and the min/max computation aren't.
 void DynamicBrickingDS::dbinfo::ComputeMinMaxes(BrickedDataset& ds) {
-  // first, check if we have this cached.
-  const std::string fname = precomputed_filename(ds, this->brickSize);
-  if(SysTools::FileExists(fname)) {
-    MESSAGE("Brick min/maxes are precomputed.  Reloading from file...");
-    std::ifstream mmfile(fname, std::ios::binary);
-    this->LoadMinMax(mmfile);
-    mmfile.close();
+  std::vector<BrickKey> missing;
+  for(auto b=ds.BricksBegin(); b != ds.BricksEnd(); ++b) {
+    MinMaxBlock mm;
+    if(!this->minmax->get(this->MinMaxEntry(b->first), mm)) {
+      missing.push_back(b->first);
+    }
+  }
+  if(missing.empty()) {
+    MESSAGE("Brick min/maxes are precomputed.");
     return;
   }
 
   {
     StackTimer precompute(PERF_MM_PRECOMPUTE);
-    unsigned i=0;
-    const unsigned len = static_cast<unsigned>(
-      std::distance(ds.BricksBegin(), ds.BricksEnd())
-    );
-    for(auto b=ds.BricksBegin(); b != ds.BricksEnd(); ++b, ++i) {
-      MESSAGE("precomputing brick %u of %u", i, len);
-      MinMaxBlock mm = minmax_brick(b->first, ds);
-      this->minmax.insert(std::make_pair(b->first, mm));
-
-      // we do want to cache to save decompression time
-      while (this->cache.size() > this->cacheBytes) { this->cache.remove(); }
-
-      // minmax_brick added something to our cache; we don't want to cache
-      // here, though, only when the brick is /actually/ used.
-      //this->cache.clear();
+    const int len = static_cast<int>(missing.size());
+    std::atomic<int> done(0);
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+    for(int i=0; i < len; ++i) {
+      try {
+        this->minmax->set(this->MinMaxEntry(missing[i]),
+                          minmax_brick(missing[i], ds));
+        MESSAGE("precomputed brick %d of %d", ++done, len);
+      } catch(...) {
+#pragma omp critical
+        if(!error) { error = std::current_exception(); }
+      }
     }
+    if(error) { std::rethrow_exception(error); }
   }
   // remove all cached bricks
-  while(this->cache.size() > 0) { this->cache.remove(); }
-
-  // try to cache that data to a file, now.
-  std::ofstream mmcache(fname, std::ios::binary);
-  if(!mmcache) {
-    WARNING("could not open min/max cache file (%s); ignoring cache.",
-            fname.c_str());
-    return;
-  }
-  this->SaveMinMax(mmcache);
-  mmcache.close();
+  this->cache.clear();
 }
 
 void DynamicBrickingDS::dbinfo::SetCacheSize(size_t bytes) {
   this->cacheBytes = bytes;
   // shrink the cache to fit.
-  while(this->cache.size() > this->cacheBytes) { this->cache.remove(); }
+  this->cache.setCapacity(bytes);
 }
 
 size_t DynamicBrickingDS::dbinfo::GetCacheSize() const {
   return this->cacheBytes;
 }
 
-/// @returns true if 'bytes' bytes will fit into the current cache
-bool DynamicBrickingDS::dbinfo::FitsInCache(size_t bytes) const {
-  // if cache is enabled and nothing is cached we allow to store any given brick
-  // to avoid an endless loop if the total cache size is smaller than the loaded
-  // brick
-  if (cache.size() == 0)
-    return true;
-  return (bytes + cache.size()) < this->cacheBytes;
-}
-
 bool DynamicBrickingDS::GetBrick(const BrickKey& k, std::vector<uint8_t>& data) const
 {
   return this->di->Brick<uint8_t>(*this, k, data);
@@ -790,6 +820,32 @@ bool DynamicBrickingDS::GetBrick(const BrickKey&,
   return false;
 }
 
+std::shared_ptr<const BrickBuffer>
+DynamicBrickingDS::GetBrickBuffer(const BrickKey& k) const
+{
+  const unsigned size = this->GetBitWidth() / 8;
+  const bool sign = this->GetIsSigned();
+  const bool fp = this->GetIsFloat();
+  if(!sign && !fp && size == 1) {
+    return this->di->Buffer<uint8_t>(*this, k);
+  } else if(!sign && !fp && size == 2) {
+    return this->di->Buffer<uint16_t>(*this, k);
+  } else if(!sign && !fp && size == 4) {
+    return this->di->Buffer<uint32_t>(*this, k);
+  } else if(sign && !fp && size == 1) {
+    return this->di->Buffer<int8_t>(*this, k);
+  } else if(sign && !fp && size == 2) {
+    return this->di->Buffer<int16_t>(*this, k);
+  } else if(sign && !fp && size == 4) {
+    return this->di->Buffer<int32_t>(*this, k);
+  } else if(sign && fp && size == 4) {
+    return this->di->Buffer<float>(*this, k);
+  }
+  T_ERROR("no support for %u-byte %s%s data with dynamic bricking!", size,
+          sign ? "signed" : "unsigned", fp ? " FP" : "");
+  return std::shared_ptr<const BrickBuffer>();
+}
+
 void DynamicBrickingDS::SetRescaleFactors(const DOUBLEVECTOR3& scale) {
   this->di->ds->SetRescaleFactors(scale);
 }
@@ -865,11 +921,8 @@ MinMaxBlock DynamicBrickingDS::MaxMinForKey(const BrickKey& bk) const {
       BrickKey skey = this->di->SourceBrickKey(bk);
       return di->ds->MaxMinForKey(skey);
     } break;
-    case MM_DYNAMIC: return minmax_brick(bk, *this); break;
-    case MM_PRECOMPUTE: {
-      assert(this->di->minmax.find(bk) != this->di->minmax.end());
-      return this->di->minmax.find(bk)->second;
-    } break;
+    case MM_DYNAMIC: /* fall through; computed when first needed */
+    case MM_PRECOMPUTE: return this->di->MinMax(bk, *this); break;
   }
   return MinMaxBlock();
 }
@@ -1137,6 +1190,8 @@ void DynamicBrickingDS::Rebrick() {
 
   // don't create more LODs than the source data set (otherwise reading
   // the data is hard, we'd have to subsample on the fly)
+  this->di->lodOffsets.clear();
+  uint64_t nbricks_total = 0;
   for(size_t lod=0; lod < di->ds->GetLODLevelCount(); ++lod) {
     const VoxelLayout voxels = {{
       this->di->ds->GetDomainSize(lod, 0)[0],
@@ -1145,6 +1200,8 @@ void DynamicBrickingDS::Rebrick() {
     }};
     const std::array<unsigned,3> blayout =
       GenericBrickLayout(voxels, this->di->BrickSansGhost());
+    this->di->lodOffsets.push_back(nbricks_total);
+    nbricks_total += uint64_t(blayout[0]) * blayout[1] * blayout[2];
 
     for(size_t x=0; x < blayout[0]; ++x) {
       for(size_t y=0; y < blayout[1]; ++y) {
@@ -1174,6 +1231,11 @@ void DynamicBrickingDS::Rebrick() {
     }
   }
 
+  this->di->lodOffsets.push_back(nbricks_total);
+
+  if(this->di->mmMode != MM_SOURCE) {
+    this->di->OpenMinMaxIndex(*this);
+  }
   if(this->di->mmMode == MM_PRECOMPUTE) {
     this->di->ComputeMinMaxes(*this);
   }
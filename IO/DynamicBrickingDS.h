@@ -54,6 +54,10 @@ public:
   virtual bool GetBrick(const BrickKey&, std::vector<int32_t>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<float>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<double>&) const;
+  /// Served straight from the brick cache when the target brick is a whole
+  /// source brick.
+  virtual std::shared_ptr<const BrickBuffer>
+  GetBrickBuffer(const BrickKey&) const;
   ///@}
 
   /// User rescaling factors.
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include "ExpressionEvaluator.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+
+namespace tuvok { namespace expression {
+
+namespace {
+  // voxels evaluated by one work item; all registers of a block together
+  // should stay in the cache.
+  const size_t iBlockElems = 512;
+
+  int Threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+  int ThreadID() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
+
+  VolumeTools::BinaryOp Operator(OpType oper) {
+    switch(oper) {
+      case OP_PLUS:         return VolumeTools::BINARY_ADD;
+      case OP_MINUS:        return VolumeTools::BINARY_SUB;
+      case OP_DIVIDE:       return VolumeTools::BINARY_DIV;
+      case OP_MULTIPLY:     return VolumeTools::BINARY_MUL;
+      case OP_GREATER_THAN: return VolumeTools::BINARY_GREATER;
+      case OP_LESS_THAN:    return VolumeTools::BINARY_LESS;
+      case OP_EQUAL_TO:     return VolumeTools::BINARY_NEAR;
+    }
+    assert(1 == 0);
+    return VolumeTools::BINARY_ADD;
+  }
+
+  template<typename T> void Load(const T* in, double* out, size_t n) {
+    for(size_t i=0; i < n; ++i) { out[i] = static_cast<double>(in[i]); }
+  }
+
+  template<typename T> void Store(const double* in, T* out, size_t n) {
+    if(!std::numeric_limits<T>::is_integer) {
+      for(size_t i=0; i < n; ++i) { out[i] = static_cast<T>(in[i]); }
+      return;
+    }
+    const double lowest = double(std::numeric_limits<T>::lowest());
+    const double highest = double(std::numeric_limits<T>::max());
+    for(size_t i=0; i < n; ++i) {
+      const double v = in[i];
+      if(!(v == v)) { out[i] = T(0); }
+      else if(v <= lowest) { out[i] = std::numeric_limits<T>::lowest(); }
+      else if(v >= highest) { out[i] = std::numeric_limits<T>::max(); }
+      else { out[i] = static_cast<T>(v); }
+    }
+  }
+}
+
+template<typename T>
+void evaluate(const Program& program, const std::vector<const T*>& volumes,
+              T* output, size_t n)
+{
+  assert(volumes.size() >= program.Volumes());
+  const std::vector<Program::Instruction>& code = program.Instructions();
+  assert(!code.empty());
+  const size_t result = program.Result();
+
+  // e.g. "v[1]": nothing to compute.
+  if(code[result].code == Program::LOAD) {
+    std::memcpy(output, volumes[code[result].volume], n * sizeof(T));
+    return;
+  }
+
+  // one row of iBlockElems values per register and thread; constants are
+  // filled in once.
+  std::vector<std::vector<double>> vRegisters(static_cast<size_t>(Threads()));
+  for(size_t t=0; t < vRegisters.size(); ++t) {
+    vRegisters[t].resize((result+1) * iBlockElems);
+    for(size_t r=0; r <= result; ++r) {
+      if(code[r].code == Program::CONSTANT) {
+        std::fill(vRegisters[t].begin() + r*iBlockElems,
+                  vRegisters[t].begin() + (r+1)*iBlockElems, code[r].value);
+      }
+    }
+  }
+
+  const int iBlocks = int((n + iBlockElems - 1) / iBlockElems);
+#pragma omp parallel for schedule(dynamic)
+  for(int b=0; b < iBlocks; ++b) {
+    double* regs = vRegisters[size_t(ThreadID())].data();
+    const size_t first = size_t(b) * iBlockElems;
+    const size_t len = std::min(iBlockElems, n - first);
+    for(size_t r=0; r <= result; ++r) {
+      const Program::Instruction& in = code[r];
+      double* out = regs + r*iBlockElems;
+      switch(in.code) {
+        case Program::LOAD:
+          Load(volumes[in.volume] + first, out, len);
+          break;
+        case Program::CONSTANT:
+          break;
+        case Program::BINARY:
+          VolumeTools::BinaryRow(Operator(in.oper), regs + in.a*iBlockElems,
+                                 regs + in.b*iBlockElems, Program::Tolerance,
+                                 out, len);
+          break;
+        case Program::SELECT:
+          VolumeTools::SelectRow(regs + in.a*iBlockElems,
+                                 regs + in.b*iBlockElems,
+                                 regs + in.c*iBlockElems, out, len);
+          break;
+      }
+    }
+    Store(regs + result*iBlockElems, output + first, len);
+  }
+}
+
+template void evaluate(const Program&, const std::vector<const float*>&,
+                       float*, size_t);
+template void evaluate(const Program&, const std::vector<const double*>&,
+                       double*, size_t);
+template void evaluate(const Program&, const std::vector<const int8_t*>&,
+                       int8_t*, size_t);
+template void evaluate(const Program&, const std::vector<const int16_t*>&,
+                       int16_t*, size_t);
+template void evaluate(const Program&, const std::vector<const int32_t*>&,
+                       int32_t*, size_t);
+template void evaluate(const Program&, const std::vector<const int64_t*>&,
+                       int64_t*, size_t);
+template void evaluate(const Program&, const std::vector<const uint8_t*>&,
+                       uint8_t*, size_t);
+template void evaluate(const Program&, const std::vector<const uint16_t*>&,
+                       uint16_t*, size_t);
+template void evaluate(const Program&, const std::vector<const uint32_t*>&,
+                       uint32_t*, size_t);
+template void evaluate(const Program&, const std::vector<const uint64_t*>&,
+                       uint64_t*, size_t);
+
+}}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
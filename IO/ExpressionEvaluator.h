@@ -0,0 +1,49 @@
+#ifndef TUVOK_EXPRESSION_EVALUATOR_H
+#define TUVOK_EXPRESSION_EVALUATOR_H
+
+#include <vector>
+#include "Basics/StdDefines.h"
+#include "expressions/program.h"
+
+namespace tuvok { namespace expression {
+
+/// Evaluates a compiled expression for n voxels, i.e. output[i] is the
+/// value of the expression with v[k] = volumes[k][i].
+///
+/// The voxels are processed in blocks, spread over all threads; each
+/// instruction runs over a whole block at once with the SIMD kernels of
+/// VolumeTools, in double precision like Node::Evaluate.  Results outside of
+/// the range of an integer T are clamped to it (NaNs become 0).
+/// @param volumes at least program.Volumes() inputs of n voxels each
+template<typename T>
+void evaluate(const Program& program, const std::vector<const T*>& volumes,
+              T* output, size_t n);
+
+}}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
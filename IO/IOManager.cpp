@@ -44,16 +44,16 @@
 #include <sstream>
 #include <map>
 #include <memory>
-#include "3rdParty/jpeglib/jconfig.h"
 
 #include "IOManager.h"
 
-#include "Basics/MC.h"
 #include "Basics/SysTools.h"
 #include "Basics/SystemInfo.h"
 #include "Controller/Controller.h"
+#include "DataMerger.h"
 #include "DSFactory.h"
 #include "DynamicBrickingDS.h"
+#include "ExpressionEvaluator.h"
 #include "exception/UnmergeableDatasets.h"
 #include "expressions/parser.h"
 #include "expressions/syntax.h"
@@ -61,12 +61,16 @@
 #include "IO/DICOM/DICOMParser.h"
 #include "IO/Images/ImageParser.h"
 #include "IO/Images/StackExporter.h"
+#include "IsosurfaceExtractor.h"
 #include "Quantize.h"
+#include "StackSliceSource.h"
 #include "TuvokJPEG.h"
 #include "TransferFunction1D.h"
 #include "TuvokSizes.h"
 #include "uvfDataset.h"
 #include "UVF/UVF.h"
+#include "UVF/TOCBlock.h"
+#include "UVF/ExtendedOctree/OctreeSliceSource.h"
 #include "UVF/GeometryDataBlock.h"
 #include "UVF/Histogram1DDataBlock.h"
 #include "UVF/Histogram2DDataBlock.h"
@@ -324,265 +328,40 @@ bool IOManager::ConvertDataset(FileStackInfo* pStack,
     MESSAGE("    Aspect Ratio: %g %g %g", pDICOMStack->m_fvfAspect.x,
             pDICOMStack->m_fvfAspect.y, pDICOMStack->m_fvfAspect.z);
 
-    string strTempMergeFilename = strTempDir +
-                                  SysTools::GetFilename(strTargetFilename) +
-                                  "~";
-    MESSAGE("Creating intermediate file %s", strTempMergeFilename.c_str());
-
-    ofstream fs;
-    fs.open(strTempMergeFilename.c_str(), fstream::binary);
-    if (fs.fail()) {
-      T_ERROR("Could not create temp file %s aborted conversion.",
-              strTempMergeFilename.c_str());
-      return false;
-    }
-
-    vector<char> vData;
+    // TODO: implement proper DICOM Windowing
     for (size_t j=0; j < pDICOMStack->m_Elements.size(); j++) {
-
-      SimpleDICOMFileInfo* pDICOMFileInfo = dynamic_cast<SimpleDICOMFileInfo*>(pDICOMStack->m_Elements[j]);
-
-      if (!pDICOMFileInfo) continue;
-
-      uint32_t iDataSize = pDICOMStack->m_Elements[j]->GetDataSize();
-      vData.resize(iDataSize);
-
-      if (pDICOMStack->m_bIsJPEGEncoded) {
-        MESSAGE("JPEG is %d bytes, offset %d", iDataSize,
-                pDICOMFileInfo->GetOffsetToData());
-        tuvok::JPEG jpg(pDICOMStack->m_Elements[j]->m_strFileName,
-                        pDICOMFileInfo->GetOffsetToData());
-        if(!jpg.valid()) {
-          T_ERROR("'%s' reports an embedded JPEG, but the JPEG is invalid.",
-                  pDICOMStack->m_Elements[j]->m_strFileName.c_str());
-          return false;
-        }
-        MESSAGE("jpg is: %u bytes (%ux%u, %u components)", uint32_t(jpg.size()),
-                uint32_t(jpg.width()), uint32_t(jpg.height()),
-                uint32_t(jpg.components()));
-
-        const char *jpeg_data = jpg.data();
-        copy(jpeg_data, jpeg_data + jpg.size(), &vData[0]);
-        pDICOMStack->m_iAllocated = BITS_IN_JSAMPLE;
-      } else {
-        pDICOMStack->m_Elements[j]->GetData(vData);
-        MESSAGE("Creating intermediate file %s\n%u%%",
-                strTempMergeFilename.c_str(),
-                static_cast<unsigned>((100*j)/pDICOMStack->m_Elements.size()));
-      }
-
-      if (pDICOMStack->m_bIsBigEndian != EndianConvert::IsBigEndian()) {
-        MESSAGE("Converting Endianess ...");
-        switch (pDICOMStack->m_iAllocated) {
-          case  8 : break;
-          case 16 : {
-                short *pData = reinterpret_cast<short*>(&vData[0]);
-                for (uint32_t k = 0;k<iDataSize/2;k++)
-                  pData[k] = EndianConvert::Swap<short>(pData[k]);
-                } break;
-          case 32 : {
-                int *pData = reinterpret_cast<int*>(&vData[0]);
-                for (uint32_t k = 0;k<iDataSize/4;k++)
-                  pData[k] = EndianConvert::Swap<int>(pData[k]);
-                } break;
-        }
-      }
-
-      // HACK: For now we set bias to 0 for unsigned file as we've
-      // encountered a number of DICOM files files where the bias
-      // parameter would create negative values and so far I don't know
-      // how to interpret this correctly
-      if (!pDICOMStack->m_bSigned) pDICOMFileInfo->m_fBias = 0.0f;
-
-      if (pDICOMFileInfo->m_fScale != 1.0f || pDICOMFileInfo->m_fBias != 0.0f) {
-        MESSAGE("Applying Scale and Bias  ...");
-        if (pDICOMStack->m_bSigned) {
-          switch (pDICOMStack->m_iAllocated) {
-            case  8 :{
-                  char *pData = reinterpret_cast<char*>(&vData[0]);
-                  for (uint32_t k = 0;k<iDataSize/2;k++){
-                    float sbValue = pData[k] * pDICOMFileInfo->m_fScale + pDICOMFileInfo->m_fBias;
-                    pData[k] = (char)(sbValue);
-                  }} break;
-            case 16 : {
-                  short *pData = reinterpret_cast<short*>(&vData[0]);
-                  for (uint32_t k = 0;k<iDataSize/2;k++){
-                    float sbValue = pData[k] * pDICOMFileInfo->m_fScale + pDICOMFileInfo->m_fBias;
-                    pData[k] = (short)(sbValue);
-                  }} break;
-            case 32 : {
-                  int *pData = reinterpret_cast<int*>(&vData[0]);
-                  for (uint32_t k = 0;k<iDataSize/4;k++){
-                    float sbValue = pData[k] * pDICOMFileInfo->m_fScale + pDICOMFileInfo->m_fBias;
-                    pData[k] = (int)(sbValue);
-                  }} break;
-          }
-        } else {
-          switch (pDICOMStack->m_iAllocated) {
-            case  8 :{
-                  unsigned char *pData = reinterpret_cast<unsigned char*>(&vData[0]);
-                  for (uint32_t k = 0;k<iDataSize/2;k++){
-                    float sbValue = pData[k] * pDICOMFileInfo->m_fScale + pDICOMFileInfo->m_fBias;
-                    pData[k] = (unsigned char)(sbValue);
-                  }} break;
-            case 16 : {
-                  unsigned short *pData = reinterpret_cast<unsigned short*>(&vData[0]);
-                  for (uint32_t k = 0;k<iDataSize/2;k++){
-                    float sbValue = pData[k] * pDICOMFileInfo->m_fScale + pDICOMFileInfo->m_fBias;
-                    pData[k] = (unsigned short)(sbValue);
-                  }} break;
-            case 32 : {
-                  unsigned int *pData = reinterpret_cast<unsigned int*>(&vData[0]);
-                  for (uint32_t k = 0;k<iDataSize/4;k++) {
-                    float sbValue = pData[k] * pDICOMFileInfo->m_fScale + pDICOMFileInfo->m_fBias;
-                    pData[k] = (unsigned int)(sbValue);
-                  }} break;
-          }
-        }
-      }
- 
-      // TODO: implement proper DICOM Windowing
-      if (pDICOMFileInfo->m_fWindowWidth > 0) {
+      SimpleDICOMFileInfo* pDICOMFileInfo =
+        dynamic_cast<SimpleDICOMFileInfo*>(pDICOMStack->m_Elements[j]);
+      if (pDICOMFileInfo && pDICOMFileInfo->m_fWindowWidth > 0) {
         WARNING("DICOM Windowing parameters found!");
-      }
-
-      // Create temporary file with the DICOM (image) data.  We pretend 3
-      // component data is 4 component data to simplify processing later.
-      /// @todo FIXME: this code assumes 3 component data is always 3*char
-      if (pDICOMStack->m_iComponentCount == 3) {
-        uint32_t iRGBADataSize = (iDataSize / 3) * 4;
-
-        // Later we'll tell RAWConverter that this dataset has
-        // m_iComponentCount components.  Since we're upping the number of
-        // components here, we update the component count too.
-        pDICOMStack->m_iComponentCount = 4;
-        // Do note that the number of components in the data and the number of
-        // components in our in-memory copy of the data now differ.
-
-        unsigned char *pRGBAData = new unsigned char[iRGBADataSize];
-        for (uint32_t k = 0;k<iDataSize/3;k++) {
-          pRGBAData[k*4+0] = vData[k*3+0];
-          pRGBAData[k*4+1] = vData[k*3+1];
-          pRGBAData[k*4+2] = vData[k*3+2];
-          pRGBAData[k*4+3] = 255;
-        }
-        fs.write((char*)pRGBAData, iRGBADataSize);
-        delete[] pRGBAData;
-      } else {
-        fs.write(&vData[0], iDataSize);
+        break;
       }
     }
 
-    fs.close();
-    MESSAGE("    done creating intermediate file %s", strTempMergeFilename.c_str());
-
-    UINT64VECTOR3 iSize = UINT64VECTOR3(pDICOMStack->m_ivSize);
-    iSize.z *= uint32_t(pDICOMStack->m_Elements.size());
-
     /// \todo evaluate pDICOMStack->m_strModality
     /// \todo read `is floating point' property from DICOM, instead of assuming
     /// false.
-    const uint64_t timesteps = 1;
-    bool result =
-      RAWConverter::ConvertRAWDataset(strTempMergeFilename, strTargetFilename,
-                                      strTempDir, 0, pDICOMStack->m_iAllocated,
-                                      pDICOMStack->m_iComponentCount,
-                                      timesteps,
-                                      pDICOMStack->m_bIsBigEndian !=
-                                      EndianConvert::IsBigEndian(),
-                                      pDICOMStack->m_bSigned,
-                                      false, iSize, pDICOMStack->m_fvfAspect,
-                                      "DICOM stack",
-                                      SysTools::GetFilename(
-                                      pDICOMStack->m_Elements[0]->m_strFileName)
-                                      + " to " + SysTools::GetFilename(
-                                        pDICOMStack->m_Elements[
-                                          pDICOMStack->m_Elements.size()-1
-                                        ]->m_strFileName
-                                      ),
-                                      iMaxBrickSize, iBrickOverlap,
-                                      m_bUseMedianFilter,
-                                      m_bClampToEdge,
-                                      m_iCompression,
-                                      m_iCompressionLevel,
-                                      m_iLayout,
-                                      0, bQuantizeTo8Bit
-                                     );
-
-    if(remove(strTempMergeFilename.c_str()) != 0) {
-      WARNING("Unable to remove temp file %s", strTempMergeFilename.c_str());
-    }
-
-    return result;
+    const string strSource = SysTools::GetFilename(
+      pDICOMStack->m_Elements[0]->m_strFileName) + " to " +
+      SysTools::GetFilename(pDICOMStack->m_Elements[
+        pDICOMStack->m_Elements.size()-1]->m_strFileName);
+    return ConvertStack(*pDICOMStack, strTargetFilename, strTempDir,
+                        "DICOM stack", strSource, iMaxBrickSize,
+                        iBrickOverlap, bQuantizeTo8Bit);
   } else if(pStack->m_strFileType == "IMAGE") {
     MESSAGE("  Detected Image stack, starting image conversion");
     MESSAGE("  Stack contains %u files",
             static_cast<unsigned>(pStack->m_Elements.size()));
 
-    string strTempMergeFilename = strTempDir +
-                                  SysTools::GetFilename(strTargetFilename) +
-                                  "~";
-    MESSAGE("Creating intermediate file %s", strTempMergeFilename.c_str());
-
-    ofstream fs;
-    fs.open(strTempMergeFilename.c_str(),fstream::binary);
-    if (fs.fail())  {
-      T_ERROR("Could not create temp file %s aborted conversion.",
-              strTempMergeFilename.c_str());
-      return false;
-    }
-
-    vector<char> vData;
-    for (size_t j = 0;j<pStack->m_Elements.size();j++) {
-      pStack->m_Elements[j]->GetData(vData);
-
-      fs.write(&vData[0], vData.size());
-      MESSAGE("Creating intermediate file %s\n%u%%",
-              strTempMergeFilename.c_str(),
-              static_cast<unsigned>((100*j)/pStack->m_Elements.size()));
-    }
-
-    fs.close();
-    MESSAGE("    done creating intermediate file %s",
-            strTempMergeFilename.c_str());
-
-    UINT64VECTOR3 iSize = UINT64VECTOR3(pStack->m_ivSize);
-    iSize.z *= uint32_t(pStack->m_Elements.size());
-
     const string first_fn =
       SysTools::GetFilename(pStack->m_Elements[0]->m_strFileName);
     const size_t last_elem = pStack->m_Elements.size()-1;
     const string last_fn =
       SysTools::GetFilename(pStack->m_Elements[last_elem]->m_strFileName);
 
-    const uint64_t timesteps = 1;
-
-    // grab the number of components from the first file in the set.
-    uint64_t components = pStack->m_Elements[0]->GetComponentCount();
-
-    bool result =
-      RAWConverter::ConvertRAWDataset(strTempMergeFilename, strTargetFilename,
-                                      strTempDir, 0, pStack->m_iAllocated,
-                                      components,
-                                      timesteps,
-                                      pStack->m_bIsBigEndian !=
-                                        EndianConvert::IsBigEndian(),
-                                      pStack->m_iComponentCount >= 32, false,
-                                      iSize, pStack->m_fvfAspect,
-                                      "Image stack",
-                                      first_fn + " to " + last_fn,
-                                      iMaxBrickSize, iBrickOverlap, 
-                                      m_bUseMedianFilter,
-                                      m_bClampToEdge,
-                                      m_iCompression,
-                                      m_iCompressionLevel,
-                                      m_iLayout);
-
-    if(remove(strTempMergeFilename.c_str()) != 0) {
-      WARNING("Unable to remove temp file %s", strTempMergeFilename.c_str());
-    }
-
-    return result;
+    return ConvertStack(*pStack, strTargetFilename, strTempDir,
+                        "Image stack", first_fn + " to " + last_fn,
+                        iMaxBrickSize, iBrickOverlap, false);
   } else {
     T_ERROR("Unknown source stack type %s", pStack->m_strFileType.c_str());
   }
@@ -593,155 +372,43 @@ bool IOManager::ConvertDataset(FileStackInfo* pStack,
   #pragma warning(default:4996)
 #endif
 
-class MergeDataset {
-public:
-  MergeDataset(std::string _strFilename="", uint64_t _iHeaderSkip=0, bool _bDelete=false,
-               double _fScale=1.0, double _fBias=0.0) :
-    strFilename(_strFilename),
-    iHeaderSkip(_iHeaderSkip),
-    bDelete(_bDelete),
-    fScale(_fScale),
-    fBias(_fBias)
-  {}
-
-  std::string strFilename;
-  uint64_t iHeaderSkip;
-  bool bDelete;
-  double fScale;
-  double fBias;
-};
-
-template <class T> class DataMerger {
-public:
-  DataMerger(const std::vector<MergeDataset>& strFiles,
-             const std::string& strTarget, uint64_t iElemCount,
-             tuvok::MasterController* pMasterController,
-             bool bUseMaxMode) :
-    bIsOK(false)
-  {
-    AbstrDebugOut& dbg = *(pMasterController->DebugOut());
-    dbg.Message(_func_,"Copying first file %s ...",
-                SysTools::GetFilename(strFiles[0].strFilename).c_str());
-    if (!LargeRAWFile::Copy(strFiles[0].strFilename, strTarget,
-                            strFiles[0].iHeaderSkip)) {
-      dbg.Error("Could not copy '%s' to '%s'", strFiles[0].strFilename.c_str(),
-                strTarget.c_str());
-      bIsOK = false;
-      return;
-    }
-
-    dbg.Message(_func_,"Merging ...");
-    LargeRAWFile target(strTarget);
-    target.Open(true);
-
-    if (!target.IsOpen()) {
-      dbg.Error("Could not open '%s'", strTarget.c_str());
-      remove(strTarget.c_str());
-      bIsOK = false;
-      return;
-    }
-
-    uint64_t iCopySize = std::min(iElemCount,BLOCK_COPY_SIZE/2)/sizeof(T);
-    T* pTargetBuffer = new T[size_t(iCopySize)];
-    T* pSourceBuffer = new T[size_t(iCopySize)];
-    for (size_t i = 1;i<strFiles.size();i++) {
-      dbg.Message(_func_,"Merging with file %s ...",
-                  SysTools::GetFilename(strFiles[i].strFilename).c_str());
-      LargeRAWFile source(strFiles[i].strFilename, strFiles[i].iHeaderSkip);
-      source.Open(false);
-      if (!source.IsOpen()) {
-        dbg.Error(_func_, "Could not open '%s'!",
-                  strFiles[i].strFilename.c_str());
-        delete [] pTargetBuffer;
-        delete [] pSourceBuffer;
-        target.Close();
-        remove(strTarget.c_str());
-        bIsOK = false;
-        return;
-      }
-
-      uint64_t iReadSize=0;
-      do {
-         source.ReadRAW((unsigned char*)pSourceBuffer, iCopySize*sizeof(T));
-         iCopySize = target.ReadRAW((unsigned char*)pTargetBuffer,
-                                    iCopySize*sizeof(T))/sizeof(T);
-
-         if (bUseMaxMode) {
-           if (i == 1) {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               pTargetBuffer[j] = std::max<T>(
-                 T(std::min<double>(
-                   strFiles[0].fScale*(pTargetBuffer[j] + strFiles[0].fBias),
-                   static_cast<double>(std::numeric_limits<T>::max())
-                 )),
-                 T(std::min<double>(
-                   strFiles[i].fScale*(pSourceBuffer[j] + strFiles[i].fBias),
-                   static_cast<double>(std::numeric_limits<T>::max()))
-                 )
-               );
-             }
-           } else {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               pTargetBuffer[j] = std::max<T>(
-                 pTargetBuffer[j],
-                 T(std::min<double>(strFiles[i].fScale*(pSourceBuffer[j] +
-                                                        strFiles[i].fBias),
-                                    static_cast<double>(std::numeric_limits<T>::max())))
-               );
-             }
-           }
-         } else {
-           if (i == 1) {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               T a = T(std::min<double>(
-                 strFiles[0].fScale*(pTargetBuffer[j] + strFiles[0].fBias),
-                 static_cast<double>(std::numeric_limits<T>::max())
-               ));
-               T b = T(std::min<double>(
-                 strFiles[i].fScale*(pSourceBuffer[j] + strFiles[i].fBias),
-                 static_cast<double>(std::numeric_limits<T>::max())
-               ));
-               T val = a + b;
-
-               if (val < a || val < b) // overflow
-                 pTargetBuffer[j] = std::numeric_limits<T>::max();
-               else
-                 pTargetBuffer[j] = val;
-             }
-           } else {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               T b = T(std::min<double>(
-                 strFiles[i].fScale*(pSourceBuffer[j] + strFiles[i].fBias),
-                 static_cast<double>(std::numeric_limits<T>::max())
-               ));
-               T val = pTargetBuffer[j] + b;
-
-               if (val < pTargetBuffer[j] || val < b) // overflow
-                 pTargetBuffer[j] = std::numeric_limits<T>::max();
-               else
-                 pTargetBuffer[j] = val;
-             }
-           }
-         }
-         target.SeekPos(iReadSize*sizeof(T));
-         target.WriteRAW((unsigned char*)pTargetBuffer, iCopySize*sizeof(T));
-         iReadSize += iCopySize;
-      } while (iReadSize < iElemCount);
-      source.Close();
-    }
-
-    delete [] pTargetBuffer;
-    delete [] pSourceBuffer;
-    target.Close();
-
-    bIsOK = true;
+/// Converts a stack straight from its files, the slices are decoded while
+/// the octree is built.
+bool IOManager::ConvertStack(FileStackInfo& stack,
+                             const string& strTargetFilename,
+                             const string& strTempDir,
+                             const string& strDesc,
+                             const string& strSource,
+                             const uint64_t iMaxBrickSize,
+                             uint64_t iBrickOverlap,
+                             const bool bQuantizeTo8Bit) const {
+  try {
+    tuvok::StackSliceSource source(stack);
+    MESSAGE("Converting %llu slices of %llux%llu, %u bit, %llu components",
+            static_cast<unsigned long long>(source.GetSize().z),
+            static_cast<unsigned long long>(source.GetSize().x),
+            static_cast<unsigned long long>(source.GetSize().y),
+            source.GetComponentSize(),
+            static_cast<unsigned long long>(source.GetComponentCount()));
+    return RAWConverter::ConvertSlices(source, strTargetFilename, strTempDir,
+                                       source.GetComponentSize(),
+                                       source.GetComponentCount(),
+                                       source.IsBigEndian(),
+                                       source.IsSigned(), false,
+                                       source.GetSize(), stack.m_fvfAspect,
+                                       strDesc, strSource,
+                                       iMaxBrickSize, iBrickOverlap,
+                                       m_bUseMedianFilter,
+                                       m_bClampToEdge,
+                                       m_iCompression,
+                                       m_iCompressionLevel,
+                                       m_iLayout,
+                                       0, bQuantizeTo8Bit);
+  } catch(const tuvok::io::DSOpenFailed& e) {
+    T_ERROR("Could not convert '%s': %s", e.File(), e.what());
   }
-
-  bool IsOK() const {return bIsOK;}
-
-private:
-  bool bIsOK;
-};
+  return false;
+}
 
 bool IOManager::MergeDatasets(const vector <string>& strFilenames,
                               const vector <double>& vScales,
@@ -920,21 +587,20 @@ bool IOManager::MergeDatasets(const vector <string>& strFilenames,
   string strMergedFile = strTempDir + "merged.raw";
 
   bool bIsMerged = false;
-  MasterController *MCtlr = &(Controller::Instance());
   if (bSignedG) {
     if (bIsFloatG) {
       assert(iComponentSizeG >= 32);
       switch (iComponentSizeG) {
         case 32 : {
           DataMerger<float> d(vIntermediateFiles, strMergedFile,
-                              vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                              vVolumeSizeG.volume()*iComponentCountG,
                               bUseMaxMode);
           bIsMerged = d.IsOK();
           break;
         }
         case 64 : {
           DataMerger<double> d(vIntermediateFiles, strMergedFile,
-                               vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                               vVolumeSizeG.volume()*iComponentCountG,
                                bUseMaxMode);
           bIsMerged = d.IsOK();
           break;
@@ -943,29 +609,29 @@ bool IOManager::MergeDatasets(const vector <string>& strFilenames,
     } else {
       switch (iComponentSizeG) {
         case 8  : {
-          DataMerger<char> d(vIntermediateFiles, strMergedFile,
-                             vVolumeSizeG.volume()*iComponentCountG, MCtlr,
-                             bUseMaxMode);
+          DataMerger<int8_t> d(vIntermediateFiles, strMergedFile,
+                               vVolumeSizeG.volume()*iComponentCountG,
+                               bUseMaxMode);
           bIsMerged = d.IsOK();
           break;
         }
         case 16 : {
           DataMerger<short> d(vIntermediateFiles, strMergedFile,
-                              vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                              vVolumeSizeG.volume()*iComponentCountG,
                               bUseMaxMode);
           bIsMerged = d.IsOK();
           break;
         }
         case 32 : {
           DataMerger<int> d(vIntermediateFiles, strMergedFile,
-                            vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                            vVolumeSizeG.volume()*iComponentCountG,
                             bUseMaxMode);
           bIsMerged = d.IsOK();
           break;
         }
         case 64 : {
           DataMerger<int64_t> d(vIntermediateFiles, strMergedFile,
-                                vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                                vVolumeSizeG.volume()*iComponentCountG,
                                 bUseMaxMode);
           bIsMerged = d.IsOK();
           break;
@@ -981,28 +647,28 @@ bool IOManager::MergeDatasets(const vector <string>& strFilenames,
     switch (iComponentSizeG) {
       case 8  : {
         DataMerger<unsigned char> d(vIntermediateFiles, strMergedFile,
-                                    vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                                    vVolumeSizeG.volume()*iComponentCountG,
                                     bUseMaxMode);
         bIsMerged = d.IsOK();
         break;
       }
       case 16 : {
         DataMerger<unsigned short> d(vIntermediateFiles, strMergedFile,
-                                     vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                                     vVolumeSizeG.volume()*iComponentCountG,
                                      bUseMaxMode);
         bIsMerged = d.IsOK();
         break;
       }
       case 32 : {
         DataMerger<unsigned int> d(vIntermediateFiles, strMergedFile,
-                                   vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                                   vVolumeSizeG.volume()*iComponentCountG,
                                    bUseMaxMode);
         bIsMerged = d.IsOK();
         break;
       }
       case 64 : {
         DataMerger<uint64_t> d(vIntermediateFiles, strMergedFile,
-                               vVolumeSizeG.volume()*iComponentCountG, MCtlr,
+                               vVolumeSizeG.volume()*iComponentCountG,
                                bUseMaxMode);
         bIsMerged = d.IsOK();
         break;
@@ -1332,26 +998,6 @@ void IOManager::AddReader(shared_ptr<FileBackedDataset> ds) {
   m_dsFactory->AddReader(ds);
 }
 
-class MCData {
-public:
-  MCData(const std::string& strTargetFile) :
-    m_strTargetFile(strTargetFile)
-  {}
-
-  virtual ~MCData() {}
-  virtual bool PerformMC(void* pData, const UINTVECTOR3& vBrickSize, const UINT64VECTOR3& vBrickOffset) = 0;
-
-protected:
-  std::string m_strTargetFile;
-};
-
-bool MCBrick(void* pData, const UINT64VECTOR3& vBrickSize, 
-             const UINT64VECTOR3& vBrickOffset, void* pUserContext) {
-    MCData* pMCData = (MCData*)pUserContext;
-    return pMCData->PerformMC(pData, UINTVECTOR3(vBrickSize), vBrickOffset);
-}
-
-
 bool IOManager::ExtractImageStack(const tuvok::UVFDataset* pSourceData,
                                   const TransferFunction1D* pTrans,
                                   uint64_t iLODlevel, 
@@ -1406,179 +1052,48 @@ bool IOManager::ExtractImageStack(const tuvok::UVFDataset* pSourceData,
   return bTargetCreated;
 }
 
-template <class T> class MCDataTemplate  : public MCData {
-public:
-  MCDataTemplate(const std::string& strTargetFile, T TIsoValue, 
-                 const FLOATVECTOR3& vScale, 
-                 UINT64VECTOR3 vDataSize, tuvok::AbstrGeoConverter* conv,
-                 const FLOATVECTOR4& vColor) :
-    MCData(strTargetFile),
-    m_TIsoValue(TIsoValue),
-    m_iIndexoffset(0),
-    m_pMarchingCubes(new MarchingCubes<T>()),
-    m_vDataSize(vDataSize),
-    m_conv(conv),
-    m_vColor(vColor),
-    m_vScale(vScale)
-  {
-  }
-
-  virtual ~MCDataTemplate() {
-    tuvok::Mesh m = tuvok::Mesh(m_vertices, m_normals, tuvok::TexCoordVec(),
-                                tuvok::ColorVec(), m_indices, m_indices, 
-                                tuvok::IndexVec(),tuvok::IndexVec(), 
-                                false,false,"Marching Cubes mesh by ImageVis3D",
-                                tuvok::Mesh::MT_TRIANGLES);
-    m.SetDefaultColor(m_vColor);
-    m_conv->ConvertToNative(m, m_strTargetFile);
-  }
-
-  virtual bool PerformMC(void* pData, const UINTVECTOR3& vBrickSize, const UINT64VECTOR3& vBrickOffset) {
-   
-    T* ptData = (T*)pData;
-
-    // extract isosurface
-    m_pMarchingCubes->SetVolume(vBrickSize.x, vBrickSize.y, vBrickSize.z,
-                                ptData);
-    m_pMarchingCubes->Process(m_TIsoValue);
-
-    // brick scale
-    float fMaxSize = (FLOATVECTOR3(m_vDataSize) * m_vScale).maxVal();
-
-    FLOATVECTOR3 vecBrickOffset(vBrickOffset);
-    vecBrickOffset = vecBrickOffset * m_vScale;
-
-    for (int i = 0;i<m_pMarchingCubes->m_Isosurface->iVertices;i++) {
-      m_vertices.push_back((m_pMarchingCubes->m_Isosurface->vfVertices[i]+vecBrickOffset-FLOATVECTOR3(m_vDataSize)/2.0f)/fMaxSize);
-    }
-
-    for (int i = 0;i<m_pMarchingCubes->m_Isosurface->iVertices;i++) {
-      m_normals.push_back(m_pMarchingCubes->m_Isosurface->vfNormals[i]);
-    }    
-
-    for (int i = 0;i<m_pMarchingCubes->m_Isosurface->iTriangles;i++) {
-      m_indices.push_back(m_pMarchingCubes->m_Isosurface->viTriangles[i].x+m_iIndexoffset);
-      m_indices.push_back(m_pMarchingCubes->m_Isosurface->viTriangles[i].y+m_iIndexoffset);
-      m_indices.push_back(m_pMarchingCubes->m_Isosurface->viTriangles[i].z+m_iIndexoffset);
-    }
-
-    m_iIndexoffset += m_pMarchingCubes->m_Isosurface->iVertices;
-
-    return true;
-  }
-
-protected:
-  T                  m_TIsoValue;
-  uint32_t           m_iIndexoffset;
-  std::shared_ptr<MarchingCubes<T>> m_pMarchingCubes;
-  UINT64VECTOR3      m_vDataSize;
-  tuvok::AbstrGeoConverter* m_conv;
-  FLOATVECTOR4       m_vColor;
-  FLOATVECTOR3       m_vScale;
-  tuvok::VertVec     m_vertices;
-  tuvok::NormVec     m_normals;
-  tuvok::IndexVec    m_indices;
-};
-
 bool IOManager::ExtractIsosurface(const tuvok::UVFDataset* pSourceData,
                                   uint64_t iLODlevel, double fIsovalue,
                                   const FLOATVECTOR4& vfColor,
                                   const string& strTargetFilename,
-                                  const string& strTempDir) const {
-  if (pSourceData->GetComponentCount() != 1) {
-    T_ERROR("Isosurface extraction only supported for scalar volumes.");
-    return false;
-  }
-
-  string strTempFilename = strTempDir + SysTools::GetFilename(strTargetFilename)+".tmp_raw";
-  std::shared_ptr<MCData> pMCData;
-
-  bool   bFloatingPoint  = pSourceData->GetIsFloat();
-  bool   bSigned         = pSourceData->GetIsSigned();
-  unsigned iComponentSize = pSourceData->GetBitWidth();
-  FLOATVECTOR3 vScale    = FLOATVECTOR3(pSourceData->GetScale());
-
+                                  const string&) const {
   AbstrGeoConverter* conv = GetGeoConverterForExt(SysTools::ToLowerCase(SysTools::GetExt(strTargetFilename)),true, false);
-  
+
   if (conv == NULL) {
     T_ERROR("Unknown Mesh Format.");
     return false;
   }
 
-  UINT64VECTOR3 vDomainSize = pSourceData->GetDomainSize(size_t(iLODlevel));
-
-  if (bFloatingPoint) {
-    if (bSigned) {
-      switch (iComponentSize) {
-        case 32:
-          pMCData.reset(new MCDataTemplate<float>(strTargetFilename,
-            float(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 64:
-          pMCData.reset(new MCDataTemplate<double>(strTargetFilename,
-            double(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-      }
-    }
-  } else {
-    if (bSigned) {
-      switch (iComponentSize) {
-        case  8:
-          pMCData.reset(new MCDataTemplate<char>(strTargetFilename,
-            char(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 16:
-          pMCData.reset(new MCDataTemplate<short>(strTargetFilename,
-            short(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 32:
-          pMCData.reset(new MCDataTemplate<int>(strTargetFilename,
-            int(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 64:
-          pMCData.reset(new MCDataTemplate<int64_t>(strTargetFilename,
-            int64_t(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-      }
-    } else {
-      switch (iComponentSize) {
-        case  8:
-          pMCData.reset(new MCDataTemplate<unsigned char>(strTargetFilename,
-            (unsigned char)(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 16:
-          pMCData.reset(new MCDataTemplate<unsigned short>(strTargetFilename,
-            (unsigned short)(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 32:
-          pMCData.reset(new MCDataTemplate<uint32_t>(strTargetFilename,
-            uint32_t(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-        case 64:
-          pMCData.reset(new MCDataTemplate<uint64_t>(strTargetFilename,
-            uint64_t(fIsovalue), vScale, vDomainSize, conv, vfColor
-          )); break;
-      }
-    }
-  }
-
-  if (!pMCData) {
-    T_ERROR("Unsupported data format.");
+  tuvok::VertVec vertices;
+  tuvok::NormVec normals;
+  tuvok::IndexVec indices;
+  if (!ComputeIsosurface(*pSourceData, size_t(iLODlevel), fIsovalue,
+                         vertices, normals, indices)) {
+    T_ERROR("Export call failed.");
     return false;
   }
 
-  bool bResult = pSourceData->ApplyFunction(iLODlevel,&MCBrick,
-                                            (void*)pMCData.get(), 1);
-
-  if (SysTools::FileExists(strTempFilename)) remove (strTempFilename.c_str());
+  // center the mesh and scale its longest side to 1
+  const UINT64VECTOR3 vDomainSize = pSourceData->GetDomainSize(size_t(iLODlevel));
+  const FLOATVECTOR3 vScale = FLOATVECTOR3(pSourceData->GetScale());
+  const float fMaxSize = (FLOATVECTOR3(vDomainSize) * vScale).maxVal();
+  const FLOATVECTOR3 vCenter = FLOATVECTOR3(vDomainSize) / 2.0f;
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    vertices[i] = (vertices[i] - vCenter) * vScale / fMaxSize;
+  }
 
-  if (bResult)
-    return true;
-  else {
+  tuvok::Mesh m = tuvok::Mesh(vertices, normals, tuvok::TexCoordVec(),
+                              tuvok::ColorVec(), indices, indices,
+                              tuvok::IndexVec(),tuvok::IndexVec(),
+                              false,false,"Marching Cubes mesh by ImageVis3D",
+                              tuvok::Mesh::MT_TRIANGLES);
+  m.SetDefaultColor(vfColor);
+  if (!conv->ConvertToNative(m, strTargetFilename)) {
     remove (strTargetFilename.c_str());
     T_ERROR("Export call failed.");
     return false;
   }
+  return true;
 }
 
 bool IOManager::ExportMesh(const std::shared_ptr<Mesh> mesh, 
@@ -2108,6 +1623,16 @@ const std::shared_ptr<const RasterDataBlock> GetFirstRDB(const UVF& uvf)
   return NULL;
 }
 
+static std::shared_ptr<const TOCBlock> GetFirstTOC(const UVF& uvf)
+{
+  for(uint64_t i=0; i < uvf.GetDataBlockCount(); ++i) {
+    if(uvf.GetDataBlock(i)->GetBlockSemantic() == UVFTables::BS_TOC_BLOCK) {
+      return std::dynamic_pointer_cast<const TOCBlock>(uvf.GetDataBlock(i));
+    }
+  }
+  return std::shared_ptr<const TOCBlock>();
+}
+
 namespace {
   template<typename T>
   std::pair<T,T> mm_init_dispatch(signed_tag) {
@@ -2116,8 +1641,8 @@ namespace {
   }
   template<typename T>
   std::pair<T,T> mm_init_dispatch(unsigned_tag) {
-    return std::make_pair(std::numeric_limits<T>::min(),
-                          std::numeric_limits<T>::max());
+    return std::make_pair(std::numeric_limits<T>::max(),
+                          std::numeric_limits<T>::min());
   }
   template<typename T>
   std::pair<T,T> mm_init() {
@@ -2230,17 +1755,9 @@ MaxMin(const RasterDataBlock* rdb)
       } else if(!is_signed && 32 == bit_width) {
         mm.push_back(get_brick_minmax<uint32_t>(rdb, vLOD, b_idx));
       } else if( is_signed && 64 == bit_width) {
-        T_ERROR("int64_t unsupported...");
-        double mn = -std::numeric_limits<double>::max();
-        double mx =  std::numeric_limits<double>::max();
-        mm.push_back(DOUBLEVECTOR4(mn,mx, mn,mx));
-        assert(1 == 0);
+        mm.push_back(get_brick_minmax<int64_t>(rdb, vLOD, b_idx));
       } else if(!is_signed && 64 == bit_width) {
-        T_ERROR("uint64_t unsupported...");
-        double mn = -std::numeric_limits<double>::max();
-        double mx =  std::numeric_limits<double>::max();
-        mm.push_back(DOUBLEVECTOR4(mn,mx, mn,mx));
-        assert(1 == 0);
+        mm.push_back(get_brick_minmax<uint64_t>(rdb, vLOD, b_idx));
       } else {
         T_ERROR("Unsupported data type!");
         assert(1 == 0);
@@ -2330,6 +1847,35 @@ void IdentifyType(const std::vector<std::shared_ptr<UVFDataset>>& uvf,
   }
 }
 
+namespace {
+  // Datasets have no 64 bit integer GetBrick; the bytes are the same as
+  // with any other type, though.
+  template<typename T>
+  bool GetTypedBrick(const Dataset& ds, const BrickKey& key,
+                     std::vector<T>& data) {
+    return ds.GetBrick(key, data);
+  }
+  template<typename T>
+  bool GetWideBrick(const Dataset& ds, const BrickKey& key,
+                    std::vector<T>& data) {
+    std::vector<uint8_t> bytes;
+    if(!ds.GetBrick(key, bytes)) { return false; }
+    data.resize(bytes.size() / sizeof(T));
+    if(!data.empty()) {
+      std::memcpy(&data[0], &bytes[0], data.size() * sizeof(T));
+    }
+    return true;
+  }
+  bool GetTypedBrick(const Dataset& ds, const BrickKey& key,
+                     std::vector<int64_t>& data) {
+    return GetWideBrick(ds, key, data);
+  }
+  bool GetTypedBrick(const Dataset& ds, const BrickKey& key,
+                     std::vector<uint64_t>& data) {
+    return GetWideBrick(ds, key, data);
+  }
+}
+
 // Reads in data of the given type.  If data is not stored that way in
 // the file, it will expand it out to the given type.  Assumes it will
 // always be expanding data, never compressing it!
@@ -2359,7 +1905,7 @@ void TypedRead(std::vector<T>& data,
   if(dest_width == width && dest_signed == is_signed &&
      dest_float == is_float) {
     MESSAGE("Data is stored the way we need it!  Yay.");
-    ds.GetBrick(key, data);
+    GetTypedBrick(ds, key, data);
     return;
   }
 
@@ -2370,7 +1916,7 @@ void TypedRead(std::vector<T>& data,
   if(is_float && width == 32) {
     std::vector<float> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<float*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
@@ -2378,52 +1924,66 @@ void TypedRead(std::vector<T>& data,
     // Can this happen?  What would we expand double into?
     std::vector<double> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<double*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
   } else if( is_signed &&  8 == width) {
     std::vector<int8_t> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<int8_t*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
   } else if(!is_signed &&  8 == width) {
     std::vector<uint8_t> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<uint8_t*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
   } else if( is_signed && 16 == width) {
     std::vector<int16_t> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<int16_t*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
   } else if(!is_signed && 16 == width) {
     std::vector<uint16_t> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<uint16_t*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
   } else if( is_signed && 32 == width) {
     std::vector<int32_t> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<int32_t*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
   } else if(!is_signed && 32 == width) {
     std::vector<uint32_t> tmpdata;
     ds.GetBrick(key, tmpdata);
-    data.resize(tmpdata.size() / (width/8));
+    data.resize(tmpdata.size());
     interpolate<uint32_t*, typename std::vector<T>::iterator, T>(
       &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
     );
+  } else if( is_signed && 64 == width) {
+    std::vector<int64_t> tmpdata;
+    GetTypedBrick(ds, key, tmpdata);
+    data.resize(tmpdata.size());
+    interpolate<int64_t*, typename std::vector<T>::iterator, T>(
+      &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
+    );
+  } else if(!is_signed && 64 == width) {
+    std::vector<uint64_t> tmpdata;
+    GetTypedBrick(ds, key, tmpdata);
+    data.resize(tmpdata.size());
+    interpolate<uint64_t*, typename std::vector<T>::iterator, T>(
+      &tmpdata[0], (&tmpdata[0]) + tmpdata.size(), range, data.begin()
+    );
   } else {
     T_ERROR("Unhandled data type!  Width: %u, Signed: %d, Float: %d",
             static_cast<unsigned>(width), is_signed, is_float);
@@ -2431,28 +1991,43 @@ void TypedRead(std::vector<T>& data,
 }
 
 namespace {
+  /// @returns false if a brick could not be read or written
   template<typename T>
-  void ReadAndEvalBrick(
+  bool ReadAndEvalBrick(
     RasterDataBlock& rdb,
     const std::vector<std::shared_ptr<UVFDataset>>& uvfs,
     const std::vector<BrickTable::const_iterator>& iters,
-    tuvok::expression::Node* tree
+    const tuvok::expression::Program& program
   ) {
-    std::vector<std::vector<T>> involumes(uvfs.size());
-    std::vector<T> output;
-    for(size_t i=0; i < uvfs.size(); ++i) {
+    const UINTVECTOR3 voxels = iters[0]->second.n_voxels;
+    const size_t n = size_t(voxels.x) * voxels.y * voxels.z *
+                     size_t(uvfs[0]->GetComponentCount());
+    // only the volumes the expression refers to are read.
+    std::vector<std::vector<T>> involumes(program.Volumes());
+    std::vector<const T*> inputs(program.Volumes());
+    for(size_t i=0; i < involumes.size(); ++i) {
       MESSAGE("Reading brick from volume %u/%u...", static_cast<unsigned>(i+1),
               static_cast<unsigned>(uvfs.size()));
       TypedRead<T>(involumes[i], *uvfs[i], iters[i]->first);
+      if(involumes[i].size() != n) {
+        T_ERROR("Brick of volume %u has %u values instead of %u!",
+                static_cast<unsigned>(i), static_cast<unsigned>(
+                  involumes[i].size()), static_cast<unsigned>(n));
+        return false;
+      }
+      inputs[i] = &involumes[i][0];
     }
     MESSAGE("Evaluating expression ...");
-    tuvok::expression::evaluate(*tree, involumes, output);
+    std::vector<T> output(n);
+    tuvok::expression::evaluate(program, inputs, &output[0], n);
 
     MESSAGE("Writing ...");
     NDBrickKey nk = uvfs[0]->IndexToVectorKey(iters[0]->first);
     if(false == rdb.SetData(&output[0], nk.lod, nk.brick)) {
       T_ERROR("Write failed!");
+      return false;
     }
+    return true;
   }
 }
 
@@ -2475,6 +2050,15 @@ IOManager::EvaluateExpression(const std::string& expr,
     throw tuvok::expression::SyntaxError("", 0, 2, __FILE__, __LINE__);
   }
 
+  // Compile the expression once; every brick then runs the same program.
+  const tuvok::expression::Program program =
+    tuvok::expression::compile(*parser_tree_root());
+  if(program.Volumes() > volumes.size()) {
+    throw tuvok::expression::semantic::Error("the expression refers to a "
+                                             "volume which was not given",
+                                             __FILE__, __LINE__);
+  }
+
   // open all of those files and get UVF datasets for each of them.
   const bool verify=false;
   std::vector<std::shared_ptr<UVFDataset>> uvf;
@@ -2496,8 +2080,6 @@ IOManager::EvaluateExpression(const std::string& expr,
     }
   }
 
-  tuvok::expression::Node* tree = parser_tree_root();
-
   // volume iterators
   std::vector<BrickTable::const_iterator> viters;
 #ifdef DETECTED_OS_APPLE
@@ -2512,6 +2094,11 @@ IOManager::EvaluateExpression(const std::string& expr,
   }
 #endif
 
+  // Figure out which what type our output data should be.
+  size_t bit_width;
+  bool is_float, is_signed;
+  IdentifyType(uvf, bit_width, is_float, is_signed);
+
   std::shared_ptr<RasterDataBlock> rdb(new RasterDataBlock());
   rdb->SetBlockSemantic(UVFTables::BS_REG_NDIM_GRID);
   rdb->SetIdentityTransformation();
@@ -2532,61 +2119,74 @@ IOManager::EvaluateExpression(const std::string& expr,
     }
     *rdb = *rdb1;
   }
+  // ... but the output is stored in the widest type of all inputs.
+  rdb->ChangeElementType(bit_width,
+                         is_float ? (bit_width == 32 ? 23 : 52) : bit_width,
+                         is_signed);
 
   std::string tmp_fn = SysTools::RemoveExt(out_fn) + ".rdb";
   LargeRAWFile_ptr lout(new TempFile(tmp_fn));
   lout->Create();
   rdb->ResetFile(lout);
 
-  // Figure out which what type our output data should be.
-  size_t bit_width;
-  bool is_float, is_signed;
-  IdentifyType(uvf, bit_width, is_float, is_signed);
+  // The next brick of every input is read in the background while the
+  // current one is evaluated.
+  uint64_t max_brick = 0;
+  for(BrickTable::const_iterator b = uvf[0]->BricksBegin();
+      b != uvf[0]->BricksEnd(); ++b) {
+    max_brick = std::max<uint64_t>(max_brick, uint64_t(b->second.n_voxels.x) *
+                                   b->second.n_voxels.y * b->second.n_voxels.z);
+  }
+  for(size_t i=0; i < program.Volumes(); ++i) {
+    uvf[i]->SetPrefetchCache(2 * max_brick * uvf[i]->GetComponentCount() *
+                             (uvf[i]->GetBitWidth() / 8), 1);
+  }
 
   //     foreach brick:
   //       load brick into 'involumes'
-  //       evaluate(tree, input-bricks-in-a-vector, output)
+  //       evaluate(program, input-bricks-in-a-vector, output)
   //       write output somewhere
-  /// @todo FIXME: we should query bit_width, is_float, is_signed to create
-  /// different 'involumes' based on the type we need...
   size_t brick = 0;
   while(viters[0] != uvf[0]->BricksEnd()) {
-    for(size_t i=0; i < uvf.size(); ++i) {
-      MESSAGE("Brick %u (file %03u/%03u)...", static_cast<unsigned>(brick),
-              static_cast<unsigned>(i+1), static_cast<unsigned>(uvf.size()));
-      // Read in the data we need.
-      if(is_float && bit_width == 32) {
-        ReadAndEvalBrick<float>(*rdb, uvf, viters, tree);
-      } else if(is_float && bit_width == 64) {
-        // Not implemented in UVF...
-        T_ERROR("double format data not supported!");
-        continue;
-      } else if( is_signed && bit_width ==  8) {
-        ReadAndEvalBrick< int8_t>(*rdb, uvf, viters, tree);
-      } else if(!is_signed && bit_width ==  8) {
-        ReadAndEvalBrick<uint8_t>(*rdb, uvf, viters, tree);
-      } else if( is_signed && bit_width == 16) {
-        ReadAndEvalBrick< int16_t>(*rdb, uvf, viters, tree);
-      } else if(!is_signed && bit_width == 16) {
-        ReadAndEvalBrick<uint16_t>(*rdb, uvf, viters, tree);
-      // These types aren't yet implemented in UVF/RasterDataBlock.
-      } else if( is_signed && bit_width == 32) {
-        T_ERROR("32bit signed int data not implemented!");
-        //ReadAndEvalBrick< int32_t>(*rdb, uvf, viters, tree);
-      } else if(!is_signed && bit_width == 32) {
-        T_ERROR("32bit unsigned data not implemented!");
-        //ReadAndEvalBrick<uint32_t>(*rdb, uvf, viters, tree);
-      } else if( is_signed && bit_width == 64) {
-        T_ERROR("64bit signed int data not implemented!");
-        //ReadAndEvalBrick< int64_t>(*rdb, uvf, viters, tree);
-      } else if(!is_signed && bit_width == 64) {
-        T_ERROR("64bit unsigned data not implemented!");
-        //ReadAndEvalBrick<uint64_t>(*rdb, uvf, viters, tree);
-      } else {
-        T_ERROR("Could not figure out destination data type!");
+    for(size_t i=0; i < program.Volumes(); ++i) {
+      BrickTable::const_iterator next = viters[i];
+      if(++next != uvf[i]->BricksEnd()) {
+        uvf[i]->Prefetch(std::vector<BrickKey>(1, next->first));
       }
     }
     MESSAGE("Brick %u (evaluation)...", static_cast<unsigned>(brick));
+    bool ok;
+    if(is_float && bit_width == 32) {
+      ok = ReadAndEvalBrick<float>(*rdb, uvf, viters, program);
+    } else if(is_float && bit_width == 64) {
+      ok = ReadAndEvalBrick<double>(*rdb, uvf, viters, program);
+    } else if( is_signed && bit_width ==  8) {
+      ok = ReadAndEvalBrick< int8_t>(*rdb, uvf, viters, program);
+    } else if(!is_signed && bit_width ==  8) {
+      ok = ReadAndEvalBrick<uint8_t>(*rdb, uvf, viters, program);
+    } else if( is_signed && bit_width == 16) {
+      ok = ReadAndEvalBrick< int16_t>(*rdb, uvf, viters, program);
+    } else if(!is_signed && bit_width == 16) {
+      ok = ReadAndEvalBrick<uint16_t>(*rdb, uvf, viters, program);
+    } else if( is_signed && bit_width == 32) {
+      ok = ReadAndEvalBrick< int32_t>(*rdb, uvf, viters, program);
+    } else if(!is_signed && bit_width == 32) {
+      ok = ReadAndEvalBrick<uint32_t>(*rdb, uvf, viters, program);
+    } else if( is_signed && bit_width == 64) {
+      ok = ReadAndEvalBrick< int64_t>(*rdb, uvf, viters, program);
+    } else if(!is_signed && bit_width == 64) {
+      ok = ReadAndEvalBrick<uint64_t>(*rdb, uvf, viters, program);
+    } else {
+      T_ERROR("Could not figure out destination data type!");
+      ok = false;
+    }
+    // a brick we could not compute would leave a hole in the output
+    if(!ok) {
+      throw tuvok::io::IOException("Could not evaluate the expression for "
+                                   "brick " + SysTools::ToString(brick),
+                                   __FILE__, __LINE__);
+    }
+    ++brick;
 
     using namespace std::placeholders;
     // advance each brick iterator by one.
@@ -2602,6 +2202,9 @@ IOManager::EvaluateExpression(const std::string& expr,
                             _1, 1));
 #endif
   }
+  for(size_t i=0; i < program.Volumes(); ++i) {
+    uvf[i]->SetPrefetchCache(0);
+  }
 
   CreateUVFFromRDB(out_fn, rdb);
 }
@@ -2612,6 +2215,35 @@ bool IOManager::ReBrickDataset(const string& strSourceFilename,
                                const uint64_t iMaxBrickSize,
                                const uint64_t iBrickOverlap,
                                bool bQuantizeTo8Bit) const {
+  // octrees are rebricked straight from their bricks, the old layout is read
+  // slice by slice (through a cache of decompressed bricks) while the new
+  // one is built.  Time series and foreign byte orders take the detour
+  // through an intermediate file.
+  if(SysTools::ToUpperCase(SysTools::GetExt(strSourceFilename)) == "UVF") {
+    // max(): disable bricksize check
+    UVFDataset v(strSourceFilename,numeric_limits<uint64_t>::max(),false,false);
+    const std::shared_ptr<const TOCBlock> toc = GetFirstTOC(*v.GetUVFFile());
+    if(toc && v.GetNumberOfTimesteps() == 1 && v.IsSameEndianness()) {
+      MESSAGE("Rebricking %s into bricks of %llu voxels...",
+              strSourceFilename.c_str(), iMaxBrickSize);
+      OctreeSliceSource source(toc->GetOctree(), 0, iMaxBrickSize);
+      const bool bRebricked = RAWConverter::ConvertSlices(
+        source, strTargetFilename, strTempDir, v.GetBitWidth(),
+        v.GetComponentCount(), EndianConvert::IsBigEndian(), v.GetIsSigned(),
+        v.GetIsFloat(), source.GetSize(), FLOATVECTOR3(v.GetScale()),
+        "UVF data", SysTools::GetFilename(strSourceFilename),
+        iMaxBrickSize, iBrickOverlap, m_bUseMedianFilter, m_bClampToEdge,
+        m_iCompression, m_iCompressionLevel, m_iLayout, NULL,
+        bQuantizeTo8Bit
+      );
+      if(!bRebricked) {
+        T_ERROR("Unable to rebrick %s into new UVF file %s",
+                strSourceFilename.c_str(), strTargetFilename.c_str());
+      }
+      return bRebricked;
+    }
+  }
+
   MESSAGE("Rebricking (Phase 1/2)...");
 
   string filenameOnly = SysTools::GetFilename(strSourceFilename);
@@ -284,6 +284,14 @@ private:
                                  tuvok::AbstrRenderer*)> m_LoadDS;
 
   void CopyToTSB(const tuvok::Mesh& m, GeometryDataBlock* tsb) const;
+  bool ConvertStack(FileStackInfo& stack,
+                    const std::string& strTargetFilename,
+                    const std::string& strTempDir,
+                    const std::string& strDesc,
+                    const std::string& strSource,
+                    const uint64_t iMaxBrickSize,
+                    uint64_t iBrickOverlap,
+                    const bool bQuantizeTo8Bit) const;
 };
 
 #endif // IOMANAGER_H
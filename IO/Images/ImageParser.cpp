@@ -35,13 +35,16 @@
   \date    September 2008
 */
 
+#include <exception>
 #include "ImageParser.h"
 #ifndef TUVOK_NO_QT
 # include <QtGui/QImage>
+# include <QtGui/QImageReader>
 # include <QtGui/QColor>
 #endif
 #include <Basics/SysTools.h>
 #include <Controller/Controller.h>
+#include <IO/DirectoryScanCache.h>
 
 using namespace boost;
 using namespace std;
@@ -207,14 +210,70 @@ void ImageParser::GetDirInfo(string  strDirectory) {
   vector<ImageFileInfo> fileInfos;
 
 #ifndef TUVOK_NO_QT
-  // query directory for image files
-  for (size_t i = 0;i<files.size();i++) {
-    MESSAGE("Looking for image data in file %s", files[i].c_str());
+  // query directory for image files.  Only the image headers are read, on
+  // several threads, and files which did not change since the last scan
+  // are taken from the cache.  The cache record of an image is its size,
+  // an empty record marks a file which is not an image.
+  if (!files.empty()) {
+    tuvok::DirectoryScanCache cache(strDirectory, "image");
+    vector<UINTVECTOR2> sizes(files.size(), UINTVECTOR2(0,0));
+    vector<LARGE_STAT_BUFFER> stats(files.size());
+    vector<char> hasStat(files.size(), 0);
+    size_t iCached = 0;
+    std::exception_ptr error;
+
+#pragma omp parallel for schedule(dynamic) num_threads(ScanThreads(files.size()))
+    for (int i = 0; i < int(files.size()); ++i) {
+      try {
+        if (!SysTools::GetFileStats(files[i], stats[i])) continue;
+        hasStat[i] = 1;
+
+        string record;
+        if (cache.Lookup(files[i], stats[i], record)) {
+          size_t pos = 0;
+          if (record.empty() ||
+              (tuvok::DirectoryScanCache::Get(record, pos, sizes[i].x) &&
+               tuvok::DirectoryScanCache::Get(record, pos, sizes[i].y))) {
+#pragma omp atomic
+            ++iCached;
+            continue;
+          }
+          sizes[i] = UINTVECTOR2(0,0);
+        }
+
+        QImageReader reader(QString::fromLocal8Bit(files[i].c_str()));
+        if (!reader.canRead()) continue;
+        QSize size = reader.size();
+        if (!size.isValid()) {
+          // the format cannot tell the size without decoding the image
+          size = reader.read().size();
+        }
+        if (size.isValid()) {
+          sizes[i] = UINTVECTOR2(size.width(), size.height());
+        }
+      } catch (...) {
+#pragma omp critical (ImageScanError)
+        {
+          if (!error) { error = std::current_exception(); }
+        }
+      }
+    }
+    if (error) { std::rethrow_exception(error); }
+
+    for (size_t i = 0;i<files.size();i++) {
+      const bool bImage = sizes[i].area() != 0;
+      if (hasStat[i]) {
+        string record;
+        if (bImage) {
+          tuvok::DirectoryScanCache::Put(record, sizes[i].x);
+          tuvok::DirectoryScanCache::Put(record, sizes[i].y);
+        }
+        cache.Store(files[i], stats[i], record);
+      }
+      if (!bImage) continue;
 
-    QImage qImage(files[i].c_str());
-    if (!qImage.isNull()) {
       ImageFileInfo info(files[i]);
-      info.m_ivSize          = UINTVECTOR2(qImage.size().width(), qImage.size().height());
+      info.m_ivSize          = sizes[i];
       info.m_iAllocated      = 8;  // lets assume all images are 8 bit
       info.m_iComponentCount = 1;  // as qt converts any image to RGBA we also assume that the images were 1 component
 
@@ -222,6 +281,11 @@ void ImageParser::GetDirInfo(string  strDirectory) {
 
       fileInfos.push_back(info);
     }
+    cache.Save();
+    MESSAGE("Scanned %u files: %u images, %u of the files from the cache.",
+            static_cast<unsigned>(files.size()),
+            static_cast<unsigned>(fileInfos.size()),
+            static_cast<unsigned>(iCached));
   }
 #else
   T_ERROR("Images loaded/verified through Qt, which is disabled!");
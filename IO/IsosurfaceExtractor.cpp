@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <exception>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include "IsosurfaceExtractor.h"
+#include "Basics/MC.h"
+#include "Controller/Controller.h"
+#include "uvfDataset.h"
+
+namespace tuvok {
+
+namespace {
+  // a range of cell layers of one brick; a brick is one or more slabs.
+  struct Slab {
+    BrickKey key;
+    UINT64VECTOR3 vSize;    ///< voxels in the brick, with overlap
+    UINT64VECTOR3 vFirst;   ///< first cell (voxel in the brick)
+    UINT64VECTOR3 vLast;    ///< one past the last cell
+    UINT64VECTOR3 vGlobal;  ///< position of vFirst in the LOD
+    UINT64VECTOR3 vDomain;
+    uint64_t iEdgeBase;     ///< keeps the edges of time steps apart
+  };
+
+  // each cell belongs to the brick which holds its first voxel as a core
+  // (non-overlap) voxel; its other voxels are then in the overlap.
+  bool MakeSlabs(const UVFDataset& ds, size_t lod, double fIsovalue,
+                 std::vector<Slab>& slabs) {
+    const UINT64VECTOR3 vOverlap(ds.GetBrickOverlapSize());
+    if (vOverlap.x == 0 || vOverlap.y == 0 || vOverlap.z == 0) {
+      T_ERROR("Isosurface extraction needs bricks with overlap.");
+      return false;
+    }
+    const UINT64VECTOR3 vCore = UINT64VECTOR3(ds.GetMaxBrickSize()) -
+                                vOverlap * 2;
+
+    std::vector<BrickKey> keys;
+    for (BrickTable::const_iterator b = ds.BricksBegin();
+         b != ds.BricksEnd(); ++b) {
+      if (std::get<1>(b->first) != lod) continue;
+      if (!ds.ContainsData(b->first, fIsovalue, fIsovalue)) continue;
+      keys.push_back(b->first);
+    }
+    // the brick table is a hash; sort, so that the mesh comes out the same
+    // every time.
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<Slab> bricks;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const size_t ts = std::get<0>(keys[i]);
+      const UINT64VECTOR3 vLayout(ds.GetBrickLayout(lod, ts));
+      const uint64_t idx = std::get<2>(keys[i]);
+      const UINT64VECTOR3 vCoords(idx % vLayout.x,
+                                  (idx / vLayout.x) % vLayout.y,
+                                  idx / (vLayout.x * vLayout.y));
+      Slab s;
+      s.key = keys[i];
+      s.vSize = UINT64VECTOR3(ds.GetBrickVoxelCounts(keys[i]));
+      s.vDomain = ds.GetDomainSize(lod, ts);
+      s.vGlobal = vCoords * vCore;
+      s.vFirst = vOverlap;
+      s.vLast = vOverlap + vCore;
+      for (size_t d = 0; d < 3; ++d) {
+        // the last voxel of the domain starts no cell
+        s.vLast[d] = std::min(s.vLast[d],
+                              vOverlap[d] + s.vDomain[d]-1 - s.vGlobal[d]);
+        s.vLast[d] = std::min(s.vLast[d], s.vSize[d]-1);
+      }
+      s.iEdgeBase = ts * 3 * s.vDomain.volume();
+      if (s.vLast.x > s.vFirst.x && s.vLast.y > s.vFirst.y &&
+          s.vLast.z > s.vFirst.z) {
+        bricks.push_back(s);
+      }
+    }
+
+    // with fewer bricks than threads, cut them into slabs along z.
+    int iThreads = 1;
+#ifdef _OPENMP
+    iThreads = omp_get_max_threads();
+#endif
+    const uint64_t iSlabs = bricks.empty() ? 1 :
+      std::max<uint64_t>(1, (2*iThreads + bricks.size()-1) / bricks.size());
+    for (size_t i = 0; i < bricks.size(); ++i) {
+      const uint64_t iLayers = bricks[i].vLast.z - bricks[i].vFirst.z;
+      const uint64_t n = std::min(iSlabs, iLayers);
+      for (uint64_t j = 0; j < n; ++j) {
+        Slab s = bricks[i];
+        s.vFirst.z = bricks[i].vFirst.z + iLayers * j / n;
+        s.vLast.z = bricks[i].vFirst.z + iLayers * (j+1) / n;
+        s.vGlobal.z += s.vFirst.z - bricks[i].vFirst.z;
+        slabs.push_back(s);
+      }
+    }
+    return true;
+  }
+
+  template<typename T>
+  bool March(const UVFDataset& ds, size_t lod, double fIsovalue,
+             IsoWelder& mesh) {
+    // integer data are marched against the truncated isovalue; test the
+    // bricks' min/maxes against the same value.
+    const T TIsoValue = T(fIsovalue);
+    std::vector<Slab> slabs;
+    if (!MakeSlabs(ds, lod, double(TIsoValue), slabs)) { return false; }
+    MESSAGE("Marching %u slabs of bricks.", unsigned(slabs.size()));
+
+    std::vector<IsoBlock> blocks(slabs.size());
+    std::exception_ptr error;
+    bool bReadError = false;
+
+#pragma omp parallel
+    {
+      std::vector<T> vData;
+      bool bHaveData = false;
+      BrickKey current;
+#pragma omp for schedule(dynamic)
+      for (int i = 0; i < int(slabs.size()); ++i) {
+        const Slab& s = slabs[size_t(i)];
+        try {
+          // slabs of one brick are next to each other; keep the brick.
+          if (!bHaveData || s.key != current) {
+            bHaveData = ds.GetBrick(s.key, vData);
+            current = s.key;
+          }
+          if (bHaveData) {
+            BlockMarchingCubes<T>::March(&vData[0], s.vSize, s.vFirst,
+                                         s.vLast, s.vGlobal, s.vDomain,
+                                         s.iEdgeBase, TIsoValue,
+                                         blocks[size_t(i)]);
+          } else {
+#pragma omp critical (MarchError)
+            bReadError = true;
+          }
+        } catch (...) {
+#pragma omp critical (MarchError)
+          if (!error) { error = std::current_exception(); }
+        }
+      }
+    }
+    if (error) { std::rethrow_exception(error); }
+    if (bReadError) {
+      T_ERROR("Could not read the bricks of the data set.");
+      return false;
+    }
+
+    // in slab order, so that the mesh does not depend on the scheduling
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      mesh.Add(blocks[i]);
+      blocks[i].Clear();
+    }
+    return true;
+  }
+}
+
+bool ComputeIsosurface(const UVFDataset& ds, size_t lod, double fIsovalue,
+                       VertVec& vertices, NormVec& normals,
+                       IndexVec& indices) {
+  if (ds.GetComponentCount() != 1) {
+    T_ERROR("Isosurface extraction only supported for scalar volumes.");
+    return false;
+  }
+  IsoWelder mesh;
+  bool bOK = false;
+  const bool bSigned = ds.GetIsSigned();
+  if (ds.GetIsFloat()) {
+    switch (ds.GetBitWidth()) {
+      case 32: bOK = March<float>(ds, lod, fIsovalue, mesh); break;
+      case 64: bOK = March<double>(ds, lod, fIsovalue, mesh); break;
+      default: T_ERROR("Unsupported data format."); return false;
+    }
+  } else {
+    switch (ds.GetBitWidth()) {
+      case 8:
+        bOK = bSigned ? March<int8_t>(ds, lod, fIsovalue, mesh)
+                      : March<uint8_t>(ds, lod, fIsovalue, mesh);
+        break;
+      case 16:
+        bOK = bSigned ? March<int16_t>(ds, lod, fIsovalue, mesh)
+                      : March<uint16_t>(ds, lod, fIsovalue, mesh);
+        break;
+      case 32:
+        bOK = bSigned ? March<int32_t>(ds, lod, fIsovalue, mesh)
+                      : March<uint32_t>(ds, lod, fIsovalue, mesh);
+        break;
+      default: T_ERROR("Unsupported data format."); return false;
+    }
+  }
+  if (!bOK) { return false; }
+
+  vertices.swap(mesh.vfVertices);
+  normals.swap(mesh.vfNormals);
+  indices.swap(mesh.viIndices);
+  MESSAGE("Isosurface has %u vertices and %u triangles.",
+          unsigned(vertices.size()), unsigned(indices.size()/3));
+  return true;
+}
+
+}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,51 @@
+#ifndef TUVOK_ISOSURFACE_EXTRACTOR_H
+#define TUVOK_ISOSURFACE_EXTRACTOR_H
+
+#include "Basics/Mesh.h"
+
+namespace tuvok {
+
+class UVFDataset;
+
+/// Extracts the isosurface of one LOD of a data set (all of its time steps)
+/// as a single indexed mesh.  Bricks are marched on all cores; LODs with few
+/// bricks are cut into slabs, so that there is still enough work to go
+/// around.  Bricks whose min/max exclude the isovalue are not even read.
+/// Each cell is marched exactly once and vertices on brick boundaries are
+/// shared, so the mesh has no seams.  The result does not depend on the
+/// number of threads.
+/// @param vertices in voxel coordinates of the LOD
+/// @returns false if the data type is not supported or a brick could not be
+/// read.
+bool ComputeIsosurface(const UVFDataset& ds, size_t lod, double fIsovalue,
+                       VertVec& vertices, NormVec& normals,
+                       IndexVec& indices);
+
+}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
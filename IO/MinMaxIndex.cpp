@@ -0,0 +1,181 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include "MinMaxIndex.h"
+#include "Basics/MemMappedFile.h"
+#include "Basics/SysTools.h"
+#include "Controller/Controller.h"
+
+namespace tuvok {
+
+// the index file is a header followed by one Entry per brick.  It is written
+// in native byte order; a file from a machine with another byte order fails
+// the header checks and is simply recomputed.
+struct MinMaxIndex::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t mode;
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint64_t sourceName;  ///< hash of the source's file name
+  uint64_t bricks[3];
+  uint64_t entries;
+  uint64_t check;       ///< of all of the above
+};
+
+static const char magic[8] = { 'T','U','V','O','K','M','M','I' };
+static const uint32_t version = 1;
+
+// FNV-1a
+static uint64_t hash(const void* data, size_t bytes) {
+  const uint8_t* d = static_cast<const uint8_t*>(data);
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i=0; i < bytes; ++i) {
+    h ^= d[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+MinMaxIndex::Identity
+MinMaxIndex::Identify(const std::string& source,
+                      const std::array<uint64_t,3>& bricks, uint32_t mode) {
+  Identity id = { source, 0, 0, bricks, mode };
+  LARGE_STAT_BUFFER st;
+  if(SysTools::GetFileStats(source, st)) {
+    id.sourceSize = uint64_t(st.st_size);
+    id.sourceTime = int64_t(st.st_mtime);
+  }
+  return id;
+}
+
+MinMaxIndex::MinMaxIndex(uint64_t entries) :
+  m_iEntries(entries),
+  m_pEntries(NULL),
+  m_vMemory(size_t(entries))
+{
+  std::memset(m_vMemory.data(), 0, m_vMemory.size() * sizeof(Entry));
+  m_pEntries = m_vMemory.data();
+}
+
+MinMaxIndex::MinMaxIndex(const std::string& filename, const Identity& id,
+                         uint64_t entries) :
+  m_iEntries(entries),
+  m_pEntries(NULL)
+{
+  Header hdr;
+  std::memset(&hdr, 0, sizeof(Header));
+  std::memcpy(hdr.magic, magic, sizeof(magic));
+  hdr.version = version;
+  hdr.mode = id.mode;
+  hdr.sourceSize = id.sourceSize;
+  hdr.sourceTime = id.sourceTime;
+  hdr.sourceName = hash(id.source.data(), id.source.size());
+  for(size_t i=0; i < 3; ++i) { hdr.bricks[i] = id.bricks[i]; }
+  hdr.entries = entries;
+  hdr.check = hash(&hdr, offsetof(Header, check));
+
+  if(!this->Open(filename, hdr)) {
+    WARNING("Could not use %s for brick min/maxes; they will not be kept.",
+            filename.c_str());
+    m_pFile.reset();
+    m_vMemory.resize(size_t(entries));
+    std::memset(m_vMemory.data(), 0, m_vMemory.size() * sizeof(Entry));
+    m_pEntries = m_vMemory.data();
+  }
+}
+
+MinMaxIndex::~MinMaxIndex() {}
+
+// maps an existing index, if it belongs to the same data; otherwise starts a
+// new one.  A new file is zero filled, i.e. all entries are missing.
+bool MinMaxIndex::Open(const std::string& filename, const Header& hdr) {
+  const uint64_t bytes = sizeof(Header) + m_iEntries * sizeof(Entry);
+
+  LARGE_STAT_BUFFER st;
+  if(SysTools::GetFileStats(filename, st)) {
+    if(uint64_t(st.st_size) == bytes) {
+      m_pFile.reset(new MemMappedFile(filename, MMFILE_ACCESS_READWRITE));
+      if(m_pFile->IsOpen() && m_pFile->GetDataPointer() != NULL &&
+         std::memcmp(m_pFile->GetDataPointer(), &hdr, sizeof(Header)) == 0) {
+        m_pEntries = reinterpret_cast<Entry*>(
+          static_cast<char*>(m_pFile->GetDataPointer()) + sizeof(Header)
+        );
+        MESSAGE("Reusing brick min/maxes from %s", filename.c_str());
+        return true;
+      }
+      m_pFile.reset();
+    }
+    MESSAGE("%s is out of date, recomputing brick min/maxes.",
+            filename.c_str());
+    if(std::remove(filename.c_str()) != 0) { return false; }
+  }
+
+  m_pFile.reset(new MemMappedFile(filename, MMFILE_ACCESS_READWRITE, bytes));
+  if(!m_pFile->IsOpen() || m_pFile->GetDataPointer() == NULL) {
+    return false;
+  }
+  std::memcpy(m_pFile->GetDataPointer(), &hdr, sizeof(Header));
+  m_pEntries = reinterpret_cast<Entry*>(
+    static_cast<char*>(m_pFile->GetDataPointer()) + sizeof(Header)
+  );
+  return true;
+}
+
+bool MinMaxIndex::get(uint64_t i, MinMaxBlock& mm) const {
+  if(i >= m_iEntries) { return false; }
+  Entry e = m_pEntries[i];
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if(e.check == 0 || e.check != hash(&e, offsetof(Entry, check))) {
+    return false;
+  }
+  mm = MinMaxBlock(e.minScalar, e.maxScalar, e.minGradient, e.maxGradient);
+  return true;
+}
+
+void MinMaxIndex::set(uint64_t i, const MinMaxBlock& mm) {
+  if(i >= m_iEntries) { return; }
+  Entry e;
+  std::memset(&e, 0, sizeof(Entry));
+  e.minScalar = mm.minScalar;
+  e.maxScalar = mm.maxScalar;
+  e.minGradient = mm.minGradient;
+  e.maxGradient = mm.maxGradient;
+  e.check = hash(&e, offsetof(Entry, check));
+  // invalidate the entry while we write it, so that a reader (or a crash)
+  // half way through sees a missing entry instead of a wrong one.
+  m_pEntries[i].check = 0;
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(&m_pEntries[i], &e, offsetof(Entry, check));
+  std::atomic_thread_fence(std::memory_order_release);
+  m_pEntries[i].check = e.check;
+}
+
+}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
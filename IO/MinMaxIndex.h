@@ -0,0 +1,98 @@
+#ifndef TUVOK_MINMAX_INDEX_H
+#define TUVOK_MINMAX_INDEX_H
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Basics/MinMaxBlock.h"
+#include "Basics/StdDefines.h"
+
+class MemMappedFile;
+
+namespace tuvok {
+
+/// Per-brick min/max information (scalar and gradient magnitude) of a data
+/// set, kept in a memory mapped file so that it survives between sessions.
+/// Entries are filled in as they are computed.  Each one carries a
+/// checksum, hence entries which were never written or were only partially
+/// written (e.g. by a crash) are reported as missing rather than used.
+/// Distinct entries may be read and written from several threads at once.
+class MinMaxIndex {
+public:
+  /// Identifies the data an index was computed for.  An index file with a
+  /// different identity is thrown away and started from scratch.
+  struct Identity {
+    std::string source;             ///< file the data come from
+    uint64_t sourceSize;            ///< its size, in bytes
+    int64_t sourceTime;             ///< and modification time
+    std::array<uint64_t,3> bricks;  ///< brick size, for rebricked data
+    uint32_t mode;                  ///< how the min/maxes are computed
+  };
+  /// @returns the identity of the given file; size and time are 0 if the
+  /// file does not exist.
+  static Identity Identify(const std::string& source,
+                           const std::array<uint64_t,3>& bricks,
+                           uint32_t mode);
+
+  /// Opens the index in 'filename', or creates it.  If the file cannot be
+  /// used, the index silently lives in memory instead.
+  MinMaxIndex(const std::string& filename, const Identity& id,
+              uint64_t entries);
+  /// An index in memory only.
+  explicit MinMaxIndex(uint64_t entries);
+  ~MinMaxIndex();
+
+  uint64_t size() const { return m_iEntries; }
+  /// @returns true if the index is backed by a file.
+  bool persistent() const { return m_pFile.get() != NULL; }
+
+  /// @returns false if the entry has not been computed (yet).
+  bool get(uint64_t i, MinMaxBlock& mm) const;
+  void set(uint64_t i, const MinMaxBlock& mm);
+
+private:
+  struct Header;
+  struct Entry {
+    double minScalar, maxScalar, minGradient, maxGradient;
+    uint64_t check; ///< of the values above; 0 for entries never written
+  };
+  MinMaxIndex(const MinMaxIndex&); ///< unimplemented
+  MinMaxIndex& operator=(const MinMaxIndex&); ///< unimplemented
+
+  bool Open(const std::string& filename, const Header& hdr);
+
+  uint64_t m_iEntries;
+  Entry* m_pEntries;
+  std::vector<Entry> m_vMemory;
+  std::unique_ptr<MemMappedFile> m_pFile;
+};
+
+}
+#endif
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -31,15 +31,26 @@
 #define SCIO_QUANTIZE_H
 
 #include <algorithm>
+#include <cstring>
+#include <exception>
 #include <stdexcept>
 #include <fstream>
 #include <functional>
 #include <limits>
+#include <memory>
+#include <sstream>
 #include <type_traits>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
 #include "Basics/BStream.h"
 #include "Basics/LargeRAWFile.h"
 #include "Basics/ctti.h"
+#include "Basics/Threads.h"
 #include "UVF/Histogram1DDataBlock.h"
+#include "UVF/ExtendedOctree/ExtendedOctreeConverter.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
 #include "TuvokSizes.h"
 #include "AbstrConverter.h"
 
@@ -341,86 +352,728 @@ std::pair<T,T> io_minmax(DataSrc<T> ds, Histogram<T, sz> histogram,
           static_cast<double>(t_minmax.second));
   return t_minmax;
 }
+}
 
-/// @returns false on error; true if we successfully generated
-/// 'strTargetFilename'.
-template <typename T, typename U>
-static bool ApplyMapping(const uint64_t iElems,
-                         const size_t iCurrentInCoreSizeBytes,
-                         raw_data_src<T>& ds,
-                         const std::string& strTargetFilename,
-                         std::map<T, size_t>& binAssignments,
-                         Histogram1DDataBlock* Histogram1D,
-                         TuvokProgress<uint64_t> progress) {
-  const size_t iCurrentInCoreElems = iCurrentInCoreSizeBytes / sizeof(U);
-
-  ds.reset();
-
-  LargeRAWFile TargetData(strTargetFilename);
-  TargetData.Create();
-
-  std::vector<U> targetData(iCurrentInCoreElems);
-  std::vector<T> sourceData(iCurrentInCoreElems);
-  uint64_t iPos = 0;
+/// The quantization engine behind Quantize and BinningQuantize.  The input
+/// is streamed in chunks of AbstrConverter::GetIncoreSize() bytes.  Every
+/// chunk is cut into blocks, which the threads work on with accumulators of
+/// their own; those are merged once the whole input has been seen.  Hence
+/// the value range, the histogram and the set of unique values all come
+/// from a single pass over the data, and the mapping is a second one.
+namespace { namespace quantization {
+  // a block, its output and its bins fit into the L2 cache
+  const size_t iBlockElems = 1 << 16;
+
+  inline int Threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+  inline int ThreadID() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
 
-  assert(iElems > 0); // our minmax assert later will fail anyway, if false.
+  /// Values are compared bitwise, after mapping -0 to 0 (std::map treats
+  /// them as one key too) and all NaNs to the same quiet NaN.
+  template<typename T> T Canonical(T v) { return v; }
+  template<> float Canonical(float v) {
+    if(v == 0.0f) { return 0.0f; }
+    return v != v ? std::numeric_limits<float>::quiet_NaN() : v;
+  }
+  template<> double Canonical(double v) {
+    if(v == 0.0) { return 0.0; }
+    return v != v ? std::numeric_limits<double>::quiet_NaN() : v;
+  }
+  /// Ascending order, NaNs last.
+  template<typename T> bool Less(T a, T b) { return a < b; }
+  template<> bool Less(float a, float b) { return a < b || (a == a && b != b); }
+  template<> bool Less(double a, double b) {
+    return a < b || (a == a && b != b);
+  }
 
-  while(iPos < iElems) {
-    size_t n_records = ds.read(
-      (unsigned char*)(&(sourceData.at(0))),
-      std::min(static_cast<size_t>(iElems-iPos), iCurrentInCoreElems)
+  /// A flat, open addressing set of at most MaxValues distinct values,
+  /// for counting the unique values of a data set.  Once more values than
+  /// allowed are inserted, the set is 'full' and ignores everything else.
+  template<typename T> class FlatValueSet {
+  public:
+    enum { SlotBits = 13, Slots = 1 << SlotBits, MaxValues = Slots / 2 };
+
+    explicit FlatValueSet(size_t iMaxValues=MaxValues) :
+      m_iMaxValues(std::min<size_t>(iMaxValues, MaxValues)),
+      m_iSize(0),
+      m_bFull(false),
+      m_vValues(Slots),
+      m_vUsed(Slots, 0)
+    {}
+
+    size_t Size() const { return m_iSize; }
+    bool Full() const { return m_bFull; }
+
+    /// @returns false if the set is full, i.e. v might not be in it.
+    bool Insert(T v) {
+      if(m_bFull) { return false; }
+      v = Canonical(v);
+      size_t s = Slot(v);
+      for(; m_vUsed[s]; s = (s+1) & (Slots-1)) {
+        if(Same(m_vValues[s], v)) { return true; }
+      }
+      if(m_iSize == m_iMaxValues) {
+        m_bFull = true;
+        return false;
+      }
+      m_vValues[s] = v;
+      m_vUsed[s] = 1;
+      ++m_iSize;
+      return true;
+    }
+
+    void Merge(const FlatValueSet& other) {
+      if(other.m_bFull) { m_bFull = true; }
+      for(size_t s=0; s < Slots && !m_bFull; ++s) {
+        if(other.m_vUsed[s]) { Insert(other.m_vValues[s]); }
+      }
+    }
+
+    /// @returns the values in ascending order.
+    std::vector<T> Sorted() const {
+      std::vector<T> v;
+      v.reserve(m_iSize);
+      for(size_t s=0; s < Slots; ++s) {
+        if(m_vUsed[s]) { v.push_back(m_vValues[s]); }
+      }
+      std::sort(v.begin(), v.end(), Less<T>);
+      return v;
+    }
+
+    /// Numbers the values in ascending order, for Rank.
+    void AssignRanks() {
+      const std::vector<T> sorted = Sorted();
+      m_vRanks.assign(Slots, 0);
+      for(size_t r=0; r < sorted.size(); ++r) {
+        m_vRanks[Find(sorted[r])] = uint16_t(r);
+      }
+    }
+    /// @returns the position of v among the sorted values; v must be in the
+    /// set and AssignRanks must have been called.
+    uint16_t Rank(T v) const { return m_vRanks[Find(Canonical(v))]; }
+
+  private:
+    static size_t Slot(T v) {
+      uint64_t bits = 0;
+      std::memcpy(&bits, &v, sizeof(T));
+      // Fibonacci hashing: the top bits of the product are well mixed
+      return size_t((bits * 0x9E3779B97F4A7C15ULL) >> (64 - SlotBits));
+    }
+    static bool Same(T a, T b) { return std::memcmp(&a, &b, sizeof(T)) == 0; }
+    size_t Find(T v) const {
+      size_t s = Slot(v);
+      while(m_vUsed[s] && !Same(m_vValues[s], v)) { s = (s+1) & (Slots-1); }
+      return s;
+    }
+
+    size_t m_iMaxValues;
+    size_t m_iSize;
+    bool m_bFull;
+    std::vector<T> m_vValues;
+    std::vector<uint8_t> m_vUsed;
+    std::vector<uint16_t> m_vRanks;
+  };
+
+  /// What one thread (or, merged, all of them) saw of the data.
+  template<typename T> struct Accumulator {
+    /// @param iHistSize values below that are counted in vHist
+    /// @param iMaxValues unique values to count at most; 0 to not count
+    Accumulator(size_t iHistSize, size_t iMaxValues) :
+      tMin(std::numeric_limits<T>::max()),
+      tMax(std::numeric_limits<T>::lowest()),
+      vHist(iHistSize, 0),
+      values(iMaxValues),
+      bValues(iMaxValues > 0)
+    {}
+
+    void Add(const T* pData, size_t n) {
+      T mn = tMin, mx = tMax;
+      for(size_t i=0; i < n; ++i) {
+        mn = std::min(mn, pData[i]);
+        mx = std::max(mx, pData[i]);
+      }
+      tMin = mn; tMax = mx;
+
+      if(!vHist.empty()) {
+        for(size_t i=0; i < n; ++i) {
+          if(uint64_t(pData[i]) < vHist.size()) { ++vHist[size_t(pData[i])]; }
+        }
+      }
+      // runs of the same value are common (e.g. the air around a scan),
+      // so only changes go to the set.
+      if(bValues && n > 0 && values.Insert(pData[0])) {
+        T last = pData[0];
+        for(size_t i=1; i < n; ++i) {
+          if(pData[i] != last) {
+            last = pData[i];
+            if(!values.Insert(last)) { break; }
+          }
+        }
+      }
+    }
+
+    void Merge(const Accumulator& other) {
+      tMin = std::min(tMin, other.tMin);
+      tMax = std::max(tMax, other.tMax);
+      for(size_t i=0; i < vHist.size(); ++i) { vHist[i] += other.vHist[i]; }
+      if(bValues) { values.Merge(other.values); }
+    }
+
+    T tMin, tMax;
+    std::vector<uint64_t> vHist;
+    FlatValueSet<T> values;
+    bool bValues;
+  };
+
+  /// The one pass over the first iElems values of 'InputData' which
+  /// computes everything 'stats' asks for.
+  template<typename T>
+  void Analyze(LargeRAWFile& InputData, uint64_t iElems,
+               Accumulator<T>& stats)
+  {
+    const size_t iInCoreElems =
+      std::max<size_t>(AbstrConverter::GetIncoreSize() / sizeof(T), 1);
+    std::vector<T> vData(size_t(std::min<uint64_t>(iElems, iInCoreElems)));
+    std::vector<Accumulator<T>> vThreads(Threads(), stats);
+    TuvokProgress<uint64_t> progress(iElems);
+    uint64_t iPos = 0;
+    size_t iRead = 0;
+
+    InputData.SeekStart();
+#pragma omp parallel
+    {
+      Accumulator<T>& local = vThreads[ThreadID()];
+      for(;;) {
+#pragma omp single
+        {
+          iRead = 0;
+          if(iPos < iElems) {
+            iRead = InputData.ReadRAW(
+              reinterpret_cast<unsigned char*>(&vData[0]),
+              std::min<uint64_t>(iElems-iPos, vData.size()) * sizeof(T)
+            ) / sizeof(T);
+            iPos += iRead;
+            if(iRead > 0) { progress.notify("Computing value range", iPos); }
+          }
+        }
+        if(iRead == 0) { break; }
+
+        const int iBlocks = int((iRead + iBlockElems - 1) / iBlockElems);
+#pragma omp for schedule(dynamic)
+        for(int b=0; b < iBlocks; ++b) {
+          const size_t iFirst = size_t(b) * iBlockElems;
+          local.Add(&vData[iFirst], std::min(iBlockElems, iRead - iFirst));
+        }
+      }
+    }
+    for(size_t t=0; t < vThreads.size(); ++t) { stats.Merge(vThreads[t]); }
+
+    if(iPos < iElems) {
+      WARNING("Short file during analysis (%llu of %llu)", iPos, iElems);
+    }
+    MESSAGE("min/max is: [%g:%g]", static_cast<double>(stats.tMin),
+            static_cast<double>(stats.tMax));
+  }
+
+  /// Analyze for data which come from a slice source: the slices are
+  /// produced in parallel, each thread analyzes the ones it produced.
+  template<typename T>
+  void AnalyzeSlices(SliceSource& source, uint64_t iSliceElems,
+                     uint64_t iSlices, Accumulator<T>& stats)
+  {
+    std::vector<Accumulator<T>> vThreads(Threads(), stats);
+    TuvokProgress<uint64_t> progress(iSlices);
+    uint64_t iDone = 0;
+    std::exception_ptr pError;
+
+#pragma omp parallel
+    {
+      Accumulator<T>& local = vThreads[ThreadID()];
+      std::vector<T> vSlice(static_cast<size_t>(iSliceElems));
+#pragma omp for schedule(dynamic)
+      for(int z=0; z < int(iSlices); ++z) {
+        try {
+          source.GetSlice(uint64_t(z),
+                          reinterpret_cast<uint8_t*>(&vSlice[0]));
+          for(size_t i=0; i < vSlice.size(); i += iBlockElems) {
+            local.Add(&vSlice[i], std::min(iBlockElems, vSlice.size() - i));
+          }
+        } catch(...) {
+#pragma omp critical (QuantizeSlicesError)
+          {
+            if(!pError) { pError = std::current_exception(); }
+          }
+        }
+#pragma omp critical (QuantizeSlicesProgress)
+        {
+          progress.notify("Computing value range", ++iDone);
+        }
+      }
+    }
+    if(pError) { std::rethrow_exception(pError); }
+    for(size_t t=0; t < vThreads.size(); ++t) { stats.Merge(vThreads[t]); }
+
+    MESSAGE("min/max is: [%g:%g]", static_cast<double>(stats.tMin),
+            static_cast<double>(stats.tMax));
+  }
+
+  inline void QuantizeRow(const float* in, float mn, double scale,
+                          double maxOut, uint16_t* out, size_t n) {
+    VolumeTools::QuantizeRow(in, mn, scale, maxOut, out, n);
+  }
+  inline void QuantizeRow(const double* in, double mn, double scale,
+                          double maxOut, uint16_t* out, size_t n) {
+    VolumeTools::QuantizeRow(in, mn, scale, maxOut, out, n);
+  }
+  inline void QuantizeRow(const int32_t* in, int32_t mn, double scale,
+                          double maxOut, uint16_t* out, size_t n) {
+    VolumeTools::QuantizeRow(reinterpret_cast<const uint32_t*>(in),
+                             uint32_t(mn), scale, maxOut, out, n);
+  }
+  inline void QuantizeRow(const uint32_t* in, uint32_t mn, double scale,
+                          double maxOut, uint16_t* out, size_t n) {
+    VolumeTools::QuantizeRow(in, mn, scale, maxOut, out, n);
+  }
+  // 64 bit integers, and the short types for building lookup tables.  The
+  // difference to the minimum always fits into 64 unsigned bits.
+  template<typename T>
+  void QuantizeRow(const T* in, T mn, double scale, double maxOut,
+                   uint16_t* out, size_t n) {
+    for(size_t i=0; i < n; ++i) {
+      out[i] = uint16_t(std::min(maxOut,
+                                 double(uint64_t(in[i]) - uint64_t(mn)) *
+                                   scale));
+    }
+  }
+
+  /// Integer types of 16 bit or less are mapped with lookup tables over
+  /// [min, max]; everything else is computed.
+  template<typename T> struct UsesTable {
+    static const bool value = std::numeric_limits<T>::is_integer &&
+                              sizeof(T) <= 2;
+  };
+
+  /// Value v goes to uint16_t(min(maxOut, (v-min)*scale)) in the output,
+  /// and to the bin with the same formula for the histogram.
+  template<typename T> class LinearMapping {
+  public:
+    LinearMapping(T mn, T mx, double scale, double maxOut,
+                  double histScale, double maxBin) :
+      m_tMin(mn), m_fScale(scale), m_fMaxOut(maxOut),
+      m_fHistScale(histScale), m_fMaxBin(maxBin)
+    {
+      if(UsesTable<T>::value) {
+        std::vector<T> values(size_t(uint64_t(mx) - uint64_t(mn)) + 1);
+        for(size_t i=0; i < values.size(); ++i) { values[i] = T(mn + T(i)); }
+        m_vOut.resize(values.size());
+        m_vBins.resize(values.size());
+        quantization::QuantizeRow(&values[0], mn, scale, maxOut, &m_vOut[0],
+                              values.size());
+        quantization::QuantizeRow(&values[0], mn, histScale, maxBin, &m_vBins[0],
+                              values.size());
+      }
+    }
+
+    /// @returns the bins.
+    const uint16_t* Map(const T* in, uint16_t* out, uint16_t* bins,
+                        size_t n) const {
+      if(!m_vOut.empty()) {
+        for(size_t i=0; i < n; ++i) {
+          const size_t v = size_t(uint64_t(in[i]) - uint64_t(m_tMin));
+          out[i] = m_vOut[v];
+          bins[i] = m_vBins[v];
+        }
+      } else {
+        quantization::QuantizeRow(in, m_tMin, m_fScale, m_fMaxOut, out, n);
+        quantization::QuantizeRow(in, m_tMin, m_fHistScale, m_fMaxBin, bins, n);
+      }
+      return bins;
+    }
+
+  private:
+    T m_tMin;
+    double m_fScale, m_fMaxOut, m_fHistScale, m_fMaxBin;
+    std::vector<uint16_t> m_vOut, m_vBins;
+  };
+
+  /// Value v goes to its rank among the unique values, for output and
+  /// histogram alike.
+  template<typename T> class RankMapping {
+  public:
+    RankMapping(T mn, T mx, FlatValueSet<T>& values) :
+      m_tMin(mn), m_pValues(&values)
+    {
+      values.AssignRanks();
+      if(UsesTable<T>::value) {
+        m_vRanks.resize(size_t(uint64_t(mx) - uint64_t(mn)) + 1, 0);
+        const std::vector<T> sorted = values.Sorted();
+        for(size_t r=0; r < sorted.size(); ++r) {
+          m_vRanks[size_t(uint64_t(sorted[r]) - uint64_t(mn))] = uint16_t(r);
+        }
+      }
+    }
+
+    const uint16_t* Map(const T* in, uint16_t* out, uint16_t*,
+                        size_t n) const {
+      if(!m_vRanks.empty()) {
+        for(size_t i=0; i < n; ++i) {
+          out[i] = m_vRanks[size_t(uint64_t(in[i]) - uint64_t(m_tMin))];
+        }
+      } else if(n > 0) {
+        T last = in[0];
+        uint16_t rank = m_pValues->Rank(last);
+        for(size_t i=0; i < n; ++i) {
+          if(in[i] != last) {
+            last = in[i];
+            rank = m_pValues->Rank(last);
+          }
+          out[i] = rank;
+        }
+      }
+      return out;
+    }
+
+  private:
+    T m_tMin;
+    const FlatValueSet<T>* m_pValues;
+    std::vector<uint16_t> m_vRanks;
+  };
+
+  /// The mapping pass: writes the mapped values of the first iElems values
+  /// of 'InputData' to 'strTargetFilename' (unless !bWrite) and bins them
+  /// into vHist, which must be large enough for every bin.
+  /// @returns false on error.
+  template<typename T, typename U, class Mapping>
+  bool Map(LargeRAWFile& InputData, uint64_t iElems, const Mapping& mapping,
+           bool bWrite, const std::string& strTargetFilename,
+           std::vector<uint64_t>& vHist, const std::string& strMessage)
+  {
+    static_assert(sizeof(U) <= 2, "mappings produce 16 bit values");
+    LargeRAWFile OutputData(strTargetFilename);
+    if(bWrite) {
+      OutputData.Create(iElems*sizeof(U));
+      if(!OutputData.IsOpen()) {
+        T_ERROR("Could not create output file '%s'",
+                strTargetFilename.c_str());
+        return false;
+      }
+    }
+
+    const size_t iInCoreElems =
+      std::max<size_t>(AbstrConverter::GetIncoreSize() / sizeof(T), 1);
+    std::vector<T> vData(size_t(std::min<uint64_t>(iElems, iInCoreElems)));
+    std::vector<U> vOut(vData.size());
+    std::vector<std::vector<uint64_t>> vThreadHist(
+      Threads(), std::vector<uint64_t>(vHist.size(), 0)
     );
-    if(n_records == 0) {
-      WARNING("Short file during mapping.");
-      break; // bail out if the read gave us nothing.
+    TuvokProgress<uint64_t> progress(iElems);
+    uint64_t iPos = 0;
+    size_t iRead = 0;
+    bool bWriteError = false;
+
+    InputData.SeekStart();
+#pragma omp parallel
+    {
+      std::vector<uint64_t>& hist = vThreadHist[ThreadID()];
+      std::vector<uint16_t> out(sizeof(U) == 1 ? iBlockElems : 0);
+      std::vector<uint16_t> bins(iBlockElems);
+      for(;;) {
+#pragma omp single
+        {
+          if(bWrite && iRead > 0 &&
+             OutputData.WriteRAW(reinterpret_cast<unsigned char*>(&vOut[0]),
+                                 iRead*sizeof(U)) != iRead*sizeof(U)) {
+            bWriteError = true;
+          }
+          iRead = 0;
+          if(iPos < iElems && !bWriteError) {
+            iRead = InputData.ReadRAW(
+              reinterpret_cast<unsigned char*>(&vData[0]),
+              std::min<uint64_t>(iElems-iPos, vData.size()) * sizeof(T)
+            ) / sizeof(T);
+            iPos += iRead;
+            if(iRead > 0) { progress.notify(strMessage, iPos); }
+          }
+        }
+        if(iRead == 0) { break; }
+
+        const int iBlocks = int((iRead + iBlockElems - 1) / iBlockElems);
+#pragma omp for schedule(dynamic)
+        for(int b=0; b < iBlocks; ++b) {
+          const size_t iFirst = size_t(b) * iBlockElems;
+          const size_t n = std::min(iBlockElems, iRead - iFirst);
+          // 16 bit output goes straight to the output buffer
+          uint16_t* pOut = sizeof(U) == 1
+            ? &out[0] : reinterpret_cast<uint16_t*>(&vOut[iFirst]);
+          const uint16_t* pBins = mapping.Map(&vData[iFirst], pOut,
+                                              &bins[0], n);
+          if(sizeof(U) == 1) {
+            for(size_t i=0; i < n; ++i) { vOut[iFirst+i] = U(pOut[i]); }
+          }
+          for(size_t i=0; i < n; ++i) { ++hist[pBins[i]]; }
+        }
+      }
+    }
+    for(size_t t=0; t < vThreadHist.size(); ++t) {
+      for(size_t i=0; i < vHist.size(); ++i) { vHist[i] += vThreadHist[t][i]; }
     }
-    sourceData.resize(n_records);
 
-    iPos += uint64_t(n_records);
-    assert(iPos <= iElems);
-    progress.notify("Mapping data values to bins", iPos);
+    if(bWriteError) {
+      T_ERROR("Could not write to '%s'", strTargetFilename.c_str());
+      return false;
+    }
+    if(iPos < iElems) {
+      WARNING("Short file during mapping (%llu of %llu)", iPos, iElems);
+    }
+    if(bWrite) { OutputData.Close(); }
+    return true;
+  }
+
+  /// The histogram size of a quantization to U.
+  template<typename U> size_t HistSize() { return sizeof(U) == 1 ? 256 : 4096; }
+  /// Unsigned integer data which fit into the histogram of U do not need
+  /// quantization; this is the histogram size to watch for them, or 0.
+  template<typename T, typename U> size_t EarlyOutHistSize() {
+    return !ctti<T>::is_signed && std::numeric_limits<T>::is_integer &&
+           sizeof(T) <= sizeof(U) ? HistSize<U>() : 0;
+  }
 
-    // Run over the in-core data and apply mapping
-    for(size_t i=0; i < n_records; ++i) {
-      targetData[i] = U(binAssignments[sourceData[i]]);
+  /// Decides on the linear quantization of data with the statistics
+  /// 'stats', mirrored by Linear and LinearSlices.
+  /// @returns the mapping to apply, empty if the data are used as they are.
+  template <typename T, typename U>
+  std::shared_ptr<LinearMapping<T>>
+  PlanLinear(uint64_t iElems, const Accumulator<T>& stats,
+             size_t* iBinCount, bool& bDataWillbeChanged,
+             std::string& strMessage)
+  {
+    const size_t hist_size = HistSize<U>();
+    const std::pair<T,T> minmax(stats.tMin, stats.tMax);
+    assert(iElems == 0 || minmax.second >= minmax.first);
+
+    // Unsigned N bit data does not need to be biased/quantized.
+    if(EarlyOutHistSize<T,U>() != 0 &&
+       uint64_t(minmax.second) < uint64_t(hist_size)) {
+      MESSAGE("Returning early; data does not need processing.");
+
+      // if we have very few values, let the calling function know
+      // how much exactly, so we can reduce the bit depth of
+      // the data
+      if (iBinCount) {
+        for (size_t bin = 0;bin<stats.vHist.size();++bin)
+          if (stats.vHist[bin] != 0) (*iBinCount)++;
+      }
+      return std::shared_ptr<LinearMapping<T>>();
     }
+    if(iElems == 0) { return std::shared_ptr<LinearMapping<T>>(); }
 
-    TargetData.WriteRAW((unsigned char*)&targetData[0], sizeof(U)*n_records);
+    if(iBinCount != NULL) {
+      *iBinCount = bins_needed<T>(minmax);
+      MESSAGE("We need %u bins", static_cast<unsigned>(*iBinCount));
+    }
+
+    const size_t max_output_val = sizeof(U) == 1 ? 255 : 65535;
+    double fQuantFact = QuantizationFactor(max_output_val, minmax.first,
+                                           minmax.second);
+    double fQuantFactHist = QuantizationFactor(hist_size-1, minmax.first,
+                                               minmax.second);
+    // constant FP data: 0 * inf would be NaN, put everything at 0 instead
+    if(minmax.first == minmax.second) {
+      fQuantFact = std::min(fQuantFact, 1.0);
+      fQuantFactHist = std::min(fQuantFactHist, 1.0);
+    }
+
+    bDataWillbeChanged = fQuantFact != 1.0 || minmax.first != 0 ||
+                         sizeof(T) > 2 || sizeof(T) > sizeof(U);
+
+    std::ostringstream qmsg;
+    if (fQuantFact == 1.0 && minmax.first == 0)
+      qmsg << "Computing quantized histogram with " << hist_size
+           << " bins (input range: ["
+           << minmax.first << "--" << minmax.second << "])";
+    else if (fQuantFact == 1.0)
+      qmsg << "Quantizing to " << (minmax.second-minmax.first)+1
+           << " integer values (input range: ["
+           << minmax.first << "--" << minmax.second << "])";
+    else
+      qmsg << "Quantizing to " << max_output_val
+           << " integer values (input range: ["
+           << minmax.first << "--" << minmax.second << "])";
+    strMessage = qmsg.str();
+
+    return std::make_shared<LinearMapping<T>>(
+      minmax.first, minmax.second, fQuantFact, double(max_output_val),
+      fQuantFactHist, double(hist_size-1)
+    );
   }
-  assert(iPos == iElems);
 
-  TargetData.Close();
+  /// Quantize, given what Analyze found in the data.
+  template <typename T, typename U>
+  bool Linear(LargeRAWFile& InputData, uint64_t iElems,
+              const Accumulator<T>& stats,
+              const std::string& strTargetFilename,
+              Histogram1DDataBlock* Histogram1D, size_t* iBinCount)
+  {
+    bool bDataWillbeChanged = false;
+    std::string strMessage;
+    const std::shared_ptr<LinearMapping<T>> mapping =
+      PlanLinear<T,U>(iElems, stats, iBinCount, bDataWillbeChanged,
+                      strMessage);
+    if(!mapping) { return false; }
+
+    std::vector<uint64_t> aHist(HistSize<U>(), 0);
+    if(!Map<T,U>(InputData, iElems, *mapping, bDataWillbeChanged,
+                 strTargetFilename, aHist, strMessage)) {
+      return false;
+    }
+    if(Histogram1D) { Histogram1D->SetHistogram(aHist); }
+    return bDataWillbeChanged;
+  }
 
-  LargeRAWFile MappedData(strTargetFilename);
-  MappedData.Open(false);
-  if(!MappedData.IsOpen()) {
-    T_ERROR("Could not open intermediate file '%s'",
-            strTargetFilename.c_str());
-    return false;
+  /// Replaces every value by its rank among the unique values.
+  template <typename T, typename U>
+  bool Ranks(LargeRAWFile& InputData, uint64_t iElems, Accumulator<T>& stats,
+             const std::string& strTargetFilename,
+             Histogram1DDataBlock* Histogram1D)
+  {
+    const size_t iBins = stats.values.Size();
+    // a histogram for 8 bit data always has 256 bins
+    std::vector<uint64_t> aHist(sizeof(U) == 1 ? 256 : iBins, 0);
+    const RankMapping<T> mapping(stats.tMin, stats.tMax, stats.values);
+    if(!Map<T,U>(InputData, iElems, mapping, true, strTargetFilename, aHist,
+                 "Mapping data values to bins")) {
+      return false;
+    }
+    if(Histogram1D) { Histogram1D->SetHistogram(aHist); }
+    return true;
   }
 
-  // now compute histogram
-  size_t hist_size = binAssignments.size();
-  if(sizeof(U) == 1) { hist_size = 256; }
-  static_assert(sizeof(U) <= 2, "we assume histo sizes");
+  /// A slice source whose slices are mapped to their quantized values on
+  /// the fly, i.e. while the octree is built from them.
+  class QuantizedSlices : public SliceSource {
+  public:
+    /// @returns the histogram of the values produced so far; once every
+    /// slice was produced, that of the quantized data.
+    virtual std::vector<uint64_t> GetHistogram() const = 0;
+  };
+
+  /// Applies a mapping (see LinearMapping, RankMapping) to the slices of a
+  /// source of T, producing U.
+  template<typename T, typename U, class Mapping>
+  class MappedSlices : public QuantizedSlices {
+  public:
+    /// @param pStats the statistics the mapping was made from, it may
+    ///               refer to them
+    MappedSlices(SliceSource& source, uint64_t iSliceElems,
+                 std::shared_ptr<Accumulator<T>> pStats,
+                 const Mapping& mapping, size_t iHistSize) :
+      m_Source(source),
+      m_iSliceElems(iSliceElems),
+      m_pStats(pStats),
+      m_Mapping(mapping),
+      m_vHist(iHistSize, 0)
+    {
+      static_assert(sizeof(U) <= 2, "mappings produce 16 bit values");
+    }
 
-  std::vector<uint64_t> aHist(hist_size, 0);
-  std::pair<T,T> minmax;
+    void GetSlice(uint64_t iSlice, uint8_t* pData) {
+      std::vector<T> vSlice(static_cast<size_t>(m_iSliceElems));
+      m_Source.GetSlice(iSlice, reinterpret_cast<uint8_t*>(&vSlice[0]));
+
+      U* pOut = reinterpret_cast<U*>(pData);
+      std::vector<uint64_t> hist(m_vHist.size(), 0);
+      std::vector<uint16_t> out(iBlockElems), bins(iBlockElems);
+      for(size_t iFirst=0; iFirst < vSlice.size(); iFirst += iBlockElems) {
+        const size_t n = std::min(iBlockElems, vSlice.size() - iFirst);
+        const uint16_t* pBins = m_Mapping.Map(&vSlice[iFirst], &out[0],
+                                              &bins[0], n);
+        for(size_t i=0; i < n; ++i) {
+          pOut[iFirst+i] = U(out[i]);
+          ++hist[pBins[i]];
+        }
+      }
 
-  const size_t sz = (sizeof(U) == 2 ? 4096 : 256);
-  minmax = io_minmax(raw_data_src<U>(MappedData),
-                     UnsignedHistogram<U, sz>(aHist),
-                     TuvokProgress<uint64_t>(iElems), iElems,
-                     iCurrentInCoreSizeBytes);
-  assert(minmax.second >= minmax.first);
+      SCOPEDLOCK(m_Guard);
+      for(size_t i=0; i < hist.size(); ++i) { m_vHist[i] += hist[i]; }
+    }
 
-  MappedData.Close();
+    std::vector<uint64_t> GetHistogram() const {
+      SCOPEDLOCK(m_Guard);
+      return m_vHist;
+    }
 
-  if(Histogram1D) { Histogram1D->SetHistogram(aHist); }
+  private:
+    SliceSource& m_Source;
+    uint64_t m_iSliceElems;
+    std::shared_ptr<Accumulator<T>> m_pStats;
+    Mapping m_Mapping;
+    std::vector<uint64_t> m_vHist;
+    mutable tuvok::CriticalSection m_Guard;
+  };
+
+  /// Moves signed 8 bit data to unsigned by adding 128, leaves unsigned
+  /// data as they are; the bins are the values.
+  template<typename T> class OffsetMapping {
+  public:
+    const uint16_t* Map(const T* in, uint16_t* out, uint16_t*,
+                        size_t n) const {
+      for(size_t i=0; i < n; ++i) {
+        out[i] = uint16_t(int(in[i]) - int(std::numeric_limits<T>::min()));
+      }
+      return out;
+    }
+  };
+
+  /// Linear for slices: decides like Linear, but instead of writing the
+  /// mapped data it returns a source which maps the slices as they are
+  /// requested.
+  /// @returns an empty pointer if the data do not need processing.
+  template <typename T, typename U>
+  std::shared_ptr<QuantizedSlices>
+  LinearSlices(SliceSource& source, uint64_t iSliceElems, uint64_t iSlices,
+               std::shared_ptr<Accumulator<T>> pStats, size_t* iBinCount)
+  {
+    bool bDataWillbeChanged = false;
+    std::string strMessage;
+    const std::shared_ptr<LinearMapping<T>> mapping =
+      PlanLinear<T,U>(iSliceElems*iSlices, *pStats, iBinCount,
+                      bDataWillbeChanged, strMessage);
+    if(!mapping) { return std::shared_ptr<QuantizedSlices>(); }
+    // unchanged data are mapped too, which only computes the histogram
+    MESSAGE("%s", strMessage.c_str());
+    return std::make_shared<MappedSlices<T,U,LinearMapping<T>>>(
+      source, iSliceElems, pStats, *mapping, HistSize<U>()
+    );
+  }
 
-  return true;
-}
+  /// Ranks for slices.
+  template <typename T, typename U>
+  std::shared_ptr<QuantizedSlices>
+  RanksSlices(SliceSource& source, uint64_t iSliceElems,
+              std::shared_ptr<Accumulator<T>> pStats)
+  {
+    MESSAGE("Mapping data values to bins");
+    // a histogram for 8 bit data always has 256 bins
+    const size_t iBins = sizeof(U) == 1 ? 256 : pStats->values.Size();
+    const RankMapping<T> mapping(pStats->tMin, pStats->tMax, pStats->values);
+    return std::make_shared<MappedSlices<T,U,RankMapping<T>>>(
+      source, iSliceElems, pStats, mapping, iBins
+    );
+  }
+} }
 
+namespace {
 /// Quantizes an (already-open) file to 'strTargetFilename'.  If 'InputData'
 /// doesn't need any quantization, this might be a no-op.
 /// @returns true if we generated 'strTargetFilename', false if the caller
@@ -438,17 +1091,12 @@ static bool Quantize(LargeRAWFile& InputData,
   }
   // this code won't behave correctly when quantizing to very wide data
   // types.  Make sure we only deal with 8 and 16 bit outputs.
-  size_t hist_size = 4096;
-  if(sizeof(U) == 1) { hist_size = 256; }
   static_assert(sizeof(U) <= 2, "we assume histogram sizes");
 
-  const size_t iCurrentInCoreSizeBytes = AbstrConverter::GetIncoreSize();
-  const size_t iCurrentInCoreElems = iCurrentInCoreSizeBytes / sizeof(T);
   if(!InputData.IsOpen()) {
     T_ERROR("Open the file before you call this.");
     return false;
   }
-  InputData.SeekStart();
 
   assert(Input.width == sizeof(T));
   const uint64_t iSize = Input.elements * Input.components * Input.timesteps *
@@ -456,125 +1104,10 @@ static bool Quantize(LargeRAWFile& InputData,
   const uint64_t iElems = Input.elements * Input.components * Input.timesteps;
   MESSAGE("%s should have %llu bytes.", InputData.GetFilename().c_str(), iSize);
 
-  // figure out min/max
-  std::vector<uint64_t> aHist(hist_size, 0);
-  std::pair<T,T> minmax;
-  const size_t sz = (sizeof(U) == 2 ? 4096 : 256);
-  minmax = io_minmax(raw_data_src<T>(InputData),
-                     UnsignedHistogram<T, sz>(aHist),
-                     TuvokProgress<uint64_t>(iElems), iElems,
-                     iCurrentInCoreSizeBytes);
-  assert(minmax.second >= minmax.first);
-
-  // Unsigned N bit data does not need to be biased/quantized.
-  if(!ctti<T>::is_signed && minmax.second < static_cast<T>(hist_size) &&
-     sizeof(T) <= ((hist_size == 256) ? 1 : 2)) {
-    MESSAGE("Returning early; data does not need processing.");
-
-    // if we have very few values, let the calling function know
-    // how much exactly, so we can reduce the bit depth of
-    // the data
-    if (iBinCount) {
-      for (size_t bin = 0;bin<aHist.size();++bin)
-        if (aHist[bin] != 0) (*iBinCount)++;
-    }
-    return false;
-  }
-  // Reset the histogram.  We'll be quantizing the data.
-  std::fill(aHist.begin(), aHist.end(), 0);
-
-  if(iBinCount != NULL) {
-    *iBinCount = bins_needed<T>(minmax);
-    MESSAGE("We need %u bins", static_cast<unsigned>(*iBinCount));
-  }
-
-  size_t max_output_val = (1 << (sizeof(U)*8)) - 1;
-  if(hist_size == 256) { max_output_val = 255; }
-  double fQuantFact = QuantizationFactor(max_output_val, minmax.first,
-                                         minmax.second);
-  double fQuantFactHist = QuantizationFactor(hist_size-1, minmax.first,
-                                             minmax.second);
-
-  bool bDataWillbeChanged = fQuantFact != 1.0 || minmax.first != 0 ||
-                            sizeof(T) > 2 || sizeof(T) > sizeof(U);
-
-  LargeRAWFile OutputData(strTargetFilename);
-  // if the only reason for quantization is the histogram computation
-  // we don't need an output file
-  if (bDataWillbeChanged) {
-    OutputData.Create(iSize*sizeof(U));
-    if(!OutputData.IsOpen()) {
-      InputData.Close();
-      T_ERROR("Could not create output file '%s'", strTargetFilename.c_str());
-      return false;
-    }
-  }
-
-  T* pInData = new T[iCurrentInCoreElems];
-  U* pOutData = new U[iCurrentInCoreElems];
-
-  InputData.SeekStart();
-  uint64_t iPos = 0;
-  uint64_t iLastDisplayedPercent = 0;
-
-  while(iPos < iSize) {
-    size_t iRead = InputData.ReadRAW((unsigned char*)pInData,
-                                     std::min((iSize - iPos)*sizeof(T),
-                                     uint64_t(iCurrentInCoreSizeBytes)))/sizeof(T);
-    if(iRead == 0) { break; } // bail if the read gave us nothing
-
-    // calculate hist + quantize to output file.
-    for(size_t i=0; i < iRead; ++i) {
-      U iNewVal = std::min<U>(static_cast<U>(max_output_val),
-        static_cast<U>((pInData[i]-minmax.first) * fQuantFact)
-      );
-      U iHistIndex = std::min<U>(static_cast<U>(hist_size-1),
-                                 static_cast<U>((pInData[i]-minmax.first) *
-                                   fQuantFactHist)
-      );
-      pOutData[i] = iNewVal;
-      aHist[iHistIndex]++;
-    }
-    iPos += static_cast<uint64_t>(iRead);
-
-    if((100*iPos)/iSize > iLastDisplayedPercent) {
-      std::ostringstream qmsg;
-
-      if (fQuantFact == 1.0)
-        if (minmax.first == 0)
-          qmsg << "Computing quantized histogram with " << hist_size
-          << " bins (input range: ["
-          << minmax.first << "--" << minmax.second << "])\n"
-          << (100*iPos)/iSize << "% complete";
-        else
-          qmsg << "Quantizing to " << (minmax.second-minmax.first)+1
-               << " integer values (input range: ["
-               << minmax.first << "--" << minmax.second << ")\n"
-               << (100*iPos)/iSize << "% complete";
-      else
-        qmsg << "Quantizing to " << max_output_val
-             << " integer values (input range: ["
-             << minmax.first << "--" << minmax.second << ")\n"
-             << (100*iPos)/iSize << "% complete";
-      MESSAGE("%s", qmsg.str().c_str());
-      iLastDisplayedPercent = (100*iPos)/iSize;
-    }
-
-    if (bDataWillbeChanged)
-      OutputData.WriteRAW(reinterpret_cast<unsigned char*>(pOutData),
-                          sizeof(U)*iRead);
-  }
-
-  delete[] pInData;
-  delete[] pOutData;
-  if(Histogram1D) { Histogram1D->SetHistogram(aHist); }
-
-  if (bDataWillbeChanged) {
-    OutputData.Close();
-    return true;
-  } else {
-    return false;
-  }
+  quantization::Accumulator<T> stats(quantization::EarlyOutHistSize<T,U>(), 0);
+  quantization::Analyze(InputData, iElems, stats);
+  return quantization::Linear<T,U>(InputData, iElems, stats, strTargetFilename,
+                               Histogram1D, iBinCount);
 }
 
 /// @returns true if we generated 'strTargetFilename', false if the caller
@@ -589,99 +1122,94 @@ static bool BinningQuantize(LargeRAWFile& InputData,
   MESSAGE("Attempting to recover integer values by binning the data.");
 
   iComponentSize = sizeof(U)*8;
-  const size_t iCurrentInCoreSizeBytes = AbstrConverter::GetIncoreSize();
-  const size_t iCurrentInCoreElems = iCurrentInCoreSizeBytes / sizeof(T);
   if(!InputData.IsOpen()) {
     T_ERROR("'%s' is not open.", InputData.GetFilename().c_str());
     return false;
   }
-  InputData.SeekStart();
-
-  MESSAGE("Counting number of unique values in the data");
 
-  raw_data_src<T> ds(InputData);
-  std::vector<T> data(iCurrentInCoreElems);
-  TuvokProgress<uint64_t> progress(iElems);
-  uint64_t iPos = 0;
-  bool bBinningPossible = true;
+  // We max out at 4k bins for Tuvok, regardless of data size.
+  const size_t max_bins = std::min<size_t>(4096, size_t(1) << (sizeof(U)*8));
+  quantization::Accumulator<T> stats(quantization::EarlyOutHistSize<T,U>(),
+                                 max_bins);
+  quantization::Analyze(InputData, iElems, stats);
+  MESSAGE("%lu bins needed...",
+          static_cast<unsigned long>(stats.values.Size()));
+
+  // too many values, need to actually quantize the data; what we know
+  // about it already is all that takes.
+  if (stats.values.Full()) {
+    return quantization::Linear<T,U>(InputData, iElems, stats, strTargetFilename,
+                                 Histogram1D, NULL);
+  }
+  if (iElems == 0) { return false; }
 
-  std::map<T, uint64_t> bins;
+  // apply this mapping
+  MESSAGE("Binning possible, applying mapping");
 
-  while(bBinningPossible && iPos < iElems) {
-    size_t n_records = ds.read(
-      (unsigned char*)(&(data.at(0))),
-      std::min(static_cast<size_t>(iElems-iPos), iCurrentInCoreElems)
-    );
-    if(n_records == 0) {
-      WARNING("Short file during counting.");
-      break; // bail out if the read gave us nothing.
-    }
-    data.resize(n_records);
+  if (stats.values.Size() < 256) {
+    iComponentSize = 8; // now we are only using 8 bits
+    return quantization::Ranks<T,uint8_t>(InputData, iElems, stats,
+                                      strTargetFilename, Histogram1D);
+  } else {
+    return quantization::Ranks<T,U>(InputData, iElems, stats, strTargetFilename,
+                                Histogram1D);
+  }
+}
 
-    iPos += uint64_t(n_records);
-    assert(iPos <= iElems);
-    progress.notify("Counting number of unique values in the data", iPos);
+/// Quantize for a volume given as slices of iSliceElems values each. The
+/// source is read once to analyze the data; the quantization itself
+/// happens when the returned source is read.
+/// @returns an empty pointer if the caller can use 'source' as-is.
+template <typename T, typename U>
+static std::shared_ptr<quantization::QuantizedSlices>
+QuantizeSlices(SliceSource& source, uint64_t iSliceElems, uint64_t iSlices,
+               size_t* iBinCount=0)
+{
+  if (iBinCount) { *iBinCount = 0; }
+  static_assert(sizeof(U) <= 2, "we assume histogram sizes");
 
-    // Run over the in core data and sort it into bins
-    for(size_t i=0; i < n_records; ++i) {
-        bins[data[i]]++;
+  std::shared_ptr<quantization::Accumulator<T>> pStats =
+    std::make_shared<quantization::Accumulator<T>>(
+      quantization::EarlyOutHistSize<T,U>(), 0
+    );
+  quantization::AnalyzeSlices(source, iSliceElems, iSlices, *pStats);
+  return quantization::LinearSlices<T,U>(source, iSliceElems, iSlices,
+                                         pStats, iBinCount);
+}
 
-        // We max out at 4k bins for Tuvok, regardless of data size.
-        const size_t max_bins = 4096;
-        if (bins.size() >
-            std::min(max_bins, static_cast<size_t>(1 << (sizeof(U) * 8))))
-        {
-          bBinningPossible = false;
-          break;
-        }
-    }
-    MESSAGE("%lu bins needed...", static_cast<unsigned long>(bins.size()));
-    MESSAGE("minmax so far: %g,%g",
-            static_cast<double>(std::min_element(bins.begin(), bins.end())->first),
-            static_cast<double>(std::max_element(bins.begin(), bins.end())->first));
-  }
+/// BinningQuantize for a volume given as slices, see QuantizeSlices.
+template <typename T, typename U>
+static std::shared_ptr<quantization::QuantizedSlices>
+BinningQuantizeSlices(SliceSource& source, uint64_t iSliceElems,
+                      uint64_t iSlices, unsigned& iComponentSize)
+{
+  MESSAGE("Attempting to recover integer values by binning the data.");
 
-  data.clear();
+  iComponentSize = sizeof(U)*8;
+  // We max out at 4k bins for Tuvok, regardless of data size.
+  const size_t max_bins = std::min<size_t>(4096, size_t(1) << (sizeof(U)*8));
+  std::shared_ptr<quantization::Accumulator<T>> pStats =
+    std::make_shared<quantization::Accumulator<T>>(
+      quantization::EarlyOutHistSize<T,U>(), max_bins
+    );
+  quantization::AnalyzeSlices(source, iSliceElems, iSlices, *pStats);
+  MESSAGE("%lu bins needed...",
+          static_cast<unsigned long>(pStats->values.Size()));
 
-  // too many values, need to actually quantize the data
-  if (!bBinningPossible) {
-    InputData.SeekStart();
-    BStreamDescriptor bsd;
-    bsd.elements = iElems;
-    bsd.components = 1;
-    bsd.width = sizeof(T);
-    bsd.is_signed = ctti<T>::is_signed;
-    bsd.fp = std::is_floating_point<T>::value;
-    bsd.big_endian = EndianConvert::IsBigEndian();
-    bsd.timesteps = 1;
-    return Quantize<T,U>(InputData, bsd, strTargetFilename, Histogram1D);
+  if (pStats->values.Full()) {
+    return quantization::LinearSlices<T,U>(source, iSliceElems, iSlices,
+                                           pStats, NULL);
   }
-
-  // now compute the mapping from values to bins
-  std::map<T, size_t> binAssignments;
-  size_t binID = 0;
-
-  for (typename std::map<T, uint64_t>::iterator it=bins.begin();
-       it != bins.end(); it++) {
-    binAssignments[(*it).first] = binID;
-    binID++;
+  if (iSliceElems*iSlices == 0) {
+    return std::shared_ptr<quantization::QuantizedSlices>();
   }
 
-  bins.clear();
-
-  // apply this mapping
   MESSAGE("Binning possible, applying mapping");
-
-  if (binAssignments.size() < 256) {
+  if (pStats->values.Size() < 256) {
     iComponentSize = 8; // now we are only using 8 bits
-    using namespace boost;
-    return ApplyMapping<T,uint8_t>(iElems, iCurrentInCoreSizeBytes, ds,
-                                   strTargetFilename, binAssignments,
-                                   Histogram1D, progress);
+    return quantization::RanksSlices<T,uint8_t>(source, iSliceElems, pStats);
   } else {
-    return ApplyMapping<T,U>(iElems, iCurrentInCoreSizeBytes, ds,
-                             strTargetFilename, binAssignments, Histogram1D,
-                             progress);
+    return quantization::RanksSlices<T,U>(source, iSliceElems, pStats);
   }
 }
 }
@@ -38,6 +38,7 @@
 #include <cinttypes>
 #include <cstdio>
 #include <cstring>
+#include <functional>
 #include <iterator>
 #include <list>
 #include "3rdParty/bzip2/bzlib.h"
@@ -360,6 +361,126 @@ quantize(std::shared_ptr<LargeRAWFile> sourceData,
   return sourceData;
 }
 
+/// quantize() for data given as slices: decides the same way, but the
+/// quantization happens while the returned source is read.
+/// @returns an empty pointer if 'source' can be used as it is.
+std::shared_ptr<quantization::QuantizedSlices>
+quantize_slices(SliceSource& source, const bool bSigned, const bool bIsFloat,
+                unsigned& iComponentSize, const uint64_t iComponentCount,
+                const UINT64VECTOR3& vVolumeSize, const bool bQuantizeTo8Bit)
+{
+  using namespace quantization;
+  std::shared_ptr<QuantizedSlices> target;
+  const uint64_t n = iComponentCount * vVolumeSize.x * vVolumeSize.y;
+  const uint64_t z = vVolumeSize.z;
+
+  if (bQuantizeTo8Bit && iComponentSize > 8) {
+    switch (iComponentSize) {
+      case 16:
+        target = bSigned
+          ? QuantizeSlices<short, unsigned char>(source, n, z)
+          : QuantizeSlices<unsigned short, unsigned char>(source, n, z);
+        break;
+      case 32:
+        if (bIsFloat)
+          target = QuantizeSlices<float, unsigned char>(source, n, z);
+        else
+          target = bSigned
+            ? QuantizeSlices<int32_t, unsigned char>(source, n, z)
+            : QuantizeSlices<uint32_t, unsigned char>(source, n, z);
+        break;
+      case 64:
+        if (bIsFloat)
+          target = QuantizeSlices<double, unsigned char>(source, n, z);
+        else
+          target = bSigned
+            ? QuantizeSlices<int64_t, unsigned char>(source, n, z)
+            : QuantizeSlices<uint64_t, unsigned char>(source, n, z);
+        break;
+    }
+    iComponentSize = 8;
+    return target;
+  }
+
+  size_t iBinCount = 0;
+  switch (iComponentSize) {
+    case 8 :
+      // as in quantize(): unsigned color data are left alone
+      MESSAGE("Dataset is 8bit.");
+      if (bSigned) {
+        target = std::make_shared<
+          MappedSlices<int8_t, uint8_t, OffsetMapping<int8_t>>
+        >(source, n, std::shared_ptr<Accumulator<int8_t>>(),
+          OffsetMapping<int8_t>(), 256);
+      } else if (iComponentCount == 1) {
+        target = std::make_shared<
+          MappedSlices<uint8_t, uint8_t, OffsetMapping<uint8_t>>
+        >(source, n, std::shared_ptr<Accumulator<uint8_t>>(),
+          OffsetMapping<uint8_t>(), 256);
+      }
+      break;
+    case 16 :
+      MESSAGE("Dataset is 16bit integers (shorts)");
+      if(bSigned) {
+        target = QuantizeSlices<short, unsigned short>(source, n, z);
+      } else {
+        target = QuantizeSlices<unsigned short, unsigned short>(source, n, z,
+                                                                &iBinCount);
+        if (iBinCount > 0 && iBinCount <= 256) {
+          target = BinningQuantizeSlices<unsigned short, unsigned char>(
+            source, n, z, iComponentSize
+          );
+        }
+      }
+      break;
+    case 32 :
+      if (bIsFloat) {
+        MESSAGE("Dataset is 32bit FP (floats)");
+        target = BinningQuantizeSlices<float, unsigned short>(
+          source, n, z, iComponentSize
+        );
+      } else {
+        MESSAGE("Dataset is 32bit integers.");
+        if(bSigned) {
+          target = QuantizeSlices<int32_t, unsigned short>(source, n, z);
+        } else {
+          target = QuantizeSlices<uint32_t, unsigned short>(source, n, z,
+                                                            &iBinCount);
+          if (iBinCount > 0 && iBinCount <= 256) {
+            return BinningQuantizeSlices<uint32_t, unsigned char>(
+              source, n, z, iComponentSize
+            );
+          }
+        }
+        iComponentSize = 16;
+      }
+      break;
+    case 64 :
+      if (bIsFloat) {
+        MESSAGE("Dataset is 64bit FP (doubles).");
+        target = BinningQuantizeSlices<double, unsigned short>(
+          source, n, z, iComponentSize
+        );
+      } else {
+        MESSAGE("Dataset is 64bit integers.");
+        if(bSigned) {
+          target = QuantizeSlices<int64_t, unsigned short>(source, n, z);
+        } else {
+          target = QuantizeSlices<uint64_t, unsigned short>(source, n, z,
+                                                            &iBinCount);
+          if (iBinCount > 0 && iBinCount <= 256) {
+            return BinningQuantizeSlices<uint64_t, unsigned char>(
+              source, n, z, iComponentSize
+            );
+          }
+        }
+        iComponentSize = 16;
+      }
+      break;
+  }
+  return target;
+}
+
 // Create a temporary file and return the name.
 // This isn't great -- there's a race between when we close and reopen it --
 // but there's no (standard) way to turn a file descriptor into an fstream or
@@ -419,44 +540,13 @@ make_raw(std::shared_ptr<LargeRAWFile> source, uint64_t n_components,
   return components;
 }
 
-bool RAWConverter::ConvertRAWDataset(const string& strFilename,
-                                     const string& strTargetFilename,
-                                     const string& strTempDir,
-                                     uint64_t iHeaderSkip,
-                                     unsigned iComponentSize,
-                                     uint64_t iComponentCount,
-                                     uint64_t timesteps,
-                                     bool bConvertEndianness, bool bSigned,
-                                     bool bIsFloat,
-                                     UINT64VECTOR3 vVolumeSize,
-                                     FLOATVECTOR3 vVolumeAspect,
-                                     const string& strDesc,
-                                     const string& strSource,
-                                     const uint64_t iTargetBrickSize,
-                                     const uint64_t iTargetBrickOverlap,
-                                     const bool bUseMedian,
-                                     const bool bClampToEdge,
-                                     uint32_t iBrickCompression,
-                                     uint32_t iBrickCompressionLevel,
-                                     uint32_t iBrickLayout,
-                                     KVPairs* pKVPairs,
-                                     const bool bQuantizeTo8Bit)
+/// Rejects conversions the converters do not support.
+static bool check_parameters(unsigned iComponentSize, uint64_t iComponentCount,
+                             const UINT64VECTOR3& vVolumeSize,
+                             const FLOATVECTOR3& vVolumeAspect,
+                             uint64_t iTargetBrickSize,
+                             uint64_t iTargetBrickOverlap)
 {
-  if (!SysTools::FileExists(strFilename)) {
-    T_ERROR("Data file %s not found; maybe there is an invalid reference in "
-            "the header file?", strFilename.c_str());
-    return false;
-  }
-
-  // Save the original metadata now: as we quantize or whatnot, we will modify
-  // it, and we need to know the original settings for recording it in the UVF.
-  std::shared_ptr<KeyValuePairDataBlock> metaPairs = metadata(
-    strDesc, strSource,
-    (bConvertEndianness && EndianConvert::IsBigEndian()) ||
-      (EndianConvert::IsLittleEndian() && !bConvertEndianness),
-    bSigned, bIsFloat, iComponentSize, pKVPairs
-  );
-
   if(iComponentSize < 8) {
     T_ERROR("width too small; you probably forgot it is in BITS (not bytes)");
 #ifndef NDEBUG
@@ -470,11 +560,6 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
     return false;
   }
 
-  if (bConvertEndianness && iComponentSize < 16) { // catch silly user input
-    WARNING("Requested endian conversion for 8bit data... broken reader?");
-    bConvertEndianness = false;
-  }
-
   if(iTargetBrickSize <= (2*iTargetBrickOverlap)) {
     T_ERROR("Bricks would contain only ghost data or occupy negative space"
             " (brick size: %llu, brick overlap: %llu)", iTargetBrickSize,
@@ -492,51 +577,23 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
     T_ERROR("Invalid aspect ratio (%f)!", vVolumeAspect.volume());
     return false;
   }
+  return true;
+}
 
-  MESSAGE("Converting RAW dataset %s to %s", strFilename.c_str(),
-          strTargetFilename.c_str());
-
-  string tmpQuantizedFile = strTempDir+SysTools::GetFilename(strFilename)+".quantized";
-
-  std::shared_ptr<LargeRAWFile> sourceData;
-
-  if (bConvertEndianness) {
-    // the new data source is the endian-converted file.
-    size_t core_size = static_cast<size_t>(iTargetBrickSize*iTargetBrickSize*
-                                           iTargetBrickSize * iComponentSize/8);
-    string tmpEndianConvertedFile =
-      convert_endianness(strFilename, strTempDir, iHeaderSkip, vVolumeSize,
-                         iComponentSize, core_size);
-    iHeaderSkip = 0;  // the new file is straight raw without any header
-    MESSAGE("temporary source data; no header skip.");
-    sourceData = std::shared_ptr<LargeRAWFile>(
-      new TempFile(tmpEndianConvertedFile)
-    );
-  } else {
-    MESSAGE("non-temp source data, with %llu-byte header skip", iHeaderSkip);
-    sourceData = std::shared_ptr<LargeRAWFile>(
-      new LargeRAWFile(strFilename, iHeaderSkip)
-    );
-  }
-  sourceData->Open(false);
-  if(!sourceData->IsOpen()) {
-    using namespace tuvok::io;
-    throw DSOpenFailed(sourceData->GetFilename().c_str(), "Could not open data"
-                       " for processing.", __FILE__, __LINE__);
-  }
-
-  Histogram1DDataBlock Histogram1D;
-
-  assert((iComponentCount*vVolumeSize.volume()*timesteps) > 0);
-
-  sourceData = quantize(sourceData, tmpQuantizedFile, bSigned, bIsFloat,
-                        iComponentSize, iComponentCount, timesteps,
-                        vVolumeSize.volume(), bQuantizeTo8Bit, &Histogram1D);
-
-  // if it was signed, we un-signed it. If it was unsigned.. it was unsigned.
-  bSigned = false;
-  bIsFloat = false; // we always produce non-FP data.
-
+/// Assembles the UVF file once the data are in their final form: if they
+/// were signed, we un-signed them, and we always produce non-FP data in
+/// native byte order. 'brick' builds the octree of one timestep.
+static bool
+write_uvf(const string& strTargetFilename, const string& strTempDir,
+          const string& strDesc, const string& strSource,
+          std::shared_ptr<KeyValuePairDataBlock> metaPairs,
+          unsigned iComponentSize, uint64_t iComponentCount,
+          uint64_t timesteps, const UINT64VECTOR3& vVolumeSize,
+          uint64_t iTargetBrickSize, Histogram1DDataBlock& Histogram1D,
+          std::function<bool (TOCBlock&, ExtendedOctree::COMPONENT_TYPE,
+                              const std::string&,
+                              std::shared_ptr<MaxMinDataBlock>)> brick)
+{
   wstring wstrUVFName(strTargetFilename.begin(), strTargetFilename.end());
   UVF uvfFile(wstrUVFName);
 
@@ -588,24 +645,10 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
     ExtendedOctree::COMPONENT_TYPE ct = ExtendedOctree::CT_UINT8;
 
     switch (iComponentSize) {
-    case 8  :
-      ct = (bSigned) ? ExtendedOctree::CT_INT8 : ExtendedOctree::CT_UINT8;
-      break;
-    case 16 :
-      ct = (bSigned) ? ExtendedOctree::CT_INT16 : ExtendedOctree::CT_UINT16;
-      break;
-    case 32 :
-      if (bIsFloat)
-        ct = ExtendedOctree::CT_FLOAT32;
-      else
-        ct = (bSigned) ? ExtendedOctree::CT_INT32 : ExtendedOctree::CT_UINT32;
-      break;
-    case 64 :
-      if (bIsFloat)
-        ct = ExtendedOctree::CT_FLOAT64;
-      else
-        ct = (bSigned) ? ExtendedOctree::CT_INT64 : ExtendedOctree::CT_UINT64;
-      break;
+    case 8  : ct = ExtendedOctree::CT_UINT8;  break;
+    case 16 : ct = ExtendedOctree::CT_UINT16; break;
+    case 32 : ct = ExtendedOctree::CT_UINT32; break;
+    case 64 : ct = ExtendedOctree::CT_UINT64; break;
     }
 
     std::string tmpfile;
@@ -616,14 +659,7 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
     }
 
     MESSAGE("Building level of detail hierarchy ...");
-    if(dataVolume->FlatDataToBrickedLOD(sourceData, tmpfile,
-       ct, iComponentCount, vVolumeSize, DOUBLEVECTOR3(vVolumeAspect),
-       UINT64VECTOR3(iTargetBrickSize,iTargetBrickSize,iTargetBrickSize),
-       uint32_t(iTargetBrickOverlap), bUseMedian, bClampToEdge,
-       size_t(Controller::ConstInstance().SysInfo().GetMaxUsableCPUMem()),
-       MaxMinData, &Controller::Debug::Out(),
-       COMPRESSION_TYPE(iBrickCompression), iBrickCompressionLevel,
-       LAYOUT_TYPE(iBrickLayout)) != true) {
+    if(!brick(*dataVolume, ct, tmpfile, MaxMinData)) {
       T_ERROR("Brick generation failed, aborting.");
       uvfFile.Close();
       return false;
@@ -672,8 +708,6 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
     }
     MESSAGE("Storing acceleration data...");
     uvfFile.AddDataBlock(MaxMinData);
-
-    sourceData->Close();
   }
 
   MESSAGE("Storing metadata...");
@@ -694,6 +728,181 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
 }
 
 
+bool RAWConverter::ConvertRAWDataset(const string& strFilename,
+                                     const string& strTargetFilename,
+                                     const string& strTempDir,
+                                     uint64_t iHeaderSkip,
+                                     unsigned iComponentSize,
+                                     uint64_t iComponentCount,
+                                     uint64_t timesteps,
+                                     bool bConvertEndianness, bool bSigned,
+                                     bool bIsFloat,
+                                     UINT64VECTOR3 vVolumeSize,
+                                     FLOATVECTOR3 vVolumeAspect,
+                                     const string& strDesc,
+                                     const string& strSource,
+                                     const uint64_t iTargetBrickSize,
+                                     const uint64_t iTargetBrickOverlap,
+                                     const bool bUseMedian,
+                                     const bool bClampToEdge,
+                                     uint32_t iBrickCompression,
+                                     uint32_t iBrickCompressionLevel,
+                                     uint32_t iBrickLayout,
+                                     KVPairs* pKVPairs,
+                                     const bool bQuantizeTo8Bit)
+{
+  if (!SysTools::FileExists(strFilename)) {
+    T_ERROR("Data file %s not found; maybe there is an invalid reference in "
+            "the header file?", strFilename.c_str());
+    return false;
+  }
+
+  // Save the original metadata now: as we quantize or whatnot, we will modify
+  // it, and we need to know the original settings for recording it in the UVF.
+  std::shared_ptr<KeyValuePairDataBlock> metaPairs = metadata(
+    strDesc, strSource,
+    (bConvertEndianness && EndianConvert::IsBigEndian()) ||
+      (EndianConvert::IsLittleEndian() && !bConvertEndianness),
+    bSigned, bIsFloat, iComponentSize, pKVPairs
+  );
+
+  if (bConvertEndianness && iComponentSize < 16) { // catch silly user input
+    WARNING("Requested endian conversion for 8bit data... broken reader?");
+    bConvertEndianness = false;
+  }
+
+  if(!check_parameters(iComponentSize, iComponentCount, vVolumeSize,
+                       vVolumeAspect, iTargetBrickSize, iTargetBrickOverlap)) {
+    return false;
+  }
+
+  MESSAGE("Converting RAW dataset %s to %s", strFilename.c_str(),
+          strTargetFilename.c_str());
+
+  string tmpQuantizedFile = strTempDir+SysTools::GetFilename(strFilename)+".quantized";
+
+  std::shared_ptr<LargeRAWFile> sourceData;
+
+  if (bConvertEndianness) {
+    // the new data source is the endian-converted file.
+    size_t core_size = static_cast<size_t>(iTargetBrickSize*iTargetBrickSize*
+                                           iTargetBrickSize * iComponentSize/8);
+    string tmpEndianConvertedFile =
+      convert_endianness(strFilename, strTempDir, iHeaderSkip, vVolumeSize,
+                         iComponentSize, core_size);
+    iHeaderSkip = 0;  // the new file is straight raw without any header
+    MESSAGE("temporary source data; no header skip.");
+    sourceData = std::shared_ptr<LargeRAWFile>(
+      new TempFile(tmpEndianConvertedFile)
+    );
+  } else {
+    MESSAGE("non-temp source data, with %llu-byte header skip", iHeaderSkip);
+    sourceData = std::shared_ptr<LargeRAWFile>(
+      new LargeRAWFile(strFilename, iHeaderSkip)
+    );
+  }
+  sourceData->Open(false);
+  if(!sourceData->IsOpen()) {
+    using namespace tuvok::io;
+    throw DSOpenFailed(sourceData->GetFilename().c_str(), "Could not open data"
+                       " for processing.", __FILE__, __LINE__);
+  }
+
+  Histogram1DDataBlock Histogram1D;
+
+  assert((iComponentCount*vVolumeSize.volume()*timesteps) > 0);
+
+  sourceData = quantize(sourceData, tmpQuantizedFile, bSigned, bIsFloat,
+                        iComponentSize, iComponentCount, timesteps,
+                        vVolumeSize.volume(), bQuantizeTo8Bit, &Histogram1D);
+
+  return write_uvf(strTargetFilename, strTempDir, strDesc, strSource,
+    metaPairs, iComponentSize, iComponentCount, timesteps, vVolumeSize,
+    iTargetBrickSize, Histogram1D,
+    [&](TOCBlock& dataVolume, ExtendedOctree::COMPONENT_TYPE ct,
+        const std::string& tmpfile,
+        std::shared_ptr<MaxMinDataBlock> MaxMinData) {
+      const bool bBricked = dataVolume.FlatDataToBrickedLOD(sourceData,
+        tmpfile, ct, iComponentCount, vVolumeSize,
+        DOUBLEVECTOR3(vVolumeAspect),
+        UINT64VECTOR3(iTargetBrickSize,iTargetBrickSize,iTargetBrickSize),
+        uint32_t(iTargetBrickOverlap), bUseMedian, bClampToEdge,
+        size_t(Controller::ConstInstance().SysInfo().GetMaxUsableCPUMem()),
+        MaxMinData, &Controller::Debug::Out(),
+        COMPRESSION_TYPE(iBrickCompression), iBrickCompressionLevel,
+        LAYOUT_TYPE(iBrickLayout));
+      sourceData->Close();
+      return bBricked;
+    });
+}
+
+bool RAWConverter::ConvertSlices(SliceSource& source,
+                                 const string& strTargetFilename,
+                                 const string& strTempDir,
+                                 unsigned iComponentSize,
+                                 uint64_t iComponentCount,
+                                 bool bSourceBigEndian, bool bSigned,
+                                 bool bIsFloat,
+                                 UINT64VECTOR3 vVolumeSize,
+                                 FLOATVECTOR3 vVolumeAspect,
+                                 const string& strDesc,
+                                 const string& strSource,
+                                 const uint64_t iTargetBrickSize,
+                                 const uint64_t iTargetBrickOverlap,
+                                 const bool bUseMedian,
+                                 const bool bClampToEdge,
+                                 uint32_t iBrickCompression,
+                                 uint32_t iBrickCompressionLevel,
+                                 uint32_t iBrickLayout,
+                                 KVPairs* pKVPairs,
+                                 const bool bQuantizeTo8Bit)
+{
+  std::shared_ptr<KeyValuePairDataBlock> metaPairs = metadata(
+    strDesc, strSource, !bSourceBigEndian, bSigned, bIsFloat, iComponentSize,
+    pKVPairs
+  );
+
+  if(!check_parameters(iComponentSize, iComponentCount, vVolumeSize,
+                       vVolumeAspect, iTargetBrickSize, iTargetBrickOverlap)) {
+    return false;
+  }
+
+  MESSAGE("Converting %s to %s", strSource.c_str(),
+          strTargetFilename.c_str());
+
+  std::shared_ptr<quantization::QuantizedSlices> quantized = quantize_slices(
+    source, bSigned, bIsFloat, iComponentSize, iComponentCount, vVolumeSize,
+    bQuantizeTo8Bit
+  );
+  SliceSource& slices = quantized ? *quantized : source;
+
+  Histogram1DDataBlock Histogram1D;
+  return write_uvf(strTargetFilename, strTempDir, strDesc, strSource,
+    metaPairs, iComponentSize, iComponentCount, 1, vVolumeSize,
+    iTargetBrickSize, Histogram1D,
+    [&](TOCBlock& dataVolume, ExtendedOctree::COMPONENT_TYPE ct,
+        const std::string& tmpfile,
+        std::shared_ptr<MaxMinDataBlock> MaxMinData) {
+      if(!dataVolume.FlatDataToBrickedLOD(slices,
+         tmpfile, ct, iComponentCount, vVolumeSize,
+         DOUBLEVECTOR3(vVolumeAspect),
+         UINT64VECTOR3(iTargetBrickSize,iTargetBrickSize,iTargetBrickSize),
+         uint32_t(iTargetBrickOverlap), bUseMedian, bClampToEdge,
+         size_t(Controller::ConstInstance().SysInfo().GetMaxUsableCPUMem()),
+         MaxMinData, &Controller::Debug::Out(),
+         COMPRESSION_TYPE(iBrickCompression), iBrickCompressionLevel,
+         LAYOUT_TYPE(iBrickLayout))) {
+        return false;
+      }
+      // every slice went through the quantization now
+      if(quantized) {
+        std::vector<uint64_t> vHist = quantized->GetHistogram();
+        Histogram1D.SetHistogram(vHist);
+      }
+      return true;
+    });
+}
+
 #ifdef WIN32
   #pragma warning( disable : 4996 ) // disable deprecated warning
 #endif
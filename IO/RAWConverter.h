@@ -48,6 +48,7 @@
 #include "IOManager.h"  // for the size defines
 
 typedef std::vector<std::pair<std::string, std::string>> KVPairs;
+class SliceSource;
 
 template<class T> class MinMaxScanner {
 public:
@@ -97,6 +98,31 @@ public:
                                 KVPairs* pKVPairs = NULL,
                                 const bool bQuantizeTo8Bit=false);
 
+  /// Converts a volume which is produced slice by slice, e.g. decoded from
+  /// a stack of images, without storing it linearly on disk first. The
+  /// slices must be in native byte order, bSourceBigEndian is only
+  /// recorded. The source is read twice if the data need quantization:
+  /// once to analyze them and once to brick them.
+  static bool ConvertSlices(SliceSource& source,
+                            const std::string& strTargetFilename,
+                            const std::string& strTempDir,
+                            unsigned iComponentSize,
+                            uint64_t iComponentCount,
+                            bool bSourceBigEndian, bool bSigned,
+                            bool bIsFloat, UINT64VECTOR3 vVolumeSize,
+                            FLOATVECTOR3 vVolumeAspect,
+                            const std::string& strDesc,
+                            const std::string& strSource,
+                            const uint64_t iTargetBrickSize,
+                            const uint64_t iTargetBrickOverlap,
+                            const bool bUseMedian,
+                            const bool bClampToEdge,
+                            uint32_t iBrickCompression,
+                            uint32_t iBrickCompressionLevel,
+                            uint32_t iBrickLayout,
+                            KVPairs* pKVPairs = NULL,
+                            const bool bQuantizeTo8Bit=false);
+
   static bool ExtractGZIPDataset(const std::string& strFilename,
                                  const std::string& strUncompressedFile,
                                  uint64_t iHeaderSkip);
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "StackSliceSource.h"
+#include "Basics/EndianConvert.h"
+#include "Basics/Threads.h"
+#include "Controller/Controller.h"
+#include "DICOM/DICOMParser.h"
+#include "TuvokIOError.h"
+#include "TuvokJPEG.h"
+
+namespace tuvok {
+
+// slices are decoded by the converter's threads, but the logging they might
+// do (e.g. in the JPEG constructor) is not thread-safe.
+static CriticalSection logGuard;
+
+namespace {
+  template<typename T> void Swap(char* pData, size_t iBytes) {
+    T* p = reinterpret_cast<T*>(pData);
+    for(size_t i=0; i < iBytes/sizeof(T); ++i) {
+      p[i] = EndianConvert::Swap<T>(p[i]);
+    }
+  }
+  template<typename T> void ScaleBias(char* pData, size_t iBytes,
+                                      float fScale, float fBias) {
+    T* p = reinterpret_cast<T*>(pData);
+    for(size_t i=0; i < iBytes/sizeof(T); ++i) {
+      p[i] = T(p[i] * fScale + fBias);
+    }
+  }
+}
+
+StackSliceSource::StackSliceSource(FileStackInfo& stack) :
+  m_Stack(stack),
+  m_bDICOM(stack.m_strFileType == "DICOM"),
+  m_iComponentSize(stack.m_iAllocated),
+  m_iFileComponents(stack.m_iComponentCount),
+  m_iComponentCount(stack.m_iComponentCount),
+  m_bSigned(stack.m_bSigned),
+  m_bBigEndian(stack.m_bIsBigEndian),
+  m_iFrames(std::max(1u, stack.m_ivSize.z)),
+  m_vSize(stack.m_ivSize.x, stack.m_ivSize.y,
+          uint64_t(m_iFrames) * stack.m_Elements.size())
+{
+  if(stack.m_Elements.empty()) {
+    throw io::DSOpenFailed("empty stack", __FILE__, __LINE__);
+  }
+  if(m_bDICOM) {
+    // libjpeg decodes to 8 bits per component
+    if(stack.m_bIsJPEGEncoded) { m_iComponentSize = 8; }
+    // We pretend 3 component data is 4 component data to simplify
+    // processing later.
+    /// @todo FIXME: this assumes 3 component data is always 3*char
+    if(m_iFileComponents == 3) { m_iComponentCount = 4; }
+  } else {
+    // images are unsigned; the number of components is known once the
+    // first one is decoded
+    m_bSigned = false;
+    m_iFrames = 1;
+    m_vSize.z = stack.m_Elements.size();
+    std::vector<char> vData;
+    if(!stack.m_Elements[0]->GetData(vData)) {
+      throw io::DSOpenFailed(stack.m_Elements[0]->m_strFileName,
+                             "could not decode image", __FILE__, __LINE__);
+    }
+    m_iFileComponents = m_iComponentCount =
+      stack.m_Elements[0]->GetComponentCount();
+  }
+}
+
+void StackSliceSource::GetSlice(uint64_t iSlice, uint8_t* pData) {
+  SimpleFileInfo* pFile = m_Stack.m_Elements[size_t(iSlice / m_iFrames)];
+  const size_t iSliceSize = size_t(GetSliceSize());
+
+  std::vector<char> vData;
+  if(m_bDICOM) {
+    GetDICOMSlice(pFile, uint32_t(iSlice % m_iFrames), vData);
+  } else {
+    GetImageSlice(pFile, vData);
+  }
+
+  if(m_iFileComponents == 3 && m_iComponentCount == 4) {
+    const size_t iVoxels = vData.size() / 3;
+    for(size_t k=0; k < iVoxels && 4*k+3 < iSliceSize; ++k) {
+      pData[k*4+0] = uint8_t(vData[k*3+0]);
+      pData[k*4+1] = uint8_t(vData[k*3+1]);
+      pData[k*4+2] = uint8_t(vData[k*3+2]);
+      pData[k*4+3] = 255;
+    }
+  } else {
+    if(vData.size() != iSliceSize) {
+      throw io::DSOpenFailed(pFile->m_strFileName, "slice size differs from "
+                             "the rest of the stack", __FILE__, __LINE__);
+    }
+    std::memcpy(pData, &vData[0], iSliceSize);
+  }
+}
+
+void StackSliceSource::GetDICOMSlice(SimpleFileInfo* pFile, uint32_t iFrame,
+                                     std::vector<char>& vData) const {
+  SimpleDICOMFileInfo* pDICOMFile = dynamic_cast<SimpleDICOMFileInfo*>(pFile);
+  if(!pDICOMFile) {
+    throw io::DSOpenFailed(pFile->m_strFileName, "not a DICOM file",
+                           __FILE__, __LINE__);
+  }
+  const size_t iFrameSize = size_t(m_vSize.x * m_vSize.y * m_iFileComponents *
+                                   m_iComponentSize / 8);
+  vData.resize(iFrameSize, 0);
+
+  if(m_Stack.m_bIsJPEGEncoded) {
+    std::unique_ptr<JPEG> jpg;
+    {
+      SCOPEDLOCK(logGuard);
+      jpg.reset(new JPEG(pFile->m_strFileName,
+                         pDICOMFile->GetOffsetToData()));
+    }
+    const char* pJPEGData = jpg->valid() ? jpg->data() : NULL;
+    if(!pJPEGData) {
+      throw io::DSOpenFailed(pFile->m_strFileName, "the DICOM reports an "
+                             "embedded JPEG, but the JPEG is invalid",
+                             __FILE__, __LINE__);
+    }
+    const size_t iFirst = std::min(size_t(iFrame) * iFrameSize, jpg->size());
+    const size_t iCount = std::min(iFrameSize, jpg->size() - iFirst);
+    std::copy(pJPEGData + iFirst, pJPEGData + iFirst + iCount, vData.begin());
+  } else if(!pDICOMFile->GetData(vData, uint32_t(iFrameSize),
+                                 uint32_t(iFrame * iFrameSize))) {
+    throw io::DSOpenFailed(pFile->m_strFileName, "could not read the pixel "
+                           "data", __FILE__, __LINE__);
+  }
+
+  if(m_bBigEndian != EndianConvert::IsBigEndian()) {
+    switch(m_iComponentSize) {
+      case 16: Swap<int16_t>(&vData[0], vData.size()); break;
+      case 32: Swap<int32_t>(&vData[0], vData.size()); break;
+    }
+  }
+
+  // HACK: For now we set bias to 0 for unsigned file as we've
+  // encountered a number of DICOM files files where the bias
+  // parameter would create negative values and so far I don't know
+  // how to interpret this correctly
+  const float fScale = pDICOMFile->m_fScale;
+  const float fBias = m_bSigned ? pDICOMFile->m_fBias : 0.0f;
+  if(fScale != 1.0f || fBias != 0.0f) {
+    char* p = &vData[0];
+    const size_t n = vData.size();
+    switch(m_iComponentSize) {
+      case 8:
+        if(m_bSigned) ScaleBias<int8_t>(p, n, fScale, fBias);
+        else          ScaleBias<uint8_t>(p, n, fScale, fBias);
+        break;
+      case 16:
+        if(m_bSigned) ScaleBias<int16_t>(p, n, fScale, fBias);
+        else          ScaleBias<uint16_t>(p, n, fScale, fBias);
+        break;
+      case 32:
+        if(m_bSigned) ScaleBias<int32_t>(p, n, fScale, fBias);
+        else          ScaleBias<uint32_t>(p, n, fScale, fBias);
+        break;
+    }
+  }
+}
+
+void StackSliceSource::GetImageSlice(SimpleFileInfo* pFile,
+                                     std::vector<char>& vData) const {
+  if(!pFile->GetData(vData)) {
+    throw io::DSOpenFailed(pFile->m_strFileName, "could not decode image",
+                           __FILE__, __LINE__);
+  }
+}
+
+}
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,85 @@
+#ifndef TUVOK_STACK_SLICE_SOURCE_H
+#define TUVOK_STACK_SLICE_SOURCE_H
+
+#include "StdTuvokDefines.h"
+#include <vector>
+#include "Basics/Vectors.h"
+#include "UVF/ExtendedOctree/ExtendedOctreeConverter.h"
+
+class FileStackInfo;
+class SimpleFileInfo;
+
+namespace tuvok {
+
+/// Decodes the slices of a DICOM or image stack on request, so that the
+/// octree of a stack is built without writing the stack to disk first.
+/// The slices come out in native byte order with the DICOM scale and bias
+/// applied; RGB data are expanded to RGBA.  Files which hold several frames
+/// contribute one slice per frame.  Slices are decoded concurrently, each
+/// from its own file.
+class StackSliceSource : public SliceSource {
+public:
+  /// @param stack a "DICOM" or "IMAGE" stack, must outlive the source
+  /// @throws io::DSOpenFailed if the stack cannot be read at all
+  explicit StackSliceSource(FileStackInfo& stack);
+
+  /// @throws io::DSOpenFailed if the file of the slice cannot be decoded
+  virtual void GetSlice(uint64_t iSlice, uint8_t* pData);
+
+  /// @returns the bits per component of the slices
+  unsigned GetComponentSize() const { return m_iComponentSize; }
+  uint64_t GetComponentCount() const { return m_iComponentCount; }
+  bool IsSigned() const { return m_bSigned; }
+  /// @returns the byte order of the files; the slices are native
+  bool IsBigEndian() const { return m_bBigEndian; }
+  UINT64VECTOR3 GetSize() const { return m_vSize; }
+  /// @returns the bytes of one slice
+  uint64_t GetSliceSize() const {
+    return m_vSize.x * m_vSize.y * m_iComponentCount * m_iComponentSize / 8;
+  }
+
+private:
+  void GetDICOMSlice(SimpleFileInfo* pFile, uint32_t iFrame,
+                     std::vector<char>& vData) const;
+  void GetImageSlice(SimpleFileInfo* pFile, std::vector<char>& vData) const;
+
+  FileStackInfo& m_Stack;
+  bool m_bDICOM;
+  unsigned m_iComponentSize;
+  uint64_t m_iFileComponents;  ///< components in the files
+  uint64_t m_iComponentCount;  ///< components in the slices
+  bool m_bSigned;
+  bool m_bBigEndian;
+  uint32_t m_iFrames;          ///< slices per file
+  UINT64VECTOR3 m_vSize;
+};
+
+}
+#endif /* TUVOK_STACK_SLICE_SOURCE_H */
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -22,8 +22,12 @@
  DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include "ExtendedOctree.h"
+#include "VolumeTools.h"
+#include "Basics/MemMappedFile.h"
 #include "Basics/nonstd.h"
 #include "Basics/Timer.h"
 #include "Controller/Controller.h"
@@ -32,6 +36,10 @@
 #include "LzmaCompression.h"
 #include "Lz4Compression.h"
 #include "BzlibCompression.h"
+#ifndef DETECTED_OS_WINDOWS
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
 
 ExtendedOctree::ExtendedOctree() :
   m_eComponentType(CT_UINT8), 
@@ -45,7 +53,8 @@ ExtendedOctree::ExtendedOctree() :
   m_iSize(0),
   m_iCompressionLevel(4), // our default level for LZMA, it's fast and still compresses well
   m_iOffset(0), 
-  m_pLargeRAWFile()
+  m_pLargeRAWFile(),
+  m_eLayout(LT_UNKNOWN)
 {}
 
 void ExtendedOctree::InitLzmaCompression()
@@ -161,6 +170,8 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
     }
   }
 
+  m_eLayout = DetectLayout();
+
   return true;
 }
 
@@ -171,10 +182,142 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
  should not be used unless another open call is performed
 */
 void ExtendedOctree::Close() {
+  UnmapFile();
   if ( m_pLargeRAWFile != LargeRAWFile_ptr()) 
     m_pLargeRAWFile->Close();
 }
 
+/*
+ DetectLayout:
+
+ The converter writes the bricks of each LoD back to back in the order of its
+ layout, but does not store that layout. Hence we follow each candidate layout
+ through the first bricks of LoD 0; the one that visits them at increasing
+ offsets is the one the file was written with. Files with a single row of
+ bricks are consistent with all layouts, we report scanline for those.
+*/
+LAYOUT_TYPE ExtendedOctree::DetectLayout() const {
+  if (m_vLODTable.empty() || m_vTOC.empty()) return LT_UNKNOWN;
+
+  const UINT64VECTOR3 domain = m_vLODTable[0].m_iLODBrickCount;
+  const uint64_t iSamples = std::min<uint64_t>(domain.volume(), 64);
+
+  const LAYOUT_TYPE candidates[] = { LT_SCANLINE, LT_MORTON, LT_HILBERT };
+  for (size_t c = 0;c<sizeof(candidates)/sizeof(candidates[0]);++c) {
+    std::shared_ptr<VolumeTools::Layout> pLayout;
+    switch (candidates[c]) {
+    default:
+    case LT_SCANLINE: pLayout.reset(new VolumeTools::ScanlineLayout(domain)); break;
+    case LT_MORTON:   pLayout.reset(new VolumeTools::MortonLayout(domain));   break;
+    case LT_HILBERT:  pLayout.reset(new VolumeTools::HilbertLayout(domain));  break;
+    }
+
+    // the space filling curves cover the next power of two cube, so in flat
+    // domains most positions are outside; give up eventually
+    bool bConsistent = true;
+    uint64_t iFound = 0;
+    uint64_t iLastOffset = 0;
+    for (uint64_t i = 0;iFound<iSamples && i < (uint64_t(1)<<20);++i) {
+      const UINT64VECTOR3 position = pLayout->GetSpatialPosition(i);
+      if (position.x >= domain.x ||
+          position.y >= domain.y ||
+          position.z >= domain.z) continue;
+
+      const uint64_t iOffset =
+        m_vTOC[size_t(BrickCoordsToIndex(UINT64VECTOR4(position, 0)))].m_iOffset;
+      if (iFound > 0 && iOffset <= iLastOffset) {
+        bConsistent = false;
+        break;
+      }
+      iLastOffset = iOffset;
+      ++iFound;
+    }
+    if (bConsistent && iFound == iSamples) return candidates[c];
+  }
+  return LT_RANDOM;
+}
+
+/*
+ MapFile:
+
+ Maps the entire file read-only; brick offsets are relative to the octree
+ header, which may be anywhere in the file. We also tell the OS how we are
+ going to access the file: with the space filling curves, bricks that are
+ close in space are also close in the file, so the default read-ahead around
+ a fault pays off. For all other layouts neighbors are far apart and
+ read-ahead only wastes I/O, the bricks themselves are requested explicitly
+ in GetMappedBrickData.
+*/
+bool ExtendedOctree::MapFile() const {
+  if (IsMapped()) return true;
+  if (m_pLargeRAWFile == LargeRAWFile_ptr() || m_vTOC.empty()) return false;
+
+  std::shared_ptr<MemMappedFile> pMapped;
+  try {
+    pMapped.reset(new MemMappedFile(m_pLargeRAWFile->GetFilename(),
+                                    MMFILE_ACCESS_READONLY));
+  } catch (std::exception const&) {
+    return false;
+  }
+  if (!pMapped->IsOpen() || pMapped->GetDataPointer() == NULL) return false;
+
+  // don't trust m_iSize, old files do not store it
+  uint64_t iEnd = 0;
+  for (size_t i = 0;i<m_vTOC.size();++i)
+    iEnd = std::max(iEnd, m_vTOC[i].m_iOffset + m_vTOC[i].m_iLength);
+  if (pMapped->GetFileMappingSize() < m_iOffset + iEnd) return false;
+
+#ifndef DETECTED_OS_WINDOWS
+  const bool bCoherent = m_eLayout == LT_MORTON || m_eLayout == LT_HILBERT;
+  madvise(pMapped->GetDataPointer(), size_t(pMapped->GetFileMappingSize()),
+          bCoherent ? MADV_NORMAL : MADV_RANDOM);
+#endif
+
+  m_pMappedFile = pMapped;
+  return true;
+}
+
+void ExtendedOctree::UnmapFile() const {
+  // the mapping goes away when the last brick handed out is released
+  m_pMappedFile.reset();
+}
+
+/*
+ GetMappedBrickData:
+
+ Returns a pointer into the mapping that shares ownership of the mapping,
+ hence the pointer stays valid even if the file gets unmapped meanwhile. As
+ the brick is about to be used, we ask the OS to read all of it now, instead
+ of faulting it in page by page.
+*/
+std::shared_ptr<const void>
+ExtendedOctree::GetMappedBrickData(uint64_t index) const {
+  const std::shared_ptr<MemMappedFile> pMapped = m_pMappedFile;
+  const TOCEntry& toc = m_vTOC[size_t(index)];
+  if (!pMapped || toc.m_eCompression != CT_NONE ||
+      toc.m_iAtlasSize.area() != 0) {
+    return std::shared_ptr<const void>();
+  }
+
+  const uint8_t* pBrick = static_cast<const uint8_t*>(pMapped->GetDataPointer())
+                          + m_iOffset + toc.m_iOffset;
+#ifndef DETECTED_OS_WINDOWS
+  static const uintptr_t iPageMask = uintptr_t(sysconf(_SC_PAGE_SIZE)) - 1;
+  const uintptr_t iStart = reinterpret_cast<uintptr_t>(pBrick) & ~iPageMask;
+  madvise(reinterpret_cast<void*>(iStart),
+          size_t(reinterpret_cast<uintptr_t>(pBrick) - iStart + toc.m_iLength),
+          MADV_WILLNEED);
+#endif
+
+  tuvok::Controller::Instance().IncrementPerfCounter(PERF_EO_BRICKS, 1.0);
+  return std::shared_ptr<const void>(pMapped, pBrick);
+}
+
+std::shared_ptr<const void>
+ExtendedOctree::GetMappedBrickData(const UINT64VECTOR4& vBrickCoords) const {
+  return GetMappedBrickData(BrickCoordsToIndex(vBrickCoords));
+}
+
 /*
  ComputeMetadata:
  
@@ -315,10 +458,21 @@ void ExtendedOctree::GetBrickData(uint8_t* pData, uint64_t index) const {
   tuvok::Controller::Instance().IncrementPerfCounter(PERF_EO_BRICKS, 1.0);
 
   if(m_vTOC[size_t(index)].m_eCompression == CT_NONE) {
-    // not compressed, just read it directly into the buffer.
+    // with a mapped file there is nothing to read (and no seek to
+    // serialize), the data are already in memory.
+    const std::shared_ptr<MemMappedFile> pMapped = m_pMappedFile;
+    if(pMapped) {
+      std::memcpy(pData, static_cast<const uint8_t*>(pMapped->GetDataPointer())
+                         + m_iOffset + m_vTOC[size_t(index)].m_iOffset,
+                  size_t(m_vTOC[size_t(index)].m_iLength));
+      return;
+    }
+    // not compressed, just read it directly into the buffer.  Bricks may be
+    // requested from several threads at once (prefetching), and all blocks
+    // of a UVF share the file, so seek and read must happen as one.
     tuvok::StackTimer t(PERF_EO_DISK_READ);
-    m_pLargeRAWFile->SeekPos(m_iOffset+m_vTOC[size_t(index)].m_iOffset);
-    m_pLargeRAWFile->ReadRAW(pData, m_vTOC[size_t(index)].m_iLength);
+    m_pLargeRAWFile->ReadRAWAt(m_iOffset+m_vTOC[size_t(index)].m_iOffset,
+                               pData, m_vTOC[size_t(index)].m_iLength);
     return;
   }
 
@@ -332,10 +486,11 @@ void ExtendedOctree::GetBrickData(uint8_t* pData, uint64_t index) const {
   std::shared_ptr<uint8_t> buf(new uint8_t[uncompressedSize],
                                nonstd::DeleteArray<uint8_t>());
   std::shared_ptr<uint8_t> out(pData, nonstd::null_deleter());
-  TimedStatement(PERF_EO_DISK_READ,
-    m_pLargeRAWFile->SeekPos(m_iOffset+m_vTOC[size_t(index)].m_iOffset);
-    m_pLargeRAWFile->ReadRAW(buf.get(), m_vTOC[size_t(index)].m_iLength);
-  );
+  {
+    tuvok::StackTimer t(PERF_EO_DISK_READ);
+    m_pLargeRAWFile->ReadRAWAt(m_iOffset+m_vTOC[size_t(index)].m_iOffset,
+                               buf.get(), m_vTOC[size_t(index)].m_iLength);
+  }
   tuvok::StackTimer decompress(PERF_EO_DECOMPRESSION);
   switch (m_vTOC[size_t(index)].m_eCompression) {
   case CT_ZLIB:
@@ -126,6 +126,7 @@ struct TOCEntry {
 // forward to the raw to brick converter, required for the
 // friend declaration down below
 class ExtendedOctreeConverter;
+class MemMappedFile;
 
 /*! \brief This class holds the actual octree data
  *
@@ -264,6 +265,48 @@ public:
   */
   void GetBrickData(uint8_t* pData, const UINT64VECTOR4& vBrickCoords) const;
 
+  /**
+    Maps the file holding the tree into memory (read-only). While the file is
+    mapped, uncompressed bricks are copied from the mapping instead of
+    seeking and reading the file, or used in place, see GetMappedBrickData. Mapping is a pure read optimization and may fail
+    (e.g. if the address space is too small), in which case the file is
+    simply read as before. Not thread safe with respect to brick reads.
+    @return true iff the file is mapped
+  */
+  bool MapFile() const;
+
+  /**
+    Drops the mapping, pointers handed out by GetMappedBrickData remain
+    valid until they are released
+  */
+  void UnmapFile() const;
+
+  /**
+    Returns true iff the file is currently mapped
+    @return true iff the file is currently mapped
+  */
+  bool IsMapped() const {return bool(m_pMappedFile);}
+
+  /**
+    Returns a pointer to the data of a brick inside the mapped file, i.e.
+    without reading or copying anything. This works only for bricks stored
+    without compression and not as an atlas, for all other bricks (or if the
+    file is not mapped) use GetBrickData
+    @param vBrickCoords coordinates of a brick: x,y,z are the spacial coordinates, w is the LoD level
+    @return the brick's data, it keeps the mapping alive; empty if the
+            brick cannot be used in place
+  */
+  std::shared_ptr<const void> GetMappedBrickData(const UINT64VECTOR4& vBrickCoords) const;
+
+  /**
+    Returns the order of the bricks in the file. The layout is not stored in
+    the file, instead it is derived from the brick offsets in the ToC when
+    the tree is opened
+    @return the order of the bricks in the file, LT_UNKNOWN if the tree has
+            not been read from a file
+  */
+  LAYOUT_TYPE GetLayout() const {return m_eLayout;}
+
 
   /**
     Returns the global aspect ratio of the volume
@@ -353,6 +396,20 @@ private:
   /// table of LoD metadata
   std::vector<LODInfo> m_vLODTable;
 
+  /// order of the bricks in the file, derived from the ToC
+  LAYOUT_TYPE m_eLayout;
+
+  /// read-only mapping of the data file, if any, see MapFile
+  mutable std::shared_ptr<MemMappedFile> m_pMappedFile;
+
+  /**
+    Guesses the order of the bricks in the file from the ToC, by checking
+    which layout visits the bricks of the highest resolution at increasing
+    offsets
+    @return the layout the ToC is consistent with, LT_RANDOM if none
+  */
+  LAYOUT_TYPE DetectLayout() const;
+
   /**
     Computes whether a brick is the last brick in a row, column, or slice.
 
@@ -402,6 +459,13 @@ private:
   */
   void GetBrickData(uint8_t* pData, uint64_t index) const;
 
+  /**
+    returns a pointer to the data of a brick inside the mapped file
+    @param index the index of the brick in the LoD table
+    @return the brick's data; empty if the brick cannot be used in place
+  */
+  std::shared_ptr<const void> GetMappedBrickData(uint64_t index) const;
+
   /** 
     returns true iff the large raw file holding this tree's
     data is is currently in RW mode
@@ -24,10 +24,12 @@
 
 // for find_if
 #include <algorithm>
+#include <exception>
 #include <memory>
 #include <map>
 #include <unordered_map>
 #include <stdexcept>
+#include <thread>
 #include "Basics/MathTools.h"
 #include "Basics/ProgressTimer.h"
 #include "Basics/Timer.h"
@@ -55,16 +57,25 @@
 ExtendedOctreeConverter::ExtendedOctreeConverter(
                           const UINT64VECTOR3& vBrickSize,
                           uint32_t iOverlap, uint64_t iMemLimit,
-                          AbstrDebugOut& progress) :
+                          AbstrDebugOut& progress,
+                          unsigned iThreads) :
     m_fProgress(0.0f),
     m_pProgressTimer(new ProgressTimer()),
     m_vBrickSize(vBrickSize),
     m_iOverlap(iOverlap),
     m_iMemLimit(iMemLimit),
+    m_iThreads(iThreads),
     m_iCacheAccessCounter(0),
+    m_eCachePolicy(CP_OPTIMAL),
+    m_iWorkBytes(0),
+    m_iCacheBytes(0),
+    m_CacheStats(),
     m_pBrickStatVec(NULL),
     m_Progress(progress)
 {
+  if (m_iThreads == 0) {
+    m_iThreads = std::max(1U, std::thread::hardware_concurrency());
+  }
   m_pProgressTimer->Start();
 }
 
@@ -139,6 +150,71 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
                       bool bComputeMedian,
                       bool bClampToEdge,
                       LAYOUT_TYPE layout) {
+  ExtendedOctree e;
+  BeginConversion(e, eComponentType, iComponentCount, vVolumeSize,
+                  vVolumeAspect, pLargeRAWFileOut, iOutOffset, stats,
+                  compression, iCompressionLevel, layout);
+
+  SetupCache(e);
+
+  // brick (permute) the input data
+  PermuteInputData(e, pLargeRAWFileIn, iInOffset, bClampToEdge);
+
+  return FinishConversion(e, bComputeMedian, bClampToEdge);
+}
+
+/*
+  Convert (slices):
+
+  Same as above, but LoD zero is cut from slabs of slices produced by the
+  source instead of from a raw file. The slab of one layer of bricks is
+  held in memory, so it is taken from the memory limit before the cache
+  gets the rest.
+*/
+bool ExtendedOctreeConverter::Convert(SliceSource& source,
+                      ExtendedOctree::COMPONENT_TYPE eComponentType,
+                      const uint64_t iComponentCount,
+                      const UINT64VECTOR3& vVolumeSize,
+                      const DOUBLEVECTOR3& vVolumeAspect,
+                      LargeRAWFile_ptr pLargeRAWFileOut,
+                      uint64_t iOutOffset,
+                      BrickStatVec* stats,
+                      COMPRESSION_TYPE compression,
+                      uint32_t iCompressionLevel,
+                      bool bComputeMedian,
+                      bool bClampToEdge,
+                      LAYOUT_TYPE layout) {
+  ExtendedOctree e;
+  BeginConversion(e, eComponentType, iComponentCount, vVolumeSize,
+                  vVolumeAspect, pLargeRAWFileOut, iOutOffset, stats,
+                  compression, iCompressionLevel, layout);
+
+  const uint64_t iSliceSize = e.m_vVolumeSize.x * e.m_vVolumeSize.y *
+                              e.GetComponentTypeSize() * e.m_iComponentCount;
+  SetupCache(e, SlabSliceCount(e) * iSliceSize);
+
+  PermuteInputSlices(e, source, bClampToEdge);
+
+  return FinishConversion(e, bComputeMedian, bClampToEdge);
+}
+
+/*
+  BeginConversion:
+
+  Fills in the metadata of the new tree and resets the per conversion
+  state of the converter.
+*/
+void ExtendedOctreeConverter::BeginConversion(ExtendedOctree &e,
+                      ExtendedOctree::COMPONENT_TYPE eComponentType,
+                      uint64_t iComponentCount,
+                      const UINT64VECTOR3& vVolumeSize,
+                      const DOUBLEVECTOR3& vVolumeAspect,
+                      LargeRAWFile_ptr pLargeRAWFileOut,
+                      uint64_t iOutOffset,
+                      BrickStatVec* stats,
+                      COMPRESSION_TYPE compression,
+                      uint32_t iCompressionLevel,
+                      LAYOUT_TYPE layout) {
   m_pBrickStatVec = stats;
   m_fProgress = 0.0f;
   PROGRESS;
@@ -147,8 +223,6 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
   assert(vVolumeSize.volume() > 0);
   assert(vVolumeAspect.volume() > 0);
 
-  ExtendedOctree e;
-
   // compute metadata
   e.m_eComponentType = eComponentType;
   e.m_iComponentCount = iComponentCount;
@@ -163,12 +237,19 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
 
   m_eCompression = compression;
   m_eLayout = layout;
+}
 
-  SetupCache(e);
-
-  // brick (permute) the input data
-  PermuteInputData(e, pLargeRAWFileIn, iInOffset, bClampToEdge);
+/*
+  FinishConversion:
 
+  Everything after LoD zero: as the hierarchy computation involves
+  averaging we choose an appropriate template here, then the bricks are
+  compressed and (re)ordered, the header is written and the file is
+  truncated to its final length.
+*/
+bool ExtendedOctreeConverter::FinishConversion(ExtendedOctree &e,
+                                               bool bComputeMedian,
+                                               bool bClampToEdge) {
   // compute hierarchy
 
   // now comes the really nasty part where we convert the input arguments
@@ -242,6 +323,14 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
   }
   // write bricks in the cache to disk
   FlushCache(e);
+  ReleaseCache();
+  m_Progress.Other(_func_, "Brick cache: %llu of %llu reads from disk, "
+                   "%llu bricks written in %llu runs, peak memory %.2f MB",
+                   static_cast<unsigned long long>(m_CacheStats.iDiskReads),
+                   static_cast<unsigned long long>(m_CacheStats.iReads),
+                   static_cast<unsigned long long>(m_CacheStats.iDiskWrites),
+                   static_cast<unsigned long long>(m_CacheStats.iWriteRuns),
+                   double(m_CacheStats.iPeakBytes) / (1024.0*1024.0));
   {
     // we store the total octree size including header length
     // we know that the last brick in ToC must be at the end of the octree data
@@ -262,17 +351,23 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
     m_eLayout = LT_SCANLINE;
   }
 
-  if (m_eLayout != LT_SCANLINE)
+  if (m_eLayout != LT_SCANLINE) {
+    // statistics and compression dominate the reordering, so with more than
+    // one thread we do them in parallel first and only move compressed
+    // bricks around afterwards; bricks are written back to back in layout
+    // order either way, hence the file is the same
+    if (m_iThreads > 1)
+      ComputeStatsAndCompressAll(e);
     ComputeStatsCompressAndPermuteAll(e);
-  else
+  } else
     ComputeStatsAndCompressAll(e);
 
   // add header to file
-  e.WriteHeader(pLargeRAWFileOut, iOutOffset);
+  e.WriteHeader(e.m_pLargeRAWFile, e.m_iOffset);
   m_Progress.Message(_func_, "Header written, truncating file...");
 
   // remove part of the file used only for temp calculations
-  pLargeRAWFileOut->Truncate(iOutOffset + e.m_iSize);
+  e.m_pLargeRAWFile->Truncate(e.m_iOffset + e.m_iSize);
 
   m_fProgress = 1.0f;
 
@@ -282,7 +377,8 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
 /*
   GetInputBrick:
 
-  This function extracts data for a specified brick from the linear raw input file.
+  This function extracts data for a specified brick from the linear raw input file,
+  or from a slab of input slices in memory if pSlab is given.
   Index magic is explained in the function.
 */
 void ExtendedOctreeConverter::GetInputBrick(std::vector<uint8_t>& vData,
@@ -290,9 +386,12 @@ void ExtendedOctreeConverter::GetInputBrick(std::vector<uint8_t>& vData,
                                             LargeRAWFile_ptr pLargeRAWFileIn,
                                             uint64_t iInOffset, 
                                             const UINT64VECTOR4& coords,
-                                            bool bClampToEdge) {
+                                            bool bClampToEdge,
+                                            const uint8_t* pSlab,
+                                            uint64_t iSlabFirst) {
   const UINT64VECTOR3 vBrickSize = tree.ComputeBrickSize(coords);
-  const uint64_t iBricksSize = (tree.m_vTOC.end()-1)->m_iLength;
+  const uint64_t iBricksSize =
+    tree.m_vTOC[size_t(tree.BrickCoordsToIndex(coords))].m_iLength;
   if (vData.size() != size_t(iBricksSize)) vData.resize(size_t(iBricksSize));
 
   // zero out the data (this makes sure boundaries are zero)
@@ -314,48 +413,63 @@ void ExtendedOctreeConverter::GetInputBrick(std::vector<uint8_t>& vData,
   const uint64_t yEnd = vBrickSize.y - ((coords.y == bricksInZeroLevel.y-1) ? m_iOverlap : 0);
   const uint64_t zEnd = vBrickSize.z - ((coords.z == bricksInZeroLevel.z-1) ? m_iOverlap : 0);
 
-  // now iterate over the x-scanlines (as x is stored continuous in the
-  // input file we only need to loop over y and z)
-  for (uint64_t z = 0;z<zEnd-zStart;z++) {
-    for (uint64_t y = 0;y<yEnd-yStart;y++) {
-
-      // the offset into the large raw file:
-      // as usual we skip beyond the user specified iInOffset next we compute the
-      // voxel coordinates multiplied with the size of a voxel to get to bytes.
-      // The voxel coordinates are computed as follows for all but the starting bricks
-      // we fill the overlap (so step m_iOverlap steps back) from the x,y, and z positions
-      // next add the coordinates of the brick to fetch multiplied with the effective
-      // brick size (i.e. the brick size without the overlap regions on each side)
-      // then do the usual 3D to 1D conversion by multiplying y coordinates with the
-      // length of a line (tree.m_vVolumeSize.x) and the z coordinate with the size
-      // of a slice (tree.m_vVolumeSize.x * tree.m_vVolumeSize.y) since we are indexing
-      // into the input volume we need to use tree.m_vVolumeSize for this
-      const uint64_t iCurrentInOffset = iInOffset + iVoxelSize * (0-(m_iOverlap-xStart) + coords.x * (m_vBrickSize.x-m_iOverlap*2) +
-                                                         (y-(m_iOverlap-yStart) + coords.y * (m_vBrickSize.y-m_iOverlap*2)) * tree.m_vVolumeSize.x +
-                                                         (z-(m_iOverlap-zStart) + coords.z * (m_vBrickSize.z-m_iOverlap*2)) * tree.m_vVolumeSize.x * tree.m_vVolumeSize.y);
-
-      // the offset into the target array
-      // this is just a simple 3D to 1D conversion of the current position
-      // y & z plus the overlap skip (xStart, yStart, yStart) which we need
-      // to add if this is the first brick (otherwise these are all 0
-      const size_t iOutOffset = size_t(iVoxelSize * (  xStart +
-                                              (y+yStart) * vBrickSize.x +
-                                              (z+zStart) * vBrickSize.x * vBrickSize.y));
-
-      // now for the amount of data to be copied:
-      // this is a full scanline unless its the first brick
-      // or if it's the last brick (and possibly both) in those
-      // cases there exists no overlap an we shorten the line
-      uint64_t iLineSize = iMaxLineSize;
-      if (coords.x == 0) {
-        iLineSize -= m_iOverlap*iVoxelSize;
-      }
-      if (coords.x == bricksInZeroLevel.x-1)  {
-        iLineSize -= m_iOverlap*iVoxelSize;
-      }
+  // a slab is only read, so the bricks of a slab are cut without locking
+  const uint64_t iSlabOffset = iSlabFirst * tree.m_vVolumeSize.x *
+                               tree.m_vVolumeSize.y * iVoxelSize;
+  {
+    // the input file is shared by all threads, and a read is a seek followed
+    // by the actual read
+    std::unique_ptr<tuvok::ScopedLock> pLock;
+    if (!pSlab) pLock.reset(new tuvok::ScopedLock(m_InputGuard));
+
+    // now iterate over the x-scanlines (as x is stored continuous in the
+    // input file we only need to loop over y and z)
+    for (uint64_t z = 0;z<zEnd-zStart;z++) {
+      for (uint64_t y = 0;y<yEnd-yStart;y++) {
+
+        // the offset into the input volume (the user specified iInOffset
+        // is added when reading from the file):
+        // we compute the voxel coordinates multiplied with the size of a voxel to get to bytes.
+        // The voxel coordinates are computed as follows for all but the starting bricks
+        // we fill the overlap (so step m_iOverlap steps back) from the x,y, and z positions
+        // next add the coordinates of the brick to fetch multiplied with the effective
+        // brick size (i.e. the brick size without the overlap regions on each side)
+        // then do the usual 3D to 1D conversion by multiplying y coordinates with the
+        // length of a line (tree.m_vVolumeSize.x) and the z coordinate with the size
+        // of a slice (tree.m_vVolumeSize.x * tree.m_vVolumeSize.y) since we are indexing
+        // into the input volume we need to use tree.m_vVolumeSize for this
+        const uint64_t iVolumeOffset = iVoxelSize * (0-(m_iOverlap-xStart) + coords.x * (m_vBrickSize.x-m_iOverlap*2) +
+                                                           (y-(m_iOverlap-yStart) + coords.y * (m_vBrickSize.y-m_iOverlap*2)) * tree.m_vVolumeSize.x +
+                                                           (z-(m_iOverlap-zStart) + coords.z * (m_vBrickSize.z-m_iOverlap*2)) * tree.m_vVolumeSize.x * tree.m_vVolumeSize.y);
+
+        // the offset into the target array
+        // this is just a simple 3D to 1D conversion of the current position
+        // y & z plus the overlap skip (xStart, yStart, yStart) which we need
+        // to add if this is the first brick (otherwise these are all 0
+        const size_t iOutOffset = size_t(iVoxelSize * (  xStart +
+                                                (y+yStart) * vBrickSize.x +
+                                                (z+zStart) * vBrickSize.x * vBrickSize.y));
+
+        // now for the amount of data to be copied:
+        // this is a full scanline unless its the first brick
+        // or if it's the last brick (and possibly both) in those
+        // cases there exists no overlap an we shorten the line
+        uint64_t iLineSize = iMaxLineSize;
+        if (coords.x == 0) {
+          iLineSize -= m_iOverlap*iVoxelSize;
+        }
+        if (coords.x == bricksInZeroLevel.x-1)  {
+          iLineSize -= m_iOverlap*iVoxelSize;
+        }
 
-      pLargeRAWFileIn->SeekPos(iCurrentInOffset);
-      pLargeRAWFileIn->ReadRAW((uint8_t*)&vData[iOutOffset], iLineSize);
+        if (pSlab) {
+          memcpy(&vData[iOutOffset], pSlab + (iVolumeOffset - iSlabOffset),
+                 size_t(iLineSize));
+        } else {
+          pLargeRAWFileIn->SeekPos(iInOffset + iVolumeOffset);
+          pLargeRAWFileIn->ReadRAW((uint8_t*)&vData[iOutOffset], iLineSize);
+        }
+      }
     }
   }
 
@@ -463,106 +577,155 @@ void ExtendedOctreeConverter::ClampToEdge(std::vector<uint8_t>& vData,
 
 /// Computes max min statistics for each brick and rewrites 
 /// it using compression, if desired.
+/// The bricks are processed in batches: a batch is read from disk, then the
+/// statistics and compression of its bricks are computed in parallel, and
+/// finally the bricks are written back in index order. A brick never grows
+/// when it is rewritten, so it always lands in front of the bricks that have
+/// not been read yet.
 void ExtendedOctreeConverter::ComputeStatsAndCompressAll(ExtendedOctree& tree)
 {
   FlushCache(tree); // be sure we've got everything on disk.
-  m_vBrickCache.clear(); // be double sure we don't use the cache anymore.
+  ReleaseCache(); // be double sure we don't use the cache anymore.
 
+  Timer timer;
+  timer.Start();
+  double t1 = m_pProgressTimer->Elapsed();
+
+  const size_t iBrickCount = tree.m_vTOC.size();
   const size_t iVoxelSize = tree.GetComponentTypeSize() *
                             size_t(tree.m_iComponentCount);
   const size_t maxbricksize = static_cast<size_t>(tree.m_iBrickSize.volume() *
                                                   iVoxelSize);
-  std::shared_ptr<uint8_t> BrickData(new uint8_t[maxbricksize],
-                                     nonstd::DeleteArray<uint8_t>());
-  std::shared_ptr<uint8_t> compressed(new uint8_t[maxbricksize],
-                                      nonstd::DeleteArray<uint8_t>());
-
-  size_t iReportInterval = std::max<size_t>(1, tree.m_vTOC.size()/2000);
-
-  if(m_eCompression == CT_NONE) {
-    // compression is disabled.  That makes our job pretty easy: only compute
-    // the brick stats
-    for(size_t i=0; i < tree.m_vTOC.size(); ++i) {
-      tree.GetBrickData(BrickData.get(), i);
-      BrickStat(m_pBrickStatVec, i, BrickData.get(), BrickSize(tree, i),
-                tree.m_iComponentCount, tree.m_eComponentType);
-
-      if (i % iReportInterval == 0) {
-        m_fProgress = float(i) / tree.m_vTOC.size();
-        std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
-        m_Progress.Message(_func_, "Statistic computation ... %5.2f%% (%s)",
-                           m_fProgress*100.0f, msg.c_str());
-      }
+  const size_t iBatchSize = size_t(std::min<uint64_t>(BatchSize(tree),
+                                                      iBrickCount));
+
+  std::vector<std::shared_ptr<uint8_t>> vBrickData(iBatchSize);
+  std::vector<std::shared_ptr<uint8_t>> vCompressed(iBatchSize);
+  std::vector<uint64_t> vCompressedLength(iBatchSize, 0);
+  for (size_t j = 0; j < iBatchSize; ++j) {
+    vBrickData[j].reset(new uint8_t[maxbricksize],
+                        nonstd::DeleteArray<uint8_t>());
+  }
+
+  // the workers store their results directly, so the statistics
+  // vector must not be resized while they are running
+  assert(m_pBrickStatVec);
+  if (m_pBrickStatVec->size() < iBrickCount * tree.m_iComponentCount)
+    m_pBrickStatVec->resize(iBrickCount * size_t(tree.m_iComponentCount));
+
+  uint64_t iBytes = 0;
+  for (size_t iFirst = 0; iFirst < iBrickCount; iFirst += iBatchSize) {
+    const size_t iCount = std::min(iBatchSize, iBrickCount - iFirst);
+
+    // all bricks live in one file, so reading is done in order by this thread
+    for (size_t j = 0; j < iCount; ++j) {
+      tree.GetBrickData(vBrickData[j].get(), iFirst + j);
+      iBytes += BrickSize(tree, iFirst + j);
     }
-  } else {
-    std::array<uint8_t, 5> lzmaProps;
 
-    // foreach brick:
-    //   load it up
+    // foreach brick of the batch:
+    //   compute its statistics
     //   compress it
-    //   write compressed payload
-    //   update brick metadata based on what compression changed
-    for(size_t i=0; i < tree.m_vTOC.size(); ++i) {
-      tree.GetBrickData(BrickData.get(), i);
-      BrickStat(m_pBrickStatVec, i, BrickData.get(), BrickSize(tree, i),
-                tree.m_iComponentCount, tree.m_eComponentType);
-
-      uint64_t newlen = 0;
-      switch (m_eCompression) {
-      case CT_ZLIB:
-        newlen = zCompress(BrickData, BrickSize(tree, i), compressed,
-                           tree.m_iCompressionLevel); // 0..9 (0 no comp)
-        break;
-      case CT_LZMA:
-        newlen = lzmaCompress(BrickData, BrickSize(tree, i), compressed,
-                              lzmaProps, tree.m_iCompressionLevel - 1); // 0..9
-        assert(lzmaProps == tree.m_lzmaProps);
-        break;
-      case CT_LZ4:
-        newlen = lz4Compress(BrickData, BrickSize(tree, i), compressed,
-                             tree.m_iCompressionLevel); // 1..17
-        break;
-      case CT_BZLIB:
-        newlen = bzCompress(BrickData, BrickSize(tree, i), compressed,
-                            tree.m_iCompressionLevel); // 1..9
-        break;
-      case CT_LZHAM:
-        throw std::runtime_error("lzham compression format is not supported anymore by Tuvok");
-        break;
-      default:
-        throw std::runtime_error("unknown compression format");
-      }
-      std::shared_ptr<uint8_t> data;
-
-      if(newlen < BrickSize(tree, i)) {
-        tree.m_vTOC[i].m_iLength = newlen;
-        tree.m_vTOC[i].m_eCompression = m_eCompression;
-        data = compressed;
-      } else {
-        tree.m_vTOC[i].m_iLength = BrickSize(tree, i);
-        tree.m_vTOC[i].m_eCompression = CT_NONE;
-        data = BrickData;
-      }
-      if(i > 0) {
-        tree.m_vTOC[i].m_iOffset = tree.m_vTOC[i-1].m_iOffset +
-                                   tree.m_vTOC[i-1].m_iLength;
+    std::exception_ptr pError;
+#pragma omp parallel for schedule(dynamic) num_threads(m_iThreads)
+    for (int j = 0; j < int(iCount); ++j) {
+      const size_t i = iFirst + size_t(j);
+      try {
+        BrickStat(m_pBrickStatVec, i, vBrickData[j].get(), BrickSize(tree, i),
+                  tree.m_iComponentCount, tree.m_eComponentType);
+        if (m_eCompression != CT_NONE) {
+          vCompressedLength[j] = CompressBrick(tree, vBrickData[j],
+                                               BrickSize(tree, i),
+                                               vCompressed[j]);
+        }
+      } catch (...) {
+#pragma omp critical (ExtendedOctreeConverterError)
+        {
+          if (!pError) pError = std::current_exception();
+        }
       }
-      tree.m_pLargeRAWFile->SeekPos(tree.m_vTOC[i].m_iOffset);
-      tree.m_pLargeRAWFile->WriteRAW(data.get(), tree.m_vTOC[i].m_iLength);
-      
-      if (i % iReportInterval == 0) {
-        m_fProgress = float(i) / tree.m_vTOC.size();
-        std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
-        m_Progress.Message(_func_, "Statistics and compression .. %5.2f%% (%s)",
-                           m_fProgress*100.0f, msg.c_str());
+    }
+    if (pError) std::rethrow_exception(pError);
+
+    // write compressed payloads in index order and update the brick
+    // metadata based on what compression changed
+    if (m_eCompression != CT_NONE) {
+      for (size_t j = 0; j < iCount; ++j) {
+        const size_t i = iFirst + j;
+        std::shared_ptr<uint8_t> data;
+
+        if(vCompressedLength[j] < BrickSize(tree, i)) {
+          tree.m_vTOC[i].m_iLength = vCompressedLength[j];
+          tree.m_vTOC[i].m_eCompression = m_eCompression;
+          data = vCompressed[j];
+        } else {
+          tree.m_vTOC[i].m_iLength = BrickSize(tree, i);
+          tree.m_vTOC[i].m_eCompression = CT_NONE;
+          data = vBrickData[j];
+        }
+        if(i > 0) {
+          tree.m_vTOC[i].m_iOffset = tree.m_vTOC[i-1].m_iOffset +
+                                     tree.m_vTOC[i-1].m_iLength;
+        }
+        tree.m_pLargeRAWFile->SeekPos(tree.m_vTOC[i].m_iOffset);
+        tree.m_pLargeRAWFile->WriteRAW(data.get(), tree.m_vTOC[i].m_iLength);
+        vCompressed[j].reset();
       }
     }
+
+    // Do not update display more than twice in a second!
+    const double t2 = m_pProgressTimer->Elapsed();
+    if ((t2 - t1) > 500) {
+      t1 = t2;
+      m_fProgress = float(iFirst + iCount) / iBrickCount;
+      std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+      m_Progress.Message(_func_, "%s ... %5.2f%% (%s)",
+                         m_eCompression == CT_NONE
+                           ? "Statistic computation"
+                           : "Statistics and compression",
+                         m_fProgress*100.0f, msg.c_str());
+    }
   }
 
+  ReportThroughput(m_eCompression == CT_NONE ? "Statistic computation"
+                                             : "Statistics and compression",
+                   iBrickCount, iBytes, timer.Elapsed());
+
   // do not forget to set new octree size
   tree.m_iSize = tree.m_vTOC.back().m_iOffset + tree.m_vTOC.back().m_iLength;
 }
 
+uint64_t ExtendedOctreeConverter::CompressBrick(
+  const ExtendedOctree& tree, std::shared_ptr<uint8_t> pData,
+  uint64_t iLength, std::shared_ptr<uint8_t>& pCompressed) const
+{
+  // *Compress will always create a buffer sized like the input data
+  switch (m_eCompression) {
+  case CT_ZLIB:
+    return zCompress(pData, size_t(iLength), pCompressed,
+                     tree.m_iCompressionLevel); // 0..9 (0 no comp)
+  case CT_LZMA: {
+    // we only use the encoded props for safety checks
+    // they should be identical for all bricks of the tree
+    std::array<uint8_t, 5> props;
+    const uint64_t iCompressed = lzmaCompress(pData, size_t(iLength),
+                                              pCompressed, props,
+                                              tree.m_iCompressionLevel - 1); // 0..9
+    assert(props == tree.m_lzmaProps);
+    return iCompressed; }
+  case CT_LZ4:
+    return lz4Compress(pData, size_t(iLength), pCompressed,
+                       tree.m_iCompressionLevel); // 1..17
+  case CT_BZLIB:
+    return bzCompress(pData, size_t(iLength), pCompressed,
+                      tree.m_iCompressionLevel); // 1..9
+  case CT_LZHAM:
+    throw std::runtime_error("lzham compression format is not supported anymore by Tuvok");
+  default:
+    throw std::runtime_error("unknown compression format");
+  }
+}
+
 std::shared_ptr<uint8_t>
 ExtendedOctreeConverter::Fetch(ExtendedOctree& tree,
                                uint64_t iIndex,
@@ -588,35 +751,8 @@ ExtendedOctreeConverter::Fetch(ExtendedOctree& tree,
     // compress if desired
     if (m_eCompression != CT_NONE) {
       std::shared_ptr<uint8_t> pCompressed;
-      // *Compress will always create a buffer sized like the input data
-      uint64_t iCompressed = 0;
-      switch (m_eCompression) {
-      case CT_ZLIB:
-        iCompressed = zCompress(pData, record.m_iLength, pCompressed,
-                                tree.m_iCompressionLevel); // 0..9 (0 no comp)
-        break;
-      case CT_LZMA: {
-        // we only use the encoded props for safety checks
-        // they should be identical for all bricks of the tree
-        std::array<uint8_t, 5> props;
-        iCompressed = lzmaCompress(pData, record.m_iLength, pCompressed,
-                                   props, tree.m_iCompressionLevel - 1); // 0..9
-        assert(props == tree.m_lzmaProps);
-        break; }
-      case CT_LZ4:
-        iCompressed = lz4Compress(pData, record.m_iLength, pCompressed,
-                                  tree.m_iCompressionLevel); // 1..17
-        break;
-      case CT_BZLIB:
-        iCompressed = bzCompress(pData, record.m_iLength, pCompressed,
-                                 tree.m_iCompressionLevel); // 1..9
-        break;
-      case CT_LZHAM:
-        throw std::runtime_error("lzham compression format is not supported anymore by Tuvok");
-        break;
-      default:
-        throw std::runtime_error("unknown compression format");
-      }
+      uint64_t iCompressed = CompressBrick(tree, pData, record.m_iLength,
+                                           pCompressed);
       if (iCompressed < record.m_iLength) {
         if (!pBuffer) {
           pData.reset(new uint8_t[iCompressed], nonstd::DeleteArray<uint8_t>());
@@ -634,7 +770,10 @@ ExtendedOctreeConverter::Fetch(ExtendedOctree& tree,
 void ExtendedOctreeConverter::ComputeStatsCompressAndPermuteAll(ExtendedOctree& tree)
 {
   FlushCache(tree); // be sure we've got everything on disk.
-  m_vBrickCache.clear(); // be double sure we don't use the cache anymore.
+  ReleaseCache(); // be double sure we don't use the cache anymore.
+
+  Timer timer;
+  timer.Start();
 
   size_t const iVoxelSize = tree.GetComponentTypeSize() * size_t(tree.m_iComponentCount);
   size_t const iMaxBrickSize = static_cast<size_t>(tree.m_iBrickSize.volume() * iVoxelSize);
@@ -645,6 +784,11 @@ void ExtendedOctreeConverter::ComputeStatsCompressAndPermuteAll(ExtendedOctree&
 
   uint64_t const treeOffset = tree.ComputeHeaderSize();
   uint64_t tempOffset = tree.GetSize();
+
+  // the bricks may have been compressed already, see Convert
+  uint64_t iUncompressedSize = treeOffset;
+  for (size_t i = 0; i < tree.m_vTOC.size(); ++i)
+    iUncompressedSize += BrickSize(tree, i);
   uint64_t writeOffset = treeOffset;
   uint64_t emptyLength = 0;
 
@@ -857,10 +1001,12 @@ void ExtendedOctreeConverter::ComputeStatsCompressAndPermuteAll(ExtendedOctree&
   } // level loop
 
   uint64_t const temporarySpace = tempOffset - tree.m_iSize;
-  uint64_t const compressionGain = tree.m_iSize - writeOffset;
+  uint64_t const compressionGain = iUncompressedSize - writeOffset;
 
   m_Progress.Other(_func_, "Temporary disk space required during brick reordering: %.3f MB", (float)temporarySpace / (1024.f*1024.f));
-  m_Progress.Other(_func_, "Space savings due to data compression: %.2f%%", (100.f - ((float)compressionGain / tree.m_iSize) * 100.f));
+  m_Progress.Other(_func_, "Space savings due to data compression: %.2f%%", (100.f - ((float)compressionGain / iUncompressedSize) * 100.f));
+  ReportThroughput("Brick reordering", tree.m_vTOC.size(),
+                   iUncompressedSize - treeOffset, timer.Elapsed());
 
   // do not forget to set new octree size
   tree.m_iSize = writeOffset;
@@ -877,8 +1023,9 @@ void ExtendedOctreeConverter::ComputeStatsCompressAndPermuteAll(ExtendedOctree&
 */
 void ExtendedOctreeConverter::SetBrick(uint8_t* pData, ExtendedOctree &tree,
                                       const UINT64VECTOR4& vBrickCoords,
-                                      bool bForceWrite) {
-  SetBrick(pData, tree, tree.BrickCoordsToIndex(vBrickCoords), bForceWrite);
+                                      uint64_t iStep, bool bForceWrite) {
+  SetBrick(pData, tree, tree.BrickCoordsToIndex(vBrickCoords), iStep,
+           bForceWrite);
 }
 
 /*
@@ -888,55 +1035,104 @@ void ExtendedOctreeConverter::SetBrick(uint8_t* pData, ExtendedOctree &tree,
   turns them into a 1D index and calls the scalar GetBrick
 */
 void ExtendedOctreeConverter::GetBrick(uint8_t* pData, ExtendedOctree &tree,
-                                       const UINT64VECTOR4& vBrickCoords) {
-  GetBrick(pData, tree, tree.BrickCoordsToIndex(vBrickCoords));
+                                       const UINT64VECTOR4& vBrickCoords,
+                                       uint64_t iStep) {
+  GetBrick(pData, tree, tree.BrickCoordsToIndex(vBrickCoords), iStep);
 }
 
 /*
   SetupCache:
 
-  Computes the size of the cache: simply as available size divided
-  by the size of a cache element
+  Splits the memory limit between the worker threads and the cache. While
+  the tree is built every thread holds up to two bricks of its own (see
+  ComputeHierarchy), if these alone do not fit into the limit we use fewer
+  threads. Input held in memory (see PermuteInputSlices) counts as work
+  memory too. Whatever remains is the cache: as many bricks as fit, including
+  the bookkeeping of each entry. The order in which the bricks will be
+  accessed is fixed by the tree layout, so we compute it up front.
 */
-void ExtendedOctreeConverter::SetupCache(ExtendedOctree &tree) {
+void ExtendedOctreeConverter::SetupCache(ExtendedOctree &tree,
+                                         uint64_t iInputBytes) {
   size_t CacheElementDataSize = size_t(tree.GetComponentTypeSize() * 
                                 tree.GetComponentCount() * 
                                 tree.m_iBrickSize.volume());
-  uint64_t iCacheElemCount = m_iMemLimit / (CacheElementDataSize + sizeof(CacheEntry));
+
+  const uint64_t iMaxThreads = std::max<uint64_t>(1,
+    m_iMemLimit / (2 * CacheElementDataSize));
+  if (iMaxThreads < m_iThreads) {
+    m_Progress.Warning(_func_, "Memory limit of %llu bytes is too small for "
+                       "%u threads, using %u", 
+                       static_cast<unsigned long long>(m_iMemLimit),
+                       m_iThreads, unsigned(iMaxThreads));
+    m_iThreads = unsigned(iMaxThreads);
+  }
+  m_iWorkBytes = 2 * CacheElementDataSize * m_iThreads + iInputBytes;
+
+  // entry, hash node and tree node of each cached brick
+  const uint64_t iEntryOverhead = sizeof(CacheEntry) + 8 * sizeof(void*) +
+                                  3 * sizeof(uint64_t);
+  const uint64_t iCacheMem = m_iMemLimit > m_iWorkBytes
+                             ? m_iMemLimit - m_iWorkBytes : 0;
+  uint64_t iCacheElemCount = iCacheMem / (CacheElementDataSize + iEntryOverhead);
   iCacheElemCount = std::min(iCacheElemCount, tree.ComputeBrickCount());
-  m_vBrickCache.resize(size_t(iCacheElemCount));
 
-  for (BrickCacheIter i = m_vBrickCache.begin();i != m_vBrickCache.end();++i) {
-    i->SetSize(CacheElementDataSize);
+  ReleaseCache();
+  m_vBrickCache.resize(size_t(iCacheElemCount));
+  for (size_t i = 0;i<m_vBrickCache.size();++i) {
+    m_vBrickCache[i].SetSize(CacheElementDataSize);
+    m_vFreeSlots.push_back(m_vBrickCache.size()-1-i);
   }
+
+  std::vector<UINT64VECTOR3> vBrickCounts;
+  for (uint64_t i = 0;i<tree.GetLODCount();++i)
+    vBrickCounts.push_back(tree.GetBrickCount(i));
+  m_Schedule = OctreeBuildSchedule(vBrickCounts);
+
+  m_iCacheAccessCounter = 0;
+  m_CacheStats = CacheStats();
+  m_CacheStats.iPeakBytes = m_iWorkBytes;
 }
 
 /*
   FlushCache:
 
-  Write all bricks to disk that have not been committed yet
+  Write all bricks to disk that have not been committed yet, in the order
+  they are stored on disk so that neighboring bricks go out in one run
 */
 void ExtendedOctreeConverter::FlushCache(ExtendedOctree &tree) {
   double t1 = m_pProgressTimer->Elapsed();
 
-  for (BrickCacheIter i = m_vBrickCache.begin();i != m_vBrickCache.end();++i) {
-    if (i->m_bDirty) {
-      WriteBrickToDisk(tree, i);
-      m_fProgress = -std::distance(i, m_vBrickCache.begin()) /
-                     float(m_vBrickCache.size());
-
-      // Do not update display more than twice in a second!
-      const double t2 = m_pProgressTimer->Elapsed();
-      if ((t2 - t1) > 500) {
-        t1 = t2;
-        const std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
-        m_Progress.Message(_func_, "Flushing brick cache ... %5.2f%% (%s)",
-                           m_fProgress*100.0f, msg.c_str());
-      }
+  std::vector<std::pair<size_t, size_t>> vDirty;
+  for (size_t i = 0;i<m_vBrickCache.size();++i) {
+    if (m_vBrickCache[i].m_bDirty)
+      vDirty.push_back(std::make_pair(m_vBrickCache[i].m_index, i));
+  }
+  std::sort(vDirty.begin(), vDirty.end());
+
+  for (size_t i = 0;i<vDirty.size();++i) {
+    if (!m_vBrickCache[vDirty[i].second].m_bDirty) continue;
+    WriteBrickRun(tree, vDirty[i].second);
+    m_fProgress = float(i) / float(vDirty.size());
+
+    // Do not update display more than twice in a second!
+    const double t2 = m_pProgressTimer->Elapsed();
+    if ((t2 - t1) > 500) {
+      t1 = t2;
+      const std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+      m_Progress.Message(_func_, "Flushing brick cache ... %5.2f%% (%s)",
+                         m_fProgress*100.0f, msg.c_str());
     }
   }
 }
 
+void ExtendedOctreeConverter::ReleaseCache() {
+  m_vBrickCache.clear();
+  m_CacheSlots.clear();
+  m_EvictionOrder.clear();
+  m_vFreeSlots.clear();
+  m_iCacheBytes = 0;
+}
+
 // @returns the number of bytes needed to store the (uncompressed) given brick.
 uint64_t ExtendedOctreeConverter::BrickSize(const ExtendedOctree& tree,
                                             uint64_t index) {
@@ -999,12 +1195,6 @@ void ExtendedOctreeConverter::BrickStat(
     (*bs)[index*components+c] = elem[c];
 }
 
-void ExtendedOctreeConverter::WriteBrickToDisk(ExtendedOctree &tree, BrickCacheIter element)
-{
-  WriteBrickToDisk(tree, element->m_pData, element->m_index);
-  element->m_bDirty = false;
-}
-
 void ExtendedOctreeConverter::WriteBrickToDisk(ExtendedOctree &tree, uint8_t* pData, size_t index)
 {
   tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset+tree.m_vTOC[index].m_iOffset);
@@ -1016,18 +1206,110 @@ void ExtendedOctreeConverter::WriteBrickToDisk(ExtendedOctree &tree, uint8_t* pD
 }
 
 /*
-  HasIndex:
+  CachePriority:
+
+  With the optimal strategy the key is the next step that needs the brick,
+  so the brick needed furthest in the future is evicted first. For LRU the
+  key decreases with every access so that the oldest access is evicted.
+*/
+uint64_t ExtendedOctreeConverter::CachePriority(uint64_t index,
+                                                uint64_t iStep) {
+  if (m_eCachePolicy == CP_LRU)
+    return OctreeBuildSchedule::NEVER - (++m_iCacheAccessCounter);
+  return m_Schedule.NextUse(index, iStep);
+}
+
+bool ExtendedOctreeConverter::ShouldCache(uint64_t iPriority,
+                                          bool bDirty) const {
+  if (m_eCachePolicy == CP_LRU) return true;
+  if (iPriority == OctreeBuildSchedule::NEVER && !bDirty) return false;
+  return !m_vFreeSlots.empty() || iPriority < m_EvictionOrder.rbegin()->first;
+}
+
+size_t ExtendedOctreeConverter::AcquireCacheSlot(ExtendedOctree &tree) {
+  size_t iSlot;
+  if (!m_vFreeSlots.empty()) {
+    iSlot = m_vFreeSlots.back();
+    m_vFreeSlots.pop_back();
+  } else {
+    iSlot = m_EvictionOrder.rbegin()->second;
+    CacheEntry& victim = m_vBrickCache[iSlot];
+    if (victim.m_bDirty) WriteBrickRun(tree, iSlot);
+    m_EvictionOrder.erase(std::make_pair(victim.m_iPriority, iSlot));
+    m_CacheSlots.erase(victim.m_index);
+  }
+
+  CacheEntry& entry = m_vBrickCache[iSlot];
+  if (entry.m_pData == NULL) {
+    // if this is a never before used cache entry allocate memory
+    entry.Allocate();
+    m_iCacheBytes += entry.GetSize();
+    m_CacheStats.iPeakBytes = std::max(m_CacheStats.iPeakBytes,
+                                       m_iCacheBytes + m_iWorkBytes);
+  }
+  return iSlot;
+}
+
+void ExtendedOctreeConverter::TouchCacheSlot(size_t iSlot,
+                                             uint64_t iPriority) {
+  CacheEntry& entry = m_vBrickCache[iSlot];
+  m_EvictionOrder.erase(std::make_pair(entry.m_iPriority, iSlot));
+  if (iPriority == OctreeBuildSchedule::NEVER && !entry.m_bDirty) {
+    // never needed again and the disk copy is up to date
+    m_CacheSlots.erase(entry.m_index);
+    m_vFreeSlots.push_back(iSlot);
+    return;
+  }
+  entry.m_iPriority = iPriority;
+  m_EvictionOrder.insert(std::make_pair(iPriority, iSlot));
+}
+
+/*
+  WriteBrickRun:
 
-  Function used for find_if, returns true iff a cache entry has a certain index
+  While the tree is built the bricks are uncompressed and stored back to
+  back in index order (see AppendLoDToToC), so bricks with adjacent indices
+  are adjacent on disk. Instead of seeking to every brick we extend the
+  brick to the longest run of dirty cached neighbors and write it in one go.
 */
-struct HasIndex :
-  public std::binary_function<ExtendedOctreeConverter::CacheEntry,
-                              uint64_t, bool> {
-  bool operator()(const ExtendedOctreeConverter::CacheEntry& cacheEntry,
-                  uint64_t index) const {
-    return cacheEntry.m_index == index;
+void ExtendedOctreeConverter::WriteBrickRun(ExtendedOctree &tree,
+                                            size_t iSlot) {
+  const size_t index = m_vBrickCache[iSlot].m_index;
+
+  std::vector<size_t> vRun(1, iSlot);
+  for (size_t i = index; i > 0; --i) {
+    std::unordered_map<uint64_t, size_t>::const_iterator prev =
+      m_CacheSlots.find(i-1);
+    if (prev == m_CacheSlots.end() || !m_vBrickCache[prev->second].m_bDirty ||
+        tree.m_vTOC[i-1].m_iOffset + BrickSize(tree, i-1) !=
+        tree.m_vTOC[i].m_iOffset)
+      break;
+    vRun.push_back(prev->second);
+  }
+  std::reverse(vRun.begin(), vRun.end());
+  for (size_t i = index+1; i < tree.m_vTOC.size(); ++i) {
+    std::unordered_map<uint64_t, size_t>::const_iterator next =
+      m_CacheSlots.find(i);
+    if (next == m_CacheSlots.end() || !m_vBrickCache[next->second].m_bDirty ||
+        tree.m_vTOC[i-1].m_iOffset + BrickSize(tree, i-1) !=
+        tree.m_vTOC[i].m_iOffset)
+      break;
+    vRun.push_back(next->second);
   }
-};
+
+  const size_t iFirst = m_vBrickCache[vRun.front()].m_index;
+  tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset+tree.m_vTOC[iFirst].m_iOffset);
+  for (size_t i = 0;i<vRun.size();++i) {
+    CacheEntry& entry = m_vBrickCache[vRun[i]];
+    TOCEntry& toc = tree.m_vTOC[entry.m_index];
+    toc.m_iLength = BrickSize(tree, entry.m_index);
+    toc.m_eCompression = CT_NONE;
+    tree.m_pLargeRAWFile->WriteRAW(entry.m_pData, toc.m_iLength);
+    entry.m_bDirty = false;
+  }
+  m_CacheStats.iDiskWrites += vRun.size();
+  ++m_CacheStats.iWriteRuns;
+}
 
 /*
   GetBrick:
@@ -1035,51 +1317,45 @@ struct HasIndex :
   Retrieves a brick from the tree. First we check if the cache is
   enabled, if not we simply request the brick from the tree. Otherwise
   we check the cache and, if we have a hit, return the cache copy
-  otherwise we fetch the data from disk and put a copy into the cache,
-  therefore we search for a suitable cache entry (the entry with the
-  oldest access counter). In either case (hit or miss) we update the
-  access counter, i.e. we use true LRU as caching strategy. */
+  otherwise we fetch the data from disk and put a copy into the cache
+  unless the brick would be the next to be evicted anyway. Which brick
+  to evict is decided by the key from CachePriority.
+  The cache is shared by all worker threads, hence the lock. */
 void ExtendedOctreeConverter::GetBrick(uint8_t* pData, ExtendedOctree &tree,
-                                       uint64_t index) {
+                                       uint64_t index, uint64_t iStep) {
+  SCOPEDLOCK(m_CacheGuard);
+  ++m_CacheStats.iReads;
   if (m_vBrickCache.empty()) {
+    ++m_CacheStats.iDiskReads;
     tree.GetBrickData(pData, index);
     return;
   }
 
-  BrickCacheIter cacheEntry = std::find_if(m_vBrickCache.begin(), m_vBrickCache.end(), std::bind2nd(HasIndex(), index));
+  const uint64_t iPriority = CachePriority(index, iStep);
+  std::unordered_map<uint64_t, size_t>::const_iterator cached =
+    m_CacheSlots.find(index);
 
-  if (cacheEntry == m_vBrickCache.end()) {
+  if (cached == m_CacheSlots.end()) {
     // cache miss
-
-    // read data from disk
+    ++m_CacheStats.iDiskReads;
     tree.GetBrickData(pData, index);
-
-    // find cache entry to evict from cache
-    cacheEntry = m_vBrickCache.begin();
-    for (BrickCacheIter i = m_vBrickCache.begin();i != m_vBrickCache.end();++i) {
-      if (i->m_iAccess < cacheEntry->m_iAccess)
-        cacheEntry = i;
-    }
-
-    if (cacheEntry->m_iAccess == 0) {
-      // if this is a never before used cache entry allocate memory
-      cacheEntry->Allocate();
-    } else {
-      // if it's dirty, write to disk
-      if (cacheEntry->m_bDirty) WriteBrickToDisk(tree, cacheEntry);
-    }
-    uint64_t uncompressedLength = BrickSize(tree, index);
+    if (!ShouldCache(iPriority, false)) return;
 
     // put new entry into cache
-    cacheEntry->m_bDirty = false;
-    cacheEntry->m_index = size_t(index);
-    cacheEntry->m_iAccess = ++m_iCacheAccessCounter;
-    memcpy(cacheEntry->m_pData, pData, size_t(uncompressedLength));
+    const size_t iSlot = AcquireCacheSlot(tree);
+    CacheEntry& entry = m_vBrickCache[iSlot];
+    entry.m_bDirty = false;
+    entry.m_index = size_t(index);
+    entry.m_iPriority = iPriority;
+    memcpy(entry.m_pData, pData, size_t(BrickSize(tree, index)));
+    m_CacheSlots[index] = iSlot;
+    m_EvictionOrder.insert(std::make_pair(iPriority, iSlot));
   } else {
     // cache hit
-    uint64_t uncompressedLength = BrickSize(tree, cacheEntry->m_index);
-    memcpy(pData, cacheEntry->m_pData, size_t(uncompressedLength));
-    cacheEntry->m_iAccess = ++m_iCacheAccessCounter;
+    const size_t iSlot = cached->second;
+    memcpy(pData, m_vBrickCache[iSlot].m_pData,
+           size_t(BrickSize(tree, index)));
+    TouchCacheSlot(iSlot, iPriority);
   }
 }
 
@@ -1088,62 +1364,57 @@ void ExtendedOctreeConverter::GetBrick(uint8_t* pData, ExtendedOctree &tree,
 
   Writes a brick to the tree. First we check if the cache is enabled, if not we simply write out
   the brick to disk. Otherwise we check the cache and, if we have a hit, write into the cache copy
-  otherwise we search for a suitable cache entry (the entry with the oldest access counter).
-  In either case (hit or miss) we update the access counter, i.e. we use true LRU as caching strategy.
+  otherwise we take a cache entry as in GetBrick, or write straight to disk if the brick is not
+  worth caching.
   If bForceWrite is enabled we write the data to disk directly bypassing the write cache, if in this
   case a cache miss occurs we only write to disk and don't update the cache in a cache hit case we update
   the data and write to disk.
+  As GetBrick, this may be called from several worker threads at once.
 */
-void ExtendedOctreeConverter::SetBrick(uint8_t* pData, ExtendedOctree &tree, uint64_t index, bool bForceWrite) {
-  if (m_vBrickCache.empty()) {
-    WriteBrickToDisk(tree, pData, size_t(index));
-    return;
-  }
-
-  BrickCacheIter cacheEntry = std::find_if(m_vBrickCache.begin(), m_vBrickCache.end(), std::bind2nd(HasIndex(), index));
-
+void ExtendedOctreeConverter::SetBrick(uint8_t* pData, ExtendedOctree &tree,
+                                       uint64_t index, uint64_t iStep,
+                                       bool bForceWrite) {
+  SCOPEDLOCK(m_CacheGuard);
   tree.m_vTOC[size_t(index)].m_iLength =
     tree.ComputeBrickSize(tree.IndexToBrickCoords(index)).volume() *
     tree.GetComponentTypeSize() *
     tree.GetComponentCount();
-  if (cacheEntry == m_vBrickCache.end()) {
-    // cache miss
 
-    if (bForceWrite) {
+  const uint64_t iPriority = m_vBrickCache.empty()
+                             ? 0 : CachePriority(index, iStep);
+  std::unordered_map<uint64_t, size_t>::const_iterator cached =
+    m_CacheSlots.find(index);
+
+  if (cached == m_CacheSlots.end()) {
+    // cache miss
+    if (m_vBrickCache.empty() || bForceWrite ||
+        !ShouldCache(iPriority, true)) {
       WriteBrickToDisk(tree, pData, size_t(index));
+      ++m_CacheStats.iDiskWrites;
+      ++m_CacheStats.iWriteRuns;
       return;
     }
 
-    // find cache entry to evict from cache
-    cacheEntry = m_vBrickCache.begin();
-    for (BrickCacheIter i = m_vBrickCache.begin();i != m_vBrickCache.end();++i) {
-      if (i->m_iAccess < cacheEntry->m_iAccess)
-        cacheEntry = i;
-    }
-
-    if (cacheEntry->m_iAccess == 0) {
-      // if this is a never before used cache entry allocate memory
-      cacheEntry->Allocate();
-    } else {
-      // if it's dirty, write to disk
-      if (cacheEntry->m_bDirty) WriteBrickToDisk(tree, cacheEntry);
-    }
-
     // put new entry into cache
-    cacheEntry->m_bDirty = true;
-    cacheEntry->m_index = size_t(index);
-    cacheEntry->m_iAccess = ++m_iCacheAccessCounter;
-    memcpy(cacheEntry->m_pData, pData, size_t(tree.m_vTOC[cacheEntry->m_index].m_iLength));
+    const size_t iSlot = AcquireCacheSlot(tree);
+    CacheEntry& entry = m_vBrickCache[iSlot];
+    entry.m_bDirty = true;
+    entry.m_index = size_t(index);
+    entry.m_iPriority = iPriority;
+    memcpy(entry.m_pData, pData, size_t(tree.m_vTOC[size_t(index)].m_iLength));
+    m_CacheSlots[index] = iSlot;
+    m_EvictionOrder.insert(std::make_pair(iPriority, iSlot));
   } else {
     // cache hit
-    cacheEntry->m_bDirty = true;
-    cacheEntry->m_iAccess = ++m_iCacheAccessCounter;
-    memcpy(cacheEntry->m_pData, pData, size_t(tree.m_vTOC[size_t(index)].m_iLength));
-    if (bForceWrite) WriteBrickToDisk(tree, cacheEntry);
+    const size_t iSlot = cached->second;
+    m_vBrickCache[iSlot].m_bDirty = true;
+    memcpy(m_vBrickCache[iSlot].m_pData, pData,
+           size_t(tree.m_vTOC[size_t(index)].m_iLength));
+    if (bForceWrite) WriteBrickRun(tree, iSlot);
+    TouchCacheSlot(iSlot, iPriority);
   }
 }
 
-
 /*
   CopyBrickToBrick:
 
@@ -1226,13 +1497,15 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
 
         UINT64VECTOR4 coords(x,y,z,iLoD);
         UINT64VECTOR3 targetBrickSize = tree.ComputeBrickSize(coords);
-        GetBrick(&vTargetData[0], tree,  coords);
+        const uint64_t iStep =
+          m_Schedule.FillStep(tree.BrickCoordsToIndex(coords));
+        GetBrick(&vTargetData[0], tree, coords, iStep);
 
         // first the six direct neighbors
         if (bHasRightNeighbour) {
           UINT64VECTOR4 sourceCoords(x+1,y,z,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(tree.m_iOverlap,0,0), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,0,0),
@@ -1242,7 +1515,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasBottomNeighbour) {
           UINT64VECTOR4 sourceCoords(x,y+1,z,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(0,tree.m_iOverlap,0), UINT64VECTOR3(0,targetBrickSize.y-tree.m_iOverlap,0),
@@ -1252,7 +1525,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasBackNeighbour) {
           UINT64VECTOR4 sourceCoords(x,y,z+1,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
             UINT64VECTOR3(0,0,tree.m_iOverlap), UINT64VECTOR3(0,0,targetBrickSize.z-tree.m_iOverlap),
@@ -1262,7 +1535,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasLeftNeighbour) {
           UINT64VECTOR4 sourceCoords(x-1,y,z,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
             UINT64VECTOR3(sourceBrickSize.x-tree.m_iOverlap*2,0,0), UINT64VECTOR3(0,0,0),
@@ -1272,7 +1545,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasTopNeighbour) {
           UINT64VECTOR4 sourceCoords(x,y-1,z,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
             UINT64VECTOR3(0,sourceBrickSize.y-tree.m_iOverlap*2,0), UINT64VECTOR3(0,0,0),
@@ -1282,7 +1555,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasFrontNeighbour) {
           UINT64VECTOR4 sourceCoords(x,y,z-1,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(0,0,sourceBrickSize.z-tree.m_iOverlap*2), UINT64VECTOR3(0,0,0),
@@ -1295,7 +1568,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasBottomNeighbour && bHasRightNeighbour) {
           UINT64VECTOR4 sourceCoords(x+1,y+1,z,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(tree.m_iOverlap,tree.m_iOverlap,0), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,targetBrickSize.y-tree.m_iOverlap,0),
@@ -1309,7 +1582,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasRightNeighbour && bHasBackNeighbour) {
           UINT64VECTOR4 sourceCoords(x+1,y,z+1,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(tree.m_iOverlap,0,tree.m_iOverlap), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,0,targetBrickSize.z-tree.m_iOverlap),
@@ -1319,7 +1592,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasBottomNeighbour && bHasBackNeighbour) {
           UINT64VECTOR4 sourceCoords(x,y+1,z+1,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(0,tree.m_iOverlap,tree.m_iOverlap), UINT64VECTOR3(0,targetBrickSize.y-tree.m_iOverlap,targetBrickSize.z-tree.m_iOverlap),
@@ -1329,7 +1602,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
         if (bHasRightNeighbour && bHasBottomNeighbour && bHasBackNeighbour) {
           UINT64VECTOR4 sourceCoords(x+1,y+1,z+1,iLoD);
           UINT64VECTOR3 sourceBrickSize = tree.ComputeBrickSize(sourceCoords);
-          GetBrick(&vSourceData[0], tree, sourceCoords);
+          GetBrick(&vSourceData[0], tree, sourceCoords, iStep);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
                            UINT64VECTOR3(tree.m_iOverlap,tree.m_iOverlap,tree.m_iOverlap), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,targetBrickSize.y-tree.m_iOverlap,targetBrickSize.z-tree.m_iOverlap),
@@ -1353,7 +1626,7 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
 
 
         // now that brick is complete, write it back to the tree
-        SetBrick(&vTargetData[0], tree, coords);
+        SetBrick(&vTargetData[0], tree, coords, iStep);
 
         // Do not update display more than twice in a second!
         const double t2 = m_pProgressTimer->Elapsed();
@@ -1374,53 +1647,243 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
 /*
   This method reorders the large input raw file into smaller bricks
   of maximum size m_vBrickSize with an overlap of m_iOverlap i.e.
-  it computes LoD level zero. Therefore, it iterates over all bricks
-  to be created and grabs each from the source data. In the process it
-  also fills the tree ToC.
+  it computes LoD level zero. Therefore, it first fills the tree ToC
+  and then grabs every brick from the source data. The bricks are
+  extracted by several threads, but reading the input file and storing
+  the bricks is serialized (see GetInputBrick and SetBrick).
 */
 void ExtendedOctreeConverter::PermuteInputData(ExtendedOctree &tree, LargeRAWFile_ptr 
                                                pLargeRAWFileIn, uint64_t iInOffset,
                                                bool bClampToEdge) {
-  std::vector<uint8_t> vData;
-  const UINT64VECTOR3 baseBricks = tree.GetBrickCount(0);
+  Timer timer;
+  timer.Start();
+  double t1 = m_pProgressTimer->Elapsed();
 
-  uint64_t iCurrentOutOffset = tree.ComputeHeaderSize();
-  for (uint64_t z = 0;z<baseBricks.z;z++) {
-    for (uint64_t y = 0;y<baseBricks.y;y++) {
-      for (uint64_t x = 0;x<baseBricks.x;x++) {
-        UINT64VECTOR4 coords(x,y,z,0);
-        uint64_t iUncompressedBrickSize =
-          tree.ComputeBrickSize(UINT64VECTOR4(x,y,z,0)).volume() *
+  AppendLoDToToC(tree, 0);
+
+  const uint64_t iBrickCount = tree.GetBrickCount(0).volume();
+  const uint64_t iBatchSize = BatchSize(tree);
+  std::exception_ptr pError;
+
+#pragma omp parallel num_threads(m_iThreads)
+  {
+    std::vector<uint8_t> vData;
+    for (uint64_t iFirst = 0; iFirst < iBrickCount; iFirst += iBatchSize) {
+      const int iCount = int(std::min(iBatchSize, iBrickCount - iFirst));
+#pragma omp for schedule(dynamic)
+      for (int j = 0; j < iCount; ++j) {
+        try {
+          const uint64_t index = iFirst + uint64_t(j);
+          GetInputBrick(vData, tree, pLargeRAWFileIn, iInOffset,
+                        tree.IndexToBrickCoords(index), bClampToEdge);
+          SetBrick(&(vData[0]), tree, index, m_Schedule.BuildStep(index));
+        } catch (...) {
+#pragma omp critical (ExtendedOctreeConverterError)
+          {
+            if (!pError) pError = std::current_exception();
+          }
+        }
+      }
+#pragma omp master
+      {
+        m_fProgress = float(iFirst + iCount) / float(iBrickCount);
+
+        // Do not update display more than twice in a second!
+        const double t2 = m_pProgressTimer->Elapsed();
+        if ((t2 - t1) > 500) {
+          t1 = t2;
+          const std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+          m_Progress.Message(_func_, "Generating LOD 0 ... %5.2f%% (%s)",
+                             m_fProgress*100.0f, msg.c_str());
+        }
+      }
+    }
+  }
+  if (pError) std::rethrow_exception(pError);
+
+  const TOCEntry& last = tree.m_vTOC.back();
+  ReportThroughput("Bricking LOD 0", iBrickCount,
+                   last.m_iOffset + last.m_iLength - tree.ComputeHeaderSize(),
+                   timer.Elapsed());
+}
+
+/*
+  PermuteInputSlices:
+
+  Computes LoD level zero from a slice source. The layers of bricks are
+  processed front to back: the slices a layer spans are produced in
+  parallel into the slab, then the bricks of the layer are cut from the
+  slab in parallel. Consecutive layers share 2*m_iOverlap slices, these
+  are moved to the front of the slab instead of being produced again.
+*/
+void ExtendedOctreeConverter::PermuteInputSlices(ExtendedOctree &tree,
+                                                 SliceSource& source,
+                                                 bool bClampToEdge) {
+  Timer timer;
+  timer.Start();
+  double t1 = m_pProgressTimer->Elapsed();
+
+  AppendLoDToToC(tree, 0);
+
+  const UINT64VECTOR3 bricks = tree.GetBrickCount(0);
+  const uint64_t iLayerSize = bricks.x * bricks.y;
+  const uint64_t iStep = m_vBrickSize.z - 2 * m_iOverlap;
+  const uint64_t iSliceSize = tree.m_vVolumeSize.x * tree.m_vVolumeSize.y *
+                              tree.GetComponentTypeSize() *
+                              tree.m_iComponentCount;
+  std::vector<uint8_t> vSlab(size_t(SlabSliceCount(tree) * iSliceSize));
+  std::exception_ptr pError;
+
+  // slices [iFirst, iEnd) are in the slab
+  uint64_t iFirst = 0;
+  uint64_t iEnd = 0;
+  for (uint64_t z = 0; z < bricks.z; ++z) {
+    const uint64_t iLayerFirst = (z == 0) ? 0 : z * iStep - m_iOverlap;
+    const uint64_t iLayerEnd = std::min(tree.m_vVolumeSize.z,
+                                        (z + 1) * iStep + m_iOverlap);
+    assert(iLayerEnd - iLayerFirst <= SlabSliceCount(tree));
+
+    // keep the slices this layer shares with the previous one
+    const uint64_t iKeepFirst = std::max(iFirst, iLayerFirst);
+    if (iKeepFirst < iEnd) {
+      memmove(&vSlab[0], &vSlab[size_t((iKeepFirst - iFirst) * iSliceSize)],
+              size_t((iEnd - iKeepFirst) * iSliceSize));
+    } else {
+      iEnd = iLayerFirst;
+    }
+    iFirst = iLayerFirst;
+
+    // produce the new ones
+    const int iNewSlices = int(iLayerEnd - iEnd);
+#pragma omp parallel for schedule(dynamic) num_threads(m_iThreads)
+    for (int j = 0; j < iNewSlices; ++j) {
+      try {
+        const uint64_t iSlice = iEnd + uint64_t(j);
+        source.GetSlice(iSlice,
+                        &vSlab[size_t((iSlice - iFirst) * iSliceSize)]);
+      } catch (...) {
+#pragma omp critical (ExtendedOctreeConverterError)
+        {
+          if (!pError) pError = std::current_exception();
+        }
+      }
+    }
+    if (pError) std::rethrow_exception(pError);
+    iEnd = iLayerEnd;
+
+    // cut the bricks of this layer
+#pragma omp parallel num_threads(m_iThreads)
+    {
+      std::vector<uint8_t> vData;
+#pragma omp for schedule(dynamic)
+      for (int j = 0; j < int(iLayerSize); ++j) {
+        try {
+          const uint64_t index = z * iLayerSize + uint64_t(j);
+          GetInputBrick(vData, tree, LargeRAWFile_ptr(), 0,
+                        tree.IndexToBrickCoords(index), bClampToEdge,
+                        &vSlab[0], iFirst);
+          SetBrick(&(vData[0]), tree, index, m_Schedule.BuildStep(index));
+        } catch (...) {
+#pragma omp critical (ExtendedOctreeConverterError)
+          {
+            if (!pError) pError = std::current_exception();
+          }
+        }
+      }
+    }
+    if (pError) std::rethrow_exception(pError);
+
+    m_fProgress = float(z + 1) / float(bricks.z);
+
+    // Do not update display more than twice in a second!
+    const double t2 = m_pProgressTimer->Elapsed();
+    if ((t2 - t1) > 500) {
+      t1 = t2;
+      const std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+      m_Progress.Message(_func_, "Generating LOD 0 ... %5.2f%% (%s)",
+                         m_fProgress*100.0f, msg.c_str());
+    }
+  }
+
+  const TOCEntry& last = tree.m_vTOC.back();
+  ReportThroughput("Bricking LOD 0 from slices", bricks.volume(),
+                   last.m_iOffset + last.m_iLength - tree.ComputeHeaderSize(),
+                   timer.Elapsed());
+}
+
+uint64_t ExtendedOctreeConverter::SlabSliceCount(
+                                  const ExtendedOctree &tree) const {
+  return std::min(m_vBrickSize.z, tree.m_vVolumeSize.z);
+}
+
+/*
+  AppendLoDToToC:
+
+  Adds the ToC entries of all bricks of one LoD level in index order. This
+  way the position of every brick on disk is fixed before any of them is
+  computed, no matter in which order the worker threads get to them.
+*/
+void ExtendedOctreeConverter::AppendLoDToToC(ExtendedOctree &tree,
+                                             uint64_t iLoD) {
+  assert(tree.m_vTOC.size() == tree.m_vLODTable[size_t(iLoD)].m_iLoDOffset);
+
+  uint64_t iCurrentOutOffset = tree.m_vTOC.empty()
+    ? tree.ComputeHeaderSize()
+    : tree.m_vTOC.back().m_iOffset + tree.m_vTOC.back().m_iLength;
+
+  const UINT64VECTOR3 bricks = tree.GetBrickCount(iLoD);
+  for (uint64_t z = 0;z<bricks.z;z++) {
+    for (uint64_t y = 0;y<bricks.y;y++) {
+      for (uint64_t x = 0;x<bricks.x;x++) {
+        const uint64_t iUncompressedBrickSize =
+          tree.ComputeBrickSize(UINT64VECTOR4(x,y,z,iLoD)).volume() *
           tree.GetComponentTypeSize() *
           tree.GetComponentCount();
         TOCEntry t = {iCurrentOutOffset, iUncompressedBrickSize, CT_NONE,
                       iUncompressedBrickSize, UINTVECTOR2(0,0)};
         tree.m_vTOC.push_back(t);
-
-        GetInputBrick(vData, tree, pLargeRAWFileIn, iInOffset, coords,
-                      bClampToEdge);
-        SetBrick(&(vData[0]), tree, coords);
-
         iCurrentOutOffset += iUncompressedBrickSize;
-        const float xf = float(x);
-        const float p = xf + y*baseBricks.x + z*baseBricks.x*baseBricks.y;
-        m_fProgress = p / float(baseBricks.volume());
       }
-      const std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
-      m_Progress.Message(_func_, "Generating LOD 0 ... %5.2f%% (%s)",
-                         m_fProgress*100.0f, msg.c_str());
     }
   }
 }
 
+/*
+  BatchSize:
+
+  Enough bricks to keep all threads busy for a while, but when the batch is
+  held in memory (see ComputeStatsAndCompressAll) it has to stay within the
+  memory limit, including a compressed copy of each brick.
+*/
+uint64_t ExtendedOctreeConverter::BatchSize(const ExtendedOctree &tree) const {
+  const uint64_t iMaxBrickSize = tree.m_iBrickSize.volume() *
+                                 tree.GetComponentTypeSize() *
+                                 tree.GetComponentCount();
+  const uint64_t iMemBatch = m_iMemLimit / (2 * iMaxBrickSize);
+  return std::max<uint64_t>(1, std::min<uint64_t>(iMemBatch, m_iThreads * 4));
+}
+
+void ExtendedOctreeConverter::ReportThroughput(const char* stage,
+                                               uint64_t iBricks,
+                                               uint64_t iBytes,
+                                               double fMilliseconds) {
+  const double fSeconds = std::max(fMilliseconds, 1.0) / 1000.0;
+  const double fMB = double(iBytes) / (1024.0*1024.0);
+  m_Progress.Other(_func_, "%s: %llu bricks (%.2f MB) in %.2f s, "
+                   "%.2f MB/s, %.1f bricks/s using %u threads", stage,
+                   static_cast<unsigned long long>(iBricks), fMB, fSeconds,
+                   fMB / fSeconds, double(iBricks) / fSeconds, m_iThreads);
+}
+
 /*
  ExportToRAW:
 
  Flattens/un-bricks a given LoD level into a file, for example a call with
  iLODLevel = 0 will recover the exact original data file used tho build this
- tree. This method is very simple, it iterates over all bricks of the given
- LoD level (x,y,z for-loops) and for each brick it writes it's non-overlap
- values into the target file. Index magic is explained inside the function.
+ tree. The level is processed one layer of bricks at a time: the bricks of a
+ layer are read and decompressed in parallel, each writes its non-overlap
+ values into a buffer holding the slices of the layer, which then goes to
+ the target file in one piece. Index magic is explained inside the function.
 */
 bool ExtendedOctreeConverter::ExportToRAW(const ExtendedOctree &tree,
                                  const LargeRAWFile_ptr pLargeRAWFile,
@@ -1428,18 +1891,26 @@ bool ExtendedOctreeConverter::ExportToRAW(const ExtendedOctree &tree,
   if (iLODLevel >= tree.GetLODCount()) return false;
 
   const size_t iVoxelSize =tree. GetComponentTypeSize() * size_t(tree.m_iComponentCount);
-  uint8_t *pBrickData = new uint8_t[size_t(tree.m_iBrickSize.volume() * iVoxelSize)];
-
   const UINT64VECTOR3 outSize = tree.m_vLODTable[size_t(iLODLevel)].m_iLODPixelSize;
+  const UINT64VECTOR3 brickCore = tree.m_iBrickSize - tree.m_iOverlap*2;
+  const uint64_t iSliceSize = outSize.x * outSize.y * iVoxelSize;
+
+  std::vector<uint8_t> vLayer(size_t(std::min(brickCore.z, outSize.z) * iSliceSize));
+  std::exception_ptr pError;
 
   UINT64VECTOR3 bricksToExport = tree.GetBrickCount(iLODLevel);
+  const int iLayerBricks = int(bricksToExport.x * bricksToExport.y);
   for (uint64_t z = 0;z<bricksToExport.z;++z) {
-    for (uint64_t y = 0;y<bricksToExport.y;++y) {
-      for (uint64_t x = 0;x<bricksToExport.x;++x) {
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < iLayerBricks; ++i) {
+      try {
+        const uint64_t x = uint64_t(i) % bricksToExport.x;
+        const uint64_t y = uint64_t(i) / bricksToExport.x;
         const UINT64VECTOR4 coords(x,y,z, iLODLevel);
         const UINT64VECTOR3 brickSize = tree.ComputeBrickSize(coords);
 
-        tree.GetBrickData(pBrickData, coords);
+        std::vector<uint8_t> vBrickData(size_t(brickSize.volume() * iVoxelSize));
+        tree.GetBrickData(&vBrickData[0], coords);
 
         // compute the length of a scanline that is the non-overlap size
         // times the size of a voxel
@@ -1448,20 +1919,19 @@ bool ExtendedOctreeConverter::ExportToRAW(const ExtendedOctree &tree,
         for (uint64_t bz = 0;bz<brickSize.z-2*tree.m_iOverlap;++bz) {
           for (uint64_t by = 0;by<brickSize.y-2*tree.m_iOverlap;++by) {
 
-            // the offset into the target file is computed as follows:
-            // first the global offset into the file as specified by the user
-            // plus the scanline coordinate within th current brick (by, by)
-            // and the coordinates of the non-overlap part of the current
-            // brick x,y,z as usual x is used as is y is multiplied with x size
+            // the offset into the layer is computed as follows:
+            // the scanline coordinate within th current brick (by, by)
+            // plus the coordinates of the non-overlap part of the current
+            // brick x,y as usual x is used as is y is multiplied with x size
             // z is multiplied with x- times y-size, since we are placing the
-            // brick inside the output file we have to use outSize
+            // brick inside the output layer we have to use outSize
             // finally we multiply the brick voxels with the voxelsize to
             // get the offset in bytes
-            const uint64_t iOutOffset =  iOffset +
+            const uint64_t iOutOffset =
               (
-                (    (x*(tree.m_iBrickSize.x-tree.m_iOverlap*2))) +
-                ((by+(y*(tree.m_iBrickSize.y-tree.m_iOverlap*2))) * outSize.x) +
-                ((bz+(z*(tree.m_iBrickSize.z-tree.m_iOverlap*2))) * outSize.x * outSize.y)
+                (    (x*brickCore.x)) +
+                ((by+(y*brickCore.y)) * outSize.x) +
+                ((bz                ) * outSize.x * outSize.y)
               ) * iVoxelSize;
 
             // the offset in the source data is computed as follows:
@@ -1478,15 +1948,28 @@ bool ExtendedOctreeConverter::ExportToRAW(const ExtendedOctree &tree,
                                 ((bz+tree.m_iOverlap) * brickSize.x * brickSize.y)
                                ) * iVoxelSize;
 
-            pLargeRAWFile->SeekPos(iOutOffset);
-            pLargeRAWFile->WriteRAW(pBrickData + iInOffset, iLineSize);
+            std::memcpy(&vLayer[size_t(iOutOffset)],
+                        &vBrickData[size_t(iInOffset)], iLineSize);
           }
         }
+      } catch (...) {
+#pragma omp critical (ExtendedOctreeConverterError)
+        {
+          if (!pError) pError = std::current_exception();
+        }
       }
     }
+    if (pError) std::rethrow_exception(pError);
+
+    // the layer's slices are contiguous in the target file
+    const uint64_t iLayerDepth = std::min(brickCore.z, outSize.z - z*brickCore.z);
+    pLargeRAWFile->SeekPos(iOffset + z*brickCore.z*iSliceSize);
+    if (pLargeRAWFile->WriteRAW(&vLayer[0], iLayerDepth*iSliceSize) !=
+        iLayerDepth*iSliceSize) {
+      return false;
+    }
   }
 
-  delete [] pBrickData;
   return true;
 }
 
@@ -29,9 +29,13 @@
 
 #include <cstring>
 #include <functional>
+#include <set>
+#include <unordered_map>
 #include "ExtendedOctree.h"
+#include "OctreeBuildSchedule.h"
 #include "VolumeTools.h"
 #include "Basics/MathTools.h"
+#include "Basics/Threads.h"
 
 /*! \brief Stores brick statistics such as the minimum and maximum values
  */
@@ -60,6 +64,27 @@ class ProgressTimer;
 /// Vector to store statistics of each brick
 typedef std::vector<BrickStats<double>> BrickStatVec;
 
+/*! \brief A volume which is produced one z-slice at a time
+ *
+ *  Input for the converter when the volume does not exist as a linear raw
+ *  file, e.g. because every slice has to be decoded from an image first.
+ *  The converter requests every slice exactly once in ascending z order of
+ *  the brick layers, slices of one layer are requested concurrently from
+ *  the worker threads.
+ */
+class SliceSource {
+public:
+  virtual ~SliceSource() {}
+
+  /**
+    Produces one z-slice of the volume
+
+    @param iSlice the z coordinate of the slice
+    @param pData receives the x*y voxels of the slice, x running fastest
+  */
+  virtual void GetSlice(uint64_t iSlice, uint8_t* pData) = 0;
+};
+
 /*! \brief A class that takes a volume as a 1D array and
  *         turns it into a bricked, hierarchical Extended octree
  *
@@ -71,12 +96,17 @@ public:
 
     @param vBrickSize the maximum size of a brick (including overlap)
     @param iOverlap the voxel overlap (must be smaller than half the brick size in all dimensions)
-    @param iMemLimit the amount of memory in bytes the converter is allowed to use for caching
+    @param iMemLimit hard limit (in bytes) for the bricks the converter holds
+                     in memory, i.e. the brick cache and the per-thread work
+                     buffers; fewer threads are used if their buffers alone
+                     would exceed it
     @param progress debug channel to use for progress information
+    @param iThreads number of threads to build the tree with, 0 uses one per
+                    core; the output file does not depend on this number
   */
   ExtendedOctreeConverter(const UINT64VECTOR3& vBrickSize,
                           uint32_t iOverlap, uint64_t iMemLimit,
-                          AbstrDebugOut& progress);
+                          AbstrDebugOut& progress, unsigned iThreads=0);
 
   virtual ~ExtendedOctreeConverter();
 
@@ -143,11 +173,69 @@ public:
                bool bComputeMedian,
                bool bClampToEdge,
                LAYOUT_TYPE layout);
+
+  /**
+    This call starts the conversion of a volume which is produced slice by
+    slice into a bricked hierarchy. Only the slices spanned by one layer of
+    bricks are held in memory at a time, so no linear copy of the volume is
+    needed on disk.
+
+    @param source produces the slices of the volume
+    @param eComponentType the type of data stored (e.g. UINT8 for 8bit unsigned char data)
+    @param iComponentCount the vector length of a voxel (e.g. 1 for scalar data or 3 for RGB)
+    @param vVolumeSize the dimensions of the input volume
+    @param vVolumeAspect the aspect ratio of the input volume
+    @param pLargeRAWOutFile a large raw-file pointer to the target file for the processed data
+    @param iOutOffset bytes to precede the data in the target file
+    @param stats pointer to a vector to store the statistics of each brick
+    @param compression the desired compression method
+    @param iCompressionLevel the higher the level the more the compression (e.g. LZMA: 0..9)
+    @param bComputeMedian use median as downsampling filter (uses average otherwise)
+    @param bClampToEdge use outer values to fill border (uses zeros otherwise)
+    @param layout brick ordering on disk
+    @return true if the conversion succeeded
+  */
+  bool Convert(SliceSource& source,
+               ExtendedOctree::COMPONENT_TYPE eComponentType,
+               uint64_t iComponentCount, const UINT64VECTOR3& vVolumeSize,
+               const DOUBLEVECTOR3& vVolumeAspect,
+               LargeRAWFile_ptr pLargeRAWOutFile, uint64_t iOutOffset,
+               BrickStatVec* stats,
+               COMPRESSION_TYPE compression,
+               uint32_t iCompressionLevel,
+               bool bComputeMedian,
+               bool bClampToEdge,
+               LAYOUT_TYPE layout);
+
   /**
     Call this method from a second thread during the conversion to check on the progress of the operation
   */
   float GetProgress() const {return m_fProgress;}
 
+  /// replacement strategies for the brick cache used while building the tree
+  enum CachePolicy {
+    CP_LRU,     ///< evict the least recently used brick
+    CP_OPTIMAL  ///< evict the brick needed furthest in the future (default)
+  };
+
+  /**
+    Selects the replacement strategy of the brick cache, the output file
+    does not depend on it
+  */
+  void SetCachePolicy(CachePolicy ePolicy) {m_eCachePolicy = ePolicy;}
+
+  /// I/O statistics of the brick cache
+  struct CacheStats {
+    uint64_t iReads;       ///< bricks requested while building the tree
+    uint64_t iDiskReads;   ///< requests that had to be read from disk
+    uint64_t iDiskWrites;  ///< bricks written to disk
+    uint64_t iWriteRuns;   ///< seeks for these writes, adjacent bricks share one
+    uint64_t iPeakBytes;   ///< peak size of cached bricks and work buffers
+  };
+
+  /// @return the cache statistics of the last conversion
+  const CacheStats& GetCacheStats() const {return m_CacheStats;}
+
 
   /**
    Exports a specific LoD Level into a continuous raw file
@@ -288,7 +376,7 @@ public:
    *
    *  This class is used in a vector/list etc. like data structure within
    *  the ExtendedOctreeConverter class it mainly stores an array with the
-   *  brick data but also contains an access counter for the FIFO implementation,
+   *  brick data but also contains the key for the replacement strategy,
    *  a dirty bool to indicate that this brick has changed in mem but has not
    *  yet written to disk, and index indicating to which brick the data belongs
    */
@@ -301,7 +389,7 @@ public:
       m_pData(NULL),
       m_bDirty(false),
       m_index(std::numeric_limits<size_t>::max()),
-      m_iAccess(0),
+      m_iPriority(0),
       m_size(0)
     {}
 
@@ -329,6 +417,9 @@ public:
       m_size = size;
     }
 
+    /// @return the size of the data block
+    size_t GetSize() const {return m_size;}
+
     /**
       Actually allocates the memory specified with the size
     */
@@ -346,8 +437,8 @@ public:
     /// the ID of the data stored in this cache entry
     size_t m_index;
 
-    /// access timestamp for the replacement strategy
-    uint64_t m_iAccess;
+    /// key for the replacement strategy, the largest key is evicted first
+    uint64_t m_iPriority;
 
   private:
     /// the size of the data block
@@ -379,6 +470,9 @@ private:
   /// max amount of memory in bytes to be used by the cache
   uint64_t m_iMemLimit;
 
+  /// number of threads used to brick, downsample and compress
+  unsigned m_iThreads;
+
   /// desired compression method for new bricks, may be ignored by the system
   /// e.g. when a compressed brick would be larger than the uncompressed
   COMPRESSION_TYPE m_eCompression;
@@ -389,9 +483,39 @@ private:
   /// the brick cache collection
   BrickCache m_vBrickCache;
 
+  /// maps brick indices to their entry in m_vBrickCache
+  std::unordered_map<uint64_t, size_t> m_CacheSlots;
+
+  /// cached entries as (priority, slot), the last one is evicted next
+  std::set<std::pair<uint64_t, size_t>> m_EvictionOrder;
+
+  /// unused entries of m_vBrickCache
+  std::vector<size_t> m_vFreeSlots;
+
   /// last timestamp used to access the brickCache
   uint64_t m_iCacheAccessCounter;
 
+  /// replacement strategy of the brick cache
+  CachePolicy m_eCachePolicy;
+
+  /// order in which the bricks are accessed while the tree is built
+  OctreeBuildSchedule m_Schedule;
+
+  /// bytes held by the worker threads outside of the cache
+  uint64_t m_iWorkBytes;
+
+  /// bytes currently allocated by the cache
+  uint64_t m_iCacheBytes;
+
+  /// I/O statistics of the current conversion
+  CacheStats m_CacheStats;
+
+  /// serializes access to the brick cache (and through it to the target file)
+  tuvok::CriticalSection m_CacheGuard;
+
+  /// serializes reads from the input file
+  tuvok::CriticalSection m_InputGuard;
+
   /// if not NULL then the statistics for each brick are stored in this vector
   BrickStatVec* m_pBrickStatVec;
 
@@ -414,6 +538,44 @@ private:
     ExtendedOctree& tree, uint64_t iIndex,
     std::shared_ptr<uint8_t> const pBuffer = nullptr);
 
+  /**
+    Compresses a brick with the requested compression method, safe to be
+    called from several threads at once
+
+    @param tree target extended octree (used to extract metadata)
+    @param pData the uncompressed brick
+    @param iLength size (in bytes) of the uncompressed brick
+    @param pCompressed receives a new buffer with the compressed brick
+    @return the size (in bytes) of the compressed brick
+  */
+  uint64_t CompressBrick(const ExtendedOctree& tree,
+                         std::shared_ptr<uint8_t> pData, uint64_t iLength,
+                         std::shared_ptr<uint8_t>& pCompressed) const;
+
+  /**
+    Appends ToC entries for all bricks of a LoD level, the bricks are laid
+    out back to back after the last brick in the ToC and are uncompressed
+
+    @param tree target extended octree
+    @param iLoD the level of detail to be added
+  */
+  void AppendLoDToToC(ExtendedOctree &tree, uint64_t iLoD);
+
+  /// @return the number of bricks processed between two progress updates
+  ///         when working in parallel
+  uint64_t BatchSize(const ExtendedOctree &tree) const;
+
+  /**
+    Writes the throughput of one stage of the conversion to the debug output
+
+    @param stage name of the stage
+    @param iBricks number of bricks processed
+    @param iBytes number of (uncompressed) bytes processed
+    @param fMilliseconds time the stage took
+  */
+  void ReportThroughput(const char* stage, uint64_t iBricks, uint64_t iBytes,
+                        double fMilliseconds);
+
   /**
     Copies the outer voxels into the border to implement clamp to border
 
@@ -460,19 +622,23 @@ private:
                         size_t voxelSize);
 
   /**
-    Fetches a brick from the raw linear input file
+    Fetches a brick from the raw linear input file or from a slab of
+    consecutive input slices in memory
 
     @param vData vector to store the brick data
     @param tree target extended octree (used to extract metadata)
-    @param pLargeRAWFileIn source raw file
+    @param pLargeRAWFileIn source raw file, unused if pSlab is given
     @param iInOffset offset into the source file
     @param coords brick coordinates of the brick to be extracted
     @param bClampToEdge use outer values to fill border (uses zeroes otherwise)
+    @param pSlab if not NULL the input slices the brick is read from
+    @param iSlabFirst z coordinate of the first slice in pSlab
   */
   void GetInputBrick(std::vector<uint8_t>& vData,
                      ExtendedOctree &tree, LargeRAWFile_ptr pLargeRAWFileIn,
                      uint64_t iInOffset, const UINT64VECTOR4& coords,
-                     bool bClampToEdge);
+                     bool bClampToEdge, const uint8_t* pSlab=NULL,
+                     uint64_t iSlabFirst=0);
 
   /**
     This method reorders the large input raw file into smaller bricks
@@ -489,6 +655,59 @@ private:
                         uint64_t iInOffset,
                         bool bClampToEdge);
 
+  /**
+    Computes LoD level zero like PermuteInputData, but from a slice
+    source: for each layer of bricks the slices it spans are produced in
+    parallel, then its bricks are cut from them. The slices in the overlap
+    of two layers are produced only once.
+
+    @param tree target extended octree
+    @param source produces the slices of the input volume
+    @param bClampToEdge use outer values to fill border (uses zeroes otherwise)
+  */
+  void PermuteInputSlices(ExtendedOctree &tree, SliceSource& source,
+                          bool bClampToEdge);
+
+  /// Number of input slices spanned by one layer of bricks at most.
+  uint64_t SlabSliceCount(const ExtendedOctree &tree) const;
+
+  /**
+    Sets up the tree metadata and the converter state for a conversion
+
+    @param tree the tree to set up
+    @param eComponentType the type of data stored
+    @param iComponentCount the vector length of a voxel
+    @param vVolumeSize the dimensions of the input volume
+    @param vVolumeAspect the aspect ratio of the input volume
+    @param pLargeRAWOutFile the target file
+    @param iOutOffset bytes to precede the data in the target file
+    @param stats vector to store the statistics of each brick
+    @param compression the desired compression method
+    @param iCompressionLevel the desired compression level
+    @param layout brick ordering on disk
+  */
+  void BeginConversion(ExtendedOctree &tree,
+                       ExtendedOctree::COMPONENT_TYPE eComponentType,
+                       uint64_t iComponentCount,
+                       const UINT64VECTOR3& vVolumeSize,
+                       const DOUBLEVECTOR3& vVolumeAspect,
+                       LargeRAWFile_ptr pLargeRAWOutFile, uint64_t iOutOffset,
+                       BrickStatVec* stats, COMPRESSION_TYPE compression,
+                       uint32_t iCompressionLevel, LAYOUT_TYPE layout);
+
+  /**
+    Completes a conversion once LoD zero is in place: computes the
+    hierarchy, the statistics and compression of all bricks and writes
+    the header
+
+    @param tree target extended octree
+    @param bComputeMedian use median as downsampling filter
+    @param bClampToEdge use outer values to fill border
+    @return true if the conversion succeeded
+  */
+  bool FinishConversion(ExtendedOctree &tree, bool bComputeMedian,
+                        bool bClampToEdge);
+
   /**
     This method fills the overlaps between the bricks, it assumes
     that the "inner" parts of the bricks have been completed already
@@ -505,9 +724,10 @@ private:
     @param pData the target buffer of the brick data
     @param tree target extended octree
     @param vBrickCoords the coordinates (x,y,z, LoD) of the requested brick
+    @param iStep the step of the build (see OctreeBuildSchedule) requesting the brick
   */
   void GetBrick(uint8_t* pData, ExtendedOctree &tree,
-                const UINT64VECTOR4& vBrickCoords);
+                const UINT64VECTOR4& vBrickCoords, uint64_t iStep);
 
   /**
     Loads a specific brick from disk (or cache) into pData
@@ -515,8 +735,10 @@ private:
     @param pData the target buffer of the brick data
     @param tree target extended octree
     @param index the 1D-index of the brick
+    @param iStep the step of the build (see OctreeBuildSchedule) requesting the brick
   */
-  void GetBrick(uint8_t* pData, ExtendedOctree &tree, uint64_t index);
+  void GetBrick(uint8_t* pData, ExtendedOctree &tree, uint64_t index,
+                uint64_t iStep);
 
   /**
     Stores a specific brick to disk (or cache) from pData
@@ -524,10 +746,12 @@ private:
     @param pData the source buffer of the brick data
     @param tree target extended octree
     @param vBrickCoords the coordinates (x,y,z, LoD) of the requested brick
+    @param iStep the step of the build (see OctreeBuildSchedule) storing the brick
     @param bForceWrite forces the brick to be flushed to disk. if compression is enabled this performs the compression
   */
   void SetBrick(uint8_t* pData, ExtendedOctree &tree,
-                const UINT64VECTOR4& vBrickCoords, bool bForceWrite=false);
+                const UINT64VECTOR4& vBrickCoords, uint64_t iStep,
+                bool bForceWrite=false);
 
   /**
     Stores a specific brick to disk (or cache) from pData
@@ -535,18 +759,21 @@ private:
     @param pData the source buffer of the brick data
     @param tree target extended octree
     @param index the 1D-index of the brick
+    @param iStep the step of the build (see OctreeBuildSchedule) storing the brick
     @param bForceWrite forces the brick to be flushed to disk, if compression is enabled this performs the compression
   */
   void SetBrick(uint8_t* pData, ExtendedOctree &tree,
-                uint64_t index, bool bForceWritee=false);
+                uint64_t index, uint64_t iStep, bool bForceWrite=false);
 
   /**
     Prepares the cache data structures, effectively resizes the
-    std collection and notifies all elements of the maximum brick size
+    std collection and notifies all elements of the maximum brick size,
+    the cache gets what the memory limit leaves after the work buffers
 
     @param tree target extended octree
+    @param iInputBytes memory held for the input besides the work buffers
   */
-  void SetupCache(ExtendedOctree &tree);
+  void SetupCache(ExtendedOctree &tree, uint64_t iInputBytes=0);
 
   /**
     Writes all dirty cache elements to disk
@@ -555,6 +782,53 @@ private:
   */
   void FlushCache(ExtendedOctree &tree);
 
+  /// Frees all cache memory, the cache must have been flushed
+  void ReleaseCache();
+
+  /**
+    Computes the key of the replacement strategy for a brick that is
+    accessed, the cached brick with the largest key is evicted first
+
+    @param index the 1D-index of the brick
+    @param iStep the step of the build accessing the brick
+  */
+  uint64_t CachePriority(uint64_t index, uint64_t iStep);
+
+  /**
+    @param iPriority key of a brick that is not in the cache
+    @param bDirty true iff the brick has to be written to disk eventually
+    @return true iff the brick is worth caching, i.e. it would not be the
+            next brick to be evicted anyway
+  */
+  bool ShouldCache(uint64_t iPriority, bool bDirty) const;
+
+  /**
+    Hands out an unused cache entry, evicting the entry with the largest key
+    if the cache is full
+
+    @param tree target extended octree
+    @return the index of the entry in m_vBrickCache
+  */
+  size_t AcquireCacheSlot(ExtendedOctree &tree);
+
+  /**
+    Updates the key of a cached brick, clean bricks that are not needed
+    anymore are dropped from the cache
+
+    @param iSlot the index of the entry in m_vBrickCache
+    @param iPriority the new key
+  */
+  void TouchCacheSlot(size_t iSlot, uint64_t iPriority);
+
+  /**
+    Writes a dirty cached brick and all dirty cached bricks that are stored
+    directly before or after it on disk with a single seek
+
+    @param tree target extended octree
+    @param iSlot the index of the entry in m_vBrickCache
+  */
+  void WriteBrickRun(ExtendedOctree &tree, size_t iSlot);
+
   /// Computes the number of bytes required to store the (uncompressed) brick.
   static uint64_t BrickSize(const ExtendedOctree&, uint64_t index);
 
@@ -564,15 +838,6 @@ private:
     size_t components, enum ExtendedOctree::COMPONENT_TYPE
   );
 
-  /**
-    Write a single brick at index i in the ToC to disk and updates
-    the minmax data structure if it is set
-
-    @param tree target extended octree
-    @param element iterator to the element in the cache to be written to disk
-  */
-  static void WriteBrickToDisk(ExtendedOctree &tree, BrickCacheIter element);
-
   /**
     Write a single brick at index i in the ToC to disk and updates
     the minmax data structure if it is set
@@ -595,12 +860,14 @@ private:
     @param pSourceData pointer to the source data
     @param sourceCoords brick coordinates of the source brick
     @param targetOffset coordinates were to place the down-sampled data in the target brick
+    @param iStep the build step of the target brick
   */
   template<class T, bool bComputeMedian> void DownsampleBricktoBrick(ExtendedOctree &tree, T* pData,
                                                 const UINT64VECTOR3& targetSize,
                                                 T* pSourceData,
                                                 const UINT64VECTOR4& sourceCoords,
-                                                const UINT64VECTOR3& targetOffset);
+                                                const UINT64VECTOR3& targetOffset,
+                                                uint64_t iStep);
 
   /**
     This function down-samples up to eight bricks into a single brick.
@@ -608,13 +875,11 @@ private:
     arrays of sufficient size to hold the largest bricks
 
     @param tree target extended octree
-    @param bClampToEdge use outer values to fill border (uses zeroes otherwise)
     @param vBrickCoords brick coordinates of the target brick of the downsampling
     @param pData pointer to hold the temp data during the downsampling process
     @param pSourceData pointer to hold the temp data during the downsampling process
   */
   template<class T, bool bComputeMedian> void DownsampleBrick(ExtendedOctree &tree,
-                                         bool bClampToEdge,
                                          const UINT64VECTOR4& vBrickCoords,
                                          T* pData, T* pSourceData);
 
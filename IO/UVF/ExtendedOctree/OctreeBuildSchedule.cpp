@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cassert>
+#include "OctreeBuildSchedule.h"
+
+const uint64_t OctreeBuildSchedule::NEVER;
+
+/*
+  The steps are laid out as follows: step i bricks the i-th brick of LoD 0,
+  then for every coarser LoD l there is one step per brick to downsample it
+  followed by one step per brick to fill its overlap, both in index order.
+*/
+OctreeBuildSchedule::OctreeBuildSchedule(
+  const std::vector<UINT64VECTOR3>& vBrickCounts) :
+  m_vBrickCounts(vBrickCounts)
+{
+  uint64_t iOffset = 0;
+  uint64_t iStep = 0;
+  for (size_t l = 0;l<m_vBrickCounts.size();++l) {
+    const uint64_t iCount = m_vBrickCounts[l].volume();
+    m_vLoDOffsets.push_back(iOffset);
+    m_vBuildStart.push_back(iStep);
+    iOffset += iCount;
+    iStep += (l == 0) ? iCount : 2*iCount;
+  }
+  m_vBuildStart.push_back(iStep);
+}
+
+uint64_t OctreeBuildSchedule::GetStepCount() const {
+  return m_vBuildStart.empty() ? 0 : m_vBuildStart.back();
+}
+
+UINT64VECTOR4 OctreeBuildSchedule::Coords(uint64_t index) const {
+  assert(!m_vLoDOffsets.empty() && index >= m_vLoDOffsets[0]);
+  const size_t l = size_t(std::upper_bound(m_vLoDOffsets.begin(),
+                                           m_vLoDOffsets.end(), index) -
+                          m_vLoDOffsets.begin()) - 1;
+  const UINT64VECTOR3& count = m_vBrickCounts[l];
+  const uint64_t local = index - m_vLoDOffsets[l];
+  return UINT64VECTOR4(local % count.x, (local / count.x) % count.y,
+                       local / (count.x * count.y), l);
+}
+
+uint64_t OctreeBuildSchedule::Local(const UINT64VECTOR4& coords) const {
+  const UINT64VECTOR3& count = m_vBrickCounts[size_t(coords.w)];
+  return coords.x + coords.y * count.x + coords.z * count.x * count.y;
+}
+
+uint64_t OctreeBuildSchedule::BuildStep(uint64_t index) const {
+  const UINT64VECTOR4 coords = Coords(index);
+  return m_vBuildStart[size_t(coords.w)] + Local(coords);
+}
+
+uint64_t OctreeBuildSchedule::FillStep(uint64_t index) const {
+  const UINT64VECTOR4 coords = Coords(index);
+  if (coords.w == 0) return NEVER;
+  return m_vBuildStart[size_t(coords.w)] +
+         m_vBrickCounts[size_t(coords.w)].volume() + Local(coords);
+}
+
+/*
+  NextUse:
+
+  Collects all steps that touch the brick and returns the first one after
+  iStep. Besides its own build and fill steps a brick is read while its
+  neighbors' overlaps are filled and while its parent is downsampled. The
+  fill of brick t reads t itself, its six direct neighbors, t+(1,1,0),
+  t+(1,0,1), t+(0,1,1) and t+(1,1,1) (see ExtendedOctreeConverter::
+  FillOverlap), so conversely brick b is read by the fills of the bricks at
+  the negated offsets.
+*/
+uint64_t OctreeBuildSchedule::NextUse(uint64_t index, uint64_t iStep) const {
+  static const int64_t readers[11][3] = {
+    { 0, 0, 0}, {-1, 0, 0}, { 0,-1, 0}, { 0, 0,-1}, { 1, 0, 0}, { 0, 1, 0},
+    { 0, 0, 1}, {-1,-1, 0}, {-1, 0,-1}, { 0,-1,-1}, {-1,-1,-1}
+  };
+
+  const UINT64VECTOR4 coords = Coords(index);
+  const size_t l = size_t(coords.w);
+  uint64_t iNext = NEVER;
+
+  const uint64_t iBuild = m_vBuildStart[l] + Local(coords);
+  if (iBuild > iStep) iNext = iBuild;
+
+  if (l > 0) {
+    const UINT64VECTOR3& count = m_vBrickCounts[l];
+    const uint64_t iFillStart = m_vBuildStart[l] + count.volume();
+    for (size_t i = 0;i<11;++i) {
+      const int64_t x = int64_t(coords.x) + readers[i][0];
+      const int64_t y = int64_t(coords.y) + readers[i][1];
+      const int64_t z = int64_t(coords.z) + readers[i][2];
+      if (x < 0 || y < 0 || z < 0 || uint64_t(x) >= count.x ||
+          uint64_t(y) >= count.y || uint64_t(z) >= count.z)
+        continue;
+      const uint64_t iFill = iFillStart +
+        Local(UINT64VECTOR4(uint64_t(x), uint64_t(y), uint64_t(z), l));
+      if (iFill > iStep && iFill < iNext) iNext = iFill;
+    }
+  }
+
+  if (l+1 < m_vBrickCounts.size()) {
+    const uint64_t iParent = m_vBuildStart[l+1] +
+      Local(UINT64VECTOR4(coords.x/2, coords.y/2, coords.z/2, l+1));
+    if (iParent > iStep && iParent < iNext) iNext = iParent;
+  }
+
+  return iNext;
+}
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef OCTREEBUILDSCHEDULE_H
+#define OCTREEBUILDSCHEDULE_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Basics/Vectors.h"
+
+/*! \brief The order in which the ExtendedOctreeConverter touches its bricks
+ *
+ *  The converter visits the bricks in a fixed order: LoD 0 is bricked from
+ *  the input in index order, then each coarser level is downsampled in index
+ *  order (reading up to eight children) and finally its overlaps are filled
+ *  in index order (reading up to ten neighbors). Each of these operations is
+ *  one step of the schedule, so the step at which any brick is used next is
+ *  known in advance and the brick cache can evict the brick that is needed
+ *  furthest in the future (Belady's optimal strategy).
+ */
+class OctreeBuildSchedule {
+public:
+  /// step returned by NextUse if the brick is not touched again
+  static const uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+  /// an empty schedule, every brick is NEVER used
+  OctreeBuildSchedule() {}
+
+  /**
+    @param vBrickCounts the number of bricks in each LoD, finest level first,
+                        bricks are indexed as in the ExtendedOctree ToC
+  */
+  explicit OctreeBuildSchedule(const std::vector<UINT64VECTOR3>& vBrickCounts);
+
+  /// @return the step at which brick 'index' is created, i.e. bricked from
+  ///         the input (LoD 0) or downsampled from its children
+  uint64_t BuildStep(uint64_t index) const;
+
+  /// @return the step at which the overlap of brick 'index' is filled,
+  ///         NEVER for LoD 0 which is bricked with its overlap
+  uint64_t FillStep(uint64_t index) const;
+
+  /// @return the first step after iStep that reads or writes brick 'index'
+  uint64_t NextUse(uint64_t index, uint64_t iStep) const;
+
+  /// @return the total number of steps of the build
+  uint64_t GetStepCount() const;
+
+private:
+  /// bricks per LoD
+  std::vector<UINT64VECTOR3> m_vBrickCounts;
+
+  /// index of the first brick of each LoD
+  std::vector<uint64_t> m_vLoDOffsets;
+
+  /// first step of the downsampling of each LoD, the fill steps follow
+  /// directly after
+  std::vector<uint64_t> m_vBuildStart;
+
+  /// splits a brick index into LoD and local brick coordinates
+  UINT64VECTOR4 Coords(uint64_t index) const;
+
+  /// @return the index of the brick within its LoD
+  uint64_t Local(const UINT64VECTOR4& coords) const;
+};
+
+#endif // OCTREEBUILDSCHEDULE_H
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
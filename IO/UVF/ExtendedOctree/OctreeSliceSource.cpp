@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "OctreeSliceSource.h"
+
+/*
+  A slab of n consecutive slices touches at most ceil(n / depth) + 1 layers
+  of bricks, the cache keeps one more so that a consumer which moves on to
+  the next slab while the last slices of the previous one are still being
+  produced does not evict bricks it is about to use.
+*/
+OctreeSliceSource::OctreeSliceSource(const ExtendedOctree& tree,
+                                     uint64_t iLODLevel,
+                                     uint64_t iSlabSlices) :
+  m_Tree(tree),
+  m_iLODLevel(iLODLevel),
+  m_vSize(tree.GetLoDSize(iLODLevel)),
+  m_vBrickCount(tree.GetBrickCount(iLODLevel)),
+  m_vStep(UINT64VECTOR3(tree.GetMaxBrickSize()) - 2*tree.GetOverlap()),
+  m_iVoxelSize(tree.GetComponentTypeSize() * tree.GetComponentCount()),
+  m_iCacheSize(0),
+  m_iUseCounter(0),
+  m_iBrickReads(0)
+{
+  const uint64_t iLayers = (std::max<uint64_t>(iSlabSlices, 1) + m_vStep.z - 1)
+                           / m_vStep.z + 2;
+  m_iCacheSize = size_t(std::min(iLayers, m_vBrickCount.z) *
+                        m_vBrickCount.x * m_vBrickCount.y);
+}
+
+uint64_t OctreeSliceSource::GetBrickReads() const {
+  SCOPEDLOCK(m_CacheGuard);
+  return m_iBrickReads;
+}
+
+/*
+ GetBrick:
+
+ Looks the brick up (or reserves its entry) under the cache lock, the read
+ itself happens under the lock of the entry only, so different bricks are
+ read and decompressed concurrently while threads asking for the same brick
+ wait for the first one to read it. Evicting an entry which is still being
+ read is harmless: whoever asked for it holds a reference.
+*/
+std::shared_ptr<const OctreeSliceSource::CachedBrick>
+OctreeSliceSource::GetBrick(uint64_t x, uint64_t y, uint64_t z) {
+  const uint64_t index = x + y*m_vBrickCount.x +
+                         z*m_vBrickCount.x*m_vBrickCount.y;
+  std::shared_ptr<CachedBrick> brick;
+  {
+    SCOPEDLOCK(m_CacheGuard);
+    std::map<uint64_t, std::shared_ptr<CachedBrick>>::iterator it =
+      m_Cache.find(index);
+    if (it == m_Cache.end()) {
+      // evict the least recently used brick
+      if (m_Cache.size() >= m_iCacheSize && !m_Cache.empty()) {
+        std::map<uint64_t, std::shared_ptr<CachedBrick>>::iterator lru =
+          m_Cache.begin();
+        for (it = m_Cache.begin(); it != m_Cache.end(); ++it) {
+          if (it->second->m_iLastUse < lru->second->m_iLastUse) lru = it;
+        }
+        m_Cache.erase(lru);
+      }
+      brick = std::make_shared<CachedBrick>();
+      m_Cache[index] = brick;
+    } else {
+      brick = it->second;
+    }
+    brick->m_iLastUse = ++m_iUseCounter;
+  }
+
+  SCOPEDLOCK(brick->m_Guard);
+  if (brick->m_vData.empty()) {
+    const UINT64VECTOR4 coords(x, y, z, m_iLODLevel);
+    std::vector<uint8_t> vData(size_t(m_Tree.ComputeBrickSize(coords).volume()
+                                      * m_iVoxelSize));
+    m_Tree.GetBrickData(&vData[0], coords);
+    brick->m_vData.swap(vData);
+    SCOPEDLOCK(m_CacheGuard);
+    ++m_iBrickReads;
+  }
+  return brick;
+}
+
+/*
+ GetSlice:
+
+ Copies the non-overlap part of the slice from each brick of the layer
+ which contains it, scanline by scanline, just like ExportToRAW does for
+ whole bricks.
+*/
+void OctreeSliceSource::GetSlice(uint64_t iSlice, uint8_t* pData) {
+  assert(iSlice < m_vSize.z);
+  const uint64_t iOverlap = m_Tree.GetOverlap();
+  const uint64_t bz = iSlice / m_vStep.z;
+  const uint64_t lz = iSlice - bz*m_vStep.z + iOverlap;
+
+  for (uint64_t by = 0;by<m_vBrickCount.y;++by) {
+    for (uint64_t bx = 0;bx<m_vBrickCount.x;++bx) {
+      const std::shared_ptr<const CachedBrick> brick = GetBrick(bx, by, bz);
+      const UINT64VECTOR3 brickSize =
+        m_Tree.ComputeBrickSize(UINT64VECTOR4(bx, by, bz, m_iLODLevel));
+      const size_t iLineSize = size_t((brickSize.x-2*iOverlap) * m_iVoxelSize);
+
+      for (uint64_t ly = 0;ly<brickSize.y-2*iOverlap;++ly) {
+        const uint64_t iOutOffset = ((by*m_vStep.y+ly) * m_vSize.x +
+                                     bx*m_vStep.x) * m_iVoxelSize;
+        const uint64_t iInOffset = (iOverlap + (ly+iOverlap) * brickSize.x +
+                                    lz * brickSize.x * brickSize.y)
+                                   * m_iVoxelSize;
+        std::memcpy(pData + iOutOffset, &brick->m_vData[size_t(iInOffset)],
+                    iLineSize);
+      }
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#ifndef OCTREESLICESOURCE_H
+#define OCTREESLICESOURCE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include "Basics/Threads.h"
+#include "ExtendedOctreeConverter.h"
+
+/*! \brief Reads one LoD of an ExtendedOctree slice by slice
+ *
+ *  Each slice is assembled from the non-overlap part of the bricks it
+ *  crosses. As every brick serves many slices the decompressed bricks are
+ *  kept in a cache which is shared by all threads: concurrent requests for
+ *  the same brick wait for a single read instead of decompressing it again.
+ *  The cache holds as many layers of bricks as a consumer working through
+ *  a slab of consecutive slices needs, so slices requested in (roughly)
+ *  increasing order read every brick exactly once.
+ */
+class OctreeSliceSource : public SliceSource {
+public:
+  /**
+    @param tree the octree to read, must outlive the source
+    @param iLODLevel the level to be read
+    @param iSlabSlices the number of consecutive slices which are requested
+                       concurrently, determines the cache size
+  */
+  OctreeSliceSource(const ExtendedOctree& tree, uint64_t iLODLevel,
+                    uint64_t iSlabSlices=1);
+
+  /// thread safe; the slice is returned in the byte order of the tree
+  virtual void GetSlice(uint64_t iSlice, uint8_t* pData);
+
+  /// @return the size of the level
+  UINT64VECTOR3 GetSize() const {return m_vSize;}
+
+  /// @return the bytes of one slice
+  uint64_t GetSliceSize() const {
+    return m_vSize.x * m_vSize.y * m_iVoxelSize;
+  }
+
+  /// @return the number of slices the bricks of a layer hold
+  uint64_t GetLayerDepth() const {return m_vStep.z;}
+
+  /// @return the number of bricks read from the tree so far
+  uint64_t GetBrickReads() const;
+
+private:
+  struct CachedBrick {
+    CachedBrick() : m_iLastUse(0) {}
+    /// held while the brick is read, so that it is only read once
+    tuvok::CriticalSection m_Guard;
+    std::vector<uint8_t> m_vData;
+    uint64_t m_iLastUse;
+  };
+
+  /// @return the decompressed brick, reads it if it is not cached
+  std::shared_ptr<const CachedBrick> GetBrick(uint64_t x, uint64_t y,
+                                              uint64_t z);
+
+  const ExtendedOctree& m_Tree;
+  const uint64_t m_iLODLevel;
+  const UINT64VECTOR3 m_vSize;
+  const UINT64VECTOR3 m_vBrickCount;
+  /// the non-overlap size of the (inner) bricks
+  const UINT64VECTOR3 m_vStep;
+  const uint64_t m_iVoxelSize;
+  /// the number of bricks the cache holds
+  size_t m_iCacheSize;
+
+  mutable tuvok::CriticalSection m_CacheGuard;
+  std::map<uint64_t, std::shared_ptr<CachedBrick>> m_Cache;
+  uint64_t m_iUseCounter;
+  uint64_t m_iBrickReads;
+};
+
+#endif // OCTREESLICESOURCE_H
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
@@ -2,6 +2,9 @@
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
+#include <cfloat>
+#include <limits>
+#include <vector>
 #include "VolumeTools.h"
 #include "Hilbert.h"
 
@@ -277,6 +280,130 @@ void VolumeTools::DeAtalasify(size_t iSizeInBytes,
   }
 }
 
+namespace {
+  // start values of the extrema accumulators which any value but a NaN
+  // replaces
+  template<typename T> T Highest() {
+    return std::numeric_limits<T>::has_infinity
+      ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+  }
+  template<typename T> T Lowest() {
+    return std::numeric_limits<T>::has_infinity
+      ? -std::numeric_limits<T>::infinity()
+      : std::numeric_limits<T>::lowest();
+  }
+
+  // folds n element-wise accumulators into the ranges of their components
+  template<typename T>
+  void MergeRange(const T* pMin, const T* pMax, size_t n, size_t iComponents,
+                  double tuvok::MinMaxBlock::* pMinField,
+                  double tuvok::MinMaxBlock::* pMaxField,
+                  tuvok::MinMaxBlock* pStats) {
+    for (size_t i = 0; i < n; ++i) {
+      tuvok::MinMaxBlock& s = pStats[i % iComponents];
+      const double mn = static_cast<double>(pMin[i]);
+      const double mx = static_cast<double>(pMax[i]);
+      s.*pMinField = mn < s.*pMinField ? mn : s.*pMinField;
+      s.*pMaxField = mx > s.*pMaxField ? mx : s.*pMaxField;
+    }
+  }
+}
+
+template<typename T>
+void VolumeTools::ComputeBrickStats(const T* pData, const UINT64VECTOR3& vSize,
+                                    size_t iComponents, bool bGradients,
+                                    tuvok::MinMaxBlock* pStats) {
+  for (size_t c = 0; c < iComponents; ++c)
+    pStats[c] = tuvok::MinMaxBlock(DBL_MAX, -DBL_MAX, DBL_MAX, -DBL_MAX);
+
+  const size_t sx = size_t(vSize.x), sy = size_t(vSize.y);
+  const size_t sz = size_t(vSize.z);
+  if (iComponents == 0 || vSize.volume() == 0) return;
+
+  // the values go into per position accumulators of a row, which are
+  // reduced to per component ranges only once at the end
+  const size_t iRow = sx * iComponents;
+  std::vector<T> vMin(iRow, Highest<T>()), vMax(iRow, Lowest<T>());
+
+  // the gradients need the slice before and after the one they are
+  // computed for, so every component keeps a window of three slices in
+  // double precision; again, per position accumulators for the extrema
+  const size_t bx = sx > 2 ? 1 : 0, by = sy > 2 ? 1 : 0, bz = sz > 2 ? 1 : 0;
+  const size_t iSlice = sx * sy;
+  const size_t nx = sx - 2*bx;
+  std::vector<double> vWindow, vMag, vGradMin, vGradMax;
+  if (bGradients) {
+    vWindow.resize(3 * iComponents * iSlice);
+    vMag.resize(nx);
+    vGradMin.resize(iComponents * nx, Highest<double>());
+    vGradMax.resize(iComponents * nx, Lowest<double>());
+  }
+  // slice z of component c in the window
+  auto plane = [&](size_t z, size_t c) {
+    return &vWindow[((z % 3) * iComponents + c) * iSlice];
+  };
+
+  for (size_t z = 0; z < sz; ++z) {
+    const T* pSlice = pData + z * iSlice * iComponents;
+    for (size_t y = 0; y < sy; ++y) {
+      const T* pRow = pSlice + y * iRow;
+      MinRow(&vMin[0], pRow, iRow);
+      MaxRow(&vMax[0], pRow, iRow);
+      if (!bGradients) continue;
+      for (size_t c = 0; c < iComponents; ++c) {
+        double* pOut = plane(z, c) + y * sx;
+        for (size_t x = 0; x < sx; ++x)
+          pOut[x] = static_cast<double>(pRow[x * iComponents + c]);
+      }
+    }
+
+    // with slice z loaded, the gradients of slice z-bz are complete
+    if (!bGradients || z < 2*bz) continue;
+    const size_t zc = z - bz;
+    for (size_t c = 0; c < iComponents; ++c) {
+      const double* pFront = plane(zc - bz, c);
+      const double* pCenter = plane(zc, c);
+      const double* pBack = plane(zc + bz, c);
+      for (size_t y = by; y < sy - by; ++y) {
+        const size_t i = y * sx + bx;
+        GradientMagnitudeRow(pCenter + i - bx, pCenter + i + bx,
+                             pCenter + i - by * sx, pCenter + i + by * sx,
+                             pFront + i, pBack + i, 2.0, &vMag[0], nx);
+        MinRow(&vGradMin[c * nx], &vMag[0], nx);
+        MaxRow(&vGradMax[c * nx], &vMag[0], nx);
+      }
+    }
+  }
+
+  MergeRange(&vMin[0], &vMax[0], iRow, iComponents,
+             &tuvok::MinMaxBlock::minScalar, &tuvok::MinMaxBlock::maxScalar,
+             pStats);
+  if (bGradients) {
+    // the gradient accumulators are grouped by component, not interleaved
+    for (size_t c = 0; c < iComponents; ++c)
+      MergeRange(&vGradMin[c * nx], &vGradMax[c * nx], nx, 1,
+                 &tuvok::MinMaxBlock::minGradient,
+                 &tuvok::MinMaxBlock::maxGradient, pStats + c);
+  }
+}
+
+#define VOLUMETOOLS_INSTANTIATE_BRICKSTATS(T)                               \
+  template void VolumeTools::ComputeBrickStats<T>(const T*,                 \
+                                                  const UINT64VECTOR3&,     \
+                                                  size_t, bool,             \
+                                                  tuvok::MinMaxBlock*);
+
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(uint8_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(int8_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(uint16_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(int16_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(uint32_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(int32_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(uint64_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(int64_t)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(float)
+VOLUMETOOLS_INSTANTIATE_BRICKSTATS(double)
+
 
 /*
  The MIT License
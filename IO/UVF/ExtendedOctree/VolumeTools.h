@@ -7,8 +7,11 @@
 
 // for the small fixed size vectors
 #include "Basics/Vectors.h"
+#include "Basics/MinMaxBlock.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace VolumeTools {
 
@@ -261,6 +264,217 @@ namespace VolumeTools {
                 F(e) + F(f) + F(g) + F(h)) / F(8));
   }
 
+  /// instruction sets DownsampleRow can use
+  enum SIMDLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2
+  };
+
+  /// @return the best instruction set supported by the CPU (and the build)
+  SIMDLevel DetectSIMDLevel();
+
+  /// @return the instruction set DownsampleRow currently uses
+  SIMDLevel GetSIMDLevel();
+
+  /**
+   Restricts DownsampleRow to the given instruction set, e.g. to compare
+   kernels in a benchmark. Levels the CPU does not support are clamped to
+   DetectSIMDLevel(). Not meant to be called while a conversion is running.
+
+   @param level the instruction set to use from now on
+   @return the level actually in use
+   */
+  SIMDLevel SetSIMDLevel(SIMDLevel level);
+
+  /**
+   Downsamples a row of 2x2x2 blocks of single component voxels with SSE2
+   or AVX2, whatever GetSIMDLevel() says. For every i in [0,n) computes
+     out[i] = Filter<T, double, bComputeMedian>(r0[2i], r1[2i], r2[2i],
+               r3[2i], r0[2i+1], r1[2i+1], r2[2i+1], r3[2i+1])
+   with bitwise identical results. Implemented (in VolumeToolsSIMD.cpp)
+   for all ExtendedOctree component types.
+
+   @param r0 2*n source voxels at (y, z)
+   @param r1 2*n source voxels at (y, z+1)
+   @param r2 2*n source voxels at (y+1, z)
+   @param r3 2*n source voxels at (y+1, z+1)
+   @param out n filtered voxels
+   @param n number of voxels to compute
+   */
+  template<typename T, bool bComputeMedian>
+  void DownsampleRow(const T* r0, const T* r1, const T* r2, const T* r3,
+                     T* out, size_t n);
+
+  /**
+   Computes gradient magnitudes from central differences for a row of
+   voxels with SSE2 or AVX2, whatever GetSIMDLevel() says. For every i in
+   [0,n) computes
+     out[i] = DOUBLEVECTOR3((left[i]-right[i])/d, (top[i]-bottom[i])/d,
+                            (front[i]-back[i])/d).length()
+   with bitwise identical results.
+
+   @param left, right the neighbours in x of n voxels
+   @param top, bottom the neighbours in y
+   @param front, back the neighbours in z
+   @param d the divisor of the differences (twice the normalization)
+   @param out n gradient magnitudes
+   @param n number of voxels to compute
+   */
+  void GradientMagnitudeRow(const double* left, const double* right,
+                            const double* top, const double* bottom,
+                            const double* front, const double* back,
+                            double d, double* out, size_t n);
+
+  /**
+   Maps n gradient magnitudes to 256 histogram bins, i.e. computes
+     out[i] = uint8_t(std::min(255.0, mag[i] / maxMag * 255.0))
+   with SSE2 or AVX2, whatever GetSIMDLevel() says. The magnitudes must
+   be in [0, maxMag]; if maxMag is 0 all of them go to bin 255.
+
+   @param mag n gradient magnitudes
+   @param maxMag the largest gradient magnitude
+   @param out n bin indices
+   @param n number of magnitudes
+   */
+  void GradientBinRow(const double* mag, double maxMag, uint8_t* out,
+                      size_t n);
+
+  /**
+   Linear quantization of n values, i.e. computes
+     out[i] = uint16_t(std::min(maxOut, double(in[i] - mn) * scale))
+   with SSE2 or AVX2, whatever GetSIMDLevel() says, with bitwise identical
+   results. The difference is taken in the type of the input; for the
+   32 bit integer version it is taken modulo 2^32, so int32 data may be
+   passed in bitwise as well. No value may be below mn and maxOut may not
+   be larger than 65535; NaNs end up at maxOut.
+
+   @param in n input values
+   @param mn the smallest input value
+   @param scale quantization factor
+   @param maxOut the largest output value
+   @param out n quantized values
+   @param n number of values
+   */
+  void QuantizeRow(const float* in, float mn, double scale, double maxOut,
+                   uint16_t* out, size_t n);
+  void QuantizeRow(const double* in, double mn, double scale, double maxOut,
+                   uint16_t* out, size_t n);
+  void QuantizeRow(const uint32_t* in, uint32_t mn, double scale,
+                   double maxOut, uint16_t* out, size_t n);
+
+  /**
+   Element-wise maximum of two rows, acc[i] = std::max(acc[i], in[i]),
+   with SSE2 or AVX2, whatever GetSIMDLevel() says. Just like with
+   std::max, a NaN in acc stays and a NaN in in is ignored.
+
+   @param acc n values, replaced by the maxima
+   @param in n values
+   @param n number of values
+   */
+  template<typename T> void MaxRow(T* acc, const T* in, size_t n);
+
+  /// element-wise minimum, acc[i] = std::min(acc[i], in[i]), like MaxRow
+  template<typename T> void MinRow(T* acc, const T* in, size_t n);
+
+  /**
+   Element-wise sum of two rows, acc[i] += in[i], which saturates at the
+   limits of T instead of wrapping around; floating point sums are plain
+   sums. Vectorized like MaxRow.
+
+   @param acc n values, replaced by the sums
+   @param in n values
+   @param n number of values
+   */
+  template<typename T> void SaturatingAddRow(T* acc, const T* in, size_t n);
+
+  /// the scalar definition of SaturatingAddRow, for a single value
+  template<typename T> T SaturatingAdd(T a, T b) {
+    if(!std::numeric_limits<T>::is_integer) { return T(a + b); }
+    if(b > T(0) && a > std::numeric_limits<T>::max() - b) {
+      return std::numeric_limits<T>::max();
+    }
+    if(b < T(0) && a < std::numeric_limits<T>::min() - b) {
+      return std::numeric_limits<T>::min();
+    }
+    return T(a + b);
+  }
+
+  /// operators of BinaryRow
+  enum BinaryOp {
+    BINARY_ADD,
+    BINARY_SUB,
+    BINARY_MUL,
+    BINARY_DIV,
+    BINARY_GREATER, ///< 1 if a > b, 0 otherwise
+    BINARY_LESS,    ///< 1 if a < b, 0 otherwise
+    BINARY_NEAR     ///< 1 if |a-b| < eps, 0 otherwise
+  };
+
+  /// the scalar definition of BinaryRow, for a single value
+  inline double Binary(BinaryOp op, double a, double b, double eps) {
+    switch (op) {
+      case BINARY_ADD:     return a + b;
+      case BINARY_SUB:     return a - b;
+      case BINARY_MUL:     return a * b;
+      case BINARY_DIV:     return a / b;
+      case BINARY_GREATER: return a > b ? 1.0 : 0.0;
+      case BINARY_LESS:    return a < b ? 1.0 : 0.0;
+      case BINARY_NEAR:    return std::fabs(a - b) < eps ? 1.0 : 0.0;
+    }
+    return 0.0;
+  }
+
+  /**
+   Applies a binary operator to two rows, out[i] = Binary(op, a[i], b[i],
+   eps), with SSE2 or AVX2, whatever GetSIMDLevel() says, with bitwise
+   identical results. out may alias a or b.
+
+   @param op the operator
+   @param a, b n operands each
+   @param eps the tolerance of BINARY_NEAR
+   @param out n results
+   @param n number of values
+   */
+  void BinaryRow(BinaryOp op, const double* a, const double* b, double eps,
+                 double* out, size_t n);
+
+  /**
+   Element-wise choice between two rows, out[i] = c[i] ? a[i] : b[i], i.e.
+   NaNs count as true. Vectorized like BinaryRow; out may alias any input.
+
+   @param c n conditions
+   @param a n values chosen where c is not 0
+   @param b n values chosen where c is 0
+   @param out n results
+   @param n number of values
+   */
+  void SelectRow(const double* c, const double* a, const double* b,
+                 double* out, size_t n);
+
+  /**
+   Computes the value range of every component of a brick and, if asked
+   for, the range of its gradient magnitudes, in a single pass over the
+   brick with the vectorized row kernels above (MinRow, MaxRow and
+   GradientMagnitudeRow). Gradients are central differences of the voxels
+   off the brick boundary,
+     |(v(x+1)-v(x-1))/2, (v(y+1)-v(y-1))/2, (v(z+1)-v(z-1))/2|,
+   except along axes thinner than three voxels, which keep their boundary
+   and contribute a derivative of 0. NaNs are ignored; ranges without any
+   value stay empty, i.e. (DBL_MAX, -DBL_MAX). Implemented (in
+   VolumeTools.cpp) for all ExtendedOctree component types.
+
+   @param pData the voxels, components interleaved
+   @param vSize the brick size in voxels
+   @param iComponents number of components per voxel
+   @param bGradients false leaves the gradient ranges empty
+   @param pStats iComponents ranges, one per component
+   */
+  template<typename T>
+  void ComputeBrickStats(const T* pData, const UINT64VECTOR3& vSize,
+                         size_t iComponents, bool bGradients,
+                         tuvok::MinMaxBlock* pStats);
+
   template<typename T> void ComputeGradientVolumeFloat(T* pSourceData, T* pTargetData, const UINT64VECTOR3& vVolumeSize) {
     for (size_t z = 0;z<size_t(vVolumeSize[2]);z++) {
       for (size_t y = 0;y<size_t(vVolumeSize[1]);y++) {
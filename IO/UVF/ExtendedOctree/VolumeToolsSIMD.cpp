@@ -0,0 +1,1496 @@
+/*
+ The MIT License
+
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
+
+// Vectorized versions of VolumeTools::Filter for whole rows of voxels,
+// see VolumeTools::DownsampleRow.  Every kernel computes exactly what the
+// scalar template computes: the mean is accumulated in double precision
+// (or in an integer type wide enough to make that exact) and truncated
+// the same way, the median repeats the scalar comparisons lane by lane.
+
+#include <atomic>
+#include "VolumeTools.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__i386__) && defined(__SSE2__)) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define VOLUMETOOLS_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
+namespace VolumeTools {
+
+static SIMDLevel DetectSIMDLevelUncached() {
+#ifdef VOLUMETOOLS_X86
+# ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] >= 7) {
+    __cpuid(info, 1);
+    const bool bOSXSave = (info[2] & (1 << 27)) != 0;
+    const bool bAVX = (info[2] & (1 << 28)) != 0;
+    __cpuidex(info, 7, 0);
+    const bool bAVX2 = (info[1] & (1 << 5)) != 0;
+    // the OS has to save the upper halves of the YMM registers for us
+    if (bOSXSave && bAVX && bAVX2 && (_xgetbv(0) & 6) == 6)
+      return SIMD_AVX2;
+  }
+# else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+# endif
+  return SIMD_SSE2;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+SIMDLevel DetectSIMDLevel() {
+  static const SIMDLevel level = DetectSIMDLevelUncached();
+  return level;
+}
+
+static std::atomic<int>& ActiveLevel() {
+  static std::atomic<int> level(DetectSIMDLevel());
+  return level;
+}
+
+SIMDLevel GetSIMDLevel() {
+  return SIMDLevel(ActiveLevel().load());
+}
+
+SIMDLevel SetSIMDLevel(SIMDLevel level) {
+  level = std::min(level, DetectSIMDLevel());
+  ActiveLevel().store(level);
+  return level;
+}
+
+#ifdef VOLUMETOOLS_X86
+
+namespace sse2 {
+
+  template<typename T> struct Ops {
+    static const bool bMedian = false;
+    static const bool bMean = false;
+  };
+
+  inline __m128i Load(const void* p) {
+    return _mm_loadu_si128(static_cast<const __m128i*>(p));
+  }
+  inline void Store(void* p, __m128i v) {
+    _mm_storeu_si128(static_cast<__m128i*>(p), v);
+  }
+
+  // keeps the low 8 bits of all 16 bit lanes of x and y, in that order
+  inline __m128i Pack8(__m128i x, __m128i y) {
+    const __m128i lowByte = _mm_set1_epi16(0x00FF);
+    return _mm_packus_epi16(_mm_and_si128(x, lowByte),
+                            _mm_and_si128(y, lowByte));
+  }
+  // keeps the low 16 bits of all 32 bit lanes of x and y, in that order
+  inline __m128i Pack16(__m128i x, __m128i y) {
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16),
+                           _mm_srai_epi32(_mm_slli_epi32(y, 16), 16));
+  }
+
+  // signed division by 8 which rounds towards zero, like the conversion
+  // from double in the scalar code does
+  inline __m128i TruncDiv8_16(__m128i s) {
+    s = _mm_add_epi16(s, _mm_and_si128(_mm_srai_epi16(s, 15),
+                                       _mm_set1_epi16(7)));
+    return _mm_srai_epi16(s, 3);
+  }
+  inline __m128i TruncDiv8_32(__m128i s) {
+    s = _mm_add_epi32(s, _mm_and_si128(_mm_srai_epi32(s, 31),
+                                       _mm_set1_epi32(7)));
+    return _mm_srai_epi32(s, 3);
+  }
+
+  // a > b for unsigned lanes, by moving the range into the signed one
+  inline __m128i GtU8(__m128i a, __m128i b) {
+    const __m128i bias = _mm_set1_epi8(char(0x80));
+    return _mm_cmpgt_epi8(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+  }
+  inline __m128i GtU16(__m128i a, __m128i b) {
+    const __m128i bias = _mm_set1_epi16(short(0x8000));
+    return _mm_cmpgt_epi16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+  }
+  inline __m128i GtU32(__m128i a, __m128i b) {
+    const __m128i bias = _mm_set1_epi32(int(0x80000000));
+    return _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+  }
+
+  // sums of neighbouring unsigned 32 bit lanes, as 64 bit integers
+  inline __m128i PairSum32(__m128i x) {
+    const __m128i lowHalf = _mm_set_epi32(0, -1, 0, -1);
+    return _mm_add_epi64(_mm_and_si128(x, lowHalf), _mm_srli_epi64(x, 32));
+  }
+  // signed 64 bit division by 8 which rounds towards zero.  Only the low
+  // 32 bits of each result are right, as the shift is a logical one.
+  inline __m128i TruncDiv8_64(__m128i s) {
+    const __m128i negative = _mm_shuffle_epi32(_mm_srai_epi32(s, 31),
+                                               _MM_SHUFFLE(3,3,1,1));
+    s = _mm_add_epi64(s, _mm_and_si128(negative, _mm_set1_epi64x(7)));
+    return _mm_srli_epi64(s, 3);
+  }
+
+  // the sum of eight 32 bit integers fits into 64 bits, so unlike the
+  // scalar code we do not need double precision to get the exact mean.
+  // Signed values are moved into the unsigned range by flipping the top
+  // bit and moved back after the summation.
+  template<bool bSigned, typename T>
+  void Mean32(const T* r0, const T* r1, const T* r2, const T* r3, T* out) {
+    const T* rows[4] = {r0, r1, r2, r3};
+    const __m128i bias = _mm_set1_epi32(bSigned ? int(0x80000000) : 0);
+    __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+    for (int r = 0; r < 4; ++r) {
+      s0 = _mm_add_epi64(s0, PairSum32(_mm_xor_si128(Load(rows[r]), bias)));
+      s1 = _mm_add_epi64(s1, PairSum32(_mm_xor_si128(Load(rows[r] + 4),
+                                                     bias)));
+    }
+    if (bSigned) {
+      const __m128i eightBiases = _mm_set1_epi64x(int64_t(1) << 34);
+      s0 = TruncDiv8_64(_mm_sub_epi64(s0, eightBiases));
+      s1 = TruncDiv8_64(_mm_sub_epi64(s1, eightBiases));
+    } else {
+      s0 = _mm_srli_epi64(s0, 3);
+      s1 = _mm_srli_epi64(s1, 3);
+    }
+    Store(out, _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(s0),
+                                               _mm_castsi128_ps(s1),
+                                               _MM_SHUFFLE(2,0,2,0))));
+  }
+
+  // the mean of floating point values is computed in double precision,
+  // two outputs at a time.  D provides
+  //   Load(p, even, odd) converting 4 consecutive values to double
+  //   Store(p, v) converting 2 doubles back and storing them
+  template<class D, typename T>
+  void MeanInDouble(const T* r0, const T* r1, const T* r2, const T* r3,
+                    T* out) {
+    __m128d e0, e1, e2, e3, o0, o1, o2, o3;
+    D::Load(r0, e0, o0);
+    D::Load(r1, e1, o1);
+    D::Load(r2, e2, o2);
+    D::Load(r3, e3, o3);
+    // same order of additions as the scalar code
+    __m128d s = _mm_add_pd(_mm_add_pd(_mm_add_pd(e0, e1), e2), e3);
+    s = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_add_pd(s, o0), o1), o2), o3);
+    // multiplying by a power of two rounds exactly like dividing by it
+    D::Store(out, _mm_mul_pd(s, _mm_set1_pd(0.125)));
+  }
+
+  struct IntOps {
+    typedef __m128i V;
+    static V Sel(V m, V x, V y) {
+      return _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, y));
+    }
+    static V AndNot(V m, V n) { return _mm_andnot_si128(m, n); }
+    static void Store(void* p, V v) { sse2::Store(p, v); }
+  };
+
+  struct Int8Ops : IntOps {
+    enum { N = 16, MN = 16 };
+    static void Split(const void* p, V& even, V& odd) {
+      const V x0 = Load(p);
+      const V x1 = Load(static_cast<const uint8_t*>(p) + 16);
+      even = Pack8(x0, x1);
+      odd = Pack8(_mm_srli_epi16(x0, 8), _mm_srli_epi16(x1, 8));
+    }
+  };
+
+  struct Int16Ops : IntOps {
+    enum { N = 8, MN = 8 };
+    static void Split(const void* p, V& even, V& odd) {
+      const V x0 = Load(p);
+      const V x1 = Load(static_cast<const uint16_t*>(p) + 8);
+      even = Pack16(x0, x1);
+      odd = Pack16(_mm_srli_epi32(x0, 16), _mm_srli_epi32(x1, 16));
+    }
+  };
+
+  struct Int32Ops : IntOps {
+    enum { N = 4, MN = 4 };
+    static void Split(const void* p, V& even, V& odd) {
+      const __m128 x0 = _mm_castsi128_ps(Load(p));
+      const __m128 x1 = _mm_castsi128_ps(
+        Load(static_cast<const uint32_t*>(p) + 4)
+      );
+      even = _mm_castps_si128(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0)));
+      odd = _mm_castps_si128(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1)));
+    }
+  };
+
+  template<> struct Ops<uint8_t> : Int8Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return GtU8(a, b); }
+    static V Lo(V a, V b) { return _mm_min_epu8(a, b); }
+    static V Hi(V a, V b) { return _mm_max_epu8(a, b); }
+    static void Mean(const uint8_t* r0, const uint8_t* r1,
+                     const uint8_t* r2, const uint8_t* r3, uint8_t* out) {
+      const uint8_t* rows[4] = {r0, r1, r2, r3};
+      const V lowByte = _mm_set1_epi16(0x00FF);
+      V s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 16);
+        s0 = _mm_add_epi16(s0, _mm_add_epi16(_mm_and_si128(x0, lowByte),
+                                             _mm_srli_epi16(x0, 8)));
+        s1 = _mm_add_epi16(s1, _mm_add_epi16(_mm_and_si128(x1, lowByte),
+                                             _mm_srli_epi16(x1, 8)));
+      }
+      Store(out, Pack8(_mm_srli_epi16(s0, 3), _mm_srli_epi16(s1, 3)));
+    }
+  };
+
+  template<> struct Ops<int8_t> : Int8Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return _mm_cmpgt_epi8(a, b); }
+    // SSE2 has no signed byte min/max, but an unsigned one
+    static V Lo(V a, V b) {
+      const V bias = _mm_set1_epi8(char(0x80));
+      return _mm_xor_si128(_mm_min_epu8(_mm_xor_si128(a, bias),
+                                        _mm_xor_si128(b, bias)), bias);
+    }
+    static V Hi(V a, V b) {
+      const V bias = _mm_set1_epi8(char(0x80));
+      return _mm_xor_si128(_mm_max_epu8(_mm_xor_si128(a, bias),
+                                        _mm_xor_si128(b, bias)), bias);
+    }
+    static void Mean(const int8_t* r0, const int8_t* r1,
+                     const int8_t* r2, const int8_t* r3, int8_t* out) {
+      const int8_t* rows[4] = {r0, r1, r2, r3};
+      V s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 16);
+        s0 = _mm_add_epi16(s0, _mm_add_epi16(
+          _mm_srai_epi16(_mm_slli_epi16(x0, 8), 8), _mm_srai_epi16(x0, 8)
+        ));
+        s1 = _mm_add_epi16(s1, _mm_add_epi16(
+          _mm_srai_epi16(_mm_slli_epi16(x1, 8), 8), _mm_srai_epi16(x1, 8)
+        ));
+      }
+      Store(out, Pack8(TruncDiv8_16(s0), TruncDiv8_16(s1)));
+    }
+  };
+
+  template<> struct Ops<uint16_t> : Int16Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return GtU16(a, b); }
+    // SSE2 has no unsigned short min/max, but a signed one
+    static V Lo(V a, V b) {
+      const V bias = _mm_set1_epi16(short(0x8000));
+      return _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(a, bias),
+                                         _mm_xor_si128(b, bias)), bias);
+    }
+    static V Hi(V a, V b) {
+      const V bias = _mm_set1_epi16(short(0x8000));
+      return _mm_xor_si128(_mm_max_epi16(_mm_xor_si128(a, bias),
+                                         _mm_xor_si128(b, bias)), bias);
+    }
+    static void Mean(const uint16_t* r0, const uint16_t* r1,
+                     const uint16_t* r2, const uint16_t* r3, uint16_t* out) {
+      const uint16_t* rows[4] = {r0, r1, r2, r3};
+      const V lowShort = _mm_set1_epi32(0xFFFF);
+      V s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 8);
+        s0 = _mm_add_epi32(s0, _mm_add_epi32(_mm_and_si128(x0, lowShort),
+                                             _mm_srli_epi32(x0, 16)));
+        s1 = _mm_add_epi32(s1, _mm_add_epi32(_mm_and_si128(x1, lowShort),
+                                             _mm_srli_epi32(x1, 16)));
+      }
+      Store(out, Pack16(_mm_srli_epi32(s0, 3), _mm_srli_epi32(s1, 3)));
+    }
+  };
+
+  template<> struct Ops<int16_t> : Int16Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return _mm_cmpgt_epi16(a, b); }
+    static V Lo(V a, V b) { return _mm_min_epi16(a, b); }
+    static V Hi(V a, V b) { return _mm_max_epi16(a, b); }
+    static void Mean(const int16_t* r0, const int16_t* r1,
+                     const int16_t* r2, const int16_t* r3, int16_t* out) {
+      const int16_t* rows[4] = {r0, r1, r2, r3};
+      V s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 8);
+        s0 = _mm_add_epi32(s0, _mm_add_epi32(
+          _mm_srai_epi32(_mm_slli_epi32(x0, 16), 16), _mm_srai_epi32(x0, 16)
+        ));
+        s1 = _mm_add_epi32(s1, _mm_add_epi32(
+          _mm_srai_epi32(_mm_slli_epi32(x1, 16), 16), _mm_srai_epi32(x1, 16)
+        ));
+      }
+      Store(out, Pack16(TruncDiv8_32(s0), TruncDiv8_32(s1)));
+    }
+  };
+
+  template<> struct Ops<uint32_t> : Int32Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return GtU32(a, b); }
+    static V Lo(V a, V b) { return Sel(Gt(a, b), b, a); }
+    static V Hi(V a, V b) { return Sel(Gt(a, b), a, b); }
+    static void Mean(const uint32_t* r0, const uint32_t* r1,
+                     const uint32_t* r2, const uint32_t* r3, uint32_t* out) {
+      Mean32<false>(r0, r1, r2, r3, out);
+    }
+  };
+
+  template<> struct Ops<int32_t> : Int32Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return _mm_cmpgt_epi32(a, b); }
+    static V Lo(V a, V b) { return Sel(Gt(a, b), b, a); }
+    static V Hi(V a, V b) { return Sel(Gt(a, b), a, b); }
+    static void Mean(const int32_t* r0, const int32_t* r1,
+                     const int32_t* r2, const int32_t* r3, int32_t* out) {
+      Mean32<true>(r0, r1, r2, r3, out);
+    }
+  };
+
+  template<> struct Ops<float> {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    enum { N = 4, MN = 2 };
+    typedef __m128 V;
+    static void Split(const float* p, V& even, V& odd) {
+      const V x0 = _mm_loadu_ps(p), x1 = _mm_loadu_ps(p + 4);
+      even = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0));
+      odd = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1));
+    }
+    static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V Gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+    static V Sel(V m, V x, V y) {
+      return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+    }
+    static V AndNot(V m, V n) { return _mm_andnot_ps(m, n); }
+    // minps/maxps return their second argument unless the comparison
+    // holds, just like the scalar code does for NaNs
+    static V Lo(V a, V b) { return _mm_min_ps(b, a); }
+    static V Hi(V a, V b) { return _mm_max_ps(a, b); }
+
+    static void Load(const float* p, __m128d& even, __m128d& odd) {
+      const V x = _mm_loadu_ps(p);
+      even = _mm_cvtps_pd(_mm_shuffle_ps(x, x, _MM_SHUFFLE(2,0,2,0)));
+      odd = _mm_cvtps_pd(_mm_shuffle_ps(x, x, _MM_SHUFFLE(3,1,3,1)));
+    }
+    static void Store(float* p, __m128d v) {
+      _mm_storel_pi(reinterpret_cast<__m64*>(p), _mm_cvtpd_ps(v));
+    }
+    static void Mean(const float* r0, const float* r1,
+                     const float* r2, const float* r3, float* out) {
+      MeanInDouble<Ops<float> >(r0, r1, r2, r3, out);
+    }
+  };
+
+  template<> struct Ops<double> {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    enum { N = 2, MN = 2 };
+    typedef __m128d V;
+    static void Split(const double* p, V& even, V& odd) {
+      const V x0 = _mm_loadu_pd(p), x1 = _mm_loadu_pd(p + 2);
+      even = _mm_unpacklo_pd(x0, x1);
+      odd = _mm_unpackhi_pd(x0, x1);
+    }
+    static void Store(double* p, V v) { _mm_storeu_pd(p, v); }
+    static V Gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+    static V Sel(V m, V x, V y) {
+      return _mm_or_pd(_mm_and_pd(m, x), _mm_andnot_pd(m, y));
+    }
+    static V AndNot(V m, V n) { return _mm_andnot_pd(m, n); }
+    static V Lo(V a, V b) { return _mm_min_pd(b, a); }
+    static V Hi(V a, V b) { return _mm_max_pd(a, b); }
+
+    static void Load(const double* p, V& even, V& odd) { Split(p, even, odd); }
+    static void Mean(const double* r0, const double* r1,
+                     const double* r2, const double* r3, double* out) {
+      MeanInDouble<Ops<double> >(r0, r1, r2, r3, out);
+    }
+  };
+
+  // there is no 64 bit integer comparison in SSE2; and the mean of 64 bit
+  // integers (rounded to double precision per addition) does not vectorize
+  // without AVX-512, so those stay scalar.
+
+  // same operations in the same order as DOUBLEVECTOR3::length()
+  inline size_t GradientMagnitudeRow(const double* left, const double* right,
+                                     const double* top, const double* bottom,
+                                     const double* front, const double* back,
+                                     double d, double* out, size_t n) {
+    const __m128d vd = _mm_set1_pd(d);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      const __m128d x = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(left + i),
+                                              _mm_loadu_pd(right + i)), vd);
+      const __m128d y = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(top + i),
+                                              _mm_loadu_pd(bottom + i)), vd);
+      const __m128d z = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(front + i),
+                                              _mm_loadu_pd(back + i)), vd);
+      const __m128d sq = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x),
+                                               _mm_mul_pd(y, y)),
+                                    _mm_mul_pd(z, z));
+      _mm_storeu_pd(out + i, _mm_sqrt_pd(sq));
+    }
+    return i;
+  }
+
+  // min_pd returns its second argument for NaNs, which sends the 0/0 of
+  // maxMag == 0 to bin 255 just like std::min(255.0, NaN) does.
+  inline __m128i GradientBins(const double* mag, __m128d vMax) {
+    const __m128d v255 = _mm_set1_pd(255.0);
+    return _mm_cvttpd_epi32(_mm_min_pd(
+      _mm_mul_pd(_mm_div_pd(_mm_loadu_pd(mag), vMax), v255), v255));
+  }
+  inline size_t GradientBinRow(const double* mag, double maxMag,
+                               uint8_t* out, size_t n) {
+    const __m128d vMax = _mm_set1_pd(maxMag);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128i lo = _mm_unpacklo_epi64(GradientBins(mag + i, vMax),
+                                            GradientBins(mag + i + 2, vMax));
+      const __m128i hi = _mm_unpacklo_epi64(GradientBins(mag + i + 4, vMax),
+                                            GradientBins(mag + i + 6, vMax));
+      const __m128i w = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(w, w));
+    }
+    return i;
+  }
+
+  // cvttpd_epi32 leaves two int32 in the low half; the results are in
+  // [0, 65535], which packs_epi32 only takes after moving them into the
+  // range of int16 (there is no packus_epi32 before SSE4.1).
+  inline __m128i QuantizeLanes(__m128d x, __m128d vScale, __m128d vMax) {
+    return _mm_cvttpd_epi32(_mm_min_pd(_mm_mul_pd(x, vScale), vMax));
+  }
+  inline void StoreQuantized(uint16_t* out, __m128i a, __m128i b,
+                             __m128i c, __m128i d) {
+    const __m128i vBias = _mm_set1_epi32(0x8000);
+    const __m128i lo = _mm_sub_epi32(_mm_unpacklo_epi64(a, b), vBias);
+    const __m128i hi = _mm_sub_epi32(_mm_unpacklo_epi64(c, d), vBias);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                     _mm_xor_si128(_mm_packs_epi32(lo, hi),
+                                   _mm_set1_epi16(short(0x8000))));
+  }
+
+  inline size_t QuantizeRow(const float* in, float mn, double scale,
+                            double maxOut, uint16_t* out, size_t n) {
+    const __m128 vMin = _mm_set1_ps(mn);
+    const __m128d vScale = _mm_set1_pd(scale);
+    const __m128d vMax = _mm_set1_pd(maxOut);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128 a = _mm_sub_ps(_mm_loadu_ps(in + i), vMin);
+      const __m128 b = _mm_sub_ps(_mm_loadu_ps(in + i + 4), vMin);
+      StoreQuantized(out + i,
+        QuantizeLanes(_mm_cvtps_pd(a), vScale, vMax),
+        QuantizeLanes(_mm_cvtps_pd(_mm_movehl_ps(a, a)), vScale, vMax),
+        QuantizeLanes(_mm_cvtps_pd(b), vScale, vMax),
+        QuantizeLanes(_mm_cvtps_pd(_mm_movehl_ps(b, b)), vScale, vMax));
+    }
+    return i;
+  }
+
+  inline size_t QuantizeRow(const double* in, double mn, double scale,
+                            double maxOut, uint16_t* out, size_t n) {
+    const __m128d vMin = _mm_set1_pd(mn);
+    const __m128d vScale = _mm_set1_pd(scale);
+    const __m128d vMax = _mm_set1_pd(maxOut);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      StoreQuantized(out + i,
+        QuantizeLanes(_mm_sub_pd(_mm_loadu_pd(in + i), vMin), vScale, vMax),
+        QuantizeLanes(_mm_sub_pd(_mm_loadu_pd(in + i + 2), vMin), vScale,
+                      vMax),
+        QuantizeLanes(_mm_sub_pd(_mm_loadu_pd(in + i + 4), vMin), vScale,
+                      vMax),
+        QuantizeLanes(_mm_sub_pd(_mm_loadu_pd(in + i + 6), vMin), vScale,
+                      vMax));
+    }
+    return i;
+  }
+
+  // there is no unsigned conversion either: flip the sign bit, convert
+  // as int32 and add 2^31 back, which is exact in double precision.
+  inline __m128d UnsignedToDouble(__m128i v) {
+    return _mm_add_pd(_mm_cvtepi32_pd(_mm_xor_si128(
+                        v, _mm_set1_epi32(int(0x80000000u)))),
+                      _mm_set1_pd(2147483648.0));
+  }
+  inline size_t QuantizeRow(const uint32_t* in, uint32_t mn, double scale,
+                            double maxOut, uint16_t* out, size_t n) {
+    const __m128i vMin = _mm_set1_epi32(int(mn));
+    const __m128d vScale = _mm_set1_pd(scale);
+    const __m128d vMax = _mm_set1_pd(maxOut);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128i a = _mm_sub_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), vMin);
+      const __m128i b = _mm_sub_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)), vMin);
+      StoreQuantized(out + i,
+        QuantizeLanes(UnsignedToDouble(a), vScale, vMax),
+        QuantizeLanes(UnsignedToDouble(_mm_unpackhi_epi64(a, a)), vScale,
+                      vMax),
+        QuantizeLanes(UnsignedToDouble(b), vScale, vMax),
+        QuantizeLanes(UnsignedToDouble(_mm_unpackhi_epi64(b, b)), vScale,
+                      vMax));
+    }
+    return i;
+  }
+
+  // element-wise extrema and saturating sum for MergeRow in the .inc;
+  // Max(acc, in) is std::max(acc, in) and Min(acc, in) std::min(acc, in),
+  // also for NaNs and signed zeros.
+  template<typename T> struct MergeOps {
+    static const bool bVectorized = false;
+  };
+  struct IntMergeOps : IntOps {
+    static const bool bVectorized = true;
+    static V Load(const void* p) { return sse2::Load(p); }
+  };
+  template<> struct MergeOps<uint8_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm_max_epu8(a, b); }
+    static V Min(V a, V b) { return _mm_min_epu8(a, b); }
+    static V Add(V a, V b) { return _mm_adds_epu8(a, b); }
+  };
+  template<> struct MergeOps<int8_t> : IntMergeOps {
+    static V Max(V a, V b) { return Sel(_mm_cmpgt_epi8(b, a), b, a); }
+    static V Min(V a, V b) { return Sel(_mm_cmpgt_epi8(a, b), b, a); }
+    static V Add(V a, V b) { return _mm_adds_epi8(a, b); }
+  };
+  template<> struct MergeOps<uint16_t> : IntMergeOps {
+    static V Max(V a, V b) { return Sel(GtU16(b, a), b, a); }
+    static V Min(V a, V b) { return Sel(GtU16(a, b), b, a); }
+    static V Add(V a, V b) { return _mm_adds_epu16(a, b); }
+  };
+  template<> struct MergeOps<int16_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm_max_epi16(a, b); }
+    static V Min(V a, V b) { return _mm_min_epi16(a, b); }
+    static V Add(V a, V b) { return _mm_adds_epi16(a, b); }
+  };
+  template<> struct MergeOps<uint32_t> : IntMergeOps {
+    static V Max(V a, V b) { return Sel(GtU32(b, a), b, a); }
+    static V Min(V a, V b) { return Sel(GtU32(a, b), b, a); }
+    // the sum wrapped around iff it is below a
+    static V Add(V a, V b) {
+      const V s = _mm_add_epi32(a, b);
+      return _mm_or_si128(s, GtU32(a, s));
+    }
+  };
+  template<> struct MergeOps<int32_t> : IntMergeOps {
+    static V Max(V a, V b) { return Sel(_mm_cmpgt_epi32(b, a), b, a); }
+    static V Min(V a, V b) { return Sel(_mm_cmpgt_epi32(a, b), b, a); }
+    // the sum overflowed iff its sign differs from the one of both
+    // operands; it then saturates towards the sign of a.
+    static V Add(V a, V b) {
+      const V s = _mm_add_epi32(a, b);
+      const V overflow = _mm_srai_epi32(
+        _mm_and_si128(_mm_xor_si128(a, s), _mm_xor_si128(b, s)), 31);
+      const V limit = _mm_xor_si128(_mm_srai_epi32(a, 31),
+                                    _mm_set1_epi32(0x7FFFFFFF));
+      return Sel(overflow, limit, s);
+    }
+  };
+  template<> struct MergeOps<float> {
+    static const bool bVectorized = true;
+    typedef __m128 V;
+    static V Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V Max(V a, V b) { return _mm_max_ps(b, a); }
+    static V Min(V a, V b) { return _mm_min_ps(b, a); }
+    static V Add(V a, V b) { return _mm_add_ps(a, b); }
+  };
+  template<> struct MergeOps<double> {
+    static const bool bVectorized = true;
+    typedef __m128d V;
+    static V Load(const double* p) { return _mm_loadu_pd(p); }
+    static void Store(double* p, V v) { _mm_storeu_pd(p, v); }
+    static V Max(V a, V b) { return _mm_max_pd(b, a); }
+    static V Min(V a, V b) { return _mm_min_pd(b, a); }
+    static V Add(V a, V b) { return _mm_add_pd(a, b); }
+  };
+
+  // the operators of BinaryRow and SelectRow for the .inc; comparisons are
+  // lane masks, which And() turns into 1.0 and 0.0.
+  struct ExprOps {
+    typedef __m128d V;
+    static const size_t N = 2;
+    static V Load(const double* p) { return _mm_loadu_pd(p); }
+    static void Store(double* p, V v) { _mm_storeu_pd(p, v); }
+    static V Set(double x) { return _mm_set1_pd(x); }
+    static V Add(V a, V b) { return _mm_add_pd(a, b); }
+    static V Sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V Mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V Div(V a, V b) { return _mm_div_pd(a, b); }
+    static V Gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+    static V Lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+    // true for NaNs, too
+    static V NotZero(V a) { return _mm_cmpneq_pd(a, _mm_setzero_pd()); }
+    static V Abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static V And(V m, V a) { return _mm_and_pd(m, a); }
+    static V Sel(V m, V a, V b) {
+      return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));
+    }
+  };
+
+#include "VolumeToolsSIMD.inc"
+}
+
+// everything in the avx2 namespace is compiled for AVX2, independent of the
+// compiler flags of the rest of the library; it is only ever called after
+// DetectSIMDLevel found a CPU which supports it.
+#if defined(__clang__)
+# pragma clang attribute push (__attribute__((target("avx2"))), \
+                               apply_to = function)
+#elif defined(__GNUC__)
+# pragma GCC push_options
+# pragma GCC target("avx2")
+#endif
+
+namespace avx2 {
+
+  template<typename T> struct Ops {
+    static const bool bMedian = false;
+    static const bool bMean = false;
+  };
+
+  inline __m256i Load(const void* p) {
+    return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+  }
+  // the pack and unpack instructions work on the two 128 bit halves
+  // separately, so after Split the 64 bit quarters of a register are
+  // ordered 0 2 1 3.  Store puts them back in order.
+  inline void Store(void* p, __m256i v) {
+    _mm256_storeu_si256(static_cast<__m256i*>(p),
+                        _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3,1,2,0)));
+  }
+
+  inline __m256i Pack8(__m256i x, __m256i y) {
+    const __m256i lowByte = _mm256_set1_epi16(0x00FF);
+    return _mm256_packus_epi16(_mm256_and_si256(x, lowByte),
+                               _mm256_and_si256(y, lowByte));
+  }
+  inline __m256i Pack16(__m256i x, __m256i y) {
+    return _mm256_packs_epi32(
+      _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16),
+      _mm256_srai_epi32(_mm256_slli_epi32(y, 16), 16)
+    );
+  }
+
+  inline __m256i TruncDiv8_16(__m256i s) {
+    s = _mm256_add_epi16(s, _mm256_and_si256(_mm256_srai_epi16(s, 15),
+                                             _mm256_set1_epi16(7)));
+    return _mm256_srai_epi16(s, 3);
+  }
+  inline __m256i TruncDiv8_32(__m256i s) {
+    s = _mm256_add_epi32(s, _mm256_and_si256(_mm256_srai_epi32(s, 31),
+                                             _mm256_set1_epi32(7)));
+    return _mm256_srai_epi32(s, 3);
+  }
+
+  inline __m256i PairSum32(__m256i x) {
+    const __m256i lowHalf = _mm256_set1_epi64x(0xFFFFFFFF);
+    return _mm256_add_epi64(_mm256_and_si256(x, lowHalf),
+                            _mm256_srli_epi64(x, 32));
+  }
+  inline __m256i TruncDiv8_64(__m256i s) {
+    const __m256i negative = _mm256_shuffle_epi32(_mm256_srai_epi32(s, 31),
+                                                  _MM_SHUFFLE(3,3,1,1));
+    s = _mm256_add_epi64(s, _mm256_and_si256(negative,
+                                             _mm256_set1_epi64x(7)));
+    return _mm256_srli_epi64(s, 3);
+  }
+
+  // see sse2::Mean32
+  template<bool bSigned, typename T>
+  void Mean32(const T* r0, const T* r1, const T* r2, const T* r3, T* out) {
+    const T* rows[4] = {r0, r1, r2, r3};
+    const __m256i bias = _mm256_set1_epi32(bSigned ? int(0x80000000) : 0);
+    __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+    for (int r = 0; r < 4; ++r) {
+      s0 = _mm256_add_epi64(s0, PairSum32(_mm256_xor_si256(Load(rows[r]),
+                                                           bias)));
+      s1 = _mm256_add_epi64(s1, PairSum32(_mm256_xor_si256(Load(rows[r] + 8),
+                                                           bias)));
+    }
+    if (bSigned) {
+      const __m256i eightBiases = _mm256_set1_epi64x(int64_t(1) << 34);
+      s0 = TruncDiv8_64(_mm256_sub_epi64(s0, eightBiases));
+      s1 = TruncDiv8_64(_mm256_sub_epi64(s1, eightBiases));
+    } else {
+      s0 = _mm256_srli_epi64(s0, 3);
+      s1 = _mm256_srli_epi64(s1, 3);
+    }
+    Store(out, _mm256_castps_si256(_mm256_shuffle_ps(
+      _mm256_castsi256_ps(s0), _mm256_castsi256_ps(s1), _MM_SHUFFLE(2,0,2,0)
+    )));
+  }
+
+  // four outputs at a time, see sse2::MeanInDouble
+  template<class D, typename T>
+  void MeanInDouble(const T* r0, const T* r1, const T* r2, const T* r3,
+                    T* out) {
+    __m256d e0, e1, e2, e3, o0, o1, o2, o3;
+    D::Load(r0, e0, o0);
+    D::Load(r1, e1, o1);
+    D::Load(r2, e2, o2);
+    D::Load(r3, e3, o3);
+    __m256d s = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(e0, e1), e2), e3);
+    s = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_add_pd(s, o0), o1),
+                                    o2), o3);
+    D::Store(out, _mm256_mul_pd(s, _mm256_set1_pd(0.125)));
+  }
+
+  struct IntOps {
+    typedef __m256i V;
+    static V Sel(V m, V x, V y) { return _mm256_blendv_epi8(y, x, m); }
+    static V AndNot(V m, V n) { return _mm256_andnot_si256(m, n); }
+    static void Store(void* p, V v) { avx2::Store(p, v); }
+  };
+
+  struct Int8Ops : IntOps {
+    enum { N = 32, MN = 32 };
+    static void Split(const void* p, V& even, V& odd) {
+      const V x0 = Load(p);
+      const V x1 = Load(static_cast<const uint8_t*>(p) + 32);
+      even = Pack8(x0, x1);
+      odd = Pack8(_mm256_srli_epi16(x0, 8), _mm256_srli_epi16(x1, 8));
+    }
+  };
+
+  struct Int16Ops : IntOps {
+    enum { N = 16, MN = 16 };
+    static void Split(const void* p, V& even, V& odd) {
+      const V x0 = Load(p);
+      const V x1 = Load(static_cast<const uint16_t*>(p) + 16);
+      even = Pack16(x0, x1);
+      odd = Pack16(_mm256_srli_epi32(x0, 16), _mm256_srli_epi32(x1, 16));
+    }
+  };
+
+  struct Int32Ops : IntOps {
+    enum { N = 8, MN = 8 };
+    static void Split(const void* p, V& even, V& odd) {
+      const __m256 x0 = _mm256_castsi256_ps(Load(p));
+      const __m256 x1 = _mm256_castsi256_ps(
+        Load(static_cast<const uint32_t*>(p) + 8)
+      );
+      even = _mm256_castps_si256(
+        _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0))
+      );
+      odd = _mm256_castps_si256(
+        _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1))
+      );
+    }
+  };
+
+  struct Int64Ops : IntOps {
+    enum { N = 4 };
+    static void Split(const void* p, V& even, V& odd) {
+      const V x0 = Load(p);
+      const V x1 = Load(static_cast<const uint64_t*>(p) + 4);
+      even = _mm256_unpacklo_epi64(x0, x1);
+      odd = _mm256_unpackhi_epi64(x0, x1);
+    }
+  };
+
+  template<> struct Ops<uint8_t> : Int8Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) {
+      const V bias = _mm256_set1_epi8(char(0x80));
+      return _mm256_cmpgt_epi8(_mm256_xor_si256(a, bias),
+                               _mm256_xor_si256(b, bias));
+    }
+    static V Lo(V a, V b) { return _mm256_min_epu8(a, b); }
+    static V Hi(V a, V b) { return _mm256_max_epu8(a, b); }
+    static void Mean(const uint8_t* r0, const uint8_t* r1,
+                     const uint8_t* r2, const uint8_t* r3, uint8_t* out) {
+      const uint8_t* rows[4] = {r0, r1, r2, r3};
+      const V lowByte = _mm256_set1_epi16(0x00FF);
+      V s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 32);
+        s0 = _mm256_add_epi16(s0, _mm256_add_epi16(
+          _mm256_and_si256(x0, lowByte), _mm256_srli_epi16(x0, 8)
+        ));
+        s1 = _mm256_add_epi16(s1, _mm256_add_epi16(
+          _mm256_and_si256(x1, lowByte), _mm256_srli_epi16(x1, 8)
+        ));
+      }
+      Store(out, Pack8(_mm256_srli_epi16(s0, 3), _mm256_srli_epi16(s1, 3)));
+    }
+  };
+
+  template<> struct Ops<int8_t> : Int8Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return _mm256_cmpgt_epi8(a, b); }
+    static V Lo(V a, V b) { return _mm256_min_epi8(a, b); }
+    static V Hi(V a, V b) { return _mm256_max_epi8(a, b); }
+    static void Mean(const int8_t* r0, const int8_t* r1,
+                     const int8_t* r2, const int8_t* r3, int8_t* out) {
+      const int8_t* rows[4] = {r0, r1, r2, r3};
+      V s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 32);
+        s0 = _mm256_add_epi16(s0, _mm256_add_epi16(
+          _mm256_srai_epi16(_mm256_slli_epi16(x0, 8), 8),
+          _mm256_srai_epi16(x0, 8)
+        ));
+        s1 = _mm256_add_epi16(s1, _mm256_add_epi16(
+          _mm256_srai_epi16(_mm256_slli_epi16(x1, 8), 8),
+          _mm256_srai_epi16(x1, 8)
+        ));
+      }
+      Store(out, Pack8(TruncDiv8_16(s0), TruncDiv8_16(s1)));
+    }
+  };
+
+  template<> struct Ops<uint16_t> : Int16Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) {
+      const V bias = _mm256_set1_epi16(short(0x8000));
+      return _mm256_cmpgt_epi16(_mm256_xor_si256(a, bias),
+                                _mm256_xor_si256(b, bias));
+    }
+    static V Lo(V a, V b) { return _mm256_min_epu16(a, b); }
+    static V Hi(V a, V b) { return _mm256_max_epu16(a, b); }
+    static void Mean(const uint16_t* r0, const uint16_t* r1,
+                     const uint16_t* r2, const uint16_t* r3, uint16_t* out) {
+      const uint16_t* rows[4] = {r0, r1, r2, r3};
+      const V lowShort = _mm256_set1_epi32(0xFFFF);
+      V s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 16);
+        s0 = _mm256_add_epi32(s0, _mm256_add_epi32(
+          _mm256_and_si256(x0, lowShort), _mm256_srli_epi32(x0, 16)
+        ));
+        s1 = _mm256_add_epi32(s1, _mm256_add_epi32(
+          _mm256_and_si256(x1, lowShort), _mm256_srli_epi32(x1, 16)
+        ));
+      }
+      Store(out, Pack16(_mm256_srli_epi32(s0, 3), _mm256_srli_epi32(s1, 3)));
+    }
+  };
+
+  template<> struct Ops<int16_t> : Int16Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return _mm256_cmpgt_epi16(a, b); }
+    static V Lo(V a, V b) { return _mm256_min_epi16(a, b); }
+    static V Hi(V a, V b) { return _mm256_max_epi16(a, b); }
+    static void Mean(const int16_t* r0, const int16_t* r1,
+                     const int16_t* r2, const int16_t* r3, int16_t* out) {
+      const int16_t* rows[4] = {r0, r1, r2, r3};
+      V s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+      for (int r = 0; r < 4; ++r) {
+        const V x0 = Load(rows[r]), x1 = Load(rows[r] + 16);
+        s0 = _mm256_add_epi32(s0, _mm256_add_epi32(
+          _mm256_srai_epi32(_mm256_slli_epi32(x0, 16), 16),
+          _mm256_srai_epi32(x0, 16)
+        ));
+        s1 = _mm256_add_epi32(s1, _mm256_add_epi32(
+          _mm256_srai_epi32(_mm256_slli_epi32(x1, 16), 16),
+          _mm256_srai_epi32(x1, 16)
+        ));
+      }
+      Store(out, Pack16(TruncDiv8_32(s0), TruncDiv8_32(s1)));
+    }
+  };
+
+  template<> struct Ops<uint32_t> : Int32Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) {
+      const V bias = _mm256_set1_epi32(int(0x80000000));
+      return _mm256_cmpgt_epi32(_mm256_xor_si256(a, bias),
+                                _mm256_xor_si256(b, bias));
+    }
+    static V Lo(V a, V b) { return _mm256_min_epu32(a, b); }
+    static V Hi(V a, V b) { return _mm256_max_epu32(a, b); }
+    static void Mean(const uint32_t* r0, const uint32_t* r1,
+                     const uint32_t* r2, const uint32_t* r3, uint32_t* out) {
+      Mean32<false>(r0, r1, r2, r3, out);
+    }
+  };
+
+  template<> struct Ops<int32_t> : Int32Ops {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    static V Gt(V a, V b) { return _mm256_cmpgt_epi32(a, b); }
+    static V Lo(V a, V b) { return _mm256_min_epi32(a, b); }
+    static V Hi(V a, V b) { return _mm256_max_epi32(a, b); }
+    static void Mean(const int32_t* r0, const int32_t* r1,
+                     const int32_t* r2, const int32_t* r3, int32_t* out) {
+      Mean32<true>(r0, r1, r2, r3, out);
+    }
+  };
+
+  // the mean of 64 bit integers stays scalar, AVX2 cannot convert them
+  // to double.
+  template<> struct Ops<uint64_t> : Int64Ops {
+    static const bool bMedian = true;
+    static const bool bMean = false;
+    static V Gt(V a, V b) {
+      const V bias = _mm256_set1_epi64x(int64_t(0x8000000000000000ULL));
+      return _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias),
+                                _mm256_xor_si256(b, bias));
+    }
+    static V Lo(V a, V b) { return Sel(Gt(a, b), b, a); }
+    static V Hi(V a, V b) { return Sel(Gt(a, b), a, b); }
+  };
+
+  template<> struct Ops<int64_t> : Int64Ops {
+    static const bool bMedian = true;
+    static const bool bMean = false;
+    static V Gt(V a, V b) { return _mm256_cmpgt_epi64(a, b); }
+    static V Lo(V a, V b) { return Sel(Gt(a, b), b, a); }
+    static V Hi(V a, V b) { return Sel(Gt(a, b), a, b); }
+  };
+
+  template<> struct Ops<float> {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    enum { N = 8, MN = 4 };
+    typedef __m256 V;
+    static void Split(const float* p, V& even, V& odd) {
+      const V x0 = _mm256_loadu_ps(p), x1 = _mm256_loadu_ps(p + 8);
+      even = _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0));
+      odd = _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1));
+    }
+    static void Store(float* p, V v) {
+      _mm256_storeu_ps(p, _mm256_castpd_ps(_mm256_permute4x64_pd(
+        _mm256_castps_pd(v), _MM_SHUFFLE(3,1,2,0)
+      )));
+    }
+    // ordered comparison: false for NaNs, like the scalar operator >
+    static V Gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static V Sel(V m, V x, V y) { return _mm256_blendv_ps(y, x, m); }
+    static V AndNot(V m, V n) { return _mm256_andnot_ps(m, n); }
+    static V Lo(V a, V b) { return _mm256_min_ps(b, a); }
+    static V Hi(V a, V b) { return _mm256_max_ps(a, b); }
+
+    static void Load(const float* p, __m256d& even, __m256d& odd) {
+      const __m128 x0 = _mm_loadu_ps(p), x1 = _mm_loadu_ps(p + 4);
+      even = _mm256_cvtps_pd(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2,0,2,0)));
+      odd = _mm256_cvtps_pd(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3,1,3,1)));
+    }
+    static void Store(float* p, __m256d v) {
+      _mm_storeu_ps(p, _mm256_cvtpd_ps(v));
+    }
+    static void Mean(const float* r0, const float* r1,
+                     const float* r2, const float* r3, float* out) {
+      MeanInDouble<Ops<float> >(r0, r1, r2, r3, out);
+    }
+  };
+
+  template<> struct Ops<double> {
+    static const bool bMedian = true;
+    static const bool bMean = true;
+    enum { N = 4, MN = 4 };
+    typedef __m256d V;
+    static void Split(const double* p, V& even, V& odd) {
+      const V x0 = _mm256_loadu_pd(p), x1 = _mm256_loadu_pd(p + 4);
+      even = _mm256_unpacklo_pd(x0, x1);
+      odd = _mm256_unpackhi_pd(x0, x1);
+    }
+    static void Store(double* p, V v) {
+      _mm256_storeu_pd(p, _mm256_permute4x64_pd(v, _MM_SHUFFLE(3,1,2,0)));
+    }
+    static V Gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static V Sel(V m, V x, V y) { return _mm256_blendv_pd(y, x, m); }
+    static V AndNot(V m, V n) { return _mm256_andnot_pd(m, n); }
+    static V Lo(V a, V b) { return _mm256_min_pd(b, a); }
+    static V Hi(V a, V b) { return _mm256_max_pd(a, b); }
+
+    // the mean works lane by lane, so it can use the shuffled order, too
+    static void Load(const double* p, V& even, V& odd) { Split(p, even, odd); }
+    static void Mean(const double* r0, const double* r1,
+                     const double* r2, const double* r3, double* out) {
+      MeanInDouble<Ops<double> >(r0, r1, r2, r3, out);
+    }
+  };
+
+  inline size_t GradientMagnitudeRow(const double* left, const double* right,
+                                     const double* top, const double* bottom,
+                                     const double* front, const double* back,
+                                     double d, double* out, size_t n) {
+    const __m256d vd = _mm256_set1_pd(d);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m256d x = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(left + i),
+                                                    _mm256_loadu_pd(right + i)),
+                                      vd);
+      const __m256d y = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(top + i),
+                                                    _mm256_loadu_pd(bottom + i)),
+                                      vd);
+      const __m256d z = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(front + i),
+                                                    _mm256_loadu_pd(back + i)),
+                                      vd);
+      const __m256d sq = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x),
+                                                     _mm256_mul_pd(y, y)),
+                                       _mm256_mul_pd(z, z));
+      _mm256_storeu_pd(out + i, _mm256_sqrt_pd(sq));
+    }
+    return i + sse2::GradientMagnitudeRow(left + i, right + i, top + i,
+                                          bottom + i, front + i, back + i,
+                                          d, out + i, n - i);
+  }
+
+  inline __m128i GradientBins(const double* mag, __m256d vMax) {
+    const __m256d v255 = _mm256_set1_pd(255.0);
+    return _mm256_cvttpd_epi32(_mm256_min_pd(
+      _mm256_mul_pd(_mm256_div_pd(_mm256_loadu_pd(mag), vMax), v255), v255));
+  }
+  inline size_t GradientBinRow(const double* mag, double maxMag,
+                               uint8_t* out, size_t n) {
+    const __m256d vMax = _mm256_set1_pd(maxMag);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128i w = _mm_packs_epi32(GradientBins(mag + i, vMax),
+                                        GradientBins(mag + i + 4, vMax));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(w, w));
+    }
+    return i;
+  }
+
+  inline __m128i QuantizeLanes(__m256d x, __m256d vScale, __m256d vMax) {
+    return _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_mul_pd(x, vScale), vMax));
+  }
+  // SSE4.1 comes with AVX2, so the results pack without the int16 bias.
+  inline void StoreQuantized(uint16_t* out, __m128i lo, __m128i hi) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                     _mm_packus_epi32(lo, hi));
+  }
+
+  inline size_t QuantizeRow(const float* in, float mn, double scale,
+                            double maxOut, uint16_t* out, size_t n) {
+    const __m256 vMin = _mm256_set1_ps(mn);
+    const __m256d vScale = _mm256_set1_pd(scale);
+    const __m256d vMax = _mm256_set1_pd(maxOut);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256 x = _mm256_sub_ps(_mm256_loadu_ps(in + i), vMin);
+      StoreQuantized(out + i,
+        QuantizeLanes(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), vScale,
+                      vMax),
+        QuantizeLanes(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), vScale,
+                      vMax));
+    }
+    return i;
+  }
+
+  inline size_t QuantizeRow(const double* in, double mn, double scale,
+                            double maxOut, uint16_t* out, size_t n) {
+    const __m256d vMin = _mm256_set1_pd(mn);
+    const __m256d vScale = _mm256_set1_pd(scale);
+    const __m256d vMax = _mm256_set1_pd(maxOut);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      StoreQuantized(out + i,
+        QuantizeLanes(_mm256_sub_pd(_mm256_loadu_pd(in + i), vMin), vScale,
+                      vMax),
+        QuantizeLanes(_mm256_sub_pd(_mm256_loadu_pd(in + i + 4), vMin),
+                      vScale, vMax));
+    }
+    return i;
+  }
+
+  inline __m256d UnsignedToDouble(__m128i v) {
+    return _mm256_add_pd(_mm256_cvtepi32_pd(_mm_xor_si128(
+                           v, _mm_set1_epi32(int(0x80000000u)))),
+                         _mm256_set1_pd(2147483648.0));
+  }
+  inline size_t QuantizeRow(const uint32_t* in, uint32_t mn, double scale,
+                            double maxOut, uint16_t* out, size_t n) {
+    const __m256i vMin = _mm256_set1_epi32(int(mn));
+    const __m256d vScale = _mm256_set1_pd(scale);
+    const __m256d vMax = _mm256_set1_pd(maxOut);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i x = _mm256_sub_epi32(Load(in + i), vMin);
+      StoreQuantized(out + i,
+        QuantizeLanes(UnsignedToDouble(_mm256_castsi256_si128(x)), vScale,
+                      vMax),
+        QuantizeLanes(UnsignedToDouble(_mm256_extracti128_si256(x, 1)),
+                      vScale, vMax));
+    }
+    return i;
+  }
+
+  template<typename T> struct MergeOps {
+    static const bool bVectorized = false;
+  };
+  struct IntMergeOps {
+    static const bool bVectorized = true;
+    typedef __m256i V;
+    static V Load(const void* p) { return avx2::Load(p); }
+    static void Store(void* p, V v) {
+      _mm256_storeu_si256(static_cast<__m256i*>(p), v);
+    }
+  };
+  template<> struct MergeOps<uint8_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm256_max_epu8(a, b); }
+    static V Min(V a, V b) { return _mm256_min_epu8(a, b); }
+    static V Add(V a, V b) { return _mm256_adds_epu8(a, b); }
+  };
+  template<> struct MergeOps<int8_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm256_max_epi8(a, b); }
+    static V Min(V a, V b) { return _mm256_min_epi8(a, b); }
+    static V Add(V a, V b) { return _mm256_adds_epi8(a, b); }
+  };
+  template<> struct MergeOps<uint16_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm256_max_epu16(a, b); }
+    static V Min(V a, V b) { return _mm256_min_epu16(a, b); }
+    static V Add(V a, V b) { return _mm256_adds_epu16(a, b); }
+  };
+  template<> struct MergeOps<int16_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm256_max_epi16(a, b); }
+    static V Min(V a, V b) { return _mm256_min_epi16(a, b); }
+    static V Add(V a, V b) { return _mm256_adds_epi16(a, b); }
+  };
+  template<> struct MergeOps<uint32_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm256_max_epu32(a, b); }
+    static V Min(V a, V b) { return _mm256_min_epu32(a, b); }
+    // the sum wrapped around iff it is below a
+    static V Add(V a, V b) {
+      const V s = _mm256_add_epi32(a, b);
+      const V noWrap = _mm256_cmpeq_epi32(_mm256_max_epu32(a, s), s);
+      return _mm256_or_si256(s, _mm256_xor_si256(noWrap,
+                                                 _mm256_set1_epi32(-1)));
+    }
+  };
+  template<> struct MergeOps<int32_t> : IntMergeOps {
+    static V Max(V a, V b) { return _mm256_max_epi32(a, b); }
+    static V Min(V a, V b) { return _mm256_min_epi32(a, b); }
+    static V Add(V a, V b) {
+      const V s = _mm256_add_epi32(a, b);
+      const V overflow = _mm256_srai_epi32(
+        _mm256_and_si256(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)), 31);
+      const V limit = _mm256_xor_si256(_mm256_srai_epi32(a, 31),
+                                       _mm256_set1_epi32(0x7FFFFFFF));
+      return _mm256_blendv_epi8(s, limit, overflow);
+    }
+  };
+  template<> struct MergeOps<float> {
+    static const bool bVectorized = true;
+    typedef __m256 V;
+    static V Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V Max(V a, V b) { return _mm256_max_ps(b, a); }
+    static V Min(V a, V b) { return _mm256_min_ps(b, a); }
+    static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+  };
+  template<> struct MergeOps<double> {
+    static const bool bVectorized = true;
+    typedef __m256d V;
+    static V Load(const double* p) { return _mm256_loadu_pd(p); }
+    static void Store(double* p, V v) { _mm256_storeu_pd(p, v); }
+    static V Max(V a, V b) { return _mm256_max_pd(b, a); }
+    static V Min(V a, V b) { return _mm256_min_pd(b, a); }
+    static V Add(V a, V b) { return _mm256_add_pd(a, b); }
+  };
+
+  struct ExprOps {
+    typedef __m256d V;
+    static const size_t N = 4;
+    static V Load(const double* p) { return _mm256_loadu_pd(p); }
+    static void Store(double* p, V v) { _mm256_storeu_pd(p, v); }
+    static V Set(double x) { return _mm256_set1_pd(x); }
+    static V Add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V Sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V Mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V Div(V a, V b) { return _mm256_div_pd(a, b); }
+    static V Gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static V Lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static V NotZero(V a) {
+      return _mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_NEQ_UQ);
+    }
+    static V Abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static V And(V m, V a) { return _mm256_and_pd(m, a); }
+    static V Sel(V m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+  };
+
+#include "VolumeToolsSIMD.inc"
+}
+
+#if defined(__clang__)
+# pragma clang attribute pop
+#elif defined(__GNUC__)
+# pragma GCC pop_options
+#endif
+
+#endif // VOLUMETOOLS_X86
+
+template<typename T, bool bComputeMedian>
+void DownsampleRow(const T* r0, const T* r1, const T* r2, const T* r3,
+                   T* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::Row<T, bComputeMedian>(r0, r1, r2, r3, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::Row<T, bComputeMedian>(r0, r1, r2, r3, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = Filter<T, double, bComputeMedian>(r0[2*i], r1[2*i],
+                                               r2[2*i], r3[2*i],
+                                               r0[2*i+1], r1[2*i+1],
+                                               r2[2*i+1], r3[2*i+1]);
+}
+
+void GradientMagnitudeRow(const double* left, const double* right,
+                          const double* top, const double* bottom,
+                          const double* front, const double* back,
+                          double d, double* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::GradientMagnitudeRow(left, right, top, bottom, front, back,
+                                     d, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::GradientMagnitudeRow(left, right, top, bottom, front, back,
+                                     d, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = DOUBLEVECTOR3((left[i] - right[i]) / d,
+                           (top[i] - bottom[i]) / d,
+                           (front[i] - back[i]) / d).length();
+}
+
+void GradientBinRow(const double* mag, double maxMag, uint8_t* out,
+                    size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::GradientBinRow(mag, maxMag, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::GradientBinRow(mag, maxMag, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = uint8_t(std::min(255.0, mag[i] / maxMag * 255.0));
+}
+
+void QuantizeRow(const float* in, float mn, double scale, double maxOut,
+                 uint16_t* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::QuantizeRow(in, mn, scale, maxOut, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::QuantizeRow(in, mn, scale, maxOut, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = uint16_t(std::min(maxOut, double(in[i] - mn) * scale));
+}
+
+void QuantizeRow(const double* in, double mn, double scale, double maxOut,
+                 uint16_t* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::QuantizeRow(in, mn, scale, maxOut, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::QuantizeRow(in, mn, scale, maxOut, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = uint16_t(std::min(maxOut, (in[i] - mn) * scale));
+}
+
+void QuantizeRow(const uint32_t* in, uint32_t mn, double scale,
+                 double maxOut, uint16_t* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::QuantizeRow(in, mn, scale, maxOut, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::QuantizeRow(in, mn, scale, maxOut, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = uint16_t(std::min(maxOut, double(uint32_t(in[i] - mn)) * scale));
+}
+
+template<typename T> void MaxRow(T* acc, const T* in, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::MaxRow(acc, in, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::MaxRow(acc, in, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    acc[i] = std::max(acc[i], in[i]);
+}
+
+template<typename T> void MinRow(T* acc, const T* in, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::MinRow(acc, in, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::MinRow(acc, in, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    acc[i] = std::min(acc[i], in[i]);
+}
+
+template<typename T> void SaturatingAddRow(T* acc, const T* in, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::SaturatingAddRow(acc, in, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::SaturatingAddRow(acc, in, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    acc[i] = SaturatingAdd(acc[i], in[i]);
+}
+
+void BinaryRow(BinaryOp op, const double* a, const double* b, double eps,
+               double* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::BinaryRow(op, a, b, eps, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::BinaryRow(op, a, b, eps, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = Binary(op, a[i], b[i], eps);
+}
+
+void SelectRow(const double* c, const double* a, const double* b,
+               double* out, size_t n) {
+  size_t i = 0;
+#ifdef VOLUMETOOLS_X86
+  switch (GetSIMDLevel()) {
+    case SIMD_AVX2:
+      i = avx2::SelectRow(c, a, b, out, n);
+      break;
+    case SIMD_SSE2:
+      i = sse2::SelectRow(c, a, b, out, n);
+      break;
+    default:
+      break;
+  }
+#endif
+  for (; i < n; ++i)
+    out[i] = c[i] ? a[i] : b[i];
+}
+
+#define VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(T)                            \
+  template void DownsampleRow<T, true>(const T*, const T*, const T*,        \
+                                       const T*, T*, size_t);               \
+  template void DownsampleRow<T, false>(const T*, const T*, const T*,       \
+                                        const T*, T*, size_t);              \
+  template void MaxRow<T>(T*, const T*, size_t);                            \
+  template void MinRow<T>(T*, const T*, size_t);                            \
+  template void SaturatingAddRow<T>(T*, const T*, size_t);
+
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(uint8_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(int8_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(uint16_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(int16_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(uint32_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(int32_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(uint64_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(int64_t)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(float)
+VOLUMETOOLS_INSTANTIATE_DOWNSAMPLEROW(double)
+
+}
@@ -1,3 +1,4 @@
+#include <exception>
 #include "Histogram1DDataBlock.h"
 
 #include "RasterDataBlock.h"
@@ -117,47 +118,118 @@ bool Histogram1DDataBlock::Compute(const TOCBlock* source, uint64_t iLevel) {
   return true;
 }
 
+namespace {
+  /// adds a row of n values to hist.  Consecutive voxels often have the same
+  /// value; with a single histogram every increment would then have to wait
+  /// for the previous one to be stored.  For small value ranges we therefore
+  /// count into four interleaved histograms (hist has 4 entries per value)
+  /// which the caller sums up at the end.
+  template <class T>
+  void BinRow(const T* pRow, size_t iCompcount, size_t n,
+              uint64_t* hist, bool bInterleaved) {
+    size_t x = 0;
+    if (bInterleaved && iCompcount == 1) {
+      for (;x+4<=n;x+=4) {
+        hist[4*size_t(pRow[x  ])  ]++;
+        hist[4*size_t(pRow[x+1])+1]++;
+        hist[4*size_t(pRow[x+2])+2]++;
+        hist[4*size_t(pRow[x+3])+3]++;
+      }
+      for (;x<n;x++) hist[4*size_t(pRow[x])]++;
+      return;
+    }
+    const size_t iStride = bInterleaved ? 4 : 1;
+    for (;x<n;x++) {
+      // TODO: think about what todo with multi component data
+      //       right now we only pick the first component
+      hist[iStride*size_t(pRow[iCompcount*x])]++;
+    }
+  }
+}
+
+/// The bricks are processed in parallel, each thread counting into a
+/// histogram of its own; these are summed up at the end.  32 bit data have
+/// too large a histogram to give every thread a copy, there the threads
+/// share the one histogram and update it atomically.
 template <class T> 
 void Histogram1DDataBlock::ComputeTemplate(const TOCBlock* source,
                                            uint64_t iLevel) {
   // compute histogram by iterating over all bricks of the given level
-  UINT64VECTOR3 bricksInSourceLevel = source->GetBrickCount(iLevel);
+  const UINT64VECTOR3 bricksInSourceLevel = source->GetBrickCount(iLevel);
+  const int iBricksPerSlice = int(bricksInSourceLevel.x*bricksInSourceLevel.y);
 
-  size_t iCompcount = size_t(source->GetComponentCount());
-  T* pTempBrickData = new T[size_t(source->GetMaxBrickSize().volume())
-                            *iCompcount];
-
-  uint32_t iOverlap =source->GetOverlap();
+  const size_t iCompcount = size_t(source->GetComponentCount());
+  const size_t iMaxBrickSize = size_t(source->GetMaxBrickSize().volume());
+  const uint32_t iOverlap = source->GetOverlap();
+  const size_t iValueRange = m_vHistData.size();
+  const bool bLocalHist = sizeof(T) <= 2;
+  const bool bInterleaved = sizeof(T) == 1;
+  std::exception_ptr pError;
 
   ProgressTimer timer;
   timer.Start();
 
-  for (uint64_t bz = 0;bz<bricksInSourceLevel.z;bz++) {
-    for (uint64_t by = 0;by<bricksInSourceLevel.y;by++) {
-      for (uint64_t bx = 0;bx<bricksInSourceLevel.x;bx++) {
-        UINT64VECTOR4 brickCoords(bx,by,bz,iLevel);
-        source->GetData((uint8_t*)pTempBrickData, brickCoords);
-        UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(brickCoords));
-
-        for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
-          for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
-            for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
-              // TODO: think about what todo with multi component data
-              //       right now we only pick the first component
-              size_t val = size_t(pTempBrickData[iCompcount*(x+y*bricksize.x+z*bricksize.x*bricksize.y)]);
-              m_vHistData[val]++;
+#pragma omp parallel
+  {
+    std::vector<T> vTempBrickData(iMaxBrickSize*iCompcount);
+    std::vector<uint64_t> vLocalHist(bLocalHist
+                                     ? iValueRange*(bInterleaved ? 4 : 1)
+                                     : 0, 0);
+
+    for (uint64_t bz = 0;bz<bricksInSourceLevel.z;bz++) {
+#pragma omp for schedule(dynamic)
+      for (int b = 0;b<iBricksPerSlice;b++) {
+        try {
+          UINT64VECTOR4 brickCoords(uint64_t(b)%bricksInSourceLevel.x,
+                                    uint64_t(b)/bricksInSourceLevel.x,
+                                    bz, iLevel);
+          source->GetData((uint8_t*)&vTempBrickData[0], brickCoords);
+          UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(brickCoords));
+          const size_t iRowLength = bricksize.x-2*iOverlap;
+
+          for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+            for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+              const T* pRow = &vTempBrickData[iCompcount*
+                (iOverlap+y*bricksize.x+size_t(z)*bricksize.x*bricksize.y)];
+              if (bLocalHist) {
+                BinRow(pRow, iCompcount, iRowLength, &vLocalHist[0],
+                       bInterleaved);
+              } else {
+                for (size_t x = 0;x<iRowLength;x++) {
+                  size_t val = size_t(pRow[iCompcount*x]);
+#pragma omp atomic
+                  m_vHistData[val]++;
+                }
+              }
             }
           }
+        } catch (...) {
+#pragma omp critical (Histogram1DError)
+          { if (!pError) pError = std::current_exception(); }
         }
       }
+#pragma omp master
+      {
+        float progress = float(bz)/float(bricksInSourceLevel.z);
+        MESSAGE("Computing 1D Histogram %5.2f%% (%s)", 
+                progress * 100.0f,
+                timer.GetProgressMessage(progress).c_str());
+      }
     }
 
-    float progress = float(bz)/float(bricksInSourceLevel.z);
-    MESSAGE("Computing 1D Histogram %5.2f%% (%s)", 
-            progress * 100.0f,
-            timer.GetProgressMessage(progress).c_str());
+    if (bLocalHist) {
+#pragma omp critical (Histogram1DMerge)
+      {
+        const size_t iStride = bInterleaved ? 4 : 1;
+        for (size_t i = 0;i<iValueRange;i++) {
+          for (size_t j = 0;j<iStride;j++) {
+            m_vHistData[i] += vLocalHist[i*iStride+j];
+          }
+        }
+      }
+    }
   }
-  delete [] pTempBrickData;
+  if (pError) std::rethrow_exception(pError);
 }
 
 
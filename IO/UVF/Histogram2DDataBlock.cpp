@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <exception>
+#include <limits>
 #include "Histogram2DDataBlock.h"
 #include "Basics/Vectors.h"
 #include "RasterDataBlock.h"
 #include "TOCBlock.h"
+#include "ExtendedOctree/VolumeTools.h"
 #include "../../Controller/Controller.h"
 #include "../../Basics/ProgressTimer.h"
 
@@ -322,131 +326,197 @@ bool Histogram2DDataBlock::Compute(
   return true;
 }
 
-template <class T>
-FUNC_PURE
-DOUBLEVECTOR3 Histogram2DDataBlock::ComputeGradient(const T* pTempBrickData,
-                              double normalizationFactor, size_t iCompcount,
-                              const UINTVECTOR3& size,
-                              const UINTVECTOR3& coords)
-{
-  // TODO: think about what todo with multi component data
-  //       right now we only pick the first component
-  size_t iCenter = size_t(coords.x+size.x*coords.y+size.x*size.y*coords.z);
-  size_t iLeft   = iCenter-1;
-  size_t iRight  = iCenter+1;
-  size_t iTop    = iCenter-size_t(size.x);
-  size_t iBottom = iCenter+size_t(size.x);
-  size_t iFront  = iCenter-size_t(size.x)*size_t(size.y);
-  size_t iBack   = iCenter+size_t(size.x)*size_t(size.y);
-
-  DOUBLEVECTOR3 vGradient((double(pTempBrickData[iCompcount*iLeft]) -double(pTempBrickData[iCompcount*iRight])) /(normalizationFactor*2),
-                          (double(pTempBrickData[iCompcount*iTop])  -double(pTempBrickData[iCompcount*iBottom]))/(normalizationFactor*2),
-                          (double(pTempBrickData[iCompcount*iFront])-double(pTempBrickData[iCompcount*iBack]))  /(normalizationFactor*2));
-  return vGradient;
+namespace {
+  /// The slices of a brick around the current one, converted to double so
+  /// that the gradients can be computed with VolumeTools::GradientMagnitudeRow.
+  /// Every slice is converted only once as we walk through the brick.
+  class SliceWindow {
+  public:
+    SliceWindow() : m_iSliceSize(0) {}
+
+    void Reset(size_t iSliceSize) {
+      m_iSliceSize = iSliceSize;
+      for (size_t i = 0;i<3;i++) {
+        if (m_vSlices[i].size() < iSliceSize) m_vSlices[i].resize(iSliceSize);
+        m_iZ[i] = std::numeric_limits<size_t>::max();
+      }
+    }
+
+    /// @returns the first component of slice z of the brick as doubles
+    template <class T>
+    const double* Get(const T* pBrick, size_t iCompcount, size_t z) {
+      std::vector<double>& slice = m_vSlices[z%3];
+      if (m_iZ[z%3] != z) {
+        const T* pSrc = pBrick + iCompcount*m_iSliceSize*z;
+        for (size_t i = 0;i<m_iSliceSize;i++) {
+          slice[i] = double(pSrc[iCompcount*i]);
+        }
+        m_iZ[z%3] = z;
+      }
+      return &slice[0];
+    }
+
+  private:
+    size_t m_iSliceSize;
+    std::vector<double> m_vSlices[3];
+    size_t m_iZ[3];
+  };
+
+  /// computes the gradient magnitudes (from central differences) of the
+  /// non-overlap voxels of row y in slice z of a brick.
+  template <class T>
+  void GradientMagnitudes(SliceWindow& window, const T* pBrick,
+                          size_t iCompcount, const UINTVECTOR3& bricksize,
+                          uint32_t iOverlap, size_t y, size_t z,
+                          double fDivisor, double* pMagnitudes) {
+    const double* pPrev = window.Get(pBrick, iCompcount, z-1);
+    const double* pNext = window.Get(pBrick, iCompcount, z+1);
+    const double* pCurr = window.Get(pBrick, iCompcount, z);
+    const size_t iRow = y*bricksize.x + iOverlap;
+    VolumeTools::GradientMagnitudeRow(pCurr + iRow - 1, pCurr + iRow + 1,
+                                      pCurr + iRow - bricksize.x,
+                                      pCurr + iRow + bricksize.x,
+                                      pPrev + iRow, pNext + iRow, fDivisor,
+                                      pMagnitudes,
+                                      bricksize.x - 2*iOverlap);
+  }
 }
 
+/// Both passes (the maximum gradient magnitude first, then the histogram
+/// itself) process the bricks in parallel.  Every thread fills a histogram
+/// of its own, these are summed up at the end of the pass.
 template <class T>
 void Histogram2DDataBlock::ComputeTemplate(const TOCBlock* source, double normalizationFactor,
                       uint64_t iLevel, size_t iHistoBinCount,
                       double fMaxNonZeroValue) {
   // compute histogram by iterating over all bricks of the given level
-  UINT64VECTOR3 bricksInSourceLevel = source->GetBrickCount(iLevel);
+  const UINT64VECTOR3 bricksInSourceLevel = source->GetBrickCount(iLevel);
+  const int iBricksPerSlice = int(bricksInSourceLevel.x*bricksInSourceLevel.y);
 
-  size_t iCompcount = size_t(source->GetComponentCount());
-  T* pTempBrickData = new T[size_t(source->GetMaxBrickSize().volume()) *
-                            iCompcount];
-
-  uint32_t iOverlap =source->GetOverlap();
+  const size_t iCompcount = size_t(source->GetComponentCount());
+  const size_t iMaxBrickSize = size_t(source->GetMaxBrickSize().volume());
+  const uint32_t iOverlap = source->GetOverlap();
+  const double fDivisor = normalizationFactor*2;
   double fMaxGradMagnitude = 0;
+  std::exception_ptr pError;
 
   ProgressTimer timer;
   timer.Start();
 
   // find the maximum gradient magnitude
-  for (uint64_t bz = 0;bz<bricksInSourceLevel.z;bz++) {
-    for (uint64_t by = 0;by<bricksInSourceLevel.y;by++) {
-      for (uint64_t bx = 0;bx<bricksInSourceLevel.x;bx++) {
-
-        UINT64VECTOR4 brickCoords(bx,by,bz,iLevel);
-        source->GetData((uint8_t*)pTempBrickData, brickCoords);
-        UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(brickCoords));
-
-#ifdef _MSC_VER
-# pragma omp parallel for shared(fMaxGradMagnitude)
-        for (int32_t z = iOverlap;uint32_t(z)<bricksize.z-iOverlap;z++) {
-#else
-# pragma omp parallel for collapse(3) shared(fMaxGradMagnitude)
-        for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
-#endif
-          for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
-            for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
-              DOUBLEVECTOR3 vGradient = ComputeGradient(
-                pTempBrickData, normalizationFactor, iCompcount, bricksize,
-                UINTVECTOR3(x,y,z)
-              );
-
-              #pragma omp flush(fMaxGradMagnitude)
-              if(vGradient.length() > fMaxGradMagnitude)
-              #pragma omp critical
-              { if(vGradient.length() > fMaxGradMagnitude) {
-                  fMaxGradMagnitude = vGradient.length();
-                }
+#pragma omp parallel
+  {
+    std::vector<T> vTempBrickData(iMaxBrickSize*iCompcount);
+    std::vector<double> vMagnitudes(size_t(source->GetMaxBrickSize().x));
+    SliceWindow window;
+    double fLocalMax = 0;
+
+    for (uint64_t bz = 0;bz<bricksInSourceLevel.z;bz++) {
+#pragma omp for schedule(dynamic)
+      for (int b = 0;b<iBricksPerSlice;b++) {
+        try {
+          UINT64VECTOR4 brickCoords(uint64_t(b)%bricksInSourceLevel.x,
+                                    uint64_t(b)/bricksInSourceLevel.x,
+                                    bz, iLevel);
+          source->GetData((uint8_t*)&vTempBrickData[0], brickCoords);
+          UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(brickCoords));
+          window.Reset(size_t(bricksize.x)*bricksize.y);
+
+          for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+            for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+              GradientMagnitudes(window, &vTempBrickData[0], iCompcount,
+                                 bricksize, iOverlap, y, z, fDivisor,
+                                 &vMagnitudes[0]);
+              for (uint32_t x = 0;x<bricksize.x-2*iOverlap;x++) {
+                fLocalMax = std::max(fLocalMax, vMagnitudes[x]);
               }
             }
           }
+        } catch (...) {
+#pragma omp critical (Histogram2DError)
+          { if (!pError) pError = std::current_exception(); }
         }
       }
+#pragma omp master
+      {
+        float progress = 0.5f*float(bz)/float(bricksInSourceLevel.z);
+        MESSAGE("Computing 2D Histogram %5.2f%% (%s)",
+                progress * 100.0f,
+                timer.GetProgressMessage(progress).c_str());
+      }
     }
-    float progress = 0.5f*float(bz)/float(bricksInSourceLevel.z);
-    MESSAGE("Computing 2D Histogram %5.2f%% (%s)", 
-            progress * 100.0f,
-            timer.GetProgressMessage(progress).c_str());
+#pragma omp critical (Histogram2DMerge)
+    fMaxGradMagnitude = std::max(fMaxGradMagnitude, fLocalMax);
   }
+  if (pError) std::rethrow_exception(pError);
 
   // fill the histogram the maximum gradient magnitude
-  for (uint64_t bz = 0;bz<bricksInSourceLevel.z;bz++) {
-    for (uint64_t by = 0;by<bricksInSourceLevel.y;by++) {
-      for (uint64_t bx = 0;bx<bricksInSourceLevel.x;bx++) {
-
-        UINT64VECTOR4 brickCoords(bx,by,bz,iLevel);
-        source->GetData((uint8_t*)pTempBrickData, brickCoords);
-        UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(brickCoords));
-        #pragma omp parallel for firstprivate(fMaxGradMagnitude)
-#ifdef _MSC_VER
-        for (int32_t z = iOverlap;uint32_t(z)<bricksize.z-iOverlap;z++) {
-#else
-        for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
-#endif
-          for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
-            for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
-              const DOUBLEVECTOR3 vGradient = ComputeGradient(
-                pTempBrickData, normalizationFactor, iCompcount, bricksize,
-                UINTVECTOR3(x,y,z)
-              );
-
-              size_t iCenter = size_t(x+bricksize.x*y+bricksize.x*bricksize.y*z);
-              size_t iGradientMagnitudeIndex = std::min<size_t>(255,size_t(vGradient.length()/fMaxGradMagnitude*255.0f));
-              size_t iValue = (fMaxNonZeroValue <= double(iHistoBinCount-1)) 
-                                  ? size_t(pTempBrickData[iCenter]) 
-                                  : size_t(double(pTempBrickData[iCenter]) * double(iHistoBinCount-1)/fMaxNonZeroValue);
-              // make sure round errors don't cause index to go out of bounds
-              if (iGradientMagnitudeIndex > 255) iGradientMagnitudeIndex = 255;
-              if (iValue > iHistoBinCount-1) iValue = iHistoBinCount-1; 
-              #pragma omp atomic
-              m_vHistData[iValue][iGradientMagnitudeIndex]++;
+#pragma omp parallel
+  {
+    std::vector<T> vTempBrickData(iMaxBrickSize*iCompcount);
+    std::vector<double> vMagnitudes(size_t(source->GetMaxBrickSize().x));
+    std::vector<uint8_t> vGradientBins(vMagnitudes.size());
+    std::vector<uint64_t> vLocalHist(iHistoBinCount*256, 0);
+    SliceWindow window;
+
+    for (uint64_t bz = 0;bz<bricksInSourceLevel.z;bz++) {
+#pragma omp for schedule(dynamic)
+      for (int b = 0;b<iBricksPerSlice;b++) {
+        try {
+          UINT64VECTOR4 brickCoords(uint64_t(b)%bricksInSourceLevel.x,
+                                    uint64_t(b)/bricksInSourceLevel.x,
+                                    bz, iLevel);
+          source->GetData((uint8_t*)&vTempBrickData[0], brickCoords);
+          UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(brickCoords));
+          window.Reset(size_t(bricksize.x)*bricksize.y);
+          const uint32_t iRowLength = bricksize.x-2*iOverlap;
+
+          for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+            for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+              GradientMagnitudes(window, &vTempBrickData[0], iCompcount,
+                                 bricksize, iOverlap, y, z, fDivisor,
+                                 &vMagnitudes[0]);
+              VolumeTools::GradientBinRow(&vMagnitudes[0], fMaxGradMagnitude,
+                                          &vGradientBins[0], iRowLength);
+
+              const T* pRow = &vTempBrickData[iCompcount*
+                (iOverlap+bricksize.x*y+size_t(bricksize.x)*bricksize.y*z)];
+              for (uint32_t x = 0;x<iRowLength;x++) {
+                const T value = pRow[iCompcount*x];
+                size_t iValue = (fMaxNonZeroValue <= double(iHistoBinCount-1))
+                                    ? size_t(value)
+                                    : size_t(double(value) * double(iHistoBinCount-1)/fMaxNonZeroValue);
+                // make sure round errors don't cause index to go out of bounds
+                if (iValue > iHistoBinCount-1) iValue = iHistoBinCount-1;
+                vLocalHist[iValue*256+vGradientBins[x]]++;
+              }
             }
           }
+        } catch (...) {
+#pragma omp critical (Histogram2DError)
+          { if (!pError) pError = std::current_exception(); }
+        }
+      }
+#pragma omp master
+      {
+        float progress = 0.5f+0.5f*float(bz)/float(bricksInSourceLevel.z);
+        MESSAGE("Computing 2D Histogram %5.2f%% (%s)",
+                progress * 100.0f,
+                timer.GetProgressMessage(progress).c_str());
+      }
+    }
+#pragma omp critical (Histogram2DMerge)
+    {
+      for (size_t i = 0;i<iHistoBinCount;i++) {
+        for (size_t j = 0;j<256;j++) {
+          m_vHistData[i][j] += vLocalHist[i*256+j];
         }
       }
     }
-    float progress = 0.5f+0.5f*float(bz)/float(bricksInSourceLevel.z);
-    MESSAGE("Computing 2D Histogram %5.2f%% (%s)", 
-            progress * 100.0f,
-            timer.GetProgressMessage(progress).c_str());
   }
-  m_fMaxGradMagnitude = float(fMaxGradMagnitude);
+  if (pError) std::rethrow_exception(pError);
 
-  delete [] pTempBrickData;
+  m_fMaxGradMagnitude = float(fMaxGradMagnitude);
 }
 
 
@@ -51,13 +51,6 @@ protected:
   virtual DataBlock* Clone() const;
 
 
-  template <class T>
-  FUNC_PURE
-  DOUBLEVECTOR3 ComputeGradient(const T* pTempBrickData,
-                                double normalizationFactor, size_t iCompcount,
-                                const UINTVECTOR3& size,
-                                const UINTVECTOR3& coords);
-
   template <class T>
   void ComputeTemplate(const TOCBlock* source, double normalizationFactor,
                        uint64_t iLevel, size_t iHistoBinCount,
@@ -634,6 +634,21 @@ void RasterDataBlock::SetTypeToVector(uint64_t iBitWith, uint64_t iMantissa, boo
   ulElementBitSize.push_back(vecB);
 }
 
+void RasterDataBlock::ChangeElementType(uint64_t iBitWith, uint64_t iMantissa,
+                                        bool bSigned) {
+  vector<ElementSemanticTable> vSemantic;
+  if (!ulElementSemantic.empty()) vSemantic = ulElementSemantic[0];
+
+  ulElementDimensionSize.clear();
+  ulElementSemantic.clear();
+  ulElementMantissa.clear();
+  bSignedElement.clear();
+  ulElementBitSize.clear();
+  SetTypeToVector(iBitWith, iMantissa, bSigned, vSemantic);
+
+  if (!m_vLODOffsets.empty()) ComputeDataSizeAndOffsetTables();
+}
+
 void RasterDataBlock::SetTypeToUByte(ElementSemanticTable semantic) {
   SetTypeToScalar(8,8,false,semantic);
 }
@@ -1319,6 +1334,25 @@ bool RasterDataBlock::GetData(std::vector<int32_t>& vData,
   return GetData(reinterpret_cast<uint8_t*>(&vData[0]), bytes, vLOD, vBrick);
 }
 
+bool RasterDataBlock::GetData(std::vector<uint64_t>& vData,
+                              const std::vector<uint64_t>& vLOD,
+                              const std::vector<uint64_t>& vBrick) const
+{
+  if(!ValidBrickIndex(vLOD, vBrick)) { return false; }
+  const size_t bytes = GetBrickByteSize(vLOD, vBrick);
+  size_vector_for_io(vData, bytes);
+  return GetData(reinterpret_cast<uint8_t*>(&vData[0]), bytes, vLOD, vBrick);
+}
+bool RasterDataBlock::GetData(std::vector<int64_t>& vData,
+                              const std::vector<uint64_t>& vLOD,
+                              const std::vector<uint64_t>& vBrick) const
+{
+  if(!ValidBrickIndex(vLOD, vBrick)) { return false; }
+  const size_t bytes = GetBrickByteSize(vLOD, vBrick);
+  size_vector_for_io(vData, bytes);
+  return GetData(reinterpret_cast<uint8_t*>(&vData[0]), bytes, vLOD, vBrick);
+}
+
 bool RasterDataBlock::GetData(std::vector<float>& vData,
                               const std::vector<uint64_t>& vLOD,
                               const std::vector<uint64_t>& vBrick) const
@@ -1403,6 +1437,27 @@ bool RasterDataBlock::SetData(uint32_t* pData,
   return m_pStreamFile->WriteRAW(reinterpret_cast<uint8_t*>(pData), sz) == sz;
 }
 
+bool RasterDataBlock::SetData(int64_t* pData,
+                              const std::vector<uint64_t>& vLOD,
+                              const std::vector<uint64_t>& vBrick)
+{
+  if(!Settable()) { return false; }
+
+  SeekToBrick(vLOD, vBrick);
+  uint64_t sz = GetBrickByteSize(vLOD, vBrick);
+  return m_pStreamFile->WriteRAW(reinterpret_cast<uint8_t*>(pData), sz) == sz;
+}
+bool RasterDataBlock::SetData(uint64_t* pData,
+                              const std::vector<uint64_t>& vLOD,
+                              const std::vector<uint64_t>& vBrick)
+{
+  if(!Settable()) { return false; }
+
+  SeekToBrick(vLOD, vBrick);
+  uint64_t sz = GetBrickByteSize(vLOD, vBrick);
+  return m_pStreamFile->WriteRAW(reinterpret_cast<uint8_t*>(pData), sz) == sz;
+}
+
 bool RasterDataBlock::SetData(float* pData,
                               const std::vector<uint64_t>& vLOD,
                               const std::vector<uint64_t>& vBrick)
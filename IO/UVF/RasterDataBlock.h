@@ -8,6 +8,7 @@
 #include <string>
 #include "DataBlock.h"
 #include "Basics/Vectors.h"
+#include "ExtendedOctree/VolumeTools.h"
 
 class AbstrDebugOut;
 
@@ -16,28 +17,21 @@ void SimpleMaxMin(const void* pIn, size_t iStart, size_t iCount,
                   std::vector<DOUBLEVECTOR4>& fMinMax) {
   const T *pDataIn = (T*)pIn;
 
-  fMinMax.resize(iVecLength);
+  tuvok::MinMaxBlock stats[iVecLength];
+  VolumeTools::ComputeBrickStats(pDataIn + iStart*iVecLength,
+                                 UINT64VECTOR3(iCount, 1, 1), iVecLength,
+                                 false, stats);
 
+  fMinMax.resize(iVecLength);
   for (size_t i = 0;i<iVecLength;i++) {
-    fMinMax[i].x = pDataIn[iStart+i]; // .x will be the minimum
-    fMinMax[i].y = pDataIn[iStart+i]; // .y will be the max
+    fMinMax[i].x = stats[i].minScalar; // .x will be the minimum
+    fMinMax[i].y = stats[i].maxScalar; // .y will be the max
 
-    /// \todo remove this if the gradient computations is implemented below
+    // readers compare these with 2D transfer function coordinates rather
+    // than gradient magnitudes, so they stay unknown
     fMinMax[i].z = -std::numeric_limits<double>::max(); // min gradient
     fMinMax[i].w = std::numeric_limits<double>::max();  // max gradient
   }
-
-  for (size_t i = iStart+iVecLength;i<iStart+iCount;i++) {
-    for (size_t iComponent = 0;iComponent<iVecLength;iComponent++) {
-        fMinMax[iComponent].x = std::min(fMinMax[iComponent].x,
-                                         static_cast<double>
-                                         (pDataIn[i*iVecLength+iComponent]));
-        fMinMax[iComponent].y = std::max(fMinMax[iComponent].y,
-                                         static_cast<double>
-                                         (pDataIn[i*iVecLength+iComponent]));
-      /// \todo compute gradients
-    }
-  }
 }
 
 template<class T>
@@ -122,6 +116,10 @@ public:
                        UVFTables::ElementSemanticTable semantic);
   void SetTypeToVector(uint64_t iBitWith, uint64_t iMantissa, bool bSigned,
                        std::vector<UVFTables::ElementSemanticTable> semantic);
+  /// Changes the type of all components of an existing (single element)
+  /// block and updates the brick offsets.  The data are not converted, so
+  /// this is meant for blocks which are about to be written.
+  void ChangeElementType(uint64_t iBitWith, uint64_t iMantissa, bool bSigned);
   void SetTypeToUByte(UVFTables::ElementSemanticTable semantic);
   void SetTypeToUShort(UVFTables::ElementSemanticTable semantic);
   void SetTypeToFloat(UVFTables::ElementSemanticTable semantic);
@@ -149,6 +147,12 @@ public:
   bool GetData(std::vector<int32_t>& vData,
                const std::vector<uint64_t>& vLOD,
                const std::vector<uint64_t>& vBrick) const;
+  bool GetData(std::vector<uint64_t>& vData,
+               const std::vector<uint64_t>& vLOD,
+               const std::vector<uint64_t>& vBrick) const;
+  bool GetData(std::vector<int64_t>& vData,
+               const std::vector<uint64_t>& vLOD,
+               const std::vector<uint64_t>& vBrick) const;
   bool GetData(std::vector<float>& vData,
                const std::vector<uint64_t>& vLOD,
                const std::vector<uint64_t>& vBrick) const;
@@ -167,6 +171,10 @@ public:
                const std::vector<uint64_t>& vBrick);
   bool SetData(uint32_t*, const std::vector<uint64_t>& vLOD,
                const std::vector<uint64_t>& vBrick);
+  bool SetData(int64_t*, const std::vector<uint64_t>& vLOD,
+               const std::vector<uint64_t>& vBrick);
+  bool SetData(uint64_t*, const std::vector<uint64_t>& vLOD,
+               const std::vector<uint64_t>& vBrick);
   bool SetData( float*, const std::vector<uint64_t>& vLOD,
                const std::vector<uint64_t>& vBrick);
   bool SetData(double*, const std::vector<uint64_t>& vLOD,
@@ -148,6 +148,68 @@ bool TOCBlock::FlatDataToBrickedLOD(
   uint32_t iCompressionLevel,
   LAYOUT_TYPE lt
 ) {
+  LargeRAWFile_ptr outFile = CreateOctreeFile(strTempFile, vMaxBrickSize,
+                                              iOverlap, debugOut);
+  if (!outFile) return false;
+  assert(vVolumeSize.volume() > 0);
+  assert(vScale.volume() > 0);
+
+  ExtendedOctreeConverter c(m_vMaxBrickSize, m_iOverlap, iCacheSize,
+                            *debugOut);
+  BrickStatVec statsVec;
+
+  if (!pSourceData->IsOpen()) pSourceData->Open();
+
+  if(!c.Convert(pSourceData, 0, eType, iComponentCount, vVolumeSize,
+                vScale, outFile, 0, &statsVec, ct, iCompressionLevel,
+                bUseMedian, bClampToEdge, lt)) {
+    debugOut->Error(_func_, "ExtOctree reported failed conversion.");
+    return false;
+  }
+  return OpenOctreeFile(outFile, statsVec, iComponentCount, pMaxMinDatBlock,
+                        debugOut);
+}
+
+bool TOCBlock::FlatDataToBrickedLOD(
+  SliceSource& source, const std::string& strTempFile,
+  ExtendedOctree::COMPONENT_TYPE eType, uint64_t iComponentCount,
+  const UINT64VECTOR3& vVolumeSize,
+  const DOUBLEVECTOR3& vScale,
+  const UINT64VECTOR3& vMaxBrickSize,
+  uint32_t iOverlap,
+  bool bUseMedian,
+  bool bClampToEdge,
+  size_t iCacheSize,
+  std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+  AbstrDebugOut* debugOut,
+  COMPRESSION_TYPE ct,
+  uint32_t iCompressionLevel,
+  LAYOUT_TYPE lt
+) {
+  LargeRAWFile_ptr outFile = CreateOctreeFile(strTempFile, vMaxBrickSize,
+                                              iOverlap, debugOut);
+  if (!outFile) return false;
+  assert(vVolumeSize.volume() > 0);
+  assert(vScale.volume() > 0);
+
+  ExtendedOctreeConverter c(m_vMaxBrickSize, m_iOverlap, iCacheSize,
+                            *debugOut);
+  BrickStatVec statsVec;
+
+  if(!c.Convert(source, eType, iComponentCount, vVolumeSize, vScale,
+                outFile, 0, &statsVec, ct, iCompressionLevel, bUseMedian,
+                bClampToEdge, lt)) {
+    debugOut->Error(_func_, "ExtOctree reported failed conversion.");
+    return false;
+  }
+  return OpenOctreeFile(outFile, statsVec, iComponentCount, pMaxMinDatBlock,
+                        debugOut);
+}
+
+LargeRAWFile_ptr TOCBlock::CreateOctreeFile(const std::string& strTempFile,
+                                            const UINT64VECTOR3& vMaxBrickSize,
+                                            uint32_t iOverlap,
+                                            AbstrDebugOut* debugOut) {
   m_vMaxBrickSize = vMaxBrickSize;
   m_iOverlap = iOverlap;
 
@@ -155,29 +217,23 @@ bool TOCBlock::FlatDataToBrickedLOD(
   assert(m_vMaxBrickSize[1] > 2*m_iOverlap);
   assert(m_vMaxBrickSize[2] > 2*m_iOverlap);
   assert(debugOut != NULL);
-  assert(vVolumeSize.volume() > 0);
-  assert(vScale.volume() > 0);
 
   LargeRAWFile_ptr outFile(new LargeRAWFile(strTempFile));
   if (!outFile->Create()) {
     debugOut->Error(_func_, "Could not create tempfile '%s'",
                     strTempFile.c_str());
-    return false;
+    return LargeRAWFile_ptr();
   }
   m_pStreamFile = outFile;
   m_strDeleteTempFile = strTempFile;
-  ExtendedOctreeConverter c(m_vMaxBrickSize, m_iOverlap, iCacheSize,
-                            *debugOut);
-  BrickStatVec statsVec;
-
-  if (!pSourceData->IsOpen()) pSourceData->Open();
+  return outFile;
+}
 
-  if(!c.Convert(pSourceData, 0, eType, iComponentCount, vVolumeSize,
-                vScale, outFile, 0, &statsVec, ct, iCompressionLevel,
-                bUseMedian, bClampToEdge, lt)) {
-    debugOut->Error(_func_, "ExtOctree reported failed conversion.");
-    return false;
-  }
+bool TOCBlock::OpenOctreeFile(LargeRAWFile_ptr outFile,
+                              BrickStatVec& statsVec,
+                              uint64_t iComponentCount,
+                              std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+                              AbstrDebugOut* debugOut) {
   outFile->Close(); // note, needed before the 'Open' below!
 
   pMaxMinDatBlock->SetDataFromFlatVector(statsVec, iComponentCount);
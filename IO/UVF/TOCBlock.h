@@ -8,6 +8,8 @@
 
 class AbstrDebugOut;
 class MaxMinDataBlock;
+class SliceSource;
+template<class T> class BrickStats;
 
 class TOCBlock : public DataBlock
 {
@@ -23,6 +25,8 @@ public:
   UINTVECTOR3 GetMaxBrickSize() const {
     return m_ExtendedOctree.GetMaxBrickSize();
   }
+  /// @returns the octree, e.g. to read it slice by slice
+  const ExtendedOctree& GetOctree() const {return m_ExtendedOctree;}
 
   bool FlatDataToBrickedLOD(const std::string& strSourceFile,
                             const std::string& strTempFile,
@@ -60,6 +64,26 @@ public:
                             COMPRESSION_TYPE ct=CT_ZLIB,
                             uint32_t iCompressionLevel=4,
                             LAYOUT_TYPE lt=LT_SCANLINE);
+  /// Bricks a volume which is produced slice by slice, the volume is never
+  /// stored linearly on disk.
+  /// @see ExtendedOctreeConverter::Convert(SliceSource&, ...)
+  bool FlatDataToBrickedLOD(SliceSource& source,
+                            const std::string& strTempFile,
+                            ExtendedOctree::COMPONENT_TYPE eType,
+                            uint64_t iComponentCount,
+                            const UINT64VECTOR3& vVolumeSize,
+                            const DOUBLEVECTOR3& vScale,
+                            const UINT64VECTOR3& vMaxBrickSize,
+                            uint32_t iOverlap,
+                            bool bUseMedian,
+                            bool bClampToEdge,
+                            size_t iCacheSize,
+                            std::shared_ptr<MaxMinDataBlock>
+                              pMaxMinDatBlock,
+                            AbstrDebugOut* pDebugOut,
+                            COMPRESSION_TYPE ct=CT_ZLIB,
+                            uint32_t iCompressionLevel=4,
+                            LAYOUT_TYPE lt=LT_SCANLINE);
 
   bool BrickedLODToFlatData(uint64_t iLoD,
                             const std::string& strTargetFile,
@@ -80,6 +104,15 @@ public:
                      AbstrDebugOut* pDebugOut=NULL) const;
 
   void GetData(uint8_t* pData, UINT64VECTOR4 coordinates) const;
+  /// Maps the file, bricks stored uncompressed are then available in place.
+  /// @see ExtendedOctree::MapFile
+  bool MapFile() const { return m_ExtendedOctree.MapFile(); }
+  void UnmapFile() const { m_ExtendedOctree.UnmapFile(); }
+  /// @returns the brick inside the mapped file; empty if the brick cannot
+  /// be used in place, use GetData then.
+  std::shared_ptr<const void> GetMappedData(UINT64VECTOR4 coordinates) const {
+    return m_ExtendedOctree.GetMappedBrickData(coordinates);
+  }
 
   uint64_t GetLoDCount() const;
   UINT64VECTOR3 GetBrickCount(uint64_t iLoD) const;
@@ -119,6 +152,17 @@ protected:
   uint64_t m_iUVFFileVersion;
 
   uint64_t ComputeHeaderSize() const;
+  /// Creates the temp file the octree is built in.
+  LargeRAWFile_ptr CreateOctreeFile(const std::string& strTempFile,
+                                    const UINT64VECTOR3& vMaxBrickSize,
+                                    uint32_t iOverlap,
+                                    AbstrDebugOut* debugOut);
+  /// Stores the brick statistics and opens the octree once it is built.
+  bool OpenOctreeFile(LargeRAWFile_ptr outFile,
+                      std::vector<BrickStats<double>>& statsVec,
+                      uint64_t iComponentCount,
+                      std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+                      AbstrDebugOut* debugOut);
   virtual uint64_t GetHeaderFromFile(LargeRAWFile_ptr pStreamFile,
                                      uint64_t iOffset, bool bIsBigEndian);
   virtual uint64_t CopyToFile(LargeRAWFile_ptr pStreamFile, uint64_t iOffset,
@@ -29,6 +29,7 @@
 
 #include "binary-expression.h"
 #include "constant.h"
+#include "program.h"
 
 namespace tuvok { namespace expression {
 
@@ -62,25 +63,17 @@ void BinaryExpression::Print(std::ostream& os) const {
   os << ")";
 }
 
-static bool fp_equal(double a, double b) {
-  return (fabs(a-b) < 0.001);
-}
-
 double BinaryExpression::Evaluate(size_t i) const {
   double lhs, rhs;
   lhs = this->GetChild(0)->Evaluate(i);
   rhs = this->GetChild(1)->Evaluate(i);
-  switch(this->oper) {
-    case OP_PLUS:         return lhs + rhs;
-    case OP_MINUS:        return lhs - rhs;
-    case OP_DIVIDE:       return lhs / rhs;
-    case OP_MULTIPLY:     return lhs * rhs;
-    case OP_GREATER_THAN: return lhs > rhs;
-    case OP_LESS_THAN:    return lhs < rhs;
-    case OP_EQUAL_TO:     return fp_equal(lhs, rhs);
-  }
-  assert(1 == 0);
-  return 0.0;
+  return Program::Apply(this->oper, lhs, rhs);
+}
+
+size_t BinaryExpression::Compile(Program& p) const {
+  const size_t lhs = this->GetChild(0)->Compile(p);
+  const size_t rhs = this->GetChild(1)->Compile(p);
+  return p.AddBinary(this->oper, lhs, rhs);
 }
 
 }}
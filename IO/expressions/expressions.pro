@@ -25,5 +25,6 @@ SOURCES += \
   binary-expression.cpp \
   conditional-expression.cpp \
   constant.cpp          \
+  program.cpp           \
   treenode.cpp          \
   volume.cpp
@@ -0,0 +1,131 @@
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2010 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "program.h"
+
+namespace tuvok { namespace expression {
+
+const double Program::Tolerance = 0.001;
+
+Program::Program() : result(0), volumes(0) { }
+
+size_t Program::Append(const Instruction& in) {
+  this->code.push_back(in);
+  this->result = this->code.size() - 1;
+  return this->result;
+}
+
+size_t Program::AddLoad(size_t volume) {
+  // every volume is only loaded once.
+  for(size_t i=0; i < this->code.size(); ++i) {
+    if(this->code[i].code == LOAD && this->code[i].volume == volume) {
+      return i;
+    }
+  }
+  Instruction in = Instruction();
+  in.code = LOAD;
+  in.volume = volume;
+  this->volumes = std::max(this->volumes, volume+1);
+  return this->Append(in);
+}
+
+size_t Program::AddConstant(double value) {
+  Instruction in = Instruction();
+  in.code = CONSTANT;
+  in.value = value;
+  return this->Append(in);
+}
+
+size_t Program::AddBinary(OpType oper, size_t a, size_t b) {
+  assert(a < this->code.size() && b < this->code.size());
+  if(this->IsConstant(a) && this->IsConstant(b)) {
+    return this->AddConstant(Apply(oper, this->code[a].value,
+                                   this->code[b].value));
+  }
+  Instruction in = Instruction();
+  in.code = BINARY;
+  in.oper = oper;
+  in.a = a;
+  in.b = b;
+  return this->Append(in);
+}
+
+size_t Program::AddSelect(size_t cond, size_t a, size_t b) {
+  assert(cond < this->code.size() && a < this->code.size() &&
+         b < this->code.size());
+  if(this->IsConstant(cond)) {
+    // NaNs are true, just like in ConditionalExpression::Evaluate.
+    return this->code[cond].value != 0.0 ? a : b;
+  }
+  Instruction in = Instruction();
+  in.code = SELECT;
+  in.a = cond;
+  in.b = a;
+  in.c = b;
+  return this->Append(in);
+}
+
+void Program::SetResult(size_t reg) {
+  assert(reg < this->code.size());
+  this->result = reg;
+}
+size_t Program::Result() const { return this->result; }
+size_t Program::Volumes() const { return this->volumes; }
+
+const std::vector<Program::Instruction>& Program::Instructions() const {
+  return this->code;
+}
+
+bool Program::IsConstant(size_t reg) const {
+  return this->code[reg].code == CONSTANT;
+}
+
+double Program::Apply(OpType oper, double a, double b) {
+  switch(oper) {
+    case OP_PLUS:         return a + b;
+    case OP_MINUS:        return a - b;
+    case OP_DIVIDE:       return a / b;
+    case OP_MULTIPLY:     return a * b;
+    case OP_GREATER_THAN: return a > b;
+    case OP_LESS_THAN:    return a < b;
+    case OP_EQUAL_TO:     return fabs(a-b) < Tolerance;
+  }
+  assert(1 == 0);
+  return 0.0;
+}
+
+Program compile(const Node& tree) {
+  Program p;
+  p.SetResult(tree.Compile(p));
+  return p;
+}
+
+}}
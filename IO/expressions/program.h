@@ -0,0 +1,104 @@
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2010 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+/// \brief An expression tree compiled into a flat list of instructions.
+#ifndef TUVOK_EXPRESSION_PROGRAM_H
+#define TUVOK_EXPRESSION_PROGRAM_H
+
+#include <cstddef>
+#include <vector>
+
+#include "treenode.h"
+
+namespace tuvok { namespace expression {
+
+/// A compiled expression.  Every instruction computes one value per voxel
+/// and only refers to the results of earlier instructions, so running them
+/// in order over a block of voxels evaluates the whole tree for that block.
+/// The result of instruction i is called 'register' i.
+class Program {
+  public:
+    enum OpCode {
+      LOAD,     ///< the voxel of input volume 'volume'
+      CONSTANT, ///< 'value'
+      BINARY,   ///< 'oper' applied to registers a and b
+      SELECT    ///< register a ? register b : register c
+    };
+    struct Instruction {
+      OpCode code;
+      OpType oper;
+      size_t a, b, c;
+      size_t volume;
+      double value;
+    };
+
+    Program();
+
+    /// Appends an instruction, unless an equivalent one exists or the result
+    /// is known at compile time.
+    /// @returns the register which holds the result
+    ///@{
+    size_t AddLoad(size_t volume);
+    size_t AddConstant(double value);
+    size_t AddBinary(OpType oper, size_t a, size_t b);
+    size_t AddSelect(size_t cond, size_t a, size_t b);
+    ///@}
+
+    /// The register which holds the value of the whole expression.
+    ///@{
+    void SetResult(size_t reg);
+    size_t Result() const;
+    ///@}
+
+    /// Number of input volumes the program needs, i.e. one more than the
+    /// largest volume index it loads.
+    size_t Volumes() const;
+
+    const std::vector<Instruction>& Instructions() const;
+
+    /// @returns true if register 'reg' holds a constant
+    bool IsConstant(size_t reg) const;
+
+    /// the scalar definition of a binary operator, as used by the tree
+    static double Apply(OpType oper, double a, double b);
+    /// how close two values must be for OP_EQUAL_TO
+    static const double Tolerance;
+
+  private:
+    size_t Append(const Instruction&);
+
+    std::vector<Instruction> code;
+    size_t result;
+    size_t volumes;
+};
+
+/// Compiles the (analyzed) expression tree into a program.
+Program compile(const Node& tree);
+
+}}
+
+#endif // TUVOK_EXPRESSION_PROGRAM_H
@@ -40,6 +40,8 @@
 
 namespace tuvok { namespace expression {
 
+class Program;
+
 class Node {
   public:
     virtual ~Node();
@@ -64,6 +66,10 @@ class Node {
 
     virtual double Evaluate(size_t idx) const=0;
 
+    /// Appends the instructions which compute this node to the program.
+    /// @returns the register which holds the node's value
+    virtual size_t Compile(Program&) const=0;
+
   protected:
     const std::shared_ptr<Node> GetChild(size_t index) const;
 
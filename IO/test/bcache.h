@@ -90,6 +90,65 @@ void sizes() {
   TS_ASSERT_EQUALS(c.size(), 0U);
 }
 
+// the least recently *used* brick should go first, not the oldest insert.
+void lru_order() {
+  BrickCache c;
+  for(size_t i=0; i < 3; ++i) {
+    std::vector<uint8_t> data(1, uint8_t(i));
+    c.add(BrickKey(0,0,i), data);
+  }
+  c.lookup(BrickKey(0,0,0), uint8_t(42));
+  c.remove();
+  TS_ASSERT_EQUALS(c.count(), 2U);
+  TS_ASSERT(c.lookup(BrickKey(0,0,0), uint8_t(42)) != NULL);
+  TS_ASSERT(c.lookup(BrickKey(0,0,1), uint8_t(42)) == NULL);
+  TS_ASSERT(c.lookup(BrickKey(0,0,2), uint8_t(42)) != NULL);
+}
+
+// asking whether a brick is there is not a use of it.
+void contains() {
+  BrickCache c;
+  for(size_t i=0; i < 3; ++i) {
+    std::vector<uint8_t> data(1, uint8_t(i));
+    c.add(BrickKey(0,0,i), data);
+  }
+  TS_ASSERT(c.contains(BrickKey(0,0,0)));
+  TS_ASSERT(!c.contains(BrickKey(0,0,3)));
+  c.remove();
+  TS_ASSERT_EQUALS(c.count(), 2U);
+  TS_ASSERT(!c.contains(BrickKey(0,0,0)));
+  TS_ASSERT(c.contains(BrickKey(0,0,1)));
+  TS_ASSERT(c.contains(BrickKey(0,0,2)));
+}
+
+// add() itself must keep the cache within its capacity.
+void capacity() {
+  BrickCache c;
+  c.setCapacity(8);
+  for(size_t i=0; i < 4; ++i) {
+    std::vector<uint16_t> data(2, uint16_t(i));
+    c.add(BrickKey(0,0,i), data);
+  }
+  TS_ASSERT_EQUALS(c.size(), 8U);
+  TS_ASSERT_EQUALS(c.count(), 2U);
+  TS_ASSERT(c.lookup(BrickKey(0,0,1), uint16_t(42)) == NULL);
+  const uint16_t* rv = static_cast<const uint16_t*>(
+    c.lookup(BrickKey(0,0,3), uint16_t(42))
+  );
+  TS_ASSERT(rv != NULL);
+  if(rv) { TS_ASSERT_EQUALS(rv[0], 3U); }
+
+  // an oversized brick still gets in, but only on its own.
+  std::vector<uint16_t> big(16, 7);
+  c.add(BrickKey(0,0,9), big);
+  TS_ASSERT_EQUALS(c.count(), 1U);
+  TS_ASSERT_EQUALS(c.size(), sizeof(uint16_t)*16);
+
+  c.setCapacity(4);
+  TS_ASSERT_EQUALS(c.count(), 0U);
+  TS_ASSERT_EQUALS(c.size(), 0U);
+}
+
 namespace {
   template<typename T>
   void normal(std::vector<T>& data, const T& mean, const T& stddev) {
@@ -138,5 +197,8 @@ public:
   void test_sizes() { sizes(); }
   void test_lookup_bug() { lookup_bug(); }
   void test_lookup_bug16() { lookup_bug16(); }
+  void test_lru_order() { lru_order(); }
+  void test_contains() { contains(); }
+  void test_capacity() { capacity(); }
 //  void test_add_many() { add_many(); }
 };
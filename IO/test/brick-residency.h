@@ -0,0 +1,112 @@
+#include <cstdint>
+#include <unordered_set>
+#include <cxxtest/TestSuite.h>
+#include "Renderer/GPUMemMan/BrickResidency.h"
+
+using tuvok::BrickKey;
+using tuvok::EvictionInfo;
+using tuvok::ResidencyKey;
+using tuvok::ResidencyKeyHash;
+
+namespace {
+  ResidencyKey br_key(const void* ds, size_t lod, size_t brick,
+                      bool pot=false, bool eightbit=false, int group=0) {
+    return ResidencyKey(ds, BrickKey(0, lod, brick), pot, eightbit, false,
+                        false, group);
+  }
+
+  // a 1 MB brick last used in the given frame, read from disk uncompressed
+  EvictionInfo br_info(uint64_t frame, uint64_t intra=0, size_t lod=0) {
+    EvictionInfo info;
+    info.iFrameCounter = frame;
+    info.iIntraFrameCounter = intra;
+    info.iBytes = info.iStoredBytes = 1024*1024;
+    info.iLOD = lod;
+    return info;
+  }
+}
+
+class BrickResidencyTests : public CxxTest::TestSuite {
+public:
+  void test_key_equality() {
+    int a, b;
+    TS_ASSERT(br_key(&a, 1, 2) == br_key(&a, 1, 2));
+    TS_ASSERT(br_key(&a, 1, 2) != br_key(&b, 1, 2));
+    TS_ASSERT(br_key(&a, 1, 2) != br_key(&a, 2, 2));
+    TS_ASSERT(br_key(&a, 1, 2) != br_key(&a, 1, 3));
+    TS_ASSERT(br_key(&a, 1, 2) != br_key(&a, 1, 2, true));
+    TS_ASSERT(br_key(&a, 1, 2) != br_key(&a, 1, 2, false, true));
+    TS_ASSERT(br_key(&a, 1, 2) != br_key(&a, 1, 2, false, false, 1));
+    TS_ASSERT_EQUALS(ResidencyKeyHash()(br_key(&a, 1, 2)),
+                     ResidencyKeyHash()(br_key(&a, 1, 2)));
+  }
+
+  // every brick/format combination finds its own slot
+  void test_key_hash() {
+    int ds[2];
+    std::unordered_set<ResidencyKey, ResidencyKeyHash> keys;
+    size_t n = 0;
+    for(size_t d=0; d < 2; ++d) {
+      for(size_t lod=0; lod < 4; ++lod) {
+        for(size_t b=0; b < 64; ++b) {
+          for(int fmt=0; fmt < 4; ++fmt) {
+            keys.insert(br_key(&ds[d], lod, b, (fmt&1) != 0, (fmt&2) != 0,
+                               int(d)));
+            ++n;
+          }
+        }
+      }
+    }
+    TS_ASSERT_EQUALS(keys.size(), n);
+    TS_ASSERT_EQUALS(keys.count(br_key(&ds[1], 3, 63, true, true, 1)),
+                     size_t(1));
+    TS_ASSERT_EQUALS(keys.count(br_key(&ds[1], 3, 63, true, true, 0)),
+                     size_t(0));
+  }
+
+  void test_reload_cost() {
+    EvictionInfo mem = br_info(0), disk = br_info(0), packed = br_info(0);
+    mem.bInMemory = true;
+    packed.iStoredBytes = mem.iBytes / 4;
+    TS_ASSERT_LESS_THAN(ReloadCost(mem), ReloadCost(packed));
+    TS_ASSERT_LESS_THAN(ReloadCost(packed), ReloadCost(disk));
+    EvictionInfo coarse = disk;
+    coarse.iLOD = 3;
+    TS_ASSERT_LESS_THAN(ReloadCost(disk), ReloadCost(coarse));
+    TS_ASSERT_LESS_THAN(0.0, ReloadCost(EvictionInfo()));
+  }
+
+  // with equal costs, this is the old least recently used order
+  void test_lru_order() {
+    const uint64_t now = 10;
+    TS_ASSERT(EvictBefore(br_info(3), br_info(7), now));
+    TS_ASSERT(!EvictBefore(br_info(7), br_info(3), now));
+    // within a frame, the brick rendered last goes first
+    TS_ASSERT(EvictBefore(br_info(7, 5), br_info(7, 2), now));
+    TS_ASSERT(!EvictBefore(br_info(7, 2), br_info(7, 5), now));
+    TS_ASSERT(!EvictBefore(br_info(7, 2), br_info(7, 2), now));
+  }
+
+  void test_users_first() {
+    EvictionInfo used = br_info(0);
+    used.iUserCount = 1;
+    TS_ASSERT(EvictBefore(br_info(10), used, 10));
+    TS_ASSERT(!EvictBefore(used, br_info(10), 10));
+  }
+
+  // an expensive brick survives longer than a cheap one of the same age,
+  // but not forever
+  void test_cost_order() {
+    EvictionInfo cheap = br_info(8), expensive = br_info(8);
+    cheap.bInMemory = true;
+    TS_ASSERT(EvictBefore(cheap, expensive, 10));
+    expensive.iFrameCounter = 7;
+    TS_ASSERT(EvictBefore(cheap, expensive, 10));
+    expensive.iFrameCounter = 0;
+    cheap.iFrameCounter = 95;
+    TS_ASSERT(EvictBefore(expensive, cheap, 100));
+
+    EvictionInfo fine = br_info(5, 0, 0), coarse = br_info(5, 0, 2);
+    TS_ASSERT(EvictBefore(fine, coarse, 6));
+  }
+};
@@ -0,0 +1,186 @@
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/MinMaxBlock.h"
+#include "Basics/Timer.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+#include "UVF/RasterDataBlock.h"
+
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level when a test is done
+  struct bs_simd_level {
+    bs_simd_level() : old(GetSIMDLevel()) {}
+    ~bs_simd_level() { SetSIMDLevel(old); }
+    SIMDLevel old;
+  };
+
+  template<typename T> T bs_random(std::mt19937& mt) {
+    switch(mt() % 8) {
+      case 0: return std::numeric_limits<T>::min();
+      case 1: return std::numeric_limits<T>::max();
+      case 2: return std::numeric_limits<T>::lowest();
+      default: return T(mt() % 200);
+    }
+  }
+  template<> float bs_random<float>(std::mt19937& mt) {
+    switch(mt() % 10) {
+      case 0: return std::numeric_limits<float>::quiet_NaN();
+      case 1: return -0.0f;
+      default: return std::uniform_real_distribution<float>(-1e6f, 1e6f)(mt);
+    }
+  }
+  template<> double bs_random<double>(std::mt19937& mt) {
+    switch(mt() % 10) {
+      case 0: return std::numeric_limits<double>::quiet_NaN();
+      case 1: return -0.0;
+      default: return std::uniform_real_distribution<double>(-1e9, 1e9)(mt);
+    }
+  }
+
+  // the scalar definition of VolumeTools::ComputeBrickStats
+  template<typename T>
+  std::vector<tuvok::MinMaxBlock> bs_reference(const std::vector<T>& data,
+                                               const UINT64VECTOR3& n,
+                                               size_t comps) {
+    std::vector<tuvok::MinMaxBlock> rv(comps, tuvok::MinMaxBlock(
+      DBL_MAX, -DBL_MAX, DBL_MAX, -DBL_MAX
+    ));
+    const size_t sx = size_t(n.x), sy = size_t(n.y), sz = size_t(n.z);
+    const size_t bx = sx > 2 ? 1 : 0, by = sy > 2 ? 1 : 0, bz = sz > 2 ? 1 : 0;
+    for(size_t z=0; z < sz; ++z) {
+      for(size_t y=0; y < sy; ++y) {
+        for(size_t x=0; x < sx; ++x) {
+          for(size_t c=0; c < comps; ++c) {
+            const size_t i = ((z*sy + y)*sx + x)*comps + c;
+            const double v = double(data[i]);
+            rv[c].minScalar = v < rv[c].minScalar ? v : rv[c].minScalar;
+            rv[c].maxScalar = v > rv[c].maxScalar ? v : rv[c].maxScalar;
+            if(x < bx || x >= sx-bx || y < by || y >= sy-by ||
+               z < bz || z >= sz-bz) { continue; }
+            const size_t dx = bx*comps, dy = by*sx*comps, dz = bz*sx*sy*comps;
+            const double g = DOUBLEVECTOR3(
+              (double(data[i-dx]) - double(data[i+dx])) / 2,
+              (double(data[i-dy]) - double(data[i+dy])) / 2,
+              (double(data[i-dz]) - double(data[i+dz])) / 2
+            ).length();
+            rv[c].minGradient = g < rv[c].minGradient ? g : rv[c].minGradient;
+            rv[c].maxGradient = g > rv[c].maxGradient ? g : rv[c].maxGradient;
+          }
+        }
+      }
+    }
+    return rv;
+  }
+
+  template<typename T> void bs_compare(SIMDLevel level, const UINT64VECTOR3& n,
+                                       size_t comps) {
+    std::mt19937 mt(uint32_t(level*1000 + n.volume() + comps));
+    std::vector<T> data(size_t(n.volume())*comps);
+    for(size_t i=0; i < data.size(); ++i) { data[i] = bs_random<T>(mt); }
+
+    TS_ASSERT_EQUALS(SetSIMDLevel(level), std::min(level, DetectSIMDLevel()));
+    const std::vector<tuvok::MinMaxBlock> ref = bs_reference(data, n, comps);
+    std::vector<tuvok::MinMaxBlock> stats(comps), values(comps);
+    ComputeBrickStats(&data[0], n, comps, true, &stats[0]);
+    ComputeBrickStats(&data[0], n, comps, false, &values[0]);
+    for(size_t c=0; c < comps; ++c) {
+      TS_ASSERT_EQUALS(stats[c].minScalar, ref[c].minScalar);
+      TS_ASSERT_EQUALS(stats[c].maxScalar, ref[c].maxScalar);
+      TS_ASSERT_EQUALS(stats[c].minGradient, ref[c].minGradient);
+      TS_ASSERT_EQUALS(stats[c].maxGradient, ref[c].maxGradient);
+      TS_ASSERT_EQUALS(values[c].minScalar, ref[c].minScalar);
+      TS_ASSERT_EQUALS(values[c].maxScalar, ref[c].maxScalar);
+      TS_ASSERT_EQUALS(values[c].minGradient, DBL_MAX);
+      TS_ASSERT_EQUALS(values[c].maxGradient, -DBL_MAX);
+    }
+  }
+
+  template<typename T> void bs_all_levels() {
+    bs_simd_level restore;
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      // odd sizes leave a scalar tail in every row; thin axes have no
+      // interior
+      bs_compare<T>(levels[l], UINT64VECTOR3(37, 9, 5), 1);
+      bs_compare<T>(levels[l], UINT64VECTOR3(19, 6, 4), 3);
+      bs_compare<T>(levels[l], UINT64VECTOR3(33, 2, 7), 1);
+      bs_compare<T>(levels[l], UINT64VECTOR3(1, 7, 2), 2);
+      bs_compare<T>(levels[l], UINT64VECTOR3(1, 1, 1), 1);
+    }
+  }
+
+  template<typename T> double bs_time(SIMDLevel level, bool reference,
+                                      const std::vector<T>& data,
+                                      const UINT64VECTOR3& n) {
+    SetSIMDLevel(level);
+    Timer t; t.Start();
+    for(size_t rep=0; rep < 4; ++rep) {
+      if(reference) {
+        bs_reference(data, n, 1);
+      } else {
+        tuvok::MinMaxBlock stats;
+        ComputeBrickStats(&data[0], n, 1, true, &stats);
+      }
+    }
+    return t.Elapsed();
+  }
+
+  // this is really a benchmark: the scalar loops against the kernel at
+  // whatever the CPU supports.  Numbers are for 4 bricks of 128^3 voxels.
+  template<typename T> void bs_bench(const char* name) {
+    bs_simd_level restore;
+    const UINT64VECTOR3 n(128, 128, 128);
+    std::mt19937 mt(42);
+    std::vector<T> data(size_t(n.volume()));
+    for(size_t i=0; i < data.size(); ++i) { data[i] = T(mt() % 4096); }
+    fprintf(stderr, "\n%-8s  loop: %7.2f ms", name,
+            bs_time(SIMD_SCALAR, true, data, n));
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      fprintf(stderr, "  %s: %7.2f ms", names[l],
+              bs_time(levels[l], false, data, n));
+    }
+  }
+}
+
+class BrickStatsTests : public CxxTest::TestSuite {
+public:
+  void test_uint8() { bs_all_levels<uint8_t>(); }
+  void test_int8() { bs_all_levels<int8_t>(); }
+  void test_uint16() { bs_all_levels<uint16_t>(); }
+  void test_int16() { bs_all_levels<int16_t>(); }
+  void test_uint32() { bs_all_levels<uint32_t>(); }
+  void test_int32() { bs_all_levels<int32_t>(); }
+  void test_uint64() { bs_all_levels<uint64_t>(); }
+  void test_int64() { bs_all_levels<int64_t>(); }
+  void test_float() { bs_all_levels<float>(); }
+  void test_double() { bs_all_levels<double>(); }
+
+  // the raster data block's per component ranges come from the kernel, too
+  void test_simple_max_min() {
+    const uint16_t data[] = { 9, 1,  3, 7,  5, 2,  8, 4 };
+    std::vector<DOUBLEVECTOR4> mm;
+    SimpleMaxMin<uint16_t, 2>(data, 1, 3, mm);
+    TS_ASSERT_EQUALS(mm.size(), size_t(2));
+    TS_ASSERT_EQUALS(mm[0].x, 3.0);
+    TS_ASSERT_EQUALS(mm[0].y, 8.0);
+    TS_ASSERT_EQUALS(mm[1].x, 2.0);
+    TS_ASSERT_EQUALS(mm[1].y, 7.0);
+  }
+
+  void test_bench() {
+    bs_bench<uint8_t>("uint8");
+    bs_bench<uint16_t>("uint16");
+    bs_bench<int16_t>("int16");
+    bs_bench<float>("float");
+    bs_bench<double>("double");
+    fprintf(stderr, "\n");
+  }
+};
@@ -0,0 +1,357 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "BrickBuffer.h"
+#include "Renderer/GPUMemMan/BrickTranscode.h"
+#include "Renderer/GPUMemMan/BrickTranscoder.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+
+using namespace tuvok;
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level when a test is done
+  struct bt_simd_level {
+    bt_simd_level() : old(GetSIMDLevel()) {}
+    ~bt_simd_level() { SetSIMDLevel(old); }
+    SIMDLevel old;
+  };
+
+  std::vector<unsigned char> bt_random(size_t bytes, uint32_t seed) {
+    std::mt19937 mt(seed);
+    std::vector<unsigned char> rv(bytes);
+    for(size_t i=0; i < rv.size(); ++i) { rv[i] = (unsigned char)(mt()); }
+    return rv;
+  }
+
+  // the scalar definition of QuantizeRow
+  uint8_t bt_quantize(uint16_t v, float fMin, float fScale, bool bSigned,
+                      bool bSwap) {
+    if(bSwap) { v = uint16_t((v >> 8) | (v << 8)); }
+    const float f = ((bSigned ? float(int16_t(v)) : float(v)) - fMin) * fScale;
+    return uint8_t(f < 0.0f ? 0.0f : (f > 255.0f ? 255.0f : f));
+  }
+
+  // the old GLVolumeListElem::PadData plus conversion, voxel by voxel: the
+  // last voxel is repeated once along each padded axis, the rest is zero.
+  std::vector<unsigned char> bt_reference(const std::vector<unsigned char>& in,
+                                          const UINTVECTOR3& n,
+                                          const TranscodeFormat& fmt) {
+    const UINTVECTOR3 o = TranscodedSize(fmt, n);
+    const size_t inElem = fmt.iCompCount * fmt.iBitWidth/8;
+    const size_t outElem = fmt.iCompCount * TranscodedBitWidth(fmt)/8;
+    const float fScale = fmt.fMax > fmt.fMin
+                           ? float(255.0 / (fmt.fMax - fmt.fMin)) : 0.0f;
+    std::vector<unsigned char> rv(size_t(o.volume()) * outElem, 0xcd);
+    for(uint32_t z=0; z < o.z; ++z) {
+      for(uint32_t y=0; y < o.y; ++y) {
+        for(uint32_t x=0; x < o.x; ++x) {
+          unsigned char* out = &rv[((size_t(z)*o.y + y)*o.x + x)*outElem];
+          UINTVECTOR3 s(x, y, z);
+          bool zero = false;
+          for(size_t a=0; a < 3; ++a) {
+            if(s[a] < n[a]) { continue; }
+            if(s[a] == n[a] && fmt.bClampBorder) { s[a] = n[a]-1; }
+            else { zero = true; }
+          }
+          if(zero) { memset(out, 0, outElem); continue; }
+          const unsigned char* v = &in[((size_t(s.z)*n.y + s.y)*n.x + s.x) *
+                                       inElem];
+          const size_t width = fmt.iBitWidth/8;
+          for(size_t c=0; c < fmt.iCompCount; ++c) {
+            unsigned char comp[8];
+            for(size_t b=0; b < width; ++b) {
+              comp[b] = v[c*width + (fmt.bToggleEndian ? width-1-b : b)];
+            }
+            if(fmt.bDownsampleTo8Bits && fmt.iBitWidth == 16) {
+              uint16_t u;
+              memcpy(&u, comp, 2);
+              out[c] = bt_quantize(u, float(fmt.fMin), fScale, fmt.bSigned,
+                                   false);
+            } else {
+              memcpy(out + c*width, comp, width);
+            }
+          }
+        }
+      }
+    }
+    return rv;
+  }
+
+  void bt_compare(const UINTVECTOR3& n, const TranscodeFormat& fmt) {
+    const std::vector<unsigned char> in = bt_random(
+      size_t(n.volume()) * fmt.iCompCount * fmt.iBitWidth/8,
+      uint32_t(n.volume() + fmt.iBitWidth)
+    );
+    const std::vector<unsigned char> ref = bt_reference(in, n, fmt);
+    TranscodedBrick out;
+    out.data.assign(ref.size(), 0xcd); // stale data from the last brick
+    TS_ASSERT(TranscodeBrick(in.empty() ? NULL : &in[0], n, fmt, out));
+    TS_ASSERT_EQUALS(out.vSize, TranscodedSize(fmt, n));
+    TS_ASSERT_EQUALS(out.iBitWidth, TranscodedBitWidth(fmt));
+    TS_ASSERT_EQUALS(uint64_t(out.data.size()), TranscodedBytes(fmt, n));
+    TS_ASSERT(out.data == ref);
+  }
+
+  TranscodeFormat bt_format(unsigned bits, unsigned comps, bool pot,
+                            bool clamp, bool swap, bool quantize=false) {
+    TranscodeFormat fmt;
+    fmt.iBitWidth = bits;
+    fmt.iCompCount = comps;
+    fmt.bPadToPowerOfTwo = pot;
+    fmt.bClampBorder = clamp;
+    fmt.bToggleEndian = swap;
+    fmt.bDownsampleTo8Bits = quantize;
+    fmt.fMin = 100;
+    fmt.fMax = 40000;
+    return fmt;
+  }
+
+  // a data set of bricks which are 16 bit ramps, 'n' voxels each
+  struct bt_source {
+    explicit bt_source(const UINTVECTOR3& n) : size(n), reads(0) {}
+    std::shared_ptr<const BrickBuffer> operator()(const BrickKey& k) {
+      ++reads;
+      std::vector<uint16_t> data(size_t(size.volume()));
+      for(size_t i=0; i < data.size(); ++i) {
+        data[i] = uint16_t(std::get<2>(k)*1000 + i);
+      }
+      return BrickBuffer::adopt(data);
+    }
+    UINTVECTOR3 size;
+    std::atomic<unsigned> reads;
+  };
+
+  std::vector<BrickKey> bt_keys(size_t n) {
+    std::vector<BrickKey> rv;
+    for(size_t i=0; i < n; ++i) { rv.push_back(BrickKey(0, 0, i)); }
+    return rv;
+  }
+
+  BrickTranscoder* bt_transcoder(bt_source& source, uint64_t maxBytes) {
+    return new BrickTranscoder(
+      [&source](const BrickKey& k) { return source(k); },
+      [&source](const BrickKey&) { return source.size; },
+      maxBytes, 3
+    );
+  }
+
+  double bt_time(SIMDLevel level, const std::vector<unsigned char>& in,
+                 const UINTVECTOR3& n, const TranscodeFormat& fmt) {
+    SetSIMDLevel(level);
+    TranscodedBrick out;
+    Timer t; t.Start();
+    for(size_t rep=0; rep < 4; ++rep) { TranscodeBrick(&in[0], n, fmt, out); }
+    return t.Elapsed();
+  }
+
+  // this is really a benchmark: the old path went over a brick up to
+  // three times.  Numbers are for 4 bricks of 127^3 voxels.
+  void bt_bench(const char* name, const TranscodeFormat& fmt) {
+    bt_simd_level restore;
+    const UINTVECTOR3 n(127, 127, 127);
+    const std::vector<unsigned char> in = bt_random(
+      size_t(n.volume()) * fmt.iCompCount * fmt.iBitWidth/8, 42
+    );
+    fprintf(stderr, "\n%-12s", name);
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      fprintf(stderr, "  %s: %7.2f ms", names[l], bt_time(levels[l], in, n,
+                                                          fmt));
+    }
+  }
+}
+
+class BrickTranscodeTests : public CxxTest::TestSuite {
+public:
+  void test_swap_row() {
+    bt_simd_level restore;
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      for(unsigned width=1; width <= 8; width *= 2) {
+        // odd lengths leave a scalar tail
+        for(size_t n=0; n < 70; n += 23) {
+          const std::vector<unsigned char> in = bt_random(n*width, 7);
+          std::vector<unsigned char> out(n*width + 1, 0xab);
+          SwapBytesRow(in.data(), out.data(), n, width);
+          for(size_t i=0; i < n*width; ++i) {
+            TS_ASSERT_EQUALS(out[i], in[(i/width)*width + width-1 - i%width]);
+          }
+          TS_ASSERT_EQUALS(out[n*width], 0xab);
+          // in place, twice, is where we started
+          SwapBytesRow(out.data(), out.data(), n, width);
+          TS_ASSERT(std::equal(in.begin(), in.end(), out.begin()));
+        }
+      }
+    }
+  }
+
+  void test_quantize_row() {
+    bt_simd_level restore;
+    const size_t n = 101;
+    std::vector<unsigned char> bytes = bt_random(n*2, 11);
+    std::vector<uint16_t> in(n);
+    memcpy(in.data(), bytes.data(), n*2);
+    in[0] = 0; in[1] = 0xffff; in[2] = 0x8000; in[3] = 0x7fff;
+
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      for(int variant=0; variant < 4; ++variant) {
+        const bool bSigned = (variant & 1) != 0, bSwap = (variant & 2) != 0;
+        const float fMin = bSigned ? -1000.0f : 100.0f;
+        const float fScale = 255.0f / 30000.0f;
+        std::vector<uint8_t> out(n);
+        QuantizeRow(in.data(), out.data(), n, fMin, fScale, bSigned, bSwap);
+        for(size_t i=0; i < n; ++i) {
+          TS_ASSERT_EQUALS(out[i], bt_quantize(in[i], fMin, fScale, bSigned,
+                                               bSwap));
+        }
+      }
+    }
+  }
+
+  void test_needs_transcode() {
+    const UINTVECTOR3 pot(64, 32, 16), npot(65, 32, 16);
+    TS_ASSERT(!NeedsTranscode(bt_format(8, 1, true, true, false), pot));
+    TS_ASSERT(NeedsTranscode(bt_format(8, 1, true, true, false), npot));
+    TS_ASSERT(!NeedsTranscode(bt_format(8, 1, false, true, false), npot));
+    TS_ASSERT(!NeedsTranscode(bt_format(8, 1, false, true, true), npot));
+    TS_ASSERT(NeedsTranscode(bt_format(16, 1, false, true, true), npot));
+    TS_ASSERT(NeedsTranscode(bt_format(16, 1, false, true, false, true), pot));
+    // 8 bit data is already as small as it gets
+    TS_ASSERT(!NeedsTranscode(bt_format(8, 1, false, true, false, true), pot));
+
+    TS_ASSERT_EQUALS(TranscodedSize(bt_format(8, 1, true, true, false), npot),
+                     UINTVECTOR3(128, 32, 16));
+    TS_ASSERT_EQUALS(TranscodedBytes(bt_format(16, 4, true, true, false), npot),
+                     uint64_t(128*32*16*4*2));
+    TS_ASSERT_EQUALS(TranscodedBytes(bt_format(16, 2, true, true, false, true),
+                                     npot), uint64_t(128*32*16*2));
+  }
+
+  void test_pad() {
+    for(int clamp=0; clamp < 2; ++clamp) {
+      bt_compare(UINTVECTOR3(5, 3, 6), bt_format(8, 1, true, clamp != 0, false));
+      bt_compare(UINTVECTOR3(17, 1, 2), bt_format(8, 4, true, clamp != 0,
+                                                  false));
+      bt_compare(UINTVECTOR3(1, 1, 1), bt_format(32, 1, true, clamp != 0,
+                                                 false));
+      bt_compare(UINTVECTOR3(8, 4, 2), bt_format(16, 1, true, clamp != 0,
+                                                 false));
+    }
+  }
+
+  // conversion and padding in one go, at every SIMD level
+  void test_convert() {
+    bt_simd_level restore;
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      for(int pot=0; pot < 2; ++pot) {
+        const UINTVECTOR3 n(37, 9, 5);
+        bt_compare(n, bt_format(16, 1, pot != 0, true, true));
+        bt_compare(n, bt_format(16, 3, pot != 0, false, true));
+        bt_compare(n, bt_format(32, 1, pot != 0, true, true));
+        bt_compare(n, bt_format(64, 2, pot != 0, true, true));
+        bt_compare(n, bt_format(16, 1, pot != 0, true, false, true));
+        bt_compare(n, bt_format(16, 2, pot != 0, true, true, true));
+        TranscodeFormat fmt = bt_format(16, 1, pot != 0, true, true, true);
+        fmt.bSigned = true;
+        fmt.fMin = -20000;
+        bt_compare(n, fmt);
+      }
+    }
+  }
+
+  void test_unsupported() {
+    std::vector<unsigned char> in(64);
+    TranscodedBrick out;
+    TS_ASSERT(!TranscodeBrick(&in[0], UINTVECTOR3(4, 4, 4),
+                              bt_format(32, 1, false, true, false, true), out));
+  }
+
+  void test_transcoder() {
+    bt_source source(UINTVECTOR3(5, 4, 3));
+    std::unique_ptr<BrickTranscoder> tc(bt_transcoder(source, 1024*1024));
+    const TranscodeFormat fmt = bt_format(16, 1, true, true, false, true);
+    tc->Request(bt_keys(8), fmt);
+    tc->Wait();
+    TS_ASSERT_EQUALS(tc->Prepared(), size_t(8));
+    TS_ASSERT_EQUALS(tc->PreparedBytes(), uint64_t(8*8*4*4));
+
+    for(size_t i=0; i < 8; ++i) {
+      std::shared_ptr<const TranscodedBrick> b = tc->Take(BrickKey(0, 0, i),
+                                                          fmt);
+      TS_ASSERT(b);
+      if(!b) { continue; }
+      TS_ASSERT_EQUALS(b->vSize, UINTVECTOR3(8, 4, 4));
+      TS_ASSERT_EQUALS(b->iBitWidth, 8u);
+      const std::shared_ptr<const BrickBuffer> raw = source(BrickKey(0, 0, i));
+      TranscodedBrick direct;
+      TS_ASSERT(TranscodeBrick(raw->data(), source.size, fmt, direct));
+      TS_ASSERT(b->data == direct.data);
+    }
+    // taken bricks are gone
+    TS_ASSERT_EQUALS(tc->Prepared(), size_t(0));
+    TS_ASSERT_EQUALS(tc->PreparedBytes(), uint64_t(0));
+    TS_ASSERT(!tc->Take(BrickKey(0, 0, 0), fmt));
+  }
+
+  // what nobody wants anymore is dropped, as is everything of another format
+  void test_transcoder_replace() {
+    bt_source source(UINTVECTOR3(5, 4, 3));
+    std::unique_ptr<BrickTranscoder> tc(bt_transcoder(source, 1024*1024));
+    const TranscodeFormat fmt = bt_format(16, 1, true, true, false);
+    tc->Request(bt_keys(8), fmt);
+    tc->Wait();
+    std::vector<BrickKey> keys = bt_keys(8);
+    keys.erase(keys.begin(), keys.begin() + 6);
+    tc->Request(keys, fmt);
+    tc->Wait();
+    TS_ASSERT_EQUALS(tc->Prepared(), size_t(2));
+    TS_ASSERT_EQUALS(source.reads.load(), 8u);
+    TS_ASSERT(!tc->Take(BrickKey(0, 0, 7), bt_format(16, 1, false, true,
+                                                     true)));
+
+    tc->Request(keys, bt_format(16, 1, true, false, false));
+    tc->Wait();
+    TS_ASSERT_EQUALS(tc->Prepared(), size_t(2));
+    TS_ASSERT_EQUALS(source.reads.load(), 10u);
+    TS_ASSERT(!tc->Take(BrickKey(0, 0, 7), fmt));
+
+    // nothing to do for bricks which are uploaded as they are
+    tc->Request(keys, bt_format(16, 1, false, true, false));
+    tc->Wait();
+    TS_ASSERT_EQUALS(tc->Prepared(), size_t(0));
+    TS_ASSERT_EQUALS(source.reads.load(), 10u);
+  }
+
+  void test_transcoder_budget() {
+    bt_source source(UINTVECTOR3(5, 4, 3));
+    // three padded 16 bit bricks fit
+    std::unique_ptr<BrickTranscoder> tc(bt_transcoder(source, 3*8*4*4*2 + 1));
+    const TranscodeFormat fmt = bt_format(16, 1, true, true, false);
+    tc->Request(bt_keys(8), fmt);
+    tc->Wait();
+    TS_ASSERT_EQUALS(tc->Prepared(), size_t(3));
+    TS_ASSERT(tc->Take(BrickKey(0, 0, 2), fmt));
+    TS_ASSERT(!tc->Take(BrickKey(0, 0, 3), fmt));
+  }
+
+  void test_bench() {
+    bt_bench("pad 8", bt_format(8, 1, true, true, false));
+    bt_bench("swap 16", bt_format(16, 1, false, true, true));
+    bt_bench("swap 32", bt_format(32, 1, false, true, true));
+    bt_bench("8 bit", bt_format(16, 1, false, true, false, true));
+    bt_bench("pad+8 bit", bt_format(16, 1, true, true, true, true));
+    fprintf(stderr, "\n");
+  }
+};
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "IO/BrickTree.h"
+
+using tuvok::BrickCuller;
+using tuvok::BrickKey;
+using tuvok::BrickMD;
+using tuvok::BrickTable;
+using tuvok::BrickTree;
+
+namespace {
+  // adds the bricks of a data set of the given size, split into bricks of
+  // (at most) the given size, like uvfDataset does: the domain is scaled to
+  // [-0.5,0.5] along its longest axis.
+  void bt_add_grid(BrickTable& table, size_t ts, size_t lod,
+                   const UINTVECTOR3& domain, const UINTVECTOR3& bsize) {
+    const UINTVECTOR3 layout((domain.x+bsize.x-1)/bsize.x,
+                             (domain.y+bsize.y-1)/bsize.y,
+                             (domain.z+bsize.z-1)/bsize.z);
+    const float scale = 1.0f / float(domain.maxVal());
+    for(uint32_t z=0; z < layout.z; ++z) {
+      for(uint32_t y=0; y < layout.y; ++y) {
+        for(uint32_t x=0; x < layout.x; ++x) {
+          const UINTVECTOR3 first(x*bsize.x, y*bsize.y, z*bsize.z);
+          const UINTVECTOR3 last(std::min(first.x+bsize.x, domain.x),
+                                 std::min(first.y+bsize.y, domain.y),
+                                 std::min(first.z+bsize.z, domain.z));
+          BrickMD md;
+          md.extents = FLOATVECTOR3(last - first) * scale;
+          md.center = (FLOATVECTOR3(first) + FLOATVECTOR3(last)) * 0.5f *
+                      scale - FLOATVECTOR3(domain) * 0.5f * scale;
+          md.n_voxels = last - first;
+          table.insert(std::make_pair(
+            BrickKey(ts, lod, (z*layout.y + y)*layout.x + x), md));
+        }
+      }
+    }
+  }
+
+  std::vector<BrickTable::const_iterator>
+  bt_select(const BrickTable& table, size_t ts, size_t lod) {
+    std::vector<BrickTable::const_iterator> v;
+    for(BrickTable::const_iterator b = table.begin(); b != table.end(); ++b) {
+      if(std::get<0>(b->first) == ts && std::get<1>(b->first) == lod) {
+        v.push_back(b);
+      }
+    }
+    return v;
+  }
+
+  // culls boxes which lie completely outside the given sphere
+  BrickCuller bt_sphere(const FLOATVECTOR3& c, float r) {
+    return [c, r](const FLOATVECTOR3& center, const FLOATVECTOR3& extents) {
+      float d2 = 0.0f;
+      for(size_t i=0; i < 3; ++i) {
+        const float d = std::max(std::fabs(center[i] - c[i]) -
+                                 extents[i]*0.5f, 0.0f);
+        d2 += d*d;
+      }
+      return d2 > r*r;
+    };
+  }
+
+  // culls boxes which lie completely in front of the given plane
+  BrickCuller bt_plane(const FLOATVECTOR3& n, float dist) {
+    return [n, dist](const FLOATVECTOR3& center, const FLOATVECTOR3& extents) {
+      const float r = (n.abs() ^ extents) * 0.5f;
+      return (n ^ center) - r > dist;
+    };
+  }
+
+  // the bricks the culler passes, checked one by one
+  std::set<BrickKey> bt_brute(const std::vector<BrickTable::const_iterator>& v,
+                              const BrickCuller& cull) {
+    std::set<BrickKey> keys;
+    for(size_t i=0; i < v.size(); ++i) {
+      if(!cull || !cull(v[i]->second.center, v[i]->second.extents)) {
+        keys.insert(v[i]->first);
+      }
+    }
+    return keys;
+  }
+
+  // for a grid of bricks, an order is front to back iff, for every pair of
+  // neighbors, the one on the eye's side of the common face comes first.
+  void bt_check_order(const std::vector<BrickTable::const_iterator>& order,
+                      const FLOATVECTOR3& eye) {
+    std::map<BrickKey, size_t> rank;
+    for(size_t i=0; i < order.size(); ++i) { rank[order[i]->first] = i; }
+    size_t pairs = 0;
+    for(size_t i=0; i < order.size(); ++i) {
+      const BrickMD& a = order[i]->second;
+      for(size_t j=0; j < order.size(); ++j) {
+        const BrickMD& b = order[j]->second;
+        for(size_t axis=0; axis < 3; ++axis) {
+          // b directly above a along 'axis'?
+          const float face = a.center[axis] + a.extents[axis]*0.5f;
+          if(std::fabs(b.center[axis] - b.extents[axis]*0.5f - face) > 1e-5f) {
+            continue;
+          }
+          bool bNeighbor = true;
+          for(size_t k=0; k < 3; ++k) {
+            if(k != axis && std::fabs(a.center[k] - b.center[k]) > 1e-5f) {
+              bNeighbor = false;
+            }
+          }
+          if(!bNeighbor || eye[axis] == face) { continue; }
+          ++pairs;
+          if(eye[axis] < face) {
+            TS_ASSERT_LESS_THAN(rank[order[i]->first], rank[order[j]->first]);
+          } else {
+            TS_ASSERT_LESS_THAN(rank[order[j]->first], rank[order[i]->first]);
+          }
+        }
+      }
+    }
+    TS_ASSERT(order.size() < 2 || pairs > 0);
+  }
+
+  std::set<BrickKey> bt_keys(const std::vector<BrickTable::const_iterator>& v) {
+    std::set<BrickKey> keys;
+    for(size_t i=0; i < v.size(); ++i) { keys.insert(v[i]->first); }
+    TS_ASSERT_EQUALS(keys.size(), v.size());
+    return keys;
+  }
+
+  void bt_bench() {
+    BrickTable table;
+    // a 4096^3 data set in 64^3 bricks, plus its next coarser level
+    bt_add_grid(table, 0, 0, UINTVECTOR3(4096,4096,4096),
+                UINTVECTOR3(64,64,64));
+    bt_add_grid(table, 0, 1, UINTVECTOR3(2048,2048,2048),
+                UINTVECTOR3(64,64,64));
+
+    Timer t;
+    t.Start();
+    BrickTree tree(bt_select(table, 0, 0));
+    const double build = t.Elapsed();
+
+    // a zoomed in view, which only sees a small part of the volume
+    const BrickCuller cull = bt_sphere(FLOATVECTOR3(0.1f,0.2f,-0.1f), 0.12f);
+    const FLOATVECTOR3 eye(0.3f, 0.8f, -2.0f);
+    const int runs = 20;
+    std::vector<BrickTable::const_iterator> result;
+    t.Start();
+    for(int r=0; r < runs; ++r) {
+      result.clear();
+      tree.Query(eye, cull, result);
+    }
+    const double query = t.Elapsed() / runs;
+
+    // what BuildSubFrameBrickList used to do: scan everything, then sort
+    std::vector<std::pair<float, BrickTable::const_iterator>> sorted;
+    t.Start();
+    for(int r=0; r < runs; ++r) {
+      sorted.clear();
+      for(BrickTable::const_iterator b = table.begin(); b != table.end(); ++b) {
+        if(std::get<0>(b->first) != 0 || std::get<1>(b->first) != 0 ||
+           cull(b->second.center, b->second.extents)) {
+          continue;
+        }
+        sorted.push_back(std::make_pair((b->second.center-eye).length(), b));
+      }
+      std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<float, BrickTable::const_iterator>& a,
+           const std::pair<float, BrickTable::const_iterator>& b) {
+          return a.first < b.first;
+        });
+    }
+    const double scan = t.Elapsed() / runs;
+
+    fprintf(stderr, "\n%u bricks, %u visible: build %.1f ms, query %.3f ms, "
+            "scan+sort %.3f ms\n", unsigned(tree.GetBrickCount()),
+            unsigned(result.size()), build, query, scan);
+    TS_ASSERT_EQUALS(result.size(), sorted.size());
+  }
+}
+
+class BrickTreeTests : public CxxTest::TestSuite {
+public:
+  void test_empty() {
+    BrickTree tree((std::vector<BrickTable::const_iterator>()));
+    TS_ASSERT_EQUALS(tree.GetBrickCount(), size_t(0));
+    std::vector<BrickTable::const_iterator> result;
+    tree.Query(FLOATVECTOR3(0,0,0), BrickCuller(), result);
+    TS_ASSERT(result.empty());
+  }
+
+  void test_all_bricks() {
+    const UINTVECTOR3 domains[] = {
+      UINTVECTOR3(1,1,1), UINTVECTOR3(100,30,7), UINTVECTOR3(256,256,256),
+      UINTVECTOR3(333,129,517),
+    };
+    for(size_t d=0; d < sizeof(domains)/sizeof(domains[0]); ++d) {
+      BrickTable table;
+      bt_add_grid(table, 0, 0, domains[d], UINTVECTOR3(32,32,32));
+      bt_add_grid(table, 0, 1, domains[d]/2 + UINTVECTOR3(1,1,1),
+                  UINTVECTOR3(32,32,32));
+      bt_add_grid(table, 1, 0, domains[d], UINTVECTOR3(32,32,32));
+      const std::vector<BrickTable::const_iterator> lod0 =
+        bt_select(table, 0, 0);
+      BrickTree tree(lod0);
+      TS_ASSERT_EQUALS(tree.GetBrickCount(), lod0.size());
+
+      std::vector<BrickTable::const_iterator> result;
+      tree.Query(FLOATVECTOR3(0.1f, -3.0f, 0.7f), BrickCuller(), result);
+      TS_ASSERT(bt_keys(result) == bt_brute(lod0, BrickCuller()));
+    }
+  }
+
+  void test_front_to_back() {
+    BrickTable table;
+    bt_add_grid(table, 0, 0, UINTVECTOR3(200,130,90), UINTVECTOR3(32,32,32));
+    const std::vector<BrickTable::const_iterator> bricks =
+      bt_select(table, 0, 0);
+    BrickTree tree(bricks);
+
+    std::mt19937 mt(7);
+    std::uniform_real_distribution<float> pos(-2.0f, 2.0f);
+    for(int i=0; i < 20; ++i) {
+      // outside as well as inside the volume
+      const FLOATVECTOR3 eye = FLOATVECTOR3(pos(mt), pos(mt), pos(mt)) *
+                               (i < 10 ? 1.0f : 0.2f);
+      std::vector<BrickTable::const_iterator> result;
+      tree.Query(eye, BrickCuller(), result);
+      TS_ASSERT_EQUALS(result.size(), bricks.size());
+      bt_check_order(result, eye);
+    }
+  }
+
+  void test_culling() {
+    BrickTable table;
+    bt_add_grid(table, 0, 0, UINTVECTOR3(300,200,160), UINTVECTOR3(32,32,32));
+    const std::vector<BrickTable::const_iterator> bricks =
+      bt_select(table, 0, 0);
+    BrickTree tree(bricks);
+
+    std::mt19937 mt(11);
+    std::uniform_real_distribution<float> pos(-0.6f, 0.6f);
+    std::uniform_real_distribution<float> rad(0.0f, 0.4f);
+    for(int i=0; i < 20; ++i) {
+      const FLOATVECTOR3 eye(pos(mt)*4.0f, pos(mt)*4.0f, pos(mt)*4.0f);
+      FLOATVECTOR3 n(pos(mt), pos(mt), pos(mt));
+      n.normalize();
+      const BrickCuller culls[] = {
+        bt_sphere(FLOATVECTOR3(pos(mt), pos(mt), pos(mt)), rad(mt)),
+        bt_plane(n, pos(mt) * 0.5f),
+      };
+      for(size_t c=0; c < 2; ++c) {
+        std::vector<BrickTable::const_iterator> result;
+        tree.Query(eye, culls[c], result);
+        TS_ASSERT(bt_keys(result) == bt_brute(bricks, culls[c]));
+        bt_check_order(result, eye);
+      }
+    }
+    // nothing passes
+    std::vector<BrickTable::const_iterator> result;
+    tree.Query(FLOATVECTOR3(0,0,0), bt_sphere(FLOATVECTOR3(5,5,5), 0.1f),
+               result);
+    TS_ASSERT(result.empty());
+  }
+
+  void test_shared_centers() {
+    // bricks which cannot be told apart by their centers end up in one leaf
+    BrickTable table;
+    for(size_t i=0; i < 5; ++i) {
+      BrickMD md;
+      md.center = FLOATVECTOR3(0.25f, 0.0f, 0.0f);
+      md.extents = FLOATVECTOR3(0.1f, 0.1f, 0.1f) * float(i+1);
+      md.n_voxels = UINTVECTOR3(8,8,8);
+      table.insert(std::make_pair(BrickKey(0, 0, i), md));
+    }
+    BrickMD md;
+    md.center = FLOATVECTOR3(-0.25f, 0.0f, 0.0f);
+    md.extents = FLOATVECTOR3(0.1f, 0.1f, 0.1f);
+    md.n_voxels = UINTVECTOR3(8,8,8);
+    table.insert(std::make_pair(BrickKey(0, 0, 5), md));
+
+    const std::vector<BrickTable::const_iterator> bricks =
+      bt_select(table, 0, 0);
+    BrickTree tree(bricks);
+    std::vector<BrickTable::const_iterator> result;
+    tree.Query(FLOATVECTOR3(-1,0,0), BrickCuller(), result);
+    TS_ASSERT_EQUALS(result.size(), size_t(6));
+    TS_ASSERT_EQUALS(std::get<2>(result.front()->first), size_t(5));
+
+    // the leaf still culls its bricks one by one
+    const BrickCuller cull = bt_sphere(FLOATVECTOR3(0.25f,0.0f,0.12f), 0.01f);
+    result.clear();
+    tree.Query(FLOATVECTOR3(-1,0,0), cull, result);
+    TS_ASSERT(bt_keys(result) == bt_brute(bricks, cull));
+  }
+
+  void test_bench() { bt_bench(); }
+};
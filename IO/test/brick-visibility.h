@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <set>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "Renderer/BrickVisibility.h"
+
+using tuvok::BrickVisibility;
+
+namespace {
+  // restores the number of threads when a test is done
+  struct bv_state {
+    bv_state() : threads(1) {
+#ifdef _OPENMP
+      threads = omp_get_max_threads();
+#endif
+    }
+    ~bv_state() {
+#ifdef _OPENMP
+      omp_set_num_threads(threads);
+#endif
+    }
+    int threads;
+  };
+
+  void bv_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+  }
+
+  // layouts of all LoDs down to a single brick, finest first
+  std::vector<UINTVECTOR3> bv_layouts(const UINTVECTOR3& leaves) {
+    std::vector<UINTVECTOR3> layouts(1, leaves);
+    while(layouts.back().volume() > 1) {
+      const UINTVECTOR3 l = layouts.back();
+      layouts.push_back(UINTVECTOR3((l.x+1)/2, (l.y+1)/2, (l.z+1)/2));
+    }
+    return layouts;
+  }
+
+  // the brick ranges of a hierarchy built from a smooth field: the leaves
+  // get a small range around the field value and every parent covers the
+  // ranges of its children, like the ranges a real data set has
+  void bv_ranges(const std::vector<UINTVECTOR3>& layouts, std::mt19937& mt,
+                 std::vector<double>& vMin, std::vector<double>& vMax) {
+    std::uniform_real_distribution<double> noise(0.0, 8.0);
+    vMin.clear(); vMax.clear();
+    const UINTVECTOR3 l0 = layouts[0];
+    for(uint32_t z=0; z < l0.z; ++z) {
+      for(uint32_t y=0; y < l0.y; ++y) {
+        for(uint32_t x=0; x < l0.x; ++x) {
+          const double v = 128.0 + 100.0 * std::sin(x*0.3) * std::cos(y*0.2) *
+                                   std::sin(z*0.25 + 0.5);
+          const double a = noise(mt), b = noise(mt);
+          vMin.push_back(v - a);
+          vMax.push_back(v + b);
+        }
+      }
+    }
+    size_t iChildOffset = 0;
+    for(size_t lod=1; lod < layouts.size(); ++lod) {
+      const UINTVECTOR3 c = layouts[lod-1], l = layouts[lod];
+      for(uint32_t z=0; z < l.z; ++z) {
+        for(uint32_t y=0; y < l.y; ++y) {
+          for(uint32_t x=0; x < l.x; ++x) {
+            double mn = std::numeric_limits<double>::max();
+            double mx = -std::numeric_limits<double>::max();
+            for(uint32_t cz=2*z; cz < std::min(2*z+2, c.z); ++cz) {
+              for(uint32_t cy=2*y; cy < std::min(2*y+2, c.y); ++cy) {
+                for(uint32_t cx=2*x; cx < std::min(2*x+2, c.x); ++cx) {
+                  const size_t i = iChildOffset + cx + c.x*(cy + c.y*cz);
+                  mn = std::min(mn, vMin[i]);
+                  mx = std::max(mx, vMax[i]);
+                }
+              }
+            }
+            vMin.push_back(mn);
+            vMax.push_back(mx);
+          }
+        }
+      }
+      iChildOffset += c.volume();
+    }
+  }
+
+  struct bv_brick { uint32_t lod, x, y, z; };
+
+  // whether anything in the subtree of the brick is visible, by brute force
+  bool bv_any_visible(const std::vector<UINTVECTOR3>& layouts,
+                      const std::vector<uint32_t>& offsets,
+                      const std::vector<bool>& visible, bv_brick b) {
+    const UINTVECTOR3 l = layouts[b.lod];
+    if(visible[offsets[b.lod] + b.x + l.x*(b.y + l.y*b.z)]) { return true; }
+    if(b.lod == 0) { return false; }
+    const UINTVECTOR3 c = layouts[b.lod-1];
+    for(uint32_t z=2*b.z; z < std::min(2*b.z+2, c.z); ++z) {
+      for(uint32_t y=2*b.y; y < std::min(2*b.y+2, c.y); ++y) {
+        for(uint32_t x=2*b.x; x < std::min(2*b.x+2, c.x); ++x) {
+          bv_brick child = { b.lod-1, x, y, z };
+          if(bv_any_visible(layouts, offsets, visible, child)) { return true; }
+        }
+      }
+    }
+    return false;
+  }
+
+  // the states as the per-brick rescan in GLVolumePool defined them
+  std::vector<uint8_t> bv_reference(const std::vector<UINTVECTOR3>& layouts,
+                                    const std::vector<double>& sMin,
+                                    const std::vector<double>& sMax,
+                                    const std::vector<double>& gMin,
+                                    const std::vector<double>& gMax,
+                                    const BrickVisibility::Window& w,
+                                    UINTVECTOR4& counts) {
+    std::vector<uint32_t> offsets;
+    uint32_t n = 0;
+    for(size_t i=0; i < layouts.size(); ++i) {
+      offsets.push_back(n);
+      n += layouts[i].volume();
+    }
+    std::vector<bool> visible(n);
+    for(uint32_t i=0; i < n; ++i) {
+      visible[i] = sMax[i] >= w.fMin && sMin[i] <= w.fMax &&
+                   (!w.bGradient || (gMax[i] >= w.fMinGradient &&
+                                     gMin[i] <= w.fMaxGradient));
+    }
+    std::vector<uint8_t> states(n);
+    counts = UINTVECTOR4(n, 0, 0, 0);
+    for(uint32_t lod=0; lod < layouts.size(); ++lod) {
+      const UINTVECTOR3 l = layouts[lod];
+      for(uint32_t z=0; z < l.z; ++z) {
+        for(uint32_t y=0; y < l.y; ++y) {
+          for(uint32_t x=0; x < l.x; ++x) {
+            const uint32_t i = offsets[lod] + x + l.x*(y + l.y*z);
+            bv_brick b = { lod, x, y, z };
+            if(visible[i]) {
+              states[i] = BrickVisibility::VISIBLE;
+            } else if(bv_any_visible(layouts, offsets, visible, b)) {
+              states[i] = BrickVisibility::EMPTY;
+              counts.y++;
+            } else {
+              states[i] = BrickVisibility::CHILD_EMPTY;
+              if(lod == 0) { counts.w++; } else { counts.z++; }
+            }
+          }
+        }
+      }
+    }
+    return states;
+  }
+
+  void bv_check(const BrickVisibility& bv,
+                const std::vector<UINTVECTOR3>& layouts,
+                const std::vector<double>& sMin,
+                const std::vector<double>& sMax,
+                const std::vector<double>& gMin,
+                const std::vector<double>& gMax,
+                const BrickVisibility::Window& w) {
+    UINTVECTOR4 counts;
+    const std::vector<uint8_t> ref = bv_reference(layouts, sMin, sMax, gMin,
+                                                  gMax, w, counts);
+    TS_ASSERT(bv.IsValid());
+    TS_ASSERT_EQUALS(bv.GetBrickCount(), uint32_t(ref.size()));
+    size_t iMismatches = 0;
+    for(uint32_t i=0; i < ref.size(); ++i) {
+      if(uint8_t(bv.GetState(i)) != ref[i]) { ++iMismatches; }
+    }
+    TS_ASSERT_EQUALS(iMismatches, size_t(0));
+    TS_ASSERT_EQUALS(bv.GetCounts(), counts);
+  }
+
+  BrickVisibility::Window bv_window(std::mt19937& mt, int mode,
+                                    double fWidth) {
+    std::uniform_real_distribution<double> pos(-20.0, 260.0);
+    std::uniform_real_distribution<double> width(0.0, fWidth);
+    const double a = pos(mt);
+    switch(mode) {
+      case 0: return BrickVisibility::Window(a, a + width(mt));
+      case 1: return BrickVisibility::Window(a, a); // isosurface
+      default: {
+        const double g = pos(mt);
+        return BrickVisibility::Window(a, a + width(mt), g, g + width(mt));
+      }
+    }
+  }
+
+  // random walks of the window, checking the state and the change list after
+  // every step
+  void bv_walk(const UINTVECTOR3& leaves, int mode, int threads) {
+    bv_state restore;
+    bv_threads(threads);
+    std::mt19937 mt(leaves.x * 131 + leaves.y * 17 + leaves.z + mode);
+    const std::vector<UINTVECTOR3> layouts = bv_layouts(leaves);
+    std::vector<double> sMin, sMax, gMin, gMax;
+    bv_ranges(layouts, mt, sMin, sMax);
+    bv_ranges(layouts, mt, gMin, gMax);
+
+    BrickVisibility bv(layouts);
+    bv.SetScalarRanges(sMin, sMax);
+    if(mode == 2) { bv.SetGradientRanges(gMin, gMax); }
+
+    BrickVisibility::Window w = bv_window(mt, mode, 120.0);
+    TS_ASSERT(!bv.CanUpdate(w));
+    TS_ASSERT(bv.Rebuild(w));
+    bv_check(bv, layouts, sMin, sMax, gMin, gMax, w);
+
+    std::normal_distribution<double> step(0.0, 6.0);
+    for(int i=0; i < 40; ++i) {
+      std::vector<uint8_t> before(bv.GetBrickCount());
+      for(uint32_t b=0; b < before.size(); ++b) {
+        before[b] = uint8_t(bv.GetState(b));
+      }
+      if(i % 10 == 9) {
+        w = bv_window(mt, mode, 120.0); // jump
+      } else {
+        w.fMin += step(mt);
+        w.fMax = (mode == 1) ? w.fMin : w.fMax + step(mt);
+        if(mode == 2) {
+          w.fMinGradient += step(mt);
+          w.fMaxGradient += step(mt);
+        }
+      }
+      TS_ASSERT(bv.CanUpdate(w));
+      const std::vector<uint32_t> changed = bv.Update(w);
+      bv_check(bv, layouts, sMin, sMax, gMin, gMax, w);
+
+      std::set<uint32_t> expected;
+      for(uint32_t b=0; b < before.size(); ++b) {
+        if(before[b] != uint8_t(bv.GetState(b))) { expected.insert(b); }
+      }
+      TS_ASSERT(std::set<uint32_t>(changed.begin(), changed.end()) == expected);
+      TS_ASSERT_EQUALS(changed.size(), expected.size());
+    }
+  }
+
+  void bv_bench() {
+    bv_state restore;
+    // about 110k leaves plus their ancestors
+    const std::vector<UINTVECTOR3> layouts = bv_layouts(UINTVECTOR3(48,48,48));
+    std::mt19937 mt(42);
+    std::vector<double> sMin, sMax;
+    bv_ranges(layouts, mt, sMin, sMax);
+    BrickVisibility bv(layouts);
+    bv.SetScalarRanges(sMin, sMax);
+
+    // a transfer function being dragged
+    std::vector<BrickVisibility::Window> drag;
+    for(int i=0; i < 100; ++i) {
+      drag.push_back(BrickVisibility::Window(60.0 + i*0.5, 140.0 + i*0.5));
+    }
+
+    Timer t;
+    const int threads[] = { 1, restore.threads };
+    for(size_t r=0; r < (restore.threads > 1 ? 2u : 1u); ++r) {
+      bv_threads(threads[r]);
+      t.Start();
+      for(size_t i=0; i < drag.size(); ++i) { bv.Rebuild(drag[i]); }
+      fprintf(stderr, "\n%u bricks, %d thread(s): rebuild %.3f ms/step",
+              bv.GetBrickCount(), threads[r], t.Elapsed() / drag.size());
+      bv.Rebuild(drag[0]);
+      size_t iChanged = 0;
+      t.Start();
+      for(size_t i=1; i < drag.size(); ++i) {
+        iChanged += bv.Update(drag[i]).size();
+      }
+      fprintf(stderr, ", incremental %.3f ms/step (%.0f changes/step)",
+              t.Elapsed() / (drag.size()-1),
+              double(iChanged) / (drag.size()-1));
+    }
+    fprintf(stderr, "\n");
+    bv_check(bv, layouts, sMin, sMax, sMin, sMax, drag.back());
+  }
+}
+
+class BrickVisibilityTests : public CxxTest::TestSuite {
+public:
+  void test_rebuild() {
+    const UINTVECTOR3 leaves[] = {
+      UINTVECTOR3(1,1,1), UINTVECTOR3(7,5,3), UINTVECTOR3(16,16,16),
+      UINTVECTOR3(9,1,4), UINTVECTOR3(1,13,2)
+    };
+    std::mt19937 mt(7);
+    for(size_t l=0; l < sizeof(leaves)/sizeof(leaves[0]); ++l) {
+      const std::vector<UINTVECTOR3> layouts = bv_layouts(leaves[l]);
+      std::vector<double> sMin, sMax, gMin, gMax;
+      bv_ranges(layouts, mt, sMin, sMax);
+      bv_ranges(layouts, mt, gMin, gMax);
+      BrickVisibility bv(layouts);
+      bv.SetScalarRanges(sMin, sMax);
+      bv.SetGradientRanges(gMin, gMax);
+      for(int mode=0; mode < 3; ++mode) {
+        for(int i=0; i < 5; ++i) {
+          const BrickVisibility::Window w = bv_window(mt, mode, 200.0);
+          TS_ASSERT(bv.Rebuild(w));
+          bv_check(bv, layouts, sMin, sMax, gMin, gMax, w);
+        }
+      }
+    }
+  }
+  void test_walk_1d() {
+    bv_walk(UINTVECTOR3(7,5,3), 0, 1);
+    bv_walk(UINTVECTOR3(24,17,9), 0, 4);
+  }
+  void test_walk_iso() {
+    bv_walk(UINTVECTOR3(7,5,3), 1, 1);
+    bv_walk(UINTVECTOR3(24,17,9), 1, 4);
+  }
+  void test_walk_2d() {
+    bv_walk(UINTVECTOR3(7,5,3), 2, 1);
+    bv_walk(UINTVECTOR3(24,17,9), 2, 4);
+  }
+  void test_unnested_ranges() {
+    // ranges that do not nest across the levels
+    const std::vector<UINTVECTOR3> layouts = bv_layouts(UINTVECTOR3(6,6,5));
+    std::mt19937 mt(3);
+    std::uniform_real_distribution<double> v(0.0, 255.0);
+    std::vector<double> sMin, sMax;
+    BrickVisibility bv(layouts);
+    for(uint32_t i=0; i < bv.GetBrickCount(); ++i) {
+      const double a = v(mt), b = v(mt);
+      sMin.push_back(std::min(a, b));
+      sMax.push_back(std::max(a, b));
+    }
+    bv.SetScalarRanges(sMin, sMax);
+    BrickVisibility::Window w(100.0, 110.0);
+    bv.Rebuild(w);
+    for(int i=0; i < 30; ++i) {
+      w = BrickVisibility::Window(v(mt), v(mt)); // also inverted windows
+      bv.Update(w);
+      bv_check(bv, layouts, sMin, sMax, sMin, sMax, w);
+    }
+  }
+  void test_nan() {
+    const std::vector<UINTVECTOR3> layouts = bv_layouts(UINTVECTOR3(5,4,3));
+    std::mt19937 mt(5);
+    std::vector<double> sMin, sMax;
+    bv_ranges(layouts, mt, sMin, sMax);
+    for(size_t i=0; i < sMin.size(); i += 7) {
+      sMin[i] = std::numeric_limits<double>::quiet_NaN();
+    }
+    BrickVisibility bv(layouts);
+    bv.SetScalarRanges(sMin, sMax);
+    BrickVisibility::Window w(50.0, 90.0);
+    bv.Rebuild(w);
+    bv_check(bv, layouts, sMin, sMax, sMin, sMax, w);
+    for(int i=0; i < 20; ++i) {
+      w = bv_window(mt, 0, 150.0);
+      bv.Update(w);
+      bv_check(bv, layouts, sMin, sMax, sMin, sMax, w);
+    }
+    const BrickVisibility::Window nan(std::numeric_limits<double>::quiet_NaN(),
+                                      100.0);
+    TS_ASSERT(!bv.CanUpdate(nan));
+    TS_ASSERT_EQUALS(bv.Update(nan).size(), size_t(bv.GetBrickCount()));
+    bv_check(bv, layouts, sMin, sMax, sMin, sMax, nan);
+  }
+  void test_interrupt() {
+    const std::vector<UINTVECTOR3> layouts = bv_layouts(UINTVECTOR3(64,64,40));
+    std::mt19937 mt(9);
+    std::vector<double> sMin, sMax;
+    bv_ranges(layouts, mt, sMin, sMax);
+    BrickVisibility bv(layouts);
+    bv.SetScalarRanges(sMin, sMax);
+    const BrickVisibility::Window w(10.0, 80.0);
+
+    int polls = 0;
+    TS_ASSERT(!bv.Rebuild(w, [&polls]() { return ++polls < 3; }));
+    TS_ASSERT_EQUALS(polls, 3);
+    TS_ASSERT(!bv.IsValid());
+    TS_ASSERT(!bv.CanUpdate(w));
+    bv.Update(w);
+    bv_check(bv, layouts, sMin, sMax, sMin, sMax, w);
+
+    // new ranges, e.g. another timestep, need a rebuild
+    bv_ranges(layouts, mt, sMin, sMax);
+    bv.SetScalarRanges(sMin, sMax);
+    TS_ASSERT(!bv.CanUpdate(w));
+    TS_ASSERT(bv.Rebuild(w, []() { return true; }));
+    bv_check(bv, layouts, sMin, sMax, sMin, sMax, w);
+  }
+  void test_bench() { bv_bench(); }
+};
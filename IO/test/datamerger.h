@@ -0,0 +1,391 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include <cxxtest/TestSuite.h>
+#include "Basics/LargeRAWFile.h"
+#include "Basics/Timer.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+#include "../DataMerger.h"
+#include "util-test.h"
+
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level and the number of threads when a test is done
+  struct dm_state {
+    dm_state() : level(GetSIMDLevel()), threads(1) {
+#ifdef _OPENMP
+      threads = omp_get_max_threads();
+#endif
+    }
+    ~dm_state() {
+      SetSIMDLevel(level);
+#ifdef _OPENMP
+      omp_set_num_threads(threads);
+#endif
+    }
+    SIMDLevel level;
+    int threads;
+  };
+
+  void dm_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+  }
+
+  // writes 'header' garbage bytes followed by the data; returns the file
+  template<typename T>
+  tuvok::MergeDataset dm_write(const std::vector<T>& data, uint64_t header,
+                               double scale, double bias) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    const std::vector<char> garbage(size_t(header), 'x');
+    if(header) { ofs.write(&garbage[0], std::streamsize(header)); }
+    ofs.write(reinterpret_cast<const char*>(&data[0]),
+              std::streamsize(data.size() * sizeof(T)));
+    return tuvok::MergeDataset(fn, header, true, scale, bias);
+  }
+
+  template<typename T> std::vector<T> dm_read(const std::string& fn) {
+    std::ifstream ifs(fn.c_str(), std::ios::in | std::ios::binary);
+    std::vector<T> data;
+    T v;
+    while(ifs.read(reinterpret_cast<char*>(&v), sizeof(T))) {
+      data.push_back(v);
+    }
+    return data;
+  }
+
+  void dm_cleanup(const std::vector<tuvok::MergeDataset>& files,
+                  const std::string& target) {
+    for(size_t i=0; i < files.size(); ++i) {
+      remove(files[i].strFilename.c_str());
+    }
+    remove(target.c_str());
+  }
+
+  // DataMerger as it was before the single pass version, in memory: the
+  // first file as it is if it is the only one, the mapped values otherwise.
+  template<typename T>
+  T dm_legacy_map(T x, const tuvok::MergeDataset& ds) {
+    return T(std::min<double>(ds.fScale*(x + ds.fBias),
+                              double(std::numeric_limits<T>::max())));
+  }
+  template<typename T>
+  std::vector<T> dm_legacy(const std::vector<std::vector<T>>& data,
+                           const std::vector<tuvok::MergeDataset>& files,
+                           bool bUseMaxMode) {
+    std::vector<T> acc = data[0];
+    for(size_t i=1; i < data.size(); ++i) {
+      for(size_t j=0; j < acc.size(); ++j) {
+        const T a = i == 1 ? dm_legacy_map(acc[j], files[0]) : acc[j];
+        const T b = dm_legacy_map(data[i][j], files[i]);
+        if(bUseMaxMode) {
+          acc[j] = std::max<T>(a, b);
+        } else {
+          const T val = T(a + b);
+          acc[j] = (val < a || val < b) ? std::numeric_limits<T>::max() : val;
+        }
+      }
+    }
+    return acc;
+  }
+
+  // non-negative values up to 'range', and some at the limit of T.  Not
+  // for 64 bit types: the legacy mapping goes through double, where their
+  // limits are out of range.
+  template<typename T>
+  std::vector<T> dm_data(size_t n, double range, std::mt19937& mt) {
+    std::uniform_real_distribution<double> dist(0.0, range);
+    std::vector<T> data(n);
+    for(size_t i=0; i < n; ++i) {
+      data[i] = (sizeof(T) < 8 && mt() % 97 == 0) ?
+        std::numeric_limits<T>::max() : T(dist(mt));
+    }
+    return data;
+  }
+
+  // the merger against the legacy code, for data where the legacy code was
+  // right: no negative values and no signed overflows.
+  template<typename T>
+  void dm_compare(size_t iFiles, bool bUseMaxMode, bool bScale) {
+    dm_state restore;
+    // neither a multiple of the chunk nor of a vector
+    const size_t n = 10007;
+    std::mt19937 mt(uint32_t(iFiles * 2 + (bUseMaxMode ? 1 : 0)));
+    // sums of signed values must not overflow in the legacy code
+    // and be exact in double precision
+    const double range = std::numeric_limits<T>::is_signed &&
+                         std::numeric_limits<T>::is_integer ?
+      std::min(1e15, double(std::numeric_limits<T>::max()) /
+                     double(2*iFiles+2)) :
+      std::min(1e6, double(std::numeric_limits<T>::max()));
+
+    std::vector<std::vector<T>> data;
+    std::vector<tuvok::MergeDataset> files;
+    for(size_t i=0; i < iFiles; ++i) {
+      data.push_back(dm_data<T>(n, range, mt));
+      if(std::numeric_limits<T>::is_signed &&
+         std::numeric_limits<T>::is_integer) {
+        // no max in the signed data either, it would overflow
+        for(size_t j=0; j < n; ++j) {
+          if(data[i][j] == std::numeric_limits<T>::max()) { data[i][j] = 0; }
+        }
+      }
+      const double scale = bScale && i % 2 ? 0.5 : 1.0;
+      const double bias = bScale && i % 3 == 2 ? 3.0 : 0.0;
+      files.push_back(dm_write(data.back(), i == 1 ? 13 : 0, scale, bias));
+    }
+    const std::vector<T> ref = dm_legacy(data, files, bUseMaxMode);
+
+    std::ofstream ofs;
+    const std::string target = mk_tmpfile(ofs, std::ios::out);
+    ofs.close();
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      for(int threads=1; threads <= 4; threads *= 4) {
+        dm_threads(threads);
+        // 4k of memory makes for chunks of 1024 values, the default for one
+        const uint64_t memory[] = { 4096, BLOCK_COPY_SIZE };
+        for(size_t m=0; m < 2; ++m) {
+          tuvok::DataMerger<T> d(files, target, n, bUseMaxMode, memory[m]);
+          TS_ASSERT(d.IsOK());
+          const std::vector<T> out = dm_read<T>(target);
+          TS_ASSERT_EQUALS(out.size(), ref.size());
+          TS_ASSERT(out.size() == ref.size() &&
+                    std::memcmp(&out[0], &ref[0], n * sizeof(T)) == 0);
+        }
+      }
+    }
+    dm_cleanup(files, target);
+  }
+
+  template<typename T> void dm_compare_all() {
+    dm_compare<T>(1, true, false);
+    dm_compare<T>(3, true, false);
+    dm_compare<T>(3, false, false);
+    dm_compare<T>(3, true, true);
+    dm_compare<T>(8, false, true);
+  }
+
+  // the kernels against their scalar definition, bit by bit, over the
+  // whole range of T, including NaNs and signed zeros.
+  template<typename T> void dm_kernels(SIMDLevel level) {
+    const size_t n = 1001;
+    std::mt19937 mt(level);
+    std::vector<T> a(n), b(n);
+    for(size_t i=0; i < n; ++i) {
+      if(std::numeric_limits<T>::is_integer) {
+        uint64_t bits[2] = { uint64_t(mt()) << 32 | mt(),
+                             uint64_t(mt()) << 32 | mt() };
+        if(i % 5 == 0) { bits[0] >>= 60; }  // small values too
+        std::memcpy(&a[i], &bits[0], sizeof(T));
+        std::memcpy(&b[i], &bits[1], sizeof(T));
+      } else {
+        std::uniform_real_distribution<double> dist(-1e3, 1e3);
+        a[i] = T(dist(mt));
+        b[i] = T(dist(mt));
+        if(i % 7 == 0) { a[i] = std::numeric_limits<T>::quiet_NaN(); }
+        if(i % 11 == 0) { b[i] = std::numeric_limits<T>::quiet_NaN(); }
+        if(i % 13 == 0) { a[i] = T(-0.0); b[i] = T(0.0); }
+        if(i % 17 == 0) { a[i] = T(0.0); b[i] = T(-0.0); }
+      }
+    }
+    a[0] = std::numeric_limits<T>::max(); b[0] = std::numeric_limits<T>::max();
+    a[1] = std::numeric_limits<T>::lowest();
+    b[1] = std::numeric_limits<T>::lowest();
+    a[2] = std::numeric_limits<T>::max();
+    b[2] = std::numeric_limits<T>::lowest();
+
+    SetSIMDLevel(level);
+    std::vector<T> mx = a, sum = a;
+    MaxRow(&mx[0], &b[0], n);
+    SaturatingAddRow(&sum[0], &b[0], n);
+    for(size_t i=0; i < n; ++i) {
+      const T refMax = std::max(a[i], b[i]);
+      const T refSum = SaturatingAdd(a[i], b[i]);
+      TS_ASSERT_SAME_DATA(&mx[i], &refMax, sizeof(T));
+      TS_ASSERT_SAME_DATA(&sum[i], &refSum, sizeof(T));
+    }
+  }
+
+  template<typename T> void dm_kernels_all() {
+    dm_state restore;
+    dm_kernels<T>(SIMD_SCALAR);
+    dm_kernels<T>(SIMD_SSE2);
+    dm_kernels<T>(SIMD_AVX2);
+  }
+
+  // the old merger, file based: copy the first file, then read, merge and
+  // write the target once per further file.
+  template<typename T>
+  bool dm_legacy_file(const std::vector<tuvok::MergeDataset>& files,
+                      const std::string& target, uint64_t iElemCount) {
+    if(!LargeRAWFile::Copy(files[0].strFilename, target,
+                           files[0].iHeaderSkip)) {
+      return false;
+    }
+    LargeRAWFile out(target);
+    if(!out.Open(true)) { return false; }
+    const size_t iCopy = size_t(std::min(iElemCount,
+                                         BLOCK_COPY_SIZE/2/sizeof(T)));
+    std::vector<T> vTarget(iCopy), vSource(iCopy);
+    for(size_t i=1; i < files.size(); ++i) {
+      LargeRAWFile in(files[i].strFilename, files[i].iHeaderSkip);
+      if(!in.Open(false)) { return false; }
+      uint64_t iDone = 0;
+      while(iDone < iElemCount) {
+        const size_t n = size_t(std::min<uint64_t>(iCopy, iElemCount - iDone));
+        out.SeekPos(iDone*sizeof(T));
+        in.ReadRAW(reinterpret_cast<unsigned char*>(&vSource[0]), n*sizeof(T));
+        out.ReadRAW(reinterpret_cast<unsigned char*>(&vTarget[0]),
+                    n*sizeof(T));
+        for(size_t j=0; j < n; ++j) {
+          const T a = i == 1 ? dm_legacy_map(vTarget[j], files[0])
+                             : vTarget[j];
+          vTarget[j] = std::max<T>(a, dm_legacy_map(vSource[j], files[i]));
+        }
+        out.SeekPos(iDone*sizeof(T));
+        out.WriteRAW(reinterpret_cast<unsigned char*>(&vTarget[0]),
+                     n*sizeof(T));
+        iDone += n;
+      }
+    }
+    return true;
+  }
+
+  // 8 channels of 16M uint16 values, merged by maximum
+  void dm_bench() {
+    dm_state restore;
+    const size_t n = size_t(1) << 24;
+    std::mt19937 mt(42);
+    std::vector<tuvok::MergeDataset> files;
+    for(size_t i=0; i < 8; ++i) {
+      files.push_back(dm_write(dm_data<uint16_t>(n, 60000.0, mt), 0,
+                               i % 2 ? 0.5 : 1.0, 0.0));
+    }
+    std::ofstream ofs;
+    const std::string target = mk_tmpfile(ofs, std::ios::out);
+    ofs.close();
+
+    Timer t; t.Start();
+    dm_legacy_file<uint16_t>(files, target, n);
+    fprintf(stderr, "\n%-28s %8.2f ms", "legacy, copy + 7 passes",
+            t.Elapsed());
+    const std::vector<uint16_t> ref = dm_read<uint16_t>(target);
+
+    struct { SIMDLevel level; int threads; const char* desc; } runs[] = {
+      { SIMD_SCALAR, 1, "single pass, scalar, 1 thread" },
+      { DetectSIMDLevel(), 1, "single pass, simd, 1 thread" },
+      { DetectSIMDLevel(), restore.threads, "single pass, all threads" },
+    };
+    for(size_t r=0; r < 3; ++r) {
+      SetSIMDLevel(runs[r].level);
+      dm_threads(runs[r].threads);
+      t.Start();
+      tuvok::DataMerger<uint16_t> d(files, target, n, true);
+      fprintf(stderr, "\n%-28s %8.2f ms", runs[r].desc, t.Elapsed());
+      TS_ASSERT(d.IsOK());
+      TS_ASSERT(dm_read<uint16_t>(target) == ref);
+    }
+    fprintf(stderr, "\n");
+    dm_cleanup(files, target);
+  }
+}
+
+class DataMergerTests : public CxxTest::TestSuite {
+public:
+  void test_uint8() { dm_compare_all<uint8_t>(); }
+  void test_int8() { dm_compare_all<int8_t>(); }
+  void test_uint16() { dm_compare_all<uint16_t>(); }
+  void test_int16() { dm_compare_all<int16_t>(); }
+  void test_uint32() { dm_compare_all<uint32_t>(); }
+  void test_int32() { dm_compare_all<int32_t>(); }
+  void test_uint64() { dm_compare_all<uint64_t>(); }
+  void test_int64() { dm_compare_all<int64_t>(); }
+  void test_float() { dm_compare_all<float>(); }
+  void test_double() { dm_compare_all<double>(); }
+
+  // the legacy code had signed sums saturate at the maximum only
+  void test_negative_sum() {
+    const std::vector<int8_t> a(100, -100), b(100, -50);
+    std::vector<tuvok::MergeDataset> files;
+    files.push_back(dm_write(a, 0, 1.0, 0.0));
+    files.push_back(dm_write(b, 0, 1.0, 0.0));
+    std::ofstream ofs;
+    const std::string target = mk_tmpfile(ofs, std::ios::out);
+    ofs.close();
+    tuvok::DataMerger<int8_t> d(files, target, a.size(), false);
+    TS_ASSERT(d.IsOK());
+    TS_ASSERT(dm_read<int8_t>(target) == std::vector<int8_t>(100, -128));
+    dm_cleanup(files, target);
+  }
+
+  // scaled floating point values saturate at both ends of the type
+  void test_float_clamp() {
+    std::vector<float> a(4, 0.0f);
+    a[0] = -3e38f; a[1] = 3e38f; a[2] = -1.0f; a[3] = 1.0f;
+    const std::vector<float> b(4, 0.0f);
+    std::vector<tuvok::MergeDataset> files;
+    files.push_back(dm_write(a, 0, 2.0, 0.0));
+    files.push_back(dm_write(b, 0, 1.0, 0.0));
+    std::ofstream ofs;
+    const std::string target = mk_tmpfile(ofs, std::ios::out);
+    ofs.close();
+    tuvok::DataMerger<float> d(files, target, a.size(), false);
+    TS_ASSERT(d.IsOK());
+    const std::vector<float> merged = dm_read<float>(target);
+    TS_ASSERT_EQUALS(merged.size(), 4u);
+    if(merged.size() == 4) {
+      TS_ASSERT_EQUALS(merged[0], std::numeric_limits<float>::lowest());
+      TS_ASSERT_EQUALS(merged[1], std::numeric_limits<float>::max());
+      TS_ASSERT_EQUALS(merged[2], -2.0f);
+      TS_ASSERT_EQUALS(merged[3], 2.0f);
+    }
+    dm_cleanup(files, target);
+  }
+
+  // an input which is too short fails the merge and leaves no target
+  void test_short_input() {
+    std::mt19937 mt(1);
+    std::vector<tuvok::MergeDataset> files;
+    files.push_back(dm_write(dm_data<uint16_t>(5000, 100.0, mt), 0, 1, 0));
+    files.push_back(dm_write(dm_data<uint16_t>(4000, 100.0, mt), 0, 1, 0));
+    std::ofstream ofs;
+    const std::string target = mk_tmpfile(ofs, std::ios::out);
+    ofs.close();
+    tuvok::DataMerger<uint16_t> d(files, target, 5000, true, 4096);
+    TS_ASSERT(!d.IsOK());
+    TS_ASSERT(!std::ifstream(target.c_str()).good());
+    dm_cleanup(files, target);
+  }
+
+  void test_kernels() {
+    dm_kernels_all<uint8_t>();
+    dm_kernels_all<int8_t>();
+    dm_kernels_all<uint16_t>();
+    dm_kernels_all<int16_t>();
+    dm_kernels_all<uint32_t>();
+    dm_kernels_all<int32_t>();
+    dm_kernels_all<uint64_t>();
+    dm_kernels_all<int64_t>();
+    dm_kernels_all<float>();
+    dm_kernels_all<double>();
+  }
+
+  // really a benchmark
+  void test_bench() { dm_bench(); }
+};
@@ -0,0 +1,245 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <cxxtest/TestSuite.h>
+#include "Controller/Controller.h"
+#include "DICOM/DICOMParser.h"
+#include "DirectoryScanCache.h"
+#include "StackSliceSource.h"
+#include "util-test.h"
+
+namespace {
+  const uint32_t ds_width = 8;
+  const uint32_t ds_height = 6;
+
+  void ds_put16(std::string& s, uint16_t v) {
+    s.push_back(char(v & 0xff));
+    s.push_back(char(v >> 8));
+  }
+  void ds_put32(std::string& s, uint32_t v) {
+    ds_put16(s, uint16_t(v & 0xffff));
+    ds_put16(s, uint16_t(v >> 16));
+  }
+  // explicit VR element with a short length field
+  void ds_elem(std::string& s, uint16_t group, uint16_t elem, const char vr[3],
+               std::string value) {
+    if(value.size() % 2) { value.push_back(vr[0] == 'U' ? '\0' : ' '); }
+    ds_put16(s, group); ds_put16(s, elem);
+    s.append(vr, 2);
+    ds_put16(s, uint16_t(value.size()));
+    s.append(value);
+  }
+  void ds_us(std::string& s, uint16_t group, uint16_t elem, uint16_t v) {
+    std::string value;
+    ds_put16(value, v);
+    ds_elem(s, group, elem, "US", value);
+  }
+  // OB/OW elements have a reserved field and a long length
+  void ds_long(std::string& s, uint16_t group, uint16_t elem, const char vr[3],
+               const std::string& value) {
+    ds_put16(s, group); ds_put16(s, elem);
+    s.append(vr, 2);
+    ds_put16(s, 0);
+    ds_put32(s, uint32_t(value.size()));
+    s.append(value);
+  }
+
+  // an explicit VR little endian DICOM of a single 16 bit slice; 'padding'
+  // bytes of private data push the pixel data back.
+  void ds_write(const std::string& fn, uint32_t series, uint32_t index,
+                size_t padding=0) {
+    std::string s(128, '\0');
+    s.append("DICM");
+    std::string meta;
+    ds_elem(meta, 0x2, 0x10, "UI", std::string("1.2.840.10008.1.2.1"));
+    std::string len;
+    ds_put32(len, uint32_t(meta.size()));
+    ds_elem(s, 0x2, 0x0, "UL", len);
+    s.append(meta);
+
+    char buf[64];
+    ds_elem(s, 0x8, 0x60, "CS", "CT");
+    if(padding) { ds_long(s, 0x9, 0x1010, "OB", std::string(padding, 'x')); }
+    sprintf(buf, "%u", series);
+    ds_elem(s, 0x20, 0x11, "IS", buf);
+    sprintf(buf, "%u", index);
+    ds_elem(s, 0x20, 0x13, "IS", buf);
+    sprintf(buf, "0\\0\\%u", 2*index);
+    ds_elem(s, 0x20, 0x32, "DS", buf);
+    ds_us(s, 0x28, 0x2, 1);
+    ds_us(s, 0x28, 0x10, uint16_t(ds_height));
+    ds_us(s, 0x28, 0x11, uint16_t(ds_width));
+    ds_us(s, 0x28, 0x100, 16);
+    ds_us(s, 0x28, 0x101, 16);
+    ds_us(s, 0x28, 0x103, 0);
+    std::string pixels;
+    for(uint32_t i=0; i < ds_width*ds_height; ++i) {
+      ds_put16(pixels, uint16_t(index*1000 + i));
+    }
+    ds_long(s, 0x7fe0, 0x10, "OW", pixels);
+
+    std::ofstream ofs(fn.c_str(), std::ios::binary);
+    ofs.write(s.data(), s.size());
+  }
+
+  struct ds_dir {
+    ds_dir() {
+      char templ[64];
+      strcpy(templ, ".iotest.XXXXXX");
+      TS_ASSERT(mkdtemp(templ) != NULL);
+      name = SysTools::CanonicalizePath(templ);
+    }
+    ~ds_dir() {
+      remove(tuvok::DirectoryScanCache(name, "dicom").Filename().c_str());
+      std::vector<std::string> files = SysTools::GetDirContents(name);
+      for(size_t i=0; i < files.size(); ++i) { remove(files[i].c_str()); }
+      rmdir(name.c_str());
+    }
+    std::string file(const char* fn) const { return name + "/" + fn; }
+    std::string name;
+  };
+
+  // checks that the stack holds the given slices in order, with their data
+  void ds_check_stack(FileStackInfo* stack, uint32_t first, uint32_t count) {
+    TS_ASSERT_EQUALS(stack->m_Elements.size(), size_t(count));
+    TS_ASSERT_EQUALS(stack->m_ivSize, UINTVECTOR3(ds_width, ds_height, 1));
+    TS_ASSERT_EQUALS(stack->m_iAllocated, 16u);
+    TS_ASSERT_DELTA(stack->m_fvfAspect.z, 2.0f, 0.0001f);
+    for(size_t i=0; i < stack->m_Elements.size(); ++i) {
+      SimpleFileInfo* slice = stack->m_Elements[i];
+      TS_ASSERT_EQUALS(slice->m_iImageIndex, uint32_t(first + i));
+      TS_ASSERT_EQUALS(slice->GetDataSize(), ds_width*ds_height*2);
+      std::vector<char> data(slice->GetDataSize());
+      TS_ASSERT(slice->GetData(data, uint32_t(data.size()), 0));
+      const uint16_t* px = reinterpret_cast<const uint16_t*>(&data[0]);
+      TS_ASSERT_EQUALS(px[0], uint16_t((first+i)*1000));
+      TS_ASSERT_EQUALS(px[ds_width*ds_height-1],
+                       uint16_t((first+i)*1000 + ds_width*ds_height-1));
+    }
+  }
+}
+
+class DICOMScanTests : public CxxTest::TestSuite {
+public:
+  void test_scan() {
+    ds_dir dir;
+    for(uint32_t i=1; i <= 5; ++i) {
+      char fn[16];
+      sprintf(fn, "slice%u.dcm", 6-i);
+      ds_write(dir.file(fn), 3, 6-i);
+    }
+    std::ofstream(dir.file("readme.txt").c_str()) << "not a DICOM";
+
+    DICOMParser parser;
+    parser.GetDirInfo(dir.name);
+    TS_ASSERT_EQUALS(parser.m_FileStacks.size(), size_t(1));
+    if(parser.m_FileStacks.size() == 1) {
+      ds_check_stack(parser.m_FileStacks[0], 1, 5);
+    }
+  }
+
+  // the header does not fit into the prefix which is read first
+  void test_large_header() {
+    ds_dir dir;
+    ds_write(dir.file("a.dcm"), 1, 1, 100000);
+    ds_write(dir.file("b.dcm"), 1, 2, 70000);
+    ds_write(dir.file("c.dcm"), 1, 3);
+
+    DICOMParser parser;
+    parser.GetDirInfo(dir.name);
+    TS_ASSERT_EQUALS(parser.m_FileStacks.size(), size_t(1));
+    if(parser.m_FileStacks.size() == 1) {
+      ds_check_stack(parser.m_FileStacks[0], 1, 3);
+    }
+  }
+
+  void test_rescan_from_cache() {
+    ds_dir dir;
+    for(uint32_t i=1; i <= 4; ++i) {
+      char fn[16];
+      sprintf(fn, "%u", i);
+      ds_write(dir.file(fn), 7, i, i == 2 ? 80000 : 0);
+    }
+    std::ofstream(dir.file("junk").c_str()) << "not a DICOM either";
+    {
+      DICOMParser parser;
+      parser.GetDirInfo(dir.name);
+    }
+
+    // every file, DICOM or not, is known now
+    tuvok::DirectoryScanCache cache(dir.name, "dicom");
+    TS_ASSERT(!cache.Filename().empty());
+    std::vector<std::string> files = SysTools::GetDirContents(dir.name);
+    TS_ASSERT_EQUALS(files.size(), size_t(5));
+    for(size_t i=0; i < files.size(); ++i) {
+      LARGE_STAT_BUFFER st;
+      TS_ASSERT(SysTools::GetFileStats(files[i], st));
+      std::string record;
+      TS_ASSERT(cache.Lookup(files[i], st, record));
+      TS_ASSERT_EQUALS(record.empty(), files[i] == dir.file("junk"));
+    }
+
+    DICOMParser parser;
+    parser.GetDirInfo(dir.name);
+    TS_ASSERT_EQUALS(parser.m_FileStacks.size(), size_t(1));
+    if(parser.m_FileStacks.size() == 1) {
+      ds_check_stack(parser.m_FileStacks[0], 1, 4);
+    }
+  }
+
+  // a file which changed is parsed again
+  void test_changed_file() {
+    ds_dir dir;
+    for(uint32_t i=1; i <= 3; ++i) {
+      char fn[16];
+      sprintf(fn, "%u", i);
+      ds_write(dir.file(fn), 2, i);
+    }
+    {
+      DICOMParser parser;
+      parser.GetDirInfo(dir.name);
+      TS_ASSERT_EQUALS(parser.m_FileStacks.size(), size_t(1));
+    }
+    // a different series, and a different size so that the change shows
+    // even if the modification time does not.
+    ds_write(dir.file("3"), 4, 3, 16);
+
+    DICOMParser parser;
+    parser.GetDirInfo(dir.name);
+    TS_ASSERT_EQUALS(parser.m_FileStacks.size(), size_t(2));
+    if(parser.m_FileStacks.size() == 2) {
+      TS_ASSERT_EQUALS(parser.m_FileStacks[0]->m_Elements.size(), size_t(2));
+      TS_ASSERT_EQUALS(parser.m_FileStacks[1]->m_Elements.size(), size_t(1));
+    }
+  }
+
+  // the slices of a stack are decoded straight from its files
+  void test_slice_source() {
+    ds_dir dir;
+    for(uint32_t i=1; i <= 3; ++i) {
+      char fn[16];
+      sprintf(fn, "%u", i);
+      ds_write(dir.file(fn), 5, i);
+    }
+    DICOMParser parser;
+    parser.GetDirInfo(dir.name);
+    TS_ASSERT_EQUALS(parser.m_FileStacks.size(), size_t(1));
+    if(parser.m_FileStacks.size() != 1) { return; }
+
+    tuvok::StackSliceSource source(*parser.m_FileStacks[0]);
+    TS_ASSERT_EQUALS(source.GetSize(), UINT64VECTOR3(ds_width, ds_height, 3));
+    TS_ASSERT_EQUALS(source.GetComponentSize(), 16u);
+    TS_ASSERT_EQUALS(source.GetComponentCount(), uint64_t(1));
+    TS_ASSERT_EQUALS(source.GetSliceSize(), uint64_t(ds_width*ds_height*2));
+    std::vector<uint16_t> slice(ds_width*ds_height);
+    for(uint64_t z=0; z < 3; ++z) {
+      source.GetSlice(z, reinterpret_cast<uint8_t*>(&slice[0]));
+      for(uint32_t i=0; i < ds_width*ds_height; ++i) {
+        TS_ASSERT_EQUALS(slice[i], uint16_t((z+1)*1000 + i));
+      }
+    }
+  }
+};
@@ -0,0 +1,148 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level when a test is done
+  struct simd_level {
+    simd_level() : old(GetSIMDLevel()) {}
+    ~simd_level() { SetSIMDLevel(old); }
+    SIMDLevel old;
+  };
+
+  template<typename T> T ds_random(std::mt19937& mt) {
+    // plenty of ties and the extremes of the type, the rest uniform
+    switch(mt() % 8) {
+      case 0: return std::numeric_limits<T>::min();
+      case 1: return std::numeric_limits<T>::max();
+      case 2: return std::numeric_limits<T>::lowest();
+      case 3: return T(mt() % 4);
+      default: {
+        T v;
+        uint64_t bits = (uint64_t(mt()) << 32) | mt();
+        memcpy(&v, &bits, sizeof(T));
+        return v;
+      }
+    }
+  }
+  // random bits include NaNs and infinities; make sure signed zeros and
+  // NaNs show up often enough to matter.
+  template<> float ds_random<float>(std::mt19937& mt) {
+    switch(mt() % 10) {
+      case 0: return std::numeric_limits<float>::quiet_NaN();
+      case 1: return -0.0f;
+      case 2: return 0.0f;
+      case 3: return float(mt() % 4);
+      case 4: return std::numeric_limits<float>::max();
+      default: return std::uniform_real_distribution<float>(-1e6f, 1e6f)(mt);
+    }
+  }
+  template<> double ds_random<double>(std::mt19937& mt) {
+    switch(mt() % 10) {
+      case 0: return std::numeric_limits<double>::quiet_NaN();
+      case 1: return -0.0;
+      case 2: return 0.0;
+      case 3: return double(mt() % 4);
+      case 4: return std::numeric_limits<double>::max();
+      default: return std::uniform_real_distribution<double>(-1e9, 1e9)(mt);
+    }
+  }
+
+  template<typename T, bool bMedian> void ds_compare(SIMDLevel level) {
+    // odd length, so that the scalar tail after the vector loop runs too
+    const size_t n = 1001;
+    std::mt19937 mt(level * 2 + bMedian);
+    std::vector<T> rows[4];
+    for(size_t r=0; r < 4; ++r) {
+      for(size_t i=0; i < 2*n; ++i) { rows[r].push_back(ds_random<T>(mt)); }
+    }
+    std::vector<T> out(n);
+    TS_ASSERT_EQUALS(SetSIMDLevel(level), std::min(level, DetectSIMDLevel()));
+    DownsampleRow<T, bMedian>(&rows[0][0], &rows[1][0], &rows[2][0],
+                              &rows[3][0], &out[0], n);
+    for(size_t i=0; i < n; ++i) {
+      const T ref = Filter<T, double, bMedian>(
+        rows[0][2*i], rows[1][2*i], rows[2][2*i], rows[3][2*i],
+        rows[0][2*i+1], rows[1][2*i+1], rows[2][2*i+1], rows[3][2*i+1]
+      );
+      // bitwise, NaN != NaN and 0.0 == -0.0 would hide differences
+      TS_ASSERT_SAME_DATA(&out[i], &ref, sizeof(T));
+    }
+  }
+
+  template<typename T> void ds_all_levels() {
+    simd_level restore;
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      ds_compare<T, true>(levels[l]);
+      ds_compare<T, false>(levels[l]);
+    }
+  }
+
+  template<typename T, bool bMedian>
+  double ds_time(SIMDLevel level, const std::vector<T>& data, size_t n,
+                 std::vector<T>& out) {
+    SetSIMDLevel(level);
+    Timer t; t.Start();
+    for(size_t rep=0; rep < 200; ++rep) {
+      DownsampleRow<T, bMedian>(&data[0], &data[2*n], &data[4*n],
+                                &data[6*n], &out[0], n);
+    }
+    return t.Elapsed();
+  }
+
+  // this is really a benchmark: the scalar templates against whatever
+  // the CPU supports.  Numbers are for 200 rows of 64k output voxels.
+  template<typename T> void ds_bench(const char* name) {
+    simd_level restore;
+    const size_t n = 1 << 16;
+    std::mt19937 mt(42);
+    std::vector<T> data(8*n);
+    for(size_t i=0; i < data.size(); ++i) { data[i] = T(mt() % 4096); }
+    std::vector<T> out(n);
+    for(int median=1; median >= 0; --median) {
+      fprintf(stderr, "\n%-8s %-6s", name, median ? "median" : "mean");
+      const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+      const char* names[] = { "scalar", "sse2", "avx2" };
+      for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+        const double ms = median ? ds_time<T, true>(levels[l], data, n, out)
+                                 : ds_time<T, false>(levels[l], data, n, out);
+        fprintf(stderr, "  %s: %7.2f ms", names[l], ms);
+      }
+    }
+  }
+}
+
+class DownsampleTests : public CxxTest::TestSuite {
+public:
+  void test_uint8() { ds_all_levels<uint8_t>(); }
+  void test_int8() { ds_all_levels<int8_t>(); }
+  void test_uint16() { ds_all_levels<uint16_t>(); }
+  void test_int16() { ds_all_levels<int16_t>(); }
+  void test_uint32() { ds_all_levels<uint32_t>(); }
+  void test_int32() { ds_all_levels<int32_t>(); }
+  void test_uint64() { ds_all_levels<uint64_t>(); }
+  void test_int64() { ds_all_levels<int64_t>(); }
+  void test_float() { ds_all_levels<float>(); }
+  void test_double() { ds_all_levels<double>(); }
+  void test_bench() {
+    ds_bench<uint8_t>("uint8");
+    ds_bench<int8_t>("int8");
+    ds_bench<uint16_t>("uint16");
+    ds_bench<int16_t>("int16");
+    ds_bench<uint32_t>("uint32");
+    ds_bench<int32_t>("int32");
+    ds_bench<uint64_t>("uint64");
+    ds_bench<float>("float");
+    ds_bench<double>("double");
+    fprintf(stderr, "\n");
+  }
+};
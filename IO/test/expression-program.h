@@ -0,0 +1,318 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+#include "expressions/binary-expression.h"
+#include "expressions/constant.h"
+#include "expressions/program.h"
+#include "expressions/volume.h"
+#include "../ExpressionEvaluator.h"
+
+using namespace VolumeTools;
+using namespace tuvok::expression;
+
+namespace {
+  // restores the SIMD level and the number of threads when a test is done
+  struct ep_state {
+    ep_state() : level(GetSIMDLevel()), threads(1) {
+#ifdef _OPENMP
+      threads = omp_get_max_threads();
+#endif
+    }
+    ~ep_state() {
+      SetSIMDLevel(level);
+#ifdef _OPENMP
+      omp_set_num_threads(threads);
+#endif
+    }
+    SIMDLevel level;
+    int threads;
+  };
+
+  void ep_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+  }
+
+  // builders for trees, as the parser would create them
+  Node* ep_volume(double i) {
+    Volume* v = new Volume();
+    v->SetIndex(i);
+    return v;
+  }
+  Node* ep_constant(double value) {
+    Constant* c = new Constant();
+    c->SetValue(value);
+    return c;
+  }
+  Node* ep_binary(OpType oper, Node* lhs, Node* rhs) {
+    Node* n = make_node(EXPR_BINARY, lhs, rhs, static_cast<Node*>(NULL));
+    dynamic_cast<BinaryExpression*>(n)->SetOperator(oper);
+    return n;
+  }
+  Node* ep_select(Node* cond, Node* a, Node* b) {
+    return make_node(EXPR_CONDITIONAL, cond, a, b, static_cast<Node*>(NULL));
+  }
+
+  // the expressions we compare the tree against; all of them use v[0],
+  // v[1] and v[2] at most.
+  std::vector<std::shared_ptr<Node>> ep_expressions() {
+    std::vector<std::shared_ptr<Node>> e;
+    // v[0]*0.5 + v[1]
+    e.push_back(std::shared_ptr<Node>(ep_binary(OP_PLUS,
+      ep_binary(OP_MULTIPLY, ep_volume(0), ep_constant(0.5)), ep_volume(1))));
+    // v[0] > v[1] ? v[0] - v[1] : v[1] / (v[0] + 1)
+    e.push_back(std::shared_ptr<Node>(ep_select(
+      ep_binary(OP_GREATER_THAN, ep_volume(0), ep_volume(1)),
+      ep_binary(OP_MINUS, ep_volume(0), ep_volume(1)),
+      ep_binary(OP_DIVIDE, ep_volume(1),
+                ep_binary(OP_PLUS, ep_volume(0), ep_constant(1))))));
+    // v[0] = v[1] ? 1000 : v[2]*v[2] - 3
+    e.push_back(std::shared_ptr<Node>(ep_select(
+      ep_binary(OP_EQUAL_TO, ep_volume(0), ep_volume(1)), ep_constant(1000),
+      ep_binary(OP_MINUS, ep_binary(OP_MULTIPLY, ep_volume(2), ep_volume(2)),
+                ep_constant(3)))));
+    // (2 + 3) * v[1] - v[0] < 7
+    e.push_back(std::shared_ptr<Node>(ep_binary(OP_LESS_THAN,
+      ep_binary(OP_MINUS, ep_binary(OP_MULTIPLY,
+                                    ep_binary(OP_PLUS, ep_constant(2),
+                                              ep_constant(3)),
+                                    ep_volume(1)),
+                ep_volume(0)),
+      ep_constant(7))));
+    // v[0] / v[1]: 0/0 gives NaNs, x/0 infinities
+    e.push_back(std::shared_ptr<Node>(ep_binary(OP_DIVIDE, ep_volume(0),
+                                                ep_volume(1))));
+    // a volume as the condition
+    e.push_back(std::shared_ptr<Node>(ep_select(ep_volume(2), ep_volume(0),
+                                                ep_constant(-2.5))));
+    // 1 ? v[2] : v[0], i.e. a copy of v[2]
+    e.push_back(std::shared_ptr<Node>(ep_select(ep_constant(1), ep_volume(2),
+                                                ep_volume(0))));
+    // no volume at all
+    e.push_back(std::shared_ptr<Node>(ep_binary(OP_MULTIPLY, ep_constant(6),
+                                                ep_constant(7))));
+    return e;
+  }
+
+  // what evaluate() stores for a value of the tree
+  template<typename T> T ep_convert(double v) {
+    if(!std::numeric_limits<T>::is_integer) { return static_cast<T>(v); }
+    if(!(v == v)) { return T(0); }
+    if(v <= double(std::numeric_limits<T>::lowest())) {
+      return std::numeric_limits<T>::lowest();
+    }
+    if(v >= double(std::numeric_limits<T>::max())) {
+      return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(v);
+  }
+
+  // three volumes; v[1] equals v[0] in every 8th voxel and is zero in every
+  // 16th, so that all branches and the division by zero are taken.
+  template<typename T> std::vector<std::vector<T>> ep_inputs(size_t n) {
+    std::mt19937 mt(42);
+    const double lo = std::max(double(std::numeric_limits<T>::lowest()), -1e6);
+    const double hi = std::min(double(std::numeric_limits<T>::max()), 1e6);
+    std::uniform_real_distribution<double> dist(lo, hi);
+    std::vector<std::vector<T>> v(3, std::vector<T>(n));
+    for(size_t i=0; i < n; ++i) {
+      for(size_t k=0; k < 3; ++k) { v[k][i] = T(dist(mt)); }
+      if(i % 8 == 0) { v[1][i] = v[0][i]; }
+      if(i % 16 == 1) { v[1][i] = T(0); }
+      if(i % 32 == 2) { v[0][i] = v[1][i] = T(0); }
+      if(i % 4 == 3) { v[2][i] = T(0); }
+    }
+    return v;
+  }
+
+  // the compiled program must give the same results as the tree, no matter
+  // which instruction set and how many threads are used.
+  template<typename T> void ep_compare() {
+    ep_state restore;
+    // not a multiple of the block or vector sizes
+    const size_t n = 5000 + 3;
+    const std::vector<std::vector<T>> in = ep_inputs<T>(n);
+    std::vector<std::vector<double>> dbl(3, std::vector<double>(n));
+    std::vector<tuvok::VariantArray> vols(3);
+    std::vector<const T*> ptrs(3);
+    for(size_t k=0; k < 3; ++k) {
+      for(size_t i=0; i < n; ++i) { dbl[k][i] = double(in[k][i]); }
+      vols[k].set(std::shared_ptr<double>(&dbl[k][0], NullDeleter<double>), n);
+      ptrs[k] = &in[k][0];
+    }
+
+    const std::vector<std::shared_ptr<Node>> exprs = ep_expressions();
+    for(size_t e=0; e < exprs.size(); ++e) {
+      exprs[e]->SetVolumes(vols);
+      std::vector<T> ref(n);
+      for(size_t i=0; i < n; ++i) {
+        ref[i] = ep_convert<T>(exprs[e]->Evaluate(i));
+      }
+      const Program program = compile(*exprs[e]);
+      TS_ASSERT_LESS_THAN_EQUALS(program.Volumes(), 3u);
+
+      const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+      for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+        SetSIMDLevel(levels[l]);
+        for(int threads=1; threads <= 4; threads *= 4) {
+          ep_threads(threads);
+          std::vector<T> out(n);
+          evaluate(program, ptrs, &out[0], n);
+          TS_ASSERT_SAME_DATA(&out[0], &ref[0], n * sizeof(T));
+        }
+      }
+    }
+  }
+
+  // the row kernels against their scalar definition, bit by bit.
+  void ep_kernels(SIMDLevel level) {
+    // odd length, so that the scalar tail after the vector loop runs too
+    const size_t n = 1001;
+    std::mt19937 mt(level);
+    std::uniform_real_distribution<double> dist(-10.0, 10.0);
+    std::vector<double> a(n), b(n), c(n);
+    for(size_t i=0; i < n; ++i) {
+      a[i] = dist(mt);
+      b[i] = i % 5 == 0 ? a[i] + dist(mt) * 1e-4 : dist(mt);
+      c[i] = i % 3 == 0 ? 0.0 : a[i];
+    }
+    a[7] = b[9] = c[11] = std::numeric_limits<double>::quiet_NaN();
+    a[12] = std::numeric_limits<double>::infinity();
+    b[12] = -std::numeric_limits<double>::infinity();
+    b[13] = 0.0;
+    c[14] = -0.0;
+    TS_ASSERT_EQUALS(SetSIMDLevel(level), std::min(level, DetectSIMDLevel()));
+
+    const BinaryOp ops[] = { BINARY_ADD, BINARY_SUB, BINARY_MUL, BINARY_DIV,
+                             BINARY_GREATER, BINARY_LESS, BINARY_NEAR };
+    std::vector<double> out(n);
+    for(size_t o=0; o < sizeof(ops)/sizeof(ops[0]); ++o) {
+      BinaryRow(ops[o], &a[0], &b[0], 0.001, &out[0], n);
+      for(size_t i=0; i < n; ++i) {
+        const double ref = Binary(ops[o], a[i], b[i], 0.001);
+        TS_ASSERT_SAME_DATA(&out[i], &ref, sizeof(double));
+      }
+    }
+    // the operators of the tree are the same
+    for(size_t i=0; i < n; ++i) {
+      TS_ASSERT_EQUALS(Binary(BINARY_NEAR, a[i], b[i], Program::Tolerance),
+                       Program::Apply(OP_EQUAL_TO, a[i], b[i]));
+      TS_ASSERT_EQUALS(Binary(BINARY_GREATER, a[i], b[i], 0.0),
+                       Program::Apply(OP_GREATER_THAN, a[i], b[i]));
+    }
+
+    SelectRow(&c[0], &a[0], &b[0], &out[0], n);
+    for(size_t i=0; i < n; ++i) {
+      const double ref = c[i] ? a[i] : b[i];
+      TS_ASSERT_SAME_DATA(&out[i], &ref, sizeof(double));
+    }
+  }
+
+  template<typename T>
+  void ep_bench(const char* name) {
+    ep_state restore;
+    const size_t n = size_t(1) << 22;
+    std::vector<std::vector<T>> in = ep_inputs<T>(n);
+    in.resize(2);
+    std::vector<const T*> ptrs(1, &in[0][0]);
+    ptrs.push_back(&in[1][0]);
+    std::unique_ptr<Node> tree(ep_binary(OP_PLUS,
+      ep_binary(OP_MULTIPLY, ep_volume(0), ep_constant(0.5)), ep_volume(1)));
+    const Program program = compile(*tree);
+    std::vector<T> out(n);
+
+    Timer t; t.Start();
+    std::memcpy(&out[0], &in[0][0], n * sizeof(T));
+    fprintf(stderr, "\n%-8s copy: %7.2f ms", name, t.Elapsed());
+
+    t.Start();
+    evaluate(*tree, in, out);
+    fprintf(stderr, "  tree: %8.2f ms", t.Elapsed());
+
+    struct { SIMDLevel level; int threads; const char* desc; } runs[] = {
+      { SIMD_SCALAR, 1, "scalar" },
+      { DetectSIMDLevel(), 1, "simd" },
+      { DetectSIMDLevel(), restore.threads, "simd, all threads" },
+    };
+    for(size_t r=0; r < 3; ++r) {
+      SetSIMDLevel(runs[r].level);
+      ep_threads(runs[r].threads);
+      t.Start();
+      evaluate(program, ptrs, &out[0], n);
+      fprintf(stderr, "  %s: %7.2f ms", runs[r].desc, t.Elapsed());
+    }
+  }
+}
+
+class ExpressionProgramTests : public CxxTest::TestSuite {
+public:
+  void test_compile() {
+    // v[0]*0.5 + v[1]
+    std::unique_ptr<Node> a(ep_binary(OP_PLUS,
+      ep_binary(OP_MULTIPLY, ep_volume(0), ep_constant(0.5)), ep_volume(1)));
+    Program p = compile(*a);
+    TS_ASSERT_EQUALS(p.Instructions().size(), 5u);
+    TS_ASSERT_EQUALS(p.Result(), 4u);
+    TS_ASSERT_EQUALS(p.Volumes(), 2u);
+    TS_ASSERT_EQUALS(p.Instructions()[4].code, Program::BINARY);
+
+    // every volume is loaded once
+    std::unique_ptr<Node> b(ep_binary(OP_MULTIPLY, ep_volume(1),
+                                      ep_volume(1)));
+    p = compile(*b);
+    TS_ASSERT_EQUALS(p.Instructions().size(), 2u);
+    TS_ASSERT_EQUALS(p.Instructions()[1].a, 0u);
+    TS_ASSERT_EQUALS(p.Instructions()[1].b, 0u);
+
+    // constants are folded
+    std::unique_ptr<Node> c(ep_binary(OP_MULTIPLY,
+      ep_binary(OP_PLUS, ep_constant(2), ep_constant(3)), ep_constant(4)));
+    p = compile(*c);
+    TS_ASSERT_EQUALS(p.Volumes(), 0u);
+    TS_ASSERT(p.IsConstant(p.Result()));
+    TS_ASSERT_EQUALS(p.Instructions()[p.Result()].value, 20.0);
+
+    // only the branch that is taken is compiled
+    std::unique_ptr<Node> d(ep_select(ep_constant(0), ep_volume(0),
+                                      ep_volume(3)));
+    p = compile(*d);
+    TS_ASSERT_EQUALS(p.Instructions().size(), 2u);
+    TS_ASSERT_EQUALS(p.Instructions()[p.Result()].code, Program::LOAD);
+    TS_ASSERT_EQUALS(p.Instructions()[p.Result()].volume, 3u);
+    TS_ASSERT_EQUALS(p.Volumes(), 4u);
+  }
+  void test_uint8() { ep_compare<uint8_t>(); }
+  void test_int16() { ep_compare<int16_t>(); }
+  void test_uint16() { ep_compare<uint16_t>(); }
+  void test_int32() { ep_compare<int32_t>(); }
+  void test_uint32() { ep_compare<uint32_t>(); }
+  void test_int64() { ep_compare<int64_t>(); }
+  void test_float() { ep_compare<float>(); }
+  void test_double() { ep_compare<double>(); }
+  void test_kernels() {
+    ep_state restore;
+    ep_kernels(SIMD_SCALAR);
+    ep_kernels(SIMD_SSE2);
+    ep_kernels(SIMD_AVX2);
+  }
+  // really a benchmark: v[0]*0.5 + v[1] on 4M voxels.
+  void test_bench() {
+    ep_bench<uint16_t>("uint16");
+    ep_bench<float>("float");
+    fprintf(stderr, "\n");
+  }
+};
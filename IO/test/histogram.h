@@ -0,0 +1,270 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "Controller/Controller.h"
+#include "UVF/Histogram1DDataBlock.h"
+#include "UVF/Histogram2DDataBlock.h"
+#include "UVF/MaxMinDataBlock.h"
+#include "UVF/TOCBlock.h"
+#include "UVF/UVF.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+#include "util-test.h"
+
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level and the number of threads when a test is done
+  struct hg_state {
+    hg_state() : level(GetSIMDLevel()) {
+#ifdef _OPENMP
+      threads = omp_get_max_threads();
+#endif
+    }
+    ~hg_state() {
+      SetSIMDLevel(level);
+#ifdef _OPENMP
+      omp_set_num_threads(threads);
+#endif
+    }
+    SIMDLevel level;
+    int threads;
+  };
+
+  void hg_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+  }
+
+  // a smooth signal with some noise on top, so that there is a range of
+  // gradients.  Returns the voxels, which are also written to 'fn'.
+  template<typename T>
+  std::vector<T> hg_volume(const UINT64VECTOR3& sz, uint32_t range,
+                           std::string& fn) {
+    std::ofstream ofs;
+    fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    std::mt19937 mt(42);
+    std::vector<T> data(size_t(sz.volume()));
+    for(uint64_t z=0; z < sz.z; ++z) {
+      for(uint64_t y=0; y < sz.y; ++y) {
+        for(uint64_t x=0; x < sz.x; ++x) {
+          const uint32_t smooth = uint32_t((x*3 + y*5 + z*7) % (range/2));
+          data[size_t(x + sz.x*(y + sz.y*z))] =
+            T((smooth + mt() % (range/8)) % range);
+        }
+      }
+    }
+    ofs.write(reinterpret_cast<const char*>(&data[0]),
+              data.size() * sizeof(T));
+    return data;
+  }
+
+  std::shared_ptr<TOCBlock> hg_toc(const std::string& fn,
+                                   ExtendedOctree::COMPONENT_TYPE type,
+                                   const UINT64VECTOR3& sz,
+                                   std::string& tmp) {
+    std::ofstream ofs;
+    tmp = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.close();
+    std::shared_ptr<TOCBlock> toc(new TOCBlock(UVF::ms_ulReaderVersion));
+    TS_ASSERT(toc->FlatDataToBrickedLOD(fn, tmp, type, 1, sz,
+                                        DOUBLEVECTOR3(1,1,1),
+                                        UINT64VECTOR3(32,32,32), 2, false,
+                                        false, 1 << 26,
+                                        std::shared_ptr<MaxMinDataBlock>(
+                                          new MaxMinDataBlock(1)),
+                                        &Controller::Debug::Out(), CT_NONE));
+    return toc;
+  }
+
+  template<typename T>
+  void hg_1d(ExtendedOctree::COMPONENT_TYPE type, uint32_t range) {
+    hg_state restore;
+    const UINT64VECTOR3 sz(70, 50, 45);
+    std::string fn, tmp;
+    const std::vector<T> data = hg_volume<T>(sz, range, fn);
+    std::shared_ptr<TOCBlock> toc = hg_toc(fn, type, sz, tmp);
+
+    std::vector<uint64_t> ref(range, 0);
+    for(size_t i=0; i < data.size(); ++i) { ref[size_t(data[i])]++; }
+    while(!ref.empty() && ref.back() == 0) { ref.pop_back(); }
+
+    for(int threads=1; threads <= 4; threads *= 4) {
+      hg_threads(threads);
+      Histogram1DDataBlock hist;
+      TS_ASSERT(hist.Compute(toc.get(), 0));
+      TS_ASSERT(hist.GetHistogram() == ref);
+    }
+    toc.reset();
+    remove(fn.c_str());
+  }
+
+  // the 2D histogram must not depend on the instruction set or the number
+  // of threads.
+  template<typename T>
+  void hg_2d(ExtendedOctree::COMPONENT_TYPE type, uint32_t range,
+             size_t bins) {
+    hg_state restore;
+    const UINT64VECTOR3 sz(70, 50, 45);
+    std::string fn, tmp;
+    hg_volume<T>(sz, range, fn);
+    std::shared_ptr<TOCBlock> toc = hg_toc(fn, type, sz, tmp);
+
+    SetSIMDLevel(SIMD_SCALAR);
+    hg_threads(1);
+    Histogram2DDataBlock ref;
+    TS_ASSERT(ref.Compute(toc.get(), 0, bins, double(range-1)));
+    uint64_t total = 0;
+    for(size_t i=0; i < ref.GetHistogram().size(); ++i) {
+      for(size_t j=0; j < ref.GetHistogram()[i].size(); ++j) {
+        total += ref.GetHistogram()[i][j];
+      }
+    }
+    TS_ASSERT_EQUALS(total, sz.volume());
+    TS_ASSERT_LESS_THAN(0.0f, ref.GetMaxGradMagnitude());
+
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      hg_threads(4);
+      Histogram2DDataBlock hist;
+      TS_ASSERT(hist.Compute(toc.get(), 0, bins, double(range-1)));
+      TS_ASSERT(hist.GetHistogram() == ref.GetHistogram());
+      TS_ASSERT_EQUALS(hist.GetMaxGradMagnitude(), ref.GetMaxGradMagnitude());
+    }
+    toc.reset();
+    remove(fn.c_str());
+  }
+
+  // the row kernels against their scalar definition, bit by bit.
+  void hg_kernels(SIMDLevel level) {
+    // odd length, so that the scalar tail after the vector loop runs too
+    const size_t n = 1001;
+    std::mt19937 mt(level);
+    std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+    std::vector<double> rows[6];
+    for(size_t r=0; r < 6; ++r) {
+      for(size_t i=0; i < n; ++i) { rows[r].push_back(dist(mt)); }
+    }
+    TS_ASSERT_EQUALS(SetSIMDLevel(level), std::min(level, DetectSIMDLevel()));
+    std::vector<double> mag(n);
+    GradientMagnitudeRow(&rows[0][0], &rows[1][0], &rows[2][0], &rows[3][0],
+                         &rows[4][0], &rows[5][0], 510.0, &mag[0], n);
+    double maxMag = 0;
+    for(size_t i=0; i < n; ++i) {
+      const double ref = DOUBLEVECTOR3((rows[0][i]-rows[1][i])/510.0,
+                                       (rows[2][i]-rows[3][i])/510.0,
+                                       (rows[4][i]-rows[5][i])/510.0).length();
+      TS_ASSERT_SAME_DATA(&mag[i], &ref, sizeof(double));
+      maxMag = std::max(maxMag, mag[i]);
+    }
+
+    std::vector<uint8_t> bins(n);
+    GradientBinRow(&mag[0], maxMag, &bins[0], n);
+    for(size_t i=0; i < n; ++i) {
+      TS_ASSERT_EQUALS(bins[i], uint8_t(std::min<size_t>(
+        255, size_t(mag[i]/maxMag*255.0f))));
+    }
+    // a constant volume: everything goes to the last bin.
+    std::fill(mag.begin(), mag.end(), 0.0);
+    GradientBinRow(&mag[0], 0.0, &bins[0], n);
+    TS_ASSERT_EQUALS(std::count(bins.begin(), bins.end(), 255), int(n));
+  }
+
+  template<typename T>
+  void hg_bench(const char* name, ExtendedOctree::COMPONENT_TYPE type,
+                uint32_t range, size_t bins) {
+    hg_state restore;
+    const UINT64VECTOR3 sz(160, 160, 160);
+    std::string fn, tmp;
+    hg_volume<T>(sz, range, fn);
+    std::shared_ptr<TOCBlock> toc = hg_toc(fn, type, sz, tmp);
+
+    struct { SIMDLevel level; int threads; const char* desc; } runs[] = {
+      { SIMD_SCALAR, 1, "scalar, 1 thread" },
+      { DetectSIMDLevel(), 1, "simd, 1 thread" },
+      { DetectSIMDLevel(), restore.threads, "simd, all threads" },
+    };
+    for(size_t r=0; r < 3; ++r) {
+      SetSIMDLevel(runs[r].level);
+      hg_threads(runs[r].threads);
+      Timer t; t.Start();
+      Histogram1DDataBlock hist1d;
+      hist1d.Compute(toc.get(), 0);
+      const double ms1d = t.Elapsed();
+      Histogram2DDataBlock hist2d;
+      hist2d.Compute(toc.get(), 0, bins, double(range-1));
+      fprintf(stderr, "\n%-8s %-18s  1D: %8.2f ms  2D: %8.2f ms", name,
+              runs[r].desc, ms1d, t.Elapsed() - ms1d);
+    }
+    toc.reset();
+    remove(fn.c_str());
+  }
+
+  // float data do not get histograms from TOCBlocks (they are quantized
+  // first), but the gradient kernel is the same; time it on float slices.
+  void hg_bench_float() {
+    hg_state restore;
+    const size_t n = 256;
+    std::mt19937 mt(42);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    std::vector<double> slices(3*n*n);
+    for(size_t i=0; i < slices.size(); ++i) { slices[i] = dist(mt); }
+    std::vector<double> mag(n);
+    const double* prev = &slices[0];
+    const double* cur = &slices[n*n];
+    const double* next = &slices[2*n*n];
+
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    const char* names[] = { "scalar", "sse2", "avx2" };
+    fprintf(stderr, "\n%-8s %-18s", "float", "gradients, 1 thread");
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      Timer t; t.Start();
+      for(size_t rep=0; rep < 200; ++rep) {
+        for(size_t y=1; y < n-1; ++y) {
+          const size_t row = y*n + 1;
+          GradientMagnitudeRow(cur + row - 1, cur + row + 1, cur + row - n,
+                               cur + row + n, prev + row, next + row, 2.0,
+                               &mag[0], n-2);
+        }
+      }
+      fprintf(stderr, "  %s: %7.2f ms", names[l], t.Elapsed());
+    }
+  }
+}
+
+class HistogramTests : public CxxTest::TestSuite {
+public:
+  void test_1d_uint8() { hg_1d<uint8_t>(ExtendedOctree::CT_UINT8, 256); }
+  void test_1d_uint16() { hg_1d<uint16_t>(ExtendedOctree::CT_UINT16, 4096); }
+  void test_2d_uint8() { hg_2d<uint8_t>(ExtendedOctree::CT_UINT8, 256, 256); }
+  // more values than bins: values are scaled into the bins
+  void test_2d_uint16() {
+    hg_2d<uint16_t>(ExtendedOctree::CT_UINT16, 4096, 1024);
+  }
+  void test_kernels() {
+    hg_state restore;
+    hg_kernels(SIMD_SCALAR);
+    hg_kernels(SIMD_SSE2);
+    hg_kernels(SIMD_AVX2);
+  }
+  // really a benchmark: 160^3 volumes, 32^3 bricks.
+  void test_bench() {
+    hg_bench<uint8_t>("uint8", ExtendedOctree::CT_UINT8, 256, 256);
+    hg_bench<uint16_t>("uint16", ExtendedOctree::CT_UINT16, 4096, 4096);
+    hg_bench_float();
+    fprintf(stderr, "\n");
+  }
+};
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include <cxxtest/TestSuite.h>
+#include "Basics/MC.h"
+#include "Basics/Timer.h"
+
+namespace {
+  // a sphere: the distance from the center, scaled to fill the type.
+  template<typename T>
+  std::vector<T> iso_sphere(const UINT64VECTOR3& sz, double scale) {
+    std::vector<T> data(size_t(sz.volume()));
+    const DOUBLEVECTOR3 center = DOUBLEVECTOR3(sz) / 2.0;
+    for(uint64_t z=0; z < sz.z; ++z) {
+      for(uint64_t y=0; y < sz.y; ++y) {
+        for(uint64_t x=0; x < sz.x; ++x) {
+          const double d = (DOUBLEVECTOR3(double(x), double(y), double(z)) -
+                            center).length();
+          data[size_t(x + sz.x*(y + sz.y*z))] = T(d * scale);
+        }
+      }
+    }
+    return data;
+  }
+
+  // the volume as one block
+  template<typename T>
+  IsoWelder iso_whole(const std::vector<T>& data, const UINT64VECTOR3& sz,
+                      T iso) {
+    IsoBlock block;
+    BlockMarchingCubes<T>::March(&data[0], sz, UINT64VECTOR3(0,0,0),
+                                 sz - UINT64VECTOR3(1,1,1),
+                                 UINT64VECTOR3(0,0,0), sz, 0, iso, block);
+    IsoWelder mesh;
+    mesh.Add(block);
+    return mesh;
+  }
+
+  // the volume cut into bricks of 'core' voxels plus 'overlap' on each side,
+  // which are marched on all threads, each brick in 'slabs' slabs.
+  template<typename T>
+  IsoWelder iso_bricked(const std::vector<T>& data, const UINT64VECTOR3& sz,
+                        T iso, uint64_t core, uint64_t overlap,
+                        uint64_t slabs) {
+    struct Job { UINT64VECTOR3 brick; uint64_t slab; };
+    std::vector<Job> jobs;
+    const UINT64VECTOR3 n((sz.x+core-1)/core, (sz.y+core-1)/core,
+                          (sz.z+core-1)/core);
+    for(uint64_t z=0; z < n.z; ++z) {
+      for(uint64_t y=0; y < n.y; ++y) {
+        for(uint64_t x=0; x < n.x; ++x) {
+          for(uint64_t s=0; s < slabs; ++s) {
+            Job j = { UINT64VECTOR3(x,y,z), s };
+            jobs.push_back(j);
+          }
+        }
+      }
+    }
+    std::vector<IsoBlock> blocks(jobs.size());
+#pragma omp parallel for schedule(dynamic)
+    for(int i=0; i < int(jobs.size()); ++i) {
+      const UINT64VECTOR3 origin = jobs[i].brick * core;
+      UINT64VECTOR3 bsz, first, last;
+      for(size_t d=0; d < 3; ++d) {
+        const uint64_t cells = std::min(core, sz[d]-1 - origin[d]);
+        bsz[d] = std::min(core, sz[d] - origin[d]) + 2*overlap;
+        first[d] = overlap;
+        last[d] = overlap + cells;
+      }
+      // copy the brick, clamping the overlap to the volume
+      std::vector<T> brick(size_t(bsz.volume()));
+      for(uint64_t z=0; z < bsz.z; ++z) {
+        for(uint64_t y=0; y < bsz.y; ++y) {
+          for(uint64_t x=0; x < bsz.x; ++x) {
+            UINT64VECTOR3 src;
+            const UINT64VECTOR3 p(x,y,z);
+            for(size_t d=0; d < 3; ++d) {
+              const int64_t v = int64_t(origin[d] + p[d]) - int64_t(overlap);
+              src[d] = uint64_t(std::max<int64_t>(0, std::min<int64_t>(
+                                  v, int64_t(sz[d])-1)));
+            }
+            brick[size_t(x + bsz.x*(y + bsz.y*z))] =
+              data[size_t(src.x + sz.x*(src.y + sz.y*src.z))];
+          }
+        }
+      }
+      const uint64_t layers = last.z - first.z;
+      const uint64_t s = jobs[i].slab;
+      UINT64VECTOR3 sfirst(first), slast(last), global(origin);
+      sfirst.z = first.z + layers * s / slabs;
+      slast.z = first.z + layers * (s+1) / slabs;
+      global.z += sfirst.z - first.z;
+      BlockMarchingCubes<T>::March(&brick[0], bsz, sfirst, slast, global, sz,
+                                   0, iso, blocks[size_t(i)]);
+    }
+    IsoWelder mesh;
+    for(size_t i=0; i < blocks.size(); ++i) { mesh.Add(blocks[i]); }
+    return mesh;
+  }
+
+  typedef std::vector<float> tri_key;
+  // triangles as their corners, independent of the numbering of vertices
+  std::multiset<tri_key> iso_triangles(const IsoWelder& mesh) {
+    std::multiset<tri_key> tris;
+    for(size_t t=0; t < mesh.viIndices.size(); t += 3) {
+      tri_key k;
+      for(size_t c=0; c < 3; ++c) {
+        const FLOATVECTOR3& v = mesh.vfVertices[mesh.viIndices[t+c]];
+        k.push_back(v.x); k.push_back(v.y); k.push_back(v.z);
+      }
+      tris.insert(k);
+    }
+    return tris;
+  }
+
+  // every edge of a closed surface is shared by exactly two triangles, and
+  // in a welded mesh no two vertices are at the same place.  Except for
+  // voxels which hit the isovalue exactly: all of their edges put a vertex
+  // there.
+  void iso_check_closed(const IsoWelder& mesh, bool bDistinct) {
+    std::map<std::pair<uint32_t,uint32_t>, unsigned> edges;
+    for(size_t t=0; t < mesh.viIndices.size(); t += 3) {
+      for(size_t c=0; c < 3; ++c) {
+        uint32_t a = mesh.viIndices[t+c];
+        uint32_t b = mesh.viIndices[t+(c+1)%3];
+        if(a > b) { std::swap(a, b); }
+        edges[std::make_pair(a,b)]++;
+      }
+    }
+    size_t open = 0;
+    for(std::map<std::pair<uint32_t,uint32_t>, unsigned>::const_iterator e =
+        edges.begin(); e != edges.end(); ++e) {
+      if(e->second != 2) { ++open; }
+    }
+    TS_ASSERT_EQUALS(open, size_t(0));
+
+    std::set<std::vector<float>> positions;
+    for(size_t v=0; v < mesh.vfVertices.size(); ++v) {
+      std::vector<float> p(&mesh.vfVertices[v].x, &mesh.vfVertices[v].x + 3);
+      positions.insert(p);
+    }
+    if(bDistinct) {
+      TS_ASSERT_EQUALS(positions.size(), mesh.vfVertices.size());
+    }
+    TS_ASSERT_EQUALS(mesh.vfVertices.size(), mesh.vfNormals.size());
+  }
+
+  void iso_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+  }
+
+  template<typename T> void iso_compare(double scale, T iso, bool bDistinct) {
+    // odd sizes: the last bricks are smaller than the others
+    const UINT64VECTOR3 sz(45, 39, 42);
+    const std::vector<T> data = iso_sphere<T>(sz, scale);
+    const IsoWelder whole = iso_whole<T>(data, sz, iso);
+    TS_ASSERT_LESS_THAN(size_t(100), whole.viIndices.size());
+    iso_check_closed(whole, bDistinct);
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    const uint64_t slabs[] = { 1, 3 };
+    for(size_t s=0; s < 2; ++s) {
+      iso_threads(1);
+      const IsoWelder serial = iso_bricked<T>(data, sz, iso, 16, 2, slabs[s]);
+      iso_threads(4);
+      const IsoWelder parallel = iso_bricked<T>(data, sz, iso, 16, 2,
+                                                slabs[s]);
+      iso_check_closed(serial, bDistinct);
+      // the same vertices and triangles as marching the volume in one go,
+      // and bit for bit the same output for any number of threads.
+      TS_ASSERT_EQUALS(serial.vfVertices.size(), whole.vfVertices.size());
+      TS_ASSERT(iso_triangles(serial) == iso_triangles(whole));
+      TS_ASSERT(serial.vfVertices == parallel.vfVertices);
+      TS_ASSERT(serial.vfNormals == parallel.vfNormals);
+      TS_ASSERT(serial.viIndices == parallel.viIndices);
+    }
+    iso_threads(threads);
+  }
+}
+
+class IsosurfaceTests : public CxxTest::TestSuite {
+public:
+  void test_float() { iso_compare<float>(1.0, 14.3f, true); }
+  void test_uint8() { iso_compare<uint8_t>(6.0, 100, false); }
+  void test_uint16() { iso_compare<uint16_t>(1000.0, 15000, false); }
+  // surfaces which leave the volume are cut open at its faces
+  void test_open() {
+    const UINT64VECTOR3 sz(20, 20, 20);
+    const std::vector<float> data = iso_sphere<float>(sz, 1.0);
+    const IsoWelder whole = iso_whole<float>(data, sz, 12.0f);
+    const IsoWelder bricked = iso_bricked<float>(data, sz, 12.0f, 8, 1, 2);
+    TS_ASSERT_LESS_THAN(size_t(0), whole.viIndices.size());
+    TS_ASSERT(iso_triangles(bricked) == iso_triangles(whole));
+    TS_ASSERT_EQUALS(bricked.vfVertices.size(), whole.vfVertices.size());
+  }
+  void test_empty() {
+    const UINT64VECTOR3 sz(10, 10, 10);
+    const std::vector<float> data = iso_sphere<float>(sz, 1.0);
+    TS_ASSERT(iso_whole<float>(data, sz, 100.0f).vfVertices.empty());
+    TS_ASSERT(iso_bricked<float>(data, sz, -1.0f, 4, 1, 1).viIndices.empty());
+  }
+  // really a benchmark: a 160^3 sphere, 32^3 bricks, one thread vs. all
+  void test_bench() {
+    const UINT64VECTOR3 sz(160, 160, 160);
+    const std::vector<uint16_t> data = iso_sphere<uint16_t>(sz, 100.0);
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    for(int t=1; t <= threads; t = (t == threads) ? t+1 : threads) {
+      iso_threads(t);
+      Timer timer; timer.Start();
+      const IsoWelder mesh = iso_bricked<uint16_t>(data, sz, 6000, 28, 2, 1);
+      fprintf(stderr, "\nisosurface %2d thread(s): %8.2f ms, %u triangles", t,
+              timer.Elapsed(), unsigned(mesh.viIndices.size()/3));
+    }
+    iso_threads(threads);
+    fprintf(stderr, "\n");
+  }
+};
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/KDTree.h"
+#include "Basics/Mesh.h"
+#include "Basics/Timer.h"
+
+using namespace tuvok;
+
+namespace {
+  // a small deterministic random number generator, in [0,1)
+  struct kd_random {
+    kd_random(uint32_t seed) : state(seed) {}
+    float operator()() {
+      state = state * 1664525u + 1013904223u;
+      return float(state >> 8) / float(1 << 24);
+    }
+    uint32_t state;
+  };
+
+  // a sphere of radius 0.5 from 'rings' x 'segments' quads plus 'soup'
+  // random small triangles all over the unit cube
+  struct kd_mesh {
+    kd_mesh(uint32_t rings, uint32_t segments, uint32_t soup) {
+      const float pi = 3.14159265f;
+      for(uint32_t r=0; r <= rings; ++r) {
+        const float theta = pi * float(r) / float(rings);
+        for(uint32_t s=0; s < segments; ++s) {
+          const float phi = 2.0f * pi * float(s) / float(segments);
+          vertices.push_back(FLOATVECTOR3(std::sin(theta)*std::cos(phi),
+                                          std::sin(theta)*std::sin(phi),
+                                          std::cos(theta)) * 0.5f);
+        }
+      }
+      for(uint32_t r=0; r < rings; ++r) {
+        for(uint32_t s=0; s < segments; ++s) {
+          const uint32_t a = r*segments + s;
+          const uint32_t b = r*segments + (s+1) % segments;
+          const uint32_t quad[6] = { a, b, a+segments,
+                                     b, b+segments, a+segments };
+          indices.insert(indices.end(), quad, quad+6);
+        }
+      }
+      kd_random rnd(soup);
+      for(uint32_t t=0; t < soup; ++t) {
+        const FLOATVECTOR3 c(rnd()-0.5f, rnd()-0.5f, rnd()-0.5f);
+        for(size_t v=0; v < 3; ++v) {
+          indices.push_back(uint32_t(vertices.size()));
+          vertices.push_back(c + FLOATVECTOR3(rnd(), rnd(), rnd()) * 0.05f);
+        }
+      }
+    }
+
+    Mesh* create(bool kdtree) const {
+      return new Mesh(vertices, NormVec(), TexCoordVec(), ColorVec(),
+                      indices, IndexVec(), IndexVec(), IndexVec(),
+                      kdtree, false, "kd test mesh", Mesh::MT_TRIANGLES);
+    }
+
+    VertVec vertices;
+    IndexVec indices;
+  };
+
+  // rays from outside the mesh towards random points of its bounding box,
+  // and every fourth one starting inside
+  std::vector<Ray> kd_rays(size_t n, uint32_t seed) {
+    kd_random rnd(seed);
+    std::vector<Ray> rays;
+    for(size_t i=0; i < n; ++i) {
+      const DOUBLEVECTOR3 target(rnd()-0.5, rnd()-0.5, rnd()-0.5);
+      DOUBLEVECTOR3 start(rnd()-0.5, rnd()-0.5, rnd()-0.5);
+      // normalized() is declared const and gets folded across temporaries
+      if(i % 4 != 0) { start = start * (3.0 / start.length()); }
+      const DOUBLEVECTOR3 dir = target - start;
+      rays.push_back(Ray(start, dir / dir.length()));
+    }
+    return rays;
+  }
+
+  double kd_pick(const Mesh& m, const Ray& r) {
+    FLOATVECTOR3 normal; FLOATVECTOR2 tc; FLOATVECTOR4 color;
+    return m.Pick(r, normal, tc, color);
+  }
+
+  // picks the rays from both meshes, returns how many differ
+  size_t kd_compare(const Mesh& a, const Mesh& b,
+                    const std::vector<Ray>& rays, size_t& hits) {
+    size_t differ = 0;
+    hits = 0;
+    for(size_t i=0; i < rays.size(); ++i) {
+      const double ta = kd_pick(a, rays[i]);
+      const double tb = kd_pick(b, rays[i]);
+      if(tb != std::numeric_limits<double>::max()) { ++hits; }
+      if(!(ta == tb || std::fabs(ta - tb) < 1e-9)) { ++differ; }
+    }
+    return differ;
+  }
+}
+
+class KDTreeTests : public CxxTest::TestSuite {
+public:
+  void test_matches_brute_force() {
+    kd_mesh geometry(64, 64, 5000);
+    std::unique_ptr<Mesh> tree(geometry.create(true));
+    std::unique_ptr<Mesh> brute(geometry.create(false));
+    TS_ASSERT(tree->GetKDTree() != NULL);
+    TS_ASSERT(tree->GetKDTree()->GetNodeCount() > 1);
+    TS_ASSERT(tree->GetKDTree()->GetMaxDepth() <= KDTree::MAX_DEPTH);
+
+    size_t hits;
+    TS_ASSERT_EQUALS(kd_compare(*tree, *brute, kd_rays(4000, 7), hits), 0u);
+    TS_ASSERT(hits > 2000);
+  }
+
+  // a depth limit of one leaves two leaves full of triangles
+  void test_shallow() {
+    kd_mesh geometry(16, 16, 200);
+    std::unique_ptr<Mesh> mesh(geometry.create(false));
+    std::unique_ptr<Mesh> brute(geometry.create(false));
+    KDTree tree(mesh.get(), "", 1);
+    TS_ASSERT(tree.GetNodeCount() <= 3u);
+    TS_ASSERT(tree.GetTriangleReferenceCount() >= 712u);
+
+    const std::vector<Ray> rays = kd_rays(500, 3);
+    for(size_t i=0; i < rays.size(); ++i) {
+      FLOATVECTOR3 normal; FLOATVECTOR2 tc; FLOATVECTOR4 color;
+      TS_ASSERT_EQUALS(tree.Intersect(rays[i], normal, tc, color, 0, 100),
+                       kd_pick(*brute, rays[i]));
+    }
+  }
+
+  // many copies of the same triangle cannot be separated by any plane
+  void test_coincident_triangles() {
+    VertVec vertices;
+    IndexVec indices;
+    vertices.push_back(FLOATVECTOR3(0,0,0));
+    vertices.push_back(FLOATVECTOR3(1,0,0));
+    vertices.push_back(FLOATVECTOR3(0,1,0));
+    for(uint32_t t=0; t < 1000; ++t) {
+      indices.push_back(0); indices.push_back(1); indices.push_back(2);
+    }
+    Mesh mesh(vertices, NormVec(), TexCoordVec(), ColorVec(), indices,
+              IndexVec(), IndexVec(), IndexVec(), true, false, "flat",
+              Mesh::MT_TRIANGLES);
+    TS_ASSERT_DELTA(kd_pick(mesh, Ray(DOUBLEVECTOR3(0.25, 0.25, 1),
+                                      DOUBLEVECTOR3(0, 0, -1))), 1.0, 1e-9);
+    TS_ASSERT_EQUALS(kd_pick(mesh, Ray(DOUBLEVECTOR3(0.75, 0.75, 1),
+                                       DOUBLEVECTOR3(0, 0, -1))),
+                     std::numeric_limits<double>::max());
+  }
+
+  void test_lines() {
+    VertVec vertices(2);
+    vertices[1] = FLOATVECTOR3(1,1,1);
+    IndexVec indices(2);
+    indices[1] = 1;
+    Mesh mesh(vertices, NormVec(), TexCoordVec(), ColorVec(), indices,
+              IndexVec(), IndexVec(), IndexVec(), true, false, "line",
+              Mesh::MT_LINES);
+    TS_ASSERT_EQUALS(mesh.GetKDTree()->GetNodeCount(), 1u);
+    TS_ASSERT_EQUALS(kd_pick(mesh, Ray(DOUBLEVECTOR3(-1,-1,-1),
+                                       DOUBLEVECTOR3(1,1,1))),
+                     std::numeric_limits<double>::max());
+  }
+
+  void test_save_load() {
+    kd_mesh geometry(32, 32, 2000);
+    std::unique_ptr<Mesh> mesh(geometry.create(false));
+    std::unique_ptr<Mesh> brute(geometry.create(false));
+    KDTree built(mesh.get());
+    std::stringstream file;
+    TS_ASSERT(built.Save(file));
+    const std::string bytes = file.str();
+
+    KDTree loaded(mesh.get(), "", 1);
+    std::istringstream in(bytes);
+    TS_ASSERT(loaded.Load(in));
+    TS_ASSERT_EQUALS(loaded.GetNodeCount(), built.GetNodeCount());
+    TS_ASSERT_EQUALS(loaded.GetTriangleReferenceCount(),
+                     built.GetTriangleReferenceCount());
+    TS_ASSERT_EQUALS(loaded.GetMaxDepth(), built.GetMaxDepth());
+
+    const std::vector<Ray> rays = kd_rays(1000, 11);
+    for(size_t i=0; i < rays.size(); ++i) {
+      FLOATVECTOR3 normal; FLOATVECTOR2 tc; FLOATVECTOR4 color;
+      TS_ASSERT_EQUALS(loaded.Intersect(rays[i], normal, tc, color, 0, 100),
+                       kd_pick(*brute, rays[i]));
+    }
+  }
+
+  // damaged or foreign files are refused and leave the tree as it was
+  void test_load_rejects() {
+    kd_mesh geometry(16, 16, 100);
+    std::unique_ptr<Mesh> mesh(geometry.create(false));
+    KDTree tree(mesh.get());
+    std::stringstream file;
+    TS_ASSERT(tree.Save(file));
+    const std::string bytes = file.str();
+    const size_t nodes = tree.GetNodeCount();
+
+    std::istringstream truncated(bytes.substr(0, bytes.size()-4));
+    TS_ASSERT(!tree.Load(truncated));
+
+    std::string version = bytes;
+    version[4] = 2;
+    std::istringstream newer(version);
+    TS_ASSERT(!tree.Load(newer));
+
+    std::string broken = bytes;
+    // the first node's flags: point its children back at the root
+    const size_t flags = 3*4 + 3*8 + 6*4 + 4;
+    broken[flags] = broken[flags+1] = broken[flags+2] = broken[flags+3] = 0;
+    std::istringstream cycle(broken);
+    TS_ASSERT(!tree.Load(cycle));
+
+    kd_mesh other(16, 16, 101);
+    std::unique_ptr<Mesh> otherMesh(other.create(false));
+    KDTree foreign(otherMesh.get(), "", 1);
+    std::istringstream in(bytes);
+    TS_ASSERT(!foreign.Load(in));
+
+    TS_ASSERT_EQUALS(tree.GetNodeCount(), nodes);
+  }
+
+  // this is really a benchmark: build and pick latency on a mesh of about
+  // a million triangles, against testing every triangle
+  void test_bench() {
+    kd_mesh geometry(700, 700, 20000);
+    std::unique_ptr<Mesh> mesh(geometry.create(false));
+    std::unique_ptr<Mesh> brute(geometry.create(false));
+    Timer t; t.Start();
+    KDTree tree(mesh.get());
+    const double build = t.Elapsed();
+
+    const std::vector<Ray> rays = kd_rays(20000, 5);
+    FLOATVECTOR3 normal; FLOATVECTOR2 tc; FLOATVECTOR4 color;
+    double sum = 0;
+    t.Start();
+    for(size_t i=0; i < rays.size(); ++i) {
+      sum += std::min(tree.Intersect(rays[i], normal, tc, color, 0, 100), 1.0);
+    }
+    const double pick = t.Elapsed() / double(rays.size());
+    t.Start();
+    for(size_t i=0; i < 10; ++i) { sum += std::min(kd_pick(*brute, rays[i]), 1.0); }
+    const double slow = t.Elapsed() / 10.0;
+    fprintf(stderr, "\n%u triangles: build %.1f ms, %u nodes; pick %.4f ms "
+            "(brute force %.2f ms) %g\n",
+            unsigned(geometry.indices.size()/3), build,
+            unsigned(tree.GetNodeCount()), pick, slow, sum);
+  }
+};
@@ -0,0 +1,262 @@
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/GeometryGenerator.h"
+#include "Basics/Mesh.h"
+#include "Basics/MeshTools.h"
+#include "Basics/Timer.h"
+
+using namespace tuvok;
+
+namespace {
+  // 'count' arrows side by side as a triangle soup: every corner has its
+  // own position and normal
+  BasicMeshData mt_arrows(uint32_t count, uint32_t segments) {
+    const std::vector<Triangle> arrow =
+      GeometryGenerator::GenArrow(1.0f, 0.7f, 0.1f, 0.2f, segments);
+    BasicMeshData d;
+    for(uint32_t a=0; a < count; ++a) {
+      const FLOATVECTOR3 offset(float(a % 100), float(a / 100), 0.0f);
+      for(size_t t=0; t < arrow.size(); ++t) {
+        for(size_t v=0; v < 3; ++v) {
+          d.m_VertIndices.push_back(uint32_t(d.m_vertices.size()));
+          d.m_NormalIndices.push_back(uint32_t(d.m_normals.size()));
+          d.m_vertices.push_back(arrow[t].m_vertices[v].m_vPos + offset);
+          d.m_normals.push_back(arrow[t].m_vertices[v].m_vNormal);
+        }
+      }
+    }
+    return d;
+  }
+
+  typedef std::pair<FLOATVECTOR3, FLOATVECTOR3> mt_corner;
+
+  // position and normal of every corner
+  std::vector<mt_corner> mt_corners(const BasicMeshData& d) {
+    std::vector<mt_corner> corners;
+    for(size_t i=0; i < d.m_VertIndices.size(); ++i) {
+      corners.push_back(mt_corner(d.m_vertices[d.m_VertIndices[i]],
+                                  d.m_normals[d.m_NormalIndices[i]]));
+    }
+    return corners;
+  }
+
+  bool mt_less(const FLOATVECTOR3& a, const FLOATVECTOR3& b) {
+    if(a.x != b.x) { return a.x < b.x; }
+    if(a.y != b.y) { return a.y < b.y; }
+    return a.z < b.z;
+  }
+  struct mt_vector_less {
+    bool operator()(const FLOATVECTOR3& a, const FLOATVECTOR3& b) const {
+      return mt_less(a, b);
+    }
+  };
+  struct mt_corner_less {
+    bool operator()(const mt_corner& a, const mt_corner& b) const {
+      if(a.first != b.first) { return mt_less(a.first, b.first); }
+      return mt_less(a.second, b.second);
+    }
+  };
+
+  // what BasicMeshData::RemoveUnusedEntries did before MeshTools
+  template <typename T>
+  void mt_reference_remove(IndexVec& indices, std::vector<T>& entries) {
+    std::vector<size_t> inverseIndex(entries.size(),0);
+    for (size_t i = 0;i<indices.size();++i) {
+      inverseIndex[indices[i]]++;
+    }
+    for (int64_t i = int64_t(inverseIndex.size()-1);i>=0;--i) {
+      if (inverseIndex[size_t(i)] == 0) {
+        for (size_t j = 0;j<indices.size();++j) {
+          if (indices[j] > size_t(i) ) indices[j]--;
+        }
+        entries.erase(entries.begin()+size_t(i));
+      }
+    }
+  }
+
+  // n vertices of which every third is used, in random order
+  void mt_sparse(size_t n, IndexVec& indices, VertVec& entries) {
+    entries.clear();
+    indices.clear();
+    uint32_t state = 17;
+    for(size_t i=0; i < n; ++i) {
+      entries.push_back(FLOATVECTOR3(float(i), 0, 0));
+      state = state * 1664525u + 1013904223u;
+      if(i % 3 == 0) { indices.push_back(uint32_t(i)); }
+    }
+    for(size_t i=indices.size(); i > 1; --i) {
+      state = state * 1664525u + 1013904223u;
+      std::swap(indices[i-1], indices[(state >> 8) % i]);
+    }
+  }
+}
+
+class MeshToolsTests : public CxxTest::TestSuite {
+public:
+  void test_remove_unused() {
+    IndexVec indices, expectedIndices;
+    VertVec entries, expectedEntries;
+    mt_sparse(1000, indices, entries);
+    indices.push_back(indices[5]);
+    expectedIndices = indices;
+    expectedEntries = entries;
+    mt_reference_remove(expectedIndices, expectedEntries);
+
+    TS_ASSERT_EQUALS(MeshTools::RemoveUnusedEntries(indices, entries),
+                     1000u - 334u);
+    TS_ASSERT_EQUALS(indices, expectedIndices);
+    TS_ASSERT_EQUALS(entries, expectedEntries);
+    TS_ASSERT_EQUALS(MeshTools::RemoveUnusedEntries(indices, entries), 0u);
+  }
+
+  void test_weld_exact() {
+    BasicMeshData d = mt_arrows(20, 16);
+    const std::vector<mt_corner> corners = mt_corners(d);
+    std::set<FLOATVECTOR3, mt_vector_less> positions(d.m_vertices.begin(),
+                                                     d.m_vertices.end());
+    const size_t before = d.m_vertices.size();
+    TS_ASSERT_EQUALS(MeshTools::WeldVertices(d),
+                     before - positions.size());
+    TS_ASSERT_EQUALS(d.m_vertices.size(), positions.size());
+    TS_ASSERT(mt_corners(d) == corners);
+  }
+
+  // a lattice where every point is there twice, once moved a little
+  void test_weld_epsilon() {
+    IndexVec indices;
+    VertVec entries;
+    for(uint32_t i=0; i < 1000; ++i) {
+      const FLOATVECTOR3 p(float(i % 10), float((i / 10) % 10),
+                           float(i / 100));
+      const float jitter = 0.01f * float(int(i % 7) - 3) / 3.0f;
+      entries.push_back(p);
+      entries.push_back(p + FLOATVECTOR3(jitter, -jitter, jitter));
+      indices.push_back(2*i+1);
+      indices.push_back(2*i);
+    }
+    IndexVec tight = indices;
+    VertVec tightEntries = entries;
+    TS_ASSERT_EQUALS(MeshTools::Weld(tight, tightEntries, 0.001f), 1000u/7+1);
+
+    TS_ASSERT_EQUALS(MeshTools::Weld(indices, entries, 0.05f), 1000u);
+    TS_ASSERT_EQUALS(entries.size(), 1000u);
+    for(uint32_t i=0; i < 1000; ++i) {
+      TS_ASSERT_EQUALS(indices[2*i], i);
+      TS_ASSERT_EQUALS(indices[2*i+1], i);
+    }
+  }
+
+  void test_unify() {
+    BasicMeshData d = mt_arrows(10, 16);
+    MeshTools::WeldVertices(d);
+    MeshTools::WeldNormals(d);
+    const std::vector<mt_corner> corners = mt_corners(d);
+    TS_ASSERT(d.m_VertIndices != d.m_NormalIndices);
+
+    TS_ASSERT(MeshTools::UnifyIndices(d));
+    TS_ASSERT_EQUALS(d.m_VertIndices, d.m_NormalIndices);
+    TS_ASSERT(d.m_TCIndices.empty());
+    TS_ASSERT(d.m_COLIndices.empty());
+    TS_ASSERT(mt_corners(d) == corners);
+    std::set<mt_corner, mt_corner_less> distinct(corners.begin(),
+                                                 corners.end());
+    TS_ASSERT_EQUALS(d.m_vertices.size(), distinct.size());
+
+    BasicMeshData broken = mt_arrows(1, 8);
+    broken.m_NormalIndices.pop_back();
+    TS_ASSERT(!MeshTools::UnifyIndices(broken));
+    broken = mt_arrows(1, 8);
+    broken.m_NormalIndices[0] = uint32_t(broken.m_normals.size());
+    TS_ASSERT(!MeshTools::UnifyIndices(broken));
+  }
+
+  void test_partition() {
+    BasicMeshData d = mt_arrows(30, 16);
+    MeshTools::WeldVertices(d);
+    MeshTools::WeldNormals(d);
+    TS_ASSERT(MeshTools::UnifyIndices(d));
+    const std::vector<mt_corner> corners = mt_corners(d);
+
+    BasicMeshData welded = mt_arrows(1, 8);
+    MeshTools::WeldVertices(welded);
+    TS_ASSERT(MeshTools::Partition(welded, 3, 100).empty());
+    const std::vector<BasicMeshData> parts = MeshTools::Partition(d, 3, 500);
+    TS_ASSERT(parts.size() > 1);
+    std::vector<mt_corner> partCorners;
+    for(size_t i=0; i < parts.size(); ++i) {
+      TS_ASSERT(parts[i].m_vertices.size() <= 500u);
+      TS_ASSERT_EQUALS(parts[i].m_VertIndices, parts[i].m_NormalIndices);
+      const std::vector<mt_corner> c = mt_corners(parts[i]);
+      partCorners.insert(partCorners.end(), c.begin(), c.end());
+      // parts hold no unused vertices
+      BasicMeshData copy = parts[i];
+      MeshTools::RemoveUnused(copy);
+      TS_ASSERT_EQUALS(copy.m_vertices.size(), parts[i].m_vertices.size());
+    }
+    TS_ASSERT(partCorners == corners);
+  }
+
+  void test_mesh_partition() {
+    const BasicMeshData d = mt_arrows(30, 16);
+    Mesh mesh(d, false, false, "arrows", Mesh::MT_TRIANGLES);
+    std::vector<Mesh*> parts = mesh.PartitionMesh(1000, true);
+    size_t indices = 0, vertices = 0;
+    for(size_t i=0; i < parts.size(); ++i) {
+      TS_ASSERT(parts[i]->GetVertices().size() <= 1000u);
+      TS_ASSERT(parts[i]->HasUniformIndices());
+      TS_ASSERT(parts[i]->Validate(true));
+      indices += parts[i]->GetVertexIndices().size();
+      vertices += parts[i]->GetVertices().size();
+      delete parts[i];
+    }
+    TS_ASSERT_EQUALS(indices, d.m_VertIndices.size());
+    // welding shares the vertices of neighboring flat shaded triangles
+    TS_ASSERT(vertices < d.m_vertices.size() / 2);
+
+    Mesh unified(d, false, false, "arrows", Mesh::MT_TRIANGLES);
+    TS_ASSERT(unified.UnifyIndices());
+    TS_ASSERT(unified.HasUniformIndices());
+  }
+
+  // this is really a benchmark: a soup of ten thousand arrows (about two
+  // million triangles) welded, unified and partitioned; and the old
+  // quadratic RemoveUnusedEntries against the new one on 20k vertices
+  void test_bench() {
+    BasicMeshData d = mt_arrows(10000, 32);
+    Timer t; t.Start();
+    const size_t weldedVertices = MeshTools::WeldVertices(d);
+    const double weldV = t.Elapsed(); t.Start();
+    const size_t weldedNormals = MeshTools::WeldNormals(d, 1e-4f);
+    const double weldN = t.Elapsed(); t.Start();
+    TS_ASSERT(MeshTools::UnifyIndices(d));
+    const double unify = t.Elapsed(); t.Start();
+    const std::vector<BasicMeshData> parts = MeshTools::Partition(d, 3, 65536);
+    const double partition = t.Elapsed(); t.Start();
+    MeshTools::RemoveUnused(d);
+    const double unused = t.Elapsed();
+    fprintf(stderr, "\n%u triangles: weld %.1f ms (-%u), normals %.1f ms "
+            "(-%u), unify %.1f ms (%u vertices), partition %.1f ms (%u "
+            "parts), remove unused %.1f ms",
+            unsigned(d.m_VertIndices.size()/3), weldV,
+            unsigned(weldedVertices), weldN, unsigned(weldedNormals), unify,
+            unsigned(d.m_vertices.size()), partition, unsigned(parts.size()),
+            unused);
+
+    IndexVec indices, referenceIndices;
+    VertVec entries, referenceEntries;
+    mt_sparse(20000, indices, entries);
+    referenceIndices = indices;
+    referenceEntries = entries;
+    t.Start();
+    mt_reference_remove(referenceIndices, referenceEntries);
+    const double quadratic = t.Elapsed(); t.Start();
+    MeshTools::RemoveUnusedEntries(indices, entries);
+    const double linear = t.Elapsed();
+    TS_ASSERT_EQUALS(indices, referenceIndices);
+    fprintf(stderr, "\nremove unused, 20k vertices: old %.1f ms, new %.3f ms\n",
+            quadratic, linear);
+  }
+};
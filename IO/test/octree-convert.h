@@ -0,0 +1,322 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Controller/Controller.h"
+#include "UVF/ExtendedOctree/ExtendedOctreeConverter.h"
+#include "UVF/ExtendedOctree/OctreeBuildSchedule.h"
+#include "UVF/ExtendedOctree/OctreeSliceSource.h"
+#include "UVF/UVF.h"
+#include "util-test.h"
+
+namespace {
+  std::vector<char> oc_slurp(const std::string& fn) {
+    std::ifstream ifs(fn.c_str(), std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(ifs)),
+                             std::istreambuf_iterator<char>());
+  }
+
+  // a volume which does not divide evenly into bricks, with some noise so
+  // that median and mean differ and compression has something to do.
+  std::string oc_volume(const UINT64VECTOR3& sz) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    std::mt19937 mtwister(42);
+    for(uint64_t i=0; i < sz.volume(); ++i) {
+      const uint16_t v = uint16_t((i/97) % 512 + mtwister() % 8);
+      ofs.write(reinterpret_cast<const char*>(&v), sizeof(uint16_t));
+    }
+    return fn;
+  }
+
+  std::string oc_convert(const std::string& in, const UINT64VECTOR3& sz,
+                         unsigned threads, uint64_t mem, COMPRESSION_TYPE ct,
+                         LAYOUT_TYPE lt, BrickStatVec& stats,
+                         ExtendedOctreeConverter::CachePolicy policy =
+                           ExtendedOctreeConverter::CP_OPTIMAL,
+                         ExtendedOctreeConverter::CacheStats* cs = NULL) {
+    std::ofstream ofs;
+    const std::string out = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.close();
+    ExtendedOctreeConverter conv(UINT64VECTOR3(32,32,32), 2, mem,
+                                 Controller::Debug::Out(), threads);
+    conv.SetCachePolicy(policy);
+    TS_ASSERT(conv.Convert(in, 0, ExtendedOctree::CT_UINT16, 1, sz,
+                           DOUBLEVECTOR3(1,1,1), out, 0, &stats, ct, 3,
+                           true, true, lt));
+    if(cs) { *cs = conv.GetCacheStats(); }
+    return out;
+  }
+
+  // serves the slices of a raw file and counts how often each is requested
+  struct oc_file_slices : public SliceSource {
+    oc_file_slices(const std::string& fn, const UINT64VECTOR3& sz) :
+      data(oc_slurp(fn)), size(sz), requests(size_t(sz.z), 0) {}
+    void GetSlice(uint64_t iSlice, uint8_t* pData) {
+      const size_t bytes = size_t(size.x * size.y * sizeof(uint16_t));
+      std::copy(data.begin() + iSlice*bytes, data.begin() + (iSlice+1)*bytes,
+                pData);
+#pragma omp atomic
+      requests[size_t(iSlice)]++;
+    }
+    std::vector<char> data;
+    UINT64VECTOR3 size;
+    std::vector<int> requests;
+  };
+
+  // converting from slices must give the same file as converting the raw
+  // file they come from, while producing every slice once.
+  void oc_slices(unsigned threads, uint64_t mem, COMPRESSION_TYPE ct) {
+    const UINT64VECTOR3 sz(100, 90, 70);
+    const std::string in = oc_volume(sz);
+    BrickStatVec fileStats, sliceStats;
+    const std::string ref = oc_convert(in, sz, threads, mem, ct, LT_SCANLINE,
+                                       fileStats);
+    std::ofstream ofs;
+    const std::string out = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.close();
+    clean f = cleanup(in).add(ref).add(out);
+
+    oc_file_slices source(in, sz);
+    {
+      LargeRAWFile_ptr outFile(new LargeRAWFile(out));
+      TS_ASSERT(outFile->Create());
+      ExtendedOctreeConverter conv(UINT64VECTOR3(32,32,32), 2, mem,
+                                   Controller::Debug::Out(), threads);
+      TS_ASSERT(conv.Convert(source, ExtendedOctree::CT_UINT16, 1, sz,
+                             DOUBLEVECTOR3(1,1,1), outFile, 0, &sliceStats,
+                             ct, 3, true, true, LT_SCANLINE));
+    }
+    TS_ASSERT(oc_slurp(out) == oc_slurp(ref));
+    TS_ASSERT_EQUALS(sliceStats.size(), fileStats.size());
+    for(size_t i=0; i < source.requests.size(); ++i) {
+      TS_ASSERT_EQUALS(source.requests[i], 1);
+    }
+  }
+
+  std::string oc_export(const std::string& octree) {
+    std::ofstream ofs;
+    const std::string out = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.close();
+    ExtendedOctree tree;
+    TS_ASSERT(tree.Open(octree, 0, UVF::ms_ulReaderVersion));
+    TS_ASSERT(ExtendedOctreeConverter::ExportToRAW(tree, out, 0, 0));
+    tree.Close();
+    return out;
+  }
+
+  // rebricking an octree into a different layout straight from its bricks
+  // must not lose a voxel, and must read every source brick once.
+  void oc_rebrick(const UINT64VECTOR3& brick, uint32_t overlap,
+                  COMPRESSION_TYPE ct) {
+    const UINT64VECTOR3 sz(100, 90, 70);
+    const std::string in = oc_volume(sz);
+    BrickStatVec stats;
+    const std::string src = oc_convert(in, sz, 4, 1 << 28, CT_LZ4,
+                                       LT_SCANLINE, stats);
+    std::ofstream ofs;
+    const std::string out = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.close();
+    clean f = cleanup(in).add(src).add(out);
+
+    {
+      ExtendedOctree tree;
+      TS_ASSERT(tree.Open(src, 0, UVF::ms_ulReaderVersion));
+      OctreeSliceSource source(tree, 0, brick.z);
+      TS_ASSERT_EQUALS(source.GetSize(), sz);
+      LargeRAWFile_ptr outFile(new LargeRAWFile(out));
+      TS_ASSERT(outFile->Create());
+      ExtendedOctreeConverter conv(brick, overlap, 1 << 20,
+                                   Controller::Debug::Out(), 4);
+      TS_ASSERT(conv.Convert(source, ExtendedOctree::CT_UINT16, 1, sz,
+                             DOUBLEVECTOR3(1,1,1), outFile, 0, &stats, ct, 3,
+                             false, true, LT_SCANLINE));
+      TS_ASSERT_EQUALS(source.GetBrickReads(), tree.GetBrickCount(0).volume());
+      tree.Close();
+    }
+
+    const std::string exported = oc_export(out);
+    clean g = cleanup(exported);
+    TS_ASSERT(oc_slurp(exported) == oc_slurp(in));
+  }
+
+  // replays the converter's build order and records the steps at which
+  // each brick is read or written.
+  std::map<uint64_t, std::vector<uint64_t>>
+  oc_trace(const std::vector<UINT64VECTOR3>& counts) {
+    std::map<uint64_t, std::vector<uint64_t>> uses;
+    std::vector<uint64_t> offsets(1, 0);
+    for(size_t l=0; l < counts.size(); ++l) {
+      offsets.push_back(offsets.back() + counts[l].volume());
+    }
+    struct {
+      const std::vector<UINT64VECTOR3>* counts;
+      const std::vector<uint64_t>* offsets;
+      uint64_t operator()(int64_t x, int64_t y, int64_t z, size_t l) const {
+        const UINT64VECTOR3& c = (*counts)[l];
+        if(x < 0 || y < 0 || z < 0 || uint64_t(x) >= c.x ||
+           uint64_t(y) >= c.y || uint64_t(z) >= c.z) {
+          return std::numeric_limits<uint64_t>::max();
+        }
+        return (*offsets)[l] + uint64_t(x) + uint64_t(y)*c.x +
+               uint64_t(z)*c.x*c.y;
+      }
+    } index = { &counts, &offsets };
+    // neighbors read by FillOverlap, relative to the target brick
+    static const int fill[11][3] = {
+      {0,0,0}, {1,0,0}, {0,1,0}, {0,0,1}, {-1,0,0}, {0,-1,0}, {0,0,-1},
+      {1,1,0}, {1,0,1}, {0,1,1}, {1,1,1}
+    };
+
+    uint64_t step = 0;
+    for(uint64_t i=0; i < counts[0].volume(); ++i) { uses[i].push_back(step++); }
+    for(size_t l=1; l < counts.size(); ++l) {
+      const UINT64VECTOR3& c = counts[l];
+      for(int64_t z=0; z < int64_t(c.z); ++z) {
+        for(int64_t y=0; y < int64_t(c.y); ++y) {
+          for(int64_t x=0; x < int64_t(c.x); ++x, ++step) {
+            for(int i=0; i < 8; ++i) {
+              const uint64_t child = index(2*x+(i&1), 2*y+((i>>1)&1),
+                                           2*z+(i>>2), l-1);
+              if(child != std::numeric_limits<uint64_t>::max()) {
+                uses[child].push_back(step);
+              }
+            }
+            uses[index(x,y,z,l)].push_back(step);
+          }
+        }
+      }
+      for(int64_t z=0; z < int64_t(c.z); ++z) {
+        for(int64_t y=0; y < int64_t(c.y); ++y) {
+          for(int64_t x=0; x < int64_t(c.x); ++x, ++step) {
+            for(int i=0; i < 11; ++i) {
+              const uint64_t n = index(x+fill[i][0], y+fill[i][1],
+                                       z+fill[i][2], l);
+              if(n != std::numeric_limits<uint64_t>::max()) {
+                uses[n].push_back(step);
+              }
+            }
+          }
+        }
+      }
+    }
+    return uses;
+  }
+
+  // output must not depend on the cache policy or size; the optimal policy
+  // must not read more than LRU.
+  void oc_policies(uint64_t mem) {
+    const UINT64VECTOR3 sz(100, 90, 70);
+    const std::string in = oc_volume(sz);
+    BrickStatVec refStats, lruStats, optStats;
+    ExtendedOctreeConverter::CacheStats lru, opt;
+    const std::string ref = oc_convert(in, sz, 2, 1 << 28, CT_NONE,
+                                       LT_SCANLINE, refStats);
+    const std::string outLRU = oc_convert(in, sz, 2, mem, CT_NONE,
+                                          LT_SCANLINE, lruStats,
+                                          ExtendedOctreeConverter::CP_LRU,
+                                          &lru);
+    const std::string outOpt = oc_convert(in, sz, 2, mem, CT_NONE,
+                                          LT_SCANLINE, optStats,
+                                          ExtendedOctreeConverter::CP_OPTIMAL,
+                                          &opt);
+    clean f = cleanup(in).add(ref).add(outLRU).add(outOpt);
+
+    const std::vector<char> expected = oc_slurp(ref);
+    TS_ASSERT(oc_slurp(outLRU) == expected);
+    TS_ASSERT(oc_slurp(outOpt) == expected);
+    TS_ASSERT_EQUALS(lru.iReads, opt.iReads);
+    TS_ASSERT_LESS_THAN_EQUALS(opt.iDiskReads, lru.iDiskReads);
+    TS_ASSERT_LESS_THAN_EQUALS(opt.iWriteRuns, opt.iDiskWrites);
+    TS_ASSERT_LESS_THAN_EQUALS(opt.iPeakBytes, std::max<uint64_t>(mem,
+                               2*32*32*32*sizeof(uint16_t)));
+    std::cerr << "\n" << mem << " bytes: LRU " << lru.iDiskReads << "/"
+              << lru.iReads << " reads, " << lru.iDiskWrites << " writes in "
+              << lru.iWriteRuns << " runs; optimal " << opt.iDiskReads << "/"
+              << opt.iReads << " reads, " << opt.iDiskWrites << " writes in "
+              << opt.iWriteRuns << " runs\n";
+  }
+
+  // the number of threads must not change a single byte of the output.
+  void oc_same_output(COMPRESSION_TYPE ct, LAYOUT_TYPE lt, uint64_t mem) {
+    const UINT64VECTOR3 sz(100, 90, 70);
+    const std::string in = oc_volume(sz);
+    BrickStatVec serialStats, parallelStats;
+    const std::string serial = oc_convert(in, sz, 1, mem, ct, lt,
+                                          serialStats);
+    const std::string parallel = oc_convert(in, sz, 4, mem, ct, lt,
+                                            parallelStats);
+    clean f = cleanup(in).add(serial).add(parallel);
+
+    TS_ASSERT(oc_slurp(serial) == oc_slurp(parallel));
+    TS_ASSERT_EQUALS(serialStats.size(), parallelStats.size());
+    for(size_t i=0; i < std::min(serialStats.size(), parallelStats.size());
+        ++i) {
+      TS_ASSERT_EQUALS(serialStats[i].minScalar, parallelStats[i].minScalar);
+      TS_ASSERT_EQUALS(serialStats[i].maxScalar, parallelStats[i].maxScalar);
+    }
+  }
+}
+
+class OctreeConvertTests : public CxxTest::TestSuite {
+public:
+  void test_uncompressed() { oc_same_output(CT_NONE, LT_SCANLINE, 1 << 28); }
+  void test_zlib() { oc_same_output(CT_ZLIB, LT_SCANLINE, 1 << 28); }
+  // small memory limit: the brick cache has to evict while workers run.
+  void test_small_cache() { oc_same_output(CT_LZ4, LT_SCANLINE, 1 << 18); }
+  void test_morton() { oc_same_output(CT_BZLIB, LT_MORTON, 1 << 28); }
+
+  // NextUse must agree with a replay of the build order.
+  void test_schedule() {
+    std::vector<UINT64VECTOR3> counts;
+    counts.push_back(UINT64VECTOR3(5,3,4));
+    counts.push_back(UINT64VECTOR3(3,2,2));
+    counts.push_back(UINT64VECTOR3(2,1,1));
+    counts.push_back(UINT64VECTOR3(1,1,1));
+    const OctreeBuildSchedule schedule(counts);
+    const std::map<uint64_t, std::vector<uint64_t>> uses = oc_trace(counts);
+
+    TS_ASSERT_EQUALS(schedule.GetStepCount(), 60u + 2*12 + 2*2 + 2*1);
+    for(auto b = uses.begin(); b != uses.end(); ++b) {
+      const std::vector<uint64_t>& steps = b->second;
+      TS_ASSERT_EQUALS(schedule.BuildStep(b->first), steps.front());
+      for(size_t i=0; i < steps.size(); ++i) {
+        const uint64_t next = i+1 < steps.size() && steps[i+1] != steps[i]
+                            ? steps[i+1] : OctreeBuildSchedule::NEVER;
+        if(i+1 < steps.size() && steps[i+1] == steps[i]) { continue; }
+        TS_ASSERT_EQUALS(schedule.NextUse(b->first, steps[i]), next);
+      }
+    }
+  }
+
+  void test_slices() { oc_slices(1, 1 << 28, CT_NONE); }
+  void test_slices_parallel() { oc_slices(4, 1 << 18, CT_LZ4); }
+
+  void test_export() {
+    const UINT64VECTOR3 sz(100, 90, 70);
+    const std::string in = oc_volume(sz);
+    BrickStatVec stats;
+    const std::string octree = oc_convert(in, sz, 4, 1 << 28, CT_ZLIB,
+                                          LT_SCANLINE, stats);
+    const std::string exported = oc_export(octree);
+    clean f = cleanup(in).add(octree).add(exported);
+    TS_ASSERT(oc_slurp(exported) == oc_slurp(in));
+  }
+  void test_rebrick_larger() {
+    oc_rebrick(UINT64VECTOR3(64,64,64), 1, CT_ZLIB);
+  }
+  void test_rebrick_smaller() {
+    oc_rebrick(UINT64VECTOR3(16,16,16), 2, CT_NONE);
+  }
+  void test_rebrick_anisotropic() {
+    oc_rebrick(UINT64VECTOR3(48,24,40), 4, CT_LZ4);
+  }
+
+  void test_no_cache() { oc_policies(0); }
+  void test_tiny_cache() { oc_policies(1 << 19); }
+  void test_medium_cache() { oc_policies(1 << 21); }
+};
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "BrickPrefetcher.h"
+#include "Basics/Threads.h"
+
+using namespace tuvok;
+
+static std::vector<BrickKey> pf_keys(size_t n) {
+  std::vector<BrickKey> rv;
+  for(size_t i=0; i < n; ++i) { rv.push_back(BrickKey(0,0,i)); }
+  return rv;
+}
+
+// every requested brick is loaded, exactly once.
+void tall_loaded() {
+  std::vector<std::atomic<unsigned>> loaded(64);
+  for(size_t i=0; i < loaded.size(); ++i) { loaded[i] = 0; }
+  BrickPrefetcher pf([&](const BrickKey& k) { ++loaded[std::get<2>(k)]; }, 4);
+  pf.Request(pf_keys(loaded.size()));
+  pf.Wait();
+  TS_ASSERT_EQUALS(pf.Pending(), 0U);
+  for(size_t i=0; i < loaded.size(); ++i) {
+    TS_ASSERT_EQUALS(loaded[i].load(), 1U);
+  }
+}
+
+// a new request replaces whatever was not started yet.
+void treplace() {
+  CriticalSection guard;
+  bool open = false;
+  WaitCondition gate;
+  std::atomic<unsigned> count(0);
+  std::vector<std::atomic<unsigned>> loaded(32);
+  for(size_t i=0; i < loaded.size(); ++i) { loaded[i] = 0; }
+  BrickPrefetcher pf([&](const BrickKey& k) {
+    {
+      SCOPEDLOCK(guard);
+      while(!open) { gate.Wait(guard); }
+    }
+    ++loaded[std::get<2>(k)];
+    ++count;
+  }, 1);
+  pf.Request(pf_keys(16));
+  // the single worker is now stuck on brick 0 (or about to be).
+  std::vector<BrickKey> second;
+  for(size_t i=16; i < 32; ++i) { second.push_back(BrickKey(0,0,i)); }
+  pf.Request(second);
+  {
+    SCOPEDLOCK(guard);
+    open = true;
+    gate.WakeAll();
+  }
+  pf.Wait();
+  for(size_t i=16; i < 32; ++i) { TS_ASSERT_EQUALS(loaded[i].load(), 1U); }
+  // at most the one brick in flight survives from the first request.
+  TS_ASSERT_LESS_THAN_EQUALS(count.load(), 17U);
+}
+
+// cancel drops pending work; it does not wait for or abort loads in flight.
+void tcancel() {
+  std::atomic<unsigned> count(0);
+  BrickPrefetcher pf([&](const BrickKey&) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ++count;
+  }, 2);
+  pf.Request(pf_keys(1000));
+  pf.Cancel();
+  pf.Wait();
+  TS_ASSERT_EQUALS(pf.Pending(), 0U);
+  TS_ASSERT_LESS_THAN(count.load(), 1000U);
+}
+
+// WaitFor returns only once a brick in flight is done.
+void twait_for() {
+  std::atomic<bool> done(false);
+  std::atomic<bool> started(false);
+  BrickPrefetcher pf([&](const BrickKey&) {
+    started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    done = true;
+  }, 1);
+  pf.Request(pf_keys(1));
+  while(!started) { std::this_thread::yield(); }
+  pf.WaitFor(BrickKey(0,0,0));
+  TS_ASSERT(done.load());
+  // a key nobody loads does not block.
+  pf.WaitFor(BrickKey(1,2,3));
+}
+
+// a throwing load function must not take down the worker.
+void tthrow() {
+  std::atomic<unsigned> count(0);
+  BrickPrefetcher pf([&](const BrickKey& k) {
+    ++count;
+    if(std::get<2>(k) % 2) { throw std::runtime_error("odd brick"); }
+  }, 1);
+  pf.Request(pf_keys(10));
+  pf.Wait();
+  TS_ASSERT_EQUALS(count.load(), 10U);
+}
+
+class PrefetchTests : public CxxTest::TestSuite {
+public:
+  void test_all_loaded() { tall_loaded(); }
+  void test_replace() { treplace(); }
+  void test_cancel() { tcancel(); }
+  void test_wait_for() { twait_for(); }
+  void test_throw() { tthrow(); }
+};
+
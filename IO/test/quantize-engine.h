@@ -0,0 +1,438 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "Controller/Controller.h"
+#include "UVF/Histogram1DDataBlock.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+#include "../Quantize.h"
+#include "util-test.h"
+
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level and the number of threads when a test is done
+  struct qe_state {
+    qe_state() : level(GetSIMDLevel()), threads(1) {
+#ifdef _OPENMP
+      threads = omp_get_max_threads();
+#endif
+    }
+    ~qe_state() {
+      SetSIMDLevel(level);
+#ifdef _OPENMP
+      omp_set_num_threads(threads);
+#endif
+    }
+    SIMDLevel level;
+    int threads;
+  };
+
+  void qe_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+  }
+
+  // Quantize as it was before the single pass engine: a min/max pass and
+  // a mapping pass, one value at a time.
+  template<typename T, typename U>
+  bool qe_legacy_quantize(LargeRAWFile& input, uint64_t iElems,
+                          const std::string& target,
+                          Histogram1DDataBlock* hist, size_t* iBinCount) {
+    if(iBinCount) { *iBinCount = 0; }
+    const size_t hist_size = sizeof(U) == 1 ? 256 : 4096;
+    const size_t iInCoreElems = AbstrConverter::GetIncoreSize() / sizeof(T);
+
+    std::vector<uint64_t> aHist(hist_size, 0);
+    const size_t sz = (sizeof(U) == 2 ? 4096 : 256);
+    std::pair<T,T> minmax = io_minmax(raw_data_src<T>(input),
+                                      UnsignedHistogram<T, sz>(aHist),
+                                      TuvokProgress<uint64_t>(iElems),
+                                      iElems, iInCoreElems*sizeof(T));
+    if(!ctti<T>::is_signed && minmax.second < static_cast<T>(hist_size) &&
+       sizeof(T) <= ((hist_size == 256) ? 1 : 2)) {
+      if(iBinCount) {
+        for(size_t b=0; b < aHist.size(); ++b) {
+          if(aHist[b] != 0) { (*iBinCount)++; }
+        }
+      }
+      return false;
+    }
+    std::fill(aHist.begin(), aHist.end(), 0);
+    if(iBinCount) { *iBinCount = bins_needed<T>(minmax); }
+
+    const size_t max_output_val = hist_size == 256 ? 255 : 65535;
+    const double fQuantFact = QuantizationFactor(max_output_val, minmax.first,
+                                                 minmax.second);
+    const double fQuantFactHist = QuantizationFactor(hist_size-1,
+                                                     minmax.first,
+                                                     minmax.second);
+    const bool bDataWillbeChanged = fQuantFact != 1.0 || minmax.first != 0 ||
+                                    sizeof(T) > 2 || sizeof(T) > sizeof(U);
+    LargeRAWFile output(target);
+    if(bDataWillbeChanged) { output.Create(); }
+
+    std::vector<T> in(iInCoreElems);
+    std::vector<U> out(iInCoreElems);
+    input.SeekStart();
+    for(uint64_t iPos=0; iPos < iElems; ) {
+      const size_t iRead = input.ReadRAW(
+        reinterpret_cast<unsigned char*>(&in[0]),
+        std::min<uint64_t>(iElems-iPos, iInCoreElems)*sizeof(T)) / sizeof(T);
+      if(iRead == 0) { break; }
+      for(size_t i=0; i < iRead; ++i) {
+        out[i] = std::min<U>(static_cast<U>(max_output_val),
+          static_cast<U>((in[i]-minmax.first) * fQuantFact));
+        aHist[std::min<U>(static_cast<U>(hist_size-1),
+          static_cast<U>((in[i]-minmax.first) * fQuantFactHist))]++;
+      }
+      if(bDataWillbeChanged) {
+        output.WriteRAW(reinterpret_cast<unsigned char*>(&out[0]),
+                        iRead*sizeof(U));
+      }
+      iPos += iRead;
+    }
+    if(hist) { hist->SetHistogram(aHist); }
+    if(bDataWillbeChanged) { output.Close(); }
+    return bDataWillbeChanged;
+  }
+
+  template<typename T, typename U>
+  bool qe_legacy_ranks(LargeRAWFile& input, uint64_t iElems,
+                       const std::string& target, Histogram1DDataBlock* hist,
+                       std::map<T, size_t>& ranks) {
+    const size_t iInCoreElems = AbstrConverter::GetIncoreSize() / sizeof(T);
+    std::vector<T> in(iInCoreElems);
+    std::vector<U> out(iInCoreElems);
+    std::vector<uint64_t> aHist(sizeof(U) == 1 ? 256 : ranks.size(), 0);
+    LargeRAWFile output(target);
+    output.Create();
+    input.SeekStart();
+    for(uint64_t iPos=0; iPos < iElems; ) {
+      const size_t iRead = input.ReadRAW(
+        reinterpret_cast<unsigned char*>(&in[0]),
+        std::min<uint64_t>(iElems-iPos, iInCoreElems)*sizeof(T)) / sizeof(T);
+      if(iRead == 0) { break; }
+      for(size_t i=0; i < iRead; ++i) {
+        out[i] = U(ranks[in[i]]);
+        aHist[out[i]]++;
+      }
+      output.WriteRAW(reinterpret_cast<unsigned char*>(&out[0]),
+                      iRead*sizeof(U));
+      iPos += iRead;
+    }
+    output.Close();
+    if(hist) { hist->SetHistogram(aHist); }
+    return true;
+  }
+
+  // BinningQuantize before the engine: unique values counted in a std::map
+  template<typename T, typename U>
+  bool qe_legacy_binning(LargeRAWFile& input, const std::string& target,
+                         uint64_t iElems, unsigned& iComponentSize,
+                         Histogram1DDataBlock* hist) {
+    iComponentSize = sizeof(U)*8;
+    const size_t iInCoreElems = AbstrConverter::GetIncoreSize() / sizeof(T);
+    const size_t max_bins = std::min<size_t>(4096, size_t(1) << (sizeof(U)*8));
+    std::vector<T> in(iInCoreElems);
+    std::map<T, uint64_t> bins;
+    bool bBinningPossible = true;
+    input.SeekStart();
+    for(uint64_t iPos=0; bBinningPossible && iPos < iElems; ) {
+      const size_t iRead = input.ReadRAW(
+        reinterpret_cast<unsigned char*>(&in[0]),
+        std::min<uint64_t>(iElems-iPos, iInCoreElems)*sizeof(T)) / sizeof(T);
+      if(iRead == 0) { break; }
+      for(size_t i=0; i < iRead; ++i) {
+        bins[in[i]]++;
+        if(bins.size() > max_bins) { bBinningPossible = false; break; }
+      }
+      iPos += iRead;
+    }
+    if(!bBinningPossible) {
+      return qe_legacy_quantize<T,U>(input, iElems, target, hist, NULL);
+    }
+    std::map<T, size_t> ranks;
+    size_t rank = 0;
+    for(typename std::map<T, uint64_t>::const_iterator b = bins.begin();
+        b != bins.end(); ++b) {
+      ranks[b->first] = rank++;
+    }
+    if(ranks.size() < 256) {
+      iComponentSize = 8;
+      return qe_legacy_ranks<T,uint8_t>(input, iElems, target, hist, ranks);
+    }
+    return qe_legacy_ranks<T,U>(input, iElems, target, hist, ranks);
+  }
+
+  struct qe_result {
+    bool generated;
+    unsigned bits;
+    size_t bins;
+    std::vector<uint64_t> hist;
+    std::vector<char> out;
+  };
+
+  template<typename T>
+  std::string qe_file(const std::vector<T>& data) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&data[0]),
+              data.size() * sizeof(T));
+    return fn;
+  }
+
+  enum qe_mode { QE_QUANTIZE, QE_BINNING };
+
+  template<typename T, typename U>
+  qe_result qe_run(const std::string& fn, uint64_t n, qe_mode mode,
+                   bool bLegacy, bool bReadOutput=true) {
+    std::ofstream ofs;
+    const std::string outfn = mk_tmpfile(ofs, std::ios::out |
+                                              std::ios::binary);
+    ofs.close();
+    qe_result r;
+    r.bits = 0;
+    r.bins = 0;
+    Histogram1DDataBlock hist;
+    {
+      LargeRAWFile input(fn);
+      input.Open(false);
+      if(mode == QE_QUANTIZE) {
+        BStreamDescriptor bsd;
+        bsd.elements = n;
+        bsd.components = 1;
+        bsd.width = sizeof(T);
+        bsd.is_signed = ctti<T>::is_signed;
+        bsd.fp = std::is_floating_point<T>::value;
+        bsd.big_endian = EndianConvert::IsBigEndian();
+        bsd.timesteps = 1;
+        r.generated = bLegacy
+          ? qe_legacy_quantize<T,U>(input, n, outfn, &hist, &r.bins)
+          : Quantize<T,U>(input, bsd, outfn, &hist, &r.bins);
+      } else {
+        r.generated = bLegacy
+          ? qe_legacy_binning<T,U>(input, outfn, n, r.bits, &hist)
+          : BinningQuantize<T,U>(input, outfn, n, r.bits, &hist);
+      }
+    }
+    r.hist = hist.GetHistogram();
+    if(r.generated && bReadOutput) {
+      r.out.resize(filesize(outfn.c_str()));
+      std::ifstream ifs(outfn.c_str(), std::ios::in | std::ios::binary);
+      ifs.read(&r.out[0], std::streamsize(r.out.size()));
+    }
+    remove(outfn.c_str());
+    return r;
+  }
+
+  // the engine against the old code, bit by bit, for all instruction sets
+  // and with one and with several threads.
+  template<typename T, typename U>
+  void qe_compare(const std::vector<T>& data, qe_mode mode,
+                  bool bExpectOutput) {
+    qe_state restore;
+    const std::string fn = qe_file(data);
+    const qe_result ref = qe_run<T,U>(fn, data.size(), mode, true);
+    TS_ASSERT_EQUALS(ref.generated, bExpectOutput);
+
+    const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+      for(int threads=1; threads <= 4; threads *= 4) {
+        SetSIMDLevel(levels[l]);
+        qe_threads(threads);
+        const qe_result r = qe_run<T,U>(fn, data.size(), mode, false);
+        TS_ASSERT_EQUALS(r.generated, ref.generated);
+        TS_ASSERT_EQUALS(r.bits, ref.bits);
+        TS_ASSERT_EQUALS(r.bins, ref.bins);
+        TS_ASSERT(r.hist == ref.hist);
+        TS_ASSERT_EQUALS(r.out.size(), ref.out.size());
+        TS_ASSERT(r.out == ref.out);
+      }
+    }
+    remove(fn.c_str());
+  }
+
+  // a smooth signal with noise on top in [lo, hi], like a scan
+  template<typename T>
+  std::vector<T> qe_scan(size_t n, double lo, double hi) {
+    std::mt19937 mt(42);
+    std::uniform_real_distribution<double> noise(0.0, 0.1);
+    std::vector<T> data(n);
+    for(size_t i=0; i < n; ++i) {
+      const double s = 0.45 * (1.0 + std::sin(double(i % 7919) * 0.01)) +
+                       noise(mt);
+      data[i] = T(lo + s * (hi - lo));
+    }
+    data[n/3] = T(lo);
+    data[n/2] = T(hi);
+    return data;
+  }
+
+  // only 'levels' distinct values, in runs
+  template<typename T>
+  std::vector<T> qe_levels(size_t n, size_t levels, double lo, double step) {
+    std::mt19937 mt(7);
+    std::vector<T> data(n);
+    for(size_t i=0; i < n; ) {
+      const T v = T(lo + double(mt() % levels) * step);
+      for(size_t run = 1 + mt() % 16; run > 0 && i < n; --run) {
+        data[i++] = v;
+      }
+    }
+    return data;
+  }
+
+  // the row kernels against their scalar definition, bit by bit.
+  void qe_kernels(SIMDLevel level) {
+    // odd length, so that the scalar tail after the vector loop runs too
+    const size_t n = 1001;
+    std::mt19937 mt(level);
+    std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+    std::vector<float> f(n);
+    std::vector<double> d(n);
+    std::vector<uint32_t> u(n);
+    for(size_t i=0; i < n; ++i) {
+      d[i] = dist(mt);
+      f[i] = float(d[i]);
+      u[i] = uint32_t(mt());
+    }
+    f[5] = std::numeric_limits<float>::quiet_NaN();
+    f[6] = 1000.0f;
+    d[7] = 1000.0;
+    u[8] = 0xffffffffu;
+    u[9] = 0;
+
+    TS_ASSERT_EQUALS(SetSIMDLevel(level), std::min(level, DetectSIMDLevel()));
+    std::vector<uint16_t> out(n);
+    const double scale = 65535.0 / 2000.0;
+    QuantizeRow(&f[0], -1000.0f, scale, 65535.0, &out[0], n);
+    for(size_t i=0; i < n; ++i) {
+      TS_ASSERT_EQUALS(out[i], uint16_t(std::min(65535.0,
+                                        double(f[i] + 1000.0f) * scale)));
+    }
+    TS_ASSERT_EQUALS(out[5], 65535);
+    QuantizeRow(&d[0], -1000.0, scale, 4095.0, &out[0], n);
+    for(size_t i=0; i < n; ++i) {
+      TS_ASSERT_EQUALS(out[i], uint16_t(std::min(4095.0,
+                                                 (d[i] + 1000.0) * scale)));
+    }
+    // int32 data go through the unsigned kernel, modulo 2^32
+    const double uscale = 65535.0 / 4294967295.0;
+    QuantizeRow(&u[0], 0x80000000u, uscale, 65535.0, &out[0], n);
+    for(size_t i=0; i < n; ++i) {
+      TS_ASSERT_EQUALS(out[i], uint16_t(std::min(65535.0,
+        double(uint32_t(u[i] - 0x80000000u)) * uscale)));
+    }
+  }
+
+  template<typename T, typename U>
+  double qe_time(const std::string& fn, uint64_t n, qe_mode mode,
+                 bool bLegacy) {
+    Timer t; t.Start();
+    qe_run<T,U>(fn, n, mode, bLegacy, false);
+    return t.Elapsed();
+  }
+
+  // this is really a benchmark: the old templates against the engine, on
+  // one thread and on all of them.
+  template<typename T, typename U>
+  void qe_bench(const char* name, const std::vector<T>& data, qe_mode mode) {
+    qe_state restore;
+    const std::string fn = qe_file(data);
+    fprintf(stderr, "\n%-8s %-9s  old: %8.2f ms", name,
+            mode == QE_BINNING ? "binning" : "quantize",
+            qe_time<T,U>(fn, data.size(), mode, true));
+    qe_threads(1);
+    fprintf(stderr, "  new, 1 thread: %8.2f ms",
+            qe_time<T,U>(fn, data.size(), mode, false));
+    qe_threads(restore.threads);
+    fprintf(stderr, "  new, max. threads: %8.2f ms",
+            qe_time<T,U>(fn, data.size(), mode, false));
+    remove(fn.c_str());
+  }
+}
+
+class QuantizeEngineTests : public CxxTest::TestSuite {
+public:
+  void test_float() {
+    const std::vector<float> data = qe_scan<float>(300000, -1.5, 2.5);
+    qe_compare<float, uint16_t>(data, QE_BINNING, true);
+    qe_compare<float, uint16_t>(data, QE_QUANTIZE, true);
+    qe_compare<float, uint8_t>(data, QE_QUANTIZE, true);
+  }
+  void test_float_levels() {
+    // few enough values for binning, to 8 and to 16 bit
+    qe_compare<float, uint16_t>(qe_levels<float>(200000, 100, -3.0, 0.37),
+                                QE_BINNING, true);
+    qe_compare<float, uint16_t>(qe_levels<float>(200000, 3000, 0.0, 0.01),
+                                QE_BINNING, true);
+  }
+  void test_double() {
+    qe_compare<double, uint16_t>(qe_scan<double>(200000, 1e3, 1e5),
+                                 QE_BINNING, true);
+    qe_compare<double, uint16_t>(qe_levels<double>(200000, 500, -1.0, 0.25),
+                                 QE_BINNING, true);
+  }
+  void test_int16() {
+    const std::vector<int16_t> data = qe_scan<int16_t>(300000, -1024, 3071);
+    qe_compare<int16_t, uint16_t>(data, QE_QUANTIZE, true);
+    qe_compare<int16_t, uint8_t>(data, QE_QUANTIZE, true);
+  }
+  void test_uint16() {
+    // fits into 12 bits: nothing to do, but the bins are counted
+    qe_compare<uint16_t, uint16_t>(qe_scan<uint16_t>(200000, 0, 4000),
+                                   QE_QUANTIZE, false);
+    qe_compare<uint16_t, uint16_t>(qe_scan<uint16_t>(200000, 100, 60000),
+                                   QE_QUANTIZE, true);
+    qe_compare<uint16_t, uint8_t>(qe_levels<uint16_t>(200000, 200, 1000, 3),
+                                  QE_BINNING, true);
+  }
+  void test_int32() {
+    qe_compare<int32_t, uint16_t>(qe_scan<int32_t>(300000, -100000, 900000),
+                                  QE_QUANTIZE, true);
+  }
+  void test_uint32() {
+    qe_compare<uint32_t, uint16_t>(qe_scan<uint32_t>(300000, 10, 4e9),
+                                   QE_QUANTIZE, true);
+    qe_compare<uint32_t, uint8_t>(qe_levels<uint32_t>(200000, 77, 5, 1000),
+                                  QE_BINNING, true);
+  }
+  void test_int64() {
+    qe_compare<int64_t, uint16_t>(qe_scan<int64_t>(200000, -1e12, 1e12),
+                                  QE_QUANTIZE, true);
+    qe_compare<uint64_t, uint8_t>(qe_levels<uint64_t>(200000, 250, 1e15, 3),
+                                  QE_BINNING, true);
+  }
+  void test_kernels() {
+    qe_state restore;
+    qe_kernels(SIMD_SCALAR);
+    qe_kernels(SIMD_SSE2);
+    qe_kernels(SIMD_AVX2);
+  }
+  // really a benchmark: 8M values, float and 32 bit integer scans.
+  void test_bench() {
+    const size_t n = size_t(1) << 23;
+    qe_bench<float, uint16_t>("float", qe_scan<float>(n, -1.5, 2.5),
+                              QE_BINNING);
+    qe_bench<float, uint16_t>("float", qe_levels<float>(n, 1000, 0.0, 0.5),
+                              QE_BINNING);
+    qe_bench<uint32_t, uint16_t>("uint32", qe_scan<uint32_t>(n, 10, 4e9),
+                                 QE_QUANTIZE);
+    qe_bench<int16_t, uint16_t>("int16", qe_scan<int16_t>(n, -1024, 3071),
+                                QE_QUANTIZE);
+    fprintf(stderr, "\n");
+  }
+};
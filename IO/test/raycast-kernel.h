@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/Timer.h"
+#include "Basics/Vectors.h"
+#include "Renderer/CPU/RaycastKernel.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
+
+using namespace tuvok;
+using namespace VolumeTools;
+
+namespace {
+  // restores the SIMD level when a test is done
+  struct rk_simd_level {
+    rk_simd_level() : old(GetSIMDLevel()) {}
+    ~rk_simd_level() { SetSIMDLevel(old); }
+    SIMDLevel old;
+  };
+
+  // a volume of n^3 voxels, centers from -0.5 to 0.5, cut into bricks of
+  // (up to) 'core' voxels with one voxel of overlap, like the data sets do
+  struct rk_volume {
+    rk_volume(size_t n_, float (*f)(float, float, float)) : n(n_),
+                                                             data(n*n*n) {
+      for(size_t z=0; z < n; ++z) {
+        for(size_t y=0; y < n; ++y) {
+          for(size_t x=0; x < n; ++x) {
+            data[(z*n + y)*n + x] = f(pos(x), pos(y), pos(z));
+          }
+        }
+      }
+    }
+
+    float pos(size_t i) const { return float(i) / float(n-1) - 0.5f; }
+
+    std::vector<RaycastBrick> bricks(size_t core) {
+      storage.clear();
+      std::vector<RaycastBrick> rv;
+      std::vector<size_t> starts;
+      for(size_t s=0; s+1 < n; s += core) { starts.push_back(s); }
+      storage.reserve(starts.size()*starts.size()*starts.size());
+      for(size_t bz=0; bz < starts.size(); ++bz) {
+        for(size_t by=0; by < starts.size(); ++by) {
+          for(size_t bx=0; bx < starts.size(); ++bx) {
+            const size_t s[3] = { starts[bx], starts[by], starts[bz] };
+            size_t lo[3], hi[3];
+            RaycastBrick b;
+            for(size_t i=0; i < 3; ++i) {
+              const size_t e = std::min(s[i] + core, n-1);
+              lo[i] = s[i] > 0 ? s[i]-1 : 0;
+              hi[i] = std::min(e+1, n-1);
+              const float count = float(hi[i] - lo[i] + 1);
+              b.vVoxelCount[i] = unsigned(count);
+              b.vMin[i] = pos(s[i]);
+              b.vMax[i] = pos(e);
+              b.vTexcoordsMin[i] = (float(s[i] - lo[i]) + 0.5f) / count;
+              b.vTexcoordsMax[i] = (float(e - lo[i]) + 0.5f) / count;
+            }
+            storage.push_back(std::vector<float>());
+            std::vector<float>& v = storage.back();
+            for(size_t z=lo[2]; z <= hi[2]; ++z) {
+              for(size_t y=lo[1]; y <= hi[1]; ++y) {
+                for(size_t x=lo[0]; x <= hi[0]; ++x) {
+                  v.push_back(data[(z*n + y)*n + x]);
+                }
+              }
+            }
+            b.pData = &v[0];
+            rv.push_back(b);
+          }
+        }
+      }
+      // front to back, for the camera of rk_params
+      std::sort(rv.begin(), rv.end(), rk_closer());
+      return rv;
+    }
+
+    struct rk_closer {
+      bool operator()(const RaycastBrick& a, const RaycastBrick& b) const {
+        const FLOATVECTOR3 eye(0.3f, 0.4f, 1.6f);
+        return ((a.vMin + a.vMax) * 0.5f - eye).length() <
+               ((b.vMin + b.vMax) * 0.5f - eye).length();
+      }
+    };
+
+    // the brick's value range
+    void range(const RaycastBrick& b, double& fMin, double& fMax) const {
+      const size_t count = size_t(b.vVoxelCount.volume());
+      fMin = fMax = b.pData[0];
+      for(size_t i=1; i < count; ++i) {
+        fMin = std::min<double>(fMin, b.pData[i]);
+        fMax = std::max<double>(fMax, b.pData[i]);
+      }
+    }
+
+    size_t n;
+    std::vector<float> data;
+    std::vector<std::vector<float>> storage;
+  };
+
+  float rk_sphere(float x, float y, float z) {
+    return std::sqrt(x*x + y*y + z*z);
+  }
+  float rk_ball(float x, float y, float z) {
+    return 1.0f - rk_sphere(x, y, z);
+  }
+  float rk_waves(float x, float y, float z) {
+    return 127.5f + 127.5f * std::sin(9.0f*x) * std::cos(7.0f*y + 3.0f*z);
+  }
+
+  // looking at the volume from slightly off the z axis
+  RaycastParams rk_params(RaycastParams::Mode mode, unsigned size) {
+    RaycastParams p;
+    p.eMode = mode;
+    p.vImageSize = UINTVECTOR2(size, size);
+    FLOATMATRIX4 mView, mProjection;
+    mView.BuildLookAt(FLOATVECTOR3(0.3f, 0.4f, 1.6f), FLOATVECTOR3(0, 0, 0),
+                      FLOATVECTOR3(0, 1, 0));
+    mProjection.Perspective(50.0f, 1.0f, 0.1f, 10.0f);
+    p.mInvViewProjection = (mView * mProjection).inverse();
+    p.fStepSize = 0.005f;
+
+    // a 256 entry ramp, transparent below 64
+    std::vector<unsigned char> rgba(256*4);
+    for(size_t i=0; i < 256; ++i) {
+      rgba[i*4+0] = (unsigned char)(i);
+      rgba[i*4+1] = (unsigned char)(255-i);
+      rgba[i*4+2] = 128;
+      rgba[i*4+3] = (unsigned char)(i < 64 ? 0 : i/4);
+    }
+    if(mode == RaycastParams::RC_2DTRANS) {
+      // four rows: the steeper the gradient, the more opaque
+      std::vector<unsigned char> rgba2(rgba.size()*4);
+      for(size_t row=0; row < 4; ++row) {
+        for(size_t i=0; i < rgba.size(); ++i) {
+          rgba2[row*rgba.size() + i] = (i % 4 == 3) ?
+            (unsigned char)(rgba[i] * (4-row) / 4) : rgba[i];
+        }
+      }
+      SetTransferFunction(p, rgba2, UINTVECTOR2(256, 4), 1.0f);
+      p.fGradientScale = 1.0f / 40.0f;
+    } else {
+      SetTransferFunction(p, rgba, UINTVECTOR2(256, 1), 1.0f);
+    }
+    p.fTFScale = 1.0f;
+    p.fIsovalue = 0.5f;
+    p.vIsoColor = FLOATVECTOR3(0.8f, 0.6f, 0.2f);
+    p.vLightDir = FLOATVECTOR3(0.0f, 0.0f, -1.0f);
+    return p;
+  }
+
+  std::vector<FLOATVECTOR4> rk_render(const RaycastParams& p,
+                                      const std::vector<RaycastBrick>& b) {
+    std::vector<FLOATVECTOR4> image(p.vImageSize.area(),
+                                    FLOATVECTOR4(0, 0, 0, 0));
+    Raycast(p, b, image);
+    return image;
+  }
+
+  float rk_max_diff(const std::vector<FLOATVECTOR4>& a,
+                    const std::vector<FLOATVECTOR4>& b) {
+    float d = 0.0f;
+    for(size_t i=0; i < a.size(); ++i) {
+      for(size_t c=0; c < 4; ++c) {
+        d = std::max(d, std::fabs(a[i][c] - b[i][c]));
+      }
+    }
+    return d;
+  }
+
+  size_t rk_covered(const std::vector<FLOATVECTOR4>& image) {
+    size_t n = 0;
+    for(size_t i=0; i < image.size(); ++i) { n += image[i].w > 0.0f; }
+    return n;
+  }
+
+  // all instruction sets run the same arithmetic
+  void rk_compare_levels(const RaycastParams& p,
+                         const std::vector<RaycastBrick>& b) {
+    rk_simd_level restore;
+    SetSIMDLevel(SIMD_SCALAR);
+    const std::vector<FLOATVECTOR4> ref = rk_render(p, b);
+    TS_ASSERT_LESS_THAN(size_t(0), rk_covered(ref));
+    const SIMDLevel levels[] = { SIMD_SSE2, SIMD_AVX2 };
+    for(size_t l=0; l < 2 && levels[l] <= DetectSIMDLevel(); ++l) {
+      SetSIMDLevel(levels[l]);
+      TS_ASSERT_LESS_THAN(rk_max_diff(ref, rk_render(p, b)), 1e-5f);
+    }
+  }
+
+  double rk_time(SIMDLevel level, const RaycastParams& p,
+                 const std::vector<RaycastBrick>& b) {
+    SetSIMDLevel(level);
+    Timer t; t.Start();
+    for(size_t rep=0; rep < 2; ++rep) { rk_render(p, b); }
+    return t.Elapsed() / 2;
+  }
+}
+
+class RaycastKernelTests : public CxxTest::TestSuite {
+public:
+  void test_simd_1d() {
+    rk_volume vol(33, rk_waves);
+    rk_compare_levels(rk_params(RaycastParams::RC_1DTRANS, 61),
+                      vol.bricks(16));
+  }
+
+  void test_simd_1d_lit() {
+    rk_volume vol(33, rk_waves);
+    RaycastParams p = rk_params(RaycastParams::RC_1DTRANS, 61);
+    p.bLighting = true;
+    rk_compare_levels(p, vol.bricks(16));
+  }
+
+  void test_simd_2d() {
+    rk_volume vol(33, rk_waves);
+    rk_compare_levels(rk_params(RaycastParams::RC_2DTRANS, 61),
+                      vol.bricks(16));
+  }
+
+  void test_simd_iso() {
+    rk_volume vol(33, rk_ball);
+    RaycastParams p = rk_params(RaycastParams::RC_ISOSURFACE, 61);
+    p.fIsovalue = 0.7f;
+    rk_compare_levels(p, vol.bricks(16));
+  }
+
+  // samples are placed along the ray independently of the bricks, so
+  // cutting the volume up changes nothing but rounding
+  void test_seamless_bricks() {
+    rk_volume vol(33, rk_waves);
+    RaycastParams p = rk_params(RaycastParams::RC_1DTRANS, 48);
+    p.bLighting = true;
+    const std::vector<FLOATVECTOR4> whole = rk_render(p, vol.bricks(32));
+    TS_ASSERT_LESS_THAN(rk_max_diff(whole, rk_render(p, vol.bricks(8))),
+                        1e-3f);
+  }
+
+  // skipping bricks which cannot be seen changes nothing
+  void test_empty_space_skipping() {
+    rk_volume vol(33, rk_sphere);
+    RaycastParams p = rk_params(RaycastParams::RC_1DTRANS, 48);
+    // only distances above 0.32 are visible: data * 200 >= 64
+    p.fTFScale = 200.0f;
+    const std::vector<RaycastBrick> all = vol.bricks(4);
+    std::vector<RaycastBrick> visible;
+    for(size_t i=0; i < all.size(); ++i) {
+      double fMin, fMax;
+      vol.range(all[i], fMin, fMax);
+      if(RaycastVisible(p, fMin, fMax)) { visible.push_back(all[i]); }
+    }
+    TS_ASSERT_LESS_THAN(visible.size(), all.size());
+    TS_ASSERT_LESS_THAN(size_t(0), visible.size());
+    const std::vector<FLOATVECTOR4> ref = rk_render(p, all);
+    TS_ASSERT_LESS_THAN(size_t(0), rk_covered(ref));
+    TS_ASSERT_EQUALS(rk_max_diff(ref, rk_render(p, visible)), 0.0f);
+  }
+
+  void test_visible() {
+    RaycastParams p = rk_params(RaycastParams::RC_1DTRANS, 4);
+    TS_ASSERT(!RaycastVisible(p, 0.0, 50.0));
+    TS_ASSERT(RaycastVisible(p, 0.0, 64.0));
+    TS_ASSERT(RaycastVisible(p, 100.0, 300.0));
+    TS_ASSERT(!RaycastVisible(p, -100.0, -1.0));
+    p.fTFScale = 0.5f;
+    TS_ASSERT(!RaycastVisible(p, 0.0, 100.0));
+    TS_ASSERT(RaycastVisible(p, 0.0, 140.0));
+
+    p.eMode = RaycastParams::RC_ISOSURFACE;
+    TS_ASSERT(RaycastVisible(p, 0.1, 0.5));
+    TS_ASSERT(!RaycastVisible(p, 0.1, 0.49));
+  }
+
+  // the isosurface is a ball of radius 0.3 in the middle of the image
+  void test_iso_sphere() {
+    rk_volume vol(33, rk_ball);
+    RaycastParams p = rk_params(RaycastParams::RC_ISOSURFACE, 64);
+    p.fIsovalue = 0.7f;
+    std::vector<FLOATVECTOR4> image = rk_render(p, vol.bricks(16));
+    TS_ASSERT_EQUALS(image[32*64 + 32].w, 1.0f);
+    TS_ASSERT_EQUALS(image[0].w, 0.0f);
+    // rays through the volume which miss the ball
+    TS_ASSERT_EQUALS(image[32*64 + 4].w, 0.0f);
+    TS_ASSERT_EQUALS(image[4*64 + 32].w, 0.0f);
+    // shaded with the isosurface color
+    TS_ASSERT_LESS_THAN(0.0f, image[32*64 + 32].x);
+    TS_ASSERT_LESS_THAN(image[32*64 + 32].z, image[32*64 + 32].x);
+  }
+
+  // an opaque function stops every ray at the first sample
+  void test_opaque() {
+    rk_volume vol(17, rk_waves);
+    RaycastParams p = rk_params(RaycastParams::RC_1DTRANS, 32);
+    std::vector<unsigned char> rgba(256*4, 255);
+    SetTransferFunction(p, rgba, UINTVECTOR2(256, 1), 1.0f);
+    std::vector<FLOATVECTOR4> image = rk_render(p, vol.bricks(8));
+    TS_ASSERT_EQUALS(image[16*32 + 16], FLOATVECTOR4(1, 1, 1, 1));
+    TS_ASSERT_EQUALS(image[0], FLOATVECTOR4(0, 0, 0, 0));
+
+    // and a transparent one leaves the image alone
+    std::fill(rgba.begin(), rgba.end(), 0);
+    SetTransferFunction(p, rgba, UINTVECTOR2(256, 1), 1.0f);
+    image.assign(image.size(), FLOATVECTOR4(0.25f, 0.5f, 0.0f, 0.5f));
+    Raycast(p, vol.bricks(8), image);
+    TS_ASSERT_EQUALS(image[16*32 + 16], FLOATVECTOR4(0.25f, 0.5f, 0, 0.5f));
+  }
+
+  // this is really a benchmark: one 256^2 frame of a 128^3 volume in
+  // bricks of 32^3, scalar against whatever the CPU supports
+  void test_bench() {
+    rk_simd_level restore;
+    rk_volume vol(129, rk_waves);
+    const std::vector<RaycastBrick> bricks = vol.bricks(32);
+    const char* modes[] = { "1D", "1D lit", "2D", "iso" };
+    for(size_t m=0; m < 4; ++m) {
+      RaycastParams p = rk_params(
+        m == 3 ? RaycastParams::RC_ISOSURFACE :
+        m == 2 ? RaycastParams::RC_2DTRANS : RaycastParams::RC_1DTRANS, 256
+      );
+      p.bLighting = m == 1;
+      if(m == 3) { p.fIsovalue = 200.0f; }
+      const SIMDLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+      const char* names[] = { "scalar", "sse2", "avx2" };
+      fprintf(stderr, "\n%-7s", modes[m]);
+      for(size_t l=0; l < 3 && levels[l] <= DetectSIMDLevel(); ++l) {
+        fprintf(stderr, "  %s: %8.2f ms", names[l],
+                rk_time(levels[l], p, bricks));
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+};
@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <fstream>
+#include <thread>
 #include <cxxtest/TestSuite.h>
 #include "Basics/SysTools.h"
+#include "Basics/Timer.h"
 #include "Controller/Controller.h"
+#include "BrickBuffer.h"
 #include "DynamicBrickingDS.h"
 #include "RAWConverter.h"
 #include "uvfDataset.h"
@@ -273,6 +278,110 @@ void tdata_half_split() {
   verify_half_split(dynamic);
 }
 
+// the zero-copy buffer interface must give the same data as GetBrick.
+static void verify_buffer(DynamicBrickingDS& dynamic, const BrickKey& bk) {
+  std::vector<uint8_t> d;
+  TS_ASSERT(dynamic.GetBrick(bk, d));
+  std::shared_ptr<const BrickBuffer> buf = dynamic.GetBrickBuffer(bk);
+  TS_ASSERT(buf);
+  if(!buf) { return; }
+  TS_ASSERT(buf->holds<uint8_t>());
+  TS_ASSERT_EQUALS(buf->size(), d.size());
+  TS_ASSERT(std::equal(d.begin(), d.end(), buf->as<uint8_t>()));
+}
+void tbrick_buffer() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  {
+    DynamicBrickingDS dynamic(ds, {{16,16,16}}, cacheBytes);
+    verify_buffer(dynamic, BrickKey(0,0,0));
+    // a pinned buffer must survive the cache going away underneath it.
+    std::shared_ptr<const BrickBuffer> buf =
+      dynamic.GetBrickBuffer(BrickKey(0,0,0));
+    std::vector<uint8_t> d(buf->as<uint8_t>(), buf->as<uint8_t>()+buf->size());
+    dynamic.Clear();
+    TS_ASSERT(std::equal(d.begin(), d.end(), buf->as<uint8_t>()));
+  }
+  {
+    DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
+    verify_buffer(dynamic, BrickKey(0,0,0));
+    verify_buffer(dynamic, BrickKey(0,0,1));
+  }
+  { // without a cache we must still get valid data.
+    DynamicBrickingDS dynamic(ds, {{16,16,16}}, 0);
+    verify_buffer(dynamic, BrickKey(0,0,0));
+  }
+}
+
+// bricks read ahead must be the same as bricks read on demand.
+void tprefetch() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  std::vector<BrickKey> keys;
+  for(auto b = ds->BricksBegin(); b != ds->BricksEnd(); ++b) {
+    keys.push_back(b->first);
+  }
+  std::vector<std::vector<uint8_t>> expected(keys.size());
+  for(size_t i=0; i < keys.size(); ++i) {
+    TS_ASSERT(ds->GetBrick(keys[i], expected[i]));
+  }
+
+  TS_ASSERT(!ds->IsBrickInMemory(keys[0]));
+  ds->SetPrefetchCache(1024*1024, 2);
+  ds->Prefetch(keys);
+  // asking does not load anything, so wait for the readers.
+  for(size_t i=0; i < keys.size(); ++i) {
+    for(size_t tries=0; tries < 500 && !ds->IsBrickInMemory(keys[i]);
+        ++tries) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    TS_ASSERT(ds->IsBrickInMemory(keys[i]));
+  }
+  for(size_t i=0; i < keys.size(); ++i) {
+    std::vector<uint8_t> d;
+    TS_ASSERT(ds->GetBrick(keys[i], d));
+    TS_ASSERT(d == expected[i]);
+    std::shared_ptr<const BrickBuffer> buf = ds->GetBrickBuffer(keys[i]);
+    TS_ASSERT(buf);
+    if(!buf) { continue; }
+    TS_ASSERT_EQUALS(buf->bytes(), expected[i].size());
+    const uint8_t* raw = static_cast<const uint8_t*>(buf->data());
+    TS_ASSERT(std::equal(expected[i].begin(), expected[i].end(), raw));
+  }
+  ds->SetPrefetchCache(0);
+  TS_ASSERT(!ds->IsBrickInMemory(keys[0]));
+}
+
+// bricks from a mapped file must be the same as bricks read from the file,
+// and stay valid after the file is unmapped.
+void tmapped() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  std::vector<BrickKey> keys;
+  for(auto b = ds->BricksBegin(); b != ds->BricksEnd(); ++b) {
+    keys.push_back(b->first);
+  }
+  std::vector<std::vector<uint8_t>> expected(keys.size());
+  for(size_t i=0; i < keys.size(); ++i) {
+    TS_ASSERT(ds->GetBrick(keys[i], expected[i]));
+  }
+
+  TS_ASSERT(ds->SetMemoryMapping(true));
+  ds->Prefetch(keys);
+  std::vector<std::shared_ptr<const BrickBuffer>> bufs;
+  for(size_t i=0; i < keys.size(); ++i) {
+    std::vector<uint8_t> d;
+    TS_ASSERT(ds->GetBrick(keys[i], d));
+    TS_ASSERT(d == expected[i]);
+    bufs.push_back(ds->GetBrickBuffer(keys[i]));
+  }
+  TS_ASSERT(ds->SetMemoryMapping(false));
+  for(size_t i=0; i < keys.size(); ++i) {
+    TS_ASSERT(bufs[i]);
+    if(!bufs[i]) { continue; }
+    TS_ASSERT_EQUALS(bufs[i]->bytes(), expected[i].size());
+    const uint8_t* raw = static_cast<const uint8_t*>(bufs[i]->data());
+    TS_ASSERT(std::equal(expected[i].begin(), expected[i].end(), raw));
+  }
+}
+
 // tests GetBrickVoxelCount API.
 void tvoxel_count() {
   std::shared_ptr<UVFDataset> ds = mk8x8testdata();
@@ -415,6 +524,33 @@ void tminmax_dynamic() {
   TS_ASSERT_DELTA(mm.maxScalar, 63.0, 0.001);
 }
 
+// min/maxes are kept in an index file; a second instance should find them
+// there instead of computing them again.
+void tminmax_index() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  std::vector<MinMaxBlock> first;
+  {
+    DynamicBrickingDS dynamic(ds, {{16,8,16}}, cacheBytes,
+                              DynamicBrickingDS::MM_DYNAMIC);
+    for(auto b=dynamic.BricksBegin(); b != dynamic.BricksEnd(); ++b) {
+      first.push_back(dynamic.MaxMinForKey(b->first));
+    }
+  }
+  DynamicBrickingDS dynamic(ds, {{16,8,16}}, cacheBytes,
+                            DynamicBrickingDS::MM_DYNAMIC);
+  size_t i=0;
+  for(auto b=dynamic.BricksBegin(); b != dynamic.BricksEnd(); ++b, ++i) {
+    const MinMaxBlock mm = dynamic.MaxMinForKey(b->first);
+    TS_ASSERT_EQUALS(mm.minScalar, first[i].minScalar);
+    TS_ASSERT_EQUALS(mm.maxScalar, first[i].maxScalar);
+    TS_ASSERT_EQUALS(mm.minGradient, first[i].minGradient);
+    TS_ASSERT_EQUALS(mm.maxGradient, first[i].maxGradient);
+    TS_ASSERT_LESS_THAN_EQUALS(0.0, mm.minGradient);
+    TS_ASSERT_LESS_THAN_EQUALS(mm.minGradient, mm.maxGradient);
+  }
+  TS_ASSERT_EQUALS(i, first.size());
+}
+
 void tcache_disable() {
   std::shared_ptr<UVFDataset> ds = mk8x8testdata();
   DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
@@ -455,6 +591,59 @@ void rmi_bench() {
 #endif
 }
 
+// N threads hammering GetBrick at the same time.  This is really a
+// benchmark, but we also make sure every thread sees the same data.
+void tcontention_bench() {
+  if(!check_for_engine()) { TS_FAIL("need engine for this test"); return; }
+  std::shared_ptr<UVFDataset> ds(new UVFDataset("engine.uvf", 256, false,
+                                                false));
+  // a cache too small for everything, so that we see evictions, too.
+  DynamicBrickingDS dynamic(ds, {{32,32,32}}, 1024U*1024U*8U,
+                            DynamicBrickingDS::MM_SOURCE);
+
+  std::vector<BrickKey> keys;
+  for(auto b=dynamic.BricksBegin(); b != dynamic.BricksEnd(); ++b) {
+    keys.push_back(b->first);
+  }
+  // reference answer: checksum of every brick, computed serially.
+  std::vector<uint64_t> sums(keys.size(), 0);
+  {
+    std::vector<uint8_t> data;
+    for(size_t i=0; i < keys.size(); ++i) {
+      dynamic.GetBrick(keys[i], data);
+      for(auto v=data.cbegin(); v != data.cend(); ++v) { sums[i] += *v; }
+    }
+  }
+
+  const size_t n_threads = std::max(2U, std::thread::hardware_concurrency());
+  const size_t reps = 8;
+  std::vector<size_t> errors(n_threads, 0);
+  Timer t; t.Start();
+  std::vector<std::thread> threads;
+  for(size_t th=0; th < n_threads; ++th) {
+    threads.push_back(std::thread([&, th]() {
+      std::vector<uint8_t> data;
+      // every thread walks the bricks in a different order.
+      for(size_t r=0; r < reps; ++r) {
+        for(size_t j=0; j < keys.size(); ++j) {
+          const size_t i = (j*(th+1) + r) % keys.size();
+          if(!dynamic.GetBrick(keys[i], data)) { ++errors[th]; continue; }
+          uint64_t sum = 0;
+          for(auto v=data.cbegin(); v != data.cend(); ++v) { sum += *v; }
+          if(sum != sums[i]) { ++errors[th]; }
+        }
+      }
+    }));
+  }
+  for(auto th=threads.begin(); th != threads.end(); ++th) { th->join(); }
+  const double ms = t.Elapsed();
+  for(size_t th=0; th < n_threads; ++th) { TS_ASSERT_EQUALS(errors[th], 0U); }
+  fprintf(stderr, "\n%u threads, %u GetBrick calls: %g ms (%g bricks/s)\n",
+          static_cast<unsigned>(n_threads),
+          static_cast<unsigned>(n_threads*reps*keys.size()), ms,
+          (n_threads*reps*keys.size()) / (ms/1000.0));
+}
+
 void trescale() {
   std::shared_ptr<UVFDataset> ds = mk8x8testdata();
   DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
@@ -513,6 +702,9 @@ public:
   void test_domain_size() { tdomain_size(); }
   void test_data_simple() { tdata_simple(); }
   void test_data_half_split() { tdata_half_split(); }
+  void test_brick_buffer() { tbrick_buffer(); }
+  void test_prefetch() { tprefetch(); }
+  void test_mapped() { tmapped(); }
   void test_voxel_count() { tvoxel_count(); }
   void test_metadata() { tmetadata(); }
   void test_real() { trealdata(); }
@@ -521,8 +713,10 @@ public:
   void test_brick_sizes() { tbsizes(); }
   void test_precompute() { tprecompute(); }
   void test_minmax_dynamic() { tminmax_dynamic(); }
+  void test_minmax_index() { tminmax_index(); }
   void test_cache_disable() { tcache_disable(); }
   void test_engine_four() { tengine_four(); }
   void test_rmi_bench() { rmi_bench(); }
+  void test_contention_bench() { tcontention_bench(); }
   void test_rescale() { trescale(); }
 };
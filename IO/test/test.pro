@@ -52,7 +52,11 @@ contains(QMAKE_PRL_CONFIG, shared) {
 }
 
 #TEST_HEADERS=quantize.h largefile.h rebricking.h cbi.h bcache.h
-TEST_HEADERS=quantize.h largefile.h rebricking.h bcache.h
+TEST_HEADERS=quantize.h largefile.h rebricking.h bcache.h prefetch.h octree-convert.h \
+  downsample.h histogram.h isosurface.h quantize-engine.h datamerger.h \
+  expression-program.h brick-visibility.h brick-tree.h dicom-scan.h \
+  brick-stats.h brick-residency.h brick-transcode.h raycast-kernel.h \
+  kdtree.h mesh-tools.h
 
 TG_PARAMS=--have-eh --abort-on-fail --no-static-init --error-printer
 alltests.target = alltests.cpp
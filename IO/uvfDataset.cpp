@@ -35,6 +35,9 @@
 #include "Basics/MathTools.h"
 #include "Basics/SysTools.h"
 #include "Controller/Controller.h"
+#include "BrickBuffer.h"
+#include "BrickCache.h"
+#include "BrickPrefetcher.h"
 #include "TuvokIOError.h"
 #include "TuvokSizes.h"
 #include "UVF/UVF.h"
@@ -59,7 +62,9 @@ UVFDataset::UVFDataset(const std::string& strFilename,
   m_pDatasetFile(NULL),
   m_strFilename(strFilename),
   m_CachedRange(make_pair(+1,-1)),
-  m_iMaxAcceptableBricksize(iMaxAcceptableBricksize)
+  m_iMaxAcceptableBricksize(iMaxAcceptableBricksize),
+  m_iPrefetchBytes(0),
+  m_iPrefetchThreads(0)
 {
   Open(bVerify, false, bMustBeSameVersion);
 }
@@ -71,7 +76,9 @@ UVFDataset::UVFDataset() :
   m_pDatasetFile(NULL),
   m_strFilename(""),
   m_CachedRange(make_pair(+1,-1)),
-  m_iMaxAcceptableBricksize(DEFAULT_BRICKSIZE)
+  m_iMaxAcceptableBricksize(DEFAULT_BRICKSIZE),
+  m_iPrefetchBytes(0),
+  m_iPrefetchThreads(0)
 {
 }
 
@@ -213,9 +220,13 @@ void UVFDataset::Open(bool bVerify, bool bReadWrite, bool bMustBeSameVersion) {
       MESSAGE("%s", stats.str().c_str());*/
     }
   }
+
+  StartPrefetch();
 }
 
 void UVFDataset::Close() {
+  // the workers read from the file we are about to close.
+  StopPrefetch();
   delete m_pDatasetFile;
 
   for(std::vector<Timestep*>::iterator ts = m_timesteps.begin();
@@ -1684,6 +1695,19 @@ std::list<std::string> UVFDataset::Extensions() const
 
 template <class T> bool
 UVFDataset::GetBrickTemplate(const BrickKey& k, std::vector<T>& vData) const
+{
+  std::shared_ptr<const void> cached = PrefetchedBrick(k);
+  if(cached) {
+    const size_t bytes = size_t(BrickBytes(k));
+    vData.resize((bytes + sizeof(T)-1) / sizeof(T));
+    std::memcpy(&vData[0], cached.get(), bytes);
+    return true;
+  }
+  return ReadBrick(k, vData);
+}
+
+template <class T> bool
+UVFDataset::ReadBrick(const BrickKey& k, std::vector<T>& vData) const
 {
   if(m_bToCBlock) {
     const UINT64VECTOR4 coords = KeyToTOCVector(k);
@@ -1708,10 +1732,174 @@ UVFDataset::GetBrickTemplate(const BrickKey& k, std::vector<T>& vData) const
   } else {
     const NDBrickKey& key = this->IndexToVectorKey(k);
     const RDTimestep* ts = static_cast<RDTimestep*>(m_timesteps[key.timestep]);
+    SCOPEDLOCK(m_ReadGuard);
     return ts->GetDB()->GetData(vData, key.lod, key.brick);
   }
 }
 
+uint64_t UVFDataset::BrickBytes(const BrickKey& k) const {
+  return uint64_t(GetBrickVoxelCounts(k).volume()) * GetComponentCount() *
+         (GetBitWidth()/8);
+}
+
+uint64_t UVFDataset::GetBrickStoredBytes(const BrickKey& k) const {
+  if(!m_bToCBlock) { return BrickBytes(k); }
+  const TOCTimestep* ts = static_cast<TOCTimestep*>(
+    m_timesteps[std::get<0>(k)]
+  );
+  return ts->GetDB()->GetBrickInfo(KeyToTOCVector(k)).m_iLength;
+}
+
+bool UVFDataset::IsBrickInMemory(const BrickKey& k) const {
+  // GPUMemMan asks this for every resident brick when it looks for one to
+  // evict, so it must neither wait for bricks being read (unlike
+  // PrefetchedBrick) nor make the asked bricks the most recently used.
+  return m_pPrefetchCache && m_pPrefetchCache->contains(k);
+}
+
+std::shared_ptr<const void>
+UVFDataset::PrefetchedBrick(const BrickKey& k) const {
+  if(!m_pPrefetcher) { return std::shared_ptr<const void>(); }
+  // if a worker is reading this brick right now, wait for it instead of
+  // reading it a second time.
+  m_pPrefetcher->WaitFor(k);
+  return m_pPrefetchCache->acquire(k, uint8_t());
+}
+
+std::shared_ptr<const void>
+UVFDataset::MappedBrick(const BrickKey& k) const {
+  if(!m_bToCBlock) { return std::shared_ptr<const void>(); }
+  const TOCTimestep* ts = static_cast<TOCTimestep*>(
+    m_timesteps[std::get<0>(k)]
+  );
+  return ts->GetDB()->GetMappedData(KeyToTOCVector(k));
+}
+
+void UVFDataset::LoadBrick(const BrickKey& k) const {
+  if(m_pPrefetchCache->acquire(k, uint8_t())) { return; }
+  std::vector<uint8_t> data;
+  if(ReadBrick(k, data)) {
+    m_pPrefetchCache->add(k, data);
+  }
+}
+
+void UVFDataset::StartPrefetch() {
+  if(m_iPrefetchBytes == 0 || m_pPrefetcher || m_timesteps.empty()) {
+    return;
+  }
+  m_pPrefetchCache.reset(new BrickCache(16));
+  m_pPrefetchCache->setCapacity(size_t(m_iPrefetchBytes));
+  m_pPrefetcher.reset(new BrickPrefetcher(
+    [this](const BrickKey& k) { this->LoadBrick(k); }, m_iPrefetchThreads
+  ));
+  MESSAGE("Prefetching up to %llu bytes of bricks with %u threads.",
+          m_iPrefetchBytes, unsigned(m_pPrefetcher->Threads()));
+}
+
+void UVFDataset::StopPrefetch() {
+  // the destructor finishes the loads in flight
+  m_pPrefetcher.reset();
+  m_pPrefetchCache.reset();
+}
+
+void UVFDataset::SetPrefetchCache(uint64_t bytes, unsigned threads) {
+  StopPrefetch();
+  m_iPrefetchBytes = bytes;
+  m_iPrefetchThreads = threads;
+  StartPrefetch();
+}
+
+bool UVFDataset::SetMemoryMapping(bool enable) {
+  if(!m_bToCBlock) { return !enable; }
+  // the prefetch workers read through the mapping, too.
+  StopPrefetch();
+  bool mapped = true;
+  for(auto ts = m_timesteps.cbegin(); ts != m_timesteps.cend(); ++ts) {
+    const TOCBlock* db = static_cast<const TOCTimestep*>(*ts)->GetDB();
+    if(enable) {
+      mapped = db->MapFile() && mapped;
+    } else {
+      db->UnmapFile();
+    }
+  }
+  StartPrefetch();
+  if(enable && !mapped) {
+    WARNING("Could not map %s, reading it instead.", Filename().c_str());
+  }
+  return mapped == enable;
+}
+
+void UVFDataset::Prefetch(const std::vector<BrickKey>& keys) const {
+  // mapped bricks need not be read, asking for them makes the OS page them
+  // in ahead of time.
+  std::vector<BrickKey> unmapped;
+  unmapped.reserve(keys.size());
+  for(auto k = keys.cbegin(); k != keys.cend(); ++k) {
+    if(!MappedBrick(*k)) { unmapped.push_back(*k); }
+  }
+  if(!m_pPrefetcher) { return; }
+  // only ask for what fits: anything beyond that would evict the bricks we
+  // asked for first, which are the ones needed first.
+  std::vector<BrickKey> request;
+  request.reserve(unmapped.size());
+  uint64_t bytes = 0;
+  for(auto k = unmapped.cbegin(); k != unmapped.cend(); ++k) {
+    bytes += BrickBytes(*k);
+    if(bytes > m_iPrefetchBytes) { break; }
+    if(m_pPrefetchCache->lookup(*k, uint8_t()) == NULL) {
+      request.push_back(*k);
+    }
+  }
+  m_pPrefetcher->Request(request);
+}
+
+namespace {
+  template<typename T> std::shared_ptr<const BrickBuffer>
+  view(const std::shared_ptr<const void>& data, uint64_t bytes) {
+    return BrickBuffer::view<T>(data, static_cast<const T*>(data.get()),
+                                size_t(bytes / sizeof(T)));
+  }
+}
+
+std::shared_ptr<const BrickBuffer>
+UVFDataset::GetBrickBuffer(const BrickKey& k) const {
+  // bricks in a mapped file need no copy at all.
+  std::shared_ptr<const void> data = MappedBrick(k);
+  if(!data) {
+    if(!m_pPrefetcher) { return Dataset::GetBrickBuffer(k); }
+
+    // hand out the cached bytes directly; if we have to read the brick, keep
+    // it in the cache so that a pending prefetch of it becomes a no-op.
+    data = PrefetchedBrick(k);
+    if(!data) {
+      std::vector<uint8_t> raw;
+      if(!ReadBrick(k, raw)) { return std::shared_ptr<const BrickBuffer>(); }
+      data = m_pPrefetchCache->store(k, raw);
+    }
+  }
+
+  const uint64_t bytes = BrickBytes(k);
+  const bool is_signed = GetIsSigned();
+  const bool is_float = GetIsFloat();
+  switch(GetBitWidth()) {
+    case 8:
+      return is_signed ? view<int8_t>(data, bytes) : view<uint8_t>(data, bytes);
+    case 16:
+      return is_signed ? view<int16_t>(data, bytes)
+                       : view<uint16_t>(data, bytes);
+    case 32:
+      if(is_float) { return view<float>(data, bytes); }
+      return is_signed ? view<int32_t>(data, bytes)
+                       : view<uint32_t>(data, bytes);
+    case 64:
+      if(is_float) { return view<double>(data, bytes); }
+      break;
+  }
+  T_ERROR("Unsupported data type (%u bit, %s, %s)", GetBitWidth(),
+          is_signed ? "signed" : "unsigned", is_float ? "float" : "integer");
+  return std::shared_ptr<const BrickBuffer>();
+}
+
 bool UVFDataset::GetBrick(const BrickKey& k, std::vector<uint8_t>& vData) const {
   return GetBrickTemplate<uint8_t>(k,vData);
 }
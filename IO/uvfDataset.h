@@ -29,8 +29,10 @@
 #ifndef TUVOK_UVF_DATASET_H
 #define TUVOK_UVF_DATASET_H
 
+#include <memory>
 #include <vector>
 #include "Basics/MinMaxBlock.h"
+#include "Basics/Threads.h"
 #include "Controller/Controller.h"
 #include "UVF/RasterDataBlock.h"
 #include "UVF/MaxMinDataBlock.h"
@@ -55,6 +57,8 @@ class GeometryDataBlock;
 class UVF;
 
 namespace tuvok {
+  class BrickCache;
+  class BrickPrefetcher;
 
   class Timestep  {
   public:
@@ -118,6 +122,26 @@ public:
   virtual bool GetBrick(const BrickKey&, std::vector<int32_t>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<float>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<double>&) const;
+  virtual std::shared_ptr<const BrickBuffer>
+  GetBrickBuffer(const BrickKey&) const;
+  /// the compressed size for octree bricks
+  virtual uint64_t GetBrickStoredBytes(const BrickKey&) const;
+  /// true for bricks in the prefetch cache
+  virtual bool IsBrickInMemory(const BrickKey&) const;
+
+  /// Reads the given bricks ahead of demand, on background threads.
+  /// Needs a prefetch cache, see SetPrefetchCache; a no-op otherwise.
+  virtual void Prefetch(const std::vector<BrickKey>&) const;
+  /// Sets the memory used for bricks read ahead of time.  0 (the default)
+  /// disables prefetching.
+  /// @param threads number of reader threads, 0 picks one per core.
+  void SetPrefetchCache(uint64_t bytes, unsigned threads=0);
+  /// Maps the file into memory.  Bricks stored uncompressed are then read
+  /// without system calls and GetBrickBuffer hands them out in place;
+  /// compressed bricks are read as before.
+  /// @returns false if the file could not be mapped, e.g. for lack of
+  /// address space; the data are read from the file then.
+  bool SetMemoryMapping(bool enable);
 
   /// Acceleration queries.
   virtual bool ContainsData(const BrickKey &k, double isoval) const;
@@ -220,6 +244,19 @@ private:
 
   template <class T> bool GetBrickTemplate(const BrickKey& k,
                                            std::vector<T>& vData) const;
+  /// reads a brick from the file, ignoring the prefetch cache.
+  template <class T> bool ReadBrick(const BrickKey& k,
+                                    std::vector<T>& vData) const;
+  /// size of a brick as stored in the file, in bytes.
+  uint64_t BrickBytes(const BrickKey& k) const;
+  /// the data of a prefetched brick; empty if it is not cached.
+  std::shared_ptr<const void> PrefetchedBrick(const BrickKey& k) const;
+  /// the brick inside the mapped file; empty if it cannot be used in place.
+  std::shared_ptr<const void> MappedBrick(const BrickKey& k) const;
+  /// the prefetch workers' load function.
+  void LoadBrick(const BrickKey& k) const;
+  void StartPrefetch();
+  void StopPrefetch();
 
 private:
   bool                                  m_bToCBlock;
@@ -235,6 +272,14 @@ private:
 
   uint64_t                              m_iMaxAcceptableBricksize;
 
+  uint64_t                              m_iPrefetchBytes;
+  unsigned                              m_iPrefetchThreads;
+  /// bricks read ahead of time, as raw bytes.
+  std::unique_ptr<BrickCache>           m_pPrefetchCache;
+  std::unique_ptr<BrickPrefetcher>      m_pPrefetcher;
+  /// the raster data block path reads from a shared file handle, too.
+  mutable CriticalSection               m_ReadGuard;
+
   FLOATVECTOR3 GetVolCoord(uint64_t pos, const UINT64VECTOR3& domSize) {
     UINT64VECTOR3 domCoords;
 
@@ -851,6 +851,21 @@ brick_distance(const Brick &b, const FLOATMATRIX4 &mat_modelview)
   return fDistance;
 }
 
+void AbstrRenderer::PrefetchBricks(const vector<Brick>& vBrickList) const {
+  // the list is sorted front to back, which is the order we'll need them in.
+  vector<BrickKey> keys;
+  keys.reserve(vBrickList.size());
+  for(auto b = vBrickList.cbegin(); b != vBrickList.cend(); ++b) {
+    if(!b->bIsEmpty) { keys.push_back(b->kBrick); }
+  }
+  m_pDataset->Prefetch(keys);
+  // and have them converted for upload while we render the first ones
+  m_pMasterController->MemMan()->PrepareVolumes(m_pDataset, keys,
+                                                 m_bUseOnlyPowerOfTwo,
+                                                 m_bDownSampleTo8Bits,
+                                                 m_bDisableBorder);
+}
+
 vector<Brick> AbstrRenderer::BuildLeftEyeSubFrameBrickList(
                              const FLOATMATRIX4& modelView,
                              const vector<Brick>& vRightEyeBrickList) const {
@@ -888,8 +903,7 @@ bool AbstrRenderer::RegionNeedsBrick(const RenderRegion& rr,
                                      bool& bIsEmptyButInFrustum) const
 {
   if(rr.is2D()) {
-    return rr.GetUseMIP() ||
-           std::get<1>(key) == m_pDataset->GetLODLevelCount()-1;
+    return RegionNeedsBox(rr, std::get<1>(key), Brick());
   }
 
   FLOATVECTOR3 vScale(float(m_pDataset->GetScale().x),
@@ -904,20 +918,8 @@ bool AbstrRenderer::RegionNeedsBrick(const RenderRegion& rr,
   b.vCenter = bmd.center * vScale;
   b.vVoxelCount = bmd.n_voxels;
 
-  // skip the brick if it is outside the current view frustum
-  if (!m_FrustumCullingLOD.IsVisible(b.vCenter, b.vExtension) ){
-    if(m_bDoStereoRendering && !m_FrustumCullingLOD2.IsVisible(b.vCenter, b.vExtension)) {
-      MESSAGE("Outside view frustum, skipping <%u,%u,%u>",
-              static_cast<unsigned>(std::get<0>(key)),
-              static_cast<unsigned>(std::get<1>(key)),
-              static_cast<unsigned>(std::get<2>(key)));
-      return false;
-    }
-  }
-
-  // skip the brick if the clipping plane removes it.
-  if(m_bClipPlaneOn && Clipped(rr, b)) {
-    MESSAGE("clipped by clip plane: skipping <%u,%u,%u>",
+  if(!RegionNeedsBox(rr, std::get<1>(key), b)) {
+    MESSAGE("Outside view frustum or clipped, skipping <%u,%u,%u>",
             static_cast<unsigned>(std::get<0>(key)),
             static_cast<unsigned>(std::get<1>(key)),
             static_cast<unsigned>(std::get<2>(key)));
@@ -932,6 +934,24 @@ bool AbstrRenderer::RegionNeedsBrick(const RenderRegion& rr,
   return true;
 }
 
+bool AbstrRenderer::RegionNeedsBox(const RenderRegion& rr, size_t lod,
+                                   const Brick& b) const
+{
+  if(rr.is2D()) {
+    return rr.GetUseMIP() || lod == m_pDataset->GetLODLevelCount()-1;
+  }
+
+  // skip the box if it is outside the current view frustum
+  if (!m_FrustumCullingLOD.IsVisible(b.vCenter, b.vExtension) &&
+      m_bDoStereoRendering &&
+      !m_FrustumCullingLOD2.IsVisible(b.vCenter, b.vExtension)) {
+    return false;
+  }
+
+  // skip the box if the clipping plane removes it.
+  return !(m_bClipPlaneOn && Clipped(rr, b));
+}
+
 /// @return true if this brick is clipped by a clipping plane.
 bool AbstrRenderer::Clipped(const RenderRegion& rr, const Brick& b) const
 {
@@ -1029,19 +1049,48 @@ vector<Brick> AbstrRenderer::BuildSubFrameBrickList(bool bUseResidencyAsDistance
                                            FLOATVECTOR3(vDomainSize)/
                                            float(vDomainSize.maxVal());
 
+  // RegionNeedsBrick scales by the domain of the current LoD, so whole
+  // groups of bricks are culled in that space, too.
+  const UINT64VECTOR3 vLODDomainSize =
+    m_pDataset->GetDomainSize(size_t(m_iCurrentLOD));
+  const FLOATVECTOR3 vCullScale = vScale /
+    (vScale * FLOATVECTOR3(vLODDomainSize) /
+     float(vLODDomainSize.maxVal())).maxVal();
+
   vScale /= vDomainSizeCorrectedScale.maxVal();
 
   MESSAGE("Building active brick list from %u active bricks.",
           static_cast<unsigned>(m_pDataset->GetBrickCount(size_t(m_iCurrentLOD),
                                                           m_iTimestep)));
 
-  BrickTable::const_iterator brick = m_pDataset->BricksBegin();
-  for(; brick != m_pDataset->BricksEnd(); ++brick) {
-    // skip over the brick if it's for the wrong timestep or LOD
-    if(std::get<0>(brick->first) != m_iTimestep ||
-       std::get<1>(brick->first) != m_iCurrentLOD) {
-      continue;
+  const size_t iLOD = size_t(m_iCurrentLOD);
+  BrickCuller cull = [&](const FLOATVECTOR3& vCenter,
+                         const FLOATVECTOR3& vExtents) {
+    Brick box;
+    box.vCenter = vCenter * vCullScale;
+    box.vExtension = vExtents * vCullScale;
+    for(auto reg = renderRegions.cbegin(); reg != renderRegions.cend(); ++reg) {
+      if(RegionNeedsBox(**reg, iLOD, box)) { return false; }
     }
+    return true;
+  };
+
+  // the spatial index hands out the bricks front to back as seen from the
+  // eye, so there is nothing left to sort.  "GetFirst" region: see FIXME
+  // below.
+  std::shared_ptr<RenderRegion3D> region3D = GetFirst3DRegion();
+  FLOATVECTOR3 vEye(0,0,0);
+  if(region3D) {
+    vEye = (FLOATVECTOR4(0,0,0,1) * region3D->modelView[0].inverse())
+           .dehomo() / vScale;
+  }
+  std::vector<BrickTable::const_iterator> vBricks;
+  m_pDataset->GetBricksFrontToBack(iLOD, size_t(m_iTimestep), vEye, cull,
+                                   vBricks);
+  vBrickList.reserve(vBricks.size());
+
+  for(auto iter = vBricks.cbegin(); iter != vBricks.cend(); ++iter) {
+    const BrickTable::const_iterator brick = *iter;
     const BrickMD& bmd = brick->second;
     Brick b;
     b.vExtension = bmd.extents * vScale;
@@ -1092,30 +1141,27 @@ vector<Brick> AbstrRenderer::BuildSubFrameBrickList(bool bUseResidencyAsDistance
         } else {
           b.fDistance = 1;
         }
-      } else {
+      } else if(region3D) {
         // compute minimum distance to brick corners (offset
         // slightly to the center to resolve ambiguities)
-        // "GetFirst" region: see FIXME below.
-        b.fDistance = brick_distance(b, GetFirst3DRegion()->modelView[0]);
+        b.fDistance = brick_distance(b, region3D->modelView[0]);
       }
     }
-/*
-MESSAGE("considering brick <%zu,%zu,%zu>", std::get<0>(brick->first),
-            std::get<1>(brick->first), std::get<2>(brick->first));
-            */
 
     // add the brick to the list of active bricks
     vBrickList.push_back(b);
   }
 
-  // depth sort bricks
-
   /// @todo FIXME?: we need to do smarter sorting.  If we've got multiple 3D
   /// regions, they might need different orderings.  However, we want to try to
   /// traverse bricks in a similar order, because the IO will rape us
   /// otherwise.
   /// For now, IV3D doesn't support multiple 3D regions in a single renderer.
-  sort(vBrickList.begin(), vBrickList.end());
+  if (bUseResidencyAsDistanceCriterion) {
+    // resident bricks first; otherwise keep the spatial order
+    std::stable_partition(vBrickList.begin(), vBrickList.end(),
+                          [](const Brick& b) { return b.fDistance == 0; });
+  }
 
   return vBrickList;
 }
@@ -1220,6 +1266,7 @@ void AbstrRenderer::PlanFrame(RenderRegion3D& region) {
       MESSAGE("Building new brick list for LOD %llu...", m_iCurrentLOD);
       m_vCurrentBrickList = BuildSubFrameBrickList();
       MESSAGE("%u bricks made the cut.", uint32_t(m_vCurrentBrickList.size()));
+      PrefetchBricks(m_vCurrentBrickList);
       if (m_bDoStereoRendering) {
         m_vLeftEyeBrickList =
           BuildLeftEyeSubFrameBrickList(region.modelView[1], m_vCurrentBrickList);
@@ -1263,6 +1310,7 @@ void AbstrRenderer::PlanHQMIPFrame(RenderRegion& renderRegion) {
 
   // build new brick todo-list
   m_vCurrentBrickList = BuildSubFrameBrickList(true);
+  PrefetchBricks(m_vCurrentBrickList);
 
   m_iBricksRenderedInThisSubFrame = 0;
 
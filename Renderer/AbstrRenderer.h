@@ -849,6 +849,10 @@ class AbstrRenderer {
     bool RegionNeedsBrick(const RenderRegion& rr, const BrickKey& key,
                           const BrickMD& bmd,
                           bool& bIsEmptyButInFrustum) const;
+    /// @return false if no brick within the given box (center and extension
+    ///         of the Brick) is needed to render the given region
+    bool RegionNeedsBox(const RenderRegion& rr, size_t lod,
+                        const Brick& b) const;
     /// @return true if this brick is clipped by a clipping plane.
     bool Clipped(const RenderRegion&, const Brick&) const;
     /// does the current brick contain relevant data?
@@ -858,6 +862,8 @@ class AbstrRenderer {
                           const FLOATMATRIX4& modelview,
                           const std::vector<Brick>& vRightEyeBrickList
                         ) const;
+    /// asks the dataset to read the (non-empty) bricks of the list ahead.
+    virtual void        PrefetchBricks(const std::vector<Brick>&) const;
     void                CompletedASubframe(RenderRegion* region);
     void                RestartTimer(const size_t iTimerIndex);
     void                RestartTimers();
@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <numeric>
+#include "BrickVisibility.h"
+#include "Basics/TuvokException.h"
+
+namespace tuvok {
+
+namespace {
+  // bricks tested between two polls of the continue predicate
+  const uint32_t iBatchBricks = 1u << 16;
+  // smaller work lists are not worth waking up the other threads for
+  const int iParallelThreshold = 4096;
+
+  // strict weak order that puts NaNs last, where no window edge ends up
+  bool Less(double a, double b) {
+    return a < b || (b != b && a == a);
+  }
+}
+
+BrickVisibility::Window::Window(double fMin, double fMax) :
+  fMin(fMin), fMax(fMax), fMinGradient(0.0), fMaxGradient(0.0),
+  bGradient(false)
+{}
+
+BrickVisibility::Window::Window(double fMin, double fMax,
+                                double fMinGradient, double fMaxGradient) :
+  fMin(fMin), fMax(fMax), fMinGradient(fMinGradient),
+  fMaxGradient(fMaxGradient), bGradient(true)
+{}
+
+BrickVisibility::BrickVisibility(const std::vector<UINTVECTOR3>& vLayouts) :
+  m_vLayouts(vLayouts),
+  m_iBrickCount(0),
+  m_Window(0.0, 0.0),
+  m_bValid(false),
+  m_vCounts(0, 0, 0, 0)
+{
+  m_vLoDOffsets.resize(m_vLayouts.size());
+  for(size_t i=0; i < m_vLayouts.size(); ++i) {
+    m_vLoDOffsets[i] = m_iBrickCount;
+    m_iBrickCount += m_vLayouts[i].volume();
+  }
+  m_vVisible.resize(m_iBrickCount, 0);
+  m_vState.resize(m_iBrickCount, CHILD_EMPTY);
+  m_vQueued.resize(m_iBrickCount, 0);
+  m_vWork.resize(m_vLayouts.size());
+}
+
+void BrickVisibility::SetScalarRanges(std::vector<double> vMin,
+                                      std::vector<double> vMax) {
+  SetRanges(m_Scalar, vMin, vMax);
+}
+
+void BrickVisibility::SetGradientRanges(std::vector<double> vMin,
+                                        std::vector<double> vMax) {
+  SetRanges(m_Gradient, vMin, vMax);
+}
+
+void BrickVisibility::SetRanges(Ranges& r, std::vector<double>& vMin,
+                                std::vector<double>& vMax) {
+  if(vMin.size() != m_iBrickCount || vMax.size() != m_iBrickCount) {
+    throw Exception("Brick range count does not match the brick layout",
+                    _func_, __LINE__);
+  }
+  m_bValid = false;
+  r.vMin.swap(vMin);
+  r.vMax.swap(vMax);
+
+  const std::vector<double>* bounds[2] = { &r.vMin, &r.vMax };
+  std::vector<uint32_t>* ids[2] = { &r.vByMin, &r.vByMax };
+  std::vector<double>* sorted[2] = { &r.vSortedMin, &r.vSortedMax };
+  for(size_t b=0; b < 2; ++b) {
+    const std::vector<double>& v = *bounds[b];
+    std::vector<uint32_t>& by = *ids[b];
+    by.resize(m_iBrickCount);
+    std::iota(by.begin(), by.end(), 0u);
+    std::sort(by.begin(), by.end(),
+              [&v](uint32_t i, uint32_t j) { return Less(v[i], v[j]); });
+    sorted[b]->resize(m_iBrickCount);
+    for(uint32_t i=0; i < m_iBrickCount; ++i) {
+      (*sorted[b])[i] = v[by[i]];
+    }
+  }
+}
+
+bool BrickVisibility::CanUpdate(const Window& window) const {
+  // with a NaN edge the sorted ranges can not tell what flipped
+  return m_bValid && window.bGradient == m_Window.bGradient &&
+         window.fMin == window.fMin && window.fMax == window.fMax &&
+         (!window.bGradient || (window.fMinGradient == window.fMinGradient &&
+                                window.fMaxGradient == window.fMaxGradient));
+}
+
+uint8_t BrickVisibility::Classify(uint32_t iLoD,
+                                  const UINTVECTOR3& vPos) const {
+  const UINTVECTOR3& layout = m_vLayouts[iLoD];
+  const uint32_t iBrickID = m_vLoDOffsets[iLoD] + vPos.x +
+                            layout.x * (vPos.y + layout.y * vPos.z);
+  if(m_vVisible[iBrickID]) { return VISIBLE; }
+  if(iLoD == 0) { return CHILD_EMPTY; }
+
+  const UINTVECTOR3& children = m_vLayouts[iLoD-1];
+  const uint32_t iOffset = m_vLoDOffsets[iLoD-1];
+  const UINTVECTOR3 vBegin = vPos * 2;
+  const UINTVECTOR3 vEnd(std::min(vBegin.x + 2, children.x),
+                         std::min(vBegin.y + 2, children.y),
+                         std::min(vBegin.z + 2, children.z));
+  for(uint32_t z = vBegin.z; z < vEnd.z; ++z) {
+    for(uint32_t y = vBegin.y; y < vEnd.y; ++y) {
+      for(uint32_t x = vBegin.x; x < vEnd.x; ++x) {
+        const uint32_t iChild = iOffset + x + children.x * (y + children.y * z);
+        if(m_vState[iChild] != CHILD_EMPTY) { return EMPTY; }
+      }
+    }
+  }
+  return CHILD_EMPTY;
+}
+
+bool BrickVisibility::Rebuild(const Window& window,
+                              PredicateFunction pContinue) {
+  if(m_Scalar.vMin.empty() ||
+     (window.bGradient && m_Gradient.vMin.empty())) {
+    throw Exception("Brick ranges were not set", _func_, __LINE__);
+  }
+  m_bValid = false;
+  m_Window = window;
+
+  for(uint32_t iStart=0; iStart < m_iBrickCount; iStart += iBatchBricks) {
+    if(pContinue && !pContinue()) { return false; }
+    const int iEnd = int(std::min(m_iBrickCount, iStart + iBatchBricks));
+#pragma omp parallel for schedule(static)
+    for(int i=int(iStart); i < iEnd; ++i) {
+      m_vVisible[i] = Test(uint32_t(i), window) ? 1 : 0;
+    }
+  }
+
+  // bottom-up, every level only reads the finished one below it, so the
+  // rows of one level are independent of each other
+  m_vCounts = UINTVECTOR4(m_iBrickCount, 0, 0, 0);
+  for(uint32_t iLoD=0; iLoD < m_vLayouts.size(); ++iLoD) {
+    const UINTVECTOR3 layout = m_vLayouts[iLoD];
+    const int iRows = int(layout.y * layout.z);
+    const int iBatchRows = int(std::max(1u, iBatchBricks / layout.x));
+    for(int iStart=0; iStart < iRows; iStart += iBatchRows) {
+      if(pContinue && !pContinue()) { return false; }
+      const int iEnd = std::min(iRows, iStart + iBatchRows);
+      int iEmpty = 0;
+      int iChildEmpty = 0;
+#pragma omp parallel for schedule(static) reduction(+:iEmpty,iChildEmpty)
+      for(int row=iStart; row < iEnd; ++row) {
+        const uint32_t y = uint32_t(row) % layout.y;
+        const uint32_t z = uint32_t(row) / layout.y;
+        uint32_t iBrickID = m_vLoDOffsets[iLoD] + uint32_t(row) * layout.x;
+        for(uint32_t x=0; x < layout.x; ++x, ++iBrickID) {
+          const uint8_t s = Classify(iLoD, UINTVECTOR3(x, y, z));
+          m_vState[iBrickID] = s;
+          if(s == EMPTY) { ++iEmpty; }
+          if(s == CHILD_EMPTY) { ++iChildEmpty; }
+        }
+      }
+      if(iLoD == 0) {
+        m_vCounts.w += uint32_t(iChildEmpty);
+      } else {
+        m_vCounts.y += uint32_t(iEmpty);
+        m_vCounts.z += uint32_t(iChildEmpty);
+      }
+    }
+  }
+  m_bValid = true;
+  return true;
+}
+
+void BrickVisibility::Touch(uint32_t iBrickID, const Window& window) {
+  const uint8_t v = Test(iBrickID, window) ? 1 : 0;
+  if(v == m_vVisible[iBrickID]) { return; }
+  m_vVisible[iBrickID] = v;
+  if(!m_vQueued[iBrickID]) {
+    m_vQueued[iBrickID] = 1;
+    const uint32_t iLoD = uint32_t(std::upper_bound(m_vLoDOffsets.begin(),
+                                                    m_vLoDOffsets.end(),
+                                                    iBrickID) -
+                                   m_vLoDOffsets.begin()) - 1;
+    m_vWork[iLoD].push_back(iBrickID);
+  }
+}
+
+void BrickVisibility::Flip(const Ranges& r, double fOldMin, double fOldMax,
+                           double fNewMin, double fNewMax,
+                           const Window& window) {
+  // "max >= fMin" changes for the bricks with a max in [lo, hi)
+  if(fOldMin != fNewMin) {
+    const double lo = std::min(fOldMin, fNewMin);
+    const double hi = std::max(fOldMin, fNewMin);
+    const size_t a = std::lower_bound(r.vSortedMax.begin(), r.vSortedMax.end(),
+                                      lo, Less) - r.vSortedMax.begin();
+    const size_t b = std::lower_bound(r.vSortedMax.begin(), r.vSortedMax.end(),
+                                      hi, Less) - r.vSortedMax.begin();
+    for(size_t i=a; i < b; ++i) { Touch(r.vByMax[i], window); }
+  }
+  // "min <= fMax" changes for the bricks with a min in (lo, hi]
+  if(fOldMax != fNewMax) {
+    const double lo = std::min(fOldMax, fNewMax);
+    const double hi = std::max(fOldMax, fNewMax);
+    const size_t a = std::upper_bound(r.vSortedMin.begin(), r.vSortedMin.end(),
+                                      lo, Less) - r.vSortedMin.begin();
+    const size_t b = std::upper_bound(r.vSortedMin.begin(), r.vSortedMin.end(),
+                                      hi, Less) - r.vSortedMin.begin();
+    for(size_t i=a; i < b; ++i) { Touch(r.vByMin[i], window); }
+  }
+}
+
+void BrickVisibility::Count(uint8_t iOld, uint8_t iNew, uint32_t iLoD) {
+  if(iLoD == 0) {
+    m_vCounts.w -= (iOld == CHILD_EMPTY) ? 1 : 0;
+    m_vCounts.w += (iNew == CHILD_EMPTY) ? 1 : 0;
+  } else {
+    m_vCounts.y -= (iOld == EMPTY) ? 1 : 0;
+    m_vCounts.z -= (iOld == CHILD_EMPTY) ? 1 : 0;
+    m_vCounts.y += (iNew == EMPTY) ? 1 : 0;
+    m_vCounts.z += (iNew == CHILD_EMPTY) ? 1 : 0;
+  }
+}
+
+const std::vector<uint32_t>& BrickVisibility::Update(const Window& window) {
+  m_vChanged.clear();
+  if(!CanUpdate(window)) {
+    Rebuild(window);
+    m_vChanged.resize(m_iBrickCount);
+    std::iota(m_vChanged.begin(), m_vChanged.end(), 0u);
+    return m_vChanged;
+  }
+
+  Flip(m_Scalar, m_Window.fMin, m_Window.fMax, window.fMin, window.fMax,
+       window);
+  if(window.bGradient) {
+    Flip(m_Gradient, m_Window.fMinGradient, m_Window.fMaxGradient,
+         window.fMinGradient, window.fMaxGradient, window);
+  }
+  m_Window = window;
+
+  // the work list of a level holds the bricks that flipped themselves and
+  // the parents of bricks that became or stopped being child empty
+  std::vector<uint8_t> vNew;
+  for(uint32_t iLoD=0; iLoD < m_vLayouts.size(); ++iLoD) {
+    std::vector<uint32_t>& vWork = m_vWork[iLoD];
+    if(vWork.empty()) { continue; }
+    const UINTVECTOR3 layout = m_vLayouts[iLoD];
+    const uint32_t iOffset = m_vLoDOffsets[iLoD];
+    const int iWork = int(vWork.size());
+    vNew.resize(vWork.size());
+#pragma omp parallel for schedule(static) if(iWork > iParallelThreshold)
+    for(int w=0; w < iWork; ++w) {
+      const uint32_t i = vWork[w] - iOffset;
+      vNew[w] = Classify(iLoD, UINTVECTOR3(i % layout.x,
+                                           (i / layout.x) % layout.y,
+                                           i / (layout.x * layout.y)));
+    }
+
+    for(int w=0; w < iWork; ++w) {
+      const uint32_t iBrickID = vWork[w];
+      const uint8_t iOld = m_vState[iBrickID];
+      m_vQueued[iBrickID] = 0;
+      if(iOld == vNew[w]) { continue; }
+      m_vState[iBrickID] = vNew[w];
+      m_vChanged.push_back(iBrickID);
+      Count(iOld, vNew[w], iLoD);
+      if(iLoD+1 < m_vLayouts.size() &&
+         (iOld == CHILD_EMPTY) != (vNew[w] == CHILD_EMPTY)) {
+        const uint32_t i = iBrickID - iOffset;
+        const UINTVECTOR3& parents = m_vLayouts[iLoD+1];
+        const uint32_t iParent = m_vLoDOffsets[iLoD+1] +
+          (i % layout.x) / 2 +
+          parents.x * (((i / layout.x) % layout.y) / 2 +
+                       parents.y * ((i / (layout.x * layout.y)) / 2));
+        if(!m_vQueued[iParent]) {
+          m_vQueued[iParent] = 1;
+          m_vWork[iLoD+1].push_back(iParent);
+        }
+      }
+    }
+    vWork.clear();
+  }
+  return m_vChanged;
+}
+
+} // namespace tuvok
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
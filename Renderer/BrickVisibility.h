@@ -0,0 +1,168 @@
+#pragma once
+
+#ifndef TUVOK_BRICKVISIBILITY_H
+#define TUVOK_BRICKVISIBILITY_H
+
+#include "StdTuvokDefines.h"
+#include <functional>
+#include <vector>
+
+#include "Basics/Vectors.h"
+
+namespace tuvok
+{
+  /** \class BrickVisibility
+   * Visibility and child emptiness of every brick in a brick hierarchy.
+   *
+   * Bricks are numbered like in GLVolumePool: LoD 0 is the finest level and
+   * the bricks of one level follow the ones of the level below in x/y/z
+   * order.  Per-brick min/max values are kept in separate arrays and, for
+   * every bound, in an index sorted by that bound.  A brick is visible if
+   * its value ranges overlap the window; when the window moves, only the
+   * bricks whose bounds lie between the old and the new window edges can
+   * change, and only those and their ancestors are looked at.
+   *
+   * Nothing in here depends on GL, so the class can be tested on its own. */
+  class BrickVisibility
+  {
+  public:
+    enum State {
+      VISIBLE = 0,
+      EMPTY,        ///< not visible, but some child is
+      CHILD_EMPTY   ///< neither the brick nor any of its children is visible
+    };
+
+    /// The value ranges bricks are tested against.
+    struct Window {
+      /// scalar range only (1D transfer functions)
+      Window(double fMin, double fMax);
+      /// scalar and gradient ranges (2D transfer functions)
+      Window(double fMin, double fMax, double fMinGradient,
+             double fMaxGradient);
+
+      double fMin;
+      double fMax;
+      double fMinGradient;
+      double fMaxGradient;
+      bool bGradient;
+    };
+
+    typedef std::function<bool ()> PredicateFunction;
+
+    /// @param vLayouts brick layout of every LoD, finest level first.  Every
+    ///        level must be the previous one halved and rounded up.
+    BrickVisibility(const std::vector<UINTVECTOR3>& vLayouts);
+
+    /// Sets the scalar ranges of all bricks and invalidates the state.
+    void SetScalarRanges(std::vector<double> vMin, std::vector<double> vMax);
+    /// Sets the gradient ranges of all bricks and invalidates the state.
+    void SetGradientRanges(std::vector<double> vMin, std::vector<double> vMax);
+    bool HasGradientRanges() const { return !m_Gradient.vMin.empty(); }
+
+    /// Forgets the current state, so that the next update is a rebuild.
+    void Invalidate() { m_bValid = false; }
+    bool IsValid() const { return m_bValid; }
+    /// @returns true if Update can derive the state for the window from the
+    ///          current one.
+    bool CanUpdate(const Window& window) const;
+
+    /// Recomputes the state of every brick from scratch.  pContinue is
+    /// polled between blocks of work; if it returns false, the state is left
+    /// invalid.
+    /// @returns false if interrupted
+    bool Rebuild(const Window& window,
+                 PredicateFunction pContinue = PredicateFunction());
+    /// Moves the window and recomputes the bricks whose state depends on
+    /// the move; falls back to Rebuild if !CanUpdate(window).
+    /// @returns the bricks whose state changed, in no particular order, or
+    ///          all bricks after a rebuild
+    const std::vector<uint32_t>& Update(const Window& window);
+
+    /// @returns true if the brick overlaps the window, independent of the
+    ///          current state
+    bool Test(uint32_t iBrickID, const Window& window) const {
+      return m_Scalar.vMax[iBrickID] >= window.fMin &&
+             m_Scalar.vMin[iBrickID] <= window.fMax &&
+             (!window.bGradient ||
+              (m_Gradient.vMax[iBrickID] >= window.fMinGradient &&
+               m_Gradient.vMin[iBrickID] <= window.fMaxGradient));
+    }
+
+    State GetState(uint32_t iBrickID) const {
+      return State(m_vState[iBrickID]);
+    }
+    uint32_t GetBrickCount() const { return m_iBrickCount; }
+    uint32_t GetLoDCount() const { return uint32_t(m_vLayouts.size()); }
+    uint32_t GetLoDOffset(uint32_t iLoD) const { return m_vLoDOffsets[iLoD]; }
+
+    /// @returns (brick count, empty inner bricks, child empty inner bricks,
+    ///           empty leaf bricks) of the current state
+    UINTVECTOR4 GetCounts() const { return m_vCounts; }
+
+  private:
+    // min/max of one quantity, and the brick IDs sorted by either bound
+    struct Ranges {
+      std::vector<double> vMin;
+      std::vector<double> vMax;
+      std::vector<double> vSortedMin;
+      std::vector<double> vSortedMax;
+      std::vector<uint32_t> vByMin;
+      std::vector<uint32_t> vByMax;
+    };
+
+    void SetRanges(Ranges& r, std::vector<double>& vMin,
+                   std::vector<double>& vMax);
+    void Flip(const Ranges& r, double fOldMin, double fOldMax,
+              double fNewMin, double fNewMax, const Window& window);
+    void Touch(uint32_t iBrickID, const Window& window);
+    uint8_t Classify(uint32_t iLoD, const UINTVECTOR3& vPos) const;
+    void Count(uint8_t iOld, uint8_t iNew, uint32_t iLoD);
+
+    std::vector<UINTVECTOR3> m_vLayouts;
+    std::vector<uint32_t> m_vLoDOffsets;
+    uint32_t m_iBrickCount;
+
+    Ranges m_Scalar;
+    Ranges m_Gradient;
+
+    std::vector<uint8_t> m_vVisible;
+    std::vector<uint8_t> m_vState;
+    std::vector<uint8_t> m_vQueued;
+    std::vector<std::vector<uint32_t>> m_vWork; // per LoD
+    std::vector<uint32_t> m_vChanged;
+
+    Window m_Window;
+    bool m_bValid;
+    UINTVECTOR4 m_vCounts;
+  };
+
+} // namespace tuvok
+
+#endif // TUVOK_BRICKVISIBILITY_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
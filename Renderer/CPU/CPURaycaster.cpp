@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <stdexcept>
+#include "CPURaycaster.h"
+
+#include "Basics/SysTools.h"
+#include "Controller/Controller.h"
+#include "IO/BrickedDataset.h"
+#include "IO/FileBackedDataset.h"
+#include "IO/IOManager.h"
+#include "IO/TransferFunction1D.h"
+#include "IO/TransferFunction2D.h"
+#include "Renderer/FrameCapture.h"
+#include "Renderer/GPUMemMan/GPUMemMan.h"
+
+namespace tuvok {
+
+namespace {
+  // FrameCapture::SaveImage flips and writes what GL would read back
+  class CPUFrameCapture : public FrameCapture {
+  public:
+    explicit CPUFrameCapture(const CPURaycaster& ren) : m_Ren(ren) {}
+
+    virtual bool CaptureSingleFrame(const std::string& strFilename,
+                                    bool bPreserveTransparency) const {
+      const std::string ext = SysTools::ToLowerCase(
+        SysTools::GetExt(strFilename)
+      );
+      if(ext == "tif" || ext == "tiff") {
+        std::vector<uint16_t> image;
+        m_Ren.GetFrame(image, bPreserveTransparency);
+        if(image.empty()) { return false; }
+        return SaveImage(strFilename, m_Ren.GetFrameSize(), image,
+                         bPreserveTransparency);
+      }
+      std::vector<uint8_t> image;
+      m_Ren.GetFrame(image, bPreserveTransparency);
+      if(image.empty()) { return false; }
+      return SaveImage(strFilename, m_Ren.GetFrameSize(), image,
+                       bPreserveTransparency);
+    }
+
+  private:
+    const CPURaycaster& m_Ren;
+  };
+
+  template<typename T>
+  bool ReadBrick(const Dataset& ds, const BrickKey& key,
+                 std::vector<float>& out) {
+    std::vector<T> data;
+    if(!ds.GetBrick(key, data)) { return false; }
+    out.assign(data.begin(), data.end());
+    return true;
+  }
+
+  bool ReadBrickAsFloat(const Dataset& ds, const BrickKey& key,
+                        std::vector<float>& out) {
+    const bool bSigned = ds.GetIsSigned();
+    switch(ds.GetBitWidth()) {
+      case 8:
+        return bSigned ? ReadBrick<int8_t>(ds, key, out)
+                       : ReadBrick<uint8_t>(ds, key, out);
+      case 16:
+        return bSigned ? ReadBrick<int16_t>(ds, key, out)
+                       : ReadBrick<uint16_t>(ds, key, out);
+      case 32:
+        if(ds.GetIsFloat()) { return ReadBrick<float>(ds, key, out); }
+        return bSigned ? ReadBrick<int32_t>(ds, key, out)
+                       : ReadBrick<uint32_t>(ds, key, out);
+      case 64:
+        if(ds.GetIsFloat()) { return ReadBrick<double>(ds, key, out); }
+        break;
+    }
+    T_ERROR("Unsupported data type: %u bit %s", ds.GetBitWidth(),
+            ds.GetIsFloat() ? "float" : "integer");
+    return false;
+  }
+}
+
+CPURaycaster::CPURaycaster(MasterController* pMasterController,
+                           bool bUseOnlyPowerOfTwo,
+                           bool bDownSampleTo8Bits,
+                           bool bDisableBorder) :
+  // power of two textures and 8 bit quantization work around GPU limits;
+  // we sample the bricks as they are.
+  AbstrRenderer(pMasterController, false, false, bDisableBorder),
+  m_pCacheDataset(NULL),
+  m_iCachedBytes(0),
+  m_vFrameSize(0, 0)
+{
+  if(bUseOnlyPowerOfTwo || bDownSampleTo8Bits) {
+    MESSAGE("Ignoring GPU compatibility settings.");
+  }
+}
+
+CPURaycaster::~CPURaycaster() {
+  Cleanup();
+}
+
+bool CPURaycaster::Initialize(std::shared_ptr<Context> ctx) {
+  if(!ctx) { ctx = std::make_shared<Context>(-1); }
+  if(!AbstrRenderer::Initialize(ctx)) {
+    T_ERROR("Error in parent call -> aborting");
+    return false;
+  }
+  if(m_pDataset->GetComponentCount() != 1) {
+    T_ERROR("The software raycaster only renders scalar data.");
+    return false;
+  }
+
+  std::string strPotential1DTransName;
+  std::string strPotential2DTransName;
+  FileBackedDataset* fbd = dynamic_cast<FileBackedDataset*>(m_pDataset);
+  if(fbd) {
+    strPotential1DTransName = SysTools::ChangeExt(fbd->Filename(), "1dt");
+    strPotential2DTransName = SysTools::ChangeExt(fbd->Filename(), "2dt");
+  }
+
+  // we sample the transfer functions ourselves: no textures
+  GPUMemMan &mm = *(Controller::Instance().MemMan());
+  if (SysTools::FileExists(strPotential1DTransName)) {
+    MESSAGE("Loading 1D TF from file.");
+    mm.Get1DTransFromFile(strPotential1DTransName, this, &m_p1DTrans, NULL,
+                          m_pDataset->Get1DHistogram()->GetFilledSize());
+  } else {
+    MESSAGE("Creating empty 1D TF.");
+    mm.GetEmpty1DTrans(m_pDataset->Get1DHistogram()->GetFilledSize(), this,
+                       &m_p1DTrans, NULL);
+  }
+  LuaBindNew1DTrans();
+
+  if (SysTools::FileExists(strPotential2DTransName)) {
+    mm.Get2DTransFromFile(strPotential2DTransName, this, &m_p2DTrans, NULL,
+                          m_pDataset->Get2DHistogram()->GetFilledSize());
+    if(m_p2DTrans == NULL) {
+      WARNING("Falling back to empty 2D TF...");
+      mm.GetEmpty2DTrans(m_pDataset->Get2DHistogram()->GetFilledSize(), this,
+                         &m_p2DTrans, NULL);
+    }
+    LuaBindNew2DTrans();
+  } else {
+    mm.GetEmpty2DTrans(m_pDataset->Get2DHistogram()->GetFilledSize(), this,
+                       &m_p2DTrans, NULL);
+
+    // the same default swatch the GL renderers start with
+    TFPolygon newSwatch;
+    newSwatch.pPoints.push_back(FLOATVECTOR2(0.1f,0.1f));
+    newSwatch.pPoints.push_back(FLOATVECTOR2(0.1f,0.9f));
+    newSwatch.pPoints.push_back(FLOATVECTOR2(0.9f,0.9f));
+    newSwatch.pPoints.push_back(FLOATVECTOR2(0.9f,0.1f));
+
+    newSwatch.pGradientCoords[0] = FLOATVECTOR2(0.1f,0.5f);
+    newSwatch.pGradientCoords[1] = FLOATVECTOR2(0.9f,0.5f);
+
+    GradientStop g1(0.0f,FLOATVECTOR4(0,0,0,0)),
+                 g2(0.5f,FLOATVECTOR4(1,1,1,1)),
+                 g3(1.0f,FLOATVECTOR4(0,0,0,0));
+    newSwatch.pGradientStops.push_back(g1);
+    newSwatch.pGradientStops.push_back(g2);
+    newSwatch.pGradientStops.push_back(g3);
+
+    m_p2DTrans->m_pvSwatches->push_back(newSwatch);
+
+    LuaBindNew2DTrans();
+    mm.Changed2DTrans(LuaClassInstance(), m_pLua2DTrans);
+  }
+  return true;
+}
+
+void CPURaycaster::Set1DTrans(const std::vector<unsigned char>& rgba) {
+  AbstrRenderer::Free1DTrans();
+
+  GPUMemMan& mm = *(Controller::Instance().MemMan());
+  mm.GetEmpty1DTrans(rgba.size() / 4, this, &m_p1DTrans, NULL);
+  m_p1DTrans->Set(rgba);
+
+  LuaBindNew1DTrans();
+}
+
+void CPURaycaster::SetViewPort(UINTVECTOR2 viLowerLeft,
+                               UINTVECTOR2 viUpperRight, bool) {
+  const UINTVECTOR2 viSize = viUpperRight-viLowerLeft;
+  const float fAspect = float(viSize.x)/float(viSize.y);
+  ComputeViewAndProjection(fAspect);
+
+  m_FrustumCullingLOD.SetProjectionMatrix(m_mProjection[0]);
+  m_FrustumCullingLOD.SetScreenParams(m_fFOV, fAspect, m_fZNear, m_fZFar,
+                                      viSize.y);
+}
+
+void CPURaycaster::ComputeViewAndProjection(float fAspect) {
+  if (m_bUserMatrices) {
+    m_mView[0] = m_UserView;
+    m_mProjection[0] = m_UserProjection;
+  } else {
+    m_mView[0].BuildLookAt(m_vEye, m_vAt, m_vUp);
+    m_mProjection[0].Perspective(m_fFOV, fAspect, m_fZNear, m_fZFar);
+  }
+}
+
+FLOATVECTOR3 CPURaycaster::Pick(const UINTVECTOR2&) const {
+  throw std::runtime_error("The software raycaster does not support "
+                           "picking.");
+}
+
+void CPURaycaster::NewFrameClear(const RenderRegion& region) {
+  for(uint32_t y=region.minCoord.y; y < region.maxCoord.y; ++y) {
+    std::fill(m_vFrame.begin() + y*m_vFrameSize.x + region.minCoord.x,
+              m_vFrame.begin() + y*m_vFrameSize.x + region.maxCoord.x,
+              FLOATVECTOR4(0,0,0,0));
+  }
+}
+
+bool CPURaycaster::Paint() {
+  if(!AbstrRenderer::Paint()) { return false; }
+  if(m_bDatasetIsInvalid) { return true; }
+  // one eye only
+  m_bDoStereoRendering = false;
+
+  if(m_vFrameSize != m_vWinSize) {
+    m_vFrameSize = m_vWinSize;
+    m_vFrame.assign(m_vFrameSize.area(), FLOATVECTOR4(0,0,0,0));
+  }
+  if(m_pCacheDataset != m_pDataset) {
+    Cleanup();
+    m_pCacheDataset = m_pDataset;
+  }
+
+  for(size_t i=0; i < renderRegions.size(); ++i) {
+    RenderRegion& region = *renderRegions[i];
+    if(!region.redrawMask) { continue; }
+    if(region.is3D()) {
+      Render3DRegion(static_cast<RenderRegion3D&>(region));
+    } else {
+      WARNING("The software raycaster only renders 3D views.");
+      NewFrameClear(region);
+    }
+    region.redrawMask = false;
+    region.isBlank = false;
+    region.isTargetBlank = false;
+  }
+  m_bPerformReCompose = false;
+  return true;
+}
+
+void CPURaycaster::PlanFrame(RenderRegion3D& region) {
+  m_FrustumCullingLOD.SetViewMatrix(region.modelView[0]);
+  m_FrustumCullingLOD.Update();
+
+  ComputeMinLODForCurrentView();
+  m_iCurrentLODOffset = m_iMinLODForCurrentView;
+  if(m_eRendererTarget == RT_CAPTURE) {
+    m_iCurrentLOD = 0;
+  } else {
+    m_iCurrentLOD = std::min<uint64_t>(m_iCurrentLODOffset,
+                                       m_pDataset->GetLODLevelCount()-1);
+  }
+  MESSAGE("Building new brick list for LOD %llu...", m_iCurrentLOD);
+  m_vCurrentBrickList = BuildSubFrameBrickList();
+  MESSAGE("%u bricks made the cut.", uint32_t(m_vCurrentBrickList.size()));
+  PrefetchBricks(m_vCurrentBrickList);
+  m_iBricksRenderedInThisSubFrame = 0;
+
+  m_iIntraFrameCounter = 0;
+  m_iFrameCounter = m_pMasterController->MemMan()->UpdateFrameCounter();
+}
+
+void CPURaycaster::PrefetchBricks(const std::vector<Brick>& vBrickList) const {
+  std::vector<BrickKey> keys;
+  keys.reserve(vBrickList.size());
+  for(auto b = vBrickList.cbegin(); b != vBrickList.cend(); ++b) {
+    if(!b->bIsEmpty && m_Bricks.find(b->kBrick) == m_Bricks.end()) {
+      keys.push_back(b->kBrick);
+    }
+  }
+  m_pDataset->Prefetch(keys);
+}
+
+void CPURaycaster::SetupParams(const RenderRegion3D& region,
+                               RaycastParams& params) {
+  params.mInvViewProjection = (region.modelView[0] *
+                               m_mProjection[0]).inverse();
+  params.vImageSize = region.maxCoord - region.minCoord;
+
+  // half a voxel of the current LoD, like the GL raycaster
+  const FLOATVECTOR3 vDomain0(m_pDataset->GetDomainSize(0));
+  const FLOATVECTOR3 vDomain(
+    m_pDataset->GetDomainSize(size_t(m_iCurrentLOD))
+  );
+  FLOATVECTOR3 vExtent = vDomain0 * FLOATVECTOR3(m_pDataset->GetScale());
+  vExtent /= vExtent.maxVal();
+  params.fStepSize = (vExtent / vDomain).minVal() * 0.5f /
+                     m_fSampleRateModifier;
+  const float fOpacityCorrection = 1.0f/m_fSampleRateModifier *
+                                   (vDomain0 / vDomain).maxVal();
+
+  switch(m_eRenderMode) {
+    case RM_2DTRANS: {
+      params.eMode = RaycastParams::RC_2DTRANS;
+      const VECTOR2<size_t> vSize = m_p2DTrans->GetSize();
+      unsigned char* pcData = NULL;
+      m_p2DTrans->GetByteArray(&pcData);
+      const std::vector<unsigned char> rgba(pcData,
+                                            pcData + vSize.area()*4);
+      delete [] pcData;
+      SetTransferFunction(params, rgba, UINTVECTOR2(vSize),
+                          fOpacityCorrection);
+      break;
+    }
+    case RM_ISOSURFACE:
+      params.eMode = RaycastParams::RC_ISOSURFACE;
+      break;
+    default: {
+      if(m_eRenderMode != RM_1DTRANS) {
+        WARNING("Unsupported render mode, using the 1D transfer function.");
+      }
+      params.eMode = RaycastParams::RC_1DTRANS;
+      std::vector<unsigned char> rgba;
+      m_p1DTrans->GetByteArray(rgba);
+      SetTransferFunction(params, rgba,
+                          UINTVECTOR2(unsigned(m_p1DTrans->GetSize()), 1),
+                          fOpacityCorrection);
+      break;
+    }
+  }
+  const std::pair<double,double> range = m_pDataset->GetRange();
+  const double fMaxValue = (range.first > range.second) ?
+                             double(m_p1DTrans->GetSize()) : range.second;
+  params.fTFScale = float((params.vTFSize.x - 1) / fMaxValue);
+  params.fGradientScale = (m_pDataset->MaxGradientMagnitude() == 0) ?
+                           1.0f : 1.0f/m_pDataset->MaxGradientMagnitude();
+
+  params.fIsovalue = GetIsoValue();
+  params.vIsoColor = m_vIsoColor;
+
+  // the isosurface is always lit
+  params.bLighting = m_bUseLighting || m_eRenderMode == RM_ISOSURFACE;
+  FLOATVECTOR3 vLightDir = (FLOATVECTOR4(m_vLightDir, 0.0f) *
+                            region.modelView[0].inverse()).xyz();
+  vLightDir.normalize();
+  params.vLightDir = vLightDir;
+  params.vAmbient = m_cAmbient.xyz() * m_cAmbient.w;
+  params.vDiffuse = m_cDiffuse.xyz() * m_cDiffuse.w;
+  params.vSpecular = m_cSpecular.xyz() * m_cSpecular.w;
+}
+
+bool CPURaycaster::BrickVisible(const RaycastParams& params,
+                                const Brick& b) const {
+  if(b.bIsEmpty) { return false; }
+  const BrickedDataset* bds = dynamic_cast<const BrickedDataset*>(m_pDataset);
+  if(!bds) { return true; }
+  const MinMaxBlock mm = bds->MaxMinForKey(b.kBrick);
+  return RaycastVisible(params, mm.minScalar, mm.maxScalar);
+}
+
+void CPURaycaster::Render3DRegion(RenderRegion3D& region) {
+  SetViewPort(region.minCoord, region.maxCoord, false);
+  region.modelView[0] = region.rotation*region.translation*m_mView[0];
+  PlanFrame(region);
+
+  RaycastParams params;
+  SetupParams(region, params);
+
+  // the bricks stay alive in 'data' even if the cache drops them
+  std::vector<std::shared_ptr<std::vector<float>>> data;
+  std::vector<RaycastBrick> bricks;
+  for(auto b = m_vCurrentBrickList.cbegin();
+      b != m_vCurrentBrickList.cend(); ++b) {
+    if(!BrickVisible(params, *b)) { continue; }
+    std::shared_ptr<std::vector<float>> pData = FetchBrick(b->kBrick);
+    if(!pData) { continue; }
+    data.push_back(pData);
+
+    RaycastBrick rb;
+    rb.pData = &pData->at(0);
+    rb.vVoxelCount = b->vVoxelCount;
+    rb.vMin = b->vCenter - b->vExtension * 0.5f;
+    rb.vMax = b->vCenter + b->vExtension * 0.5f;
+    rb.vTexcoordsMin = b->vTexcoordsMin;
+    rb.vTexcoordsMax = b->vTexcoordsMax;
+    bricks.push_back(rb);
+  }
+  EvictBricks();
+  MESSAGE("Casting rays through %u of %u bricks.", uint32_t(bricks.size()),
+          uint32_t(m_vCurrentBrickList.size()));
+
+  std::vector<FLOATVECTOR4> image(params.vImageSize.area(),
+                                  FLOATVECTOR4(0,0,0,0));
+  Raycast(params, bricks, image);
+  for(uint32_t y=0; y < params.vImageSize.y; ++y) {
+    std::copy(image.begin() + y*params.vImageSize.x,
+              image.begin() + (y+1)*params.vImageSize.x,
+              m_vFrame.begin() + (region.minCoord.y+y)*m_vFrameSize.x +
+              region.minCoord.x);
+  }
+  m_iBricksRenderedInThisSubFrame = m_vCurrentBrickList.size();
+}
+
+std::shared_ptr<std::vector<float>>
+CPURaycaster::FetchBrick(const BrickKey& key) {
+  CachedBrick& cached = m_Bricks[key];
+  cached.iFrame = m_iFrameCounter;
+  if(!cached.pData) {
+    std::shared_ptr<std::vector<float>> pData(new std::vector<float>());
+    if(!ReadBrickAsFloat(*m_pDataset, key, *pData) || pData->empty()) {
+      T_ERROR("Could not read brick <%u,%u,%u>",
+              static_cast<unsigned>(std::get<0>(key)),
+              static_cast<unsigned>(std::get<1>(key)),
+              static_cast<unsigned>(std::get<2>(key)));
+      m_Bricks.erase(key);
+      return std::shared_ptr<std::vector<float>>();
+    }
+    cached.pData = pData;
+    m_iCachedBytes += pData->size() * sizeof(float);
+  }
+  return cached.pData;
+}
+
+void CPURaycaster::EvictBricks() {
+  const uint64_t iMaxBytes = m_pMasterController->MemMan()->GetCPUMem() / 4;
+  while(m_iCachedBytes > iMaxBytes) {
+    auto oldest = m_Bricks.end();
+    for(auto i = m_Bricks.begin(); i != m_Bricks.end(); ++i) {
+      if(i->second.iFrame != m_iFrameCounter &&
+         (oldest == m_Bricks.end() ||
+          i->second.iFrame < oldest->second.iFrame)) {
+        oldest = i;
+      }
+    }
+    // everything left is needed for the current frame
+    if(oldest == m_Bricks.end()) { break; }
+    m_iCachedBytes -= oldest->second.pData->size() * sizeof(float);
+    m_Bricks.erase(oldest);
+  }
+}
+
+bool CPURaycaster::IsVolumeResident(const BrickKey& key) const {
+  return m_Bricks.find(key) != m_Bricks.end();
+}
+
+void CPURaycaster::Cleanup() {
+  m_Bricks.clear();
+  m_iCachedBytes = 0;
+}
+
+bool CPURaycaster::CropDataset(const std::string& strTempDir,
+                               bool bKeepOldData) {
+  ExtendedPlane p = GetClipPlane();
+  FLOATMATRIX4 trans = GetFirst3DRegion()->rotation *
+                       GetFirst3DRegion()->translation;
+
+  // get rid of the viewing transformation in the plane
+  p.Transform(trans.inverse(),false);
+
+  if (!m_pDataset->Crop(p.Plane(),strTempDir,bKeepOldData,
+      m_pMasterController->IOMan()->GetUseMedianFilter(),
+      m_pMasterController->IOMan()->GetClampToEdge())) return false;
+
+  Cleanup();
+  FileBackedDataset* fbd = dynamic_cast<FileBackedDataset*>(m_pDataset);
+  if (NULL != fbd)
+  {
+    LoadFile(fbd->Filename());
+  }
+
+  return true;
+}
+
+template<typename T>
+void CPURaycaster::ConvertFrame(std::vector<T>& rgba,
+                                bool bPreserveTransparency,
+                                float fMax) const {
+  rgba.resize(m_vFrame.size()*4);
+  for(uint32_t y=0; y < m_vFrameSize.y; ++y) {
+    // [0] is the bottom of the background gradient, [1] the top
+    const float t = m_vFrameSize.y > 1 ? float(y)/float(m_vFrameSize.y-1)
+                                       : 0.0f;
+    const FLOATVECTOR3 vBackground = m_vBackgroundColors[0] * (1.0f-t) +
+                                     m_vBackgroundColors[1] * t;
+    for(uint32_t x=0; x < m_vFrameSize.x; ++x) {
+      const size_t i = size_t(y)*m_vFrameSize.x + x;
+      FLOATVECTOR4 c = m_vFrame[i];
+      if(!bPreserveTransparency) {
+        c = FLOATVECTOR4(c.xyz() + vBackground * (1.0f-c.w), 1.0f);
+      }
+      for(size_t j=0; j < 4; ++j) {
+        rgba[i*4+j] = T(std::min(std::max(c[j], 0.0f), 1.0f) * fMax + 0.5f);
+      }
+    }
+  }
+}
+
+void CPURaycaster::GetFrame(std::vector<uint8_t>& rgba,
+                            bool bPreserveTransparency) const {
+  ConvertFrame(rgba, bPreserveTransparency, 255.0f);
+}
+
+void CPURaycaster::GetFrame(std::vector<uint16_t>& rgba,
+                            bool bPreserveTransparency) const {
+  ConvertFrame(rgba, bPreserveTransparency, 65535.0f);
+}
+
+bool CPURaycaster::CaptureSingleFrame(const std::string& strFilename,
+                                      bool bPreserveTransparency) const {
+  if(m_vFrame.empty()) { return false; }
+  CPUFrameCapture f(*this);
+  return f.CaptureSingleFrame(strFilename, bPreserveTransparency);
+}
+
+} // namespace tuvok
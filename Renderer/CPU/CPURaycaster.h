@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef TUVOK_CPURAYCASTER_H
+#define TUVOK_CPURAYCASTER_H
+
+#include "StdTuvokDefines.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "Renderer/AbstrRenderer.h"
+#include "RaycastKernel.h"
+
+namespace tuvok {
+
+/** \class CPURaycaster
+ * Software raycaster.
+ *
+ * CPURaycaster renders scalar data sets in the 1D, 2D and isosurface modes
+ * without any GPU: bricks are read through Dataset::GetBrick, bricks the
+ * per brick statistics rule out are skipped, and the rays are cast by the
+ * threads of RaycastKernel.  Meant for rendering thumbnails and movies on
+ * machines without graphics hardware, and as a reference for the GL
+ * renderers.  Every Paint renders the whole frame at the finest level of
+ * detail the view calls for; there is no progressive refinement. */
+class CPURaycaster : public AbstrRenderer {
+  public:
+    CPURaycaster(MasterController* pMasterController,
+                 bool bUseOnlyPowerOfTwo,
+                 bool bDownSampleTo8Bits,
+                 bool bDisableBorder);
+    virtual ~CPURaycaster();
+
+    /// Does not need a context; creates a dummy one if 'ctx' is empty.
+    virtual bool Initialize(std::shared_ptr<Context> ctx);
+    virtual bool Paint();
+
+    virtual void Set1DTrans(const std::vector<unsigned char>& rgba);
+
+    virtual void SetViewPort(UINTVECTOR2 lower_left, UINTVECTOR2 upper_right,
+                             bool decrease_screen_res);
+    virtual FLOATVECTOR3 Pick(const UINTVECTOR2&) const;
+    virtual void NewFrameClear(const RenderRegion&);
+
+    /// The last frame as 8 bit RGBA, bottom row first.  Blended over the
+    /// background unless bPreserveTransparency is set, in which case the
+    /// colors are premultiplied with alpha.
+    void GetFrame(std::vector<uint8_t>& rgba,
+                  bool bPreserveTransparency) const;
+    /// ditto, 16 bit
+    void GetFrame(std::vector<uint16_t>& rgba,
+                  bool bPreserveTransparency) const;
+    UINTVECTOR2 GetFrameSize() const {return m_vFrameSize;}
+
+    virtual ERendererType GetRendererType() const {return RT_RC;}
+
+  protected:
+    virtual bool CaptureSingleFrame(const std::string& strFilename,
+                                    bool bPreserveTransparency) const;
+
+    /** Drops the cached bricks. */
+    virtual void Cleanup();
+    virtual bool CropDataset(const std::string& strTempDir,
+                             bool bKeepOldData);
+
+    virtual void FixedFunctionality() const {}
+    virtual void SyncStateManager() {}
+    virtual void ClearColorBuffer() const {}
+    virtual void UpdateLightParamsInShaders() {}
+
+    /// plans the finest level of detail right away
+    virtual void PlanFrame(RenderRegion3D& region);
+    /// only reads ahead, there is nothing to upload
+    virtual void PrefetchBricks(const std::vector<Brick>&) const;
+    virtual bool IsVolumeResident(const BrickKey& key) const;
+
+  private:
+    /// A brick converted to float, shared with the frames still using it.
+    struct CachedBrick {
+      CachedBrick() : iFrame(0) {}
+      std::shared_ptr<std::vector<float>> pData;
+      uint64_t iFrame;               ///< last frame which rendered it
+    };
+
+    void Render3DRegion(RenderRegion3D& region);
+    void ComputeViewAndProjection(float fAspect);
+    void SetupParams(const RenderRegion3D& region, RaycastParams& params);
+    /// @returns false if the brick cannot contribute to the image
+    bool BrickVisible(const RaycastParams& params, const Brick& b) const;
+    /// reads the brick through the brick cache
+    std::shared_ptr<std::vector<float>> FetchBrick(const BrickKey& key);
+    /// drops the least recently rendered bricks until the cache fits into a
+    /// quarter of the CPU memory, but none of the current frame
+    void EvictBricks();
+    template<typename T> void ConvertFrame(std::vector<T>& rgba,
+                                           bool bPreserveTransparency,
+                                           float fMax) const;
+
+    std::map<BrickKey, CachedBrick> m_Bricks;
+    const Dataset* m_pCacheDataset;      ///< the bricks in m_Bricks are from
+    uint64_t m_iCachedBytes;
+
+    std::vector<FLOATVECTOR4> m_vFrame;  ///< premultiplied, bottom row first
+    UINTVECTOR2 m_vFrameSize;
+};
+
+} // namespace tuvok
+
+#endif // TUVOK_CPURAYCASTER_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
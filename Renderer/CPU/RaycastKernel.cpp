@@ -0,0 +1,503 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "RaycastKernel.h"
+#include "IO/UVF/ExtendedOctree/VolumeTools.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__i386__) && defined(__SSE2__)) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define RAYCASTKERNEL_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+#endif
+
+namespace tuvok {
+
+RaycastParams::RaycastParams() :
+  eMode(RC_1DTRANS),
+  vImageSize(0, 0),
+  fStepSize(0.01f),
+  vTFSize(0, 0),
+  fTFScale(1.0f),
+  fGradientScale(1.0f),
+  fIsovalue(0.5f),
+  vIsoColor(0.5f, 0.5f, 0.5f),
+  bLighting(false),
+  vLightDir(0.0f, 0.0f, -1.0f),
+  vAmbient(0.1f, 0.1f, 0.1f),
+  vDiffuse(1.0f, 1.0f, 1.0f),
+  vSpecular(1.0f, 1.0f, 1.0f)
+{}
+
+void SetTransferFunction(RaycastParams& params,
+                         const std::vector<unsigned char>& rgba,
+                         const UINTVECTOR2& vSize, float fOpacityCorrection) {
+  const size_t n = size_t(vSize.area());
+  assert(n > 0 && rgba.size() >= n*4);
+  params.vTFSize = vSize;
+  params.vTF.resize(n*4);
+  for(size_t i=0; i < n; ++i) {
+    for(size_t c=0; c < 3; ++c) {
+      params.vTF[c*n + i] = rgba[i*4 + c] / 255.0f;
+    }
+    const float a = rgba[i*4 + 3] / 255.0f;
+    params.vTF[3*n + i] = 1.0f - std::pow(1.0f - a, fOpacityCorrection);
+  }
+}
+
+namespace {
+  // the column Raycast looks a value up in; false comparisons clamp NaNs
+  size_t Column(const RaycastParams& params, float v) {
+    const float fLast = float(params.vTFSize.x - 1);
+    float c = v * params.fTFScale;
+    c = c > 0.0f ? c : 0.0f;
+    c = c < fLast ? c : fLast;
+    return size_t(c + 0.5f);
+  }
+}
+
+bool RaycastVisible(const RaycastParams& params, double fMin, double fMax) {
+  if(params.eMode == RaycastParams::RC_ISOSURFACE) {
+    return !(fMax < params.fIsovalue);
+  }
+  if(!(fMin <= fMax) || params.vTF.empty()) { return true; }
+
+  // one column of slack on each side for rounding in the interpolation
+  const size_t iColumns = params.vTFSize.x;
+  const size_t c0 = std::max<size_t>(Column(params, float(fMin)), 1) - 1;
+  const size_t c1 = std::min<size_t>(Column(params, float(fMax)) + 1,
+                                     iColumns - 1);
+  // a 2D function can be looked up in any row: gradients are interpolated,
+  // so the per brick gradient range does not bound them.
+  const float* pAlpha = &params.vTF[3 * params.vTFSize.area()];
+  for(size_t row=0; row < params.vTFSize.y; ++row) {
+    for(size_t c=c0; c <= c1; ++c) {
+      if(pAlpha[row*iColumns + c] > 0.0f) { return true; }
+    }
+  }
+  return false;
+}
+
+namespace {
+  // rays terminate once they are this opaque, just like in the shaders
+  const float RAYCAST_OPAQUE = 0.99f;
+  // bisection steps to find an isosurface between two samples
+  const int ISO_REFINEMENT = 8;
+
+  enum { TILE_PIXELS = RAYCAST_TILE_SIZE * RAYCAST_TILE_SIZE };
+
+  // the parameters of a frame, as the kernels use them
+  struct Setup {
+    RaycastParams::Mode eMode;
+    bool bLighting;
+    float fStepSize;
+    float fMaxT;                 ///< no ray is longer than that
+    const float* pTF[4];         ///< red, green, blue and opacity planes
+    float fTFScale;
+    float fGradientScale;
+    float fLastColumn;
+    float fLastRow;
+    int iColumns;
+    float fIsovalue;
+    float vIsoColor[3];
+    float vLightDir[3];
+    float vAmbient[3];
+    float vDiffuse[3];
+    float vSpecular[3];
+  };
+
+  struct BrickSetup {
+    const float* pData;
+    float vMin[3];
+    float vMax[3];
+    // voxel coordinates are position * fScale + fBias
+    float fScale[3];
+    float fBias[3];
+    float fLast[3];              ///< the last voxel
+    float fLastCell[3];          ///< the first voxel of the last cell
+    int iStride[3];              ///< 1, x and x*y voxels
+    int iStep[3];                ///< to the next voxel; 0 for a single voxel
+  };
+
+  // the rays of a tile, row by row, and what they composited so far.
+  // Rays outside the image start out opaque.
+  struct Tile {
+    float ox[TILE_PIXELS], oy[TILE_PIXELS], oz[TILE_PIXELS];
+    float dx[TILE_PIXELS], dy[TILE_PIXELS], dz[TILE_PIXELS];
+    float r[TILE_PIXELS], g[TILE_PIXELS], b[TILE_PIXELS], a[TILE_PIXELS];
+  };
+
+  void ShadeIsoHit(const Setup& s, const BrickSetup& b, Tile& t, size_t i,
+                   float k);
+
+  namespace scalar {
+    struct Ops {
+      enum { N = 1 };
+      typedef float V;
+      typedef int I;
+      typedef bool M;
+      static V Set(float f) { return f; }
+      static V Load(const float* p) { return *p; }
+      static void Store(float* p, V v) { *p = v; }
+      static V Add(V a, V b) { return a + b; }
+      static V Sub(V a, V b) { return a - b; }
+      static V Mul(V a, V b) { return a * b; }
+      static V Div(V a, V b) { return a / b; }
+      static V Sqrt(V a) { return std::sqrt(a); }
+      static V Min(V a, V b) { return a < b ? a : b; }
+      static V Max(V a, V b) { return a > b ? a : b; }
+      static M Lt(V a, V b) { return a < b; }
+      static M Ge(V a, V b) { return a >= b; }
+      static M And(M a, M b) { return a && b; }
+      static M AndNot(M a, M b) { return a && !b; }
+      static bool Any(M m) { return m; }
+      static V Sel(M m, V x, V y) { return m ? x : y; }
+      static I Trunc(V v) { return I(v); }
+      static V ToFloat(I i) { return V(i); }
+      static I ISet(int i) { return i; }
+      static I IAdd(I a, I b) { return a + b; }
+      static I IMul(I a, int b) { return a * b; }
+      static V Gather(const float* p, I i) { return p[i]; }
+    };
+
+#include "RaycastKernel.inc"
+  }
+
+#ifdef RAYCASTKERNEL_X86
+  namespace sse2 {
+    struct Ops {
+      enum { N = 4 };
+      typedef __m128 V;
+      typedef __m128i I;
+      typedef __m128 M;
+      static V Set(float f) { return _mm_set1_ps(f); }
+      static V Load(const float* p) { return _mm_loadu_ps(p); }
+      static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+      static V Add(V a, V b) { return _mm_add_ps(a, b); }
+      static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+      static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+      static V Div(V a, V b) { return _mm_div_ps(a, b); }
+      static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+      static V Min(V a, V b) { return _mm_min_ps(a, b); }
+      static V Max(V a, V b) { return _mm_max_ps(a, b); }
+      static M Lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+      static M Ge(V a, V b) { return _mm_cmpge_ps(a, b); }
+      static M And(M a, M b) { return _mm_and_ps(a, b); }
+      static M AndNot(M a, M b) { return _mm_andnot_ps(b, a); }
+      static bool Any(M m) { return _mm_movemask_ps(m) != 0; }
+      static V Sel(M m, V x, V y) {
+        return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+      }
+      static I Trunc(V v) { return _mm_cvttps_epi32(v); }
+      static V ToFloat(I i) { return _mm_cvtepi32_ps(i); }
+      static I ISet(int i) { return _mm_set1_epi32(i); }
+      static I IAdd(I a, I b) { return _mm_add_epi32(a, b); }
+      // SSE2 has no 32 bit multiplication, but a 32x32 -> 64 bit one
+      static I IMul(I a, int b) {
+        const I vb = _mm_set1_epi32(b);
+        const I even = _mm_mul_epu32(a, vb);
+        const I odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), vb);
+        return _mm_unpacklo_epi32(
+          _mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+          _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0))
+        );
+      }
+      static V Gather(const float* p, I i) {
+        int idx[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(idx), i);
+        return _mm_setr_ps(p[idx[0]], p[idx[1]], p[idx[2]], p[idx[3]]);
+      }
+    };
+
+#include "RaycastKernel.inc"
+  }
+
+// everything in the avx2 namespace is compiled for AVX2, independent of the
+// compiler flags of the rest of the library; it is only ever called after
+// DetectSIMDLevel found a CPU which supports it.
+#if defined(__clang__)
+# pragma clang attribute push (__attribute__((target("avx2"))), \
+                               apply_to = function)
+#elif defined(__GNUC__)
+# pragma GCC push_options
+# pragma GCC target("avx2")
+#endif
+
+  namespace avx2 {
+    struct Ops {
+      enum { N = 8 };
+      typedef __m256 V;
+      typedef __m256i I;
+      typedef __m256 M;
+      static V Set(float f) { return _mm256_set1_ps(f); }
+      static V Load(const float* p) { return _mm256_loadu_ps(p); }
+      static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+      static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+      static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+      static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+      static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+      static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+      static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+      static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+      static M Lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+      static M Ge(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+      static M And(M a, M b) { return _mm256_and_ps(a, b); }
+      static M AndNot(M a, M b) { return _mm256_andnot_ps(b, a); }
+      static bool Any(M m) { return _mm256_movemask_ps(m) != 0; }
+      static V Sel(M m, V x, V y) { return _mm256_blendv_ps(y, x, m); }
+      static I Trunc(V v) { return _mm256_cvttps_epi32(v); }
+      static V ToFloat(I i) { return _mm256_cvtepi32_ps(i); }
+      static I ISet(int i) { return _mm256_set1_epi32(i); }
+      static I IAdd(I a, I b) { return _mm256_add_epi32(a, b); }
+      static I IMul(I a, int b) {
+        return _mm256_mullo_epi32(a, _mm256_set1_epi32(b));
+      }
+      static V Gather(const float* p, I i) {
+        return _mm256_i32gather_ps(p, i, 4);
+      }
+    };
+
+#include "RaycastKernel.inc"
+  }
+
+#if defined(__clang__)
+# pragma clang attribute pop
+#elif defined(__GNUC__)
+# pragma GCC pop_options
+#endif
+
+#endif // RAYCASTKERNEL_X86
+
+  void VoxelAt(const BrickSetup& b, const float o[3], const float d[3],
+               float fDistance, float vox[3]) {
+    for(size_t i=0; i < 3; ++i) {
+      vox[i] = (o[i] + d[i]*fDistance) * b.fScale[i] + b.fBias[i];
+    }
+  }
+
+  // finds the surface between sample k and the one before it by bisection
+  // and shades it with the isosurface color
+  void ShadeIsoHit(const Setup& s, const BrickSetup& b, Tile& t, size_t i,
+                   float k) {
+    typedef scalar::Ops O;
+    const float o[3] = { t.ox[i], t.oy[i], t.oz[i] };
+    const float d[3] = { t.dx[i], t.dy[i], t.dz[i] };
+    float lo = std::max(k - 1.0f, 0.0f) * s.fStepSize;
+    float hi = k * s.fStepSize;
+    float vox[3];
+    for(int iter=0; iter < ISO_REFINEMENT; ++iter) {
+      const float mid = 0.5f * (lo + hi);
+      VoxelAt(b, o, d, mid, vox);
+      if(scalar::Sample<O>(b, vox[0], vox[1], vox[2]) >= s.fIsovalue) {
+        hi = mid;
+      } else {
+        lo = mid;
+      }
+    }
+    VoxelAt(b, o, d, hi, vox);
+    float nx, ny, nz;
+    scalar::Gradient<O>(b, vox[0], vox[1], vox[2], nx, ny, nz);
+    scalar::Normal<O>(b, nx, ny, nz);
+    float r = s.vIsoColor[0], g = s.vIsoColor[1], bl = s.vIsoColor[2];
+    scalar::Shade<O>(s, nx, ny, nz, -d[0], -d[1], -d[2], r, g, bl);
+    t.r[i] = r;
+    t.g[i] = g;
+    t.b[i] = bl;
+    t.a[i] = 1.0f;
+  }
+
+  void MarchBrick(const Setup& s, const BrickSetup& b, Tile& t) {
+#ifdef RAYCASTKERNEL_X86
+    switch(VolumeTools::GetSIMDLevel()) {
+      case VolumeTools::SIMD_AVX2:
+        avx2::MarchBrick<avx2::Ops>(s, b, t);
+        return;
+      case VolumeTools::SIMD_SSE2:
+        sse2::MarchBrick<sse2::Ops>(s, b, t);
+        return;
+      default:
+        break;
+    }
+#endif
+    scalar::MarchBrick<scalar::Ops>(s, b, t);
+  }
+
+  Setup MakeSetup(const RaycastParams& params) {
+    Setup s;
+    s.eMode = params.eMode;
+    s.bLighting = params.bLighting;
+    s.fStepSize = params.fStepSize;
+    // keeps sample indices exact in single precision
+    s.fMaxT = params.fStepSize * float(1 << 23);
+    const size_t n = size_t(params.vTFSize.area());
+    for(size_t c=0; c < 4; ++c) {
+      s.pTF[c] = n ? &params.vTF[c*n] : NULL;
+    }
+    s.fTFScale = params.fTFScale;
+    s.fGradientScale = params.fGradientScale;
+    s.fLastColumn = float(std::max(params.vTFSize.x, 1u) - 1);
+    s.fLastRow = float(std::max(params.vTFSize.y, 1u) - 1);
+    s.iColumns = int(params.vTFSize.x);
+    s.fIsovalue = params.fIsovalue;
+    for(size_t i=0; i < 3; ++i) {
+      s.vIsoColor[i] = params.vIsoColor[i];
+      s.vLightDir[i] = params.vLightDir[i];
+      s.vAmbient[i] = params.vAmbient[i];
+      s.vDiffuse[i] = params.vDiffuse[i];
+      s.vSpecular[i] = params.vSpecular[i];
+    }
+    return s;
+  }
+
+  BrickSetup MakeBrickSetup(const RaycastBrick& brick) {
+    BrickSetup b;
+    b.pData = brick.pData;
+    int iStride = 1;
+    for(size_t i=0; i < 3; ++i) {
+      const float n = float(brick.vVoxelCount[i]);
+      const float fTexPerUnit = (brick.vTexcoordsMax[i] -
+                                 brick.vTexcoordsMin[i]) /
+                                (brick.vMax[i] - brick.vMin[i]);
+      b.vMin[i] = brick.vMin[i];
+      b.vMax[i] = brick.vMax[i];
+      b.fScale[i] = fTexPerUnit * n;
+      b.fBias[i] = (brick.vTexcoordsMin[i] - brick.vMin[i]*fTexPerUnit) * n -
+                   0.5f;
+      b.fLast[i] = n - 1.0f;
+      b.fLastCell[i] = std::max(n - 2.0f, 0.0f);
+      b.iStride[i] = iStride;
+      b.iStep[i] = brick.vVoxelCount[i] > 1 ? iStride : 0;
+      iStride *= int(brick.vVoxelCount[i]);
+    }
+    return b;
+  }
+
+  // the pixels a brick can cover, [x0,x1) x [y0,y1); the whole image if
+  // part of it is behind the eye.
+  struct PixelRect {
+    int x0, y0, x1, y1;
+  };
+
+  PixelRect Footprint(const RaycastBrick& brick,
+                      const FLOATMATRIX4& mViewProjection,
+                      const UINTVECTOR2& vImageSize) {
+    PixelRect rect = { 0, 0, int(vImageSize.x), int(vImageSize.y) };
+    FLOATVECTOR2 vMin(1e30f, 1e30f), vMax(-1e30f, -1e30f);
+    for(int c=0; c < 8; ++c) {
+      const FLOATVECTOR4 corner((c & 1) ? brick.vMax.x : brick.vMin.x,
+                                (c & 2) ? brick.vMax.y : brick.vMin.y,
+                                (c & 4) ? brick.vMax.z : brick.vMin.z, 1.0f);
+      const FLOATVECTOR4 clip = corner * mViewProjection;
+      if(!(clip.w > 1e-6f)) { return rect; }
+      const FLOATVECTOR2 ndc(clip.x / clip.w, clip.y / clip.w);
+      vMin.x = std::min(vMin.x, ndc.x);
+      vMin.y = std::min(vMin.y, ndc.y);
+      vMax.x = std::max(vMax.x, ndc.x);
+      vMax.y = std::max(vMax.y, ndc.y);
+    }
+    // pixel centers (i+0.5)/size*2-1, widened by a pixel for rounding
+    const FLOATVECTOR2 vSize(vImageSize);
+    const FLOATVECTOR2 p0 = (vMin + 1.0f) * 0.5f * vSize - 1.5f;
+    const FLOATVECTOR2 p1 = (vMax + 1.0f) * 0.5f * vSize + 1.5f;
+    rect.x0 = int(std::max(p0.x, 0.0f));
+    rect.y0 = int(std::max(p0.y, 0.0f));
+    rect.x1 = int(std::min(std::max(p1.x, 0.0f), vSize.x));
+    rect.y1 = int(std::min(std::max(p1.y, 0.0f), vSize.y));
+    return rect;
+  }
+
+  void RenderTile(const RaycastParams& params, const Setup& s,
+                  const std::vector<BrickSetup>& bricks,
+                  const std::vector<PixelRect>& footprints, int iTile,
+                  std::vector<FLOATVECTOR4>& image) {
+    const int iWidth = int(params.vImageSize.x);
+    const int iHeight = int(params.vImageSize.y);
+    const int iTilesX = (iWidth + RAYCAST_TILE_SIZE-1) / RAYCAST_TILE_SIZE;
+    const int x0 = (iTile % iTilesX) * RAYCAST_TILE_SIZE;
+    const int y0 = (iTile / iTilesX) * RAYCAST_TILE_SIZE;
+    const int x1 = std::min(x0 + int(RAYCAST_TILE_SIZE), iWidth);
+    const int y1 = std::min(y0 + int(RAYCAST_TILE_SIZE), iHeight);
+
+    Tile t;
+    for(int i=0; i < TILE_PIXELS; ++i) {
+      const int x = x0 + i % RAYCAST_TILE_SIZE;
+      const int y = y0 + i / RAYCAST_TILE_SIZE;
+      if(x >= x1 || y >= y1) {
+        t.ox[i] = t.oy[i] = t.oz[i] = 0.0f;
+        t.dx[i] = t.dy[i] = 0.0f;
+        t.dz[i] = 1.0f;
+        t.r[i] = t.g[i] = t.b[i] = 0.0f;
+        t.a[i] = 1.0f;
+        continue;
+      }
+      const float fX = (x + 0.5f) / iWidth * 2.0f - 1.0f;
+      const float fY = (y + 0.5f) / iHeight * 2.0f - 1.0f;
+      FLOATVECTOR4 vNear = FLOATVECTOR4(fX, fY, -1.0f, 1.0f) *
+                           params.mInvViewProjection;
+      FLOATVECTOR4 vFar = FLOATVECTOR4(fX, fY, 1.0f, 1.0f) *
+                          params.mInvViewProjection;
+      const FLOATVECTOR3 o = vNear.xyz() / vNear.w;
+      FLOATVECTOR3 d = vFar.xyz() / vFar.w - o;
+      d.normalize();
+      t.ox[i] = o.x; t.oy[i] = o.y; t.oz[i] = o.z;
+      t.dx[i] = d.x; t.dy[i] = d.y; t.dz[i] = d.z;
+      const FLOATVECTOR4& c = image[size_t(y)*iWidth + x];
+      t.r[i] = c.x; t.g[i] = c.y; t.b[i] = c.z; t.a[i] = c.w;
+    }
+
+    for(size_t br=0; br < bricks.size(); ++br) {
+      const PixelRect& f = footprints[br];
+      if(f.x1 <= x0 || f.x0 >= x1 || f.y1 <= y0 || f.y0 >= y1) { continue; }
+      MarchBrick(s, bricks[br], t);
+      // early out once every ray of the tile terminated
+      bool bDone = true;
+      for(int i=0; i < TILE_PIXELS && bDone; ++i) {
+        bDone = !(t.a[i] < RAYCAST_OPAQUE);
+      }
+      if(bDone) { break; }
+    }
+
+    for(int y=y0; y < y1; ++y) {
+      for(int x=x0; x < x1; ++x) {
+        const int i = (y-y0)*RAYCAST_TILE_SIZE + (x-x0);
+        image[size_t(y)*iWidth + x] = FLOATVECTOR4(t.r[i], t.g[i], t.b[i],
+                                                   t.a[i]);
+      }
+    }
+  }
+}
+
+void Raycast(const RaycastParams& params,
+             const std::vector<RaycastBrick>& bricks,
+             std::vector<FLOATVECTOR4>& image) {
+  assert(image.size() == size_t(params.vImageSize.area()));
+  if(image.empty() || bricks.empty()) { return; }
+  assert(params.eMode == RaycastParams::RC_ISOSURFACE ||
+         params.vTF.size() == size_t(params.vTFSize.area())*4);
+
+  const Setup s = MakeSetup(params);
+  const FLOATMATRIX4 mViewProjection = params.mInvViewProjection.inverse();
+  std::vector<BrickSetup> vBricks;
+  std::vector<PixelRect> vFootprints;
+  vBricks.reserve(bricks.size());
+  vFootprints.reserve(bricks.size());
+  for(auto b = bricks.cbegin(); b != bricks.cend(); ++b) {
+    vBricks.push_back(MakeBrickSetup(*b));
+    vFootprints.push_back(Footprint(*b, mViewProjection, params.vImageSize));
+  }
+
+  const int iTilesX = int(params.vImageSize.x + RAYCAST_TILE_SIZE-1) /
+                      RAYCAST_TILE_SIZE;
+  const int iTilesY = int(params.vImageSize.y + RAYCAST_TILE_SIZE-1) /
+                      RAYCAST_TILE_SIZE;
+  const int iTiles = iTilesX * iTilesY;
+  // tiles cost very different amounts of work, so threads grab the next
+  // one whenever they are done with theirs
+#pragma omp parallel for schedule(dynamic)
+  for(int i=0; i < iTiles; ++i) {
+    RenderTile(params, s, vBricks, vFootprints, i, image);
+  }
+}
+
+} // namespace tuvok
@@ -0,0 +1,117 @@
+#pragma once
+
+#ifndef TUVOK_RAYCASTKERNEL_H
+#define TUVOK_RAYCASTKERNEL_H
+
+#include "StdTuvokDefines.h"
+#include <vector>
+
+#include "Basics/Vectors.h"
+
+namespace tuvok
+{
+  /// A brick as the software raycaster samples it.  Everything is in volume
+  /// space, the space the bricks of a data set are placed in.
+  struct RaycastBrick {
+    RaycastBrick() : pData(NULL) {}
+
+    const float* pData;          ///< one value per voxel, x fastest
+    UINTVECTOR3 vVoxelCount;     ///< including the overlap
+    FLOATVECTOR3 vMin;           ///< the box this brick renders
+    FLOATVECTOR3 vMax;
+    /// where vMin and vMax are in the brick, voxel i is at (i+0.5)/count
+    FLOATVECTOR3 vTexcoordsMin;
+    FLOATVECTOR3 vTexcoordsMax;
+  };
+
+  /// How the software raycaster renders a frame.
+  struct RaycastParams {
+    enum Mode {
+      RC_1DTRANS = 0,
+      RC_2DTRANS,
+      RC_ISOSURFACE
+    };
+
+    RaycastParams();
+
+    Mode eMode;
+    /// maps normalized device coordinates to volume space
+    FLOATMATRIX4 mInvViewProjection;
+    UINTVECTOR2 vImageSize;
+    /// sample k of every ray is k*fStepSize away from the near plane, no
+    /// matter which brick it falls into, so bricks line up seamlessly.
+    float fStepSize;
+
+    /// red, green, blue and (corrected) opacity planes of vTFSize.area()
+    /// values each, see SetTransferFunction.  1D functions have one row.
+    std::vector<float> vTF;
+    UINTVECTOR2 vTFSize;
+    float fTFScale;              ///< transfer function column per data value
+    /// 2D: the row is (1 - |gradient| * fGradientScale) * (rows-1), with the
+    /// gradient in data values per voxel, just like the shaders look it up
+    float fGradientScale;
+
+    float fIsovalue;
+    FLOATVECTOR3 vIsoColor;
+
+    bool bLighting;              ///< shade the transfer function modes, too
+    FLOATVECTOR3 vLightDir;      ///< unit length, in volume space
+    FLOATVECTOR3 vAmbient;
+    FLOATVECTOR3 vDiffuse;
+    FLOATVECTOR3 vSpecular;
+  };
+
+  /// Sets the transfer function from 8 bit RGBA texels, the way the GL
+  /// renderers upload it, and applies the opacity correction
+  ///   a' = 1 - (1 - a)^fOpacityCorrection
+  void SetTransferFunction(RaycastParams& params,
+                           const std::vector<unsigned char>& rgba,
+                           const UINTVECTOR2& vSize,
+                           float fOpacityCorrection);
+
+  /// @returns false if a brick with values in [fMin, fMax] cannot contribute
+  /// to the image, for empty space skipping with the per brick statistics.
+  bool RaycastVisible(const RaycastParams& params, double fMin, double fMax);
+
+  /// Width and height of the tiles Raycast distributes over its threads.
+  enum { RAYCAST_TILE_SIZE = 16 };
+
+  /// Casts a ray through every pixel center and composites the bricks, which
+  /// must be sorted front to back, behind what 'image' already holds.
+  /// 'image' has vImageSize.area() premultiplied RGBA pixels, bottom row
+  /// first, like OpenGL reads them back.  Tiles are handed out to OpenMP
+  /// threads dynamically; rays are marched in packets with SSE2 or AVX2,
+  /// whatever VolumeTools::GetSIMDLevel() says.
+  void Raycast(const RaycastParams& params,
+               const std::vector<RaycastBrick>& bricks,
+               std::vector<FLOATVECTOR4>& image);
+} // namespace tuvok
+
+#endif // TUVOK_RAYCASTKERNEL_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -14,9 +14,11 @@
 #include "Basics/MathTools.h"
 #include "Basics/TuvokException.h"
 #include "Basics/Threads.h"
+#include "IO/BrickBuffer.h"
 #include "IO/LinearIndexDataset.h"
 #include "IO/UVF/ExtendedOctree/VolumeTools.h"
 #include "Controller/StackTimer.h"
+#include "Renderer/BrickVisibility.h"
 #include "Renderer/VisibilityState.h"
 #include "Renderer/writebrick.h"
 #include "GLSLProgram.h"
@@ -137,6 +139,7 @@ GLVolumePool::GLVolumePool(const UINTVECTOR3& poolSize,
     m_bUseGLCore(bUseGLCore),
     m_iInsertPos(0),
     m_pDataset(pDataset),
+    m_pVisibility(NULL),
     m_pUpdater(NULL),
     m_bVisibilityUpdated(false)
 #ifdef GLVOLUMEPOOL_PROFILE
@@ -225,20 +228,17 @@ GLVolumePool::GLVolumePool(const UINTVECTOR3& poolSize,
   CreateGLResources();
 
   // duplicate minmax scalar data from dataset for efficient access
-  m_vMinMaxScalar.resize(m_iTotalBrickCount);
-  for (uint32_t i = 0; i < m_vMinMaxScalar.size(); i++) {
-    UINTVECTOR4 const vBrickID = GetVectorBrickID(i);
-    BrickKey const key = m_pDataset->IndexFrom4D(vBrickID, m_iMinMaxScalarTimestep);
-    MinMaxBlock imme = m_pDataset->MaxMinForKey(key);
-    m_vMinMaxScalar[i].min = imme.minScalar;
-    m_vMinMaxScalar[i].max = imme.maxScalar;
-  }
+  std::vector<UINTVECTOR3> vLayouts(m_iLoDCount);
+  for (uint32_t i = 0; i < m_iLoDCount; ++i)
+    vLayouts[i] = GetBrickLayout(m_volumeSize, m_maxInnerBrickSize, i);
+  m_pVisibility = new BrickVisibility(vLayouts);
+  FetchMinMax(m_iMinMaxScalarTimestep, false);
 
   switch (m_eDebugMode) {
   default:
   case DM_NONE:
     {
-      uint32_t const iAsyncUpdaterThreshold = 7500 * 5; // we can process 7500 bricks/ms (1500 running debug build)
+      uint32_t const iAsyncUpdaterThreshold = 50000 * 5; // a rebuild processes about 50000 bricks/ms and thread, moving the TF window is much cheaper
       if (m_iTotalBrickCount > iAsyncUpdaterThreshold)
         m_pUpdater = new AsyncVisibilityUpdater(*this);
     }
@@ -278,6 +278,9 @@ void GLVolumePool::PH_Reset(const VisibilityState& visibility, size_t iTimestep)
   // restore largest single brick flag
   m_vBrickMetadata[iLastBrickIndex] = iLastBrickFlag;
 
+  // the metadata does not match the visibility state anymore
+  m_pVisibility->Invalidate();
+
   RecomputeVisibility(visibility, iTimestep, true);
 }
 
@@ -302,6 +305,22 @@ UINTVECTOR4 GLVolumePool::GetVectorBrickID(uint32_t iBrickID) const {
                      lod);
 }
 
+void GLVolumePool::FetchMinMax(size_t iTimestep, bool bGradient) {
+  std::vector<double> vMin(m_iTotalBrickCount);
+  std::vector<double> vMax(m_iTotalBrickCount);
+  for (uint32_t iBrickID = 0; iBrickID < m_iTotalBrickCount; iBrickID++) {
+    UINTVECTOR4 const vBrickID = GetVectorBrickID(iBrickID);
+    BrickKey const key = m_pDataset->IndexFrom4D(vBrickID, iTimestep);
+    MinMaxBlock imme = m_pDataset->MaxMinForKey(key);
+    vMin[iBrickID] = bGradient ? imme.minGradient : imme.minScalar;
+    vMax[iBrickID] = bGradient ? imme.maxGradient : imme.maxScalar;
+  }
+  if (bGradient)
+    m_pVisibility->SetGradientRanges(std::move(vMin), std::move(vMax));
+  else
+    m_pVisibility->SetScalarRanges(std::move(vMin), std::move(vMax));
+}
+
 UINTVECTOR3 const& GLVolumePool::GetPoolCapacity() const {
   return m_vPoolCapacity;
 }
@@ -670,7 +689,7 @@ std::string GLVolumePool::GetShaderFragment(uint32_t iMetaTextureUnit,
 }
 
 
-void GLVolumePool::UploadBrick(uint32_t iBrickID, const UINTVECTOR3& vVoxelSize, void* pData, 
+void GLVolumePool::UploadBrick(uint32_t iBrickID, const UINTVECTOR3& vVoxelSize, const void* pData, 
                                size_t iInsertPos, uint64_t iTimeOfCreation)
 {
   StackTimer ubrick(PERF_POOL_UPLOAD_BRICK);
@@ -725,12 +744,16 @@ namespace {
     const LinearIndexDataset* pDataset
   ) {
     const UINTVECTOR3 vVoxelCount = pDataset->GetBrickVoxelCounts(bkey);
-    std::vector<T> vUploadMem(vVoxelCount.volume());
+    std::shared_ptr<const BrickBuffer> brick;
     {
       tuvok::StackTimer poolGetBrick(PERF_POOL_GET_BRICK);
-      pDataset->GetBrick(bkey, vUploadMem);
+      brick = pDataset->GetBrickBuffer(bkey);
+    }
+    if (!brick) {
+      throw Exception("Could not read the first brick", _func_, __LINE__);
     }
-    pool.UploadFirstBrick(vVoxelCount, &vUploadMem[0]);
+    assert(brick->holds<T>());
+    pool.UploadFirstBrick(vVoxelCount, brick->data());
   }
 
 }
@@ -760,12 +783,12 @@ void GLVolumePool::UploadFirstBrick(const BrickKey& bkey) {
   }
 }
 
-void GLVolumePool::UploadFirstBrick(const UINTVECTOR3& m_vVoxelSize, void* pData) {
+void GLVolumePool::UploadFirstBrick(const UINTVECTOR3& m_vVoxelSize, const void* pData) {
   uint32_t iLastBrickIndex = *(m_vLoDOffsetTable.end()-1);
   UploadBrick(iLastBrickIndex, m_vVoxelSize, pData, m_vPoolSlotData.size()-1, std::numeric_limits<uint64_t>::max());
 }
 
-bool GLVolumePool::UploadBrick(const BrickElemInfo& metaData, void* pData) {
+bool GLVolumePool::UploadBrick(const BrickElemInfo& metaData, const void* pData) {
   // in this frame we already replaced all bricks (except the single low-res brick)
   // in the pool so now we should render them first
   if (m_iInsertPos >= m_vPoolSlotData.size()-1)
@@ -809,6 +832,7 @@ void GLVolumePool::Disable() const {
 GLVolumePool::~GLVolumePool() {
   if (m_pUpdater)
     delete m_pUpdater;
+  delete m_pVisibility;
 
   FreeGLResources();
 }
@@ -959,46 +983,63 @@ void GLVolumePool::PrepareForPaging() {
 }
 
 namespace {
-  template<AbstrRenderer::ERenderMode eRenderMode>
-  bool ContainsData(VisibilityState const& visibility, uint32_t iBrickID,
-                    std::vector<GLVolumePool::MinMax> const& vMinMaxScalar,
-                    std::vector<GLVolumePool::MinMax> const& vMinMaxGradient)
+  bool GetWindow(VisibilityState const& visibility, BrickVisibility::Window& window)
   {
-    assert(eRenderMode == visibility.GetRenderMode());
-    static_assert(eRenderMode == AbstrRenderer::RM_1DTRANS ||
-                  eRenderMode == AbstrRenderer::RM_2DTRANS ||
-                  eRenderMode == AbstrRenderer::RM_ISOSURFACE, "render mode not supported");
-    switch (eRenderMode) {
+    switch (visibility.GetRenderMode()) {
     case AbstrRenderer::RM_1DTRANS:
-      return (visibility.Get1DTransfer().fMax >= vMinMaxScalar[iBrickID].min &&
-              visibility.Get1DTransfer().fMin <= vMinMaxScalar[iBrickID].max);
-      break;
+      window = BrickVisibility::Window(visibility.Get1DTransfer().fMin,
+                                       visibility.Get1DTransfer().fMax);
+      return true;
     case AbstrRenderer::RM_2DTRANS:
-      return (visibility.Get2DTransfer().fMax >= vMinMaxScalar[iBrickID].min &&
-              visibility.Get2DTransfer().fMin <= vMinMaxScalar[iBrickID].max)
-              &&
-             (visibility.Get2DTransfer().fMaxGradient >= vMinMaxGradient[iBrickID].min &&
-              visibility.Get2DTransfer().fMinGradient <= vMinMaxGradient[iBrickID].max);
-      break;
+      window = BrickVisibility::Window(visibility.Get2DTransfer().fMin,
+                                       visibility.Get2DTransfer().fMax,
+                                       visibility.Get2DTransfer().fMinGradient,
+                                       visibility.Get2DTransfer().fMaxGradient);
+      return true;
     case AbstrRenderer::RM_ISOSURFACE:
-      return (visibility.GetIsoSurface().fIsoValue >= vMinMaxScalar[iBrickID].min &&
-              visibility.GetIsoSurface().fIsoValue <= vMinMaxScalar[iBrickID].max);
-      break;
+      window = BrickVisibility::Window(visibility.GetIsoSurface().fIsoValue,
+                                       visibility.GetIsoSurface().fIsoValue);
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // metadata of a brick that is not in the pool
+  uint32_t MetadataFlag(BrickVisibility::State state)
+  {
+    switch (state) {
+    case BrickVisibility::EMPTY:       return BI_EMPTY;
+    case BrickVisibility::CHILD_EMPTY: return BI_CHILD_EMPTY;
+    default:                           return BI_MISSING;
+    }
+  }
+
+  // copies the visibility state of the given bricks (of all bricks if
+  // pBrickIDs is NULL) into the metadata, skipping bricks cached in the pool
+  void ApplyVisibility(BrickVisibility const& visibility,
+                       std::vector<uint32_t>& vBrickMetadata,
+                       std::vector<uint32_t> const* pBrickIDs)
+  {
+    int const iCount = int(pBrickIDs ? pBrickIDs->size() : visibility.GetBrickCount());
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < iCount; i++) {
+      uint32_t const brickIndex = pBrickIDs ? (*pBrickIDs)[i] : uint32_t(i);
+      if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT)
+        vBrickMetadata[brickIndex] = MetadataFlag(visibility.GetState(brickIndex));
     }
-    return true;
   }
 
-  template<AbstrRenderer::ERenderMode eRenderMode>
+  // bStateKnown tells whether the state of visibility matches window, if it
+  // does not, invisible bricks are flagged BI_EMPTY for now
   void RecomputeVisibilityForBrickPool(
-    VisibilityState const& visibility, GLVolumePool const& pool,
-    std::vector<uint32_t>& vBrickMetadata, std::vector<PoolSlotData>& vBrickPool,
-    std::vector<GLVolumePool::MinMax> const& vMinMaxScalar,
-    std::vector<GLVolumePool::MinMax> const& vMinMaxGradient)
+    BrickVisibility const& visibility, BrickVisibility::Window const& window,
+    bool bStateKnown, GLVolumePool const& pool,
+    std::vector<uint32_t>& vBrickMetadata, std::vector<PoolSlotData>& vBrickPool)
   {
-    assert(eRenderMode == visibility.GetRenderMode());
     for (auto slot = vBrickPool.begin(); slot < vBrickPool.end(); slot++) {
       if (slot->WasEverUsed()) {
-        bool const bContainsData = ContainsData<eRenderMode>(visibility, slot->m_iBrickID, vMinMaxScalar, vMinMaxGradient);
+        bool const bContainsData = visibility.Test(slot->m_iBrickID, window);
         bool const bContainedData = slot->ContainsVisibleBrick();
 
         if (bContainsData) {
@@ -1011,383 +1052,48 @@ namespace {
         } else {
           if (bContainedData)
             slot->FlagEmpty();
-          vBrickMetadata[slot->m_iBrickID] = BI_EMPTY;
+          vBrickMetadata[slot->m_iBrickID] = bStateKnown ? MetadataFlag(visibility.GetState(slot->m_iBrickID)) : uint32_t(BI_EMPTY);
         }
       }
     } // for all slots in brick pool
   }
 
-  template<bool bInterruptable, AbstrRenderer::ERenderMode eRenderMode>
-  UINTVECTOR4 RecomputeVisibilityForOctree(
-    VisibilityState const& visibility, GLVolumePool const& pool,
-    std::vector<uint32_t>& vBrickMetadata,
-    std::vector<GLVolumePool::MinMax> const& vMinMaxScalar,
-    std::vector<GLVolumePool::MinMax> const& vMinMaxGradient,
-    tuvok::ThreadClass::PredicateFunction pContinue = tuvok::ThreadClass::PredicateFunction())
-  {
-    UINTVECTOR4 vEmptyBrickCount(0, 0, 0, 0);
-#ifndef _DEBUG
-    uint32_t const iContinue = 375; // we approximately process 7500 bricks/ms, checking for interruption every 375 bricks allows us to pause in 0.05 ms (worst case)
-#else
-    uint32_t const iContinue = 75; // we'll just get 1500 bricks/ms running a debug build
-#endif
-    uint32_t const iLoDCount = pool.GetLoDCount();
-    UINTVECTOR3 iChildLayout = GetBrickLayout(pool.GetVolumeSize(), pool.GetMaxInnerBrickSize(), 0);
-
-    // evaluate child visibility for finest level
-    for (uint32_t z = 0; z < iChildLayout.z; z++) {
-      for (uint32_t y = 0; y < iChildLayout.y; y++) {
-        for (uint32_t x = 0; x < iChildLayout.x; x++) {
-
-          if (bInterruptable && !(x % iContinue)/* && pContinue*/)
-            if (!pContinue())
-              return vEmptyBrickCount;
-
-          vEmptyBrickCount.x++; // increment total brick count
-
-          UINTVECTOR4 const vBrickID(x, y, z, 0);
-          uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-          if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-          {
-            bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-            if (!bContainsData) {
-              vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // finest level bricks are all child empty by definition
-              vEmptyBrickCount.w++; // increment leaf empty brick count
-            }
-          }
-        } // for x
-      } // for y
-    } // for z
-
-    // walk up hierarchy (from finest to coarsest level) and propagate child empty visibility
-    for (uint32_t iLoD = 1; iLoD < iLoDCount; iLoD++)
-    {
-      UINTVECTOR3 const iLayout = GetBrickLayout(pool.GetVolumeSize(), pool.GetMaxInnerBrickSize(), iLoD);
-
-      // process even-sized volume
-      UINTVECTOR3 const iEvenLayout = iChildLayout / 2;
-      for (uint32_t z = 0; z < iEvenLayout.z; z++) {
-        for (uint32_t y = 0; y < iEvenLayout.y; y++) {
-          for (uint32_t x = 0; x < iEvenLayout.x; x++) {
-
-            if (bInterruptable && !(x % iContinue)/* && pContinue*/)
-              if (!pContinue())
-                return vEmptyBrickCount;
-
-            vEmptyBrickCount.x++; // increment total brick count
-
-            UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-            uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-            if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-            {
-              bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-              if (!bContainsData) {
-                vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-                UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-                if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 0, 1, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 1, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 1, 1, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 0, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 0, 1, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 1, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 1, 1, 0))] != BI_CHILD_EMPTY))
-                {
-                  vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non child empty child
-                  vEmptyBrickCount.y++; // increment empty brick count
-                } else {
-                  vEmptyBrickCount.z++; // increment child empty brick count
-                }
-              }
-            }
-          } // for x
-        } // for y
-      } // for z
-
-      // process odd boundaries (if any)
-
-      // plane at the end of the x-axis
-      if (iChildLayout.x % 2) {
-        for (uint32_t z = 0; z < iEvenLayout.z; z++) {
-          for (uint32_t y = 0; y < iEvenLayout.y; y++) {
-
-            if (bInterruptable && !(y % iContinue)/* && pContinue*/)
-              if (!pContinue())
-                return vEmptyBrickCount;
-
-            vEmptyBrickCount.x++; // increment total brick count
-
-            uint32_t const x = iLayout.x - 1;
-            UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-            uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-            if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-            {
-              bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-              if (!bContainsData) {
-                vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-                UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-                if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 0, 1, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 1, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 1, 1, 0))] != BI_CHILD_EMPTY))
-                {
-                  vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non child empty child
-                  vEmptyBrickCount.y++; // increment empty brick count
-                } else {
-                  vEmptyBrickCount.z++; // increment child empty brick count
-                }
-              }
-            }
-          } // for y
-        } // for z
-      } // if x is odd
-
-      // plane at the end of the y-axis
-      if (iChildLayout.y % 2) {
-        for (uint32_t z = 0; z < iEvenLayout.z; z++) {
-          for (uint32_t x = 0; x < iEvenLayout.x; x++) {
-
-            if (bInterruptable && !(x % iContinue)/* && pContinue*/)
-              if (!pContinue())
-                return vEmptyBrickCount;
-
-            vEmptyBrickCount.x++; // increment total brick count
-
-            uint32_t const y = iLayout.y - 1;
-            UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-            uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-            if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-            {
-              bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-              if (!bContainsData) {
-                vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-                UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-                if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 0, 1, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 0, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 0, 1, 0))] != BI_CHILD_EMPTY))
-                {
-                  vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non-empty child
-                  vEmptyBrickCount.y++; // increment empty brick count
-                } else {
-                  vEmptyBrickCount.z++; // increment child empty brick count
-                }
-              }
-            }
-          } // for x
-        } // for z
-      } // if y is odd
-
-      // plane at the end of the z-axis
-      if (iChildLayout.z % 2) {
-        for (uint32_t y = 0; y < iEvenLayout.y; y++) {
-          for (uint32_t x = 0; x < iEvenLayout.x; x++) {
-
-            if (bInterruptable && !(x % iContinue)/* && pContinue*/)
-              if (!pContinue())
-                return vEmptyBrickCount;
-
-            vEmptyBrickCount.x++; // increment total brick count
-
-            uint32_t const z = iLayout.z - 1;
-            UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-            uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-            if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-            {
-              bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-              if (!bContainsData) {
-                vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-                UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-                if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 1, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 0, 0, 0))] != BI_CHILD_EMPTY) ||
-                    (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 1, 0, 0))] != BI_CHILD_EMPTY))
-                {
-                  vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non-empty child
-                  vEmptyBrickCount.y++; // increment empty brick count
-                } else {
-                  vEmptyBrickCount.z++; // increment child empty brick count
-                }
-              }
-            }
-          } // for x
-        } // for y
-      } // if z is odd
-
-      // line at the end of the x/y-axes
-      if (iChildLayout.x % 2 && iChildLayout.y % 2) {
-        for (uint32_t z = 0; z < iEvenLayout.z; z++) {
-
-          if (bInterruptable && !(z % iContinue)/* && pContinue*/)
-            if (!pContinue())
-              return vEmptyBrickCount;
-
-          vEmptyBrickCount.x++; // increment total brick count
-
-          uint32_t const y = iLayout.y - 1;
-          uint32_t const x = iLayout.x - 1;
-          UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-          uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-          if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-          {
-            bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-            if (!bContainsData) {
-              vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-            
-              UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-              if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                  (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 0, 1, 0))] != BI_CHILD_EMPTY))
-              {
-                vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non-empty child
-                vEmptyBrickCount.y++; // increment empty brick count
-              } else {
-                vEmptyBrickCount.z++; // increment child empty brick count
-              }
-            }
-          }
-        } // for z
-      } // if x and y are odd
-
-      // line at the end of the x/z-axes
-      if (iChildLayout.x % 2 && iChildLayout.z % 2) {
-        for (uint32_t y = 0; y < iEvenLayout.y; y++) {
-
-          if (bInterruptable && !(y % iContinue)/* && pContinue*/)
-            if (!pContinue())
-              return vEmptyBrickCount;
-
-          vEmptyBrickCount.x++; // increment total brick count
-
-          uint32_t const z = iLayout.z - 1;
-          uint32_t const x = iLayout.x - 1;
-          UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-          uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-          if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-          {
-            bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-            if (!bContainsData) {
-              vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-              UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-              if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                  (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(0, 1, 0, 0))] != BI_CHILD_EMPTY))
-              {
-                vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non-empty child
-                vEmptyBrickCount.y++; // increment empty brick count
-              } else {
-                vEmptyBrickCount.z++; // increment child empty brick count
-              }
-            }
-          }
-        } // for y
-      } // if x and z are odd
-
-      // line at the end of the y/z-axes
-      if (iChildLayout.y % 2 && iChildLayout.z % 2) {
-        for (uint32_t x = 0; x < iEvenLayout.x; x++) {
-
-          if (bInterruptable && !(x % iContinue)/* && pContinue*/)
-            if (!pContinue())
-              return vEmptyBrickCount;
-
-          vEmptyBrickCount.x++; // increment total brick count
-
-          uint32_t const z = iLayout.z - 1;
-          uint32_t const y = iLayout.y - 1;
-          UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-          uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-          if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-          {
-            bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-            if (!bContainsData) {
-              vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-              UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-              if ((vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY) ||
-                  (vBrickMetadata[pool.GetIntegerBrickID(childPosition + UINTVECTOR4(1, 0, 0, 0))] != BI_CHILD_EMPTY))
-              {
-                vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non-empty child
-                vEmptyBrickCount.y++; // increment empty brick count
-              } else {
-                vEmptyBrickCount.z++; // increment child empty brick count
-              }
-            }
-          }
-        } // for x
-      } // if y and z are odd
-
-      // single brick at the x/y/z corner
-      if (iChildLayout.x % 2 && iChildLayout.y % 2 && iChildLayout.z % 2) {
-
-        if (bInterruptable /* && pContinue*/)
-          if (!pContinue())
-            return vEmptyBrickCount;
-
-        vEmptyBrickCount.x++; // increment total brick count
-
-        uint32_t const z = iLayout.z - 1;
-        uint32_t const y = iLayout.y - 1;
-        uint32_t const x = iLayout.x - 1;
-        UINTVECTOR4 const vBrickID(x, y, z, iLoD);
-        uint32_t const brickIndex = pool.GetIntegerBrickID(vBrickID);
-        if (vBrickMetadata[brickIndex] < BI_FLAG_COUNT) // only check bricks that are not cached in the pool
-        {
-          bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
-          if (!bContainsData) {
-            vBrickMetadata[brickIndex] = BI_CHILD_EMPTY; // flag parent brick to be child empty for now so that we can save a couple of tests below
-
-            UINTVECTOR4 const childPosition(x*2, y*2, z*2, iLoD-1);
-            if (vBrickMetadata[pool.GetIntegerBrickID(childPosition)] != BI_CHILD_EMPTY)
-            {
-              vBrickMetadata[brickIndex] = BI_EMPTY; // downgrade parent brick if we found a non-empty child
-              vEmptyBrickCount.y++; // increment empty brick count
-            } else {
-              vEmptyBrickCount.z++; // increment child empty brick count
-            }
-          }
-        }
-      } // if x, y and z are odd
-
-      iChildLayout = iLayout;
-    } // for all levels
-
-    return vEmptyBrickCount;
-  }
-
   template<typename T, bool brickDebug>
   uint32_t UploadBricksToBrickPoolT(
     GLVolumePool& pool,
     std::vector<UINTVECTOR4> const& vBrickIDs,
     const LinearIndexDataset* pDataset,
     size_t iTimestep,
-    const size_t maxUsedBrickVoxelCount // we pass it in here to avoid the pDataset->GetMaxUsedBrickSize() loop over all bricks
+    const size_t /*maxUsedBrickVoxelCount*/ // bricks come in their own (possibly cached) buffers now
   ) {
     uint32_t iPagedBricks = 0;
-    std::vector<T> vUploadMem(maxUsedBrickVoxelCount);
     Timer t;
     for (auto missingBrick = vBrickIDs.cbegin(); missingBrick < vBrickIDs.cend(); missingBrick++) {
       UINTVECTOR4 const& vBrickID = *missingBrick;
       BrickKey const key = pDataset->IndexFrom4D(vBrickID, iTimestep);
       UINTVECTOR3 const vVoxelSize = pDataset->GetBrickVoxelCounts(key);
 
-      // upload brick core
+      // upload brick core; on a cache hit this does not copy the data at all
+      std::shared_ptr<const BrickBuffer> brick;
       {
         tuvok::StackTimer poolGetBrick(PERF_POOL_GET_BRICK);
-        pDataset->GetBrick(key, vUploadMem);
+        brick = pDataset->GetBrickBuffer(key);
+      }
+      if (!brick) {
+        T_ERROR("Could not read brick <%u,%u,%u>", unsigned(std::get<0>(key)),
+                unsigned(std::get<1>(key)), unsigned(std::get<2>(key)));
+        break;
       }
+      assert(brick->holds<T>());
       if (brickDebug) {
-        writeBrick(key, vUploadMem);
+        writeBrickT<const T*, T>(key, brick->as<T>(), brick->as<T>()+brick->size());
       }
-      if (!pool.UploadBrick(BrickElemInfo(vBrickID, vVoxelSize), &vUploadMem[0]))
+      if (!pool.UploadBrick(BrickElemInfo(vBrickID, vVoxelSize), brick->data()))
         break;
       else
         iPagedBricks++;
 
-      tuvok::Controller::Instance().IncrementPerfCounter(PERF_POOL_UPLOADED_MEM, double(vUploadMem.size() * sizeof(T)));
+      tuvok::Controller::Instance().IncrementPerfCounter(PERF_POOL_UPLOADED_MEM, double(brick->bytes()));
     }
     return iPagedBricks;
   }
@@ -1400,6 +1106,14 @@ namespace {
     const size_t maxUsedBrickVoxelCount, // we pass it in here to avoid the pDataset->GetMaxUsedBrickSize() loop over all bricks
     bool brickDebug
   ) {
+    // let the dataset read and decompress the later bricks while we are
+    // still uploading the first ones.
+    std::vector<BrickKey> keys;
+    keys.reserve(vBrickIDs.size());
+    for (auto id = vBrickIDs.cbegin(); id != vBrickIDs.cend(); ++id)
+      keys.push_back(pDataset->IndexFrom4D(*id, iTimestep));
+    pDataset->Prefetch(keys);
+
     unsigned int const iBitWidth = pDataset->GetBitWidth();
     if (brickDebug) {
       // brick debugging enabled
@@ -1451,20 +1165,18 @@ namespace {
     //return 0;
   }
 
-  template<AbstrRenderer::ERenderMode eRenderMode, typename T, bool brickDebug>
+  template<typename T, bool brickDebug>
   uint32_t PotentiallyUploadBricksToBrickPoolT(
-    const VisibilityState& visibility,
+    const BrickVisibility& visibility,
+    const BrickVisibility::Window& window,
     const LinearIndexDataset* pDataset,
     size_t iTimestep,
     GLVolumePool& pool,
     std::vector<uint32_t>& vBrickMetadata,
     const std::vector<UINTVECTOR4>& vBrickIDs,
-    const std::vector<GLVolumePool::MinMax>& vMinMaxScalar,
-    const std::vector<GLVolumePool::MinMax>& vMinMaxGradient,
-    const size_t maxUsedBrickVoxelCount // we pass it in here to avoid the pDataset->GetMaxUsedBrickSize() loop over all bricks
+    const size_t /*maxUsedBrickVoxelCount*/ // bricks come in their own (possibly cached) buffers now
   ) {
     uint32_t iPagedBricks = 0;
-    std::vector<T> vUploadMem(maxUsedBrickVoxelCount);
 
     // now iterate over the missing bricks and upload them to the GPU
     // todo: consider batching this if it turns out to make a difference
@@ -1479,23 +1191,30 @@ namespace {
       // the brick could be flagged as empty by now if the async updater tested the brick after we ran the last render pass
       if (vBrickMetadata[brickIndex] == BI_MISSING) {
         // we might not have tested the brick for visibility yet since the updater's still running and we do not have a BI_UNKNOWN flag for now
-        bool const bContainsData = ContainsData<eRenderMode>(visibility, brickIndex, vMinMaxScalar, vMinMaxGradient);
+        bool const bContainsData = visibility.Test(brickIndex, window);
         if (bContainsData) {
 
-          // upload brick core
+          // upload brick core; on a cache hit this does not copy the data at all
+          std::shared_ptr<const BrickBuffer> brick;
           {
             tuvok::StackTimer poolGetBrick(PERF_POOL_GET_BRICK);
-            pDataset->GetBrick(key, vUploadMem);
+            brick = pDataset->GetBrickBuffer(key);
+          }
+          if (!brick) {
+            T_ERROR("Could not read brick <%u,%u,%u>", unsigned(std::get<0>(key)),
+                    unsigned(std::get<1>(key)), unsigned(std::get<2>(key)));
+            return iPagedBricks;
           }
+          assert(brick->holds<T>());
           if(brickDebug) {
-            writeBrick(key, vUploadMem);
+            writeBrickT<const T*, T>(key, brick->as<T>(), brick->as<T>()+brick->size());
           }
-          if (!pool.UploadBrick(BrickElemInfo(vBrickID, vVoxelSize), &vUploadMem[0]))
+          if (!pool.UploadBrick(BrickElemInfo(vBrickID, vVoxelSize), brick->data()))
             return iPagedBricks;
           else
             iPagedBricks++;
 
-          tuvok::Controller::Instance().IncrementPerfCounter(PERF_POOL_UPLOADED_MEM, double(vUploadMem.size() * sizeof(T)));
+          tuvok::Controller::Instance().IncrementPerfCounter(PERF_POOL_UPLOADED_MEM, double(brick->bytes()));
 
         } else {
           vBrickMetadata[brickIndex] = BI_EMPTY;
@@ -1511,16 +1230,14 @@ namespace {
     return iPagedBricks;
   }
 
-  template<AbstrRenderer::ERenderMode eRenderMode>
   uint32_t PotentiallyUploadBricksToBrickPool(
-    const VisibilityState& visibility,
+    const BrickVisibility& visibility,
+    const BrickVisibility::Window& window,
     const LinearIndexDataset* pDataset,
     size_t iTimestep,
     GLVolumePool& pool,
     std::vector<uint32_t>& vBrickMetadata,
     const std::vector<UINTVECTOR4>& vBrickIDs,
-    const std::vector<GLVolumePool::MinMax>& vMinMaxScalar,
-    const std::vector<GLVolumePool::MinMax>& vMinMaxGradient,
     const size_t maxUsedBrickVoxelCount, // we pass it in here to avoid the pDataset->GetMaxUsedBrickSize() loop over all bricks
     bool brickDebug
     ) {
@@ -1529,22 +1246,22 @@ namespace {
         // brick debugging enabled
         if (!pDataset->GetIsSigned()) {
           switch (iBitWidth) {
-          case 8  : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, uint8_t,  true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 16 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, uint16_t, true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 32 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, uint32_t, true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
+          case 8  : return PotentiallyUploadBricksToBrickPoolT<uint8_t,  true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 16 : return PotentiallyUploadBricksToBrickPoolT<uint16_t, true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 32 : return PotentiallyUploadBricksToBrickPoolT<uint32_t, true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
           default : throw Exception("Invalid bit width for an unsigned dataset", _func_, __LINE__);
           }
         } else if (pDataset->GetIsFloat()) {
           switch (iBitWidth) {
-          case 32 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, float,    true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 64 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, double,   true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
+          case 32 : return PotentiallyUploadBricksToBrickPoolT<float,    true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 64 : return PotentiallyUploadBricksToBrickPoolT<double,   true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
           default : throw Exception("Invalid bit width for a float dataset", _func_, __LINE__);
           }
         } else {
           switch (iBitWidth) {
-          case 8  : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, int8_t,   true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 16 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, int16_t,  true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 32 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, int32_t,  true>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
+          case 8  : return PotentiallyUploadBricksToBrickPoolT<int8_t,   true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 16 : return PotentiallyUploadBricksToBrickPoolT<int16_t,  true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 32 : return PotentiallyUploadBricksToBrickPoolT<int32_t,  true>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
           default : throw Exception("Invalid bit width for a signed dataset", _func_, __LINE__);
           }
         }
@@ -1552,22 +1269,22 @@ namespace {
         // brick debugging disabled
         if (!pDataset->GetIsSigned()) {
           switch (iBitWidth) {
-          case 8  : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, uint8_t,  false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 16 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, uint16_t, false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 32 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, uint32_t, false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
+          case 8  : return PotentiallyUploadBricksToBrickPoolT<uint8_t,  false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 16 : return PotentiallyUploadBricksToBrickPoolT<uint16_t, false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 32 : return PotentiallyUploadBricksToBrickPoolT<uint32_t, false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
           default : throw Exception("Invalid bit width for an unsigned dataset", _func_, __LINE__);
           }
         } else if (pDataset->GetIsFloat()) {
           switch (iBitWidth) {
-          case 32 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, float,    false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 64 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, double,   false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
+          case 32 : return PotentiallyUploadBricksToBrickPoolT<float,    false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 64 : return PotentiallyUploadBricksToBrickPoolT<double,   false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
           default : throw Exception("Invalid bit width for a float dataset", _func_, __LINE__);
           }
         } else {
           switch (iBitWidth) {
-          case 8  : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, int8_t,   false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 16 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, int16_t,  false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
-          case 32 : return PotentiallyUploadBricksToBrickPoolT<eRenderMode, int32_t,  false>(visibility, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, vMinMaxScalar, vMinMaxGradient, maxUsedBrickVoxelCount);
+          case 8  : return PotentiallyUploadBricksToBrickPoolT<int8_t,   false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 16 : return PotentiallyUploadBricksToBrickPoolT<int16_t,  false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
+          case 32 : return PotentiallyUploadBricksToBrickPoolT<int32_t,  false>(visibility, window, pDataset, iTimestep, pool, vBrickMetadata, vBrickIDs, maxUsedBrickVoxelCount);
           default : throw Exception("Invalid bit width for a signed dataset", _func_, __LINE__);
           }
         }
@@ -1586,6 +1303,12 @@ UINTVECTOR4 GLVolumePool::RecomputeVisibility(VisibilityState const& visibility,
     return vEmptyBrickCount;
   }
 
+  BrickVisibility::Window window(0.0, 0.0);
+  if (!GetWindow(visibility, window)) {
+    T_ERROR("Unhandled rendering mode.");
+    return vEmptyBrickCount;
+  }
+
 #ifdef GLVOLUMEPOOL_PROFILE
   m_Timer.Start();
 #endif
@@ -1597,112 +1320,84 @@ UINTVECTOR4 GLVolumePool::RecomputeVisibility(VisibilityState const& visibility,
   // fill minmax scalar acceleration data structure if timestep changed
   if (m_iMinMaxScalarTimestep != iTimestep) {
     m_iMinMaxScalarTimestep = iTimestep;
-    for (uint32_t iBrickID = 0; iBrickID < m_vMinMaxScalar.size(); iBrickID++) {
-      UINTVECTOR4 const vBrickID = GetVectorBrickID(iBrickID);
-      BrickKey const key = m_pDataset->IndexFrom4D(vBrickID, m_iMinMaxScalarTimestep);
-      MinMaxBlock imme = m_pDataset->MaxMinForKey(key);
-      m_vMinMaxScalar[iBrickID].min = imme.minScalar;
-      m_vMinMaxScalar[iBrickID].max = imme.maxScalar;
-    }
+    FetchMinMax(iTimestep, false);
   }
 
   // fill minmax gradient acceleration data structure if needed and timestep changed
-  if (visibility.GetRenderMode() == AbstrRenderer::RM_2DTRANS) {
-    if (m_iMinMaxGradientTimestep != iTimestep || m_vMinMaxGradient.empty()) {
-      if (m_vMinMaxGradient.empty())
-        m_vMinMaxGradient.resize(m_iTotalBrickCount);
+  if (window.bGradient) {
+    if (m_iMinMaxGradientTimestep != iTimestep || !m_pVisibility->HasGradientRanges()) {
       m_iMinMaxGradientTimestep = iTimestep;
-      for (uint32_t iBrickID = 0; iBrickID < m_vMinMaxScalar.size(); iBrickID++) {
-        UINTVECTOR4 const vBrickID = GetVectorBrickID(iBrickID);
-        BrickKey const key = m_pDataset->IndexFrom4D(vBrickID, m_iMinMaxGradientTimestep);
-        MinMaxBlock imme = m_pDataset->MaxMinForKey(key);
-        m_vMinMaxGradient[iBrickID].min = imme.minGradient;
-        m_vMinMaxGradient[iBrickID].max = imme.maxGradient;
-      }
+      FetchMinMax(iTimestep, true);
     }
   }
 
-  // reset meta data for all bricks (BI_MISSING means that we haven't test the data for visibility until the async updater finishes)
-  std::fill(m_vBrickMetadata.begin(), m_vBrickMetadata.end(), BI_MISSING);
+  // moving the window only touches the bricks whose visibility flips, so we
+  // can always afford that synchronously, only a rebuild of the whole
+  // hierarchy is left to the async updater
+  bool const bIncremental = m_pVisibility->CanUpdate(window);
+  if (!m_pUpdater || bForceSynchronousUpdate || bIncremental) {
+    std::vector<uint32_t> const& vChangedBrickIDs = m_pVisibility->Update(window);
 
-  // TODO: if metadata texture grows too large (14 ms CPU update time for approx 2000x2000 texture) consider to
-  //       update texel regions efficiently that will be toched by RecomputeVisibilityForBrickPool()
-  //       updating every single texel turned out to be not efficient in this case
-/*
-  m_pPoolMetadataTexture->Write();
-  GL(glClearColor(0, 0, 0, 0)); // clears metadata texture to BI_MISSING that equals zero
-  GL(glClear(GL_COLOR_BUFFER_BIT));
-  m_pPoolMetadataTexture->FinishWrite();
-*/
+    // if the async updater did not finish, the metadata does not match
+    // the previous state and we have to copy all of it
+    ApplyVisibility(*m_pVisibility, m_vBrickMetadata,
+                    (bIncremental && m_bVisibilityUpdated) ? &vChangedBrickIDs : NULL);
 
 #ifdef GLVOLUMEPOOL_PROFILE
-  double const t = m_Timer.Elapsed();
+    double const t = m_Timer.Elapsed();
 #endif
-  // recompute visibility for cached bricks immediately
-  switch (visibility.GetRenderMode()) {
-  case AbstrRenderer::RM_1DTRANS:
-    RecomputeVisibilityForBrickPool<AbstrRenderer::RM_1DTRANS>(visibility, *this, m_vBrickMetadata, m_vPoolSlotData, m_vMinMaxScalar, m_vMinMaxGradient);
-    break;
-  case AbstrRenderer::RM_2DTRANS:
-    RecomputeVisibilityForBrickPool<AbstrRenderer::RM_2DTRANS>(visibility, *this, m_vBrickMetadata, m_vPoolSlotData, m_vMinMaxScalar, m_vMinMaxGradient);
-    break;
-  case AbstrRenderer::RM_ISOSURFACE:
-    RecomputeVisibilityForBrickPool<AbstrRenderer::RM_ISOSURFACE>(visibility, *this, m_vBrickMetadata, m_vPoolSlotData, m_vMinMaxScalar, m_vMinMaxGradient);
-    break;
-  default:
-    T_ERROR("Unhandled rendering mode.");
-    return vEmptyBrickCount;
-  }
+    RecomputeVisibilityForBrickPool(*m_pVisibility, window, true, *this, m_vBrickMetadata, m_vPoolSlotData);
 #ifdef GLVOLUMEPOOL_PROFILE
-  m_TimesRecomputeVisibilityForBrickPool.Push(m_Timer.Elapsed() - t);
+    m_TimesRecomputeVisibilityForBrickPool.Push(static_cast<float>(m_Timer.Elapsed() - t));
 #endif
 
-  if (!m_pUpdater || bForceSynchronousUpdate) {
-    // recompute visibility for the entire hierarchy immediately
-    switch (visibility.GetRenderMode()) {
-    case AbstrRenderer::RM_1DTRANS:
-      vEmptyBrickCount = RecomputeVisibilityForOctree<false, AbstrRenderer::RM_1DTRANS>(visibility, *this, m_vBrickMetadata, m_vMinMaxScalar, m_vMinMaxGradient);
-      break;
-    case AbstrRenderer::RM_2DTRANS:
-      vEmptyBrickCount = RecomputeVisibilityForOctree<false, AbstrRenderer::RM_2DTRANS>(visibility, *this, m_vBrickMetadata, m_vMinMaxScalar, m_vMinMaxGradient);
-      break;
-    case AbstrRenderer::RM_ISOSURFACE:
-      vEmptyBrickCount = RecomputeVisibilityForOctree<false, AbstrRenderer::RM_ISOSURFACE>(visibility, *this, m_vBrickMetadata, m_vMinMaxScalar, m_vMinMaxGradient);
-      break;
-    default:
-      T_ERROR("Unhandled rendering mode.");
-      return vEmptyBrickCount;
-    }
+    vEmptyBrickCount = m_pVisibility->GetCounts();
     m_bVisibilityUpdated = true; // will be true after we uploaded the metadata texture in the next line
-    if (vEmptyBrickCount.x != m_iTotalBrickCount) {
-      WARNING("%u of %u bricks were processed during synchronous visibility recomputation!");
+
+    if (bIncremental) {
+      OTHER("Incrementally updated brick visibility, %u bricks changed",
+        uint32_t(vChangedBrickIDs.size()));
+    } else {
+      uint32_t const iLeafBrickCount = m_pDataset->GetBrickLayout(0, 0).volume();
+      uint32_t const iInternalBrickCount = m_iTotalBrickCount - iLeafBrickCount;
+
+      MESSAGE("Synchronously recomputed brick visibility for %u bricks",
+        vEmptyBrickCount.x);
+      MESSAGE("%u inner bricks are EMPTY (%.2f%% of inner bricks, %.2f%% of all bricks)",
+        vEmptyBrickCount.y,
+        (static_cast<float>(vEmptyBrickCount.y)/iInternalBrickCount)*100.0f,
+        (static_cast<float>(vEmptyBrickCount.y)/m_iTotalBrickCount)*100.0f);
+      MESSAGE("%u inner bricks are CHILD_EMPTY (%.2f%% of inner bricks, %.2f%% of all bricks)",
+        vEmptyBrickCount.z,
+        (static_cast<float>(vEmptyBrickCount.z)/iInternalBrickCount)*100.0f,
+        (static_cast<float>(vEmptyBrickCount.z)/m_iTotalBrickCount)*100.0f);
+      MESSAGE("%u leaf bricks are empty  (%.2f%% of leaf bricks, %.2f%% of all bricks)",
+        vEmptyBrickCount.w,
+        (static_cast<float>(vEmptyBrickCount.w)/iLeafBrickCount)*100.0f,
+        (static_cast<float>(vEmptyBrickCount.w)/m_iTotalBrickCount)*100.0f);
     }
-    uint32_t const iLeafBrickCount = m_pDataset->GetBrickLayout(0, 0).volume();
-    uint32_t const iInternalBrickCount = m_iTotalBrickCount - iLeafBrickCount;
-
-    MESSAGE("Synchronously recomputed brick visibility for %u bricks",
-      vEmptyBrickCount.x);
-    MESSAGE("%u inner bricks are EMPTY (%.2f%% of inner bricks, %.2f%% of all bricks)",
-      vEmptyBrickCount.y,
-      (static_cast<float>(vEmptyBrickCount.y)/iInternalBrickCount)*100.0f,
-      (static_cast<float>(vEmptyBrickCount.y)/m_iTotalBrickCount)*100.0f);
-    MESSAGE("%u inner bricks are CHILD_EMPTY (%.2f%% of inner bricks, %.2f%% of all bricks)",
-      vEmptyBrickCount.z,
-      (static_cast<float>(vEmptyBrickCount.z)/iInternalBrickCount)*100.0f,
-      (static_cast<float>(vEmptyBrickCount.z)/m_iTotalBrickCount)*100.0f);
-    MESSAGE("%u leaf bricks are empty  (%.2f%% of leaf bricks, %.2f%% of all bricks)",
-      vEmptyBrickCount.w,
-      (static_cast<float>(vEmptyBrickCount.w)/iLeafBrickCount)*100.0f,
-      (static_cast<float>(vEmptyBrickCount.w)/m_iTotalBrickCount)*100.0f);
+  } else {
+    m_bVisibilityUpdated = false;
+
+    // reset meta data for all bricks (BI_MISSING means that we haven't test the data for visibility until the async updater finishes)
+    std::fill(m_vBrickMetadata.begin(), m_vBrickMetadata.end(), BI_MISSING);
+
+#ifdef GLVOLUMEPOOL_PROFILE
+    double const t = m_Timer.Elapsed();
+#endif
+    // recompute visibility for cached bricks immediately
+    RecomputeVisibilityForBrickPool(*m_pVisibility, window, false, *this, m_vBrickMetadata, m_vPoolSlotData);
+#ifdef GLVOLUMEPOOL_PROFILE
+    m_TimesRecomputeVisibilityForBrickPool.Push(static_cast<float>(m_Timer.Elapsed() - t));
+#endif
   }
 
   // upload new metadata to GPU
   UploadMetadataTexture();
 
   // restart async updater because visibility changed
-  if (m_pUpdater && !bForceSynchronousUpdate) {
+  if (!m_bVisibilityUpdated) {
     m_pUpdater->Restart(visibility);
-    m_bVisibilityUpdated = false;
     OTHER("computed visibility for %d bricks in volume pool and started async visibility update for the entire hierarchy", m_vPoolSlotData.size());
   }
 #ifdef GLVOLUMEPOOL_PROFILE
@@ -1730,36 +1425,16 @@ uint32_t GLVolumePool::UploadBricks(const std::vector<UINTVECTOR4>& vBrickIDs,
     PrepareForPaging();
 
     if (!m_bVisibilityUpdated) {
-      VisibilityState const& visibility = m_pUpdater->GetVisibility();
-      switch (visibility.GetRenderMode()) {
-      case AbstrRenderer::RM_1DTRANS:
-        iPagedBricks =
-          PotentiallyUploadBricksToBrickPool<AbstrRenderer::RM_1DTRANS>(
-            visibility, m_pDataset, m_iMinMaxScalarTimestep, *this,
-            m_vBrickMetadata, vBrickIDs, m_vMinMaxScalar, m_vMinMaxGradient,
-            m_iMaxUsedBrickVoxelCount, brickDebug
-          );
-        break;
-      case AbstrRenderer::RM_2DTRANS:
-        iPagedBricks =
-          PotentiallyUploadBricksToBrickPool<AbstrRenderer::RM_2DTRANS>(
-            visibility, m_pDataset, m_iMinMaxScalarTimestep, *this,
-            m_vBrickMetadata, vBrickIDs, m_vMinMaxScalar, m_vMinMaxGradient,
-            m_iMaxUsedBrickVoxelCount, brickDebug
-          );
-        break;
-      case AbstrRenderer::RM_ISOSURFACE:
-        iPagedBricks =
-          PotentiallyUploadBricksToBrickPool<AbstrRenderer::RM_ISOSURFACE>(
-            visibility, m_pDataset, m_iMinMaxScalarTimestep, *this,
-            m_vBrickMetadata, vBrickIDs, m_vMinMaxScalar, m_vMinMaxGradient,
-            m_iMaxUsedBrickVoxelCount, brickDebug
-          );
-        break;
-      default:
+      BrickVisibility::Window window(0.0, 0.0);
+      if (!GetWindow(m_pUpdater->GetVisibility(), window)) {
         T_ERROR("Unhandled rendering mode.");
         return iPagedBricks;
       }
+      iPagedBricks =
+        PotentiallyUploadBricksToBrickPool(
+          *m_pVisibility, window, m_pDataset, m_iMinMaxScalarTimestep, *this,
+          m_vBrickMetadata, vBrickIDs, m_iMaxUsedBrickVoxelCount, brickDebug
+        );
     } else {
       // visibility is updated guaranteeing that requested bricks do contain data
       iPagedBricks = UploadBricksToBrickPool(
@@ -1887,19 +1562,13 @@ void AsyncVisibilityUpdater::ThreadMain(void*)
     m_Timer.Start();
 #endif
 
-    switch (m_Visibility.GetRenderMode()) {
-    case AbstrRenderer::RM_1DTRANS:
-      RecomputeVisibilityForOctree<true, AbstrRenderer::RM_1DTRANS>(m_Visibility, m_Pool, m_Pool.m_vBrickMetadata, m_Pool.m_vMinMaxScalar, m_Pool.m_vMinMaxGradient, pContinue);
-      break;
-    case AbstrRenderer::RM_2DTRANS:
-      RecomputeVisibilityForOctree<true, AbstrRenderer::RM_2DTRANS>(m_Visibility, m_Pool, m_Pool.m_vBrickMetadata, m_Pool.m_vMinMaxScalar, m_Pool.m_vMinMaxGradient, pContinue);
-      break;
-    case AbstrRenderer::RM_ISOSURFACE:
-      RecomputeVisibilityForOctree<true, AbstrRenderer::RM_ISOSURFACE>(m_Visibility, m_Pool, m_Pool.m_vBrickMetadata, m_Pool.m_vMinMaxScalar, m_Pool.m_vMinMaxGradient, pContinue);
-      break;
-    default:
+    // the metadata is copied in one go, so that the parent never sees a
+    // state it does not match
+    BrickVisibility::Window window(0.0, 0.0);
+    if (!GetWindow(m_Visibility, window)) {
       assert(false); //T_ERROR("Unhandled rendering mode.");
-      break;
+    } else if (m_Pool.m_pVisibility->Rebuild(window, pContinue)) {
+      ApplyVisibility(*m_Pool.m_pVisibility, m_Pool.m_vBrickMetadata, NULL);
     }
 
 #ifdef GLVOLUMEPOOL_PROFILE
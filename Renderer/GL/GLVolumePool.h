@@ -21,6 +21,7 @@ namespace tuvok {
   class GLSLProgram;
   class LinearIndexDataset;
   class AsyncVisibilityUpdater;
+  class BrickVisibility;
   class VisibilityState;
 
   class PoolSlotData {
@@ -98,8 +99,8 @@ namespace tuvok {
       void UploadFirstBrick(const BrickKey& bkey);
 
       // returns false if we need to render first before we can continue to upload further bricks
-      bool UploadBrick(const BrickElemInfo& metaData, void* pData); // TODO: we could use the 1D-index here too
-      void UploadFirstBrick(const UINTVECTOR3& m_vVoxelSize, void* pData);
+      bool UploadBrick(const BrickElemInfo& metaData, const void* pData); // TODO: we could use the 1D-index here too
+      void UploadFirstBrick(const UINTVECTOR3& m_vVoxelSize, const void* pData);
       void UploadMetadataTexture();
       void UploadMetadataTexel(uint32_t iBrickID);
       bool IsBrickResident(const UINTVECTOR4& vBrickID) const;
@@ -134,11 +135,6 @@ namespace tuvok {
       UINTVECTOR3 const& GetVolumeSize() const;
       UINTVECTOR3 const& GetMaxInnerBrickSize() const;
 
-      struct MinMax {
-        double min;
-        double max;
-      };
-
       uint64_t GetMaxUsedBrickBytes() const { return m_iMaxUsedBrickBytes; }
 
     protected:
@@ -164,6 +160,7 @@ namespace tuvok {
 
       uint32_t m_iTotalBrickCount;
       LinearIndexDataset* m_pDataset;
+      BrickVisibility* m_pVisibility; // state of every brick, owns the minmax acceleration data
 
       friend class AsyncVisibilityUpdater;
       AsyncVisibilityUpdater* m_pUpdater;
@@ -180,10 +177,8 @@ namespace tuvok {
       std::vector<PoolSlotData> m_vPoolSlotData;   // size of available pool slots
       std::vector<uint32_t>     m_vLoDOffsetTable; // size of LoDs, stores index sums, level 0 is finest
 
-      size_t m_iMinMaxScalarTimestep;        // current timestep of scalar acceleration structure below
-      size_t m_iMinMaxGradientTimestep;      // current timestep of gradient acceleration structure below
-      std::vector<MinMax> m_vMinMaxScalar;   // accelerates access to minmax scalar information, gets constructed in c'tor
-      std::vector<MinMax> m_vMinMaxGradient; // accelerates access to minmax gradient information, gets constructed on first access to safe some mem
+      size_t m_iMinMaxScalarTimestep;        // current timestep of the scalar ranges in m_pVisibility, set in c'tor
+      size_t m_iMinMaxGradientTimestep;      // current timestep of the gradient ranges in m_pVisibility, set on first access to safe some mem
       double m_BrickIOTime;
       uint64_t m_BrickIOBytes;
 
@@ -191,12 +186,15 @@ namespace tuvok {
       uint64_t m_iMaxUsedBrickVoxelCount;
       uint64_t m_iMaxUsedBrickBytes;
 
+      // copies the scalar or gradient ranges of a timestep into m_pVisibility
+      void FetchMinMax(size_t iTimestep, bool bGradient);
+
       void CreateGLResources();
       void FreeGLResources();
 
       void PrepareForPaging();
 
-      void UploadBrick(uint32_t iBrickID, const UINTVECTOR3& vVoxelSize, void* pData, 
+      void UploadBrick(uint32_t iBrickID, const UINTVECTOR3& vVoxelSize, const void* pData, 
                        size_t iInsertPos, uint64_t iTimeOfCreation);
 
       DebugMode const m_eDebugMode;
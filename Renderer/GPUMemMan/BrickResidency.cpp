@@ -0,0 +1,75 @@
+#include <functional>
+#include "BrickResidency.h"
+
+namespace tuvok {
+
+namespace {
+  // reading a byte from disk, relative to uploading it
+  const double fDiskFactor = 8.0;
+}
+
+ResidencyKey::ResidencyKey(const void* _pDataset, const BrickKey& _key,
+                           bool bIsPaddedToPowerOfTwo,
+                           bool bIsDownsampledTo8Bits, bool bDisableBorder,
+                           bool bEmulate3DWith2DStacks, int _iShareGroupID) :
+  pDataset(_pDataset),
+  key(_key),
+  iFlags((bIsPaddedToPowerOfTwo  ? 1u : 0u) |
+         (bIsDownsampledTo8Bits  ? 2u : 0u) |
+         (bDisableBorder         ? 4u : 0u) |
+         (bEmulate3DWith2DStacks ? 8u : 0u)),
+  iShareGroupID(_iShareGroupID)
+{}
+
+bool ResidencyKey::operator==(const ResidencyKey& other) const {
+  return pDataset == other.pDataset && key == other.key &&
+         iFlags == other.iFlags && iShareGroupID == other.iShareGroupID;
+}
+
+size_t ResidencyKeyHash::operator()(const ResidencyKey& k) const {
+  size_t seed = BKeyHash()(k.key);
+  seed ^= std::hash<const void*>()(k.pDataset) + 0x9e3779b9 +
+          (seed << 6) + (seed >> 2);
+  seed ^= std::hash<unsigned>()(k.iFlags |
+                                (unsigned(k.iShareGroupID) << 4)) +
+          0x9e3779b9 + (seed << 6) + (seed >> 2);
+  return seed;
+}
+
+EvictionInfo::EvictionInfo() :
+  iFrameCounter(0),
+  iIntraFrameCounter(0),
+  iUserCount(0),
+  iBytes(0),
+  iStoredBytes(0),
+  bInMemory(false),
+  iLOD(0)
+{}
+
+double ReloadCost(const EvictionInfo& info) {
+  double cost = double(info.iBytes);
+  if(!info.bInMemory) {
+    cost += fDiskFactor * double(info.iStoredBytes);
+    if(info.iStoredBytes < info.iBytes) { cost += double(info.iBytes); }
+  }
+  // never 0, so that the ages still decide between empty bricks
+  return (cost + 1.0) * double(info.iLOD + 1);
+}
+
+bool EvictBefore(const EvictionInfo& a, const EvictionInfo& b,
+                 uint64_t iFrameCounter) {
+  if(a.iUserCount != b.iUserCount) { return a.iUserCount < b.iUserCount; }
+
+  // frames since the last access; bricks used in this frame count as 1
+  const double fAgeA = double(iFrameCounter > a.iFrameCounter
+                              ? iFrameCounter - a.iFrameCounter : 0) + 1.0;
+  const double fAgeB = double(iFrameCounter > b.iFrameCounter
+                              ? iFrameCounter - b.iFrameCounter : 0) + 1.0;
+  // fAgeA / cost(a) > fAgeB / cost(b), without the divisions
+  const double fScoreA = fAgeA * ReloadCost(b);
+  const double fScoreB = fAgeB * ReloadCost(a);
+  if(fScoreA != fScoreB) { return fScoreA > fScoreB; }
+  return a.iIntraFrameCounter > b.iIntraFrameCounter;
+}
+
+} // namespace tuvok
@@ -0,0 +1,95 @@
+#pragma once
+
+#ifndef TUVOK_BRICKRESIDENCY_H
+#define TUVOK_BRICKRESIDENCY_H
+
+#include "StdTuvokDefines.h"
+#include <cstddef>
+
+#include "IO/Brick.h"
+
+namespace tuvok
+{
+  /// Identifies a brick texture of the memory manager: the same brick of
+  /// the same data set, prepared for upload the same way, for the same
+  /// share group.  Two textures with equal keys are interchangeable.
+  struct ResidencyKey {
+    ResidencyKey(const void* pDataset, const BrickKey& key,
+                 bool bIsPaddedToPowerOfTwo, bool bIsDownsampledTo8Bits,
+                 bool bDisableBorder, bool bEmulate3DWith2DStacks,
+                 int iShareGroupID);
+
+    bool operator==(const ResidencyKey& other) const;
+    bool operator!=(const ResidencyKey& other) const {
+      return !(*this == other);
+    }
+
+    const void* pDataset;
+    BrickKey key;
+    unsigned iFlags; ///< the four format bools, one bit each
+    int iShareGroupID;
+  };
+
+  struct ResidencyKeyHash {
+    size_t operator()(const ResidencyKey& k) const;
+  };
+
+  /// What the eviction policy knows about a resident brick.
+  struct EvictionInfo {
+    EvictionInfo();
+
+    uint64_t iFrameCounter;      ///< frame of the last access
+    uint64_t iIntraFrameCounter; ///< position of that access in its frame
+    uint32_t iUserCount;         ///< renderers currently using the brick
+    uint64_t iBytes;             ///< size of the data to upload
+    uint64_t iStoredBytes;       ///< bytes to read when it is not in memory
+    bool     bInMemory;          ///< a reload does not touch the disk
+    size_t   iLOD;               ///< 0 is the finest level
+  };
+
+  /// @returns the estimated cost of bringing the brick back, in units of
+  /// uploaded bytes.  Disk reads are charged several times their size;
+  /// decompression (stored smaller than in memory) like one more upload.
+  /// Coarse bricks are needed by every progressive frame, so their cost
+  /// grows with the LoD.
+  double ReloadCost(const EvictionInfo& info);
+
+  /// The eviction order: bricks with fewer users go first.  Among those,
+  /// the brick unused for the most frames per unit of reload cost goes
+  /// first, i.e. a brick twice as expensive to reload is kept twice as
+  /// long.  Ties go to the brick accessed last within its frame, like the
+  /// memory manager always did.
+  /// @param iFrameCounter the current frame
+  /// @returns true if a should be evicted before b
+  bool EvictBefore(const EvictionInfo& a, const EvictionInfo& b,
+                   uint64_t iFrameCounter);
+} // namespace tuvok
+
+#endif // TUVOK_BRICKRESIDENCY_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cstring>
+#include "BrickTranscode.h"
+#include "Basics/MathTools.h"
+#include "IO/UVF/ExtendedOctree/VolumeTools.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__i386__) && defined(__SSE2__)) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define BRICKTRANSCODE_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+#endif
+
+namespace tuvok {
+
+TranscodeFormat::TranscodeFormat() :
+  iBitWidth(8),
+  iCompCount(1),
+  bSigned(false),
+  bToggleEndian(false),
+  bDownsampleTo8Bits(false),
+  fMin(0.0),
+  fMax(255.0),
+  bPadToPowerOfTwo(false),
+  bClampBorder(true)
+{}
+
+bool TranscodeFormat::operator==(const TranscodeFormat& other) const {
+  return iBitWidth == other.iBitWidth && iCompCount == other.iCompCount &&
+         bSigned == other.bSigned && bToggleEndian == other.bToggleEndian &&
+         bDownsampleTo8Bits == other.bDownsampleTo8Bits &&
+         fMin == other.fMin && fMax == other.fMax &&
+         bPadToPowerOfTwo == other.bPadToPowerOfTwo &&
+         bClampBorder == other.bClampBorder;
+}
+
+namespace {
+  bool Quantizes(const TranscodeFormat& fmt) {
+    return fmt.bDownsampleTo8Bits && fmt.iBitWidth != 8;
+  }
+  bool Swaps(const TranscodeFormat& fmt) {
+    return fmt.bToggleEndian && fmt.iBitWidth > 8;
+  }
+
+  // scalar definitions of the row kernels; the SIMD versions only handle
+  // the bulk of a row and leave the rest to these.
+  template<typename T> T Swap(T v) {
+    T r;
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(&v);
+    unsigned char* dst = reinterpret_cast<unsigned char*>(&r);
+    for(size_t b=0; b < sizeof(T); ++b) { dst[b] = src[sizeof(T)-1-b]; }
+    return r;
+  }
+  template<typename T> void SwapScalar(const void* pSource, void* pTarget,
+                                       size_t i, size_t n) {
+    const T* src = static_cast<const T*>(pSource);
+    T* dst = static_cast<T*>(pTarget);
+    for(; i < n; ++i) { dst[i] = Swap(src[i]); }
+  }
+
+  void QuantizeScalar(const uint16_t* src, uint8_t* dst, size_t i, size_t n,
+                      float fMin, float fScale, bool bSigned, bool bSwap) {
+    for(; i < n; ++i) {
+      const uint16_t raw = bSwap ? Swap(src[i]) : src[i];
+      const int v = bSigned ? int(int16_t(raw)) : int(raw);
+      float f = (float(v) - fMin) * fScale;
+      f = f > 0.0f ? f : 0.0f;
+      f = f < 255.0f ? f : 255.0f;
+      dst[i] = uint8_t(f);
+    }
+  }
+
+#ifdef BRICKTRANSCODE_X86
+  namespace sse2 {
+    inline __m128i Load(const void* p) {
+      return _mm_loadu_si128(static_cast<const __m128i*>(p));
+    }
+    inline void Store(void* p, __m128i v) {
+      _mm_storeu_si128(static_cast<__m128i*>(p), v);
+    }
+    inline __m128i Swap16(__m128i v) {
+      return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    }
+    inline __m128i Swap32(__m128i v) {
+      v = Swap16(v);
+      v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1));
+      return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,0,1));
+    }
+    inline __m128i Swap64(__m128i v) {
+      v = Swap16(v);
+      v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3));
+      return _mm_shufflehi_epi16(v, _MM_SHUFFLE(0,1,2,3));
+    }
+
+    // returns the number of elements done
+    size_t SwapRow(const void* pSource, void* pTarget, size_t n,
+                   unsigned iByteWidth) {
+      const unsigned char* src = static_cast<const unsigned char*>(pSource);
+      unsigned char* dst = static_cast<unsigned char*>(pTarget);
+      const size_t bytes = (n * iByteWidth) & ~size_t(15);
+      for(size_t b=0; b < bytes; b += 16) {
+        const __m128i v = Load(src + b);
+        switch(iByteWidth) {
+          case 2: Store(dst + b, Swap16(v)); break;
+          case 4: Store(dst + b, Swap32(v)); break;
+          default: Store(dst + b, Swap64(v)); break;
+        }
+      }
+      return bytes / iByteWidth;
+    }
+
+    // 4 floats from 4 (sign or zero extended) 32 bit lanes, quantized
+    inline __m128i Quantize4(__m128i v, __m128 vMin, __m128 vScale) {
+      __m128 f = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(v), vMin), vScale);
+      f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+      return _mm_cvttps_epi32(f);
+    }
+    inline __m128i Widen(__m128i v, bool bHigh, bool bSigned) {
+      if(bSigned) {
+        return _mm_srai_epi32(bHigh ? _mm_unpackhi_epi16(v, v)
+                                    : _mm_unpacklo_epi16(v, v), 16);
+      }
+      return bHigh ? _mm_unpackhi_epi16(v, _mm_setzero_si128())
+                   : _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    }
+
+    size_t QuantizeRow(const uint16_t* src, uint8_t* dst, size_t n,
+                       float fMin, float fScale, bool bSigned, bool bSwap) {
+      const __m128 vMin = _mm_set1_ps(fMin);
+      const __m128 vScale = _mm_set1_ps(fScale);
+      const size_t done = n & ~size_t(15);
+      for(size_t i=0; i < done; i += 16) {
+        __m128i a = Load(src + i);
+        __m128i b = Load(src + i + 8);
+        if(bSwap) { a = Swap16(a); b = Swap16(b); }
+        const __m128i q0 = Quantize4(Widen(a, false, bSigned), vMin, vScale);
+        const __m128i q1 = Quantize4(Widen(a, true, bSigned), vMin, vScale);
+        const __m128i q2 = Quantize4(Widen(b, false, bSigned), vMin, vScale);
+        const __m128i q3 = Quantize4(Widen(b, true, bSigned), vMin, vScale);
+        Store(dst + i, _mm_packus_epi16(_mm_packs_epi32(q0, q1),
+                                        _mm_packs_epi32(q2, q3)));
+      }
+      return done;
+    }
+  }
+
+# if defined(__clang__)
+#  pragma clang attribute push (__attribute__((target("avx2"))), \
+                                apply_to=function)
+# elif defined(__GNUC__)
+#  pragma GCC push_options
+#  pragma GCC target("avx2")
+# endif
+  namespace avx2 {
+    inline __m256i Load(const void* p) {
+      return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+    }
+    inline void Store(void* p, __m256i v) {
+      _mm256_storeu_si256(static_cast<__m256i*>(p), v);
+    }
+    inline __m256i SwapMask(unsigned iByteWidth) {
+      switch(iByteWidth) {
+        case 2: return _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+                                        1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+        case 4: return _mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,
+                                        3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12);
+        default:
+          return _mm256_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,
+                                  7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+      }
+    }
+
+    size_t SwapRow(const void* pSource, void* pTarget, size_t n,
+                   unsigned iByteWidth) {
+      const unsigned char* src = static_cast<const unsigned char*>(pSource);
+      unsigned char* dst = static_cast<unsigned char*>(pTarget);
+      const __m256i mask = SwapMask(iByteWidth);
+      const size_t bytes = (n * iByteWidth) & ~size_t(31);
+      for(size_t b=0; b < bytes; b += 32) {
+        Store(dst + b, _mm256_shuffle_epi8(Load(src + b), mask));
+      }
+      return bytes / iByteWidth;
+    }
+
+    inline __m256i Quantize8(__m128i v, bool bSigned, __m256 vMin,
+                             __m256 vScale) {
+      const __m256i w = bSigned ? _mm256_cvtepi16_epi32(v)
+                                : _mm256_cvtepu16_epi32(v);
+      __m256 f = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(w), vMin),
+                               vScale);
+      f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()),
+                        _mm256_set1_ps(255.0f));
+      return _mm256_cvttps_epi32(f);
+    }
+
+    size_t QuantizeRow(const uint16_t* src, uint8_t* dst, size_t n,
+                       float fMin, float fScale, bool bSigned, bool bSwap) {
+      const __m256 vMin = _mm256_set1_ps(fMin);
+      const __m256 vScale = _mm256_set1_ps(fScale);
+      const __m256i mask = SwapMask(2);
+      const size_t done = n & ~size_t(15);
+      for(size_t i=0; i < done; i += 16) {
+        __m256i v = Load(src + i);
+        if(bSwap) { v = _mm256_shuffle_epi8(v, mask); }
+        const __m256i q0 = Quantize8(_mm256_castsi256_si128(v), bSigned,
+                                     vMin, vScale);
+        const __m256i q1 = Quantize8(_mm256_extracti128_si256(v, 1), bSigned,
+                                     vMin, vScale);
+        // packs works within 128 bit lanes; put the halves back in order
+        const __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(q0, q1),
+                                                   _MM_SHUFFLE(3,1,2,0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_packus_epi16(_mm256_castsi256_si128(p),
+                                          _mm256_extracti128_si256(p, 1)));
+      }
+      return done;
+    }
+  }
+# if defined(__clang__)
+#  pragma clang attribute pop
+# elif defined(__GNUC__)
+#  pragma GCC pop_options
+# endif
+#endif // BRICKTRANSCODE_X86
+}
+
+void SwapBytesRow(const void* pSource, void* pTarget, size_t n,
+                  unsigned iByteWidth) {
+  if(iByteWidth <= 1) {
+    if(pSource != pTarget) { std::memmove(pTarget, pSource, n); }
+    return;
+  }
+  size_t i = 0;
+#ifdef BRICKTRANSCODE_X86
+  switch(VolumeTools::GetSIMDLevel()) {
+    case VolumeTools::SIMD_AVX2:
+      i = avx2::SwapRow(pSource, pTarget, n, iByteWidth);
+      break;
+    case VolumeTools::SIMD_SSE2:
+      i = sse2::SwapRow(pSource, pTarget, n, iByteWidth);
+      break;
+    default: break;
+  }
+#endif
+  switch(iByteWidth) {
+    case 2: SwapScalar<uint16_t>(pSource, pTarget, i, n); break;
+    case 4: SwapScalar<uint32_t>(pSource, pTarget, i, n); break;
+    default: SwapScalar<uint64_t>(pSource, pTarget, i, n); break;
+  }
+}
+
+void QuantizeRow(const uint16_t* pSource, uint8_t* pTarget, size_t n,
+                 float fMin, float fScale, bool bSigned, bool bToggleEndian) {
+  size_t i = 0;
+#ifdef BRICKTRANSCODE_X86
+  switch(VolumeTools::GetSIMDLevel()) {
+    case VolumeTools::SIMD_AVX2:
+      i = avx2::QuantizeRow(pSource, pTarget, n, fMin, fScale, bSigned,
+                            bToggleEndian);
+      break;
+    case VolumeTools::SIMD_SSE2:
+      i = sse2::QuantizeRow(pSource, pTarget, n, fMin, fScale, bSigned,
+                            bToggleEndian);
+      break;
+    default: break;
+  }
+#endif
+  QuantizeScalar(pSource, pTarget, i, n, fMin, fScale, bSigned,
+                 bToggleEndian);
+}
+
+bool NeedsTranscode(const TranscodeFormat& fmt, const UINTVECTOR3& vSize) {
+  return Quantizes(fmt) || Swaps(fmt) || TranscodedSize(fmt, vSize) != vSize;
+}
+
+UINTVECTOR3 TranscodedSize(const TranscodeFormat& fmt,
+                           const UINTVECTOR3& vSize) {
+  if(!fmt.bPadToPowerOfTwo) { return vSize; }
+  return UINTVECTOR3(MathTools::NextPow2(vSize.x),
+                     MathTools::NextPow2(vSize.y),
+                     MathTools::NextPow2(vSize.z));
+}
+
+unsigned TranscodedBitWidth(const TranscodeFormat& fmt) {
+  return Quantizes(fmt) ? 8 : fmt.iBitWidth;
+}
+
+uint64_t TranscodedBytes(const TranscodeFormat& fmt,
+                         const UINTVECTOR3& vSize) {
+  return UINT64VECTOR3(TranscodedSize(fmt, vSize)).volume() *
+         fmt.iCompCount * (TranscodedBitWidth(fmt)/8);
+}
+
+bool TranscodeBrick(const void* pSource, const UINTVECTOR3& vSize,
+                    const TranscodeFormat& fmt, TranscodedBrick& out) {
+  out.vSize = TranscodedSize(fmt, vSize);
+  out.iBitWidth = TranscodedBitWidth(fmt);
+  out.data.resize(size_t(TranscodedBytes(fmt, vSize)));
+  if(out.data.empty()) { return !Quantizes(fmt) || fmt.iBitWidth == 16; }
+  return TranscodeBrick(pSource, vSize, fmt, &out.data[0]);
+}
+
+bool TranscodeBrick(const void* pSource, const UINTVECTOR3& vSize,
+                    const TranscodeFormat& fmt, unsigned char* pTarget) {
+  const bool bQuantize = Quantizes(fmt);
+  if(bQuantize && fmt.iBitWidth != 16) { return false; }
+
+  const UINTVECTOR3 vOutSize = TranscodedSize(fmt, vSize);
+  const size_t iInElem = fmt.iCompCount * (fmt.iBitWidth/8);
+  const size_t iOutElem = fmt.iCompCount * (TranscodedBitWidth(fmt)/8);
+  const size_t iInRow = vSize.x * iInElem;
+  const size_t iOutRow = vOutSize.x * iOutElem;
+  const size_t iOutSlice = iOutRow * vOutSize.y;
+  if(vSize.volume() == 0) {
+    std::memset(pTarget, 0, iOutSlice * vOutSize.z);
+    return true;
+  }
+  const size_t iRowValues = size_t(vSize.x) * fmt.iCompCount;
+  const bool bSwap = Swaps(fmt);
+  const float fMin = float(fmt.fMin);
+  const float fScale = fmt.fMax > fmt.fMin
+                         ? float(255.0 / (fmt.fMax - fmt.fMin)) : 0.0f;
+
+  const unsigned char* src = static_cast<const unsigned char*>(pSource);
+  unsigned char* dst = pTarget;
+  for(size_t z=0; z < vSize.z; ++z) {
+    unsigned char* slice = dst + z*iOutSlice;
+    for(size_t y=0; y < vSize.y; ++y) {
+      const unsigned char* in = src + (z*vSize.y + y)*iInRow;
+      unsigned char* row = slice + y*iOutRow;
+      if(bQuantize) {
+        QuantizeRow(reinterpret_cast<const uint16_t*>(in), row, iRowValues,
+                    fMin, fScale, fmt.bSigned, bSwap);
+      } else if(bSwap) {
+        SwapBytesRow(in, row, iRowValues, fmt.iBitWidth/8);
+      } else {
+        std::memcpy(row, in, iInRow);
+      }
+      // repeat the last voxel once so that the texture behaves like clamp
+      size_t x = vSize.x;
+      if(x < vOutSize.x && fmt.bClampBorder) {
+        std::memcpy(row + x*iOutElem, row + (x-1)*iOutElem, iOutElem);
+        ++x;
+      }
+      std::memset(row + x*iOutElem, 0, (vOutSize.x - x)*iOutElem);
+    }
+    size_t y = vSize.y;
+    if(y < vOutSize.y && fmt.bClampBorder) {
+      std::memcpy(slice + y*iOutRow, slice + (y-1)*iOutRow, iOutRow);
+      ++y;
+    }
+    std::memset(slice + y*iOutRow, 0, (vOutSize.y - y)*iOutRow);
+  }
+  size_t z = vSize.z;
+  if(z < vOutSize.z && fmt.bClampBorder) {
+    std::memcpy(dst + z*iOutSlice, dst + (z-1)*iOutSlice, iOutSlice);
+    ++z;
+  }
+  std::memset(dst + z*iOutSlice, 0, (vOutSize.z - z)*iOutSlice);
+  return true;
+}
+
+} // namespace tuvok
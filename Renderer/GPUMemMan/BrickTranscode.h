@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef TUVOK_BRICKTRANSCODE_H
+#define TUVOK_BRICKTRANSCODE_H
+
+#include "StdTuvokDefines.h"
+#include <cstddef>
+#include <vector>
+
+#include "Basics/Vectors.h"
+
+namespace tuvok
+{
+  /// How a data set stores its bricks and how we want to upload them.
+  /// Everything but the size of a brick, which differs between bricks.
+  struct TranscodeFormat {
+    TranscodeFormat();
+
+    bool operator==(const TranscodeFormat& other) const;
+    bool operator!=(const TranscodeFormat& other) const {
+      return !(*this == other);
+    }
+
+    unsigned iBitWidth;       ///< of one component as stored: 8, 16, 32, 64
+    unsigned iCompCount;
+    bool bSigned;
+    bool bToggleEndian;       ///< stored in the other byte order
+    /// quantize 16 bit data to 8 bit, mapping [fMin, fMax] to [0, 255]
+    bool bDownsampleTo8Bits;
+    double fMin;
+    double fMax;
+    bool bPadToPowerOfTwo;
+    /// padding repeats the last voxel once, like GL_CLAMP would sample it;
+    /// otherwise padding is zero.
+    bool bClampBorder;
+  };
+
+  /// A brick as we upload it.
+  struct TranscodedBrick {
+    TranscodedBrick() : iBitWidth(0) {}
+
+    std::vector<unsigned char> data;
+    UINTVECTOR3 vSize;        ///< voxels, including padding
+    unsigned iBitWidth;       ///< of one component
+  };
+
+  /// @returns true if a brick of the given size can not be uploaded as the
+  /// data set stores it.
+  bool NeedsTranscode(const TranscodeFormat& fmt, const UINTVECTOR3& vSize);
+
+  /// @returns the size of the brick after TranscodeBrick, in voxels
+  UINTVECTOR3 TranscodedSize(const TranscodeFormat& fmt,
+                             const UINTVECTOR3& vSize);
+  /// @returns the component width after TranscodeBrick, in bits
+  unsigned TranscodedBitWidth(const TranscodeFormat& fmt);
+  /// @returns the size of the brick after TranscodeBrick, in bytes
+  uint64_t TranscodedBytes(const TranscodeFormat& fmt,
+                           const UINTVECTOR3& vSize);
+
+  /// Converts a brick into what we upload in a single pass over the data:
+  /// byte order, quantization and padding are applied row by row, and only
+  /// the padding is cleared.  Uses whatever VolumeTools::GetSIMDLevel()
+  /// says.  Thread safe.  'out.data' is only reallocated if it is too
+  /// small.
+  /// @param pSource the brick as the data set stores it
+  /// @param vSize the size of the brick in voxels
+  /// @returns false for formats we cannot convert (quantization of
+  /// anything but 16 bit data).
+  bool TranscodeBrick(const void* pSource, const UINTVECTOR3& vSize,
+                      const TranscodeFormat& fmt, TranscodedBrick& out);
+  /// Same as above, into TranscodedBytes(fmt, vSize) bytes at pTarget.
+  bool TranscodeBrick(const void* pSource, const UINTVECTOR3& vSize,
+                      const TranscodeFormat& fmt, unsigned char* pTarget);
+
+  /// Swaps the byte order of n elements of iByteWidth (1, 2, 4 or 8) bytes.
+  /// pSource and pTarget may be the same.
+  void SwapBytesRow(const void* pSource, void* pTarget, size_t n,
+                    unsigned iByteWidth);
+
+  /// Maps n 16 bit values linearly to 8 bits, in single precision:
+  ///   pTarget[i] = uint8_t(clamp((float(v) - fMin) * fScale, 0, 255))
+  /// where v is pSource[i], byte swapped first if bToggleEndian and read as
+  /// int16_t if bSigned.  SIMD and scalar code give identical results.
+  void QuantizeRow(const uint16_t* pSource, uint8_t* pTarget, size_t n,
+                   float fMin, float fScale, bool bSigned,
+                   bool bToggleEndian);
+} // namespace tuvok
+
+#endif // TUVOK_BRICKTRANSCODE_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -0,0 +1,110 @@
+#include <unordered_set>
+#include "BrickTranscoder.h"
+#include "IO/BrickBuffer.h"
+#include "IO/BrickPrefetcher.h"
+
+namespace tuvok {
+
+BrickTranscoder::BrickTranscoder(SourceFunction source, SizeFunction size,
+                                 uint64_t iMaxBytes, unsigned threads) :
+  m_Source(source),
+  m_Size(size),
+  m_iMaxBytes(iMaxBytes),
+  m_iPreparedBytes(0)
+{
+  m_pPool.reset(new BrickPrefetcher(
+    [this](const BrickKey& k) { this->Transcode(k); }, threads
+  ));
+}
+
+BrickTranscoder::~BrickTranscoder() {
+  // the workers use our members; stop them before those go away.
+  m_pPool.reset();
+}
+
+void BrickTranscoder::Request(const std::vector<BrickKey>& keys,
+                              const TranscodeFormat& fmt) {
+  std::vector<BrickKey> todo;
+  {
+    SCOPEDLOCK(m_Guard);
+    if(fmt != m_Format) {
+      m_Format = fmt;
+      m_Prepared.clear();
+      m_iPreparedBytes = 0;
+    }
+
+    // only ask for what fits: anything beyond that would have to wait
+    // until the bricks we asked for first are taken.
+    std::unordered_set<BrickKey, BKeyHash> wanted;
+    uint64_t bytes = 0;
+    for(auto k = keys.cbegin(); k != keys.cend(); ++k) {
+      const UINTVECTOR3 vSize = m_Size(*k);
+      if(!NeedsTranscode(fmt, vSize)) { continue; }
+      bytes += TranscodedBytes(fmt, vSize);
+      if(bytes > m_iMaxBytes) { break; }
+      wanted.insert(*k);
+      if(m_Prepared.find(*k) == m_Prepared.end()) { todo.push_back(*k); }
+    }
+    for(auto p = m_Prepared.begin(); p != m_Prepared.end(); ) {
+      if(wanted.count(p->first)) { ++p; continue; }
+      m_iPreparedBytes -= p->second->data.size();
+      p = m_Prepared.erase(p);
+    }
+  }
+  m_pPool->Request(todo);
+}
+
+std::shared_ptr<const TranscodedBrick>
+BrickTranscoder::Take(const BrickKey& key, const TranscodeFormat& fmt) {
+  m_pPool->WaitFor(key);
+
+  SCOPEDLOCK(m_Guard);
+  if(fmt != m_Format) { return std::shared_ptr<const TranscodedBrick>(); }
+  auto p = m_Prepared.find(key);
+  if(p == m_Prepared.end()) { return std::shared_ptr<const TranscodedBrick>(); }
+  std::shared_ptr<const TranscodedBrick> brick = p->second;
+  m_iPreparedBytes -= brick->data.size();
+  m_Prepared.erase(p);
+  return brick;
+}
+
+void BrickTranscoder::Wait() {
+  m_pPool->Wait();
+}
+
+size_t BrickTranscoder::Prepared() const {
+  SCOPEDLOCK(m_Guard);
+  return m_Prepared.size();
+}
+
+uint64_t BrickTranscoder::PreparedBytes() const {
+  SCOPEDLOCK(m_Guard);
+  return m_iPreparedBytes;
+}
+
+void BrickTranscoder::Transcode(const BrickKey& key) {
+  TranscodeFormat fmt;
+  {
+    SCOPEDLOCK(m_Guard);
+    if(m_Prepared.find(key) != m_Prepared.end()) { return; }
+    fmt = m_Format;
+  }
+
+  const std::shared_ptr<const BrickBuffer> source = m_Source(key);
+  if(!source) { return; }
+  std::shared_ptr<TranscodedBrick> brick(new TranscodedBrick());
+  // a brick we cannot convert is the render thread's problem; it reports
+  // the error when it converts the brick itself.
+  if(!TranscodeBrick(source->data(), m_Size(key), fmt, *brick)) { return; }
+
+  SCOPEDLOCK(m_Guard);
+  // the request changed while we were busy
+  if(fmt != m_Format ||
+     m_iPreparedBytes + brick->data.size() > m_iMaxBytes) {
+    return;
+  }
+  m_iPreparedBytes += brick->data.size();
+  m_Prepared[key] = brick;
+}
+
+} // namespace tuvok
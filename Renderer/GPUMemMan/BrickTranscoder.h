@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef TUVOK_BRICKTRANSCODER_H
+#define TUVOK_BRICKTRANSCODER_H
+
+#include "StdTuvokDefines.h"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Basics/Threads.h"
+#include "IO/Brick.h"
+#include "BrickTranscode.h"
+
+namespace tuvok
+{
+  class BrickBuffer;
+  class BrickPrefetcher;
+
+  /// Converts bricks for upload (see TranscodeBrick) on a pool of worker
+  /// threads, ahead of the render thread asking for them.  The render
+  /// thread then takes the prepared brick and only uploads it.
+  /// Like the prefetcher, requests replace each other: prepared bricks
+  /// which are no longer requested are dropped.
+  class BrickTranscoder {
+  public:
+    /// @returns the brick as the data set stores it; must be thread safe
+    typedef std::function<std::shared_ptr<const BrickBuffer>
+                          (const BrickKey&)> SourceFunction;
+    /// @returns the size of the brick in voxels; must be thread safe
+    typedef std::function<UINTVECTOR3 (const BrickKey&)> SizeFunction;
+
+    /// @param iMaxBytes how much prepared data we keep at most
+    /// @param threads number of workers; 0 picks one per hardware thread.
+    BrickTranscoder(SourceFunction source, SizeFunction size,
+                    uint64_t iMaxBytes, unsigned threads=0);
+    /// stops all workers.  Bricks in flight are finished first.
+    ~BrickTranscoder();
+
+    /// replaces the requested bricks.  Keys should be sorted by priority,
+    /// most important first; bricks beyond the memory limit and bricks
+    /// which need no conversion are ignored.
+    void Request(const std::vector<BrickKey>& keys,
+                 const TranscodeFormat& fmt);
+    /// @returns the prepared brick and forgets about it, waiting for it if
+    /// a worker is converting it right now.  NULL if the brick was not
+    /// requested in the given format (or could not be converted).
+    std::shared_ptr<const TranscodedBrick> Take(const BrickKey& key,
+                                                const TranscodeFormat& fmt);
+    /// blocks until all requested bricks are prepared.
+    void Wait();
+
+    /// @returns the number of bricks ready to be taken.
+    size_t Prepared() const;
+    uint64_t PreparedBytes() const;
+
+  private:
+    void Transcode(const BrickKey& key);
+
+    SourceFunction                            m_Source;
+    SizeFunction                              m_Size;
+    const uint64_t                            m_iMaxBytes;
+    mutable CriticalSection                   m_Guard;
+    TranscodeFormat                           m_Format;
+    std::unordered_map<BrickKey, std::shared_ptr<const TranscodedBrick>,
+                       BKeyHash>              m_Prepared;
+    uint64_t                                  m_iPreparedBytes;
+    std::unique_ptr<BrickPrefetcher>          m_pPool;
+
+    BrickTranscoder(const BrickTranscoder&);
+    BrickTranscoder& operator=(const BrickTranscoder&);
+  };
+} // namespace tuvok
+
+#endif // TUVOK_BRICKTRANSCODER_H
+
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Interactive Visualization and Data Analysis Group.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
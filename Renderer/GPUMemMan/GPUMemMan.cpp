@@ -53,6 +53,7 @@
 #include "Basics/SysTools.h"
 #include "Controller/Controller.h"
 #include "GPUMemManDataStructs.h"
+#include "BrickTranscoder.h"
 #include "IO/FileBackedDataset.h"
 #include "IO/IOManager.h"
 #include "IO/TransferFunction1D.h"
@@ -114,7 +115,9 @@ GPUMemMan::~GPUMemMan() {
     } catch(std::bad_cast) {
       dbg.Warning(_func_, "Detected unfreed dataset %p.", i->pVolumeDataset);
     }
+    i->pTranscoder.reset();
     delete i->pVolumeDataset;
+    m_iAllocatedCPUMemory -= i->iCPUReserved;
   }
 
   for (SimpleTextureListIter i = m_vpSimpleTextures.begin();
@@ -132,10 +135,12 @@ GPUMemMan::~GPUMemMan() {
        i < m_vpTrans1DList.end(); ++i) {
     dbg.Warning(_func_, "Detected unfreed 1D Transferfunction.");
 
-    m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
-    m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
+    if (i->pTexture) {
+      m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
+      m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
 
-    delete i->pTexture;
+      delete i->pTexture;
+    }
     delete i->pTransferFunction1D;
   }
 
@@ -143,10 +148,12 @@ GPUMemMan::~GPUMemMan() {
        i < m_vpTrans2DList.end(); ++i) {
     dbg.Warning(_func_, "Detected unfreed 2D Transferfunction.");
 
-    m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
-    m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
+    if (i->pTexture) {
+      m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
+      m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
 
-    delete i->pTexture;
+      delete i->pTexture;
+    }
     delete i->pTransferFunction2D;
   }
 
@@ -223,7 +230,35 @@ Dataset* GPUMemMan::LoadDataset(const string& strFilename,
     // false: assume the file has already been verified
     mgr.CreateDataset(strFilename, mgr.GetMaxBrickSize(), false);
 
+  // let UVFs read and decompress bricks ahead of the renderer.  The read
+  // ahead gets an eighth of the CPU memory that is not allocated yet, which
+  // stays charged to this data set until it is freed.  Mapping the file lets
+  // uncompressed bricks skip the read (and the cache) entirely.
+  uint64_t iPrefetchBytes = 0;
+  UVFDataset* uvf = dynamic_cast<UVFDataset*>(dataset);
+  if(uvf) {
+    iPrefetchBytes = GetUnallocatedCPUMem() / 8;
+    uvf->SetMemoryMapping(true);
+    uvf->SetPrefetchCache(iPrefetchBytes, GetNumCPUs());
+  }
+
   m_vpVolumeDatasets.push_back(VolDataListElem(dataset, requester));
+  m_vpVolumeDatasets.back().iCPUReserved = iPrefetchBytes;
+  m_iAllocatedCPUMemory += iPrefetchBytes;
+
+  // UVF bricks can be read from several threads, so we can also convert
+  // them for upload ahead of time.  Converted bricks get another share,
+  // charged the same way.
+  if(uvf) {
+    const uint64_t iTranscodeBytes = GetUnallocatedCPUMem() / 16;
+    m_vpVolumeDatasets.back().pTranscoder.reset(new BrickTranscoder(
+      [uvf](const BrickKey& k) { return uvf->GetBrickBuffer(k); },
+      [uvf](const BrickKey& k) { return uvf->GetBrickVoxelCounts(k); },
+      iTranscodeBytes, GetNumCPUs()
+    ));
+    m_vpVolumeDatasets.back().iCPUReserved += iTranscodeBytes;
+    m_iAllocatedCPUMemory += iTranscodeBytes;
+  }
   return dataset;
 }
 
@@ -287,7 +322,9 @@ void GPUMemMan::FreeDataset(Dataset* pVolumeDataset,
     if (requester->GetContext()) // if we never created a context then we never created any textures
       FreeAssociatedTextures(pVolumeDataset, requester->GetContext()->GetShareGroupID());
     dbg.Message(_func_, "Released Dataset %s", ds_name.c_str());
+    vol_ds->pTranscoder.reset();
     delete pVolumeDataset;
+    m_iAllocatedCPUMemory -= vol_ds->iCPUReserved;
     m_vpVolumeDatasets.erase(vol_ds);
   } else {
     dbg.Message(_func_,"Decreased access count but dataset %s is still "
@@ -395,15 +432,20 @@ void GPUMemMan::GetEmpty1DTrans(size_t iSize, AbstrRenderer* requester,
   *ppTransferFunction1D = new TransferFunction1D(iSize);
   (*ppTransferFunction1D)->SetStdFunction();
 
-  std::vector<unsigned char> vTFData;
-  (*ppTransferFunction1D)->GetByteArray(vTFData);
-  *tex = new GLTexture1D(uint32_t((*ppTransferFunction1D)->GetSize()), GL_RGBA8,
-                         GL_RGBA, GL_UNSIGNED_BYTE, &vTFData.at(0));
-
-  m_iAllocatedGPUMemory += (*tex)->GetGPUSize();
-  m_iAllocatedCPUMemory += (*tex)->GetCPUSize();
+  GLTexture1D* pTexture = NULL;
+  if (tex) {
+    std::vector<unsigned char> vTFData;
+    (*ppTransferFunction1D)->GetByteArray(vTFData);
+    pTexture = new GLTexture1D(uint32_t((*ppTransferFunction1D)->GetSize()),
+                               GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,
+                               &vTFData.at(0));
+
+    m_iAllocatedGPUMemory += pTexture->GetGPUSize();
+    m_iAllocatedCPUMemory += pTexture->GetCPUSize();
+    *tex = pTexture;
+  }
 
-  m_vpTrans1DList.push_back(Trans1DListElem(*ppTransferFunction1D, *tex,
+  m_vpTrans1DList.push_back(Trans1DListElem(*ppTransferFunction1D, pTexture,
                                             requester));
 }
 
@@ -418,15 +460,20 @@ void GPUMemMan::Get1DTransFromFile(const string& strFilename,
     (*ppTransferFunction1D)->Resample(iSize);
   }
 
-  std::vector<unsigned char> vTFData;
-  (*ppTransferFunction1D)->GetByteArray(vTFData);
-  *tex = new GLTexture1D(uint32_t((*ppTransferFunction1D)->GetSize()), GL_RGBA8,
-                         GL_RGBA, GL_UNSIGNED_BYTE, &vTFData.at(0));
-
-  m_iAllocatedGPUMemory += (*tex)->GetGPUSize();
-  m_iAllocatedCPUMemory += (*tex)->GetCPUSize();
+  GLTexture1D* pTexture = NULL;
+  if (tex) {
+    std::vector<unsigned char> vTFData;
+    (*ppTransferFunction1D)->GetByteArray(vTFData);
+    pTexture = new GLTexture1D(uint32_t((*ppTransferFunction1D)->GetSize()),
+                               GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,
+                               &vTFData.at(0));
+
+    m_iAllocatedGPUMemory += pTexture->GetGPUSize();
+    m_iAllocatedCPUMemory += pTexture->GetCPUSize();
+    *tex = pTexture;
+  }
 
-  m_vpTrans1DList.push_back(Trans1DListElem(*ppTransferFunction1D, *tex,
+  m_vpTrans1DList.push_back(Trans1DListElem(*ppTransferFunction1D, pTexture,
                                             requester));
 }
 
@@ -479,12 +526,14 @@ void GPUMemMan::Free1DTrans(TransferFunction1D* pTransferFunction1D,
           if (i->qpUser.empty()) {
             dbg.Message(_func_, "Released 1D TF");
 
-            m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
-            m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
-
             delete i->pTransferFunction1D;
-            i->pTexture->Delete();
-            delete i->pTexture;
+            if (i->pTexture) {
+              m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
+              m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
+
+              i->pTexture->Delete();
+              delete i->pTexture;
+            }
             m_vpTrans1DList.erase(i);
           } else {
             dbg.Message(_func_, "Decreased access count, but 1D TF is still "
@@ -538,16 +587,20 @@ void GPUMemMan::GetEmpty2DTrans(const VECTOR2<size_t>& iSize,
   MESSAGE("Creating new empty 2D transfer function");
   *ppTransferFunction2D = new TransferFunction2D(iSize);
 
-  unsigned char* pcData = NULL;
-  (*ppTransferFunction2D)->GetByteArray(&pcData);
-  *tex = new GLTexture2D(uint32_t(iSize.x), uint32_t(iSize.y), GL_RGBA8, GL_RGBA,
-                         GL_UNSIGNED_BYTE, pcData);
-  delete [] pcData;
-
-  m_iAllocatedGPUMemory += (*tex)->GetGPUSize();
-  m_iAllocatedCPUMemory += (*tex)->GetCPUSize();
+  GLTexture2D* pTexture = NULL;
+  if (tex) {
+    unsigned char* pcData = NULL;
+    (*ppTransferFunction2D)->GetByteArray(&pcData);
+    pTexture = new GLTexture2D(uint32_t(iSize.x), uint32_t(iSize.y), GL_RGBA8,
+                               GL_RGBA, GL_UNSIGNED_BYTE, pcData);
+    delete [] pcData;
+
+    m_iAllocatedGPUMemory += pTexture->GetGPUSize();
+    m_iAllocatedCPUMemory += pTexture->GetCPUSize();
+    *tex = pTexture;
+  }
 
-  m_vpTrans2DList.push_back(Trans2DListElem(*ppTransferFunction2D, *tex,
+  m_vpTrans2DList.push_back(Trans2DListElem(*ppTransferFunction2D, pTexture,
                                             requester));
 }
 
@@ -572,17 +625,21 @@ void GPUMemMan::Get2DTransFromFile(const string& strFilename,
     (*ppTransferFunction2D)->Resample(vSize);
   }
 
-  unsigned char* pcData = NULL;
-  (*ppTransferFunction2D)->GetByteArray(&pcData);
-  *tex = new GLTexture2D(uint32_t((*ppTransferFunction2D)->GetSize().x),
-                         uint32_t((*ppTransferFunction2D)->GetSize().y),
-                         GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,pcData);
-  delete [] pcData;
-
-  m_iAllocatedGPUMemory += (*tex)->GetGPUSize();
-  m_iAllocatedCPUMemory += (*tex)->GetCPUSize();
+  GLTexture2D* pTexture = NULL;
+  if (tex) {
+    unsigned char* pcData = NULL;
+    (*ppTransferFunction2D)->GetByteArray(&pcData);
+    pTexture = new GLTexture2D(uint32_t((*ppTransferFunction2D)->GetSize().x),
+                               uint32_t((*ppTransferFunction2D)->GetSize().y),
+                               GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,pcData);
+    delete [] pcData;
+
+    m_iAllocatedGPUMemory += pTexture->GetGPUSize();
+    m_iAllocatedCPUMemory += pTexture->GetCPUSize();
+    *tex = pTexture;
+  }
 
-  m_vpTrans2DList.push_back(Trans2DListElem(*ppTransferFunction2D, *tex,
+  m_vpTrans2DList.push_back(Trans2DListElem(*ppTransferFunction2D, pTexture,
                                             requester));
 }
 
@@ -612,12 +669,14 @@ void GPUMemMan::Free2DTrans(TransferFunction2D* pTransferFunction2D,
           if (i->qpUser.empty()) {
             dbg.Message(_func_, "Released 2D TF");
 
-            m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
-            m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
-
             delete i->pTransferFunction2D;
-            i->pTexture->Delete();
-            delete i->pTexture;
+            if (i->pTexture) {
+              m_iAllocatedGPUMemory -= i->pTexture->GetGPUSize();
+              m_iAllocatedCPUMemory -= i->pTexture->GetCPUSize();
+
+              i->pTexture->Delete();
+              delete i->pTexture;
+            }
 
             m_vpTrans2DList.erase(i);
           } else {
@@ -640,15 +699,10 @@ bool GPUMemMan::IsResident(const Dataset* pDataset,
                            bool bDisableBorder,
                            bool bEmulate3DWith2DStacks,
                            int iShareGroupID) const {
-  for(GLVolumeListConstIter i = m_vpTex3DList.begin();
-      i < m_vpTex3DList.end(); ++i) {
-    if((*i)->Equals(pDataset, key, bUseOnlyPowerOfTwo,
-                    bDownSampleTo8Bits, bDisableBorder,
-                    bEmulate3DWith2DStacks, iShareGroupID)) {
-      return true;
-    }
-  }
-  return false;
+  return m_Tex3DIndex.count(ResidencyKey(pDataset, key, bUseOnlyPowerOfTwo,
+                                         bDownSampleTo8Bits, bDisableBorder,
+                                         bEmulate3DWith2DStacks,
+                                         iShareGroupID)) > 0;
 }
 
 /// Calculates the amount of memory the given brick will take up.
@@ -664,98 +718,81 @@ required_cpu_memory(const Dataset& ds, const BrickKey& key)
   return mem;
 }
 
-/// Searches the texture list for a texture which matches the given criterion.
-/// @return matching texture, or lst.end() if no texture matches.
-static GLVolumeListIter
-find_closest_texture(GLVolumeList &lst, const UINTVECTOR3& vSize,
-                     bool use_pot, bool downsample, bool disable_border,
-                     bool bEmulate3DWith2DStacks,
-                     int iShareGroupID)
+/// What the eviction policy needs to know about a texture.
+static EvictionInfo
+eviction_info(const GLVolumeListElem& tex)
 {
-  uint64_t iTargetFrameCounter = UINT64_INVALID;
-  uint64_t iTargetIntraFrameCounter = UINT64_INVALID;
-
-  GLVolumeListIter iBestMatch = lst.end();
-  for (GLVolumeListIter i=lst.begin(); i < lst.end(); ++i) {
-    if ((*i)->BestMatch(vSize, use_pot, downsample, disable_border,
-                        bEmulate3DWith2DStacks,
-                        iTargetIntraFrameCounter, iTargetFrameCounter,
-                        iShareGroupID)) {
-      iBestMatch = i;
-    }
-  }
-  if(iBestMatch != lst.end()) {
-    MESSAGE("  Found suitable target brick from frame %llu with intraframe "
-            "counter %llu.", iTargetFrameCounter,
-            iTargetIntraFrameCounter);
-  }
-  return iBestMatch;
+  EvictionInfo info;
+  tex.GetCounters(info.iIntraFrameCounter, info.iFrameCounter);
+  info.iUserCount = tex.iUserCount;
+  info.iBytes = required_cpu_memory(*tex.pDataset, tex.GetKey());
+  info.iStoredBytes = tex.pDataset->GetBrickStoredBytes(tex.GetKey());
+  info.bInMemory = tex.pDataset->IsBrickInMemory(tex.GetKey());
+  info.iLOD = std::get<1>(tex.GetKey());
+  return info;
 }
 
-
-// We use our own function instead of a functor because we're searching through
-// a list of 3D textures, which are noncopyable.  A copy operation on our 3d
-// texes would be expensive.
-template <typename ForwIter> static ForwIter
-find_brick_with_usercount(ForwIter first, const ForwIter last,
-                          int iShareGroupID, uint32_t user_count)
+template<typename Pred> GLVolumeListIter
+GPUMemMan::FindEvictionCandidate(Pred eligible)
 {
-  while(first != last && !((*first)->iUserCount == user_count && iShareGroupID == (*first)->GetShareGroupID())) {
-    ++first;
+  GLVolumeListIter candidate = m_vpTex3DList.end();
+  EvictionInfo candidateInfo;
+  for(GLVolumeListIter i = m_vpTex3DList.begin();
+      i != m_vpTex3DList.end(); ++i) {
+    if(!eligible(**i)) { continue; }
+    const EvictionInfo info = eviction_info(**i);
+    if(candidate == m_vpTex3DList.end() ||
+       EvictBefore(info, candidateInfo, m_iFrameCounter)) {
+      candidate = i;
+      candidateInfo = info;
+    }
   }
-  return first;
+  return candidate;
 }
 
 // Gets rid of *all* unused bricks.  Returns the number of bricks it deleted.
 size_t GPUMemMan::DeleteUnusedBricks(int iShareGroupID) {
+  // Deleting from the middle of a deque invalidates all iterators, so we
+  // free the textures first and compact the list afterwards.
   size_t removed = 0;
-  // This is a bit harsh.  erase() in the middle of a deque invalidates *all*
-  // iterators.  So we repeatedly search for unused bricks, until our search
-  // comes up empty.
-  // That said, erase() at the beginning or end of a deque only invalidates the
-  // pointed-to element.  You might consider an optimization where we delete
-  // all unused bricks from the beginning and end of the structure, before
-  // moving on to the exhaustive+expensive search.
-  bool found;
-  do {
-    found = false;
-    const GLVolumeListIter& iter = find_brick_with_usercount(
-                                      m_vpTex3DList.begin(),
-                                      m_vpTex3DList.end(), 0, iShareGroupID
-                                    );
-    if(iter != m_vpTex3DList.end()) {
+  for(GLVolumeListIter i = m_vpTex3DList.begin();
+      i != m_vpTex3DList.end(); ++i) {
+    if((*i)->iUserCount == 0 && (*i)->GetShareGroupID() == iShareGroupID) {
+      Free3DTexture(*i);
+      *i = NULL;
       ++removed;
-      found = true;
-      Delete3DTexture(iter);
     }
-  } while(!m_vpTex3DList.empty() && found);
+  }
+  Controller::Instance().IncrementPerfCounter(PERF_GPU_BRICK_EVICTIONS,
+                                              double(removed));
+  m_vpTex3DList.erase(std::remove(m_vpTex3DList.begin(), m_vpTex3DList.end(),
+                                  static_cast<GLVolumeListElem*>(NULL)),
+                      m_vpTex3DList.end());
 
   MESSAGE("Got rid of %u unused bricks.", static_cast<unsigned int>(removed));
   return removed;
 }
 
-// We don't have enough CPU memory to load something.  Get rid of a brick.
+// We don't have enough CPU memory to load something.  Get rid of the brick
+// which is cheapest to lose.
 void GPUMemMan::DeleteArbitraryBrick(int iShareGroupID) {
   assert(!m_vpTex3DList.empty());
 
-  // Identify the least used brick.  The 128 is an arbitrary choice.  We want
-  // it to be high enough to hit every conceivable number of users for a brick.
-  // We don't want to use 2^32 though, because then the application would feel
-  // like it hung if we had some other bug.
-  for(uint32_t in_use_by=0; in_use_by < 128; ++in_use_by) {
-    const GLVolumeListIter& iter = find_brick_with_usercount(
-                                      m_vpTex3DList.begin(),
-                                      m_vpTex3DList.end(), iShareGroupID, in_use_by
-                                    );
-    if(iter != m_vpTex3DList.end()) {
-      MESSAGE("  Deleting texture %d",
-              std::distance(iter, m_vpTex3DList.begin()));
-      Delete3DTexture(iter);
-      return;
+  const GLVolumeListIter iter = FindEvictionCandidate(
+    [iShareGroupID](const GLVolumeListElem& tex) {
+      return tex.GetShareGroupID() == iShareGroupID;
     }
+  );
+  if(iter == m_vpTex3DList.end()) {
+    WARNING("No bricks in this share group: "
+            "cannot make space for a new brick.");
+    return;
   }
-  WARNING("All bricks are (heavily) in use: "
-          "cannot make space for a new brick.");
+  MESSAGE("  Deleting texture %d used by %u renderers",
+          int(std::distance(m_vpTex3DList.begin(), iter)),
+          (*iter)->iUserCount);
+  Controller::Instance().IncrementPerfCounter(PERF_GPU_BRICK_EVICTIONS, 1.0);
+  Delete3DTexture(iter);
 }
 
 void GPUMemMan::DeleteVolumePool(GLVolumePool** pool) {
@@ -894,16 +931,19 @@ GLVolume* GPUMemMan::AllocOrGetVolume(Dataset* pDataset,
                                       uint64_t iIntraFrameCounter,
                                       uint64_t iFrameCounter,
                                       int iShareGroupID) {
-  for (GLVolumeListIter i = m_vpTex3DList.begin();
-       i < m_vpTex3DList.end(); i++) {
-    if ((*i)->Equals(pDataset, key, bUseOnlyPowerOfTwo,
-                     bDownSampleTo8Bits, bDisableBorder,
-                     bEmulate3DWith2DStacks, iShareGroupID)) {
+  {
+    const auto resident = m_Tex3DIndex.find(
+      ResidencyKey(pDataset, key, bUseOnlyPowerOfTwo, bDownSampleTo8Bits,
+                   bDisableBorder, bEmulate3DWith2DStacks, iShareGroupID)
+    );
+    if(resident != m_Tex3DIndex.end()) {
       GL_CHECK();
       MESSAGE("Reusing 3D texture");
-      return (*i)->Access(iIntraFrameCounter, iFrameCounter);
+      Controller::Instance().IncrementPerfCounter(PERF_GPU_BRICK_HITS, 1.0);
+      return resident->second->Access(iIntraFrameCounter, iFrameCounter);
     }
   }
+  Controller::Instance().IncrementPerfCounter(PERF_GPU_BRICK_MISSES, 1.0);
 
   uint64_t iNeededCPUMemory = required_cpu_memory(*pDataset, key);
 
@@ -920,29 +960,36 @@ GLVolume* GPUMemMan::AllocOrGetVolume(Dataset* pDataset,
             "paging ...", sz[0], sz[1], sz[2],
             iBitWidth, iCompCount);
 
-    // search for best brick to replace with this brick
-    UINTVECTOR3 vSize = pDataset->GetBrickVoxelCounts(key);
-    GLVolumeListIter iBestMatch = find_closest_texture(m_vpTex3DList, vSize,
-                                                       bUseOnlyPowerOfTwo,
-                                                       bDownSampleTo8Bits,
-                                                       bDisableBorder,
-                                                       bEmulate3DWith2DStacks,
-                                                       iShareGroupID);
+    // search for the brick which is cheapest to replace with this brick
+    GLVolumeListIter iBestMatch = FindEvictionCandidate(
+      [&](const GLVolumeListElem& tex) {
+        return tex.CanReplace(sz, bUseOnlyPowerOfTwo, bDownSampleTo8Bits,
+                              bDisableBorder, bEmulate3DWith2DStacks,
+                              iShareGroupID);
+      }
+    );
     if (iBestMatch != m_vpTex3DList.end()) {
       // found a suitable brick that can be replaced
+      MESSAGE("  Found suitable target brick from frame %llu with "
+              "intraframe counter %llu.", (*iBestMatch)->GetFrameCounter(),
+              (*iBestMatch)->GetIntraFrameCounter());
+      Controller::Instance().IncrementPerfCounter(PERF_GPU_BRICK_EVICTIONS,
+                                                  1.0);
+      Unindex3DTexture(*iBestMatch);
       (*iBestMatch)->Replace(pDataset, key, bUseOnlyPowerOfTwo,
                              bDownSampleTo8Bits, bDisableBorder,
                              bEmulate3DWith2DStacks,
                              iIntraFrameCounter, iFrameCounter,
                              m_vUploadHub,
                              iShareGroupID);
+      Index3DTexture(*iBestMatch);
       (*iBestMatch)->iUserCount++;
       return (*iBestMatch)->volume;
     } else {
       // We know the brick doesn't fit in memory, and we know there's no
       // existing texture which matches enough that we could overwrite it with
       // this one.  There's little we can do at this point ...
-      WARNING("  No suitable brick found. Randomly deleting bricks until this"
+      WARNING("  No suitable brick found. Deleting bricks until this"
               " brick fits into memory");
 
       while (m_iAllocatedCPUMemory + iNeededCPUMemory >
@@ -992,39 +1039,77 @@ GLVolume* GPUMemMan::AllocOrGetVolume(Dataset* pDataset,
   m_iAllocatedCPUMemory += pNew3DTex->GetCPUSize();
 
   m_vpTex3DList.push_back(pNew3DTex);
-  return (*(m_vpTex3DList.end()-1))->volume;
+  Index3DTexture(pNew3DTex);
+  return pNew3DTex->volume;
 }
 
 void GPUMemMan::Release3DTexture(GLVolume* pGLVolume) {
-  for (size_t i = 0;i<m_vpTex3DList.size();i++) {
-    if (m_vpTex3DList[i]->volume == pGLVolume) {
-      if (m_vpTex3DList[i]->iUserCount > 0) {
-        m_vpTex3DList[i]->iUserCount--;
-        MESSAGE("Decreased 3D texture use count to %u",
-                m_vpTex3DList[i]->iUserCount);
-      } else {
-        WARNING("Attempting to release a 3D volume that is not in use.");
-      }
-    }
+  const auto tex = m_Tex3DByVolume.find(pGLVolume);
+  if (tex == m_Tex3DByVolume.end()) { return; }
+  if (tex->second->iUserCount > 0) {
+    tex->second->iUserCount--;
+    MESSAGE("Decreased 3D texture use count to %u",
+            tex->second->iUserCount);
+  } else {
+    WARNING("Attempting to release a 3D volume that is not in use.");
   }
 }
 
+void GPUMemMan::PrepareVolumes(const Dataset* pDataset,
+                               const std::vector<BrickKey>& keys,
+                               bool bUseOnlyPowerOfTwo,
+                               bool bDownSampleTo8Bits,
+                               bool bDisableBorder) {
+  VolDataListIter vol_ds = std::find_if(m_vpVolumeDatasets.begin(),
+                                        m_vpVolumeDatasets.end(),
+                                        find_ds(pDataset));
+  if(vol_ds == m_vpVolumeDatasets.end() || !vol_ds->pTranscoder) { return; }
+  vol_ds->pTranscoder->Request(keys, GLVolumeListElem::UploadFormat(
+    *pDataset, bUseOnlyPowerOfTwo, bDownSampleTo8Bits, bDisableBorder
+  ));
+}
 
-void GPUMemMan::Delete3DTexture(const GLVolumeListIter& tex) {
-  m_iAllocatedGPUMemory -= (*tex)->GetGPUSize();
-  m_iAllocatedCPUMemory -= (*tex)->GetCPUSize();
+std::shared_ptr<const TranscodedBrick>
+GPUMemMan::TakePreparedVolume(const Dataset* pDataset, const BrickKey& key,
+                              const TranscodeFormat& fmt) {
+  VolDataListIter vol_ds = std::find_if(m_vpVolumeDatasets.begin(),
+                                        m_vpVolumeDatasets.end(),
+                                        find_ds(pDataset));
+  if(vol_ds == m_vpVolumeDatasets.end() || !vol_ds->pTranscoder) {
+    return std::shared_ptr<const TranscodedBrick>();
+  }
+  return vol_ds->pTranscoder->Take(key, fmt);
+}
 
-  if((*tex)->iUserCount != 0) {
+void GPUMemMan::Index3DTexture(GLVolumeListElem* tex) {
+  m_Tex3DIndex[tex->GetResidencyKey()] = tex;
+  m_Tex3DByVolume[tex->volume] = tex;
+}
+
+void GPUMemMan::Unindex3DTexture(const GLVolumeListElem* tex) {
+  const auto entry = m_Tex3DIndex.find(tex->GetResidencyKey());
+  if(entry != m_Tex3DIndex.end() && entry->second == tex) {
+    m_Tex3DIndex.erase(entry);
+  }
+  m_Tex3DByVolume.erase(tex->volume);
+}
+
+void GPUMemMan::Free3DTexture(GLVolumeListElem* tex) {
+  m_iAllocatedGPUMemory -= tex->GetGPUSize();
+  m_iAllocatedCPUMemory -= tex->GetCPUSize();
+
+  if(tex->iUserCount != 0) {
     WARNING("Freeing used GL volume!");
   }
   MESSAGE("Deleting GL texture with use count %u",
-          static_cast<unsigned>((*tex)->iUserCount));
-  delete *tex;
-  m_vpTex3DList.erase(tex);
+          static_cast<unsigned>(tex->iUserCount));
+  Unindex3DTexture(tex);
+  delete tex;
 }
 
-void GPUMemMan::Delete3DTexture(size_t iIndex) {
-  this->Delete3DTexture(m_vpTex3DList.begin() + iIndex);
+void GPUMemMan::Delete3DTexture(const GLVolumeListIter& tex) {
+  Free3DTexture(*tex);
+  m_vpTex3DList.erase(tex);
 }
 
 // Functor to identify a texture that belongs to a particular dataset.
@@ -1085,35 +1170,14 @@ GLFBOTex* GPUMemMan::GetFBO(GLenum minfilter, GLenum magfilter,
     MESSAGE("Not enough memory for FBO %i x %i x %i, "
             "paging out bricks ...", int(width), int(height), iNumBuffers);
 
-    // search for best brick to replace with this brick
-    uint64_t iMinTargetFrameCounter;
-    uint64_t iMaxTargetIntraFrameCounter;
-    (*m_vpTex3DList.begin())->GetCounters(iMaxTargetIntraFrameCounter,
-                                          iMinTargetFrameCounter);
-    size_t iIndex = 0;
-    size_t iBestIndex = 0;
-
-    for (GLVolumeListIter i = m_vpTex3DList.begin()+1;
-         i < m_vpTex3DList.end(); ++i) {
-      uint64_t iTargetFrameCounter = UINT64_INVALID;
-      uint64_t iTargetIntraFrameCounter = UINT64_INVALID;
-      (*i)->GetCounters(iTargetIntraFrameCounter, iTargetFrameCounter);
-      iIndex++;
-
-      if (iTargetFrameCounter < iMinTargetFrameCounter) {
-        iMinTargetFrameCounter = iTargetFrameCounter;
-        iMaxTargetIntraFrameCounter = iTargetIntraFrameCounter;
-        iBestIndex = iIndex;
-      } else {
-        if (iTargetFrameCounter == iMinTargetFrameCounter &&
-            iTargetIntraFrameCounter > iMaxTargetIntraFrameCounter) {
-          iMaxTargetIntraFrameCounter = iTargetIntraFrameCounter;
-          iBestIndex = iIndex;
-        }
-      }
-    }
-    MESSAGE("   Deleting texture %u", static_cast<unsigned>(iBestIndex));
-    Delete3DTexture(iBestIndex);
+    // any brick will do; take the one which is cheapest to lose
+    const GLVolumeListIter iter = FindEvictionCandidate(
+      [](const GLVolumeListElem&) { return true; }
+    );
+    MESSAGE("   Deleting texture %d",
+            int(std::distance(m_vpTex3DList.begin(), iter)));
+    Controller::Instance().IncrementPerfCounter(PERF_GPU_BRICK_EVICTIONS, 1.0);
+    Delete3DTexture(iter);
   }
 
 
@@ -1228,6 +1292,11 @@ uint32_t GPUMemMan::GetBitWidthMem() const {
 }
 uint32_t GPUMemMan::GetNumCPUs() const {return m_SystemInfo.GetNumberOfCPUs();}
 
+uint64_t GPUMemMan::GetUnallocatedCPUMem() const {
+  const uint64_t iMax = m_SystemInfo.GetMaxUsableCPUMem();
+  return iMax > m_iAllocatedCPUMemory ? iMax - m_iAllocatedCPUMemory : 0;
+}
+
 
 void GPUMemMan::RegisterLuaCommands() {
   std::string id;
@@ -31,6 +31,7 @@
 #define TUVOK_GPUMEMMAN_H
 
 #include <deque>
+#include <unordered_map>
 #include <utility>
 #include "../../StdTuvokDefines.h"
 #include "3rdParty/GLEW/GL/glew.h"
@@ -67,6 +68,9 @@ class GPUMemMan {
 
     void Changed1DTrans(LuaClassInstance abstrRenderer,
                         LuaClassInstance transferFun1D);
+    /// The Get*Trans calls create no texture if 'tex' is NULL, for renderers
+    /// which sample the transfer function themselves.  Access*Trans returns
+    /// NULL for such transfer functions.
     void GetEmpty1DTrans(size_t iSize, AbstrRenderer* requester,
                          TransferFunction1D** ppTransferFunction1D,
                          GLTexture1D** tex);
@@ -115,6 +119,20 @@ class GPUMemMan {
 
     void Release3DTexture(GLVolume* pGLVolume);
 
+    /// Hint that these bricks will be uploaded soon with the given settings.
+    /// Bricks which need converting for upload (see TranscodeBrick) are
+    /// converted on worker threads in the meantime.
+    void PrepareVolumes(const Dataset* pDataset,
+                        const std::vector<BrickKey>& keys,
+                        bool bUseOnlyPowerOfTwo, bool bDownSampleTo8Bits,
+                        bool bDisableBorder);
+    /// @returns the brick PrepareVolumes converted to the given format, and
+    /// forgets about it; NULL if there is none.
+    std::shared_ptr<const TranscodedBrick> TakePreparedVolume(
+      const Dataset* pDataset, const BrickKey& key,
+      const TranscodeFormat& fmt
+    );
+
     GLFBOTex* GetFBO(GLenum minfilter, GLenum magfilter, GLenum wrapmode,
                      GLsizei width, GLsizei height, GLenum intformat,
                      GLenum format, GLenum type,
@@ -148,11 +166,20 @@ class GPUMemMan {
     ///@}
 
   private:
+    /// what is left of GetMaxUsableCPUMem after all allocations
+    uint64_t GetUnallocatedCPUMem() const;
+
     VolDataList                 m_vpVolumeDatasets;
     SimpleTextureList           m_vpSimpleTextures;
     Trans1DList                 m_vpTrans1DList;
     Trans2DList                 m_vpTrans2DList;
     GLVolumeList                m_vpTex3DList;
+    /// m_vpTex3DList by brick and format, and by texture
+    ///@{
+    std::unordered_map<ResidencyKey, GLVolumeListElem*,
+                       ResidencyKeyHash> m_Tex3DIndex;
+    std::unordered_map<const GLVolume*, GLVolumeListElem*> m_Tex3DByVolume;
+    ///@}
     FBOList                     m_vpFBOList;
     GLSLList                    m_vpGLSLList;
     MasterController*           m_MasterController;
@@ -179,8 +206,16 @@ class GPUMemMan {
                                int iShareGroupID);
     size_t DeleteUnusedBricks(int iShareGroupID);
     void DeleteArbitraryBrick(int iShareGroupID);
-    void Delete3DTexture(size_t iIndex);
     void Delete3DTexture(const GLVolumeListIter &tex);
+    /// deletes the texture but leaves its (dangling) entry in the list
+    void Free3DTexture(GLVolumeListElem* tex);
+    void Index3DTexture(GLVolumeListElem* tex);
+    void Unindex3DTexture(const GLVolumeListElem* tex);
+    /// @returns the texture to evict first (see EvictBefore) among those
+    /// 'eligible' accepts, or m_vpTex3DList.end() if there is none.
+    template<typename Pred> GLVolumeListIter FindEvictionCandidate(
+      Pred eligible
+    );
     void RegisterLuaCommands();
 };
 }
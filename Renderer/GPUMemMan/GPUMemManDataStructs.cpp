@@ -40,8 +40,9 @@
 #include <numeric>
 #include <typeinfo>
 #include "IO/IOManager.h"
+#include "IO/BrickBuffer.h"
 #include "GPUMemManDataStructs.h"
-#include "Basics/MathTools.h"
+#include "GPUMemMan.h"
 #include "Controller/Controller.h"
 #include "IO/uvfDataset.h"
 #include "Renderer/GL/GLTexture3D.h"
@@ -105,6 +106,12 @@ bool GLVolumeListElem::Equals(const Dataset* _pDataset, const BrickKey& key,
   return true;
 }
 
+ResidencyKey GLVolumeListElem::GetResidencyKey() const {
+  return ResidencyKey(pDataset, m_Key, m_bIsPaddedToPowerOfTwo,
+                      m_bIsDownsampledTo8Bits, m_bDisableBorder,
+                      m_bEmulate3DWith2DStacks, m_iShareGroupID);
+}
+
 GLVolume* GLVolumeListElem::Access(uint64_t& iIntraFrameCounter, uint64_t& iFrameCounter) {
   m_iIntraFrameCounter = iIntraFrameCounter;
   m_iFrameCounter = iFrameCounter;
@@ -113,43 +120,19 @@ GLVolume* GLVolumeListElem::Access(uint64_t& iIntraFrameCounter, uint64_t& iFram
   return volume;
 }
 
-bool GLVolumeListElem::BestMatch(const UINTVECTOR3& vDimension,
-                                 bool bIsPaddedToPowerOfTwo,
-                                 bool bIsDownsampledTo8Bits,
-                                 bool bDisableBorder,
-                                 bool bEmulate3DWith2DStacks,
-                                 uint64_t& iIntraFrameCounter,
-                                 uint64_t& iFrameCounter,
-                                 int iShareGroupID) const
+bool GLVolumeListElem::CanReplace(const UINTVECTOR3& vDimension,
+                                  bool bIsPaddedToPowerOfTwo,
+                                  bool bIsDownsampledTo8Bits,
+                                  bool bDisableBorder,
+                                  bool bEmulate3DWith2DStacks,
+                                  int iShareGroupID) const
 {
-  if (!Match(vDimension) || iUserCount > 0
-      || m_bIsPaddedToPowerOfTwo != bIsPaddedToPowerOfTwo
-      || m_bIsDownsampledTo8Bits != bIsDownsampledTo8Bits
-      || m_bDisableBorder != bDisableBorder
-      || m_bEmulate3DWith2DStacks != bEmulate3DWith2DStacks
-      || m_iShareGroupID != iShareGroupID) {
-    return false;
-  }
-
-  // framewise older data as before found -> use this object
-  if (iFrameCounter > m_iFrameCounter) {
-      iFrameCounter = m_iFrameCounter;
-      iIntraFrameCounter = m_iIntraFrameCounter;
-
-      return true;
-  }
-
-  // framewise older data as before found -> use this object
-  if (iFrameCounter == m_iFrameCounter &&
-      iIntraFrameCounter < m_iIntraFrameCounter) {
-
-      iFrameCounter = m_iFrameCounter;
-      iIntraFrameCounter = m_iIntraFrameCounter;
-
-      return true;
-  }
-
-  return false;
+  return Match(vDimension) && iUserCount == 0
+      && m_bIsPaddedToPowerOfTwo == bIsPaddedToPowerOfTwo
+      && m_bIsDownsampledTo8Bits == bIsDownsampledTo8Bits
+      && m_bDisableBorder == bDisableBorder
+      && m_bEmulate3DWith2DStacks == bEmulate3DWith2DStacks
+      && m_iShareGroupID == iShareGroupID;
 }
 
 namespace nonstd {
@@ -262,159 +245,119 @@ bool GLVolumeListElem::Replace(Dataset* _pDataset,
   }
   while (glGetError() != GL_NO_ERROR) {};  // clear gl error flags
 
-  const UINTVECTOR3 vSize = pDataset->GetBrickVoxelCounts(m_Key);
-
-  if (!m_bIsPaddedToPowerOfTwo ||
-      (MathTools::IsPow2(uint32_t(vSize[0])) &&
-       MathTools::IsPow2(uint32_t(vSize[1])) &&
-       MathTools::IsPow2(uint32_t(vSize[2])))) {
-    volume->SetData(m_bUsingHub ? &vUploadHub.at(0) : &vData.at(0));
-  } else {
-    std::pair<std::shared_ptr<unsigned char>, UINTVECTOR3> padded = PadData(
-      m_bUsingHub ? &vUploadHub.at(0) : &vData.at(0),
-      pDataset->GetBrickVoxelCounts(m_Key),
-      pDataset->GetBitWidth(),
-      pDataset->GetComponentCount()
-    );
-
-    volume->SetData(padded.first.get());
-  }
+  volume->SetData(UploadData(vUploadHub));
+  FreeData();
 
   return GL_NO_ERROR==glGetError();
 }
 
+TranscodeFormat GLVolumeListElem::UploadFormat(const Dataset& ds,
+                                               bool bIsPaddedToPowerOfTwo,
+                                               bool bIsDownsampledTo8Bits,
+                                               bool bDisableBorder) {
+  TranscodeFormat fmt;
+  fmt.iBitWidth = unsigned(ds.GetBitWidth());
+  fmt.iCompCount = unsigned(ds.GetComponentCount());
+  fmt.bSigned = ds.GetIsSigned();
+  fmt.bToggleEndian = !ds.IsSameEndianness();
+  fmt.bDownsampleTo8Bits = bIsDownsampledTo8Bits;
+  fmt.fMin = ds.GetRange().first;
+  fmt.fMax = ds.GetRange().second;
+  fmt.bPadToPowerOfTwo = bIsPaddedToPowerOfTwo;
+  fmt.bClampBorder = !bDisableBorder;
+  return fmt;
+}
 
-bool GLVolumeListElem::LoadData(std::vector<unsigned char>& vUploadHub) {
-  const UINTVECTOR3 vSize = pDataset->GetBrickVoxelCounts(m_Key);
-  uint64_t iByteWidth  = pDataset->GetBitWidth()/8;
-  uint64_t iCompCount = pDataset->GetComponentCount();
-
-  uint64_t iBrickSize = vSize[0]*vSize[1]*vSize[2]*iByteWidth * iCompCount;
-
-  if (!vUploadHub.empty() && iBrickSize <=
-      uint64_t(m_pMasterController->IOMan()->GetIncoresize()*4)) {
-    m_bUsingHub = true;
-    return pDataset->GetBrick(m_Key, vUploadHub);
-  } else {
-    return pDataset->GetBrick(m_Key, vData);
-  }
+TranscodeFormat GLVolumeListElem::UploadFormat() const {
+  return UploadFormat(*pDataset, m_bIsPaddedToPowerOfTwo,
+                      m_bIsDownsampledTo8Bits, m_bDisableBorder);
 }
 
-void  GLVolumeListElem::FreeData() {
-  vData.resize(0);
+const unsigned char* GLVolumeListElem::UploadData(
+  const std::vector<unsigned char>& vUploadHub
+) const {
+  if(m_pPrepared) { return &m_pPrepared->data.at(0); }
+  if(m_pBrick) {
+    return static_cast<const unsigned char*>(m_pBrick->data());
+  }
+  return m_bUsingHub ? &vUploadHub.at(0) : &m_vTranscoded.at(0);
 }
 
-static void DeleteArray(unsigned char* p) { delete[] p; }
+bool GLVolumeListElem::LoadData(std::vector<unsigned char>& vUploadHub) {
+  FreeData();
 
-std::pair<std::shared_ptr<unsigned char>, UINTVECTOR3>
-GLVolumeListElem::PadData(unsigned char* pRawData, UINTVECTOR3 vSize, uint64_t iBitWidth,
-                          uint64_t iCompCount) const
-{
-  // pad the data to a power of two
-  UINTVECTOR3 vPaddedSize(MathTools::NextPow2(uint32_t(vSize[0])),
-                          MathTools::NextPow2(uint32_t(vSize[1])),
-                          MathTools::NextPow2(uint32_t(vSize[2])));
-  size_t iTarget = 0;
-  size_t iSource = 0;
-  size_t iElementSize = static_cast<size_t>(iBitWidth/8*iCompCount);
-  size_t iRowSizeSource = vSize[0]*iElementSize;
-  size_t iRowSizeTarget = vPaddedSize[0]*iElementSize;
-
-  std::shared_ptr<unsigned char> pPaddedData;
-  try {
-    pPaddedData = std::shared_ptr<unsigned char>(
-      new unsigned char[iRowSizeTarget * vPaddedSize[1] * vPaddedSize[2]],
-      DeleteArray
-    );
-  } catch(std::bad_alloc&) {
-    return std::make_pair(std::shared_ptr<unsigned char>(), vPaddedSize);
+  // If we upload the data as they are, we can use the dataset's buffer
+  // directly instead of copying the brick first.
+  const TranscodeFormat fmt = UploadFormat();
+  const UINTVECTOR3 vSize = pDataset->GetBrickVoxelCounts(m_Key);
+  if(!NeedsTranscode(fmt, vSize)) {
+    m_pBrick = pDataset->GetBrickBuffer(m_Key);
+    return m_pBrick && m_pBrick->size() > 0;
   }
-  memset(pPaddedData.get(), 0, iRowSizeTarget*vPaddedSize[1]*vPaddedSize[2]);
-
-  for (size_t z = 0;z<vSize[2];z++) {
-    for (size_t y = 0;y<vSize[1];y++) {
-      memcpy(pPaddedData.get()+iTarget, pRawData+iSource, iRowSizeSource);
-
-      // if the x sizes differ, duplicate the last element to make the
-      // texture behave like clamp
-      if (!m_bDisableBorder && iRowSizeTarget > iRowSizeSource)
-        memcpy(pPaddedData.get()+iTarget+iRowSizeSource,
-               pPaddedData.get()+iTarget+iRowSizeSource-iElementSize,
-               iElementSize);
-      iTarget += iRowSizeTarget;
-      iSource += iRowSizeSource;
-    }
-    // if the y sizes differ, duplicate the last element to make the texture
-    // behave like clamp
-    if (vPaddedSize[1] > vSize[1]) {
-      if (!m_bDisableBorder)
-        memcpy(pPaddedData.get()+iTarget, pPaddedData.get()+iTarget-iRowSizeTarget,
-               iRowSizeTarget);
-      iTarget += (vPaddedSize[1]-vSize[1])*iRowSizeTarget;
+
+  m_pPrepared = m_pMasterController->MemMan()->TakePreparedVolume(
+    pDataset, m_Key, fmt
+  );
+  if(m_pPrepared) { return !m_pPrepared->data.empty(); }
+
+  const std::shared_ptr<const BrickBuffer> brick =
+    pDataset->GetBrickBuffer(m_Key);
+  if(!brick || brick->size() == 0) { return false; }
+
+  const uint64_t iBytes = TranscodedBytes(fmt, vSize);
+  unsigned char* pTarget = NULL;
+  if(iBytes <= uint64_t(vUploadHub.size())) {
+    m_bUsingHub = true;
+    pTarget = &vUploadHub.at(0);
+  } else {
+    try {
+      m_vTranscoded.resize(size_t(iBytes));
+    } catch(std::bad_alloc&) {
+      return false;
     }
+    pTarget = &m_vTranscoded.at(0);
   }
-
-  // if the z sizes differ, duplicate the last element to make the texture
-  // behave like clamp
-  if (!m_bDisableBorder && vPaddedSize[2] > vSize[2]) {
-    memcpy(pPaddedData.get()+iTarget,
-           pPaddedData.get()+(iTarget-vPaddedSize[1]*iRowSizeTarget),
-           vPaddedSize[1]*iRowSizeTarget);
+  if(!TranscodeBrick(brick->data(), vSize, fmt, pTarget)) {
+    T_ERROR("Don't know how to convert %u-bit data for upload.",
+            fmt.iBitWidth);
+    FreeData();
+    return false;
   }
+  return true;
+}
 
-  MESSAGE("Actually using new texture %u x %u x %u, bitsize=%llu, "
-          "componentcount=%llu due to compatibility settings",
-          vPaddedSize[0], vPaddedSize[1], vPaddedSize[2],
-          iBitWidth, iCompCount);
-
-  return std::make_pair(pPaddedData, vPaddedSize);
+void  GLVolumeListElem::FreeData() {
+  std::vector<unsigned char>().swap(m_vTranscoded);
+  m_pBrick.reset();
+  m_pPrepared.reset();
+  m_bUsingHub = false;
 }
 
 bool GLVolumeListElem::CreateTexture(std::vector<unsigned char>& vUploadHub,
                                      bool bDeleteOldTexture) {
   if (bDeleteOldTexture) FreeTexture();
 
-  if (vData.empty()) {
-    MESSAGE("Completely reloading brick");
-    if (!LoadData(vUploadHub)) { return false; }
-  } else {
-    MESSAGE("Reusing CPU copy of brick data");
-  }
-
-  unsigned char* pRawData = (m_bUsingHub) ? &vUploadHub.at(0) : &vData.at(0);
+  MESSAGE("Completely reloading brick");
+  if (!LoadData(vUploadHub)) { return false; }
 
   // Figure out how big this is going to be.
-  const UINTVECTOR3 vSize = pDataset->GetBrickVoxelCounts(m_Key);
-
-  bool bToggleEndian = !pDataset->IsSameEndianness();
-  uint64_t iBitWidth  = pDataset->GetBitWidth();
-  uint64_t iCompCount = pDataset->GetComponentCount();
+  const TranscodeFormat fmt = UploadFormat();
+  const UINTVECTOR3 vSize = TranscodedSize(
+    fmt, pDataset->GetBrickVoxelCounts(m_Key)
+  );
+  const unsigned iBitWidth = TranscodedBitWidth(fmt);
+  const unsigned iCompCount = fmt.iCompCount;
 
-  MESSAGE("%llu components of width %llu", iCompCount, iBitWidth);
+  MESSAGE("%u components of width %u", iCompCount, iBitWidth);
+  if (vSize != pDataset->GetBrickVoxelCounts(m_Key)) {
+    MESSAGE("Actually using new texture %u x %u x %u due to compatibility "
+            "settings", vSize[0], vSize[1], vSize[2]);
+  }
 
   GLint glInternalformat;
   GLenum glFormat;
   GLenum glType;
 
-  if (m_bIsDownsampledTo8Bits && iBitWidth != 8) {
-    // here we assume that data which is not 8 bit is 16 bit
-    if (iBitWidth != 16) {
-      T_ERROR("Don't know how to handle %llu-bit data.", iBitWidth);
-      FreeData();
-      return false;
-    }
-
-    double fMin = pDataset->GetRange().first;
-    double fMax = pDataset->GetRange().second;
-
-    for (size_t i = 0;i<vSize[0]*vSize[1]*vSize[2]*iCompCount;i++) {
-      unsigned char iQuantizedVal = (unsigned char)((255.0*((unsigned short*)pRawData)[i] - fMin) / (fMax-fMin));
-      pRawData[i] = iQuantizedVal;
-    }
-
-    iBitWidth = 8;
-  }
-
   switch (iCompCount) {
     case 1 : glFormat = GL_LUMINANCE; break;
     case 3 : glFormat = GL_RGB; break;
@@ -433,16 +376,6 @@ bool GLVolumeListElem::CreateTexture(std::vector<unsigned char>& vUploadHub,
   } else {
     if (iBitWidth == 16) {
       glType = GL_UNSIGNED_SHORT;
-
-      if (bToggleEndian) {
-        /// @todo BROKEN for N-dimensional data; we're assuming we only get 3D
-        /// data here.
-        uint64_t iElemCount = vSize[0] * vSize[1] * vSize[2];
-        short* pShorData = (short*)pRawData;
-        std::transform(pShorData, pShorData+(iCompCount*iElemCount), pShorData,
-                       EndianConvert::Swap<short>);
-      }
-
       switch (iCompCount) {
         case 1 : glInternalformat = GL_LUMINANCE16; break;
         case 3 : glInternalformat = GL_RGB16; break;
@@ -463,50 +396,19 @@ bool GLVolumeListElem::CreateTexture(std::vector<unsigned char>& vUploadHub,
   }
 
   glGetError();
-  if (!m_bIsPaddedToPowerOfTwo ||
-      (MathTools::IsPow2(uint32_t(vSize[0])) &&
-       MathTools::IsPow2(uint32_t(vSize[1])) &&
-       MathTools::IsPow2(uint32_t(vSize[2])))) {
-    GLenum clamp = m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP;
-
-    if (m_bEmulate3DWith2DStacks) {
-      volume = new GLVolume2DTex(uint32_t(vSize[0]), uint32_t(vSize[1]),
-                                 uint32_t(vSize[2]),
-                                 glInternalformat, glFormat, glType,
-                                 pRawData,
-                                 GL_LINEAR, GL_LINEAR,
-                                 clamp, clamp, clamp);
-    } else {
-      volume = new GLVolume3DTex(uint32_t(vSize[0]), uint32_t(vSize[1]),
-                                 uint32_t(vSize[2]),
-                                 glInternalformat, glFormat, glType,
-                                 pRawData,
-                                 GL_LINEAR, GL_LINEAR,
-                                 clamp, clamp, clamp);
-    }
+  const GLenum clamp = m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP;
+  if (m_bEmulate3DWith2DStacks) {
+    volume = new GLVolume2DTex(vSize[0], vSize[1], vSize[2],
+                               glInternalformat, glFormat, glType,
+                               UploadData(vUploadHub),
+                               GL_LINEAR, GL_LINEAR,
+                               clamp, clamp, clamp);
   } else {
-    std::pair<std::shared_ptr<unsigned char>, UINTVECTOR3> padded =
-      PadData(pRawData, vSize, iBitWidth, iCompCount);
-    const std::shared_ptr<unsigned char>& pPaddedData = padded.first;
-    const UINTVECTOR3& vPaddedSize = padded.second;
-
-    if (m_bEmulate3DWith2DStacks) {
-      volume = new GLVolume2DTex(vPaddedSize[0], vPaddedSize[1], vPaddedSize[2],
-                                 glInternalformat, glFormat, glType,
-                                 pPaddedData.get(),
-                                 GL_LINEAR, GL_LINEAR,
-                                 m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP,
-                                 m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP,
-                                 m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP);
-    } else {
-      volume = new GLVolume3DTex(vPaddedSize[0], vPaddedSize[1], vPaddedSize[2],
-                                 glInternalformat, glFormat, glType,
-                                 pPaddedData.get(),
-                                 GL_LINEAR, GL_LINEAR,
-                                 m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP,
-                                 m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP,
-                                 m_bDisableBorder ? GL_CLAMP_TO_EDGE : GL_CLAMP);
-    }
+    volume = new GLVolume3DTex(vSize[0], vSize[1], vSize[2],
+                               glInternalformat, glFormat, glType,
+                               UploadData(vUploadHub),
+                               GL_LINEAR, GL_LINEAR,
+                               clamp, clamp, clamp);
   }
 
   // In the OpenGL case we can release the data at this point as we
@@ -48,6 +48,8 @@
 #include "boost/noncopyable.hpp"
 #include "Basics/Vectors.h"
 #include "IO/Brick.h"
+#include "BrickResidency.h"
+#include "BrickTranscode.h"
 #include "../Context.h"
 #include "../../StdTuvokDefines.h"
 #include "../GL/GLFBOTex.h"
@@ -61,6 +63,8 @@ class TransferFunction2D;
 class VolumeDataset;
 
 namespace tuvok {
+  class BrickBuffer;
+  class BrickTranscoder;
   class Dataset;
   class GLTexture1D;
   class GLTexture2D;
@@ -74,13 +78,20 @@ namespace tuvok {
   class VolDataListElem {
   public:
     VolDataListElem(Dataset* _pVolumeDataset, AbstrRenderer* pUser) :
-      pVolumeDataset(_pVolumeDataset)
+      pVolumeDataset(_pVolumeDataset),
+      iCPUReserved(0)
     {
       qpUser.push_back(pUser);
     }
 
     Dataset*          pVolumeDataset;
     AbstrRendererList qpUser;
+    /// CPU memory handed to the data set's caches, charged to the memory
+    /// manager until the data set is freed
+    uint64_t          iCPUReserved;
+    /// converts bricks for upload ahead of time; only for data sets which
+    /// can be read from several threads.  Must go before the data set.
+    std::shared_ptr<BrickTranscoder> pTranscoder;
   };
   typedef std::deque<VolDataListElem> VolDataList;
   typedef VolDataList::iterator VolDataListIter;
@@ -165,11 +176,12 @@ namespace tuvok {
                  bool bDisableBorder, bool bEmulate3DWith2DStacks,
                  uint64_t iIntraFrameCounter, uint64_t iFrameCounter,
                  std::vector<unsigned char>& vUploadHub, int iShareGroupID);
-    bool BestMatch(const UINTVECTOR3& vDimension,
-                   bool bIsPaddedToPowerOfTwo, bool bIsDownsampledTo8Bits,
-                   bool bDisableBorder, bool bEmulate3DWith2DStacks,
-                   uint64_t& iIntraFrameCounter,
-                   uint64_t& iFrameCounter, int iShareGroupID) const;
+    /// @returns true if the texture is unused and could hold a brick of
+    /// the given size and format via Replace.
+    bool CanReplace(const UINTVECTOR3& vDimension,
+                    bool bIsPaddedToPowerOfTwo, bool bIsDownsampledTo8Bits,
+                    bool bDisableBorder, bool bEmulate3DWith2DStacks,
+                    int iShareGroupID) const;
     void GetCounters(uint64_t& iIntraFrameCounter,
                      uint64_t& iFrameCounter) const {
       iIntraFrameCounter = m_iIntraFrameCounter;
@@ -184,19 +196,24 @@ namespace tuvok {
 
     GLVolume* Access(uint64_t& iIntraFrameCounter, uint64_t& iFrameCounter);
 
+    /// Fetches the brick and converts it for upload if needed (see
+    /// TranscodeBrick).  A brick GPUMemMan prepared ahead of time is used as
+    /// it is; otherwise we convert into the upload hub if it is big enough.
     bool LoadData(std::vector<unsigned char>& vUploadHub);
     void FreeData();
-    std::pair<std::shared_ptr<unsigned char>, UINTVECTOR3> PadData(
-      unsigned char* pRawData,
-      UINTVECTOR3 vSize,
-      uint64_t iBitWidth,
-      uint64_t iCompCount
-    ) const;
     bool CreateTexture(std::vector<unsigned char>& vUploadHub,
                        bool bDeleteOldTexture=true);
     void FreeTexture();
 
-    std::vector<unsigned char>    vData;
+    /// how the data set stores its bricks and how we upload them.
+    static TranscodeFormat UploadFormat(const Dataset& ds,
+                                        bool bIsPaddedToPowerOfTwo,
+                                        bool bIsDownsampledTo8Bits,
+                                        bool bDisableBorder);
+
+    /// brick data shared with the dataset (e.g. its brick cache); used
+    /// instead of a converted copy when we upload the data unchanged.
+    std::shared_ptr<const BrickBuffer> m_pBrick;
     GLVolume*                     volume;
     Dataset*                      pDataset;
     uint32_t                      iUserCount;
@@ -205,9 +222,17 @@ namespace tuvok {
     uint64_t GetFrameCounter() const {return m_iFrameCounter;}
 
     int GetShareGroupID() const {return m_iShareGroupID;}
+    const BrickKey& GetKey() const {return m_Key;}
+    /// the key GPUMemMan finds this texture by; changes with Replace.
+    ResidencyKey GetResidencyKey() const;
   
   private:
     bool Match(const UINTVECTOR3& vDimension) const;
+    TranscodeFormat UploadFormat() const;
+    /// the currently loaded brick data, ready for upload, wherever it lives.
+    const unsigned char* UploadData(
+      const std::vector<unsigned char>& vUploadHub
+    ) const;
 
     uint64_t m_iIntraFrameCounter;
     uint64_t m_iFrameCounter;
@@ -218,6 +243,10 @@ namespace tuvok {
     bool m_bIsDownsampledTo8Bits;
     bool m_bDisableBorder;
     bool m_bEmulate3DWith2DStacks;
+    /// converted brick data, when the upload hub is too small
+    std::vector<unsigned char> m_vTranscoded;
+    /// converted brick data, as GPUMemMan's transcoder prepared it
+    std::shared_ptr<const TranscodedBrick> m_pPrepared;
     bool m_bUsingHub;
     int m_iShareGroupID;
   };
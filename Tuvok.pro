@@ -106,9 +106,11 @@ HEADERS += \
            Basics/LargeFileC.h \
            Basics/LargeFile.h \
            Basics/LargeRAWFile.h \
+           Basics/MemMappedFile.h \
            Basics/MathTools.h \
            Basics/MC.h \
            Basics/Mesh.h \
+           Basics/MeshTools.h \
            Basics/nonstd.h \
            Basics/PerfCounter.h \
            Basics/Plane.h \
@@ -164,13 +166,22 @@ HEADERS += \
            IO/AmiraConverter.h \
            IO/AnalyzeConverter.h \
            IO/BMinMax.h \
+           IO/MinMaxIndex.h \
+           IO/BrickTree.h \
+           IO/ExpressionEvaluator.h \
+           IO/DataMerger.h \
+           IO/IsosurfaceExtractor.h \
            IO/BOVConverter.h \
            IO/BrickCache.h \
+           IO/BrickPrefetcher.h \
+           IO/BrickBuffer.h \
            IO/BrickedDataset.h \
            IO/const-brick-iterator.h \
            IO/Dataset.h \
            IO/DICOM/DICOMParser.h \
            IO/DirectoryParser.h \
+           IO/StackSliceSource.h \
+           IO/DirectoryScanCache.h \
            IO/DSFactory.h \
            IO/DynamicBrickingDS.h \
            IO/FileBackedDataset.h \
@@ -217,6 +228,8 @@ HEADERS += \
            IO/UVF/ExtendedOctree/Lz4Compression.h \
            IO/UVF/ExtendedOctree/LzmaCompression.h \
            IO/UVF/ExtendedOctree/VolumeTools.h \
+           IO/UVF/ExtendedOctree/OctreeBuildSchedule.h \
+           IO/UVF/ExtendedOctree/OctreeSliceSource.h \
            IO/UVF/ExtendedOctree/ZlibCompression.h \
            IO/UVF/GeometryDataBlock.h \
            IO/UVF/GlobalHeader.h \
@@ -257,6 +270,9 @@ HEADERS += \
            LuaScripting/TuvokSpecific/LuaTuvokTypes.h \
            LuaScripting/TuvokSpecific/MatrixMath.h \
            Renderer/AbstrRenderer.h \
+           Renderer/CPU/CPURaycaster.h \
+           Renderer/CPU/RaycastKernel.h \
+           Renderer/BrickVisibility.h \
            Renderer/Context.h \
            Renderer/ContextIdentification.h \
            Renderer/CullingLOD.h \
@@ -288,6 +304,9 @@ HEADERS += \
            Renderer/GL/QtGLContext.h \
            Renderer/GL/RenderMeshGL.h \
            Renderer/GPUMemMan/GPUMemManDataStructs.h \
+           Renderer/GPUMemMan/BrickResidency.h \
+           Renderer/GPUMemMan/BrickTranscoder.h \
+           Renderer/GPUMemMan/BrickTranscode.h \
            Renderer/GPUMemMan/GPUMemMan.h \
            Renderer/GPUObject.h \
            Renderer/RenderMesh.h \
@@ -351,9 +370,11 @@ SOURCES += \
            Basics/LargeFileC.cpp \
            Basics/LargeFile.cpp \
            Basics/LargeRAWFile.cpp \
+           Basics/MemMappedFile.cpp \
            Basics/MathTools.cpp \
            Basics/MC.cpp \
            Basics/Mesh.cpp \
+           Basics/MeshTools.cpp \
            Basics/Plane.cpp \
            Basics/ProgressTimer.cpp \
            Basics/SystemInfo.cpp \
@@ -481,13 +502,21 @@ SOURCES += \
            IO/AmiraConverter.cpp \
            IO/AnalyzeConverter.cpp \
            IO/BMinMax.cpp \
+           IO/MinMaxIndex.cpp \
+           IO/BrickTree.cpp \
+           IO/ExpressionEvaluator.cpp \
+           IO/DataMerger.cpp \
+           IO/IsosurfaceExtractor.cpp \
            IO/BOVConverter.cpp \
            IO/BrickCache.cpp \
+           IO/BrickPrefetcher.cpp \
            IO/BrickedDataset.cpp \
            IO/const-brick-iterator.cpp \
            IO/Dataset.cpp \
            IO/DICOM/DICOMParser.cpp \
            IO/DirectoryParser.cpp \
+           IO/StackSliceSource.cpp \
+           IO/DirectoryScanCache.cpp \
            IO/DSFactory.cpp \
            IO/DynamicBrickingDS.cpp \
            IO/FileBackedDataset.cpp \
@@ -529,6 +558,9 @@ SOURCES += \
            IO/UVF/ExtendedOctree/Lz4Compression.cpp \
            IO/UVF/ExtendedOctree/LzmaCompression.cpp \
            IO/UVF/ExtendedOctree/VolumeTools.cpp \
+           IO/UVF/ExtendedOctree/OctreeBuildSchedule.cpp \
+           IO/UVF/ExtendedOctree/OctreeSliceSource.cpp \
+           IO/UVF/ExtendedOctree/VolumeToolsSIMD.cpp \
            IO/UVF/ExtendedOctree/ZlibCompression.cpp \
            IO/UVF/GeometryDataBlock.cpp \
            IO/UVF/GlobalHeader.cpp \
@@ -562,6 +594,9 @@ SOURCES += \
            LuaScripting/TuvokSpecific/LuaTuvokTypes.cpp \
            LuaScripting/TuvokSpecific/MatrixMath.cpp \
            Renderer/AbstrRenderer.cpp \
+           Renderer/CPU/CPURaycaster.cpp \
+           Renderer/CPU/RaycastKernel.cpp \
+           Renderer/BrickVisibility.cpp \
            Renderer/Context.cpp \
            Renderer/CullingLOD.cpp \
            Renderer/GL/GLCommon.cpp \
@@ -589,6 +624,9 @@ SOURCES += \
            Renderer/GL/RenderMeshGL.cpp \
            Renderer/GPUMemMan/GPUMemMan.cpp \
            Renderer/GPUMemMan/GPUMemManDataStructs.cpp \
+           Renderer/GPUMemMan/BrickResidency.cpp \
+           Renderer/GPUMemMan/BrickTranscoder.cpp \
+           Renderer/GPUMemMan/BrickTranscode.cpp \
            Renderer/RenderMesh.cpp \
            Renderer/RenderRegion.cpp \
            Renderer/SBVRGeogen2D.cpp \
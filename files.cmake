@@ -37,9 +37,11 @@ set( TUVOK_HEADERS  StdTuvokDefines.h
                     Basics/LargeFileC.h
                     Basics/LargeRAWFile.h
                     Basics/LargeFileMMap.h
+                    Basics/MemMappedFile.h
                     Basics/MathTools.h
                     Basics/MC.h
                     Basics/Mesh.h
+                    Basics/MeshTools.h
                     Basics/PerfCounter.h
                     Basics/Plane.h
                     Basics/ProgressTimer.h
@@ -101,13 +103,22 @@ set( TUVOK_HEADERS  StdTuvokDefines.h
                     IO/AmiraConverter.h
                     IO/AnalyzeConverter.h
                     IO/BMinMax.h
+                    IO/MinMaxIndex.h
+                    IO/BrickTree.h
+                    IO/ExpressionEvaluator.h
+                    IO/DataMerger.h
+                    IO/IsosurfaceExtractor.h
                     IO/BOVConverter.h
                     IO/Brick.h
                     IO/BrickedDataset.h
                     IO/BrickCache.h
+                    IO/BrickPrefetcher.h
+                    IO/BrickBuffer.h
                     IO/Dataset.h
                     IO/DICOM/DICOMParser.h
                     IO/DirectoryParser.h
+                    IO/StackSliceSource.h
+                    IO/DirectoryScanCache.h
                     IO/DSFactory.h
                     IO/DynamicBrickingDS.h
                     IO/FileBackedDataset.h
@@ -166,6 +177,8 @@ set( TUVOK_HEADERS  StdTuvokDefines.h
                     IO/UVF/ExtendedOctree/ExtendedOctree.h
                     IO/UVF/ExtendedOctree/ExtendedOctreeConverter.h
                     IO/UVF/ExtendedOctree/VolumeTools.h
+                    IO/UVF/ExtendedOctree/OctreeBuildSchedule.h
+                    IO/UVF/ExtendedOctree/OctreeSliceSource.h
                     IO/UVF/ExtendedOctree/Hilbert.h
                     IO/UVF/ExtendedOctree/ZlibCompression.h
                     IO/UVF/ExtendedOctree/LzmaCompression.h
@@ -197,6 +210,9 @@ set( TUVOK_HEADERS  StdTuvokDefines.h
                     LuaScripting/TuvokSpecific/LuaTuvokTypes.h
                     LuaScripting/TuvokSpecific/MatrixMath.h
                     Renderer/AbstrRenderer.h
+                    Renderer/CPU/CPURaycaster.h
+                    Renderer/CPU/RaycastKernel.h
+                    Renderer/BrickVisibility.h
                     Renderer/Context.h
                     Renderer/ContextIdentification.h
                     Renderer/CullingLOD.h
@@ -229,6 +245,9 @@ set( TUVOK_HEADERS  StdTuvokDefines.h
                     Renderer/GL/QtGLContext.h
                     Renderer/GL/RenderMeshGL.h
                     Renderer/GPUMemMan/GPUMemManDataStructs.h
+                    Renderer/GPUMemMan/BrickResidency.h
+                    Renderer/GPUMemMan/BrickTranscoder.h
+                    Renderer/GPUMemMan/BrickTranscode.h
                     Renderer/GPUMemMan/GPUMemMan.h
                     Renderer/GPUObject.h
                     Renderer/RenderMesh.h
@@ -285,6 +304,7 @@ set(TUVOK_SRCS 3rdParty/LUA/lapi.cpp
                Basics/LargeFile.cpp
                Basics/LargeFileC.cpp
                Basics/LargeFileMMap.cpp
+               Basics/MemMappedFile.cpp
                Basics/MathTools.cpp
                Basics/MC.cpp
                Basics/Plane.cpp
@@ -294,6 +314,7 @@ set(TUVOK_SRCS 3rdParty/LUA/lapi.cpp
                Basics/Clipper.cpp
                Basics/SysTools.cpp
                Basics/Mesh.cpp
+               Basics/MeshTools.cpp
                Basics/KDTree.cpp
                Basics/Threads.cpp
                Controller/MasterController.cpp
@@ -418,12 +439,20 @@ set(TUVOK_SRCS 3rdParty/LUA/lapi.cpp
                IO/AmiraConverter.cpp
                IO/AnalyzeConverter.cpp
                IO/BMinMax.cpp
+               IO/MinMaxIndex.cpp
+               IO/BrickTree.cpp
+               IO/ExpressionEvaluator.cpp
+               IO/DataMerger.cpp
+               IO/IsosurfaceExtractor.cpp
                IO/BOVConverter.cpp
                IO/BrickedDataset.cpp
                IO/BrickCache.cpp
+               IO/BrickPrefetcher.cpp
                IO/Dataset.cpp
                IO/DICOM/DICOMParser.cpp
                IO/DirectoryParser.cpp
+               IO/StackSliceSource.cpp
+               IO/DirectoryScanCache.cpp
                IO/DynamicBrickingDS.cpp
                IO/DSFactory.cpp
                IO/FileBackedDataset.cpp
@@ -476,6 +505,9 @@ set(TUVOK_SRCS 3rdParty/LUA/lapi.cpp
                IO/UVF/ExtendedOctree/ExtendedOctree.cpp
                IO/UVF/ExtendedOctree/ExtendedOctreeConverter.cpp
                IO/UVF/ExtendedOctree/VolumeTools.cpp
+               IO/UVF/ExtendedOctree/OctreeBuildSchedule.cpp
+               IO/UVF/ExtendedOctree/OctreeSliceSource.cpp
+               IO/UVF/ExtendedOctree/VolumeToolsSIMD.cpp
                IO/UVF/ExtendedOctree/ZlibCompression.cpp
                IO/UVF/ExtendedOctree/LzmaCompression.cpp
                IO/UVF/ExtendedOctree/Lz4Compression.cpp
@@ -500,6 +532,9 @@ set(TUVOK_SRCS 3rdParty/LUA/lapi.cpp
                LuaScripting/TuvokSpecific/LuaTuvokTypes.cpp
                LuaScripting/TuvokSpecific/MatrixMath.cpp
                Renderer/AbstrRenderer.cpp
+               Renderer/CPU/CPURaycaster.cpp
+               Renderer/CPU/RaycastKernel.cpp
+               Renderer/BrickVisibility.cpp
                Renderer/Context.cpp
                Renderer/CullingLOD.cpp
                Renderer/GL/GLCommon.cpp
@@ -528,6 +563,9 @@ set(TUVOK_SRCS 3rdParty/LUA/lapi.cpp
                Renderer/GL/RenderMeshGL.cpp
                Renderer/GPUMemMan/GPUMemMan.cpp
                Renderer/GPUMemMan/GPUMemManDataStructs.cpp
+               Renderer/GPUMemMan/BrickResidency.cpp
+               Renderer/GPUMemMan/BrickTranscoder.cpp
+               Renderer/GPUMemMan/BrickTranscode.cpp
                Renderer/RenderMesh.cpp
                Renderer/RenderRegion.cpp
                Renderer/SBVRGeogen2D.cpp